@@ -1,15 +1,181 @@
 #include <benchmark/benchmark.h>
+#include <datadog/base64.h>
+#include <datadog/batch_sampling.h>
+#include <datadog/clock.h>
 #include <datadog/collector.h>
+#include <datadog/compiled_span_matcher.h>
+#include <datadog/curl.h>
+#include <datadog/ddsketch.h>
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <datadog/event_scheduler.h>
+#include <datadog/glob.h>
+#include <datadog/gzip.h>
+#include <datadog/header_map.h>
+#include <datadog/http_client.h>
+#include <datadog/id_generator.h>
+#include <datadog/limiter.h>
 #include <datadog/logger.h>
+#include <datadog/msgpack.h>
+#include <datadog/parse_util.h>
+#include <datadog/sampling_decision.h>
+#include <datadog/sampling_util.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
 #include <datadog/span_data.h>
+#include <datadog/span_matcher.h>
+#include <datadog/span_sampler_config.h>
+#include <datadog/telemetry/metrics.h>
+#include <datadog/trace_sampler.h>
+#include <datadog/trace_sampler_config.h>
+#include <datadog/trace_context.h>
 #include <datadog/tracer.h>
+#include <datadog/tracer_telemetry.h>
+#include <datadog/w3c_propagation.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <malloc.h>
 #include <memory>
+#include <new>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "hasher.h"
 
 namespace {
 
+// `Allocations` counts calls to `operator new`, and the bytes that they
+// request.
+struct Allocations {
+  std::size_t count = 0;
+  std::size_t bytes = 0;
+};
+
+// `allocated` is what the current thread has allocated, so that benchmarks
+// can report how many allocations, and how many bytes, an operation costs.
+// See `AllocationCounter`.
+thread_local Allocations allocated;
+
+// `live_bytes` is the size of the heap blocks allocated by the current thread
+// minus those that it has freed, so that benchmarks can report how much
+// memory is held by what they build.  Blocks are measured using
+// `malloc_usable_size`, so the allocator's rounding is included.
+thread_local std::ptrdiff_t live_bytes = 0;
+
+void* allocated_block(void* memory) {
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  live_bytes += std::ptrdiff_t(malloc_usable_size(memory));
+  return memory;
+}
+
+void deallocate(void* memory) noexcept {
+  if (memory) {
+    live_bytes -= std::ptrdiff_t(malloc_usable_size(memory));
+    std::free(memory);
+  }
+}
+
+void* allocate(std::size_t size) {
+  ++allocated.count;
+  allocated.bytes += size;
+  return allocated_block(std::malloc(size == 0 ? 1 : size));
+}
+
+void* allocate(std::size_t size, std::align_val_t alignment) {
+  ++allocated.count;
+  allocated.bytes += size;
+  // `aligned_alloc` requires a size that is a multiple of the alignment.
+  const auto align = static_cast<std::size_t>(alignment);
+  const std::size_t padded = (size + align - 1) / align * align;
+  return allocated_block(
+      std::aligned_alloc(align, padded == 0 ? align : padded));
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return allocate(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept { deallocate(memory); }
+void operator delete(void* memory, std::size_t) noexcept {
+  deallocate(memory);
+}
+void operator delete[](void* memory) noexcept { deallocate(memory); }
+void operator delete[](void* memory, std::size_t) noexcept {
+  deallocate(memory);
+}
+void operator delete(void* memory, std::align_val_t) noexcept {
+  deallocate(memory);
+}
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+  deallocate(memory);
+}
+void operator delete[](void* memory, std::align_val_t) noexcept {
+  deallocate(memory);
+}
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+  deallocate(memory);
+}
+
+namespace {
+
+// `AllocationCounter` accumulates what the current thread allocates between
+// each call to `start` and the following call to `stop`.  `report` then sets
+// the counters "allocs_per_<unit>" and "bytes_per_<unit>" of a benchmark to
+// the averages per operation, e.g.
+//
+//     AllocationCounter counter;
+//     for (auto _ : state) {
+//       counter.start();
+//       span.inject(writer);
+//       counter.stop();
+//     }
+//     counter.report(state, "inject", state.iterations());
+class AllocationCounter {
+  Allocations total_;
+  Allocations started_;
+
+ public:
+  void start() { started_ = allocated; }
+
+  void stop() {
+    total_.count += allocated.count - started_.count;
+    total_.bytes += allocated.bytes - started_.bytes;
+  }
+
+  void report(benchmark::State& state, const std::string& unit,
+              double operations) const {
+    if (operations == 0) {
+      return;
+    }
+    state.counters["allocs_per_" + unit] = double(total_.count) / operations;
+    state.counters["bytes_per_" + unit] = double(total_.bytes) / operations;
+  }
+};
+
 namespace dd = datadog::tracing;
 
 // `NullLogger` doesn't log. It avoids `log_startup` spam in the benchmark.
@@ -26,9 +192,16 @@ struct NullLogger : public dd::Logger {
 struct SerializingCollector : public dd::Collector {
   dd::Expected<void> send(
       std::vector<std::unique_ptr<dd::SpanData>>&& spans,
+      const std::shared_ptr<dd::TraceSampler>& response_handler) override {
+    return send(std::move(spans), dd::ChunkTags{}, response_handler);
+  }
+
+  dd::Expected<void> send(
+      std::vector<std::unique_ptr<dd::SpanData>>&& spans,
+      const dd::ChunkTags& chunk_tags,
       const std::shared_ptr<dd::TraceSampler>& /*response_handler*/) override {
     std::string buffer;
-    return dd::msgpack_encode(buffer, spans);
+    return dd::msgpack_encode(buffer, spans, chunk_tags);
   }
 
   std::string config() const override {
@@ -36,6 +209,27 @@ struct SerializingCollector : public dd::Collector {
   }
 };
 
+// `DiscardingCollector` discards the spans sent to it.  Unlike with
+// `NullCollector`, a tracer records the spans that it sends to this collector,
+// so it's used by benchmarks that measure the cost of recording spans.
+struct DiscardingCollector : public dd::Collector {
+  dd::Expected<void> send(
+      std::vector<std::unique_ptr<dd::SpanData>>&&,
+      const std::shared_ptr<dd::TraceSampler>&) override {
+    return {};
+  }
+
+  dd::Expected<void> send(
+      std::vector<std::unique_ptr<dd::SpanData>>&&, const dd::ChunkTags&,
+      const std::shared_ptr<dd::TraceSampler>&) override {
+    return {};
+  }
+
+  std::string config() const override {
+    return R"({"type": "DiscardingCollector"})";
+  }
+};
+
 // The benchmark `BM_TraceTinyCCSource`, for each iteration over `state`,
 // creates a trace whose shape is the same as the file system tree under
 // `./tinycc`. It's similar to what is done in `../example`.
@@ -53,6 +247,1814 @@ void BM_TraceTinyCCSource(benchmark::State& state) {
 }
 BENCHMARK(BM_TraceTinyCCSource);
 
+// `make_spans` returns the specified `count` of spans, each having a handful of
+// tags and metrics, as a stand-in for a large trace chunk.
+std::vector<std::unique_ptr<dd::SpanData>> make_spans(std::size_t count) {
+  std::vector<std::unique_ptr<dd::SpanData>> spans;
+  for (std::size_t i = 0; i < count; ++i) {
+    auto span = std::make_unique<dd::SpanData>();
+    span->service = "benchmark";
+    span->service_type = "web";
+    span->name = "do.thing";
+    span->resource = "GET /api/v1/thing/" + std::to_string(i);
+    span->span_id = i + 1;
+    span->parent_id = i;
+    span->tags.emplace("http.method", "GET");
+    span->tags.emplace("http.url", "https://example.com/api/v1/thing");
+    span->tags.emplace("component", "benchmark");
+    span->numeric_tags.emplace("http.status_code", 200);
+    spans.push_back(std::move(span));
+  }
+  return spans;
+}
+
+// The benchmark `BM_MsgpackEncodeSpans` encodes a chunk of `state.range(0)`
+// spans, one span at a time, into a buffer that either is reserved up front
+// (`state.range(1) == 1`) or grows as needed (`state.range(1) == 0`). It
+// reports the number of bytes copied by buffer reallocations per encoded span.
+void BM_MsgpackEncodeSpans(benchmark::State& state) {
+  const auto spans = make_spans(state.range(0));
+  const bool reserve = state.range(1);
+  std::size_t bytes_copied = 0;
+  std::size_t bytes_encoded = 0;
+  for (auto _ : state) {
+    std::string buffer;
+    if (reserve) {
+      buffer.reserve(dd::msgpack_encoded_size_bound(spans, dd::ChunkTags{}));
+    }
+    for (const auto& span : spans) {
+      const auto capacity = buffer.capacity();
+      const auto size = buffer.size();
+      (void)dd::msgpack_encode(buffer, *span, dd::ChunkTags{});
+      if (buffer.capacity() != capacity) {
+        bytes_copied += size;
+      }
+    }
+    bytes_encoded += buffer.size();
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  const double spans_encoded = double(state.iterations()) * spans.size();
+  state.counters["bytes_copied_per_span"] = bytes_copied / spans_encoded;
+  state.counters["bytes_per_span"] = bytes_encoded / spans_encoded;
+}
+BENCHMARK(BM_MsgpackEncodeSpans)
+    ->ArgsProduct({{100, 10000}, {0, 1}})
+    ->ArgNames({"spans", "reserve"});
+
+// The benchmark `BM_ScanSpanScalars` reads the IDs, duration, and error flag
+// of `state.range(0)` spans, as the loops over a trace segment's spans do,
+// visiting the spans in allocation order or, when `state.range(1)` is nonzero,
+// in a shuffled order that defeats prefetching.  It is sensitive to the
+// layout of `SpanData`.  In a build with `DD_TRACE_BENCHMARK_PERF_COUNTERS`,
+// it reports cache misses per span, among the other hardware counters.
+void BM_ScanSpanScalars(benchmark::State& state) {
+  auto spans = make_spans(state.range(0));
+  if (state.range(1)) {
+    std::shuffle(spans.begin(), spans.end(), std::mt19937_64(42));
+  }
+  for (auto _ : state) {
+    std::uint64_t sum = 0;
+    for (const auto& span : spans) {
+      sum += span->span_id + span->parent_id + span->trace_id.low +
+             span->duration.count() + span->error;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * spans.size());
+}
+BENCHMARK(BM_ScanSpanScalars)
+    ->ArgsProduct({{100000}, {0, 1}})
+    ->ArgNames({"spans", "shuffled"});
+
+// `HeaderReader` is a `DictReader` over a list of request headers.
+struct HeaderReader : public dd::DictReader {
+  std::vector<std::pair<std::string, std::string>> headers;
+
+  dd::Optional<dd::StringView> lookup(dd::StringView key) const override {
+    for (const auto& [name, value] : headers) {
+      if (name == key) {
+        return dd::StringView(value);
+      }
+    }
+    return dd::nullopt;
+  }
+
+  void visit(Visitor visitor) const override {
+    for (const auto& [name, value] : headers) {
+      visitor(name, value);
+    }
+  }
+};
+
+// `NullHTTPClient` discards requests. It lets `BM_DatadogAgentSend` measure
+// `DatadogAgent` without any network I/O.
+struct NullHTTPClient : public dd::HTTPClient {
+  dd::Expected<void> post(
+      const URL&, HeadersSetter, std::string, ResponseHandler, ErrorHandler,
+      std::chrono::steady_clock::time_point /*deadline*/) override {
+    return {};
+  }
+
+  void drain(std::chrono::steady_clock::time_point /*deadline*/) override {}
+
+  std::string config() const override {
+    return R"({"type": "NullHTTPClient"})";
+  }
+};
+
+// `agent_tracer` is shared by all of the threads of `BM_DatadogAgentSend`.
+std::unique_ptr<dd::Tracer> agent_tracer;
+
+// The benchmark `BM_DatadogAgentSend` has each of `state.threads()` threads
+// create two-span traces using one `Tracer` whose collector is `DatadogAgent`.
+// It tracks contention among threads finishing traces at the same time.
+void BM_DatadogAgentSend(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    dd::TracerConfig config;
+    config.service = "benchmark";
+    config.logger = std::make_shared<NullLogger>();
+    config.agent.http_client = std::make_shared<NullHTTPClient>();
+    config.agent.remote_configuration_enabled = false;
+    config.telemetry.enabled = false;
+    const auto valid_config = dd::finalize_config(config);
+    agent_tracer = std::make_unique<dd::Tracer>(*valid_config);
+  }
+  for (auto _ : state) {
+    auto root = agent_tracer->create_span();
+    auto child = root.create_child();
+    (void)child;
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    agent_tracer.reset();
+  }
+}
+BENCHMARK(BM_DatadogAgentSend)->ThreadRange(1, 8)->UseRealTime();
+
+// `shared_tracer` is shared by all of the threads of `BM_SharedTracer` and of
+// `BM_SharedSegmentChildren`.
+std::unique_ptr<dd::Tracer> shared_tracer;
+
+// The benchmark `BM_SharedTracer` has each of `state.threads()` threads
+// extract a trace from request headers and finish it with a child span, using
+// one `Tracer` configured as in production: sampling rules, span sampling
+// rules, telemetry, and a `DatadogAgent` collector.  So each trace passes
+// through the configuration manager, the trace sampler and its limiter, the
+// telemetry metrics, and the agent's buffer, all shared among threads.
+void BM_SharedTracer(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    dd::TracerConfig config;
+    config.service = "benchmark";
+    config.logger = std::make_shared<NullLogger>();
+    config.agent.http_client = std::make_shared<NullHTTPClient>();
+    config.agent.remote_configuration_enabled = false;
+    dd::TraceSamplerConfig::Rule rule;
+    rule.service = "benchmark";
+    rule.resource = "GET /api/*";
+    rule.sample_rate = 1.0;
+    config.trace_sampler.rules.push_back(rule);
+    config.trace_sampler.max_per_second = 1e9;
+    dd::SpanSamplerConfig::Rule span_rule;
+    span_rule.name = "db.query";
+    config.span_sampler.rules.push_back(span_rule);
+    const auto valid_config = dd::finalize_config(config);
+    shared_tracer = std::make_unique<dd::Tracer>(*valid_config);
+  }
+  HeaderReader reader;
+  reader.headers = {{"x-datadog-trace-id", "5208512171318403364"},
+                    {"x-datadog-parent-id", "6433872893834271671"}};
+  for (auto _ : state) {
+    auto root = shared_tracer->extract_or_create_span(reader);
+    root.set_resource_name("GET /api/orders");
+    auto child = root.create_child();
+    child.set_name("db.query");
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    shared_tracer.reset();
+  }
+}
+BENCHMARK(BM_SharedTracer)->ThreadRange(1, 8)->UseRealTime();
+
+// `shared_root` is the span whose trace segment is shared by all of the
+// threads of `BM_SharedSegmentChildren`.
+dd::Optional<dd::Span> shared_root;
+
+// The benchmark `BM_SharedSegmentChildren` has each of `state.threads()`
+// threads create and finish child spans of one root span, as a server that
+// fans out a request to a thread pool does.  It tracks contention for the
+// trace segment.  A finished child is kept until the whole trace finishes, so
+// the number of iterations is fixed to bound memory use.
+void BM_SharedSegmentChildren(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    dd::TracerConfig config;
+    config.service = "benchmark";
+    config.logger = std::make_shared<NullLogger>();
+    config.collector = std::make_shared<DiscardingCollector>();
+    const auto valid_config = dd::finalize_config(config);
+    shared_tracer = std::make_unique<dd::Tracer>(*valid_config);
+    shared_root.emplace(shared_tracer->create_span());
+  }
+  for (auto _ : state) {
+    auto child = shared_root->create_child();
+    child.set_tag("worker", "1");
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    shared_root.reset();
+    shared_tracer.reset();
+  }
+}
+BENCHMARK(BM_SharedSegmentChildren)
+    ->ThreadRange(1, 8)
+    ->Iterations(20000)
+    ->UseRealTime();
+
+// The benchmark `BM_TracerStartup` finalizes a configuration and creates and
+// destroys a `Tracer` that sends to the Datadog Agent using the default HTTP
+// client and event scheduler, as a short-lived process that never creates a
+// span does.  `state.range(0)` is whether `DatadogAgentConfig::lazy_start` is
+// enabled.
+void BM_TracerStartup(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.telemetry.enabled = false;
+  config.agent.lazy_start = state.range(0) != 0;
+  for (auto _ : state) {
+    const auto valid_config = dd::finalize_config(config);
+    dd::Tracer tracer{*valid_config};
+    benchmark::DoNotOptimize(&tracer);
+  }
+}
+BENCHMARK(BM_TracerStartup)->Arg(0)->Arg(1)->ArgName("lazy")->UseRealTime();
+
+// `ManualEventScheduler` never runs its events.  It keeps the first recurring
+// event, which for `DatadogAgent` is the flush, so that a benchmark can flush
+// when it chooses.
+struct ManualEventScheduler : public dd::EventScheduler {
+  std::function<void()> flush;
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration,
+                                  std::function<void()> callback) override {
+    if (!flush) {
+      flush = std::move(callback);
+    }
+    return []() {};
+  }
+
+  std::string config() const override {
+    return R"({"type": "ManualEventScheduler"})";
+  }
+};
+
+// `EmptyHeaders` is a `DictReader` without any entries.
+struct EmptyHeaders : public dd::DictReader {
+  dd::Optional<dd::StringView> lookup(dd::StringView) const override {
+    return dd::nullopt;
+  }
+  void visit(Visitor) const override {}
+};
+
+// `NullDictWriter` discards what is written to it.  It overrides
+// `DictWriter::set_all`, as a writer that batches headers would.
+struct NullDictWriter : public dd::DictWriter {
+  void set(dd::StringView key, dd::StringView value) override {
+    benchmark::DoNotOptimize(key);
+    benchmark::DoNotOptimize(value);
+  }
+  void set_all(const Entry* entries, std::size_t count) override {
+    benchmark::DoNotOptimize(entries);
+    benchmark::DoNotOptimize(count);
+  }
+};
+
+// `RespondingHTTPClient` completes each request immediately with an empty
+// successful response, so that `DatadogAgent` never waits for requests in
+// flight.
+struct RespondingHTTPClient : public dd::HTTPClient {
+  dd::Expected<void> post(
+      const URL&, HeadersSetter, std::string, ResponseHandler on_response,
+      ErrorHandler, std::chrono::steady_clock::time_point) override {
+    on_response(200, EmptyHeaders{}, "{}");
+    return {};
+  }
+
+  void drain(std::chrono::steady_clock::time_point) override {}
+
+  std::string config() const override {
+    return R"({"type": "RespondingHTTPClient"})";
+  }
+};
+
+// The benchmark `BM_DatadogAgentFlush` has `DatadogAgent` flush
+// `state.range(0)` buffered two-span traces: encoding them as a request body,
+// handing the request to the HTTP client, and handling the response.  Only
+// the flush is timed.
+void BM_DatadogAgentFlush(benchmark::State& state) {
+  const auto scheduler = std::make_shared<ManualEventScheduler>();
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.agent.http_client = std::make_shared<RespondingHTTPClient>();
+  config.agent.event_scheduler = scheduler;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (std::int64_t i = 0; i < state.range(0); ++i) {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      (void)child;
+    }
+    state.ResumeTiming();
+    allocations.start();
+    scheduler->flush();
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  allocations.report(state, "flush", state.iterations());
+}
+BENCHMARK(BM_DatadogAgentFlush)->Arg(10)->Arg(1000)->ArgName("traces");
+
+// The benchmark `BM_TraceFootprint` measures the heap memory held per trace
+// and per span while traces are in flight.  Each iteration builds 1000
+// traces of a root span and four children, each span having `state.range(0)`
+// tags besides those that the tracer sets.  When `state.range(1)` is zero,
+// the traces are kept open, as the requests of a busy server are.
+// Otherwise, the traces are finished, and so they are buffered by
+// `DatadogAgent` until its next flush.  It reports the live bytes per trace
+// and per span, at the point where all of the traces are open or buffered.
+void BM_TraceFootprint(benchmark::State& state) {
+  const auto num_tags = std::size_t(state.range(0));
+  const bool buffered = state.range(1) != 0;
+  const std::size_t num_traces = 1000;
+  const std::size_t spans_per_trace = 5;
+  const auto scheduler = std::make_shared<ManualEventScheduler>();
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.agent.http_client = std::make_shared<RespondingHTTPClient>();
+  config.agent.event_scheduler = scheduler;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  const auto valid_config = dd::finalize_config(config);
+  std::vector<std::string> tag_names;
+  for (std::size_t i = 0; i < num_tags; ++i) {
+    tag_names.push_back("benchmark.tag." + std::to_string(i));
+  }
+  const std::string tag_value = "a typical tag value";
+
+  std::ptrdiff_t total_bytes = 0;
+  std::vector<dd::Span> spans;
+  spans.reserve(num_traces * spans_per_trace);
+  for (auto _ : state) {
+    // Each iteration uses a new tracer, so that the collector's buffers
+    // start empty, rather than with the capacity of a previous iteration.
+    state.PauseTiming();
+    scheduler->flush = nullptr;
+    auto tracer = std::make_unique<dd::Tracer>(*valid_config);
+    state.ResumeTiming();
+    const std::ptrdiff_t before = live_bytes;
+    for (std::size_t i = 0; i < num_traces; ++i) {
+      spans.push_back(tracer->create_span());
+      dd::Span& root = spans.back();
+      for (std::size_t j = 1; j < spans_per_trace; ++j) {
+        spans.push_back(root.create_child());
+      }
+    }
+    for (dd::Span& span : spans) {
+      span.set_resource_name("GET /api/v2/orders");
+      for (const std::string& name : tag_names) {
+        span.set_tag(name, tag_value);
+      }
+    }
+    if (buffered) {
+      // Finish the children before their roots.
+      for (auto span = spans.rbegin(); span != spans.rend(); ++span) {
+        dd::Span finished = std::move(*span);
+      }
+      // `spans` keeps its capacity, which was reserved before `before`.
+      spans.clear();
+    }
+    total_bytes += live_bytes - before;
+    state.PauseTiming();
+    spans.clear();
+    scheduler->flush();
+    tracer.reset();
+    state.ResumeTiming();
+  }
+  const double iterations = double(state.iterations());
+  state.counters["bytes_per_trace"] = total_bytes / iterations / num_traces;
+  state.counters["bytes_per_span"] =
+      total_bytes / iterations / (num_traces * spans_per_trace);
+}
+BENCHMARK(BM_TraceFootprint)
+    ->ArgsProduct({{0, 8, 32}, {0, 1}})
+    ->ArgNames({"tags", "buffered"})
+    ->Iterations(20);
+
+// `SimulatedTime` is a clock that advances only when told to, so that a
+// benchmark can simulate seconds of a tracer's operation without waiting.
+struct SimulatedTime {
+  dd::TimePoint now = dd::default_clock();
+
+  dd::Clock clock() {
+    return [this]() { return now; };
+  }
+};
+
+// `SimulatedAgent` is an `HTTPClient` that behaves like a Datadog Agent at
+// the other end of a network, in simulated time.  Each request takes the
+// time to transfer its body over a link of limited bandwidth, on which
+// requests queue behind one another, plus a latency drawn from a log-normal
+// distribution.  A fraction of requests fail with a network error, and
+// another fraction are answered with status 429.  Other requests are
+// answered with sample rates by service, as the Datadog Agent does.  A
+// request that would complete after its deadline fails at the deadline
+// instead.  Requests complete only during `advance` and `drain`.
+class SimulatedAgent : public dd::HTTPClient {
+ public:
+  struct Conditions {
+    std::chrono::microseconds median_latency{500};
+    // The standard deviation of the natural logarithm of the latency.
+    double latency_spread = 0.25;
+    double error_rate = 0;
+    double throttle_rate = 0;
+    // Zero means that bandwidth is unlimited.
+    std::size_t bytes_per_second = 0;
+  };
+
+  std::size_t requests = 0;
+  std::size_t failures = 0;
+  std::size_t bytes_received = 0;
+
+ private:
+  struct Request {
+    std::chrono::steady_clock::time_point due;
+    // Whether the request fails, and if not, the response status.
+    bool fails;
+    int status;
+    SharedBody body;
+    ResponseHandler on_response;
+    ErrorHandler on_error;
+  };
+
+  SimulatedTime& time_;
+  const Conditions conditions_;
+  std::mt19937_64 random_{42};
+  std::lognormal_distribution<double> latency_;
+  std::uniform_real_distribution<double> outcome_{0, 1};
+  // When the link will have transferred the requests sent so far.
+  std::chrono::steady_clock::time_point link_free_;
+  std::vector<Request> in_flight_;
+
+  // Complete, in order, the requests that are due by the specified `now`.
+  void complete(std::chrono::steady_clock::time_point now) {
+    std::vector<Request> done;
+    auto due = [now](const Request& request) { return request.due <= now; };
+    auto split = std::stable_partition(in_flight_.begin(), in_flight_.end(),
+                                       [&](const Request& request) {
+                                         return !due(request);
+                                       });
+    std::move(split, in_flight_.end(), std::back_inserter(done));
+    in_flight_.erase(split, in_flight_.end());
+    std::sort(done.begin(), done.end(),
+              [](const Request& left, const Request& right) {
+                return left.due < right.due;
+              });
+    for (Request& request : done) {
+      if (request.fails) {
+        ++failures;
+        request.on_error(dd::Error{dd::Error::CURL_REQUEST_FAILURE,
+                                   "simulated network error"});
+      } else {
+        request.on_response(
+            request.status, EmptyHeaders{},
+            request.status == 200
+                ? R"({"rate_by_service":{"service:,env:":1.0,)"
+                  R"("service:benchmark,env:":0.5}})"
+                : "");
+      }
+    }
+  }
+
+ public:
+  SimulatedAgent(SimulatedTime& time, const Conditions& conditions)
+      : time_(time),
+        conditions_(conditions),
+        latency_(std::log(double(conditions.median_latency.count())),
+                 conditions.latency_spread),
+        link_free_(time.now.tick) {}
+
+  // Advance simulated time by the specified `duration` in steps of the
+  // specified `step`, completing requests as they become due.
+  void advance(std::chrono::steady_clock::duration duration,
+               std::chrono::steady_clock::duration step) {
+    for (auto elapsed = step; elapsed <= duration; elapsed += step) {
+      time_.now += step;
+      complete(time_.now.tick);
+    }
+  }
+
+  std::size_t num_in_flight() const { return in_flight_.size(); }
+
+  dd::Expected<void> post(
+      const URL& url, HeadersSetter set_headers, std::string body,
+      ResponseHandler on_response, ErrorHandler on_error,
+      std::chrono::steady_clock::time_point deadline) override {
+    auto buffer = std::make_shared<const std::string>(std::move(body));
+    return post(url, set_headers, SharedBody(std::move(buffer)),
+                std::move(on_response), std::move(on_error), deadline);
+  }
+
+  dd::Expected<void> post(
+      const URL&, HeadersSetter set_headers, SharedBody body,
+      ResponseHandler on_response, ErrorHandler on_error,
+      std::chrono::steady_clock::time_point deadline) override {
+    NullDictWriter headers;
+    set_headers(headers);
+    ++requests;
+    bytes_received += body.data.size();
+    const auto now = time_.now.tick;
+    auto transferred = std::max(link_free_, now);
+    if (conditions_.bytes_per_second) {
+      transferred += std::chrono::microseconds(
+          body.data.size() * 1000000 / conditions_.bytes_per_second);
+    }
+    link_free_ = transferred;
+    Request request;
+    request.due = transferred + std::chrono::microseconds(
+                                    std::int64_t(latency_(random_)));
+    const double outcome = outcome_(random_);
+    request.fails = outcome < conditions_.error_rate;
+    request.status =
+        outcome < conditions_.error_rate + conditions_.throttle_rate ? 429
+                                                                     : 200;
+    if (request.due > deadline) {
+      request.due = deadline;
+      request.fails = true;
+    }
+    request.body = std::move(body);
+    request.on_response = std::move(on_response);
+    request.on_error = std::move(on_error);
+    in_flight_.push_back(std::move(request));
+    return {};
+  }
+
+  void drain(std::chrono::steady_clock::time_point deadline) override {
+    complete(deadline);
+  }
+
+  std::string config() const override {
+    return R"({"type": "SimulatedAgent"})";
+  }
+};
+
+// The conditions of the Datadog Agent simulated by `BM_FlushToSimulatedAgent`,
+// indexed by `state.range(0)`: a healthy local agent, a slow one, a flaky
+// one, and one behind a slow link.
+SimulatedAgent::Conditions simulated_agent_conditions(std::int64_t index) {
+  SimulatedAgent::Conditions conditions;
+  switch (index) {
+    case 1:
+      conditions.median_latency = std::chrono::milliseconds(800);
+      conditions.latency_spread = 0.75;
+      break;
+    case 2:
+      conditions.median_latency = std::chrono::milliseconds(5);
+      conditions.error_rate = 0.2;
+      conditions.throttle_rate = 0.1;
+      break;
+    case 3:
+      conditions.median_latency = std::chrono::milliseconds(2);
+      conditions.bytes_per_second = 256 * 1024;
+      break;
+  }
+  return conditions;
+}
+
+// The benchmark `BM_FlushToSimulatedAgent` runs a tracer against a
+// `SimulatedAgent` in the conditions selected by `state.range(0)` (healthy,
+// slow, flaky, or bandwidth-limited).  Each iteration is one flush interval
+// of simulated time: 2000 two-span traces are finished, requests complete as
+// time passes, and then the flush happens.  Only the flush is timed.  It
+// reports the requests sent and failed, and the bytes sent, per flush, the
+// requests in flight after a flush, and the most heap memory held by the
+// tracer after a flush, including buffered chunks, retries, and requests in
+// flight, which shows whether the buffers grow without bound.
+void BM_FlushToSimulatedAgent(benchmark::State& state) {
+  SimulatedTime time;
+  const auto scheduler = std::make_shared<ManualEventScheduler>();
+  const auto agent = std::make_shared<SimulatedAgent>(
+      time, simulated_agent_conditions(state.range(0)));
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.agent.http_client = agent;
+  config.agent.event_scheduler = scheduler;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.flush_interval_milliseconds = 1000;
+  config.telemetry.enabled = false;
+  const auto valid_config = dd::finalize_config(config, time.clock());
+  const std::ptrdiff_t baseline = live_bytes;
+  auto tracer = std::make_unique<dd::Tracer>(*valid_config);
+  const auto interval = std::chrono::milliseconds(1000);
+  const std::size_t traces_per_interval = 2000;
+
+  std::ptrdiff_t max_held_bytes = 0;
+  std::size_t total_in_flight = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (std::size_t i = 0; i < traces_per_interval; ++i) {
+      auto root = tracer->create_span();
+      root.set_resource_name("GET /api/v2/orders");
+      auto child = root.create_child();
+      child.set_tag("db.statement", "SELECT * FROM orders WHERE id = ?");
+    }
+    agent->advance(interval, std::chrono::milliseconds(10));
+    state.ResumeTiming();
+    scheduler->flush();
+    state.PauseTiming();
+    max_held_bytes = std::max(max_held_bytes, live_bytes - baseline);
+    total_in_flight += agent->num_in_flight();
+    state.ResumeTiming();
+  }
+  const double iterations = double(state.iterations());
+  state.counters["requests_per_flush"] = agent->requests / iterations;
+  state.counters["failures_per_flush"] = agent->failures / iterations;
+  state.counters["in_flight_after_flush"] = total_in_flight / iterations;
+  state.counters["max_held_bytes"] = double(max_held_bytes);
+  state.counters["bytes_sent_per_flush"] = agent->bytes_received / iterations;
+  tracer.reset();
+}
+BENCHMARK(BM_FlushToSimulatedAgent)
+    ->DenseRange(0, 3)
+    ->ArgName("agent")
+    ->Iterations(60);
+
+// The benchmark `BM_GzipCompressChunk` gzip compresses the MessagePack encoding
+// of a chunk of `state.range(0)` spans, as `DatadogAgent` does for requests
+// when compression is enabled.  It reports the compressed size relative to the
+// encoded size, and the bytes saved per second of compression, so that the CPU
+// cost can be weighed against the bandwidth saved.
+void BM_GzipCompressChunk(benchmark::State& state) {
+  if (!dd::gzip_available()) {
+    state.SkipWithError("This library was built without zlib.");
+    return;
+  }
+  const auto spans = make_spans(state.range(0));
+  std::string encoded;
+  (void)dd::msgpack_encode(encoded, spans, dd::ChunkTags{});
+  std::size_t compressed_size = 0;
+  for (auto _ : state) {
+    std::string compressed;
+    (void)dd::gzip_compress(compressed, encoded);
+    compressed_size = compressed.size();
+    benchmark::DoNotOptimize(compressed.data());
+  }
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+  state.counters["compression_ratio"] = double(compressed_size) / encoded.size();
+  state.counters["bytes_saved_per_second"] = benchmark::Counter(
+      double(state.iterations()) * (encoded.size() - compressed_size),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_GzipCompressChunk)->Arg(100)->Arg(10000)->ArgName("spans");
+
+// The benchmark `BM_DefaultSpanID` generates span IDs using the default
+// `IDGenerator`, as the tracer does once for every span.  Run with multiple
+// threads, it reports the rate of IDs generated per thread.
+void BM_DefaultSpanID(benchmark::State& state) {
+  const auto generator = dd::default_id_generator(false);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(generator->span_id());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DefaultSpanID)->ThreadRange(1, 8);
+
+// The benchmark `BM_DefaultTraceID` generates trace IDs using the default
+// `IDGenerator`, as the tracer does once for every new trace, in 64-bit mode
+// or, when `state.range(0)` is nonzero, in 128-bit mode.
+void BM_DefaultTraceID(benchmark::State& state) {
+  const auto generator = dd::default_id_generator(state.range(0) != 0);
+  dd::TimePoint start = dd::default_clock();
+  for (auto _ : state) {
+    start.wall += std::chrono::microseconds(1);
+    benchmark::DoNotOptimize(generator->trace_id(start));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DefaultTraceID)->Arg(0)->Arg(1)->ArgName("128_bit");
+
+// The benchmark `BM_CreateChildSpans` creates `state.range(0)` child spans of
+// a root span, either one at a time using `Span::create_child`, or all at once
+// using `Span::create_children` when `state.range(1)` is nonzero.
+void BM_CreateChildSpans(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  const auto count = std::size_t(state.range(0));
+  const bool batched = state.range(1) != 0;
+  for (auto _ : state) {
+    auto root = tracer.create_span();
+    if (batched) {
+      auto children = root.create_children(count);
+      benchmark::DoNotOptimize(children.data());
+    } else {
+      std::vector<dd::Span> children;
+      children.reserve(count);
+      for (std::size_t i = 0; i < count; ++i) {
+        children.push_back(root.create_child());
+      }
+      benchmark::DoNotOptimize(children.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_CreateChildSpans)
+    ->ArgsProduct({{10, 100}, {0, 1}})
+    ->ArgNames({"children", "batched"});
+
+// The benchmark `BM_SetHTTPTags` sets the dozen tags that an HTTP integration
+// typically sets on a span, either one at a time using `Span::set_tag`, or all
+// at once using `Span::set_tags` when `state.range(0)` is nonzero.
+void BM_SetHTTPTags(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  const bool batched = state.range(0) != 0;
+  const std::initializer_list<std::pair<dd::StringView, dd::StringView>> tags{
+      {"http.method", "GET"},
+      {"http.url", "https://example.com/api/v2/orders?page=3"},
+      {"http.status_code", "200"},
+      {"http.route", "/api/v2/orders"},
+      {"http.useragent", "Mozilla/5.0 (X11; Linux x86_64)"},
+      {"http.client_ip", "203.0.113.7"},
+      {"http.request.content_length", "0"},
+      {"http.response.content_length", "5123"},
+      {"component", "nginx"},
+      {"span.kind", "server"},
+      {"network.destination.name", "example.com"},
+      {"peer.hostname", "backend-7.internal"}};
+  for (auto _ : state) {
+    auto span = tracer.create_span();
+    if (batched) {
+      span.set_tags(tags);
+    } else {
+      for (const auto& [name, value] : tags) {
+        span.set_tag(name, value);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * tags.size());
+}
+BENCHMARK(BM_SetHTTPTags)->Arg(0)->Arg(1)->ArgName("batched");
+
+// The benchmark `BM_SpanLifetime` creates and finishes a root span and one
+// child, using `default_clock` or, when `state.range(0)` is nonzero,
+// `fast_clock`.  Each span reads the clock when it starts and when it
+// finishes.  It reports the allocations per trace and per span.
+void BM_SpanLifetime(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  const auto valid_config = dd::finalize_config(
+      config, state.range(0) ? dd::fast_clock : dd::default_clock);
+  dd::Tracer tracer{*valid_config};
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    allocations.start();
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      benchmark::DoNotOptimize(child.id());
+    }
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+  allocations.report(state, "trace", state.iterations());
+  allocations.report(state, "span", state.iterations() * 2);
+}
+BENCHMARK(BM_SpanLifetime)->Arg(0)->Arg(1)->ArgName("fast_clock");
+
+// The benchmark `BM_LimiterAllow` calls `Limiter::allow` on a limiter shared
+// by all of the benchmark's threads, as the samplers do for each kept
+// decision.  When `state.range(0)` is zero, each call also locks a mutex
+// shared by the threads, as the samplers did before `Limiter` was safe to use
+// concurrently.
+void BM_LimiterAllow(benchmark::State& state) {
+  static std::mutex mutex;
+  static dd::Limiter limiter{dd::default_clock, 1'000'000};
+  const bool locked = state.range(0) == 0;
+  for (auto _ : state) {
+    if (locked) {
+      std::lock_guard<std::mutex> lock(mutex);
+      benchmark::DoNotOptimize(limiter.allow());
+    } else {
+      benchmark::DoNotOptimize(limiter.allow());
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LimiterAllow)
+    ->Arg(0)
+    ->Arg(1)
+    ->ArgName("lock_free")
+    ->Threads(1)
+    ->Threads(8)
+    ->Threads(32)
+    ->Threads(64)
+    ->UseRealTime();
+
+// The benchmark `BM_GlobMatch` matches sampling rule patterns against
+// resource names typical of HTTP and SQL spans, using `glob_match`, which
+// prepares a `Glob` for each match, or, when `state.range(0)` is nonzero, a
+// precompiled `Glob`.
+void BM_GlobMatch(benchmark::State& state) {
+  const std::vector<std::pair<dd::StringView, dd::StringView>> cases{
+      {"GET /api/v2/orders/{order_id}/line-items",
+       "GET /API/V2/ORDERS/{ORDER_ID}/LINE-ITEMS"},
+      {"GET /api/v2/*", "GET /api/v2/orders/{order_id}/line-items"},
+      {"*/line-items", "GET /api/v2/orders/{order_id}/line-items"},
+      {"SELECT * FROM orders o JOIN line_items l ON *",
+       "select * from orders o join line_items l on l.order_id = o.id"},
+      {"POST /api/v?/payments/*/refunds",
+       "POST /api/v3/payments/{payment_id}/refunds"},
+  };
+  std::vector<dd::Glob> globs;
+  for (const auto& [pattern, subject] : cases) {
+    globs.emplace_back(pattern);
+  }
+  const bool compiled = state.range(0) != 0;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < cases.size(); ++i) {
+      if (compiled) {
+        benchmark::DoNotOptimize(globs[i].match(cases[i].second));
+      } else {
+        benchmark::DoNotOptimize(
+            dd::glob_match(cases[i].first, cases[i].second));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * cases.size());
+}
+BENCHMARK(BM_GlobMatch)->Arg(0)->Arg(1)->ArgName("compiled");
+
+// The benchmark `BM_GlobMatchAdversarial` matches patterns that would make a
+// backtracking matcher take time proportional to the product of the lengths
+// of the pattern and the subject, against a resource of `state.range(0)`
+// bytes.  It reports the bytes of resource matched per second, which should
+// not depend on the length of the resource.
+void BM_GlobMatchAdversarial(benchmark::State& state) {
+  const std::string resource(std::size_t(state.range(0)), 'a');
+  const std::vector<dd::Glob> globs{
+      dd::Glob("*a*a*a*a*a*a*a*a*b"),
+      dd::Glob("*" + std::string(60, 'a') + "b*"),
+      dd::Glob("*" + std::string(200, '?') + "b*"),
+  };
+  for (auto _ : state) {
+    for (const auto& glob : globs) {
+      benchmark::DoNotOptimize(glob.match(resource));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * globs.size() *
+                          resource.size());
+}
+BENCHMARK(BM_GlobMatchAdversarial)->Arg(1 << 10)->Arg(1 << 16);
+
+// The benchmark `BM_KeepByRate` makes keep/drop decisions for a batch of
+// `state.range(0)` trace IDs at one sample rate, one ID at a time using
+// `knuth_hash` or, when `state.range(1)` is nonzero, all at once using
+// `keep_by_rate`.  It reports the rate of decisions.
+void BM_KeepByRate(benchmark::State& state) {
+  const auto count = std::size_t(state.range(0));
+  const bool batched = state.range(1) != 0;
+  std::mt19937_64 generator;
+  std::vector<std::uint64_t> ids(count);
+  for (auto& id : ids) {
+    id = generator();
+  }
+  std::vector<std::uint64_t> keep((count + 63) / 64);
+  const dd::Rate rate = *dd::Rate::from(0.1);
+  const std::uint64_t threshold = dd::max_id_from_rate(rate);
+  for (auto _ : state) {
+    if (batched) {
+      dd::keep_by_rate(ids.data(), count, rate, keep.data());
+    } else {
+      for (std::size_t i = 0; i < count; ++i) {
+        const bool kept = dd::knuth_hash(ids[i]) < threshold;
+        auto& word = keep[i / 64];
+        word = (word & ~(std::uint64_t(1) << (i % 64))) |
+               (std::uint64_t(kept) << (i % 64));
+      }
+    }
+    benchmark::DoNotOptimize(keep.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_KeepByRate)
+    ->ArgsProduct({{1024, 65536}, {0, 1}})
+    ->ArgNames({"ids", "batched"});
+
+// The benchmark `BM_ParseTraceparent` parses a typical "traceparent" header
+// value, as is done for each request extracted in the W3C style.
+void BM_ParseTraceparent(benchmark::State& state) {
+  const dd::StringView traceparent =
+      "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+  for (auto _ : state) {
+    dd::ExtractedData result;
+    benchmark::DoNotOptimize(dd::parse_traceparent(result, traceparent));
+    benchmark::DoNotOptimize(result.parent_id);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseTraceparent);
+
+// The benchmark `BM_Base64Decode` decodes a base64-encoded payload of
+// `state.range(0)` bytes, as remote configuration does for the "targets" of
+// each response and for each changed configuration file.  The second argument
+// selects the scalar decoder (0) or the vectorized decoder (1).
+void BM_Base64Decode(benchmark::State& state) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::mt19937 generator{42};
+  std::string encoded;
+  for (std::int64_t i = 0; i < state.range(0) / 3 * 4; ++i) {
+    encoded += alphabet[generator() % 64];
+  }
+  const auto decode =
+      state.range(1) ? dd::base64_decode : dd::base64_decode_scalar;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(decode(encoded));
+  }
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_Base64Decode)
+    ->ArgsProduct({{1024, 65536}, {0, 1}})
+    ->ArgNames({"bytes", "vectorized"});
+
+// `shared_counter` is incremented by all of the threads of `BM_CounterInc`.
+datadog::telemetry::CounterMetric shared_counter{
+    "benchmark.counter", "benchmark", {}, true};
+
+// The benchmark `BM_CounterInc` has each of `state.threads()` threads
+// increment the same telemetry counter, as every thread that creates spans
+// does.
+void BM_CounterInc(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_counter.inc();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CounterInc)->ThreadRange(1, 8)->UseRealTime();
+
+// The benchmark `BM_ParseUint64` parses the IDs of typical propagation headers:
+// a decimal "x-datadog-trace-id", a decimal "x-datadog-parent-id", and a
+// 16 digit hexadecimal "x-b3-spanid".
+void BM_ParseUint64(benchmark::State& state) {
+  const dd::StringView trace_id = "4614717839126574914";
+  const dd::StringView parent_id = "83249071234";
+  const dd::StringView span_id = "00f067aa0ba902b7";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dd::parse_uint64(trace_id, 10));
+    benchmark::DoNotOptimize(dd::parse_uint64(parent_id, 10));
+    benchmark::DoNotOptimize(dd::parse_uint64(span_id, 16));
+  }
+  state.SetItemsProcessed(state.iterations() * 3);
+}
+BENCHMARK(BM_ParseUint64);
+
+// The benchmark `BM_EncodeTracestate` encodes a "tracestate" header value
+// with an origin, a few propagated trace tags, and another vendor's entry.
+void BM_EncodeTracestate(benchmark::State& state) {
+  const dd::Optional<std::string> origin = "synthetics";
+  const std::vector<std::pair<std::string, std::string>> trace_tags{
+      {"_dd.p.dm", "-4"},
+      {"_dd.p.tid", "640cfd8d00000000"},
+      {"_dd.p.usr.id", "dXNlckBleGFtcGxlLmNvbQ=="}};
+  const dd::Optional<std::string> additional_datadog;
+  const dd::Optional<std::string> additional = "rojo=00f067aa0ba902b7";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dd::encode_tracestate(
+        0x00f067aa0ba902b7, 2, origin, trace_tags, additional_datadog,
+        additional));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncodeTracestate);
+
+// The benchmark `BM_InjectHeaders` injects the trace context of a span in the
+// Datadog, B3 and W3C styles, as is done for each outbound request.  It
+// reports the allocations per injection.
+void BM_InjectHeaders(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  config.injection_styles = {dd::PropagationStyle::DATADOG,
+                             dd::PropagationStyle::B3,
+                             dd::PropagationStyle::W3C};
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  auto span = tracer.create_span();
+  NullDictWriter writer;
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    allocations.start();
+    span.inject(writer);
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations());
+  allocations.report(state, "inject", state.iterations());
+}
+BENCHMARK(BM_InjectHeaders);
+
+// The propagation styles measured by `BM_ExtractSpan` and
+// `BM_InjectHeadersInStyle`, indexed by `state.range(0)`.
+const dd::PropagationStyle benchmark_styles[] = {
+    dd::PropagationStyle::DATADOG, dd::PropagationStyle::B3,
+    dd::PropagationStyle::W3C};
+
+// Return the headers of a typical request that carries the context of a
+// sampled trace in the specified `style`.
+HeaderReader request_headers(dd::PropagationStyle style) {
+  HeaderReader reader;
+  reader.headers = {
+      {"host", "orders.internal:8080"},
+      {"user-agent", "curl/8.4.0"},
+      {"accept", "application/json"},
+      {"content-type", "application/json"},
+  };
+  switch (style) {
+    case dd::PropagationStyle::DATADOG:
+      reader.headers.insert(reader.headers.end(),
+                            {{"x-datadog-trace-id", "5208512171318403364"},
+                             {"x-datadog-parent-id", "6433872893834271671"},
+                             {"x-datadog-sampling-priority", "1"},
+                             {"x-datadog-origin", "rum"},
+                             {"x-datadog-tags", "_dd.p.dm=-4"}});
+      break;
+    case dd::PropagationStyle::B3:
+      reader.headers.insert(reader.headers.end(),
+                            {{"x-b3-traceid", "4848a0e5a2e25b24"},
+                             {"x-b3-spanid", "594a16ab1e4a0bb7"},
+                             {"x-b3-sampled", "1"}});
+      break;
+    default:
+      reader.headers.insert(
+          reader.headers.end(),
+          {{"traceparent",
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"},
+           {"tracestate", "dd=s:1;o:rum;t.dm:-4,congo=t61rcWkgMzE"}});
+      break;
+  }
+  return reader;
+}
+
+// The benchmark `BM_ExtractSpan` extracts a span from request headers in the
+// style selected by `state.range(0)` (Datadog, B3, or W3C), and finishes it,
+// as is done for each inbound request.  It reports the allocations per
+// extraction, not counting the span's finishing.
+void BM_ExtractSpan(benchmark::State& state) {
+  const auto style = benchmark_styles[state.range(0)];
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  config.extraction_styles = {style};
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  const HeaderReader reader = request_headers(style);
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    allocations.start();
+    auto span = tracer.extract_span(reader);
+    benchmark::DoNotOptimize(span);
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations());
+  allocations.report(state, "extract", state.iterations());
+}
+BENCHMARK(BM_ExtractSpan)->DenseRange(0, 2)->ArgName("style");
+
+// The benchmark `BM_ExtractLongTracestate` extracts a span in the W3C style
+// from a "tracestate" header in which the Datadog entry is among several
+// other vendors' entries, which are propagated as they are.  It reports the
+// number of allocations per extraction.
+void BM_ExtractLongTracestate(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  config.extraction_styles = {dd::PropagationStyle::W3C};
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  HeaderReader reader;
+  reader.headers = {
+      {"traceparent",
+       "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"},
+      {"tracestate",
+       "congo=t61rcWkgMzE,rojo=00f067aa0ba902b7,"
+       "vendor1=c3VwZXJjYWxpZnJhZ2lsaXN0aWM,vendor2=ZXhwaWFsaWRvY2lvdXM,"
+       "dd=s:1;o:rum;t.dm:-4;x:extra,"
+       "vendor3=YW5kIGEgbG9uZyB2YWx1ZQ,vendor4=dGhhdCBpcyBwcm9wYWdhdGVk,"
+       "vendor5=YnV0IG5vdCBpbnRlcnByZXRlZA"}};
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    allocations.start();
+    auto span = tracer.extract_span(reader);
+    benchmark::DoNotOptimize(span);
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations());
+  allocations.report(state, "extract", state.iterations());
+}
+BENCHMARK(BM_ExtractLongTracestate);
+
+// The benchmark `BM_ExtractSpanFromHeaderMap` copies request headers that
+// carry trace context in the Datadog style into a `HeaderMap` that is reused
+// across requests, and extracts a span from it.  It reports the number of
+// allocations per request.
+void BM_ExtractSpanFromHeaderMap(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  config.extraction_styles = {dd::PropagationStyle::DATADOG};
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  const HeaderReader request = request_headers(dd::PropagationStyle::DATADOG);
+  dd::HeaderMap headers;
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    allocations.start();
+    headers.clear();
+    for (const auto& [name, value] : request.headers) {
+      headers.append(name, value);
+    }
+    auto span = tracer.extract_span(headers);
+    benchmark::DoNotOptimize(span);
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations());
+  allocations.report(state, "request", state.iterations());
+}
+BENCHMARK(BM_ExtractSpanFromHeaderMap);
+
+// The benchmark `BM_ExtractSpans` extracts a span from each of a batch of 64
+// messages whose headers carry trace context in the Datadog style, as a
+// message queue consumer does, and keeps the spans until the whole batch is
+// processed.  If `state.range(0)` is nonzero, then the batch is extracted
+// with one call to `extract_spans`.  Otherwise, `extract_span` is called for
+// each message.
+void BM_ExtractSpans(benchmark::State& state) {
+  const bool batched = state.range(0) != 0;
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  config.extraction_styles = {dd::PropagationStyle::DATADOG};
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  const HeaderReader message = request_headers(dd::PropagationStyle::DATADOG);
+  const std::vector<const dd::DictReader*> readers(64, &message);
+  for (auto _ : state) {
+    if (batched) {
+      auto spans = tracer.extract_spans(readers.data(), readers.size());
+      benchmark::DoNotOptimize(spans);
+    } else {
+      std::vector<dd::Expected<dd::Span>> spans;
+      spans.reserve(readers.size());
+      for (const dd::DictReader* reader : readers) {
+        spans.push_back(tracer.extract_span(*reader));
+      }
+      benchmark::DoNotOptimize(spans);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * readers.size());
+}
+BENCHMARK(BM_ExtractSpans)->Arg(0)->Arg(1)->ArgName("batched");
+
+// The benchmark `BM_ExtractOrCreateSpanWithoutContext` calls
+// `extract_or_create_span` on request headers that carry no trace context, as
+// is done for each request that enters the system, and finishes the resulting
+// root span.  It reports the number of allocations per call.
+void BM_ExtractOrCreateSpanWithoutContext(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  HeaderReader reader;
+  reader.headers = {
+      {"host", "orders.internal:8080"},
+      {"user-agent", "curl/8.4.0"},
+      {"accept", "application/json"},
+      {"content-type", "application/json"},
+  };
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    allocations.start();
+    auto span = tracer.extract_or_create_span(reader);
+    benchmark::DoNotOptimize(span);
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations());
+  allocations.report(state, "extract", state.iterations());
+}
+BENCHMARK(BM_ExtractOrCreateSpanWithoutContext);
+
+// The benchmark `BM_InjectHeadersInStyle` injects the trace context of a span
+// in the one style selected by `state.range(0)` (Datadog, B3, or W3C).
+void BM_InjectHeadersInStyle(benchmark::State& state) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  config.injection_styles = {benchmark_styles[state.range(0)]};
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  auto span = tracer.create_span();
+  NullDictWriter writer;
+  for (auto _ : state) {
+    span.inject(writer);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InjectHeadersInStyle)->DenseRange(0, 2)->ArgName("style");
+
+// The benchmark `BM_InProcessHandoff` hands a span's trace context to a new
+// trace segment in the same process, as at a queue between thread pools.  If
+// `state.range(0)` is zero, then the context is injected into headers and
+// extracted from them.  Otherwise, it is exported as a `TraceContext` and the
+// trace is continued from that.  The trace carries an origin and trace tags.
+void BM_InProcessHandoff(benchmark::State& state) {
+  const bool binary = state.range(0) != 0;
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<DiscardingCollector>();
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  const HeaderReader request = request_headers(dd::PropagationStyle::DATADOG);
+  auto producer = tracer.extract_span(request);
+  dd::HeaderMap headers;
+  for (auto _ : state) {
+    if (binary) {
+      auto consumer = tracer.continue_trace(producer->export_trace_context());
+      benchmark::DoNotOptimize(consumer);
+    } else {
+      headers.clear();
+      producer->inject(headers);
+      auto consumer = tracer.extract_span(headers);
+      benchmark::DoNotOptimize(consumer);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InProcessHandoff)->Arg(0)->Arg(1)->ArgName("binary");
+
+// The benchmark `BM_HTTPRequest` traces what a server does for each request,
+// which is the workload that matters most, and so is the throughput to track.
+// For each iteration, it extracts the request's span from headers that carry
+// the trace context in both the Datadog and W3C styles, tags it, creates
+// `state.range(0)` children with typical tags, injects trace context into
+// `state.range(1)` outbound requests made by those children, and then
+// finishes the spans, which sends them to a collector that serializes them.
+// If `state.range(2)` is nonzero, then tracing is disabled, and so the spans
+// are not recorded, but trace context is still propagated.
+void BM_HTTPRequest(benchmark::State& state) {
+  const std::int64_t num_children = state.range(0);
+  const std::int64_t num_injections = state.range(1);
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<SerializingCollector>();
+  config.report_traces = state.range(2) == 0;
+  config.extraction_styles = {dd::PropagationStyle::DATADOG,
+                              dd::PropagationStyle::W3C};
+  config.injection_styles = {dd::PropagationStyle::DATADOG,
+                             dd::PropagationStyle::W3C};
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+
+  // The same trace context, in both styles.
+  HeaderReader reader = request_headers(dd::PropagationStyle::W3C);
+  reader.headers.insert(reader.headers.end(),
+                        {{"x-datadog-trace-id", "11803532876627986230"},
+                         {"x-datadog-parent-id", "67667974448284343"},
+                         {"x-datadog-sampling-priority", "1"},
+                         {"x-datadog-origin", "rum"},
+                         {"x-datadog-tags",
+                          "_dd.p.dm=-4,_dd.p.tid=4bf92f3577b34da6"}});
+  NullDictWriter writer;
+
+  for (auto _ : state) {
+    auto root = tracer.extract_or_create_span(reader);
+    root.set_resource_name("GET /api/v2/orders/{order_id}");
+    root.set_tag("http.method", "GET");
+    root.set_tag("http.route", "/api/v2/orders/{order_id}");
+    root.set_tag("http.url", "https://orders.internal:8080/api/v2/orders/42");
+    root.set_tag("http.useragent", "curl/8.4.0");
+    root.set_tag("component", "nginx");
+    root.set_tag("span.kind", "server");
+    for (std::int64_t i = 0; i < num_children; ++i) {
+      dd::SpanConfig child_config;
+      child_config.name = "postgres.query";
+      child_config.resource = "SELECT * FROM orders WHERE id = ?";
+      auto child = root.create_child(std::move(child_config));
+      child.set_tag("db.system", "postgresql");
+      child.set_tag("db.name", "orders");
+      child.set_tag("out.host", "db-3.internal");
+      child.set_tag("span.kind", "client");
+      // The outbound requests are spread across the children.
+      for (std::int64_t j = i; j < num_injections; j += num_children) {
+        child.inject(writer);
+      }
+    }
+    root.set_tag("http.status_code", "200");
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_HTTPRequest)
+    ->Args({4, 2, 0})
+    ->Args({16, 4, 0})
+    ->Args({4, 2, 1})
+    ->Args({16, 4, 1})
+    ->ArgNames({"children", "injections", "disabled"});
+
+// Return a root span typical of an HTTP server.
+std::unique_ptr<dd::SpanData> http_server_span() {
+  auto span = std::make_unique<dd::SpanData>();
+  span->service = "orders";
+  span->name = "http.request";
+  span->resource = "GET /api/v2/orders/{order_id}";
+  span->tags.emplace("http.method", "GET");
+  span->tags.emplace("http.status_code", "200");
+  span->tags.emplace("http.route", "/api/v2/orders/{order_id}");
+  span->trace_id = dd::TraceID(0x4bf92f3577b34da6);
+  return span;
+}
+
+// The benchmark `BM_TraceSamplerDecide` makes the sampling decision for a
+// root span, as is done for each trace, using `state.range(0)` sampling rules
+// of which only the last matches the span.
+void BM_TraceSamplerDecide(benchmark::State& state) {
+  dd::TraceSamplerConfig config;
+  for (std::int64_t i = 0; i + 1 < state.range(0); ++i) {
+    dd::TraceSamplerConfig::Rule rule;
+    rule.service = "service-" + std::to_string(i);
+    rule.sample_rate = 0.5;
+    config.rules.push_back(rule);
+  }
+  if (state.range(0) != 0) {
+    dd::TraceSamplerConfig::Rule rule;
+    rule.service = "orders";
+    rule.resource = "GET /api/v2/*";
+    rule.sample_rate = 0.5;
+    config.rules.push_back(rule);
+  }
+  config.max_per_second = 1e9;
+  const auto valid_config = dd::finalize_config(config);
+  dd::TraceSampler sampler{*valid_config, dd::default_clock};
+  const auto span = http_server_span();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sampler.decide(*span));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TraceSamplerDecide)->Arg(0)->Arg(1)->Arg(16)->ArgName("rules");
+
+// The benchmark `BM_SpanMatcherMatch` matches a span against a sampling rule
+// having service, name, resource, and tag patterns, using `SpanMatcher` or,
+// when `state.range(0)` is nonzero, a `CompiledSpanMatcher`.
+void BM_SpanMatcherMatch(benchmark::State& state) {
+  dd::SpanMatcher matcher;
+  matcher.service = "ord*";
+  matcher.name = "http.*";
+  matcher.resource = "GET /api/v?/orders/*";
+  matcher.tags.emplace("http.method", "GET");
+  matcher.tags.emplace("http.status_code", "2??");
+  const dd::CompiledSpanMatcher compiled{matcher};
+  const auto span = http_server_span();
+  const bool use_compiled = state.range(0) != 0;
+  for (auto _ : state) {
+    if (use_compiled) {
+      benchmark::DoNotOptimize(compiled.match(*span));
+    } else {
+      benchmark::DoNotOptimize(matcher.match(*span));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpanMatcherMatch)->Arg(0)->Arg(1)->ArgName("compiled");
+
+// The benchmark `BM_DDSketchAdd` adds span durations, spread over several
+// orders of magnitude, to a `DDSketch`: one at a time if the argument is zero,
+// or in bulk otherwise.  It reports the size of the serialized sketch.
+void BM_DDSketchAdd(benchmark::State& state) {
+  std::mt19937_64 generator{42};
+  std::lognormal_distribution<double> nanoseconds{13.0, 2.0};
+  std::vector<double> durations(4096);
+  for (double& duration : durations) {
+    duration = nanoseconds(generator);
+  }
+  const bool bulk = state.range(0) != 0;
+  dd::DDSketch sketch;
+  for (auto _ : state) {
+    if (bulk) {
+      sketch.add(durations.data(), durations.size());
+    } else {
+      for (const double duration : durations) {
+        sketch.add(duration);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * durations.size());
+  std::string encoded;
+  sketch.encode(encoded);
+  state.counters["serialized_bytes"] = double(encoded.size());
+}
+BENCHMARK(BM_DDSketchAdd)->Arg(0)->Arg(1)->ArgName("bulk");
+
+// The benchmark `BM_TelemetryHeartbeat` produces a telemetry heartbeat message
+// for a tracer with some user metrics, after capturing the metrics as often as
+// the tracer does between heartbeats.  It reports the number of allocations
+// per message.
+void BM_TelemetryHeartbeat(benchmark::State& state) {
+  std::vector<std::shared_ptr<datadog::telemetry::Metric>> user_metrics;
+  for (int i = 0; i < 20; ++i) {
+    user_metrics.push_back(std::make_shared<datadog::telemetry::CounterMetric>(
+        "benchmark.counter." + std::to_string(i), "benchmark",
+        std::vector<std::string>{"integration:benchmark", "shard:" +
+                                                              std::to_string(i)},
+        false));
+  }
+  dd::TracerTelemetry telemetry{true,
+                                dd::default_clock,
+                                std::make_shared<NullLogger>(),
+                                dd::TracerSignature{dd::RuntimeID::generate(),
+                                                    "benchmark", "test"},
+                                "benchmark",
+                                "1.0.0",
+                                user_metrics};
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    for (int capture = 0; capture < 6; ++capture) {
+      telemetry.metrics().tracer.spans_created.add(100);
+      for (const auto& metric : user_metrics) {
+        static_cast<datadog::telemetry::CounterMetric&>(*metric).inc();
+      }
+      telemetry.capture_metrics();
+    }
+    allocations.start();
+    benchmark::DoNotOptimize(telemetry.heartbeat_and_telemetry());
+    allocations.stop();
+  }
+  allocations.report(state, "heartbeat", state.iterations());
+}
+BENCHMARK(BM_TelemetryHeartbeat);
+
+// `LoopbackCurlLibrary` completes each request as soon as `Curl`'s event loop
+// adds it to the multi-handle, without any network activity.
+class LoopbackCurlLibrary : public dd::CurlLibrary {
+  // `added_` and `message_` are accessed only by the event loop thread.
+  std::vector<CURL*> added_;
+  CURLMsg message_;
+
+ public:
+  std::atomic<std::size_t> num_sent{0};
+
+  CURLcode easy_getinfo_response_code(CURL*, long* code) override {
+    *code = 200;
+    return CURLE_OK;
+  }
+  CURLMcode multi_add_handle(CURLM*, CURL* handle) override {
+    added_.push_back(handle);
+    ++num_sent;
+    return CURLM_OK;
+  }
+  CURLMsg* multi_info_read(CURLM*, int* msgs_in_queue) override {
+    if (added_.empty()) {
+      *msgs_in_queue = 0;
+      return nullptr;
+    }
+    message_.msg = CURLMSG_DONE;
+    message_.easy_handle = added_.back();
+    message_.data.result = CURLE_OK;
+    added_.pop_back();
+    *msgs_in_queue = int(added_.size());
+    return &message_;
+  }
+  CURLMcode multi_perform(CURLM*, int* running_handles) override {
+    *running_handles = int(added_.size());
+    return CURLM_OK;
+  }
+  CURLMcode multi_remove_handle(CURLM*, CURL*) override { return CURLM_OK; }
+};
+
+// The benchmark `BM_CurlPostToSend` measures the latency between a call to
+// `Curl::post` and `Curl`'s event loop handing the request to libcurl.
+void BM_CurlPostToSend(benchmark::State& state) {
+  LoopbackCurlLibrary library;
+  dd::Curl client{std::make_shared<NullLogger>(), dd::default_clock, library};
+  const dd::HTTPClient::URL url{"http", "localhost:8126", "/v0.4/traces"};
+  const auto ignore = [](auto&&...) {};
+  for (auto _ : state) {
+    const std::size_t num_sent = library.num_sent;
+    (void)client.post(url, ignore, "body", ignore, ignore,
+                      dd::default_clock().tick + std::chrono::seconds(10));
+    while (library.num_sent == num_sent) {
+    }
+  }
+  client.drain(dd::default_clock().tick + std::chrono::seconds(1));
+}
+BENCHMARK(BM_CurlPostToSend)->UseRealTime();
+
+// `ReplayedSpan` is what is needed to recreate a captured span using a
+// `Tracer`: its configuration, tags, and duration, and the index of its parent
+// within its `ReplayedTrace`.
+struct ReplayedSpan {
+  static constexpr std::size_t no_parent = std::size_t(-1);
+  std::size_t parent = no_parent;
+  dd::SpanConfig config;
+  std::vector<std::pair<std::string, std::string>> tags;
+  std::vector<std::pair<std::string, double>> metrics;
+  dd::Duration duration;
+  bool error;
+};
+
+// The spans of a captured trace chunk, ordered so that each span's parent, if
+// it is in the chunk, precedes it.
+using ReplayedTrace = std::vector<ReplayedSpan>;
+
+// `Capture` is the trace chunks read from a file of captured traces, both as
+// decoded and as prepared for replay through a `Tracer`.
+struct Capture {
+  std::vector<std::vector<std::unique_ptr<dd::SpanData>>> chunks;
+  std::vector<ReplayedTrace> traces;
+  std::size_t num_spans = 0;
+};
+
+// Return the specified decoded `chunk` prepared for replay.  Tags whose names
+// begin with an underscore, and the chunk tags, are set by the tracer, and so
+// are not replayed.
+ReplayedTrace replayed_trace(
+    const std::vector<std::unique_ptr<dd::SpanData>>& chunk) {
+  std::unordered_map<std::uint64_t, std::size_t> index_by_id;
+  std::unordered_map<std::uint64_t, std::vector<std::size_t>> children;
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    index_by_id.emplace(chunk[i]->span_id, i);
+    children[chunk[i]->parent_id].push_back(i);
+  }
+  ReplayedTrace trace;
+  // Visit each tree of the chunk depth first from its root, i.e. from each
+  // span whose parent is not in the chunk.
+  std::vector<std::pair<std::size_t, std::size_t>> pending;
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    if (!index_by_id.count(chunk[i]->parent_id)) {
+      pending.emplace_back(i, ReplayedSpan::no_parent);
+    }
+  }
+  while (!pending.empty()) {
+    const auto [index, parent] = pending.back();
+    pending.pop_back();
+    const dd::SpanData& span = *chunk[index];
+    ReplayedSpan replayed;
+    replayed.parent = parent;
+    replayed.config.service = span.service;
+    replayed.config.service_type = span.service_type;
+    replayed.config.name = span.name;
+    replayed.config.resource = span.resource;
+    for (const auto& [name, value] : span.tags) {
+      if (name.empty() || name[0] == '_' || name == "language" ||
+          name == "runtime-id") {
+        continue;
+      }
+      replayed.tags.emplace_back(name, value);
+    }
+    for (const auto& [name, value] : span.numeric_tags) {
+      if (name.empty() || name[0] == '_' || name == "process_id") {
+        continue;
+      }
+      replayed.metrics.emplace_back(name, value);
+    }
+    replayed.duration = span.duration;
+    replayed.error = span.error;
+    trace.push_back(std::move(replayed));
+    const auto found = children.find(span.span_id);
+    if (found != children.end()) {
+      for (const std::size_t child : found->second) {
+        if (child != index) {
+          pending.emplace_back(child, trace.size() - 1);
+        }
+      }
+    }
+  }
+  return trace;
+}
+
+// Read the trace chunks captured in the file at the specified `path`, which
+// is either a spool file written by `FileSpoolCollector`, or a sequence of
+// "/v0.4/traces" request bodies, e.g. as recorded by a proxy in front of the
+// Datadog Agent.
+dd::Expected<Capture> load_capture(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return dd::Error{dd::Error::OTHER, "Unable to open " + path};
+  }
+  std::string contents{std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>()};
+  Capture capture;
+  const dd::StringView spool_magic("DDSPOOL\0", 8);
+  if (dd::StringView(contents).substr(0, spool_magic.size()) == spool_magic) {
+    // See `file_spool_collector.h`.  Records begin at multiples of eight
+    // bytes, after the 16 byte file header, and the first record of size
+    // zero ends the file.  Checksums are not verified, and integers are
+    // assumed to be in the host's byte order, i.e. little-endian.
+    std::size_t offset = 16;
+    while (offset + 8 <= contents.size()) {
+      std::uint32_t size;
+      std::memcpy(&size, contents.data() + offset, sizeof size);
+      if (size == 0 || offset + 8 + size > contents.size()) {
+        break;
+      }
+      dd::StringView record(contents.data() + offset + 8, size);
+      auto chunk = dd::msgpack_decode_spans(record);
+      if (!chunk) {
+        return chunk.error().with_prefix("In spool record: ");
+      }
+      capture.chunks.push_back(std::move(*chunk));
+      offset = (offset + 8 + size + 7) / 8 * 8;
+    }
+  } else {
+    dd::StringView input = contents;
+    while (!input.empty()) {
+      const auto num_chunks = dd::msgpack::unpack_array(input);
+      if (!num_chunks) {
+        return num_chunks.error().with_prefix("In payload: ");
+      }
+      for (std::size_t i = 0; i < *num_chunks; ++i) {
+        auto chunk = dd::msgpack_decode_spans(input);
+        if (!chunk) {
+          return chunk.error().with_prefix("In payload: ");
+        }
+        capture.chunks.push_back(std::move(*chunk));
+      }
+    }
+  }
+  for (const auto& chunk : capture.chunks) {
+    capture.traces.push_back(replayed_trace(chunk));
+    capture.num_spans += chunk.size();
+  }
+  return capture;
+}
+
+// The benchmark `BM_ReplayCapture/tracer` recreates each trace of a
+// `Capture` using a `Tracer`, with the captured services, names, resources,
+// tags, and durations, so that sampling and serialization as MessagePack are
+// measured for the shapes and tags of real traces.  It reports the
+// allocations per span.  It is registered only if the environment variable
+// `DD_TRACE_BENCHMARK_CAPTURE` names a capture file.  See `main`.
+void BM_ReplayCaptureThroughTracer(benchmark::State& state,
+                                   const Capture& capture) {
+  dd::TracerConfig config;
+  config.service = "benchmark";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::make_shared<SerializingCollector>();
+  const auto valid_config = dd::finalize_config(config);
+  dd::Tracer tracer{*valid_config};
+  std::vector<dd::Span> spans;
+  AllocationCounter allocations;
+  for (auto _ : state) {
+    allocations.start();
+    for (const ReplayedTrace& trace : capture.traces) {
+      spans.reserve(trace.size());
+      for (const ReplayedSpan& replayed : trace) {
+        if (replayed.parent == ReplayedSpan::no_parent) {
+          spans.push_back(tracer.create_span(replayed.config));
+        } else {
+          spans.push_back(spans[replayed.parent].create_child(replayed.config));
+        }
+        dd::Span& span = spans.back();
+        for (const auto& [name, value] : replayed.tags) {
+          span.set_tag(name, value);
+        }
+        for (const auto& [name, value] : replayed.metrics) {
+          span.set_metric(name, value);
+        }
+        if (replayed.error) {
+          span.set_error(true);
+        }
+        span.set_end_time(span.start_time().tick + replayed.duration);
+      }
+      // Finish children before their parents.
+      while (!spans.empty()) {
+        spans.pop_back();
+      }
+    }
+    allocations.stop();
+  }
+  state.SetItemsProcessed(state.iterations() * capture.num_spans);
+  allocations.report(state, "span", state.iterations() * capture.num_spans);
+}
+
+// The benchmark `BM_ReplayCapture/encode` encodes the trace chunks of a
+// `Capture` as MessagePack, as `DatadogAgent` does, without a `Tracer`, so
+// that the encoder is measured alone.
+void BM_ReplayCaptureEncode(benchmark::State& state, const Capture& capture) {
+  std::string buffer;
+  for (auto _ : state) {
+    buffer.clear();
+    for (const auto& chunk : capture.chunks) {
+      (void)dd::msgpack_encode(buffer, chunk, dd::ChunkTags{});
+    }
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  state.SetItemsProcessed(state.iterations() * capture.num_spans);
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+// Register the benchmarks that replay the capture named by the environment
+// variable `DD_TRACE_BENCHMARK_CAPTURE`, if any.  Return false if the capture
+// cannot be loaded.
+bool register_capture_benchmarks() {
+  const char* const path = std::getenv("DD_TRACE_BENCHMARK_CAPTURE");
+  if (!path) {
+    return true;
+  }
+  auto loaded = load_capture(path);
+  if (!loaded) {
+    std::cerr << "Unable to load DD_TRACE_BENCHMARK_CAPTURE: "
+              << loaded.error().message << '\n';
+    return false;
+  }
+  // The benchmarks refer to the capture until the program exits.
+  static Capture capture;
+  capture = std::move(*loaded);
+  benchmark::RegisterBenchmark(
+      "BM_ReplayCapture/tracer",
+      [](benchmark::State& state) {
+        BM_ReplayCaptureThroughTracer(state, capture);
+      });
+  benchmark::RegisterBenchmark(
+      "BM_ReplayCapture/encode",
+      [](benchmark::State& state) { BM_ReplayCaptureEncode(state, capture); });
+  return true;
+}
+
+// In a build with `DD_TRACE_BENCHMARK_PERF_COUNTERS`, Google Benchmark reads
+// hardware performance counters using libpfm, and every benchmark reports
+// `perf_counters`, unless another list is specified with
+// `--benchmark_perf_counters`, e.g. to measure `BRANCH-MISSES`.  Instructions
+// over cycles is the benchmark's IPC.  Some versions of Google Benchmark read
+// at most three counters.
+const char perf_counters[] = "CYCLES,INSTRUCTIONS,CACHE-MISSES";
+
 }  // namespace
 
-BENCHMARK_MAIN();
+int main(int argc, char** argv) {
+  std::vector<char*> args;
+  if (argv) {
+    args.assign(argv, argv + argc);
+  } else {
+    static char program[] = "benchmark";
+    args.push_back(program);
+  }
+#ifdef DD_TRACE_BENCHMARK_PERF_COUNTERS
+  const bool counters_specified =
+      std::any_of(args.begin(), args.end(), [](const char* arg) {
+        return std::strncmp(arg, "--benchmark_perf_counters", 25) == 0;
+      });
+  std::string counters_flag =
+      std::string("--benchmark_perf_counters=") + perf_counters;
+  if (!counters_specified) {
+    args.insert(args.begin() + 1, counters_flag.data());
+  }
+#endif
+  if (!register_capture_benchmarks()) {
+    return 1;
+  }
+  int count = int(args.size());
+  args.push_back(nullptr);
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,445 @@
+// This is a soak test of dd-trace-cpp: a program that traces a realistic
+// workload for a long time, typically hours, and watches the process's memory
+// for growth that a short benchmark would not reveal, such as a slow leak,
+// heap fragmentation, or traces that accumulate in the tracer's buffer.
+//
+// Worker threads handle simulated HTTP requests as `BM_HTTPRequest` in
+// `benchmark.cpp` does, except that tag values vary from request to request,
+// and some requests record an error.  The tracer is configured as in
+// production, with its own flush thread, except that it sends traces to
+// `MockAgent`, an `HTTPClient` that answers each request at once, as a healthy
+// Datadog Agent would, without using the network.
+//
+// Every interval, the program prints a line of CSV reporting the resident set
+// size, the heap's statistics (where glibc provides them), and the number of
+// traces that have finished but not yet been received by the mock agent.  At
+// the end, it fits a line to the samples taken after a warm-up period, and
+// reports growth if the resident set size or the heap in use grew faster than
+// a threshold.  The exit status is nonzero if growth was reported.
+//
+// Usage:
+//
+//     dd_trace_cpp-soak [--duration SECONDS] [--interval SECONDS]
+//                       [--threads N] [--rate TRACES_PER_SECOND]
+//                       [--max-growth MIB_PER_HOUR]
+//
+// See `README.md`.
+
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <datadog/header_map.h>
+#include <datadog/http_client.h>
+#include <datadog/logger.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+namespace dd = datadog::tracing;
+
+struct Options {
+  std::chrono::seconds duration{std::chrono::hours(4)};
+  std::chrono::seconds interval{10};
+  int threads = 4;
+  // Traces per second, across all threads.  Zero means as fast as possible.
+  double rate = 2000;
+  // Growth faster than this, after warm-up, is reported.
+  double max_growth_mib_per_hour = 16;
+};
+
+// `NullLogger` counts the errors logged by the tracer, and discards them.
+struct NullLogger : public dd::Logger {
+  std::atomic<std::uint64_t> errors{0};
+
+  void log_error(const LogFunc&) override { ++errors; }
+  void log_startup(const LogFunc&) override {}
+  void log_error(const dd::Error&) override { ++errors; }
+  void log_error(dd::StringView) override { ++errors; }
+};
+
+// `EmptyHeaders` is a `DictReader` without any entries.
+struct EmptyHeaders : public dd::DictReader {
+  dd::Optional<dd::StringView> lookup(dd::StringView) const override {
+    return dd::nullopt;
+  }
+  void visit(Visitor) const override {}
+};
+
+// `TraceCountWriter` is a `DictWriter` that keeps only the value of the
+// "X-Datadog-Trace-Count" request header.
+struct TraceCountWriter : public dd::DictWriter {
+  std::uint64_t count = 0;
+
+  void set(dd::StringView key, dd::StringView value) override {
+    if (key == "X-Datadog-Trace-Count") {
+      count = std::strtoull(std::string(value).c_str(), nullptr, 10);
+    }
+  }
+};
+
+// `MockAgent` answers each request before `post` returns: requests for
+// traces with sample rates by service, as the Datadog Agent does, and other
+// requests with an empty object.  It counts the traces that it receives.
+class MockAgent : public dd::HTTPClient {
+ public:
+  std::atomic<std::uint64_t> requests{0};
+  std::atomic<std::uint64_t> traces{0};
+  std::atomic<std::uint64_t> bytes{0};
+
+  dd::Expected<void> post(const URL& url, HeadersSetter set_headers,
+                          std::string body, ResponseHandler on_response,
+                          ErrorHandler,
+                          std::chrono::steady_clock::time_point) override {
+    TraceCountWriter writer;
+    set_headers(writer);
+    ++requests;
+    bytes += body.size();
+    if (url.path.find("/traces") == std::string::npos) {
+      on_response(200, EmptyHeaders{}, "{}");
+      return {};
+    }
+    traces += writer.count;
+    on_response(200, EmptyHeaders{},
+                R"({"rate_by_service":{"service:,env:":1.0,)"
+                R"("service:soak,env:soak":1.0}})");
+    return {};
+  }
+
+  void drain(std::chrono::steady_clock::time_point) override {}
+
+  std::string config() const override {
+    return R"({"type": "MockAgent"})";
+  }
+};
+
+// `Sample` is a measurement of the process's memory.  Heap statistics are
+// zero where they are not available.
+struct Sample {
+  double seconds;
+  std::uint64_t rss_bytes;
+  // Bytes obtained from the system by the allocator, bytes in use by the
+  // program, and bytes free within what was obtained.
+  std::uint64_t heap_bytes;
+  std::uint64_t heap_in_use_bytes;
+  std::uint64_t heap_free_bytes;
+  std::uint64_t buffered_traces;
+};
+
+std::uint64_t resident_set_bytes() {
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  std::uint64_t size = 0;
+  std::uint64_t resident = 0;
+  statm >> size >> resident;
+  return resident * std::uint64_t(::sysconf(_SC_PAGESIZE));
+#else
+  // This is the peak, rather than the current, resident set size, which is
+  // enough to detect growth.
+  rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return std::uint64_t(usage.ru_maxrss);
+#else
+  return std::uint64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+void sample_heap(Sample& sample) {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  const struct mallinfo2 info = ::mallinfo2();
+  // `arena` is the main heap, and `hblkhd` is memory mapped for large blocks.
+  sample.heap_bytes = info.arena + info.hblkhd;
+  sample.heap_in_use_bytes = info.uordblks + info.hblkhd;
+  sample.heap_free_bytes = info.fordblks;
+#else
+  sample.heap_bytes = 0;
+  sample.heap_in_use_bytes = 0;
+  sample.heap_free_bytes = 0;
+#endif
+}
+
+// Return the slope, per second, of the least squares line through the
+// specified `values` at the `seconds` of the specified `samples`.
+template <typename Value>
+double slope(const std::vector<Sample>& samples, Value value) {
+  const double n = double(samples.size());
+  if (n < 2) {
+    return 0;
+  }
+  double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+  for (const Sample& sample : samples) {
+    const double x = sample.seconds;
+    const double y = double(value(sample));
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+  }
+  const double denominator = n * sum_xx - sum_x * sum_x;
+  return denominator == 0 ? 0 : (n * sum_xy - sum_x * sum_y) / denominator;
+}
+
+// `RequestHeaders` is a `DictReader` over the headers of an incoming
+// request, whose trace context is in the Datadog style.
+struct RequestHeaders : public dd::DictReader {
+  std::string trace_id;
+  std::string parent_id;
+
+  dd::Optional<dd::StringView> lookup(dd::StringView key) const override {
+    if (key == "x-datadog-trace-id") return dd::StringView(trace_id);
+    if (key == "x-datadog-parent-id") return dd::StringView(parent_id);
+    if (key == "x-datadog-sampling-priority") return dd::StringView("1");
+    if (key == "x-datadog-origin") return dd::StringView("rum");
+    if (key == "x-datadog-tags") return dd::StringView("_dd.p.dm=-4");
+    return dd::nullopt;
+  }
+
+  void visit(Visitor visitor) const override {
+    for (const char* key :
+         {"x-datadog-trace-id", "x-datadog-parent-id",
+          "x-datadog-sampling-priority", "x-datadog-origin",
+          "x-datadog-tags"}) {
+      visitor(key, *lookup(key));
+    }
+  }
+};
+
+// Handle one simulated request, numbered `request`, whose trace context is
+// drawn from the specified `random`.  The URL, user agent, and number of
+// children vary, and one request in fifty records an error.
+void handle_request(dd::Tracer& tracer, std::mt19937_64& random,
+                    std::uint64_t request) {
+  RequestHeaders headers;
+  headers.trace_id = std::to_string(random() >> 1);
+  headers.parent_id = std::to_string(random() >> 1);
+  auto root = tracer.extract_or_create_span(headers);
+  const std::string order = std::to_string(request % 100000);
+  root.set_resource_name("GET /api/v2/orders/{order_id}");
+  root.set_tag("http.method", "GET");
+  root.set_tag("http.route", "/api/v2/orders/{order_id}");
+  root.set_tag("http.url",
+               "https://orders.internal:8080/api/v2/orders/" + order);
+  root.set_tag("http.useragent",
+               "soak/" + std::to_string(request % 7) + ".0");
+  root.set_tag("span.kind", "server");
+
+  dd::HeaderMap outbound;
+  const std::uint64_t children = 2 + request % 8;
+  for (std::uint64_t i = 0; i < children; ++i) {
+    dd::SpanConfig config;
+    config.name = "postgres.query";
+    config.resource = "SELECT * FROM orders WHERE id = ?";
+    auto child = root.create_child(std::move(config));
+    child.set_tag("db.system", "postgresql");
+    child.set_tag("db.row_count", std::to_string(random() % 1000));
+    child.set_tag("out.host", "db-" + std::to_string(i % 4) + ".internal");
+    if (i % 3 == 0) {
+      outbound.clear();
+      child.inject(outbound);
+    }
+  }
+
+  if (request % 50 == 0) {
+    root.set_error_message("order " + order + " not found");
+    root.set_error_type("NotFound");
+    root.set_error_stack("#0 find_order\n#1 handle_get\n#2 serve\n");
+    root.set_tag("http.status_code", "404");
+  } else {
+    root.set_tag("http.status_code", "200");
+  }
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string flag = argv[i];
+    if (i + 1 == argc) {
+      std::cerr << "Missing value for " << flag << '\n';
+      return false;
+    }
+    const char* value = argv[++i];
+    if (flag == "--duration") {
+      options.duration = std::chrono::seconds(std::atoll(value));
+    } else if (flag == "--interval") {
+      options.interval = std::chrono::seconds(std::atoll(value));
+    } else if (flag == "--threads") {
+      options.threads = std::atoi(value);
+    } else if (flag == "--rate") {
+      options.rate = std::atof(value);
+    } else if (flag == "--max-growth") {
+      options.max_growth_mib_per_hour = std::atof(value);
+    } else {
+      std::cerr << "Unknown option " << flag << '\n';
+      return false;
+    }
+  }
+  if (options.duration.count() <= 0 || options.interval.count() <= 0 ||
+      options.threads <= 0 || options.rate < 0) {
+    std::cerr << "Durations, intervals, and threads must be positive.\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    std::cerr << "usage: " << argv[0]
+              << " [--duration SECONDS] [--interval SECONDS] [--threads N]"
+                 " [--rate TRACES_PER_SECOND] [--max-growth MIB_PER_HOUR]\n";
+    return 2;
+  }
+
+  const auto agent = std::make_shared<MockAgent>();
+  const auto logger = std::make_shared<NullLogger>();
+  dd::TracerConfig config;
+  config.service = "soak";
+  config.environment = "soak";
+  config.logger = logger;
+  config.agent.http_client = agent;
+  config.agent.remote_configuration_enabled = false;
+  // Every trace is kept, so that every trace reaches the mock agent.
+  dd::TraceSamplerConfig::Rule keep_all;
+  keep_all.sample_rate = 1.0;
+  config.trace_sampler.rules.push_back(keep_all);
+  auto finalized = dd::finalize_config(config);
+  if (!finalized) {
+    std::cerr << "Invalid configuration: " << finalized.error() << '\n';
+    return 2;
+  }
+
+  std::atomic<std::uint64_t> finished{0};
+  std::atomic<bool> stop{false};
+  std::vector<Sample> samples;
+  {
+    dd::Tracer tracer{*finalized};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < options.threads; ++t) {
+      workers.emplace_back([&, t]() {
+        std::mt19937_64 random(t);
+        // Each thread paces itself to its share of the rate.
+        const auto period =
+            options.rate == 0
+                ? std::chrono::nanoseconds(0)
+                : std::chrono::nanoseconds(std::int64_t(
+                      1e9 * options.threads / options.rate));
+        auto next = std::chrono::steady_clock::now();
+        for (std::uint64_t request = t; !stop; request += options.threads) {
+          handle_request(tracer, random, request);
+          ++finished;
+          if (period.count() != 0) {
+            next += period;
+            std::this_thread::sleep_until(next);
+          }
+        }
+      });
+    }
+
+    std::cout << "seconds,traces,rss_bytes,heap_bytes,heap_in_use_bytes,"
+                 "heap_free_bytes,fragmentation,buffered_traces\n";
+    const auto start = std::chrono::steady_clock::now();
+    for (auto when = start + options.interval;
+         when <= start + options.duration; when += options.interval) {
+      std::this_thread::sleep_until(when);
+      Sample sample;
+      sample.seconds =
+          std::chrono::duration<double>(when - start).count();
+      sample.rss_bytes = resident_set_bytes();
+      sample_heap(sample);
+      const std::uint64_t traces = finished;
+      const std::uint64_t received = agent->traces;
+      sample.buffered_traces = traces > received ? traces - received : 0;
+      samples.push_back(sample);
+      // Fragmentation is the fraction of the heap that is free.
+      const double fragmentation =
+          sample.heap_bytes == 0
+              ? 0
+              : double(sample.heap_free_bytes) / double(sample.heap_bytes);
+      std::printf("%.0f,%llu,%llu,%llu,%llu,%llu,%.3f,%llu\n", sample.seconds,
+                  (unsigned long long)traces,
+                  (unsigned long long)sample.rss_bytes,
+                  (unsigned long long)sample.heap_bytes,
+                  (unsigned long long)sample.heap_in_use_bytes,
+                  (unsigned long long)sample.heap_free_bytes, fragmentation,
+                  (unsigned long long)sample.buffered_traces);
+      std::fflush(stdout);
+    }
+
+    stop = true;
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+
+  // The first fifth of the run, or the first two samples if there are fewer
+  // than ten, is warm-up: caches, pools, and the heap grow to their working
+  // size then.
+  const std::size_t warm_up =
+      samples.size() < 10 ? std::min<std::size_t>(2, samples.size())
+                          : samples.size() / 5;
+  const std::vector<Sample> steady(samples.begin() + warm_up, samples.end());
+  const double per_hour = 3600.0 / (1024 * 1024);
+  const double rss_growth =
+      per_hour * slope(steady, [](const Sample& s) { return s.rss_bytes; });
+  const double heap_growth = per_hour * slope(steady, [](const Sample& s) {
+                               return s.heap_in_use_bytes;
+                             });
+  const double buffered_growth =
+      3600.0 *
+      slope(steady, [](const Sample& s) { return s.buffered_traces; });
+
+  std::cerr << "traces finished: " << finished
+            << "\ntraces received by the agent: " << agent->traces
+            << "\nrequests to the agent: " << agent->requests
+            << "\nerrors logged: " << logger->errors
+            << "\nRSS growth after warm-up: " << rss_growth << " MiB/hour"
+            << "\nheap growth after warm-up: " << heap_growth << " MiB/hour"
+            << "\nbuffered trace growth after warm-up: " << buffered_growth
+            << " traces/hour\n";
+
+  if (steady.size() < 2) {
+    std::cerr << "Too few samples after warm-up to detect growth.\n";
+    return 0;
+  }
+  bool grew = false;
+  if (rss_growth > options.max_growth_mib_per_hour) {
+    std::cerr << "GROWTH: the resident set size grew faster than "
+              << options.max_growth_mib_per_hour << " MiB/hour.\n";
+    grew = true;
+  }
+  if (heap_growth > options.max_growth_mib_per_hour) {
+    std::cerr << "GROWTH: the heap in use grew faster than "
+              << options.max_growth_mib_per_hour << " MiB/hour.\n";
+    grew = true;
+  }
+  return grew ? 1 : 0;
+}
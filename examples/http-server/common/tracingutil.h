@@ -34,9 +34,7 @@ class HeaderReader : public datadog::tracing::DictReader {
  public:
   explicit HeaderReader(const httplib::Headers& headers) : headers_(headers) {}
 
-  void visit(
-      const std::function<void(std::string_view key, std::string_view value)>&
-          visitor) const override {
+  void visit(Visitor visitor) const override {
     for (const auto& [key, value] : headers_) {
       visitor(key, value);
     }
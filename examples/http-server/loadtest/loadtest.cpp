@@ -0,0 +1,383 @@
+// This is a load test that measures the cost of tracing per request in a
+// setup like that of the docker compose services: a proxy that forwards
+// requests to a server, where both are traced.
+//
+// Everything runs in this process, on the loopback interface:
+//
+// - a mock Datadog Agent that accepts and discards `/v0.4/traces`,
+// - an upstream server that handles `GET /notes` with a child span,
+// - a proxy that forwards all requests to the upstream server, and
+// - a load generator that sends `GET /notes` to the proxy from several
+//   connections at once.
+//
+// The load test runs three times: with tracing disabled (the handlers don't
+// call the tracer at all), with tracing enabled and a `NullCollector`, and
+// with tracing enabled and a `DatadogAgent` sending traces to the mock agent.
+// For each, it prints the throughput, the median and 99th percentile request
+// latency, and the CPU time used by the process per request.  The difference
+// between a traced run and the untraced run is the tracing tax per request.
+//
+// Usage:
+//
+//     http-loadtest-example [<requests> [<connections>]]
+//
+// By default, 20000 requests are sent over 8 connections, after 1000
+// requests to warm up.
+
+#include <datadog/null_collector.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httplib.h"
+#include "tracingutil.h"
+
+// Alias the datadog namespace for brevity.
+namespace dd = datadog::tracing;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// `Mode` is how the proxy and the upstream server are traced.
+enum class Mode { untraced, null_collector, datadog_agent };
+
+const char* to_string(Mode mode) {
+  switch (mode) {
+    case Mode::untraced:
+      return "disabled";
+    case Mode::null_collector:
+      return "NullCollector";
+    case Mode::datadog_agent:
+      return "DatadogAgent";
+  }
+  return "";
+}
+
+// `MockAgent` is an HTTP server that accepts and discards whatever the tracer
+// sends it, and counts the trace payloads.
+class MockAgent {
+  httplib::Server server_;
+  std::thread thread_;
+  int port_;
+
+ public:
+  std::atomic<std::size_t> payloads{0};
+  std::atomic<std::size_t> payload_bytes{0};
+
+  MockAgent() {
+    const auto traces = [this](const httplib::Request& request,
+                               httplib::Response& response) {
+      ++payloads;
+      payload_bytes += request.body.size();
+      response.set_content(R"({"rate_by_service": {}})", "application/json");
+    };
+    server_.Put("/v0.4/traces", traces);
+    server_.Post("/v0.4/traces", traces);
+    // Telemetry and anything else are accepted too.
+    const auto other = [](const httplib::Request&,
+                          httplib::Response& response) {
+      response.set_content("{}", "application/json");
+    };
+    server_.Get(".*", other);
+    server_.Post(".*", other);
+    server_.Put(".*", other);
+
+    port_ = server_.bind_to_any_port("127.0.0.1");
+    thread_ = std::thread([this]() { server_.listen_after_bind(); });
+    server_.wait_until_ready();
+  }
+
+  ~MockAgent() {
+    server_.stop();
+    thread_.join();
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port_);
+  }
+};
+
+// Return a tracer for the specified `service`, configured for the specified
+// `mode`, or return `std::nullopt` if `mode` is `Mode::untraced`.
+std::optional<dd::Tracer> make_tracer(Mode mode, const std::string& service,
+                                      const MockAgent& agent) {
+  if (mode == Mode::untraced) {
+    return std::nullopt;
+  }
+
+  dd::TracerConfig config;
+  config.service = service;
+  config.log_on_startup = false;
+  if (mode == Mode::null_collector) {
+    config.collector = std::make_shared<dd::NullCollector>();
+  } else {
+    config.agent.url = agent.url();
+  }
+
+  auto finalized_config = dd::finalize_config(config);
+  if (dd::Error* error = finalized_config.if_error()) {
+    std::cerr << "Error: Datadog is misconfigured. " << *error << '\n';
+    std::exit(1);
+  }
+  return std::optional<dd::Tracer>{std::in_place, *finalized_config};
+}
+
+// `Service` is an HTTP server, listening on an ephemeral loopback port, that
+// handles requests on its own threads.
+class Service {
+  httplib::Server server_;
+  std::thread thread_;
+  int port_ = 0;
+
+ public:
+  httplib::Server& server() { return server_; }
+
+  void start() {
+    port_ = server_.bind_to_any_port("127.0.0.1");
+    thread_ = std::thread([this]() { server_.listen_after_bind(); });
+    server_.wait_until_ready();
+  }
+
+  int port() const { return port_; }
+
+  ~Service() {
+    server_.stop();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+};
+
+// Install a handler for `GET /notes` on the specified `upstream`, traced by
+// the specified `tracer` if it has a value.  The handler does a little work in
+// a child span, as the real server does when it queries its database.
+void install_upstream(httplib::Server& upstream,
+                      std::optional<dd::Tracer>& tracer) {
+  upstream.Get("/notes", [&tracer](const httplib::Request& req,
+                                   httplib::Response& res) {
+    const auto render = []() {
+      std::string body = "[";
+      for (int i = 0; i < 10; ++i) {
+        if (i) {
+          body += ',';
+        }
+        body += R"(["2023-05-12 16:18:37","note )" + std::to_string(i) + "\"]";
+      }
+      body += ']';
+      return body;
+    };
+
+    if (!tracer) {
+      res.set_content(render(), "application/json");
+      return;
+    }
+
+    tracingutil::HeaderReader reader(req.headers);
+    auto span = tracer->extract_or_create_span(reader);
+    span.set_name("handle.request");
+    span.set_resource_name(req.method + " " + req.path);
+    span.set_tag("http.route", req.path);
+    span.set_tag("http.method", req.method);
+    {
+      auto child = span.create_child();
+      child.set_name("notes.render");
+      res.set_content(render(), "application/json");
+    }
+    span.set_tag("http.status_code", std::to_string(res.status));
+  });
+}
+
+// Install a handler on the specified `proxy` that forwards requests to the
+// specified `upstream_port`, traced by the specified `tracer` if it has a
+// value.  The handler is that of `proxy.cpp`.
+void install_proxy(httplib::Server& proxy, int upstream_port,
+                   std::optional<dd::Tracer>& tracer) {
+  proxy.Get(".*", [&tracer, upstream_port](const httplib::Request& req,
+                                           httplib::Response& res) {
+    httplib::Client upstream_client("127.0.0.1", upstream_port);
+    httplib::Error er;
+    httplib::Request forward_request(req);
+    forward_request.path = req.target;
+
+    if (!tracer) {
+      upstream_client.send(forward_request, res, er);
+      if (er != httplib::Error::Success) {
+        res.status = 500;
+      }
+      return;
+    }
+
+    tracingutil::HeaderReader reader(req.headers);
+    auto span = tracer->extract_or_create_span(reader);
+    span.set_name("forward.request");
+    span.set_resource_name(req.method + " " + req.path);
+    span.set_tag("network.origin.ip", req.remote_addr);
+    span.set_tag("network.origin.port", std::to_string(req.remote_port));
+    span.set_tag("http.url_details.path", req.target);
+    span.set_tag("http.route", req.path);
+    span.set_tag("http.method", req.method);
+
+    tracingutil::HeaderWriter writer(forward_request.headers);
+    span.inject(writer);
+
+    upstream_client.send(forward_request, res, er);
+    if (er != httplib::Error::Success) {
+      res.status = 500;
+      span.set_error_message(httplib::to_string(er));
+    }
+    span.set_tag("http.status_code", std::to_string(res.status));
+  });
+}
+
+// Return the process's user plus system CPU time.
+std::chrono::microseconds cpu_time() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const auto to_micros = [](const timeval& time) {
+    return std::chrono::seconds(time.tv_sec) +
+           std::chrono::microseconds(time.tv_usec);
+  };
+  return to_micros(usage.ru_utime) + to_micros(usage.ru_stime);
+}
+
+struct Result {
+  double requests_per_second;
+  double p50_micros;
+  double p99_micros;
+  double cpu_micros_per_request;
+  std::size_t failures;
+};
+
+// Send the specified number of `requests` of `GET /notes` to the specified
+// `proxy_port`, divided among the specified number of `connections`, and
+// return the measurements.
+Result generate_load(int proxy_port, std::size_t requests,
+                     std::size_t connections) {
+  std::vector<std::vector<Clock::duration>> latencies(connections);
+  std::atomic<std::size_t> failures{0};
+  std::vector<std::thread> threads;
+
+  const auto cpu_before = cpu_time();
+  const auto before = Clock::now();
+  for (std::size_t i = 0; i < connections; ++i) {
+    const std::size_t count =
+        requests / connections + (i < requests % connections);
+    threads.emplace_back([&, i, count]() {
+      httplib::Client client("127.0.0.1", proxy_port);
+      client.set_keep_alive(true);
+      latencies[i].reserve(count);
+      for (std::size_t j = 0; j < count; ++j) {
+        const auto start = Clock::now();
+        auto response = client.Get("/notes");
+        latencies[i].push_back(Clock::now() - start);
+        if (!response || response->status != 200) {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto elapsed = Clock::now() - before;
+  const auto cpu = cpu_time() - cpu_before;
+
+  std::vector<Clock::duration> all;
+  all.reserve(requests);
+  for (const auto& some : latencies) {
+    all.insert(all.end(), some.begin(), some.end());
+  }
+  std::sort(all.begin(), all.end());
+  const auto micros = [](Clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+  };
+
+  Result result;
+  result.requests_per_second =
+      requests / std::chrono::duration<double>(elapsed).count();
+  result.p50_micros = micros(all[all.size() / 2]);
+  result.p99_micros = micros(all[all.size() * 99 / 100]);
+  result.cpu_micros_per_request = double(cpu.count()) / requests;
+  result.failures = failures;
+  return result;
+}
+
+Result run(Mode mode, MockAgent& agent, std::size_t requests,
+           std::size_t connections) {
+  // Declare the tracers before the services, so that the services' threads
+  // are stopped before the tracers are destroyed.
+  auto upstream_tracer =
+      make_tracer(mode, "dd-trace-cpp-http-loadtest-server", agent);
+  auto proxy_tracer =
+      make_tracer(mode, "dd-trace-cpp-http-loadtest-proxy", agent);
+
+  Service upstream;
+  install_upstream(upstream.server(), upstream_tracer);
+  upstream.start();
+
+  Service proxy;
+  install_proxy(proxy.server(), upstream.port(), proxy_tracer);
+  proxy.start();
+
+  generate_load(proxy.port(), std::max<std::size_t>(requests / 20, 1),
+                connections);
+  return generate_load(proxy.port(), requests, connections);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t requests = 20000;
+  std::size_t connections = 8;
+  if (argc > 1) {
+    requests = std::strtoul(argv[1], nullptr, 10);
+  }
+  if (argc > 2) {
+    connections = std::strtoul(argv[2], nullptr, 10);
+  }
+  if (requests == 0 || connections == 0) {
+    std::cerr << "usage: " << argv[0] << " [<requests> [<connections>]]\n";
+    return 1;
+  }
+
+  MockAgent agent;
+  std::printf("%zu requests over %zu connections\n\n", requests, connections);
+  std::printf("%-14s %10s %10s %10s %12s %12s\n", "tracing", "req/s",
+              "p50 (us)", "p99 (us)", "CPU/req (us)", "tax (us)");
+
+  double untraced_cpu = 0;
+  for (const Mode mode :
+       {Mode::untraced, Mode::null_collector, Mode::datadog_agent}) {
+    const Result result = run(mode, agent, requests, connections);
+    if (mode == Mode::untraced) {
+      untraced_cpu = result.cpu_micros_per_request;
+    }
+    std::printf("%-14s %10.0f %10.1f %10.1f %12.1f %12.1f\n", to_string(mode),
+                result.requests_per_second, result.p50_micros,
+                result.p99_micros, result.cpu_micros_per_request,
+                result.cpu_micros_per_request - untraced_cpu);
+    if (result.failures) {
+      std::printf("  (%zu requests failed)\n", result.failures);
+    }
+  }
+
+  std::printf("\nThe mock agent received %zu trace payloads (%zu bytes).\n",
+              agent.payloads.load(), agent.payload_bytes.load());
+  return 0;
+}
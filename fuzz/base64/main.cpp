@@ -2,10 +2,15 @@
 #include <datadog/string_view.h>
 
 #include <cstdint>
+#include <cstdlib>
 
 namespace dd = datadog::tracing;
 
 extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, size_t size) {
-  dd::base64_decode(dd::StringView{(const char*)data, size});
+  const dd::StringView input{(const char*)data, size};
+  // The vectorized decoder must agree with the scalar decoder.
+  if (dd::base64_decode(input) != dd::base64_decode_scalar(input)) {
+    std::abort();
+  }
   return 0;
 }
@@ -1,15 +1,18 @@
 #include <datadog/dict_reader.h>
 #include <datadog/dict_writer.h>
+#include <datadog/extracted_data.h>
 #include <datadog/null_collector.h>
 #include <datadog/optional.h>
 #include <datadog/parse_util.h>
 #include <datadog/string_view.h>
 #include <datadog/tracer.h>
+#include <datadog/w3c_propagation.h>
 
 #include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <memory>
+#include <regex>
 #include <string>
 #include <unordered_map>
 
@@ -48,9 +51,7 @@ struct MockDictReader : public dd::DictReader {
     return dd::nullopt;
   }
 
-  void visit(
-      const std::function<void(dd::StringView key, dd::StringView value)>&
-          visitor) const override {
+  void visit(Visitor visitor) const override {
     visitor("traceparent", traceparent);
     visitor("tracestate", tracestate);
   }
@@ -60,6 +61,64 @@ struct MockDictWriter : public dd::DictWriter {
   void set(dd::StringView, dd::StringView) override {}
 };
 
+// `reference_parse_traceparent` is the `std::regex` based parser that
+// `dd::parse_traceparent` replaced.  The two must agree on every input.
+dd::Optional<std::string> reference_parse_traceparent(
+    dd::ExtractedData& result, dd::StringView traceparent) {
+  static const std::regex regex{
+      "([0-9a-f]{2})"
+      "-"
+      "([0-9a-f]{32})"
+      "-"
+      "([0-9a-f]{16})"
+      "-"
+      "([0-9a-f]{2})"
+      "($|-.*)"};
+
+  std::cmatch match;
+  if (!std::regex_match(traceparent.data(),
+                        traceparent.data() + traceparent.size(), match,
+                        regex)) {
+    return "malformed_traceparent";
+  }
+
+  const auto group = [&](std::size_t index) {
+    return dd::StringView(traceparent.data() + match.position(index),
+                          std::size_t(match.length(index)));
+  };
+
+  if (group(1) == "ff") {
+    return "invalid_version";
+  }
+  if (group(1) == "00" && !group(5).empty()) {
+    return "malformed_traceparent";
+  }
+  result.trace_id = *dd::TraceID::parse_hex(group(2));
+  if (result.trace_id == 0) {
+    return "trace_id_zero";
+  }
+  result.parent_id = *dd::parse_uint64(group(3), 16);
+  if (*result.parent_id == 0) {
+    return "parent_id_zero";
+  }
+  result.sampling_priority = int(*dd::parse_uint64(group(4), 16) & 1);
+  return dd::nullopt;
+}
+
+// Abort if `dd::parse_traceparent` and `reference_parse_traceparent` disagree
+// about the specified `traceparent`.
+void check_traceparent(dd::StringView traceparent) {
+  dd::ExtractedData actual;
+  dd::ExtractedData expected;
+  if (dd::parse_traceparent(actual, traceparent) !=
+          reference_parse_traceparent(expected, traceparent) ||
+      actual.trace_id != expected.trace_id ||
+      actual.parent_id != expected.parent_id ||
+      actual.sampling_priority != expected.sampling_priority) {
+    std::abort();
+  }
+}
+
 }  // namespace
 
 extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, size_t size) {
@@ -75,6 +134,8 @@ extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, size_t size) {
     reader.tracestate =
         dd::StringView(begin_tracestate, end - begin_tracestate);
 
+    check_traceparent(reader.traceparent);
+
     const auto span = tracer.extract_span(reader);
     if (!span) {
       continue;
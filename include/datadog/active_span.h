@@ -0,0 +1,99 @@
+#pragma once
+
+// This component provides a per-thread record of the active span, for
+// correlating a sampling profiler's samples with traces.
+//
+// A profiler that samples a thread's stack, e.g. from a `SIGPROF` handler or
+// from another thread or process, can attribute the sample to the span and
+// endpoint that the thread was working on, but only if it can find that span
+// without calling into the tracer.  `ActiveSpanSlot` is that record: a small
+// block of memory per thread, at an address that does not change for the
+// life of the thread, containing the trace ID, span ID, and local root span
+// ID of the span that the thread most recently activated.
+//
+// The tracer does not know which span a thread is working on, so the
+// application says so with an `ActiveSpanGuard`:
+//
+//     void handle(Request& request) {
+//       Span span = tracer.extract_or_create_span(request.headers());
+//       ActiveSpanGuard active{span};
+//       // Profiler samples of this thread are attributed to `span` until
+//       // `active` is destroyed, at which point the previously active
+//       // span, if any, is active again.
+//       ...
+//     }
+//
+// Guards must be destroyed on the thread that created them, in the reverse
+// order of their creation, as local variables are.  A coroutine that is
+// suspended while a guard is alive might resume on another thread, so a
+// coroutine should instead use `SpanScope` (see `coroutine.h`) and activate
+// a guard only between suspension points.
+//
+// Updating the slot costs a few plain stores, and nothing is updated unless
+// a guard is used.  A reader uses `ActiveSpanSlot::read`, which never blocks
+// or allocates, and so may be called from a signal handler that interrupted
+// the thread while it was updating the slot.  A reader in another process,
+// e.g. an eBPF-based profiler, instead follows the same protocol on the raw
+// memory: `sequence` is odd while the slot is being updated, and changes
+// whenever it is updated, so a copy of the IDs taken between two equal, even
+// readings of `sequence` is consistent.  The fields are 64-bit integers in
+// the order declared, with no padding.
+//
+// The first use of a thread's slot, e.g. by `active_span_slot`, might
+// allocate the thread's storage for thread-local variables.  A profiler
+// that reads slots from a signal handler should therefore call
+// `active_span_slot` on each thread before sampling it, e.g. when it
+// registers the thread, and keep the returned address.
+
+#include <atomic>
+#include <cstdint>
+
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+class Span;
+
+struct ActiveSpanSlot {
+  // The IDs of a span, all zero if no span is active.
+  struct Value {
+    TraceID trace_id;
+    std::uint64_t span_id = 0;
+    std::uint64_t local_root_id = 0;
+  };
+
+  std::atomic<std::uint64_t> sequence{0};
+  std::atomic<std::uint64_t> trace_id_low{0};
+  std::atomic<std::uint64_t> trace_id_high{0};
+  std::atomic<std::uint64_t> span_id{0};
+  std::atomic<std::uint64_t> local_root_id{0};
+
+  // Store the specified `value`.  Only the slot's own thread may call this
+  // function.
+  void write(const Value& value);
+  // Copy the slot's IDs into the specified `value` and return `true`, or
+  // return `false` if the slot was being written, in which case `value` is
+  // not meaningful.  This function is async-signal-safe, and may be called
+  // on any thread.
+  bool read(Value& value) const;
+};
+
+// Return the calling thread's `ActiveSpanSlot`.
+ActiveSpanSlot& active_span_slot();
+
+// `ActiveSpanGuard` makes a span the active span of the calling thread's
+// `ActiveSpanSlot` until the guard is destroyed.
+class ActiveSpanGuard {
+  ActiveSpanSlot* slot_;
+  ActiveSpanSlot::Value previous_;
+
+ public:
+  explicit ActiveSpanGuard(const Span& span);
+  ActiveSpanGuard(const ActiveSpanGuard&) = delete;
+  ActiveSpanGuard& operator=(const ActiveSpanGuard&) = delete;
+  ~ActiveSpanGuard();
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,38 @@
+#pragma once
+
+// This component provides functions that make the keep/drop decisions of
+// probabilistic trace sampling for many traces at once, such as when recorded
+// traces are sampled again offline.  A trace is kept at a sample rate if and
+// only if a `TraceSampler` that samples the trace at that rate would keep it.
+//
+// The functions take the lower 64 bits of each trace ID, which are all that
+// the decision depends on, and produce a bit mask: bit `i % 64` of
+// `keep[i / 64]` is set if the `i`th trace is kept, and clear otherwise.
+// Unused bits of the last element of the mask are clear.  The decisions are
+// evaluated without branching on the trace IDs, so that the compiler can
+// vectorize them.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "rate.h"
+
+namespace datadog {
+namespace tracing {
+
+// Decide whether to keep each of the traces whose IDs are the specified
+// `count` `trace_ids`, sampled at the specified `rate`.  Store the decisions
+// in the specified `keep`, which must have room for `(count + 63) / 64`
+// elements.
+void keep_by_rate(const std::uint64_t* trace_ids, std::size_t count,
+                  Rate rate, std::uint64_t* keep);
+
+// Decide whether to keep each of the traces whose IDs are the specified
+// `count` `trace_ids`, where the trace `trace_ids[i]` is sampled at the
+// specified `rates[i]`.  Store the decisions in the specified `keep`, which
+// must have room for `(count + 63) / 64` elements.
+void keep_by_rates(const std::uint64_t* trace_ids, const Rate* rates,
+                   std::size_t count, std::uint64_t* keep);
+
+}  // namespace tracing
+}  // namespace datadog
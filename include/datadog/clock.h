@@ -18,6 +18,14 @@
 // `Clock` is an alias for `std::function<TimePoint()>`, and the default
 // `Clock`, `default_clock`, gives a `TimePoint` using the
 // `std::chrono::system_clock` and `std::chrono::steady_clock`.
+//
+// `fast_clock` is an alternative `Clock` that reads only the
+// `std::chrono::steady_clock`, and derives the wall time from an offset
+// between the two clocks that it samples at most once a second.  It halves the
+// number of clock reads per span, which matters on hosts where reading a clock
+// is a system call.  The trade-off is that an adjustment to the system clock
+// is reflected in span start times up to a second late.  To use it, pass it to
+// `finalize_config`.
 
 #include <chrono>
 #include <functional>
@@ -55,6 +63,7 @@ inline TimePoint& operator+=(TimePoint& self, Duration offset) {
 using Clock = std::function<TimePoint()>;
 
 extern const Clock default_clock;
+extern const Clock fast_clock;
 
 }  // namespace tracing
 }  // namespace datadog
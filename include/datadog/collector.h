@@ -14,10 +14,12 @@
 #include <vector>
 
 #include "expected.h"
+#include "pressure.h"
 
 namespace datadog {
 namespace tracing {
 
+struct ChunkTags;
 struct SpanData;
 class TraceSampler;
 
@@ -31,6 +33,22 @@ class Collector {
       std::vector<std::unique_ptr<SpanData>>&& spans,
       const std::shared_ptr<TraceSampler>& response_handler) = 0;
 
+  // Submit ownership of the specified `spans` to the collector, as above.
+  // Each of the `spans` is additionally to be tagged with the specified
+  // `chunk_tags`, which the caller has not added to the spans themselves.  The
+  // default implementation adds `chunk_tags` to each span and then calls the
+  // two-argument overload of `send`.  Collectors that serialize spans can
+  // override this overload to write `chunk_tags` directly instead.
+  virtual Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const ChunkTags& chunk_tags,
+      const std::shared_ptr<TraceSampler>& response_handler);
+
+  // Return how far this collector is falling behind the spans sent to it.
+  // This function must be cheap and must not block, since it might be called
+  // for every span.  The default implementation returns `Pressure::NORMAL`.
+  virtual Pressure pressure() const;
+
   // Return a JSON representation of this object's configuration. The JSON
   // representation is an object with the following properties:
   //
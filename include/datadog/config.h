@@ -25,6 +25,10 @@ enum class ConfigName : char {
   TRACE_SAMPLING_LIMIT,
   TRACE_SAMPLING_RULES,
   SPAN_SAMPLING_RULES,
+  FLUSH_INTERVAL,
+  MAX_BUFFERED_BYTES,
+  MAX_SPANS_PER_TRACE,
+  COMPRESSION_ENABLED,
 };
 
 // Represents metadata for configuration parameters
@@ -0,0 +1,183 @@
+#pragma once
+
+// This component provides facilities for tracing C++20 coroutines: a class,
+// `SpanScope`, that tracks the active span of a coroutine, a base class for
+// promise types, `SpanScopePromise`, that gives each coroutine a `SpanScope`,
+// and an awaitable, `this_span_scope`, that finds that `SpanScope` from inside
+// the coroutine.
+//
+// A coroutine can be suspended on one thread and resumed on another, so a
+// thread-local "active span" does not follow it across `co_await`.  Instead,
+// the active span is kept in the coroutine's frame, as a `SpanContext`, and so
+// is the same wherever and whenever the coroutine resumes.  There is nothing
+// to save on suspension or to restore on resumption, and no thread-local
+// state is consulted.
+//
+// For example, where `Task` is an application's coroutine type whose promise
+// type derives from `SpanScopePromise`:
+//
+//     Task<void> handle(SpanContext parent, Request request) {
+//       // The active span is `parent`, the coroutine's `SpanContext`
+//       // argument.
+//       SpanScope& scope = co_await this_span_scope;
+//       Optional<Span> span = scope.create_child();
+//       auto activation = scope.activate(*span);
+//       // Children of `scope`, and coroutines called with
+//       // `scope.active()`, are now children of `span`, even after
+//       // resuming on another thread.
+//       co_await fetch(scope.active(), request);
+//     }
+//
+// This library is built as C++17.  This header does not require that the
+// library be built otherwise: it is header-only, and declares nothing unless
+// it is included in a translation unit compiled with coroutine support.
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <type_traits>
+#include <utility>
+
+#include "optional.h"
+#include "span.h"
+#include "span_config.h"
+#include "span_context.h"
+
+namespace datadog {
+namespace tracing {
+
+class SpanScope {
+  SpanContext active_;
+
+ public:
+  // `Activation` makes a span the active span of a `SpanScope` until the
+  // `Activation` is destroyed, at which point the previously active span is
+  // active again.  An `Activation` must not outlive its `SpanScope`, and
+  // activations of the same `SpanScope` must be destroyed in the reverse order
+  // of their creation, as local variables are.
+  class Activation {
+    SpanScope* scope_;
+    SpanContext previous_;
+
+    friend class SpanScope;
+    Activation(SpanScope& scope, SpanContext active)
+        : scope_(&scope), previous_(std::move(scope.active_)) {
+      scope.active_ = std::move(active);
+    }
+
+   public:
+    Activation(Activation&& other) noexcept
+        : scope_(std::exchange(other.scope_, nullptr)),
+          previous_(std::move(other.previous_)) {}
+    Activation(const Activation&) = delete;
+    Activation& operator=(const Activation&) = delete;
+    Activation& operator=(Activation&&) = delete;
+
+    ~Activation() {
+      if (scope_) {
+        scope_->active_ = std::move(previous_);
+      }
+    }
+  };
+
+  // Create a `SpanScope` having no active span, or having the specified
+  // `active` span.
+  SpanScope() = default;
+  explicit SpanScope(SpanContext active) : active_(std::move(active)) {}
+
+  // Return the active span.  It refers to no span if none is active.
+  const SpanContext& active() const { return active_; }
+
+  // Return a child of the active span, configured by the optionally specified
+  // `config`.  Return null if no span is active, or if the active span's trace
+  // segment no longer exists.  See `SpanContext::create_child`.
+  Optional<Span> create_child() const { return active_.create_child(); }
+  Optional<Span> create_child(const SpanConfig& config) const {
+    return active_.create_child(config);
+  }
+  Optional<Span> create_child(SpanConfig&& config) const {
+    return active_.create_child(std::move(config));
+  }
+
+  // Make the specified `span` the active span until the returned
+  // `Activation` is destroyed.
+  [[nodiscard]] Activation activate(const Span& span) {
+    return Activation(*this, span.context());
+  }
+  [[nodiscard]] Activation activate(SpanContext context) {
+    return Activation(*this, std::move(context));
+  }
+};
+
+// `SpanScopePromise` is a base class for the promise type of a coroutine.  It
+// gives each coroutine a `SpanScope`, which `co_await this_span_scope`
+// returns.
+//
+// If the coroutine has a parameter of type `SpanContext` or `Span`, then the
+// coroutine's scope begins with that span active.  If there are several, the
+// first is used.  For this to work, the derived promise type must inherit the
+// constructors of `SpanScopePromise`:
+//
+//     struct promise_type : datadog::tracing::SpanScopePromise {
+//       using SpanScopePromise::SpanScopePromise;
+//       ...
+//     };
+class SpanScopePromise {
+  SpanScope span_scope_;
+
+  template <typename Parameter>
+  bool seed(const Parameter& parameter) {
+    using Type = std::decay_t<Parameter>;
+    if constexpr (std::is_same_v<Type, SpanContext>) {
+      span_scope_ = SpanScope(parameter);
+      return true;
+    } else if constexpr (std::is_same_v<Type, Span>) {
+      span_scope_ = SpanScope(parameter.context());
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+ public:
+  SpanScopePromise() = default;
+  // The compiler calls this constructor with the coroutine's parameters.
+  template <typename... Parameters>
+  explicit SpanScopePromise(const Parameters&... parameters) {
+    (seed(parameters) || ...);
+  }
+
+  SpanScope& span_scope() { return span_scope_; }
+};
+
+// `co_await this_span_scope` evaluates to a reference to the `SpanScope` of
+// the calling coroutine, without suspending it.  The coroutine's promise type
+// must derive from `SpanScopePromise`.
+struct ThisSpanScope {
+  struct Awaiter {
+    SpanScope* scope = nullptr;
+
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      static_assert(std::is_base_of_v<SpanScopePromise, Promise>,
+                    "co_await this_span_scope requires a promise type derived "
+                    "from datadog::tracing::SpanScopePromise.");
+      scope = &handle.promise().span_scope();
+      // Resume immediately.
+      return false;
+    }
+
+    SpanScope& await_resume() const noexcept { return *scope; }
+  };
+
+  Awaiter operator co_await() const noexcept { return Awaiter{}; }
+};
+
+inline constexpr ThisSpanScope this_span_scope{};
+
+}  // namespace tracing
+}  // namespace datadog
+
+#endif  // defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
@@ -12,6 +12,8 @@
 // See `tracer_config.h`.
 
 #include <chrono>
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -23,12 +25,79 @@
 #include "http_client.h"
 #include "remote_config/listener.h"
 #include "string_view.h"
+#include "thread_factory.h"
 
 namespace datadog {
 namespace tracing {
 
 class EventScheduler;
 class Logger;
+class Reactor;
+
+// `TraceAPIVersion` identifies the format in which traces are sent to the
+// Datadog Agent.
+enum class TraceAPIVersion {
+  // "/v0.4/traces": each span is a MessagePack map whose keys and values are
+  // spelled out in full.
+  V0_4,
+  // "/v0.5/traces": each payload has a dictionary of strings, and each span is
+  // a fixed-length MessagePack array that refers to strings by their index in
+  // the dictionary.  If the Datadog Agent does not support v0.5, then the
+  // tracer falls back to v0.4.
+  V0_5,
+  // "/v0.7/traces": each payload is a MessagePack map of the tracer's
+  // attributes, such as its language, runtime ID, environment, and version,
+  // and of the trace chunks.  Each chunk is a map of its sampling priority,
+  // its origin, and its spans, which omit the attributes carried by the
+  // payload or the chunk.  If the Datadog Agent does not support v0.7, then
+  // the tracer falls back to v0.4.
+  V0_7,
+};
+
+// `BufferOverflowPolicy` determines which trace chunks `DatadogAgent` drops
+// when accepting another chunk would exceed its buffer budget.  See
+// `DatadogAgentConfig::max_buffered_bytes`.  Trace chunks encoded for the v0.5
+// trace API share a string table, and so cannot be dropped once buffered; for
+// them, the policy is always `DROP_NEWEST`.
+enum class BufferOverflowPolicy {
+  // Drop the chunk that did not fit.
+  DROP_NEWEST,
+  // Drop the oldest buffered chunks until the new chunk fits.
+  DROP_OLDEST,
+  // Drop buffered chunks whose trace was not sampled, oldest first, until the
+  // new chunk fits.  If the new chunk's trace was not sampled, or if dropping
+  // unsampled chunks does not make enough room, then drop the new chunk.
+  DROP_UNSAMPLED_FIRST,
+  // Rank each chunk: chunks whose trace was kept by the user (sampling
+  // priority 2) or that contain an error rank highest, then other sampled
+  // chunks, then chunks whose trace was not sampled.  Drop buffered chunks of
+  // lower rank than the new chunk, lowest rank and oldest first, until the
+  // new chunk fits; otherwise drop the new chunk.  Also, when a flush produces
+  // more payloads than may be sent at once, put the highest ranked chunks in
+  // the payloads that are sent first.
+  DROP_LOWEST_PRIORITY,
+};
+
+// `FlushReport` describes one request that sent trace chunks to the Datadog
+// Agent.  See `DatadogAgentConfig::on_flush`.
+struct FlushReport {
+  // The number of trace chunks, and of spans, in the request.
+  std::size_t chunks = 0;
+  std::size_t spans = 0;
+  // The size of the request body as sent, after any compression.
+  std::size_t bytes = 0;
+  // How long the flush that sent the request had spent preparing its
+  // payloads, including this one's encoding and compression, when the request
+  // was sent.
+  std::chrono::steady_clock::duration encode_duration{};
+  // How long the request took to complete or fail.
+  std::chrono::steady_clock::duration latency{};
+  // The HTTP status of the response, or zero if there was no response.
+  int status = 0;
+  // The number of trace chunks dropped, because the buffer was full or the
+  // tracer's memory budget was exhausted, since the previous report.
+  std::size_t dropped_chunks = 0;
+};
 
 struct DatadogAgentConfig {
   // The `HTTPClient` used to submit traces to the Datadog Agent.  If this
@@ -41,9 +110,24 @@ struct DatadogAgentConfig {
   // Datadog Agent.  If `event_scheduler` is null, then a
   // `ThreadedEventScheduler` instance will be used instead.
   std::shared_ptr<EventScheduler> event_scheduler = nullptr;
+  // The most worker threads on which the default `ThreadedEventScheduler`
+  // runs the agent's flushes, telemetry, and remote configuration polls.  With
+  // zero workers, they run one at a time on the scheduler's own thread, so a
+  // slow flush delays the others.  Workers are started only as needed.  The
+  // default is zero.  `scheduler_workers` has no effect on an
+  // `event_scheduler` specified by the user, and is overridden by the
+  // `DD_TRACE_SCHEDULER_WORKERS` environment variable.
+  Optional<std::size_t> scheduler_workers;
   // A list of Remote Configuration listeners.
   std::vector<std::shared_ptr<remote_config::Listener>>
       remote_configuration_listeners;
+  // A function invoked once for each request that sends trace chunks to the
+  // Datadog Agent, when the request completes or fails, with a `FlushReport`
+  // describing it.  `on_flush` lets an application monitor the tracer in its
+  // own metrics system.  It is invoked on the thread of the `HTTPClient`,
+  // not on the threads that finish spans, and so it should return promptly.
+  // There is no callback by default.
+  std::function<void(const FlushReport&)> on_flush;
   // A URL at which the Datadog Agent can be contacted.
   // The following formats are supported:
   //
@@ -54,8 +138,54 @@ struct DatadogAgentConfig {
   //
   // The port defaults to 8126 if it is not specified.
   Optional<std::string> url;
+  // URLs, in the formats accepted for `url`, of several Datadog Agents among
+  // which requests carrying trace chunks are divided, so that trace intake is
+  // not limited to what one Datadog Agent can accept.  Requests go to each
+  // agent in turn, skipping for a while any agent whose requests repeatedly
+  // fail or are slow.  The sample rates that the agents return are averaged.
+  // Telemetry, remote configuration, and APM stats are still sent to `url`.
+  // By default, traces are sent to `url` only.  `trace_agent_urls` is
+  // overridden by the `DD_TRACE_AGENT_URLS` environment variable, a comma or
+  // space separated list.
+  Optional<std::vector<std::string>> trace_agent_urls;
+  // The URL of a trace intake to which traces are sent directly, instead of
+  // to a Datadog Agent, for environments where no Agent can run, such as
+  // serverless functions.  The intake must accept the v0.4 trace API at the
+  // URL as given, e.g. "https://intake.example.com/v0.4/traces", and requests
+  // carry `api_key` in the "DD-API-KEY" header.  Traces are batched, buffered,
+  // and retried as they are for an Agent, and are compressed by default if
+  // this library was built with zlib.  Since there is no Agent, sample rates
+  // are not received, and remote configuration, APM stats computation,
+  // telemetry, and the v0.5 and v0.7 trace APIs are disabled.
+  // `agentless_url` is overridden by the `DD_TRACE_AGENTLESS_URL` environment
+  // variable.
+  Optional<std::string> agentless_url;
+  // The Datadog API key with which requests are authenticated when
+  // `agentless_url` is set.  `api_key` is required in that case, and is
+  // otherwise unused.  `api_key` is overridden by the `DD_API_KEY` environment
+  // variable.
+  Optional<std::string> api_key;
   // How often, in milliseconds, to send batches of traces to the Datadog Agent.
+  // If `adaptive_flush_enabled`, this is only the initial interval.  The
+  // "tracing_flush_interval_milliseconds" of remote configuration can
+  // lengthen, but not shorten, the interval at runtime.
   Optional<int> flush_interval_milliseconds;
+  // Whether the interval between flushes adapts to the load.  After each
+  // flush, the interval is lengthened or shortened, by at most a factor of
+  // two, toward one in which about `flush_target_payload_bytes` are buffered.
+  // It is kept at least ten times as long as the flush took, and at least as
+  // long as the latency of the most recent response, and always within
+  // `min_flush_interval_milliseconds` and `max_flush_interval_milliseconds`.
+  // `adaptive_flush_enabled` is false by default, and is overridden by the
+  // `DD_TRACE_AGENT_ADAPTIVE_FLUSH_ENABLED` environment variable.
+  Optional<bool> adaptive_flush_enabled;
+  // The bounds, in milliseconds, of the adaptive flush interval.  The
+  // defaults are 100 and 10000.  Unused unless `adaptive_flush_enabled`.
+  Optional<int> min_flush_interval_milliseconds;
+  Optional<int> max_flush_interval_milliseconds;
+  // The number of bytes of encoded trace chunks that an adaptive flush aims
+  // to send.  The default is 1 MiB.  Unused unless `adaptive_flush_enabled`.
+  Optional<std::size_t> flush_target_payload_bytes;
   // Maximum amount of time an HTTP request is allowed to run.
   Optional<int> request_timeout_milliseconds;
   // Maximum amount of time the process is allowed to wait before shutting down.
@@ -66,13 +196,190 @@ struct DatadogAgentConfig {
   // How often, in seconds, to query the Datadog Agent for remote configuration
   // updates.
   Optional<double> remote_configuration_poll_interval_seconds;
+  // The longest time, in seconds, between queries for remote configuration
+  // updates.  While the Datadog Agent reports no changes, the time between
+  // queries doubles, up to this limit.  It returns to
+  // `remote_configuration_poll_interval_seconds` as soon as a change arrives.
+  // The default is the poll interval, i.e. no back-off, and
+  // `remote_configuration_max_poll_interval_seconds` is overridden by the
+  // `DD_REMOTE_CONFIG_MAX_POLL_INTERVAL_SECONDS` environment variable.
+  Optional<double> remote_configuration_max_poll_interval_seconds;
+  // The trace intake API of the Datadog Agent to which traces are sent: "v0.4"
+  // (the default), "v0.5", or "v0.7".  See `TraceAPIVersion`.
+  // `trace_api_version` is overridden by the `DD_TRACE_API_VERSION`
+  // environment variable.
+  Optional<std::string> trace_api_version;
+  // The maximum total size, in bytes, of encoded trace chunks awaiting the
+  // next flush, including requests awaiting a retry (see `max_retries`).
+  // Chunks beyond this budget are dropped according to
+  // `buffer_overflow_policy`.  The default is 25 MiB, and
+  // `max_buffered_bytes` is overridden by the
+  // `DD_TRACE_WRITER_BUFFER_SIZE_BYTES` environment variable, and at runtime
+  // by the "tracing_max_buffered_bytes" of remote configuration.
+  Optional<std::size_t> max_buffered_bytes;
+  // The maximum total number of spans in trace chunks awaiting the next
+  // flush.  There is no limit by default.  `max_buffered_spans` is overridden
+  // by the `DD_TRACE_WRITER_BUFFER_SIZE_SPANS` environment variable.
+  Optional<std::size_t> max_buffered_spans;
+  // What to drop when the buffer budget is exceeded: "drop_newest" (the
+  // default), "drop_oldest", "drop_unsampled_first", or
+  // "drop_lowest_priority".  See
+  // `BufferOverflowPolicy`.  `buffer_overflow_policy` is overridden by the
+  // `DD_TRACE_WRITER_BUFFER_OVERFLOW_POLICY` environment variable.
+  Optional<std::string> buffer_overflow_policy;
+  // When the encoded trace chunks awaiting submission reach this many bytes,
+  // they are sent without waiting for the next flush interval.  The default
+  // is 4 MiB.  `flush_threshold_bytes` is overridden by the
+  // `DD_TRACE_WRITER_FLUSH_THRESHOLD_BYTES` environment variable.
+  Optional<std::size_t> flush_threshold_bytes;
+  // The maximum size, in bytes, of the body of a request that sends v0.4
+  // trace chunks to the Datadog Agent.  Larger batches are split into several
+  // requests, though a single chunk larger than this is still sent by itself.
+  // The default is 8 MiB, well below the Datadog Agent's limit.
+  // `max_payload_bytes` is overridden by the
+  // `DD_TRACE_WRITER_MAX_PAYLOAD_SIZE_BYTES` environment variable.
+  Optional<std::size_t> max_payload_bytes;
+  // The maximum number of requests sending trace chunks to the Datadog Agent
+  // that may be in progress at the same time.  Requests beyond this limit are
+  // deferred to the next flush, and their chunks continue to count against
+  // `max_buffered_bytes`.  The default is 4.  `max_in_flight_requests` is
+  // overridden by the `DD_TRACE_WRITER_MAX_IN_FLIGHT_REQUESTS` environment
+  // variable.
+  Optional<std::size_t> max_in_flight_requests;
+  // How many more times to send a request of trace chunks that failed due to
+  // a network error or a response status indicating a transient condition
+  // (408, 429, or 5xx).  Retries wait for an exponentially increasing, jittered
+  // delay, and are sent as part of a later flush, together with new chunks
+  // when possible.  While they wait, they count against `max_buffered_bytes`,
+  // and a request that does not fit is dropped.  The default is 3, and zero
+  // disables retries.
+  // `max_retries` is overridden by the `DD_TRACE_WRITER_MAX_RETRIES`
+  // environment variable.
+  Optional<std::size_t> max_retries;
+  // The number of trace requests in a row that must fail before the tracer
+  // considers the Datadog Agent unreachable.  Until the Agent responds again,
+  // new trace chunks are dropped without being encoded, chunks already
+  // buffered stay buffered, and the only trace request sent is an empty
+  // probe, at intervals that grow from `flush_interval_milliseconds` to one
+  // minute.  The default is 5, and zero disables this behavior.
+  // `circuit_breaker_threshold` is overridden by the
+  // `DD_TRACE_WRITER_CIRCUIT_BREAKER_THRESHOLD` environment variable.
+  Optional<std::size_t> circuit_breaker_threshold;
+  // Whether to gzip compress the bodies of requests to the Datadog Agent that
+  // are at least `compression_threshold_bytes` in size.  Compression trades
+  // CPU time for network bandwidth, and so is worthwhile mainly when the
+  // Datadog Agent is on another host.  Compression is disabled by default,
+  // and requires that this library was built with zlib.
+  // `compression_enabled` is overridden by the
+  // `DD_TRACE_WRITER_COMPRESSION_ENABLED` environment variable, and at
+  // runtime by the "tracing_compression_enabled" of remote configuration.
+  Optional<bool> compression_enabled;
+  // The smallest request body that is compressed when `compression_enabled`
+  // is true.  The default is 8 KiB.  `compression_threshold_bytes` is
+  // overridden by the `DD_TRACE_WRITER_COMPRESSION_THRESHOLD_BYTES`
+  // environment variable.
+  Optional<std::size_t> compression_threshold_bytes;
+  // Whether the tracer computes APM stats (hits, errors, and latency
+  // distributions) from its spans and sends them to the Datadog Agent's
+  // `/v0.6/stats` endpoint, rather than leaving their computation to the
+  // Datadog Agent.  Stats are aggregated over ten second buckets, and sent
+  // with the first flush after a bucket ends.  Since the Datadog Agent then
+  // has no use for traces dropped by sampling, they are not sent, which saves
+  // encoding them and most of the network traffic.  Stats computation is
+  // disabled by default.  `stats_computation_enabled` is overridden by the
+  // `DD_TRACE_STATS_COMPUTATION_ENABLED` environment variable.
+  Optional<bool> stats_computation_enabled;
+  // Whether the default HTTP client negotiates HTTP/2, so that trace,
+  // telemetry, and remote configuration requests are multiplexed over a single
+  // connection to the Datadog Agent.  HTTP/2 is used without an upgrade for
+  // "http", "http+unix", and "unix" URLs, and so requires that the Agent, or a
+  // proxy in front of it, accepts HTTP/2 over cleartext.  HTTP/2 is disabled
+  // by default, and has no effect on an `http_client` specified by the user
+  // or on a library built without libcurl.  `http2_enabled` is overridden by
+  // the `DD_TRACE_AGENT_HTTP2_ENABLED` environment variable.
+  Optional<bool> http2_enabled;
+  // Whether a null `http_client` or `event_scheduler` is replaced by an
+  // instance shared with every other `DatadogAgent` in the process that also
+  // enables `shared_runtime_enabled`, rather than by an instance of its own.
+  // A process that creates many tracers can thereby run one scheduler thread
+  // and one HTTP event loop for all of them.  Each agent still has its own
+  // buffer, limits, and telemetry, but waits on shutdown for requests sent by
+  // the other agents too.  `shared_runtime_enabled` is false by default, and
+  // is overridden by the `DD_TRACE_SHARED_RUNTIME_ENABLED` environment
+  // variable.
+  Optional<bool> shared_runtime_enabled;
+  // The application's event loop, if the tracer is to run its timers and, if
+  // this library was built with libcurl, its HTTP requests on that loop
+  // instead of on threads of its own.  If `reactor` is not null, then a null
+  // `event_scheduler` is replaced by a `ReactorEventScheduler`, and a null
+  // `http_client` by a `Curl` instance driven by `reactor`.  `reactor` takes
+  // precedence over `shared_runtime_enabled`.  See `reactor.h`.
+  std::shared_ptr<Reactor> reactor;
+  // Whether the agent defers starting its threads, scheduling its recurring
+  // tasks, and sending its "app-started" telemetry until the `Tracer` that
+  // uses it creates or extracts its first span.  The `Tracer` also defers its
+  // startup log until then.  This makes constructing a `Tracer` cheap for a
+  // process that might never trace anything, such as a short-lived tool.  A
+  // default `http_client` is created when the first request is sent.
+  // `lazy_start` is false by default, and is overridden by the
+  // `DD_TRACE_AGENT_LAZY_START_ENABLED` environment variable.
+  Optional<bool> lazy_start;
+  // Whether the recurring flush is scheduled only while there is something to
+  // send.  The flush is then scheduled when a trace chunk is buffered, and
+  // unscheduled by the first flush that finds nothing buffered, deferred,
+  // awaiting a retry, or in flight.  A process that is idle for long periods
+  // thereby does not wake up every `flush_interval_milliseconds` to flush
+  // nothing.  Idle mode has no effect if `stats_computation_enabled`, since
+  // stats are flushed whether or not there are traces.  `idle_mode_enabled`
+  // is false by default, and is overridden by the
+  // `DD_TRACE_AGENT_IDLE_MODE_ENABLED` environment variable.
+  Optional<bool> idle_mode_enabled;
+  // The path of a file in which the sample rates most recently sent by the
+  // Datadog Agent, and the state of Remote Configuration, are saved whenever
+  // they change, and from which they are loaded at startup.  A process that
+  // restarts thereby samples traces at the rates its predecessor last
+  // received, rather than keeping every trace until the Datadog Agent first
+  // responds.  Processes of the same service may share the file.  There is no
+  // state file by default.  `state_file` is overridden by the
+  // `DD_TRACE_AGENT_STATE_FILE` environment variable.
+  Optional<std::string> state_file;
+  // Whether the health of the trace pipeline is reported as metrics to
+  // DogStatsD: the bytes and spans buffered, trace chunks dropped, how long
+  // the latest flush took, bytes and requests sent, failed requests, and the
+  // fraction of trace chunks kept by sampling.  The metrics are named
+  // "datadog.tracer.*", and are sent as one datagram every
+  // `health_metrics_interval_seconds`, without blocking.  They are computed
+  // from the counters that telemetry reports, but arrive in real time, and
+  // wherever the DogStatsD server sends them.  `health_metrics_enabled` is
+  // false by default, and is overridden by the
+  // `DD_TRACE_HEALTH_METRICS_ENABLED` environment variable.  It is not
+  // supported on Windows.
+  Optional<bool> health_metrics_enabled;
+  // The DogStatsD server to which health metrics are sent, either
+  // "udp://<host>:<port>" or "unix://<path>".  The default is
+  // "udp://localhost:8125".  `dogstatsd_url` is overridden by the
+  // `DD_DOGSTATSD_URL` environment variable.
+  Optional<std::string> dogstatsd_url;
+  // How often, in seconds, health metrics are sent.  The default is 10.
+  Optional<double> health_metrics_interval_seconds;
+  // How long, in seconds, the buffers of trace chunks may keep more memory
+  // than the load needs.  Every `memory_trim_interval_seconds`, a buffer
+  // whose capacity is more than twice the most it held during the interval
+  // is shrunk, and if any buffer was, then memory that the allocator holds
+  // free is returned to the operating system (with `malloc_trim`, where the
+  // C library is glibc).  A burst of traces thereby doesn't leave the
+  // process at its peak size after the load subsides.  In idle mode, memory
+  // is trimmed only while the recurring flush is scheduled.  Zero disables
+  // trimming.  The default is 60.
+  Optional<double> memory_trim_interval_seconds;
 
   static Expected<HTTPClient::URL> parse(StringView);
 };
 
 class FinalizedDatadogAgentConfig {
   friend Expected<FinalizedDatadogAgentConfig> finalize_config(
-      const DatadogAgentConfig&, const std::shared_ptr<Logger>&, const Clock&);
+      const DatadogAgentConfig&, const std::shared_ptr<Logger>&, const Clock&,
+      const ThreadFactory&);
 
   FinalizedDatadogAgentConfig() = default;
 
@@ -83,11 +390,56 @@ class FinalizedDatadogAgentConfig {
   std::shared_ptr<EventScheduler> event_scheduler;
   std::vector<std::shared_ptr<remote_config::Listener>>
       remote_configuration_listeners;
+  // Null if there is no callback.
+  std::function<void(const FlushReport&)> on_flush;
   HTTPClient::URL url;
+  // Empty if traces are sent to `url` only.
+  std::vector<HTTPClient::URL> trace_agent_urls;
+  // Null unless traces are sent to an intake instead of to an Agent.
+  Optional<HTTPClient::URL> agentless_url;
+  // Empty unless `agentless_url` is set.
+  std::string api_key;
   std::chrono::steady_clock::duration flush_interval;
+  bool adaptive_flush_enabled;
+  std::chrono::steady_clock::duration min_flush_interval;
+  std::chrono::steady_clock::duration max_flush_interval;
+  std::size_t flush_target_payload_bytes;
   std::chrono::steady_clock::duration request_timeout;
   std::chrono::steady_clock::duration shutdown_timeout;
   std::chrono::steady_clock::duration remote_configuration_poll_interval;
+  std::chrono::steady_clock::duration remote_configuration_max_poll_interval;
+  TraceAPIVersion trace_api_version;
+  std::size_t max_buffered_bytes;
+  // Null if there is no limit.
+  Optional<std::size_t> max_buffered_spans;
+  BufferOverflowPolicy buffer_overflow_policy;
+  std::size_t flush_threshold_bytes;
+  std::size_t max_payload_bytes;
+  std::size_t max_in_flight_requests;
+  std::size_t max_retries;
+  std::size_t circuit_breaker_threshold;
+  bool compression_enabled;
+  std::size_t compression_threshold_bytes;
+  bool stats_computation_enabled;
+  bool http2_enabled;
+  bool shared_runtime_enabled;
+  bool lazy_start;
+  bool idle_mode_enabled;
+  std::size_t scheduler_workers;
+  // Empty if there is no state file.
+  std::string state_file;
+  bool health_metrics_enabled;
+  std::string dogstatsd_url;
+  std::chrono::steady_clock::duration health_metrics_interval;
+  // Zero if memory is not trimmed.
+  std::chrono::steady_clock::duration memory_trim_interval;
+  // Whether `http_client` and `event_scheduler`, respectively, were created
+  // by `finalize_config` to run on threads of their own, rather than being
+  // specified by the user or driven by a `reactor`.
+  bool default_http_client;
+  bool default_event_scheduler;
+  // Starts the threads of the default `http_client` and `event_scheduler`.
+  ThreadFactory thread_factory;
   std::unordered_map<ConfigName, ConfigMetadata> metadata;
 };
 
@@ -95,5 +447,21 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
     const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger,
     const Clock& clock);
 
+// Return the finalized form of the specified `config`, as above, except that
+// the threads of the default `http_client` and `event_scheduler`, if any, are
+// started using the specified `thread_factory` if it is not null.  See
+// `thread_factory.h`.
+Expected<FinalizedDatadogAgentConfig> finalize_config(
+    const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger,
+    const Clock& clock, const ThreadFactory& thread_factory);
+
+// Replace the `http_client` and `event_scheduler` of the specified `config`
+// that were created by `finalize_config` with new instances, using the
+// specified `logger`.  This is for use in the child of a `fork`, where the
+// threads of the original instances do not exist.  The original instances
+// are not destroyed by this function.
+void renew_default_runtime(FinalizedDatadogAgentConfig& config,
+                           const std::shared_ptr<Logger>& logger);
+
 }  // namespace tracing
 }  // namespace datadog
@@ -3,9 +3,17 @@
 // This component provides an interface, `DictReader`, that represents a
 // read-only key/value mapping of strings.  It's used when extracting trace
 // context from externalized formats: HTTP headers, gRPC metadata, etc.
+//
+// An implementation of `DictReader` overrides `lookup` and one of the two
+// overloads of `visit`: preferably the one that takes a `Visitor`.  The other
+// overload, which takes a `std::function`, is deprecated.  It remains so that
+// implementations written before `Visitor` existed continue to compile and to
+// work; each overload's default implementation forwards to the other.
 
 #include <functional>
+#include <type_traits>
 
+#include "function_ref.h"
 #include "optional.h"
 #include "string_view.h"
 
@@ -14,6 +22,11 @@ namespace tracing {
 
 class DictReader {
  public:
+  // `Visitor` refers to, but does not own, the callback passed to `visit`.
+  // Any callable object, such as a lambda expression or a `std::function`,
+  // converts to a `Visitor`.  See `function_ref.h`.
+  using Visitor = FunctionRef<void(StringView key, StringView value)>;
+
   virtual ~DictReader() {}
 
   // Return the value at the specified `key`, or return `nullopt` if there
@@ -21,9 +34,34 @@ class DictReader {
   virtual Optional<StringView> lookup(StringView key) const = 0;
 
   // Invoke the specified `visitor` once for each key/value pair in this object.
+  // The default implementation forwards to the deprecated overload below.
+  virtual void visit(Visitor visitor) const {
+    const std::function<void(StringView, StringView)> function = visitor;
+    visit(function);
+  }
+
+  // Deprecated: override `visit(Visitor)` instead.  Invoke the specified
+  // `visitor` once for each key/value pair in this object.  The default
+  // implementation forwards to `visit(Visitor)`.
   virtual void visit(
       const std::function<void(StringView key, StringView value)>& visitor)
-      const = 0;
+      const {
+    visit(Visitor(visitor));
+  }
+
+  // Invoke the specified `callable` once for each key/value pair in this
+  // object.  This overload resolves a call with a lambda expression, which
+  // would otherwise convert equally well to either of the above, in favor of
+  // `visit(Visitor)`.
+  template <typename Callable,
+            typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<Callable>, Visitor> &&
+                !std::is_same_v<std::decay_t<Callable>,
+                                std::function<void(StringView, StringView)>> &&
+                std::is_invocable_v<Callable&, StringView, StringView>>>
+  void visit(Callable&& callable) const {
+    visit(Visitor(callable));
+  }
 };
 
 }  // namespace tracing
@@ -7,6 +7,14 @@
 // Note that while the data structure modeled is a mapping, duplicate keys are
 // permitted to result from repeated invocations of `DictWriter::set` with the
 // same key.
+//
+// Trace context injection writes all of its keys with one call to
+// `DictWriter::set_all`.  By default, `set_all` calls `set` for each key, but
+// an implementation can override `set_all` to, for example, reserve space for
+// all of the keys at once.
+
+#include <cstddef>
+#include <utility>
 
 #include "string_view.h"
 
@@ -15,12 +23,23 @@ namespace tracing {
 
 class DictWriter {
  public:
+  using Entry = std::pair<StringView, StringView>;
+
   virtual ~DictWriter() {}
 
   // Associate the specified `value` with the specified `key`.  An
   // implementation may, but is not required to, overwrite any previous value at
   // `key`.
   virtual void set(StringView key, StringView value) = 0;
+
+  // Associate the value of each of the specified `count` `entries` with its
+  // key, in order, as if by calling `set` for each.  The default
+  // implementation calls `set` for each entry.
+  virtual void set_all(const Entry* entries, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      set(entries[i].first, entries[i].second);
+    }
+  }
 };
 
 }  // namespace tracing
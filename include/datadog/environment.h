@@ -25,11 +25,14 @@ namespace environment {
 // preprocessor is used so that the DD_* symbols are listed exactly once.
 #define LIST_ENVIRONMENT_VARIABLES(MACRO)            \
   MACRO(DD_AGENT_HOST)                               \
+  MACRO(DD_API_KEY)                                  \
+  MACRO(DD_DOGSTATSD_URL)                            \
   MACRO(DD_ENV)                                      \
   MACRO(DD_INSTRUMENTATION_TELEMETRY_ENABLED)        \
   MACRO(DD_PROPAGATION_STYLE_EXTRACT)                \
   MACRO(DD_PROPAGATION_STYLE_INJECT)                 \
   MACRO(DD_REMOTE_CONFIGURATION_ENABLED)             \
+  MACRO(DD_REMOTE_CONFIG_MAX_POLL_INTERVAL_SECONDS)  \
   MACRO(DD_REMOTE_CONFIG_POLL_INTERVAL_SECONDS)      \
   MACRO(DD_SERVICE)                                  \
   MACRO(DD_SPAN_SAMPLING_RULES)                      \
@@ -39,16 +42,52 @@ namespace environment {
   MACRO(DD_TRACE_PROPAGATION_STYLE_INJECT)           \
   MACRO(DD_TRACE_PROPAGATION_STYLE)                  \
   MACRO(DD_TAGS)                                     \
+  MACRO(DD_TRACE_ADAPTIVE_SAMPLING_TARGET)           \
+  MACRO(DD_TRACE_AGENT_ADAPTIVE_FLUSH_ENABLED)       \
+  MACRO(DD_TRACE_AGENTLESS_URL)                      \
+  MACRO(DD_TRACE_AGENT_HTTP2_ENABLED)                \
+  MACRO(DD_TRACE_AGENT_IDLE_MODE_ENABLED)            \
+  MACRO(DD_TRACE_AGENT_LAZY_START_ENABLED)           \
   MACRO(DD_TRACE_AGENT_PORT)                         \
+  MACRO(DD_TRACE_AGENT_STATE_FILE)                   \
   MACRO(DD_TRACE_AGENT_URL)                          \
+  MACRO(DD_TRACE_AGENT_URLS)                         \
+  MACRO(DD_TRACE_API_VERSION)                        \
+  MACRO(DD_TRACE_ASYNC_LOGGING_ENABLED)              \
+  MACRO(DD_TRACE_BACKGROUND_FINALIZATION_ENABLED)    \
   MACRO(DD_TRACE_DEBUG)                              \
+  MACRO(DD_TRACE_EARLY_SAMPLING_DECISION_ENABLED)    \
   MACRO(DD_TRACE_ENABLED)                            \
+  MACRO(DD_TRACE_HEALTH_METRICS_ENABLED)             \
+  MACRO(DD_TRACE_MAX_SPANS_PER_TRACE)                \
+  MACRO(DD_TRACE_MEMORY_BUDGET_BYTES)                \
+  MACRO(DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS)    \
+  MACRO(DD_TRACE_PARTIAL_FLUSH_ENABLED)              \
+  MACRO(DD_TRACE_PARTIAL_FLUSH_MIN_SPANS)            \
   MACRO(DD_TRACE_RATE_LIMIT)                         \
   MACRO(DD_TRACE_REPORT_HOSTNAME)                    \
   MACRO(DD_TRACE_SAMPLE_RATE)                        \
   MACRO(DD_TRACE_SAMPLING_RULES)                     \
+  MACRO(DD_TRACE_SCHEDULER_WORKERS)                  \
+  MACRO(DD_TRACE_SHARED_RUNTIME_ENABLED)             \
+  MACRO(DD_TRACE_SINGLE_PASS_EXTRACTION_ENABLED)     \
+  MACRO(DD_TRACE_SPAN_SUMMARY_MIN_SPANS)             \
+  MACRO(DD_TRACE_STAGE_TIMING_ENABLED)               \
   MACRO(DD_TRACE_STARTUP_LOGS)                       \
+  MACRO(DD_TRACE_STATS_COMPUTATION_ENABLED)          \
   MACRO(DD_TRACE_TAGS_PROPAGATION_MAX_LENGTH)        \
+  MACRO(DD_TRACE_TAG_VALUE_LENGTH_LIMITS)            \
+  MACRO(DD_TRACE_TAG_VALUE_MAX_LENGTH)               \
+  MACRO(DD_TRACE_WRITER_BUFFER_OVERFLOW_POLICY)      \
+  MACRO(DD_TRACE_WRITER_BUFFER_SIZE_BYTES)           \
+  MACRO(DD_TRACE_WRITER_BUFFER_SIZE_SPANS)           \
+  MACRO(DD_TRACE_WRITER_CIRCUIT_BREAKER_THRESHOLD)   \
+  MACRO(DD_TRACE_WRITER_COMPRESSION_ENABLED)         \
+  MACRO(DD_TRACE_WRITER_COMPRESSION_THRESHOLD_BYTES) \
+  MACRO(DD_TRACE_WRITER_FLUSH_THRESHOLD_BYTES)       \
+  MACRO(DD_TRACE_WRITER_MAX_IN_FLIGHT_REQUESTS)      \
+  MACRO(DD_TRACE_WRITER_MAX_PAYLOAD_SIZE_BYTES)      \
+  MACRO(DD_TRACE_WRITER_MAX_RETRIES)                 \
   MACRO(DD_VERSION)                                  \
   MACRO(DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED) \
   MACRO(DD_TELEMETRY_HEARTBEAT_INTERVAL)             \
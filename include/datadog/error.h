@@ -76,6 +76,41 @@ struct Error {
     DATADOG_AGENT_INVALID_REMOTE_CONFIG_POLL_INTERVAL = 51,
     SAMPLING_DELEGATION_RESPONSE_INVALID_JSON = 52,
     REMOTE_CONFIGURATION_INVALID_INPUT = 53,
+    DATADOG_AGENT_INVALID_TRACE_API_VERSION = 54,
+    DATADOG_AGENT_INVALID_MAX_BUFFERED_BYTES = 55,
+    DATADOG_AGENT_INVALID_MAX_BUFFERED_SPANS = 56,
+    DATADOG_AGENT_INVALID_BUFFER_OVERFLOW_POLICY = 57,
+    DATADOG_AGENT_INVALID_FLUSH_THRESHOLD = 58,
+    DATADOG_AGENT_INVALID_MAX_PAYLOAD_SIZE = 59,
+    DATADOG_AGENT_INVALID_MAX_IN_FLIGHT_REQUESTS = 60,
+    GZIP_COMPRESSION_FAILED = 61,
+    DATADOG_AGENT_COMPRESSION_UNAVAILABLE = 62,
+    SOCKET_HTTP_CLIENT_SETUP_FAILED = 63,
+    SOCKET_HTTP_CLIENT_NOT_RUNNING = 64,
+    SOCKET_HTTP_CLIENT_REQUEST_SETUP_FAILED = 65,
+    SOCKET_HTTP_CLIENT_REQUEST_FAILURE = 66,
+    SOCKET_HTTP_CLIENT_DEADLINE_EXCEEDED = 67,
+    INVALID_PARTIAL_FLUSH_MIN_SPANS = 68,
+    ADAPTIVE_SAMPLING_TARGET_OUT_OF_RANGE = 69,
+    INVALID_TAIL_SAMPLING_POLICY = 70,
+    SHARED_MEMORY_COLLECTOR_SETUP_FAILED = 71,
+    SHARED_MEMORY_COLLECTOR_CHUNK_TOO_LARGE = 72,
+    FILE_SPOOL_COLLECTOR_FILE_FAILED = 73,
+    FILE_SPOOL_COLLECTOR_CHUNK_TOO_LARGE = 74,
+    MEMORY_RESOURCE_CONFLICT = 75,
+    MESSAGEPACK_DECODE_FAILURE = 76,
+    DATADOG_AGENT_STATE_FILE_FAILED = 77,
+    TRACE_SAMPLING_RULES_MAX_PER_SECOND_WRONG_TYPE = 78,
+    WINHTTP_CLIENT_SETUP_FAILED = 79,
+    WINHTTP_CLIENT_NOT_RUNNING = 80,
+    WINHTTP_CLIENT_REQUEST_SETUP_FAILED = 81,
+    WINHTTP_CLIENT_REQUEST_FAILURE = 82,
+    DATADOG_AGENT_MISSING_API_KEY = 83,
+    DOGSTATSD_INVALID_URL = 84,
+    DOGSTATSD_SOCKET_FAILED = 85,
+    DATADOG_AGENT_INVALID_HEALTH_METRICS_INTERVAL = 86,
+    DATADOG_AGENT_INVALID_MEMORY_TRIM_INTERVAL = 87,
+    INVALID_PARALLEL_FINALIZATION_THREADS = 88,
   };
 
   Code code;
@@ -1,16 +1,20 @@
 #pragma once
 
 // This component provides an interface, `EventScheduler`, that allows a
-// specified function-like object to be invoked at regular intervals.
+// specified function-like object to be invoked at regular intervals, or once
+// as soon as possible.
 //
 // `DatadogAgent` uses an `EventScheduler` to periodically send batches of
-// traces to the Datadog Agent.
+// traces to the Datadog Agent, and to send a batch early when many traces
+// accumulate between periodic sends.
 //
 // The default implementation is `ThreadedEventScheduler`.  See
 // `threaded_event_scheduler.h`.
 
 #include <chrono>
 #include <functional>
+#include <future>
+#include <memory>
 #include <string>
 
 namespace datadog {
@@ -19,6 +23,10 @@ namespace tracing {
 class EventScheduler {
  public:
   using Cancel = std::function<void()>;
+  // `AsyncCancel` is like `Cancel`, except that it does not wait for an
+  // invocation of the callback that is in progress.  Instead, it returns a
+  // future that is ready once no invocation is in progress.
+  using AsyncCancel = std::function<std::future<void>()>;
 
   // Invoke the specified `callback` repeatedly, with the specified `interval`
   // elapsing between invocations.  The first invocation is after an initial
@@ -28,6 +36,32 @@ class EventScheduler {
       std::chrono::steady_clock::duration interval,
       std::function<void()> callback) = 0;
 
+  // Invoke the specified `callback` as `schedule_recurring_event` does, but
+  // return an `AsyncCancel` instead of a `Cancel`, so that the caller can do
+  // other work while an invocation in progress finishes.  The default
+  // implementation cancels synchronously, and returns a future that is
+  // already ready.
+  virtual AsyncCancel schedule_recurring_event_async_cancel(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) {
+    auto cancel = std::make_shared<Cancel>(
+        schedule_recurring_event(interval, std::move(callback)));
+    return [cancel = std::move(cancel)]() {
+      (*cancel)();
+      std::promise<void> done;
+      done.set_value();
+      return done.get_future();
+    };
+  }
+
+  // Invoke the specified `callback` once, as soon as possible, without
+  // blocking the caller.  Return whether the invocation was scheduled.  The
+  // default implementation does not support one-off events, and returns
+  // `false` without invoking `callback`.
+  virtual bool schedule_event(std::function<void()> /*callback*/) {
+    return false;
+  }
+
   // Return a JSON representation of this object's configuration. The JSON
   // representation is an object with the following properties:
   //
@@ -0,0 +1,120 @@
+#pragma once
+
+// This component provides a `class`, `FileSpoolCollector`, that implements
+// the `Collector` interface by appending trace chunks to files in a local
+// directory, to be uploaded later by a separate process.  It suits short-lived
+// batch jobs, which might exit before `DatadogAgent` can flush, and hosts
+// where a Datadog Agent is not always reachable.  Appending a trace chunk is
+// a copy into a memory-mapped file, and destroying the collector does not
+// wait on the network.
+//
+// Files are written one at a time.  The file being written is named
+// "traces-<pid>-<milliseconds since epoch>-<sequence>.spool.partial".  When it
+// is full, or when the collector is destroyed, it is truncated to the records
+// written, renamed without the ".partial" suffix, and the next file is begun.
+// An uploader may take any file ending in ".spool".  A ".partial" file whose
+// writer is no longer running was left by a crash, and its records up to the
+// first invalid one may be uploaded as well.
+//
+// A file begins with a 16 byte header: the 8 bytes "DDSPOOL\0" and a 4 byte
+// version, 1, followed by 4 reserved bytes.  A sequence of records follows,
+// each beginning at a multiple of eight bytes: a 4 byte size of the payload,
+// a 4 byte CRC-32C of the payload, and then the payload, which is one trace
+// chunk encoded as a MessagePack array of spans, as in the body of a
+// "/v0.4/traces" request.  Integers are little-endian.  A record's header is
+// written after its payload, and the rest of the file is zero, so a record
+// having size zero, or whose checksum does not match, marks the end of the
+// file.
+//
+// How much survives a crash of the host, as opposed to a crash of the process,
+// depends on `FileSpoolSync`.
+//
+// A `FileSpoolCollector` is installed as the `collector` of a `TracerConfig`.
+// It is available on POSIX platforms only.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "collector.h"
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+class Logger;
+
+// `FileSpoolSync` is the policy for flushing spool files to storage.
+enum class FileSpoolSync {
+  // Leave it to the operating system.  Records survive a crash of the
+  // process, but not of the host.
+  NEVER,
+  // Flush each file when it is complete, before it is renamed.
+  ON_ROTATE,
+  // Flush each record as it is written.  This is a system call per trace
+  // chunk.
+  EVERY_CHUNK,
+};
+
+struct FileSpoolCollectorConfig {
+  // The directory to which spool files are written.  It must exist.
+  std::string directory;
+  // The size, in bytes, at which a spool file is complete.
+  std::size_t max_file_bytes = 16 * 1024 * 1024;
+  FileSpoolSync sync = FileSpoolSync::ON_ROTATE;
+};
+
+class FileSpoolCollector : public Collector {
+  std::shared_ptr<Logger> logger_;
+  std::string directory_;
+  std::size_t max_file_bytes_;
+  FileSpoolSync sync_;
+  // The rest are guarded by `mutex_`.
+  std::mutex mutex_;
+  // The file being written, or -1 if a new file could not be begun.
+  int fd_ = -1;
+  char* mapping_ = nullptr;
+  // The number of bytes of `mapping_` used by the file header and records.
+  std::size_t size_ = 0;
+  // The path of the file being written, without the ".partial" suffix.
+  std::string path_;
+  std::uint64_t sequence_ = 0;
+
+  FileSpoolCollector(const FileSpoolCollectorConfig&,
+                     const std::shared_ptr<Logger>&);
+
+  // Begin a new spool file.
+  Expected<void> begin_file();
+  // Truncate, flush if so configured, and rename the file being written.
+  // Remove it instead if it contains no records.
+  void finish_file();
+
+ public:
+  // Return a collector writing to the directory specified by `config`, or
+  // return an error if `config` is invalid or a spool file cannot be created.
+  static Expected<std::shared_ptr<FileSpoolCollector>> create(
+      const FileSpoolCollectorConfig& config,
+      const std::shared_ptr<Logger>& logger);
+  // Finish the file being written.
+  ~FileSpoolCollector();
+
+  FileSpoolCollector(const FileSpoolCollector&) = delete;
+  FileSpoolCollector& operator=(const FileSpoolCollector&) = delete;
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const ChunkTags& chunk_tags,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+
+  std::string config() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
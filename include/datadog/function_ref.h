@@ -0,0 +1,79 @@
+#pragma once
+
+// This component provides a class template, `FunctionRef`, that refers to a
+// callable object without owning it, e.g.
+//
+//     void visit_twice(FunctionRef<void(int)> visitor) {
+//       visitor(1);
+//       visitor(2);
+//     }
+//
+//     int sum = 0;
+//     visit_twice([&](int value) { sum += value; });
+//
+// Unlike `std::function`, a `FunctionRef` never copies the callable object,
+// and so never allocates, regardless of what a lambda expression captures.
+// It's used for the callbacks in this library's interfaces that are invoked
+// only before the function to which they're passed returns, such as
+// `DictReader::visit` and `Logger::LogFunc`.  Any callable object, including a
+// `std::function`, converts to a `FunctionRef`, so code that passed a
+// `std::function` or a lambda expression to those interfaces does not need to
+// change.
+//
+// A `FunctionRef` refers to a callable object that must outlive it.  It's
+// meant to be a function parameter, initialized from an argument that is a
+// temporary or a local variable.  A `FunctionRef` must not be stored for use
+// after the function to which it was passed has returned.
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+
+template <typename Signature>
+class FunctionRef;
+
+template <typename Result, typename... Args>
+class FunctionRef<Result(Args...)> {
+  union Target {
+    void* object;
+    Result (*function)(Args...);
+  };
+
+  Target target_;
+  Result (*invoke_)(Target, Args...);
+
+ public:
+  // Refer to the specified `callable`, which is not a `FunctionRef`.
+  template <typename Callable,
+            typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<Callable>, FunctionRef> &&
+                !std::is_function_v<std::remove_reference_t<Callable>> &&
+                std::is_invocable_r_v<Result, Callable&, Args...>>>
+  FunctionRef(Callable&& callable) noexcept
+      : invoke_([](Target target, Args... args) -> Result {
+          return (*static_cast<std::remove_reference_t<Callable>*>(
+              target.object))(std::forward<Args>(args)...);
+        }) {
+    target_.object = const_cast<void*>(
+        static_cast<const void*>(std::addressof(callable)));
+  }
+
+  // Refer to the specified `function`.
+  FunctionRef(Result (*function)(Args...)) noexcept
+      : invoke_([](Target target, Args... args) -> Result {
+          return target.function(std::forward<Args>(args)...);
+        }) {
+    target_.function = function;
+  }
+
+  // Invoke the referenced callable object with the specified `args`.
+  Result operator()(Args... args) const {
+    return invoke_(target_, std::forward<Args>(args)...);
+  }
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,109 @@
+#pragma once
+
+// This component provides a class, `HeaderMap`, that is a collection of HTTP
+// headers (or gRPC metadata, etc.) that implements both `DictReader` and
+// `DictWriter`.  An integration can copy a request's headers into a
+// `HeaderMap` and extract trace context from it, or inject trace context into
+// one and copy its headers into an outbound request, rather than implementing
+// `DictReader` and `DictWriter` itself.
+//
+// Header names are compared without regard to the case of ASCII letters.
+// Each header's name is hashed, in lower case, when the header is added, so a
+// lookup compares hashes, and compares names only when the hashes match.
+//
+// The characters of the names and values are stored contiguously in one
+// buffer, and the headers themselves are stored inline, within the
+// `HeaderMap` object, up to `inline_capacity` of them.  A request with typical
+// headers thus costs a single allocation, and a `HeaderMap` that is reused,
+// e.g. by calling `clear` between requests, usually none.
+//
+//     HeaderMap headers;
+//     for (const auto& [name, value] : request.headers()) {
+//       headers.append(name, value);
+//     }
+//     Span span = tracer.extract_or_create_span(headers);
+//
+// The `StringView`s returned by `lookup`, and those passed to the visitor of
+// `visit`, refer to storage within the `HeaderMap`.  They remain valid until
+// the `HeaderMap` is next modified or is destroyed, and must not be passed to
+// the member functions that modify it.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dict_reader.h"
+#include "dict_writer.h"
+#include "optional.h"
+#include "string_view.h"
+
+namespace datadog {
+namespace tracing {
+
+class HeaderMap : public DictReader, public DictWriter {
+ public:
+  // The number of headers that are stored without allocating.
+  static constexpr std::size_t inline_capacity = 16;
+
+ private:
+  struct Field {
+    // The hash of the name, in lower case.
+    std::uint32_t hash;
+    // The name and value are `chars_.substr(offset, name_size)` and
+    // `chars_.substr(offset + name_size, value_size)`.
+    std::uint32_t offset;
+    std::uint32_t name_size;
+    std::uint32_t value_size;
+  };
+
+  std::string chars_;
+  std::size_t size_ = 0;
+  Field inline_[inline_capacity];
+  // The headers beyond the first `inline_capacity`.
+  std::vector<Field> overflow_;
+
+  Field& field(std::size_t index);
+  const Field& field(std::size_t index) const;
+  StringView name(const Field&) const;
+  StringView value(const Field&) const;
+  // Return the first header whose name is the specified `name`, ignoring
+  // case, or return null if there is none.  `hash` is the hash of `name`.
+  Field* find(std::uint32_t hash, StringView name);
+  const Field* find(std::uint32_t hash, StringView name) const;
+  // Store the specified `name` and `value` as a new header having the
+  // specified name `hash`.
+  void push(std::uint32_t hash, StringView name, StringView value);
+
+ public:
+  // Return the number of headers, including any duplicates.
+  std::size_t size() const;
+  bool empty() const;
+  // Remove all headers, but keep the storage for reuse.
+  void clear();
+  // Reserve storage for the specified `count` headers whose names and values
+  // together have the specified number of `chars`.
+  void reserve(std::size_t count, std::size_t chars);
+
+  // Add a header having the specified `name` and `value`, even if there is
+  // already a header having `name`.  This is how a request's headers are
+  // copied in, since a request may repeat a header.
+  void append(StringView name, StringView value);
+
+  // Return the value of the first header whose name is the specified `key`,
+  // ignoring case, or return null if there is none.
+  Optional<StringView> lookup(StringView key) const override;
+  // Invoke the specified `visitor` for each header, in the order added.
+  void visit(Visitor visitor) const override;
+
+  // Set the value of the first header whose name is the specified `key`,
+  // ignoring case, to the specified `value`, or add a header if there is
+  // none.
+  void set(StringView key, StringView value) override;
+  // Set each of the specified `count` `entries` as if by `set`, reserving
+  // storage for them first.
+  void set_all(const Entry* entries, std::size_t count) override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -6,13 +6,17 @@
 // `HTTPClient` is used by `DatadogAgent` to send traces to the Datadog Agent.
 //
 // If this library was built with support for libcurl, then `Curl` implements
-// `HTTPClient` in terms of libcurl.  See `curl.h`.
+// `HTTPClient` in terms of libcurl.  See `curl.h`.  On Windows,
+// `WinHTTPClient` implements it in terms of WinHTTP.  See `winhttp_client.h`.
 
 #include <chrono>
 #include <functional>
+#include <memory>
+#include <string>
 
 #include "error.h"
 #include "expected.h"
+#include "string_view.h"
 
 namespace datadog {
 namespace tracing {
@@ -37,6 +41,26 @@ class HTTPClient {
   // error-indicating HTTP responses.
   using ErrorHandler = std::function<void(Error)>;
 
+  // `SharedBody` is a request body that refers to all or part of an immutable
+  // buffer, which the `HTTPClient` keeps alive until the request completes.
+  // It allows a buffer to be sent without being copied, and without giving up
+  // ownership of it, e.g. so that the buffer can be sent again later.  The
+  // `HTTPClient` does not access the buffer after invoking the request's
+  // `on_response` or `on_error`.
+  struct SharedBody {
+    std::shared_ptr<const std::string> buffer;
+    // `data` refers to characters within `*buffer`.
+    StringView data;
+
+    SharedBody() = default;
+    // Refer to all of the specified `buffer`.
+    SharedBody(std::shared_ptr<const std::string> buffer)
+        : SharedBody(buffer, buffer ? StringView(*buffer) : StringView()) {}
+    // Refer to the specified `data` within the specified `buffer`.
+    SharedBody(std::shared_ptr<const std::string> buffer, StringView data)
+        : buffer(std::move(buffer)), data(data) {}
+  };
+
   // Send a POST request to the specified `url`.  Set request headers by calling
   // the specified `set_headers` callback.  Include the specified `body` at the
   // end of the request.  Invoke the specified `on_response` callback if/when
@@ -50,6 +74,14 @@ class HTTPClient {
       ResponseHandler on_response, ErrorHandler on_error,
       std::chrono::steady_clock::time_point deadline) = 0;
 
+  // Send a POST request as above, except that the body is the specified
+  // shared `body` rather than a string owned by the request.  The default
+  // implementation copies `body` and calls the other overload of `post`.
+  virtual Expected<void> post(const URL& url, HeadersSetter set_headers,
+                              SharedBody body, ResponseHandler on_response,
+                              ErrorHandler on_error,
+                              std::chrono::steady_clock::time_point deadline);
+
   // Wait until there are no more outstanding requests, or until the specified
   // `deadline`.
   virtual void drain(std::chrono::steady_clock::time_point deadline) = 0;
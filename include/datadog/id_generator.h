@@ -9,6 +9,7 @@
 // pseudo-random sequence of uniformly distributed 63-bit unsigned integers. The
 // sequence is randomly seeded once per thread and anytime the process forks.
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 
@@ -24,6 +25,11 @@ class IDGenerator {
 
   // Generate a span ID.
   virtual std::uint64_t span_id() const = 0;
+  // Generate the specified `count` span IDs into the array beginning at the
+  // specified `ids`.  This is used when many spans are created at once (see
+  // `Span::create_children`).  The default implementation calls `span_id`
+  // `count` times.
+  virtual void span_ids(std::uint64_t* ids, std::size_t count) const;
   // Generate a trace ID for a trace having the specified `start` time.
   virtual TraceID trace_id(const TimePoint& start) const = 0;
 };
@@ -0,0 +1,120 @@
+#pragma once
+
+// This component provides a mutex type, `TracerMutex`, that the tracer uses
+// for its internal locks, and a function, `lock_statistics`, that reports how
+// often each of those locks was acquired and contended, and how long threads
+// waited for it.
+//
+// The statistics show which of the tracer's locks, if any, are worth making
+// lock-free in a particular deployment.  Collecting them costs a few atomic
+// increments per acquisition, so they are collected only if the library is
+// built with `-DDD_TRACE_LOCK_STATISTICS=ON`, which defines the macro
+// `DD_TRACE_LOCK_STATISTICS` for the library and for code that uses it.
+// Otherwise, `TracerMutex` is `std::mutex`, and `lock_statistics` returns an
+// empty vector.
+//
+// The statistics of a lock are those of all instances of it, e.g. of the
+// mutexes of every `TraceSegment`, since the process started.
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "string_view.h"
+
+#if defined(DD_TRACE_LOCK_STATISTICS)
+#include <atomic>
+#endif
+
+namespace datadog {
+namespace tracing {
+
+// `TracerLock` identifies one of the tracer's internal locks.
+enum class TracerLock {
+  // `TraceSegment::mutex_`, which guards the sampling decision and trace tags.
+  trace_segment,
+  // `TraceSegment::flush_mutex_`, which serializes (partial) flushes of a
+  // segment's spans.
+  trace_segment_flush,
+  // `DatadogAgent::mutex_`, which guards the payloads being flushed.
+  datadog_agent,
+  // The mutexes of `DatadogAgent`'s buffers of encoded trace chunks.
+  datadog_agent_shard,
+  // `ConfigManager::mutex_`, which serializes configuration updates.
+  config_manager,
+  // `CurlImpl::mutex_`, which guards the requests handed to the libcurl
+  // event loop.
+  curl,
+  // `CerrLogger::mutex_`, which serializes writes to standard error.
+  cerr_logger,
+};
+
+struct LockStatistics {
+  // The name of the lock, e.g. "TraceSegment::mutex_".
+  StringView name;
+  // The number of times that the lock was acquired.
+  std::uint64_t acquisitions = 0;
+  // The number of acquisitions that had to wait because another thread held
+  // the lock.
+  std::uint64_t contentions = 0;
+  // The total time spent waiting in contended acquisitions.
+  std::chrono::nanoseconds wait_time = std::chrono::nanoseconds::zero();
+};
+
+// Return the statistics of every `TracerLock`, in the order declared, or
+// return an empty vector if the library was built without
+// `DD_TRACE_LOCK_STATISTICS`.
+std::vector<LockStatistics> lock_statistics();
+
+#if defined(DD_TRACE_LOCK_STATISTICS)
+
+struct LockCounters {
+  std::atomic<std::uint64_t> acquisitions{0};
+  std::atomic<std::uint64_t> contentions{0};
+  std::atomic<std::uint64_t> wait_nanoseconds{0};
+};
+
+// Return the counters of the specified `lock`.
+LockCounters& lock_counters(TracerLock lock);
+
+template <TracerLock which>
+class TracerMutex {
+  std::mutex mutex_;
+
+ public:
+  void lock() {
+    LockCounters& counters = lock_counters(which);
+    counters.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (mutex_.try_lock()) {
+      return;
+    }
+    const auto before = std::chrono::steady_clock::now();
+    mutex_.lock();
+    const auto waited = std::chrono::steady_clock::now() - before;
+    counters.contentions.fetch_add(1, std::memory_order_relaxed);
+    counters.wait_nanoseconds.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+        std::memory_order_relaxed);
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    lock_counters(which).acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void unlock() { mutex_.unlock(); }
+};
+
+#else
+
+template <TracerLock>
+using TracerMutex = std::mutex;
+
+#endif
+
+}  // namespace tracing
+}  // namespace datadog
@@ -39,9 +39,9 @@
 //       return;
 //     }
 
-#include <functional>
 #include <ostream>
 
+#include "function_ref.h"
 #include "string_view.h"
 
 namespace datadog {
@@ -51,7 +51,10 @@ struct Error;
 
 class Logger {
  public:
-  using LogFunc = std::function<void(std::ostream&)>;
+  // `LogFunc` refers to, but does not own, the callback passed to
+  // `log_error` or `log_startup`, so it must not be kept after the call
+  // returns.  See `function_ref.h`.
+  using LogFunc = FunctionRef<void(std::ostream&)>;
 
   virtual ~Logger() {}
 
@@ -0,0 +1,42 @@
+#pragma once
+
+// This component provides an interface, `MemoryResource`, from which the
+// tracer obtains the storage of the objects that it allocates for every span
+// and every trace: the `SpanData` of each span and the `TraceSegment` of each
+// trace.  An application can install one via `TracerConfig::memory_resource`,
+// e.g. to place tracing memory in a dedicated arena, or to measure it.
+//
+// That storage is cached per thread and reused (see `block_cache.h`), so the
+// `MemoryResource` is consulted only when a thread's cache is empty or full.
+// The strings within spans, such as tag values, and the buffers into which
+// traces are encoded, are still allocated by the global allocator.
+//
+// Blocks are cached per thread for the whole process, not per `Tracer`, so
+// there is one `MemoryResource` per process.  It is installed by the first
+// `Tracer` that specifies one, provided that no span or trace has been
+// created before then.  Otherwise, storage from the global allocator might be
+// returned to the `MemoryResource`, or vice versa, so the `Tracer` logs an
+// error and the global allocator remains in use.  A `MemoryResource`, once
+// installed, is used until the process exits.
+
+#include <cstddef>
+
+namespace datadog {
+namespace tracing {
+
+class MemoryResource {
+ public:
+  virtual ~MemoryResource() = default;
+
+  // Return storage of at least the specified `size` bytes, aligned as by
+  // `::operator new`.  Throw an exception, such as `std::bad_alloc`, if no
+  // storage is available.  This function may be called on any thread.
+  virtual void* allocate(std::size_t size) = 0;
+  // Release the specified `block`, which was returned by `allocate` with the
+  // specified `size`.  This function may be called on any thread, not
+  // necessarily the one that allocated `block`.
+  virtual void deallocate(void* block, std::size_t size) noexcept = 0;
+};
+
+}  // namespace tracing
+}  // namespace datadog
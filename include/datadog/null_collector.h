@@ -2,6 +2,9 @@
 
 // This component provides a `class`, `NullCollector`, that implements the
 // `Collector` interface in terms of a no-op. It's used in unit tests.
+//
+// A `Tracer` whose collector is a `NullCollector` does not record spans at
+// all, since they would be discarded anyway.  See `span.h`.
 
 #include "collector.h"
 
@@ -15,6 +18,12 @@ class NullCollector : public Collector {
     return {};
   }
 
+  Expected<void> send(std::vector<std::unique_ptr<SpanData>>&&,
+                      const ChunkTags&,
+                      const std::shared_ptr<TraceSampler>&) override {
+    return {};
+  }
+
   std::string config() const override {
     // clang-format off
     return R"({
@@ -0,0 +1,27 @@
+#pragma once
+
+// This component provides an `enum class`, `Pressure`, that describes how far
+// a `Collector` is falling behind the traces sent to it.  See
+// `Tracer::pressure`.
+//
+// Instrumentation can consult the pressure to degrade gracefully during an
+// incident, e.g. by not creating optional child spans, or by tagging spans
+// less, while the pressure is not `Pressure::NORMAL`.  Spans that are created
+// anyway are still accepted, but are more likely to be dropped.
+
+namespace datadog {
+namespace tracing {
+
+enum class Pressure {
+  // Traces are being sent as fast as they arrive.
+  NORMAL,
+  // Traces are arriving faster than they are being sent, e.g. the buffer of
+  // traces awaiting submission is half full, or recent requests failed.
+  ELEVATED,
+  // Traces are being dropped, or soon will be, e.g. the buffer is nearly
+  // full, or the destination of traces is unreachable.
+  HIGH,
+};
+
+}  // namespace tracing
+}  // namespace datadog
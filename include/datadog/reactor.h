@@ -0,0 +1,63 @@
+#pragma once
+
+// This component provides an interface, `Reactor`, through which an event loop
+// that the application already runs can drive the tracer's timers and network
+// I/O, so that tracing adds no threads of its own.
+//
+// The application implements `Reactor` in terms of its event loop (e.g. one
+// built on epoll or io_uring), and sets `DatadogAgentConfig::reactor`.  Then
+// the tracer uses a `ReactorEventScheduler` (see `reactor_event_scheduler.h`)
+// instead of a `ThreadedEventScheduler`, and, if this library was built with
+// libcurl, a `Curl` client that uses libcurl's multi-socket interface (see
+// `curl.h`) instead of running libcurl's event loop on a thread of its own.
+//
+// Every member function of `Reactor` may be called from any thread, including
+// from within the callbacks that the reactor invokes.  The callbacks are
+// invoked on the thread that runs the event loop, and never from within a call
+// to a member function of `Reactor`.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace datadog {
+namespace tracing {
+
+class Reactor {
+ public:
+  // Bits of the `events` passed to `watch`, and of the events passed to its
+  // callback.
+  static constexpr int readable = 1;
+  static constexpr int writable = 2;
+
+  using TimerID = std::uint64_t;
+
+  // Invoke the specified `on_ready` whenever the specified file descriptor
+  // `fd` is ready for any of the specified `events`, passing the bits of
+  // `events` that are ready.  This replaces any earlier watch of `fd`.
+  virtual void watch(int fd, int events,
+                     std::function<void(int ready)> on_ready) = 0;
+
+  // Stop watching the specified file descriptor `fd`.  The callback of an
+  // earlier `watch` of `fd` is not invoked after `unwatch` returns, unless
+  // `unwatch` is called from a callback while another is pending.
+  virtual void unwatch(int fd) = 0;
+
+  // Invoke the specified `on_timeout` once, at or after the specified
+  // `deadline`.  Return an identifier for the timer that can be passed to
+  // `cancel_timer`.
+  virtual TimerID set_timer(std::chrono::steady_clock::time_point deadline,
+                            std::function<void()> on_timeout) = 0;
+
+  // Prevent the timer having the specified `id` from invoking its callback,
+  // if it has not already done so.
+  virtual void cancel_timer(TimerID id) = 0;
+
+  // Invoke the specified `task` once, as soon as possible.
+  virtual void post(std::function<void()> task) = 0;
+
+  virtual ~Reactor() = default;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,117 @@
+#pragma once
+
+// This component provides a `class`, `SharedMemoryCollector`, that implements
+// the `Collector` interface by writing trace chunks into a ring buffer in a
+// memory-mapped file shared with another process on the same host, such as a
+// Datadog Agent running as a sidecar.  Compared to `DatadogAgent`, there is
+// no HTTP request, no HTTP client, and, in the steady state, no system call:
+// a trace chunk is MessagePack encoded and copied into the ring, and the
+// reader is woken only if it is waiting.
+//
+// The file is created if it does not exist.  Its layout is as follows, where
+// integers are in the host's byte order:
+//
+//     offset  size  field
+//     ------  ----  -----
+//          0     4  magic, "DDRB"
+//          4     4  version, 1
+//          8     8  capacity of the data region, a power of two
+//         64     8  write position, advanced by the writer
+//        128     8  read position, advanced by the reader
+//        192     4  doorbell, incremented by the writer after each write
+//        196     4  nonzero while the reader is waiting on the doorbell
+//       4096     -  the data region
+//
+// The positions count bytes written to and read from the data region since
+// it was created; a position `p` refers to the byte at `p % capacity`.  The
+// data region contains a sequence of records, each beginning at a multiple of
+// eight bytes and preceded by an eight byte header: a 4 byte size of what
+// follows, and a 4 byte type.  A record of type 1 is one trace chunk, encoded
+// as a MessagePack array of spans, as in the body of a "/v0.4/traces" request.
+// A record of type 0 is padding: the rest of the data region is skipped, and
+// the next record begins at the start of the data region.
+//
+// On Linux, the reader can wait for records without polling.  It sets the
+// "waiting" field, checks the write position once more, and then waits on the
+// doorbell as a futex.  The writer wakes the futex after a write only when
+// "waiting" is set.
+//
+// If the ring does not have room for a trace chunk, then the chunk is dropped,
+// and an error is logged when dropping begins and when it ends.  The reader
+// does not reply, so trace sampling rates are not adjusted by the Datadog
+// Agent.  Only one process may write to a ring at a time, though any number of
+// threads in that process may `send` trace chunks concurrently.
+//
+// A `SharedMemoryCollector` is installed as the `collector` of a
+// `TracerConfig`.  It is available on POSIX platforms only.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "collector.h"
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+class Logger;
+
+struct SharedMemoryCollectorConfig {
+  // The path of the file containing the ring buffer, e.g. within a volume
+  // shared with the sidecar.
+  std::string path;
+  // The size, in bytes, of the ring's data region when the file is created.
+  // It must be a power of two of at least 64 KiB.  If the file already
+  // contains a ring, then the existing ring's capacity is used instead.
+  std::size_t capacity = 8 * 1024 * 1024;
+};
+
+class SharedMemoryCollector : public Collector {
+  struct Header;
+
+  std::shared_ptr<Logger> logger_;
+  std::string path_;
+  void* mapping_;
+  std::size_t mapping_size_;
+  Header* header_;
+  char* data_;
+  std::uint64_t capacity_;
+  // Guards writes to the ring.
+  std::mutex mutex_;
+  // The number of trace chunks dropped since dropping last began, or zero if
+  // the most recent chunk was not dropped.  Guarded by `mutex_`.
+  std::uint64_t dropped_chunks_ = 0;
+
+  SharedMemoryCollector(const std::shared_ptr<Logger>&, std::string path,
+                        void* mapping, std::size_t mapping_size);
+
+ public:
+  // Return a collector writing to the ring in the file specified by `config`,
+  // creating the file if necessary, or return an error if the file cannot be
+  // created or does not contain a compatible ring.
+  static Expected<std::shared_ptr<SharedMemoryCollector>> create(
+      const SharedMemoryCollectorConfig& config,
+      const std::shared_ptr<Logger>& logger);
+  ~SharedMemoryCollector();
+
+  SharedMemoryCollector(const SharedMemoryCollector&) = delete;
+  SharedMemoryCollector& operator=(const SharedMemoryCollector&) = delete;
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const ChunkTags& chunk_tags,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+
+  std::string config() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
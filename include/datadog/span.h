@@ -33,20 +33,41 @@
 // propagation.  A `Span` can be _extracted_ from its external parent via
 // `Tracer::extract_span`, and a `Span` can be _injected_ via `Span::inject`
 // into an outside context from which its external children might be extracted.
+// Within one process, a trace can instead continue in a new trace segment via
+// `Span::export_trace_context` and `Tracer::continue_trace`, without formatting
+// or parsing headers.
 //
 // If an error occurs during the operation that a span represents, the error can
 // be noted in the span via the `set_error` family of member functions.
 //
 // A `Span` is finished when it is destroyed.  The end time can be overridden
 // via the `set_end_time` member function prior to the span's destruction.
+//
+// A `Span` might not be recorded.  If the tracer is configured to make early
+// sampling decisions (see `TracerConfig::early_sampling_decision`), then the
+// children of spans in a dropped trace are not recorded.  An unrecorded span
+// has IDs and a start time, and can be injected and can have children, but
+// it ignores modifications to its other properties and tags, and it is not
+// sent to Datadog.
+//
+// If traces are not reported, because `TracerConfig::report_traces` is false
+// (or tracing was disabled by remote configuration), or because the collector
+// is a `NullCollector`, then no span of a trace created in the meantime is
+// recorded, not even its root.  Such spans cost little more than their IDs,
+// and trace context is still extracted and injected as usual.
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
-#include <functional>
+#include <initializer_list>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "clock.h"
 #include "optional.h"
+#include "span_context.h"
+#include "static_string.h"
 #include "string_view.h"
 #include "trace_id.h"
 
@@ -58,24 +79,45 @@ class DictReader;
 class DictWriter;
 struct SpanConfig;
 struct SpanData;
+class SpanTemplate;
+struct TraceContext;
 class TraceSegment;
 
 class Span {
+  friend class SpanContext;
+
   std::shared_ptr<TraceSegment> trace_segment_;
   SpanData* data_;
-  std::function<std::uint64_t()> generate_span_id_;
-  Clock clock_;
   Optional<std::chrono::steady_clock::time_point> end_time_;
   mutable bool expecting_delegated_sampling_decision_;
+  // Whether `data_` is registered with `trace_segment_`, and so will be sent
+  // to the collector when this span finishes.
+  bool recorded_;
+  // Whether the span owns `data_`.  Only an unrecorded span does, except for
+  // the local root of a segment that records no spans, whose `data_` is
+  // owned by the segment.  See `TraceSegment::disable_recording`.
+  bool owns_data_;
+
+  // Create an unrecorded span that owns the specified `data`, and that is
+  // associated with the specified `trace_segment`.
+  Span(std::unique_ptr<SpanData> data,
+       const std::shared_ptr<TraceSegment>& trace_segment);
+  // Return an unrecorded child of this span that has the specified `id`, and
+  // that starts as specified by `config`.
+  Span create_unrecorded_child(const SpanConfig& config,
+                               std::uint64_t id) const;
+  // Return a child of this span configured by the specified `config`, which
+  // is a `const SpanConfig&`, a `SpanConfig&&`, or a `const SpanTemplate&`.
+  template <typename Config>
+  Span create_child_from(Config&& config) const;
 
  public:
-  // Create a span whose properties are stored in the specified `data`, that is
-  // associated with the specified `trace_segment`, that uses the specified
-  // `generate_span_id` to generate IDs of child spans, and that uses the
-  // specified `clock` to determine start and end times.
-  Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment,
-       const std::function<std::uint64_t()>& generate_span_id,
-       const Clock& clock);
+  // Create a span whose properties are stored in the specified `data`, and
+  // that is associated with the specified `trace_segment`, which owns `data`.
+  // The span uses the segment's `IDGenerator` to generate IDs of child spans,
+  // and the segment's `Clock` to determine start and end times.  The span is
+  // recorded unless the segment records no spans.
+  Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment);
   Span(const Span&) = delete;
   Span(Span&&) = default;
   Span& operator=(Span&&) = delete;
@@ -88,19 +130,49 @@ class Span {
   // destroying data members.
   ~Span();
 
+  // Finish the specified `spans` at once, as if by destroying each of them,
+  // and then clear `spans`.  This is cheaper than destroying them one by one,
+  // e.g. after waiting for the results of parallel calls whose spans were
+  // created by `create_children`: the current time is read once for the
+  // spans of each trace segment that lack an end time (see `set_end_time`),
+  // and each segment notes its spans' finishing all at once.  Spans of the
+  // same segment that are adjacent in `spans` are finished together.
+  static void finish_all(std::vector<Span>& spans);
+
   // Return a span that is a child of this span.  Use the optionally specified
   // `config` to determine the properties of the child span.  If `config` is not
   // specified, then the child span's properties are determined by the
   // `SpanDefaults` that were used to configure the `Tracer` to which this span
   // is related.  The child span's start time is the current time unless
-  // overridden in `config`.
+  // overridden in `config`.  If `config` is an rvalue, then its strings and
+  // tags are moved into the child rather than copied.
   Span create_child(const SpanConfig& config) const;
+  Span create_child(SpanConfig&& config) const;
   Span create_child() const;
+  // Return a span that is a child of this span, and whose attributes are
+  // those prepared by the specified `span_template`.  See `span_template.h`.
+  Span create_child(const SpanTemplate& span_template) const;
+
+  // Return the specified `count` spans that are children of this span, as if
+  // by calling `create_child` `count` times with the optionally specified
+  // `config`.  This is cheaper than calling `create_child` repeatedly: the
+  // children's IDs are generated in a single call to `IDGenerator::span_ids`,
+  // and the children are added to the trace all at once.
+  std::vector<Span> create_children(std::size_t count,
+                                    const SpanConfig& config) const;
+  std::vector<Span> create_children(std::size_t count) const;
 
+  // Return whether this span is recorded, i.e. whether it will be sent to
+  // Datadog if its trace is kept.
+  bool recorded() const;
   // Return this span's ID (span ID).
   std::uint64_t id() const;
   // Return the ID of the trace of which this span is a part.
   TraceID trace_id() const;
+  // Return a copyable handle from which children of this span can be
+  // created, even after this span is moved or destroyed.  See
+  // `span_context.h`.
+  SpanContext context() const;
   // Return the ID of this span's parent span, or return null if this span has
   // no parent.
   Optional<std::uint64_t> parent_id() const;
@@ -128,11 +200,23 @@ class Span {
   // if there is no such metric.
   Optional<double> lookup_metric(StringView name) const;
   // Overwrite the tag having the specified `name` so that it has the specified
-  // `value`, or create a new tag.
+  // `value`, or create a new tag.  A `value` longer than the configured limit
+  // is truncated.  See `TracerConfig::max_tag_value_length`.
   void set_tag(StringView name, StringView value);
+  // As above, but store references to `name` and `value` instead of copies,
+  // unless `value` is truncated.  See `static_string.h`.
+  void set_tag(StaticString name, StaticString value);
   // Overwrite the metric having the specified `name` so that it has the
   // specified `value`, or create a new metric.
   void set_metric(StringView name, double value);
+  // Set each of the specified `tags`, in order, as if by `set_tag`.  Space
+  // for the tags is reserved once, rather than as each tag is added.
+  void set_tags(std::initializer_list<std::pair<StringView, StringView>> tags);
+  // Set each of the specified `metrics`, in order, as if by `set_metric`.
+  // Space for the metrics is reserved once, rather than as each metric is
+  // added.
+  void set_metrics(
+      std::initializer_list<std::pair<StringView, double>> metrics);
   // Delete the tag having the specified `name` if it exists.
   void remove_tag(StringView name);
   // Delete the metric having the specified `name` if it exists.
@@ -143,7 +227,9 @@ class Span {
   // Set the type of the service associated with this span, e.g. "web".
   void set_service_type(StringView);
   // Set the name of the operation that this span represents, e.g.
-  // "handle.request", "execute.query", or "healthcheck".
+  // "handle.request", "execute.query", or "healthcheck".  The name, like the
+  // resource name and the error message, type, and stack set below, is
+  // truncated as `set_tag` truncates a long value.
   void set_name(StringView);
   // Set the name of the resource associated with the operation that this span
   // represents, e.g. "/api/v1/info" or "select count(*) from users".
@@ -159,16 +245,25 @@ class Span {
   void set_error_type(StringView);
   // Associate a call stack with the error that occurred during the extent of
   // this span.  This also has the effect of calling `set_error(true)`.
+  // Identical stacks are stored once, and shared by the spans that have them.
   void set_error_stack(StringView);
   // Set end time of this span.  Doing so will override the default behavior of
   // using the current time in the destructor.
   void set_end_time(std::chrono::steady_clock::time_point);
 
   // Write information about this span and its trace into the specified `writer`
-  // using all of the configured injection propagation styles.
+  // using all of the configured injection propagation styles.  All of the
+  // headers are written with one call to `DictWriter::set_all`.
   void inject(DictWriter& writer) const;
   void inject(DictWriter& writer, const InjectionOptions& options) const;
 
+  // Return the trace context of this span, for continuing the trace in a new
+  // trace segment within this process via `Tracer::continue_trace`, without
+  // formatting or parsing header values.  As with `inject`, a sampling
+  // decision is made first if there isn't one already.  See
+  // `trace_context.h`.
+  TraceContext export_trace_context() const;
+
   // If this span is expecting a sampling decision that it previously delegated,
   // then extract a sampling decision from the specified `reader`. Return an
   // error if a sampling decision is present in `reader` but is invalid. Return
@@ -0,0 +1,68 @@
+#pragma once
+
+// This component provides a class, `SpanContext`, that identifies a `Span`
+// and can create children of it, without owning it.
+//
+// A `Span` can be moved but not copied, and it keeps its trace segment alive.
+// Code that only needs to continue a trace elsewhere, such as a callback run
+// later on another thread, can instead capture the `SpanContext` returned by
+// `Span::context`.  A `SpanContext` is two IDs and a weak reference to the
+// trace segment, so copying one costs one atomic increment.
+//
+// A child created from a `SpanContext` is recorded only while its trace
+// segment is unfinished, i.e. while some span of the segment, not
+// necessarily the one the `SpanContext` came from, has not been destroyed.
+// Otherwise the child is not recorded (see `span.h`), but it still has IDs
+// and can be injected, so the trace continues downstream.
+
+#include <cstdint>
+#include <memory>
+
+#include "optional.h"
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+class Span;
+struct SpanConfig;
+class TraceSegment;
+
+class SpanContext {
+  friend class Span;
+
+  std::weak_ptr<TraceSegment> trace_segment_;
+  TraceID trace_id_;
+  std::uint64_t span_id_ = 0;
+  // Whether the span was recorded.  Children of an unrecorded span are not
+  // recorded either.
+  bool recorded_ = false;
+
+  SpanContext(const std::shared_ptr<TraceSegment>& trace_segment,
+              TraceID trace_id, std::uint64_t span_id, bool recorded);
+
+  // Return a child of the span configured by the specified `config`, which
+  // is either a `const SpanConfig&` or a `SpanConfig&&`.
+  template <typename Config>
+  Optional<Span> create_child_from(Config&& config) const;
+
+ public:
+  // Create a `SpanContext` that refers to no span.  Creating a child of it
+  // returns null.
+  SpanContext() = default;
+
+  // Return the ID of the trace to which the span belongs.
+  TraceID trace_id() const;
+  // Return the ID of the span.
+  std::uint64_t span_id() const;
+
+  // Return a child of the span, configured by the optionally specified
+  // `config`, as if by `Span::create_child`.  Return null if the span's trace
+  // segment no longer exists.  This function may be called on any thread.
+  Optional<Span> create_child() const;
+  Optional<Span> create_child(const SpanConfig& config) const;
+  Optional<Span> create_child(SpanConfig&& config) const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,68 @@
+#pragma once
+
+// This component provides a class, `SpanTemplate`, that prepares a
+// `SpanConfig` once for creating many spans alike.  The following member
+// functions accept a `SpanTemplate` argument:
+//
+// - `Tracer::create_span`
+// - `Span::create_child`
+//
+// Creating a span from a `SpanConfig` merges the config's properties and tags
+// with the tracer's `SpanDefaults` anew for every span.  A `SpanTemplate`
+// does the merge once, and each span created from it copies the result, e.g.
+//
+//     // Once, e.g. when the handler is registered:
+//     SpanConfig config;
+//     config.name = "http.request";
+//     config.resource = "GET /health";
+//     config.tags.emplace("component", "health-check");
+//     static const SpanTemplate health_check{std::move(config)};
+//
+//     // For every request:
+//     auto span = tracer.create_span(health_check);
+//
+// The merge is redone, once, whenever the `SpanDefaults` change, e.g. by
+// remote configuration.  A `SpanTemplate` may be used by many threads at
+// once.
+
+#include <cstddef>
+#include <memory>
+
+#include "function_ref.h"
+#include "span_config.h"
+#include "string_view.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+struct SpanDefaults;
+
+class SpanTemplate {
+  friend struct SpanData;
+
+  SpanConfig config_;
+  // The properties of a span created from this template, as prepared for the
+  // `SpanDefaults` to which `prototype_->defaults` refers.  `prototype_` is
+  // accessed atomically.
+  mutable std::shared_ptr<const SpanData> prototype_;
+
+  // Return the properties of a span created from this template using the
+  // specified `defaults` and `tag_value_limit`, preparing them anew if
+  // `defaults` differs from those last prepared.  `tag_value_limit` is the
+  // same for all spans that use `defaults`, since both belong to a `Tracer`.
+  std::shared_ptr<const SpanData> prototype(
+      const std::shared_ptr<const SpanDefaults>& defaults,
+      FunctionRef<std::size_t(StringView)> tag_value_limit) const;
+
+ public:
+  explicit SpanTemplate(SpanConfig config);
+  SpanTemplate(const SpanTemplate&);
+  SpanTemplate& operator=(const SpanTemplate&) = delete;
+  ~SpanTemplate();
+
+  const SpanConfig& config() const { return config_; }
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,45 @@
+#pragma once
+
+// This component provides a `struct`, `StageTimings`, that measures how long
+// the tracer itself spends in each stage of its work, such as creating a span
+// or encoding a trace chunk.
+//
+// Each stage has a `telemetry::DistributionMetric` of durations, in
+// nanoseconds.  Stage timing is disabled by default (see
+// `TracerConfig::stage_timing`).  When it is enabled, `Tracer::stage_timings`
+// returns the tracer's `StageTimings`, and if telemetry is enabled, the
+// distributions are also reported with the tracer's telemetry.  Reporting
+// telemetry captures and resets the distributions, so while telemetry is
+// enabled, a program reading them sees only the durations added since the
+// last report.
+
+#include "telemetry/metrics.h"
+
+namespace datadog {
+namespace tracing {
+
+struct StageTimings {
+  // `Tracer::create_span`
+  telemetry::DistributionMetric create_span = {
+      "stage.duration_ns", "tracers", {"stage:create_span"}, false};
+  // `Tracer::extract_span`
+  telemetry::DistributionMetric extract_span = {
+      "stage.duration_ns", "tracers", {"stage:extract_span"}, false};
+  // Finishing a span, including finishing its trace segment if it was the
+  // segment's last unfinished span.
+  telemetry::DistributionMetric span_finished = {
+      "stage.duration_ns", "tracers", {"stage:span_finished"}, false};
+  // Making a sampling decision for a trace segment.
+  telemetry::DistributionMetric sampler_decide = {
+      "stage.duration_ns", "tracers", {"stage:sampler_decide"}, false};
+  // Encoding a trace chunk as MessagePack.
+  telemetry::DistributionMetric msgpack_encode = {
+      "stage.duration_ns", "tracers", {"stage:msgpack_encode"}, false};
+  // Flushing buffered trace chunks to the Datadog Agent, not including
+  // waiting for responses.
+  telemetry::DistributionMetric flush = {
+      "stage.duration_ns", "tracers", {"stage:flush"}, false};
+};
+
+}  // namespace tracing
+}  // namespace datadog
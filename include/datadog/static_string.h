@@ -0,0 +1,49 @@
+#pragma once
+
+// This component provides a class, `StaticString`, that refers to a string
+// that lives at least as long as the program's spans, such as a string
+// literal.
+//
+// Tag names and values are usually copied into the span.  A tag whose name
+// and value are both `StaticString` is instead stored by reference, and is
+// encoded directly from the referenced characters, so setting it allocates
+// nothing.  See `Span::set_tag`.
+//
+// A `StaticString` is constructed explicitly, so that a string is never
+// mistaken for a static one:
+//
+//     span.set_tag(StaticString{"component"}, StaticString{"grpc"});
+
+#include <cstddef>
+
+#include "string_view.h"
+
+namespace datadog {
+namespace tracing {
+
+class StaticString {
+  StringView value_;
+
+  constexpr explicit StaticString(StringView value, int) : value_(value) {}
+
+ public:
+  // Refer to the specified string `literal`, excluding its terminating null
+  // character.
+  template <std::size_t size>
+  constexpr explicit StaticString(const char (&literal)[size])
+      : value_(literal, size - 1) {}
+
+  // Return a `StaticString` that refers to the specified `value`.  The
+  // behavior is undefined unless the characters referred to by `value` remain
+  // valid and unchanged until every span whose tags refer to them has been
+  // sent, e.g. until the program exits.
+  static constexpr StaticString assume_static(StringView value) {
+    return StaticString(value, 0);
+  }
+
+  constexpr StringView view() const { return value_; }
+  constexpr operator StringView() const { return value_; }
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -19,10 +19,18 @@ struct Configuration {
   // Can be overriden by the `DD_TELEMETRY_METRICS_ENABLED` environment
   // variable.
   tracing::Optional<bool> report_metrics;
-  // Interval at which the metrics payload will be sent.
+  // Interval at which the metrics payload will be sent, together with a
+  // heartbeat.
+  // Default: 60 seconds.
   // Can be overriden by `DD_TELEMETRY_METRICS_INTERVAL_SECONDS` environment
   // variable.
   tracing::Optional<double> metrics_interval_seconds;
+  // Interval at which the values of metrics are captured, to be sent with the
+  // next metrics payload.  If the Datadog Agent's recurring flush runs at
+  // least this often, then it captures the metrics, and telemetry needs no
+  // timer of its own.
+  // Default: 10 seconds.
+  tracing::Optional<double> metrics_capture_interval_seconds;
   // Interval at which the heartbeat payload will be sent.
   // Can be overriden by `DD_TELEMETRY_HEARTBEAT_INTERVAL` environment variable.
   tracing::Optional<double> heartbeat_interval_seconds;
@@ -40,6 +48,7 @@ struct FinalizedConfiguration {
   bool enabled;
   bool report_metrics;
   std::chrono::steady_clock::duration metrics_interval;
+  std::chrono::steady_clock::duration metrics_capture_interval;
   std::chrono::steady_clock::duration heartbeat_interval;
   std::string integration_name;
   std::string integration_version;
@@ -1,29 +1,43 @@
 #pragma once
 
 // This component provides an interface, `Metric`, and specific classes for
-// Counter and Gauge metrics. A metric has a name, type, and set of key:value
-// tags associated with it. Metrics can be general to APM or language-specific.
-// General metrics have `common` set to `true`, and language-specific metrics
-// have `common` set to `false`.
+// Counter, Gauge, and Distribution metrics. A metric has a name, type, and set
+// of key:value tags associated with it. Metrics can be general to APM or
+// language-specific. General metrics have `common` set to `true`, and
+// language-specific metrics have `common` set to `false`.
+//
+// A metric's name, type, scope, and tags do not change once it is
+// constructed, so its tags are also serialized as a JSON array once, at
+// construction, and reused by every telemetry report.
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace datadog {
 namespace telemetry {
 
+// The kinds of metric, as reported in the "type" field of telemetry.
+enum class MetricType { COUNT, GAUGE, DISTRIBUTION };
+
 class Metric {
   // The name of the metric that will be published. A transformation occurs
   // based on the name and whether it is "common" or "language-specific" when it
   // is recorded.
   std::string name_;
-  // The type of the metric. This will currently be count or gauge.
-  std::string type_;
+  // The type of the metric.
+  MetricType type_;
   // Namespace of the metric.
   std::string scope_;
   // Tags associated with this specific instance of the metric.
   std::vector<std::string> tags_;
+  // `tags_` as a JSON array of strings.
+  std::string tags_json_;
   // This affects the transformation of the metric name, where it can be a
   // common telemetry metric, or a language-specific metric that is prefixed
   // with the language name.
@@ -31,29 +45,58 @@ class Metric {
 
  protected:
   std::atomic<uint64_t> value_ = 0;
-  Metric(std::string name, std::string type, std::string scope,
+  Metric(std::string name, MetricType type, std::string scope,
          std::vector<std::string> tags, bool common);
 
  public:
+  virtual ~Metric() = default;
+
   // Accessors for name, type, tags, common and capture_and_reset_value are used
-  // when producing the JSON message for reporting metrics.
-  std::string name();
-  std::string type();
-  std::string scope();
-  std::vector<std::string> tags();
-  bool common();
-  uint64_t value();
-  uint64_t capture_and_reset_value();
+  // when producing the JSON message for reporting metrics.  `type` is the
+  // name of `kind`: "count", "gauge", or "distribution".
+  const std::string& name() const;
+  MetricType kind() const;
+  const std::string& type() const;
+  const std::string& scope() const;
+  const std::vector<std::string>& tags() const;
+  const std::string& tags_json() const;
+  bool common() const;
+  virtual uint64_t value();
+  virtual uint64_t capture_and_reset_value();
 };
 
 // A count metric is used for measuring activity, and has methods for adding a
 // number of actions, or incrementing the current number of actions by 1.
+//
+// Counters such as the number of spans created are incremented by every
+// thread, so a count is spread over several `Shard`s, chosen per thread, each
+// on its own cache line.  Threads counting at the same time then seldom write
+// to the same cache line.  `value` and `capture_and_reset_value` sum the
+// shards.
+//
+// The shards are never reset.  Instead, `capture_and_reset_value` remembers
+// the sum that it captured, and `value` is the sum less that.  So `total`,
+// the count since the counter was created, is not disturbed by telemetry, and
+// other reporters may take the difference between two totals.  Calls to
+// `capture_and_reset_value` must not overlap.
 class CounterMetric : public Metric {
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  static constexpr std::size_t num_shards = 16;
+  Shard shards_[num_shards];
+  // The total as of the most recent `capture_and_reset_value`.
+  std::atomic<uint64_t> captured_{0};
+
  public:
   CounterMetric(std::string name, std::string scope,
                 std::vector<std::string> tags, bool common);
   void inc();
   void add(uint64_t amount);
+  uint64_t value() override;
+  uint64_t capture_and_reset_value() override;
+  // Return the count since this counter was created.
+  uint64_t total() const;
 };
 
 // A gauge metric is used for measuring state, and mas methods to set the
@@ -70,5 +113,108 @@ class GaugeMetric : public Metric {
   void sub(uint64_t amount);
 };
 
+// A distribution metric is used for measuring the spread of values, such as
+// the sizes of requests or how long they took, and has a method for adding a
+// value.
+//
+// Values are counted in log-linear buckets: values less than 32 each have their
+// own bucket, and every power of two above that is divided into 16 buckets of
+// equal width.  A value is reported as the midpoint of its bucket, which is
+// within 1/32 (about 3%) of the value.  Adding a value is one relaxed atomic
+// increment, so distributions can be updated from any thread without locking.
+//
+// `value` and `capture_and_reset_value` return the number of values added.
+class DistributionMetric : public Metric {
+ public:
+  static constexpr std::size_t sub_buckets = 16;
+  static constexpr std::size_t num_buckets = 61 * sub_buckets;
+
+  // A value, and the number of times it was added.
+  using Bucket = std::pair<uint64_t, uint64_t>;
+
+ private:
+  std::atomic<uint64_t> buckets_[num_buckets] = {};
+
+ public:
+  DistributionMetric(std::string name, std::string scope,
+                     std::vector<std::string> tags, bool common);
+  void add(uint64_t value);
+  uint64_t value() override;
+  uint64_t capture_and_reset_value() override;
+  // Return the values added since the previous capture, in increasing order,
+  // and reset the distribution.  Buckets that are empty are omitted.
+  std::vector<Bucket> capture_and_reset_buckets();
+
+  // Return the index of the bucket that counts the specified `value`.
+  static std::size_t bucket_index(uint64_t value);
+  // Return the value reported for the bucket at the specified `index`.
+  static uint64_t bucket_value(std::size_t index);
+};
+
+// A counter family is a set of count metrics that share a name and scope, one
+// for each distinct list of tags with which the family is used, e.g. one
+// counter per endpoint.  The counters need not be created up front.
+//
+// `counter` returns the counter having a list of tags, creating it the first
+// time the list is seen.  Finding an existing counter takes no lock: the tags
+// are hashed, and the family's hash table is probed with atomic loads.
+// Creating a counter locks a mutex.  Counters are never removed, so the
+// reference returned by `counter` remains valid for the life of the family,
+// and a caller that keeps it pays only for the counter's `add`.
+//
+// A family has at most `max_counters` counters, so that tags with unbounded
+// values cannot grow it without bound.  Lists of tags first seen once the
+// family is full share one more counter, tagged "overflow:true".
+//
+// A family is reported by `Telemetry`, which reports each of its counters as
+// it would a `CounterMetric`.  See `telemetry.h`.
+class CounterFamily {
+  struct Cell;
+
+  const std::string name_;
+  const std::string scope_;
+  const bool common_;
+  const std::size_t max_counters_;
+  // Open addressing hash table of the counters, by the hash of their tags.
+  // It has at least twice `max_counters_` slots, so probes are short, and
+  // there is always an empty slot.  Slots are written while `mutex_` is
+  // locked.
+  std::size_t slot_mask_;
+  std::unique_ptr<std::atomic<Cell*>[]> slots_;
+  // The counters in the order they were created, of which the first `size_`
+  // exist, and the overflow counter, if it exists.  Written while `mutex_` is
+  // locked.
+  std::unique_ptr<std::unique_ptr<Cell>[]> cells_;
+  std::atomic<std::size_t> size_{0};
+  std::atomic<Cell*> overflow_{nullptr};
+  std::mutex mutex_;
+
+  // Return the counter in `slots_` having the specified `tags` and `hash`, or
+  // null if there is none.  Set the specified `slot` to the index at which
+  // the probe ended.
+  Cell* find(const std::vector<std::string>& tags, std::uint64_t hash,
+             std::size_t& slot) const;
+
+ public:
+  CounterFamily(std::string name, std::string scope, bool common,
+                std::size_t max_counters = 256);
+  ~CounterFamily();
+
+  CounterFamily(const CounterFamily&) = delete;
+  CounterFamily& operator=(const CounterFamily&) = delete;
+
+  // Return the counter of this family having the specified `tags`, creating
+  // it if necessary.  The order of `tags` matters.
+  CounterMetric& counter(const std::vector<std::string>& tags);
+
+  const std::string& name() const;
+  // Return the number of counters created so far, including the overflow
+  // counter.
+  std::size_t size() const;
+  // Return the counter created at the specified `index` in order of creation.
+  // The behavior is undefined unless `index < size()`.
+  CounterMetric& at(std::size_t index) const;
+};
+
 }  // namespace telemetry
 }  // namespace datadog
@@ -24,9 +24,12 @@ class Telemetry {
   std::shared_ptr<tracing::TracerTelemetry> tracer_telemetry_;
 
  public:
+  // Report the specified `metrics`, and the counters of the specified
+  // `families`, including counters created after construction.
   Telemetry(FinalizedConfiguration configuration,
             std::shared_ptr<tracing::Logger> logger,
-            std::vector<std::shared_ptr<Metric>> metrics);
+            std::vector<std::shared_ptr<Metric>> metrics,
+            std::vector<std::shared_ptr<CounterFamily>> families = {});
 
   ~Telemetry() = default;
 };
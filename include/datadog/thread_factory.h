@@ -0,0 +1,68 @@
+#pragma once
+
+// This component provides a type, `ThreadFactory`, with which an application
+// starts the threads that the tracer runs in the background, and a function,
+// `start_thread`, that the tracer uses to start them.
+//
+// An application can install a `ThreadFactory` via
+// `TracerConfig::thread_factory`, e.g. to pin the tracer's threads to
+// housekeeping cores, away from cores isolated for latency-critical work, or
+// to give them a scheduling policy, priority, or name.  The factory must
+// start a thread that invokes the specified function, and return that thread;
+// it may configure the thread either before the function is invoked, from
+// within the new thread, or afterward, using the returned thread's
+// `native_handle()`.  For example:
+//
+//     config.thread_factory = [](StringView name,
+//                                std::function<void()> body) {
+//       return std::thread([body = std::move(body)]() {
+//         cpu_set_t cpus;
+//         CPU_ZERO(&cpus);
+//         CPU_SET(0, &cpus);
+//         pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+//         body();
+//       });
+//     };
+//
+// The `name` passed to the factory identifies the thread's role, and is one
+// of:
+//
+// - "dd-scheduler": the thread of a `ThreadedEventScheduler`, which keeps
+//   time for flushes, telemetry, and remote configuration polls;
+// - "dd-scheduler-worker": a worker of a `ThreadedEventScheduler` (see
+//   `DatadogAgentConfig::scheduler_workers`);
+// - "dd-http": the event loop of the default HTTP client;
+// - "dd-finalizer": the thread that finalizes trace segments if
+//   `TracerConfig::background_finalization` is enabled;
+// - "dd-finalizer-worker": a thread that finalizes part of a large trace
+//   segment (see `TracerConfig::parallel_finalization_min_spans`);
+// - "dd-logger": the thread of the default logger if
+//   `TracerConfig::async_logging` is enabled.
+//
+// A thread started by a factory may be joined or detached by the tracer, but
+// the factory itself may be invoked on any thread, including one of the
+// tracer's own.  A factory shared by several tracers that use
+// `DatadogAgentConfig::shared_runtime_enabled` starts the shared threads for
+// whichever tracer creates them.
+
+#include <functional>
+#include <thread>
+
+#include "string_view.h"
+
+namespace datadog {
+namespace tracing {
+
+// Start a thread, identified by the specified `name`, that invokes the
+// specified `body`, and return the thread.
+using ThreadFactory =
+    std::function<std::thread(StringView name, std::function<void()> body)>;
+
+// Return a thread, identified by the specified `name`, that invokes the
+// specified `body`, as started by the specified `factory`, or by
+// `std::thread` if `factory` is null.
+std::thread start_thread(const ThreadFactory& factory, StringView name,
+                         std::function<void()> body);
+
+}  // namespace tracing
+}  // namespace datadog
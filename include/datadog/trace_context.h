@@ -0,0 +1,53 @@
+#pragma once
+
+// This component provides a `struct TraceContext`, that is the trace context
+// of a span in binary form, for propagating a trace to another trace segment
+// within the same process.
+//
+// `Span::inject` and `Tracer::extract_span` propagate a trace across process
+// boundaries, and so they format the trace context as header values and parse
+// it again.  When the new segment is in the same process, e.g. where work
+// passes through a queue between thread pools that are traced as different
+// services, `Span::export_trace_context` and `Tracer::continue_trace` do the
+// same without formatting or parsing anything:
+//
+//     TraceContext context = span.export_trace_context();
+//     // ... later, perhaps on another thread ...
+//     Span consumer = tracer.continue_trace(std::move(context));
+//
+// Unlike `SpanContext`, a `TraceContext` does not refer to the segment that
+// it came from, and so the segment that continues the trace is a different
+// segment, with its own local root, as if the trace had been extracted.
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "optional.h"
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+struct TraceContext {
+  // The ID of the trace.
+  TraceID trace_id;
+  // The ID of the span from which the context was exported, which is the
+  // parent of the span that continues the trace.
+  std::uint64_t parent_id = 0;
+  // The trace's sampling priority.  See `sampling_priority.h`.
+  int sampling_priority = 0;
+  // The origin of the trace, e.g. "synthetics", if any.
+  Optional<std::string> origin;
+  // The trace tags that are propagated, e.g. "_dd.p.dm".
+  std::vector<std::pair<std::string, std::string>> trace_tags;
+  // The entries of the W3C "tracestate" header extracted from upstream that
+  // this library does not interpret, whether in the "dd" entry or outside of
+  // it, so that they are propagated downstream.
+  Optional<std::string> additional_w3c_tracestate;
+  Optional<std::string> additional_datadog_w3c_tracestate;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -7,6 +7,9 @@
 // `TraceSamplerConfig` is specified as the `trace_sampler` property of
 // `TracerConfig`.
 
+#include <chrono>
+#include <cstddef>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -24,19 +27,49 @@ struct TraceSamplerRule final {
   Rate rate;
   SpanMatcher matcher;
   SamplingMechanism mechanism;
+  // If set, traces kept by this rule are limited to this many per second by
+  // a limiter of the rule's own, instead of by the sampler's overall limiter.
+  Optional<double> max_per_second;
 };
 
 struct TraceSamplerConfig {
   struct Rule : public SpanMatcher {
     double sample_rate = 1.0;
+    Optional<double> max_per_second;
 
     Rule(const SpanMatcher&);
     Rule() = default;
   };
 
+  // A tail policy is consulted when a trace segment finishes, after all of
+  // its spans are known.  A segment that the sampler dropped is kept anyway
+  // if any of the policy's criteria match it.  This way `sample_rate` and
+  // `rules` can keep only a small share of ordinary traces without losing
+  // the interesting ones.
+  struct TailPolicy {
+    // Keep segments having any span with an error.
+    bool keep_errors = false;
+    // Keep segments whose local root span lasted at least this long.
+    Optional<std::chrono::milliseconds> latency_threshold;
+    // Thresholds that replace `latency_threshold` for local root spans having
+    // particular resource names.
+    std::unordered_map<std::string, std::chrono::milliseconds>
+        resource_latency_thresholds;
+    // Keep segments having at least this many spans.
+    Optional<std::size_t> min_span_count;
+  };
+
   Optional<double> sample_rate;
   std::vector<Rule> rules;
   Optional<double> max_per_second;
+  // If set, traces that no rule matches are kept at rates chosen by an
+  // `AdaptiveSampler` so that about this many such traces are kept per second,
+  // instead of at the rates sent by the Datadog Agent.  Overridden by the
+  // `DD_TRACE_ADAPTIVE_SAMPLING_TARGET` environment variable.
+  Optional<double> adaptive_target_per_second;
+  // If set, traces dropped by the sampler are reconsidered when they finish.
+  // There is no environment variable for this.
+  Optional<TailPolicy> tail_policy;
 };
 
 class FinalizedTraceSamplerConfig {
@@ -48,7 +81,9 @@ class FinalizedTraceSamplerConfig {
 
  public:
   double max_per_second;
+  Optional<double> adaptive_target_per_second;
   std::vector<TraceSamplerRule> rules;
+  Optional<TraceSamplerConfig::TailPolicy> tail_policy;
   std::unordered_map<ConfigName, ConfigMetadata> metadata;
 };
 
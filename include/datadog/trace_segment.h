@@ -26,64 +26,174 @@
 // When all of the `Span`s associated with `TraceSegment` have been destroyed,
 // the `TraceSegment` submits them in a payload to a `Collector`.
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "clock.h"
 #include "expected.h"
+#include "lock_statistics.h"
 #include "optional.h"
 #include "propagation_style.h"
-#include "runtime_id.h"
 #include "sampling_decision.h"
 #include "sampling_priority.h"
+#include "trace_id.h"
 
 namespace datadog {
 namespace tracing {
 
+class BackgroundWorker;
 class Collector;
 class DictReader;
 class DictWriter;
+class IDGenerator;
 struct InjectionOptions;
 class Logger;
 struct SpanData;
 struct SpanDefaults;
 class SpanSampler;
+class TailSamplingPolicy;
+struct TraceContext;
 class TraceSampler;
 class ConfigManager;
+class WorkerPool;
 class TracerTelemetry;
 
-class TraceSegment {
-  mutable std::mutex mutex_;
+// `TraceSegmentContext` is the part of a `TraceSegment`'s configuration that
+// is the same for every segment created by a `Tracer`.  The `Tracer` shares
+// one instance, which is never modified, among all of its segments, so that
+// creating a segment copies one pointer instead of each of these members.
+struct TraceSegmentContext {
+  std::shared_ptr<Logger> logger;
+  std::shared_ptr<Collector> collector;
+  std::shared_ptr<TracerTelemetry> tracer_telemetry;
+  std::shared_ptr<SpanSampler> span_sampler;
+  std::shared_ptr<ConfigManager> config_manager;
+  // The generator and clock used by the spans of each segment, shared here
+  // rather than copied into each span.
+  std::shared_ptr<const IDGenerator> id_generator;
+  Clock clock;
+  // Whether `clock` is `default_clock` or `fast_clock`, whose ticks are
+  // readings of `std::chrono::steady_clock`.  If so, then spans other than a
+  // segment's local root read only the steady clock.  See `TraceSegment::now`.
+  bool steady_clock_ticks;
+  // The tracer's runtime ID, as tagged on each trace chunk.
+  std::string runtime_id;
+  std::vector<PropagationStyle> injection_styles;
+  // The styles that `TraceSegment::inject` writes: `injection_styles` without
+  // duplicates or `PropagationStyle::NONE`, prepared once per tracer.
+  std::vector<PropagationStyle> injected_styles;
+  // Whether `injected_styles` includes `PropagationStyle::DATADOG`, the only
+  // style that can request sampling delegation.
+  bool injects_datadog;
+  Optional<std::string> hostname;
+  std::size_t tags_header_max_size;
+  // The length limits of tag values set on spans.  See
+  // `TracerConfig::max_tag_value_length` and
+  // `TracerConfig::tag_value_length_limits`.
+  std::size_t max_tag_value_length;
+  std::vector<std::pair<std::string, std::size_t>> tag_value_length_limits;
+  // If nonzero, then finished spans other than the local root are sent to the
+  // `Collector` before the segment finishes, once at least this many of them
+  // have accumulated.
+  std::size_t partial_flush_min_spans;
+  // If nonzero, then at most this many spans, including the local root, are
+  // recorded by each segment.  Remote configuration can replace this value
+  // at runtime.  See `ConfigManager::PipelineOverrides`.
+  std::size_t max_spans_per_trace;
+  // If nonzero, then groups of at least this many identical leaf spans are
+  // summarized when a segment finishes.  See `span_summary.h`.
+  std::size_t span_summary_min_spans;
+  // If not null, then each segment is finalized and sent on `finalizer`'s
+  // thread once its last span finishes.
+  std::shared_ptr<BackgroundWorker> finalizer;
+  // If not null, then the spans of large segments are sampled by several
+  // threads at once.  See `TracerConfig::parallel_finalization_min_spans`.
+  std::shared_ptr<WorkerPool> workers;
+  // Whether segments are configured to delegate their sampling decisions.
+  // See `doc/sampling-delegation.md`.
+  bool sampling_delegation_enabled;
+  // If not null, then segments dropped by the trace sampler are reconsidered
+  // by this policy when they finish.
+  std::shared_ptr<const TailSamplingPolicy> tail_policy;
+};
 
-  std::shared_ptr<Logger> logger_;
-  std::shared_ptr<Collector> collector_;
-  std::shared_ptr<TracerTelemetry> tracer_telemetry_;
-  std::shared_ptr<TraceSampler> trace_sampler_;
-  std::shared_ptr<SpanSampler> span_sampler_;
+class TraceSegment : public std::enable_shared_from_this<TraceSegment> {
+  using Mutex = TracerMutex<TracerLock::trace_segment>;
+  using FlushMutex = TracerMutex<TracerLock::trace_segment_flush>;
 
+  mutable Mutex mutex_;
+
+  std::shared_ptr<const TraceSegmentContext> context_;
+  // The trace sampler and span defaults are those of the tracer's
+  // configuration when this segment was created.  Remote configuration can
+  // replace them in the tracer, but not in this segment.
+  std::shared_ptr<TraceSampler> trace_sampler_;
   std::shared_ptr<const SpanDefaults> defaults_;
-  RuntimeID runtime_id_;
-  const std::vector<PropagationStyle> injection_styles_;
-  const Optional<std::string> hostname_;
   const Optional<std::string> origin_;
-  const std::size_t tags_header_max_size_;
   std::vector<std::pair<std::string, std::string>> trace_tags_;
+  // The "x-datadog-tags" header value from which `trace_tags_` were
+  // extracted, if encoding them would reproduce it exactly, and they have not
+  // changed since.  Otherwise, null.  A segment that passes the trace along
+  // unchanged thereby injects the header as it arrived, without encoding
+  // `trace_tags_`.
+  Optional<std::string> extracted_trace_tags_;
 
-  std::vector<std::unique_ptr<SpanData>> spans_;
-  std::size_t num_finished_spans_;
+  // The first span of this segment.  It is sent to the `Collector` with the
+  // last chunk of the segment, after which it is null.  Unrecorded spans can
+  // outlive it, so what they need of it is kept separately.
+  std::unique_ptr<SpanData> local_root_;
+  // The start time of `local_root_`, from which `now` derives wall times.
+  const TimePoint anchor_;
+  const std::uint64_t local_root_id_;
+  // Whether `inject` omitted an oversized "x-datadog-tags" header.  If so,
+  // then the local root is tagged with a propagation error when it is sent.
+  std::atomic<bool> trace_tags_oversized_;
+  // The other spans registered with this segment that have not yet been sent
+  // to the `Collector`, most recently registered first, linked through
+  // `SpanData::next_registered`.  The spans are owned by this segment.  Spans
+  // are registered without taking `mutex_`.
+  std::atomic<SpanData*> registered_spans_;
+  // The number of spans registered but not yet finished.  The span that
+  // brings this to zero finishes the segment.
+  std::atomic<std::size_t> num_unfinished_spans_;
+  // The number of spans, other than the local root, that are finished but
+  // not yet sent.  This is maintained only if
+  // `TraceSegmentContext::partial_flush_min_spans` is nonzero.
+  std::atomic<std::size_t> num_finished_spans_;
+  // The number of spans recorded by this segment, including the local root,
+  // and the number not recorded because of
+  // `TraceSegmentContext::max_spans_per_trace` or of the tracer's memory
+  // budget.
+  std::atomic<std::size_t> num_spans_;
+  std::atomic<std::size_t> num_capped_spans_;
+  // `flush_mutex_` is held while spans are taken from `registered_spans_` to
+  // be sent, so that a partial flush and the final flush do not overlap.
+  FlushMutex flush_mutex_;
   Optional<SamplingDecision> sampling_decision_;
+  // Whether spans created from now on are recorded.  This is false only
+  // after an early sampling decision dropped the trace, and until the trace
+  // is kept by a subsequent decision, or if the segment records no spans.
+  // See `make_early_sampling_decision` and `disable_recording`.
+  std::atomic<bool> records_new_spans_;
+  // Whether this segment records any spans at all.  See `disable_recording`.
+  bool records_spans_;
   Optional<std::string> additional_w3c_tracestate_;
   Optional<std::string> additional_datadog_w3c_tracestate_;
-
-  std::shared_ptr<ConfigManager> config_manager_;
+  // Header values injected by `inject` that are the same for every span of
+  // this segment, or null if they have not been computed since the sampling
+  // decision last changed.  See `trace_segment.cpp`.
+  struct InjectionHeaders;
+  std::shared_ptr<const InjectionHeaders> injection_headers_;
 
   // See `doc/sampling-delegation.md` for more information about
   // `struct SamplingDelegation`.
   struct SamplingDelegation {
-    // This segment is configured to delegate its sampling decision.
-    bool enabled;
     // The trace context from which the local root span was extracted delegated
     // the sampling decision to this segment.
     bool decision_was_delegated_to_me;
@@ -99,30 +209,50 @@ class TraceSegment {
   } sampling_delegation_ = {};
 
  public:
-  TraceSegment(const std::shared_ptr<Logger>& logger,
-               const std::shared_ptr<Collector>& collector,
-               const std::shared_ptr<TracerTelemetry>& tracer_telemetry,
+  TraceSegment(const std::shared_ptr<const TraceSegmentContext>& context,
                const std::shared_ptr<TraceSampler>& trace_sampler,
-               const std::shared_ptr<SpanSampler>& span_sampler,
                const std::shared_ptr<const SpanDefaults>& defaults,
-               const std::shared_ptr<ConfigManager>& config_manager,
-               const RuntimeID& runtime_id, bool sampling_delegation_enabled,
                bool sampling_decision_was_delegated_to_me,
-               const std::vector<PropagationStyle>& injection_styles,
-               const Optional<std::string>& hostname,
-               Optional<std::string> origin, std::size_t tags_header_max_size,
+               Optional<std::string> origin,
                std::vector<std::pair<std::string, std::string>> trace_tags,
+               Optional<std::string> extracted_trace_tags,
                Optional<SamplingDecision> sampling_decision,
                Optional<std::string> additional_w3c_tracestate,
                Optional<std::string> additional_datadog_w3c_tracestate,
                std::unique_ptr<SpanData> local_root);
+  ~TraceSegment();
 
   const SpanDefaults& defaults() const;
+  // Return the `SpanDefaults` as shared with the spans of this segment, which
+  // inherit its tags.
+  const std::shared_ptr<const SpanDefaults>& shared_defaults() const;
+  const IDGenerator& id_generator() const;
+  const Clock& clock() const;
+  // Return the current time, for the start of a span of this segment.  If
+  // `TraceSegmentContext::steady_clock_ticks`, then read only the steady
+  // clock, and derive the wall time from the start time of the local root,
+  // so that spans of the segment are timed relative to one reading of the
+  // system clock.  Otherwise, return `clock()()`.
+  TimePoint now() const;
+  // Return the current steady clock time, for the end of a span of this
+  // segment.  This is `now().tick`, but without deriving the wall time.
+  std::chrono::steady_clock::time_point now_tick() const;
   const Optional<std::string>& hostname() const;
   const Optional<std::string>& origin() const;
+  // Return the ID of the segment's local root span.
+  std::uint64_t local_root_id() const;
   Optional<SamplingDecision> sampling_decision() const;
+  // Return whether new spans in this segment are recorded, i.e. registered
+  // with this segment and eventually sent to the `Collector`.
+  bool records_new_spans() const;
+  // Return whether this segment records spans, i.e. whether its local root
+  // is recorded.  See `disable_recording`.
+  bool records_spans() const;
 
   Logger& logger() const;
+  // Return the greatest length of a value of the tag having the specified
+  // `name`, or zero if there is no limit.
+  std::size_t tag_value_limit(StringView name) const;
 
   // Inject trace context for the specified `span` into the specified `writer`.
   // Return whether the trace sampling decision was delegated.
@@ -130,6 +260,10 @@ class TraceSegment {
   bool inject(DictWriter& writer, const SpanData& span);
   bool inject(DictWriter& writer, const SpanData& span,
               const InjectionOptions& options);
+  // Return the trace context for the specified `span`, making a sampling
+  // decision first if there isn't one already.  This function is the
+  // implementation of `Span::export_trace_context`.
+  TraceContext export_context(const SpanData& span);
 
   // Inject this segment's trace sampling decision into the specified `writer`,
   // if appropriate.
@@ -139,11 +273,44 @@ class TraceSegment {
   // one, and use the resulting decision, if appropriate.
   Expected<void> read_sampling_delegation_response(const DictReader& reader);
 
+  // Claim room for up to the specified `count` new spans under
+  // `TraceSegmentContext::max_spans_per_trace`, and return how many may be
+  // recorded.  None may be recorded while the tracer's memory budget is
+  // exhausted.  The rest are counted as not recorded.
+  std::size_t reserve_spans(std::size_t count);
+  // Take ownership of the specified `span` unless every span registered with
+  // this segment has finished, in which case leave `span` alone.  Return
+  // whether `span` was registered.  Unlike `register_span`, this may be
+  // called by code that does not hold an unfinished span of this segment.
+  bool register_span_if_unfinished(std::unique_ptr<SpanData>& span);
   // Take ownership of the specified `span`.
   void register_span(std::unique_ptr<SpanData> span);
-  // Increment the number of finished spans.  If that number is equal to the
-  // number of registered spans, send all of the spans to the `Collector`.
-  void span_finished();
+  // Take ownership of the specified `spans`, all at once.
+  void register_spans(std::vector<std::unique_ptr<SpanData>> spans);
+  // Note that the specified `span` is finished.  If it is the last of the
+  // registered spans to finish, send all of the unsent spans to the
+  // `Collector`.  Otherwise, if partial flushing is enabled and enough spans
+  // have finished, send the finished spans other than the local root.
+  void span_finished(SpanData& span);
+  // Note that the specified `finished_count` `finished_spans` are finished,
+  // as if by calling `span_finished` for each, but updating telemetry and the
+  // count of unfinished spans once for all of them.
+  void spans_finished(SpanData* const* finished_spans,
+                      std::size_t finished_count);
+
+  // Make a trace sampling decision now, if there isn't one already and unless
+  // this segment might delegate its decision.  If the trace is dropped and
+  // neither span sampling nor a tail sampling policy could keep any of its
+  // spans, then stop recording new spans until the decision is changed to
+  // keep the trace.
+  void make_early_sampling_decision();
+
+  // Record none of this segment's spans, not even its local root, and never
+  // send the segment to the `Collector`.  A sampling decision is still made
+  // when trace context is injected, so that the trace propagates as usual.
+  // The `Tracer` calls this on each segment that it creates while traces are
+  // not reported, before the segment's first span is created.
+  void disable_recording();
 
   // Set the sampling decision to be a local, manual decision with the specified
   // sampling `priority`.  Overwrite any previous sampling decision.
@@ -156,8 +323,33 @@ class TraceSegment {
   void make_sampling_decision_if_null();
   // Set or remove the `tags::internal::decision_maker` trace tag in
   // `trace_tags_` according to either information extracted from trace context
-  // or from a local sampling decision.
+  // or from a local sampling decision.  This is called whenever the sampling
+  // decision changes, and so it also discards `injection_headers_`.
   void update_decision_maker_trace_tag();
+  // Return the header values that `inject` writes for every span whose trace
+  // ID is the specified `trace_id`, computing them if necessary.  `mutex_`
+  // must be locked, and there must be a sampling decision.
+  std::shared_ptr<const InjectionHeaders> injection_headers(TraceID trace_id);
+  // Add the specified `count` spans, linked from the specified `newest`
+  // through `SpanData::next_registered` to the specified `oldest`, to
+  // `registered_spans_`.
+  void push_registered(SpanData* newest, SpanData* oldest, std::size_t count);
+  // Add the spans linked from the specified `newest` to the specified
+  // `oldest` to `registered_spans_` without counting them as unfinished.
+  void push_list(SpanData* newest, SpanData* oldest);
+  // Make a sampling decision if necessary, put the local root in front of the
+  // specified `spans`, whose first element is empty, decorate it with
+  // trace-level tags, and send the `spans` to the `Collector`.  This is the
+  // final chunk of the segment.
+  void finalize(std::vector<std::unique_ptr<SpanData>>&& spans);
+  // Send the finished spans in `registered_spans_` to the `Collector`, unless
+  // another flush is in progress.
+  void flush_finished_spans();
+  // Run the span sampler on the specified `spans`, whose trace was dropped.
+  void sample_spans(const std::vector<std::unique_ptr<SpanData>>& spans);
+  // Send the specified trace chunk `spans` to the `Collector`, if traces are
+  // reported.
+  void send(std::vector<std::unique_ptr<SpanData>>&& spans);
 };
 
 }  // namespace tracing
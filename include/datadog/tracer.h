@@ -11,12 +11,16 @@
 // `tracer_config.h`.
 
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "clock.h"
 #include "expected.h"
 #include "id_generator.h"
 #include "optional.h"
+#include "pressure.h"
 #include "span.h"
 #include "tracer_config.h"
 #include "tracer_signature.h"
@@ -24,13 +28,20 @@
 namespace datadog {
 namespace tracing {
 
+class BackgroundWorker;
+class DatadogAgent;
 class TracerTelemetry;
 class ConfigManager;
 class DictReader;
 struct SpanConfig;
+class SpanTemplate;
 class TraceSampler;
 class SpanSampler;
 class IDGenerator;
+struct StageTimings;
+struct TraceContext;
+struct TraceSegmentContext;
+class WorkerPool;
 
 class Tracer {
   std::shared_ptr<Logger> logger_;
@@ -39,14 +50,66 @@ class Tracer {
   std::shared_ptr<TracerTelemetry> tracer_telemetry_;
   std::shared_ptr<ConfigManager> config_manager_;
   std::shared_ptr<Collector> collector_;
-  std::shared_ptr<SpanSampler> span_sampler_;
-  std::shared_ptr<const IDGenerator> generator_;
-  Clock clock_;
-  std::vector<PropagationStyle> injection_styles_;
+  // The configuration shared by every trace segment that this tracer
+  // creates.  It is replaced, not modified, by `reinitialize_after_fork`.
+  std::shared_ptr<const TraceSegmentContext> segment_context_;
   std::vector<PropagationStyle> extraction_styles_;
-  Optional<std::string> hostname_;
-  std::size_t tags_header_max_size_;
-  bool sampling_delegation_enabled_;
+  bool early_sampling_decision_;
+  bool single_pass_extraction_;
+  // Whether `collector_` is a `NullCollector`, in which case traces are not
+  // worth recording.
+  bool null_collector_;
+  // Null unless the start of the Datadog Agent is deferred until the first
+  // span.  See `DatadogAgentConfig::lazy_start`.
+  struct DeferredStart;
+  std::shared_ptr<DeferredStart> deferred_start_;
+  // Null unless the collector is a Datadog Agent.  It is kept so that
+  // `reinitialize_after_fork` can create the agent again.
+  std::shared_ptr<FinalizedDatadogAgentConfig> agent_config_;
+  // Starts the thread of background finalization, if enabled, including
+  // again in `reinitialize_after_fork`.
+  ThreadFactory thread_factory_;
+  // The result of `config()`, which is computed when first needed and again
+  // only after remote configuration changes.
+  struct ConfigCache;
+  std::shared_ptr<ConfigCache> config_cache_;
+
+  // Start the specified `agent`, if any, send it the "app-started" telemetry
+  // event containing the specified `metadata`, and log this tracer's
+  // configuration if `log_on_startup` is true.
+  void start(DatadogAgent* agent,
+             const std::unordered_map<ConfigName, ConfigMetadata>& metadata,
+             bool log_on_startup);
+  // Do the work of `deferred_start_`, if any, unless it is already done.
+  void start_if_deferred();
+  // Return a new Datadog Agent configured by `agent_config_`, which encodes
+  // large trace chunks using the specified `workers`, if not null.
+  std::shared_ptr<DatadogAgent> make_agent(
+      const std::shared_ptr<WorkerPool>& workers);
+  // Return whether traces created now are reported, i.e. whether their spans
+  // are recorded.  This can change by remote configuration.
+  bool reports_traces() const;
+  // Return the root span of a new trace, configured by the specified
+  // `config`, which is a `const SpanConfig&`, a `SpanConfig&&`, or a
+  // `const SpanTemplate&`.
+  template <typename Config>
+  Span create_span_from(Config&& config);
+  // The configuration that each extraction of a batch shares.  See
+  // `extract_spans`.
+  struct ExtractionBatch;
+  // Return a new `ExtractionBatch` reflecting the current configuration.
+  ExtractionBatch begin_extraction();
+  // Return a span extracted from the specified `reader` and configured by the
+  // specified `config` and `batch`, having the specified `span_id`.  If there
+  // is no span to extract, or the trace context is invalid, then return null,
+  // and first call the specified `on_error` with a function that returns the
+  // `Error` describing why.  The message of the `Error` is formatted only if
+  // `on_error` calls that function.
+  template <typename OnError>
+  Optional<Span> extract_span_from(const DictReader& reader,
+                                   const SpanConfig& config,
+                                   const ExtractionBatch& batch,
+                                   std::uint64_t span_id, OnError&& on_error);
 
  public:
   // Create a tracer configured using the specified `config`, and optionally:
@@ -57,9 +120,16 @@ class Tracer {
          const std::shared_ptr<const IDGenerator>& generator);
 
   // Create a new trace and return the root span of the trace.  Optionally
-  // specify a `config` indicating the attributes of the root span.
+  // specify a `config` indicating the attributes of the root span.  If
+  // `config` is an rvalue, then its strings and tags are moved into the span
+  // rather than copied.
   Span create_span();
   Span create_span(const SpanConfig& config);
+  Span create_span(SpanConfig&& config);
+  // Create a new trace and return the root span of the trace, whose
+  // attributes are those prepared by the specified `span_template`.  See
+  // `span_template.h`.
+  Span create_span(const SpanTemplate& span_template);
 
   // Return a span whose parent and other context is parsed from the specified
   // `reader`, and whose attributes are determined by the optionally specified
@@ -70,6 +140,18 @@ class Tracer {
   Expected<Span> extract_span(const DictReader& reader,
                               const SpanConfig& config);
 
+  // Return the spans extracted from each of the specified `count` `readers`,
+  // in order, as if by calling `extract_span` for each, with the optionally
+  // specified `config`.  This is cheaper than calling `extract_span`
+  // repeatedly, e.g. for each message of a batch received from a message
+  // queue: the configuration is consulted once for the batch, and the spans'
+  // IDs are generated in a single call to `IDGenerator::span_ids`.
+  std::vector<Expected<Span>> extract_spans(const DictReader* const* readers,
+                                            std::size_t count);
+  std::vector<Expected<Span>> extract_spans(const DictReader* const* readers,
+                                            std::size_t count,
+                                            const SpanConfig& config);
+
   // Return a span extracted from the specified `reader` (see `extract_span`).
   // If there is no span to extract, or if an error occurs during extraction,
   // then return a span that is the root of a new trace (see `create_span`).
@@ -78,9 +160,41 @@ class Tracer {
   Span extract_or_create_span(const DictReader& reader,
                               const SpanConfig& config);
 
+  // Return a span that continues the trace of the specified `context`, which
+  // was returned by `Span::export_trace_context` (see `trace_context.h`), in
+  // a new trace segment, as if `context` had been injected and then
+  // extracted.  The span's attributes are determined by the optionally
+  // specified `config`.  The strings of `context` are moved into the segment.
+  Span continue_trace(TraceContext context);
+  Span continue_trace(TraceContext context, const SpanConfig& config);
+
   // Return a JSON object describing this Tracer's configuration. It is the same
-  // JSON object that was logged when this Tracer was created.
+  // JSON object that was logged when this Tracer was created, except for any
+  // changes made since then by remote configuration.
   std::string config() const;
+
+  // Return how far this tracer is falling behind in sending its traces, as
+  // reported by its collector, or as implied by how much of its memory budget
+  // is in use (see `TracerConfig::memory_budget`), whichever is higher.  This
+  // is cheap and does not block, so it can be consulted before creating each
+  // optional span.  See `pressure.h`.
+  Pressure pressure() const;
+
+  // Prepare this tracer for use in the child of a `fork`, when the tracer was
+  // created before the `fork`.  The threads of the tracer's Datadog Agent,
+  // event scheduler, and HTTP client do not exist in the child, so create
+  // them again from the configuration already finalized, without creating a
+  // new tracer.  The parent's instances, and any trace data buffered in
+  // them, are abandoned.  An event scheduler or HTTP client specified by the
+  // user is reused.  Call this function in the child before any other use of
+  // this tracer, and before the child starts other threads that might use it,
+  // e.g. in a worker process's initialization.  Copies of this tracer are not
+  // affected.
+  void reinitialize_after_fork();
+
+  // Return the durations of the stages of this Tracer's work, or return null
+  // if stage timing is disabled.  See `stage_timings.h`.
+  std::shared_ptr<StageTimings> stage_timings() const;
 };
 
 }  // namespace tracing
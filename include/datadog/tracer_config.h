@@ -8,16 +8,20 @@
 
 #include <cstddef>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
 #include "clock.h"
 #include "datadog_agent_config.h"
 #include "expected.h"
+#include "memory_resource.h"
 #include "propagation_style.h"
 #include "runtime_id.h"
 #include "span_defaults.h"
 #include "span_sampler_config.h"
+#include "thread_factory.h"
 #include "trace_sampler_config.h"
 
 namespace datadog {
@@ -69,8 +73,10 @@ struct TracerConfig {
   std::shared_ptr<Collector> collector;
 
   // `report_traces` indicates whether traces generated by the tracer will be
-  // sent to a collector (`true`) or discarded on completion (`false`).  If
-  // `report_traces` is `false`, then both `agent` and `collector` are ignored.
+  // sent to a collector (`true`) or not recorded at all (`false`).  If
+  // `report_traces` is `false`, then both `agent` and `collector` are ignored,
+  // and spans are created unrecorded, though they still propagate trace
+  // context (see `span.h`).
   // `report_traces` is overridden by the `DD_TRACE_ENABLED` environment
   // variable.
   Optional<bool> report_traces;
@@ -120,11 +126,175 @@ struct TracerConfig {
   // exceed `tags_header_size`, the header will be omitted instead.
   Optional<std::size_t> max_tags_header_size;
 
+  // `max_tag_value_length` is the greatest length, in bytes, of a string tag
+  // value stored in a span, whether it is set by a `Span` member function, a
+  // `SpanConfig`, or the default tags.  A span's name and resource are
+  // limited as though they were the "operation" and "resource.name" tags.  A
+  // longer value is cut short at a UTF-8 character boundary and ends with
+  // "...", so that the value, including the "...", fits within the limit.
+  // Tags whose names begin with "_dd." are not limited.  Zero means no limit,
+  // which is the default.
+  // `max_tag_value_length` is overridden by the
+  // `DD_TRACE_TAG_VALUE_MAX_LENGTH` environment variable.
+  Optional<std::size_t> max_tag_value_length;
+
+  // `tag_value_length_limits` maps tag names to limits, like
+  // `max_tag_value_length`, that apply to those tags instead, e.g. a larger
+  // limit for "db.statement", or zero for no limit.  It is meant for a few
+  // tags; each is compared with the name of every tag set.
+  // `tag_value_length_limits` is overridden by the
+  // `DD_TRACE_TAG_VALUE_LENGTH_LIMITS` environment variable, whose value is a
+  // list of "name:length" pairs separated by commas or spaces.
+  Optional<std::unordered_map<std::string, std::size_t>>
+      tag_value_length_limits;
+
+  // `partial_flush_enabled` indicates whether the finished spans of a trace
+  // segment that is still in progress are sent to the collector before the
+  // segment's last span finishes.  This bounds the memory held by long-lived
+  // traces, such as those of streaming RPCs or batch jobs.  The local root
+  // span is always sent with the last chunk of its segment.
+  // `partial_flush_enabled` is overridden by the
+  // `DD_TRACE_PARTIAL_FLUSH_ENABLED` environment variable.  Partial flushing
+  // is disabled by default.
+  Optional<bool> partial_flush_enabled;
+
+  // `partial_flush_min_spans` is the number of finished spans that a trace
+  // segment accumulates before they are sent, if `partial_flush_enabled`.  It
+  // must be positive.  `partial_flush_min_spans` is overridden by the
+  // `DD_TRACE_PARTIAL_FLUSH_MIN_SPANS` environment variable.  The default is
+  // 500.
+  Optional<std::size_t> partial_flush_min_spans;
+
+  // `max_spans_per_trace` is the most spans that a trace segment records,
+  // including its local root.  Children created beyond the limit are not
+  // recorded: they propagate trace context as usual, but are not sent to the
+  // collector, and cost no memory once destroyed.  The local root of a
+  // truncated segment is tagged with the number of children created beyond
+  // the limit, not counting their own descendants.  This bounds the memory
+  // held by, and the time taken to finish, a trace that a bug causes to grow
+  // without bound.  Zero means no limit.
+  // `max_spans_per_trace` is overridden by the `DD_TRACE_MAX_SPANS_PER_TRACE`
+  // environment variable, and at runtime by the
+  // "tracing_max_spans_per_trace" of remote configuration.  There is no limit
+  // by default.
+  Optional<std::size_t> max_spans_per_trace;
+
+  // `span_summary_min_spans`, if nonzero, is the number of identical leaf
+  // spans, i.e. spans having the same parent, service, type, operation name,
+  // and resource name, and no children, at or above which a finished trace
+  // segment sends one summary span in their place.  The summary span covers
+  // the group, and has numeric tags giving the number of spans summarized,
+  // their total and longest durations, and how many had an error.  This
+  // shrinks traces that consist mostly of repetitive work, such as cache
+  // reads, at the cost of the individual spans.  Summarization is disabled if
+  // `DatadogAgentConfig::stats_computation_enabled`, since stats are computed
+  // from every span.  See `span_summary.h`.  `span_summary_min_spans` is
+  // overridden by the `DD_TRACE_SPAN_SUMMARY_MIN_SPANS` environment
+  // variable.  Zero, the default, means that spans are not summarized.
+  Optional<std::size_t> span_summary_min_spans;
+
+  // `memory_budget` is the most memory, in bytes, that the tracer aims to
+  // hold at once in spans and trace segments in progress, in trace chunks
+  // buffered by the collector, and in trace requests in flight or awaiting
+  // retry.  Once half of the budget is in use, buffered trace chunks are
+  // flushed early.  Once all of it is in use, new child spans are not
+  // recorded, as if beyond `max_spans_per_trace`, and trace chunks are
+  // dropped, until memory is released.  Memory is accounted for, and reported
+  // in telemetry, whether or not there is a budget.  Zero means no budget.
+  // `memory_budget` is overridden by the `DD_TRACE_MEMORY_BUDGET_BYTES`
+  // environment variable.  There is no budget by default.
+  Optional<std::size_t> memory_budget;
+
+  // `background_finalization` indicates whether a trace segment whose last
+  // span has finished is sampled, finalized, and sent to the collector on a
+  // dedicated thread, rather than on the thread that finished the span.  This
+  // keeps the cost of finishing the last span of a trace independent of the
+  // size of the trace.  `background_finalization` is overridden by the
+  // `DD_TRACE_BACKGROUND_FINALIZATION_ENABLED` environment variable.  It is
+  // disabled by default.
+  Optional<bool> background_finalization;
+
+  // `parallel_finalization_min_spans`, if nonzero, is the number of spans at
+  // or above which a trace segment, or a chunk of one, is finalized by
+  // several threads at once: its spans are divided into ranges, which are
+  // matched against the span sampling rules, and encoded by the Datadog
+  // Agent collector, concurrently, and the encoded ranges are concatenated.
+  // This shortens the finalization of traces having tens of thousands of
+  // spans.  Smaller traces are finalized on one thread, as usual.
+  // `parallel_finalization_min_spans` is overridden by the
+  // `DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS` environment variable.  Zero,
+  // the default, means that finalization is not divided.
+  Optional<std::size_t> parallel_finalization_min_spans;
+
+  // `parallel_finalization_threads` is the number of threads that help the
+  // finalizing thread if `parallel_finalization_min_spans` is nonzero.  The
+  // default is half of the hardware threads, but at least one and at most
+  // four.
+  Optional<std::size_t> parallel_finalization_threads;
+
+  // `early_sampling_decision` indicates whether the trace sampling decision
+  // for a trace segment is made as soon as its local root span is created or
+  // extracted, rather than when it is first needed.  If the trace is dropped,
+  // and there are no span sampling rules, then the children of its spans are
+  // not recorded: they have IDs and can be injected, but they ignore tags and
+  // other properties, and are not sent to the collector.  Only the local root
+  // span of such a segment is sent.  Note that the decision is then made
+  // before any properties set on the root span after its creation, such as
+  // its resource name, are known to the trace sampler.  Sampling delegation,
+  // if enabled, takes precedence over an early decision.
+  // `early_sampling_decision` is overridden by the
+  // `DD_TRACE_EARLY_SAMPLING_DECISION_ENABLED` environment variable.  It is
+  // disabled by default.
+  Optional<bool> early_sampling_decision;
+
+  // `single_pass_extraction` indicates whether `Tracer::extract_span` visits
+  // the headers once, using `DictReader::visit`, and extracts every configured
+  // propagation style from what it saw, rather than calling
+  // `DictReader::lookup` for each header of each style.  This is faster for
+  // readers whose lookups are expensive, such as a linear scan of a list of
+  // HTTP headers.  It requires that `DictReader::visit` visit every header,
+  // and that the values it passes to the visitor remain valid until
+  // `extract_span` returns.  Header names are then matched
+  // case-insensitively.  `single_pass_extraction` is overridden by the
+  // `DD_TRACE_SINGLE_PASS_EXTRACTION_ENABLED` environment variable.  It is
+  // disabled by default.
+  Optional<bool> single_pass_extraction;
+
+  // `stage_timing` indicates whether the tracer measures the time it spends in
+  // each stage of its own work, such as creating spans and encoding trace
+  // chunks.  The durations are available from `Tracer::stage_timings`, and are
+  // reported with the tracer's telemetry.  See `stage_timings.h`.
+  // `stage_timing` is overridden by the `DD_TRACE_STAGE_TIMING_ENABLED`
+  // environment variable.  It is disabled by default.
+  Optional<bool> stage_timing;
+
   // `logger` specifies how the tracer will issue diagnostic messages.  If
   // `logger` is null, then it defaults to a logger that inserts into
   // `std::cerr`.
   std::shared_ptr<Logger> logger;
 
+  // `async_logging` indicates whether the default logger writes to
+  // `std::cerr` from a background thread, with repeated messages collapsed
+  // and a limit on messages per second, rather than from the thread that
+  // logs.  It has no effect if `logger` is specified.  `async_logging` is
+  // overridden by the `DD_TRACE_ASYNC_LOGGING_ENABLED` environment variable.
+  // It is disabled by default.
+  Optional<bool> async_logging;
+
+  // `memory_resource` specifies where the tracer allocates the storage of
+  // spans and trace segments.  If `memory_resource` is null, then the global
+  // allocator is used.  There is at most one `MemoryResource` per process; see
+  // `memory_resource.h`.
+  std::shared_ptr<MemoryResource> memory_resource;
+
+  // `thread_factory` starts the threads that the tracer runs in the
+  // background: those of the default HTTP client and event scheduler, of
+  // background finalization, and of the asynchronous default logger.  If
+  // `thread_factory` is null, then they are started as plain `std::thread`s.
+  // An application can use it to pin the tracer's threads to particular CPUs,
+  // or to set their scheduling policy or priority.  See `thread_factory.h`.
+  ThreadFactory thread_factory;
+
   // `log_on_startup` indicates whether the tracer will log a banner of
   // configuration information once initialized.
   // `log_on_startup` is overridden by the `DD_TRACE_STARTUP_LOGS` environment
@@ -186,7 +356,22 @@ class FinalizedTracerConfig final {
 
   bool report_hostname;
   std::size_t tags_header_size;
+  std::size_t max_tag_value_length;
+  std::unordered_map<std::string, std::size_t> tag_value_length_limits;
+  bool partial_flush_enabled;
+  std::size_t partial_flush_min_spans;
+  std::size_t max_spans_per_trace;
+  std::size_t span_summary_min_spans;
+  std::size_t memory_budget;
+  bool background_finalization;
+  std::size_t parallel_finalization_min_spans;
+  std::size_t parallel_finalization_threads;
+  bool early_sampling_decision;
+  bool single_pass_extraction;
+  bool stage_timing;
   std::shared_ptr<Logger> logger;
+  std::shared_ptr<MemoryResource> memory_resource;
+  ThreadFactory thread_factory;
   bool log_on_startup;
   bool generate_128bit_trace_ids;
   Optional<RuntimeID> runtime_id;
@@ -18,6 +18,9 @@
 //    updates are relevant to the `Tracer` that created the collector that is
 //    polling the Datadog Agent. See
 //    `RemoteConfigurationManager::process_response` in `remote_config.h`.
+// 4. When traces are sent using the Datadog Agent's v0.7 trace API, the
+//    tracer signature, including the default version, heads each payload.
+//    See `DatadogAgent` in `datadog_agent.h`.
 
 #include <string>
 
@@ -35,15 +38,18 @@ struct TracerSignature {
   RuntimeID runtime_id;
   std::string default_service;
   std::string default_environment;
+  std::string default_version;
   std::string library_version;
   StringView library_language;
   StringView library_language_version;
 
   TracerSignature() = delete;
-  TracerSignature(RuntimeID id, std::string service, std::string environment)
+  TracerSignature(RuntimeID id, std::string service, std::string environment,
+                  std::string version = "")
       : runtime_id(id),
         default_service(std::move(service)),
         default_environment(std::move(environment)),
+        default_version(std::move(version)),
         library_version(tracer_version),
         library_language("cpp"),
         library_language_version(DD_TRACE_STRINGIFY(__cplusplus), 6) {}
@@ -0,0 +1,61 @@
+#include <datadog/active_span.h>
+#include <datadog/span.h>
+#include <datadog/trace_segment.h>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Readers outside of the process rely on the slot being five 64-bit integers.
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+static_assert(sizeof(std::atomic<std::uint64_t>) == sizeof(std::uint64_t));
+static_assert(sizeof(ActiveSpanSlot) == 5 * sizeof(std::uint64_t));
+
+// The slot is constant-initialized, so that its first use on a thread runs no
+// constructor.
+thread_local ActiveSpanSlot slot;
+
+}  // namespace
+
+void ActiveSpanSlot::write(const Value& value) {
+  // This is a sequence lock with a single writer.  The odd `sequence` marks
+  // the update as in progress before any ID is stored.
+  const std::uint64_t before = sequence.load(std::memory_order_relaxed);
+  sequence.store(before + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  trace_id_low.store(value.trace_id.low, std::memory_order_relaxed);
+  trace_id_high.store(value.trace_id.high, std::memory_order_relaxed);
+  span_id.store(value.span_id, std::memory_order_relaxed);
+  local_root_id.store(value.local_root_id, std::memory_order_relaxed);
+  sequence.store(before + 2, std::memory_order_release);
+}
+
+bool ActiveSpanSlot::read(Value& value) const {
+  const std::uint64_t before = sequence.load(std::memory_order_acquire);
+  if (before % 2) {
+    return false;
+  }
+  value.trace_id.low = trace_id_low.load(std::memory_order_relaxed);
+  value.trace_id.high = trace_id_high.load(std::memory_order_relaxed);
+  value.span_id = span_id.load(std::memory_order_relaxed);
+  value.local_root_id = local_root_id.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return sequence.load(std::memory_order_relaxed) == before;
+}
+
+ActiveSpanSlot& active_span_slot() { return slot; }
+
+ActiveSpanGuard::ActiveSpanGuard(const Span& span) : slot_(&slot) {
+  // Only this thread writes the slot, so this read cannot fail.
+  slot_->read(previous_);
+  ActiveSpanSlot::Value active;
+  active.trace_id = span.trace_id();
+  active.span_id = span.id();
+  active.local_root_id = span.trace_segment().local_root_id();
+  slot_->write(active);
+}
+
+ActiveSpanGuard::~ActiveSpanGuard() { slot_->write(previous_); }
+
+}  // namespace tracing
+}  // namespace datadog
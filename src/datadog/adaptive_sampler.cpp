@@ -0,0 +1,116 @@
+#include "adaptive_sampler.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// The weight of the most recent window in the smoothed traces per second.
+constexpr double smoothing = 0.5;
+
+// Smoothed traces per second below this are considered zero, so that a key
+// that stops sending traces eventually gives up its share of the target.
+constexpr double min_per_second = 0.001;
+
+// Return the FNV-1a hash of the specified `service` and `resource`.
+std::uint64_t key_hash(StringView service, StringView resource) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  const auto add = [&](StringView text) {
+    for (const char c : text) {
+      hash ^= std::uint64_t((unsigned char)c);
+      hash *= 1099511628211ULL;
+    }
+  };
+  add(service);
+  // Separate the fields, so that e.g. ("ab", "c") and ("a", "bc") differ.
+  hash ^= 0xff;
+  hash *= 1099511628211ULL;
+  add(resource);
+  return hash;
+}
+
+}  // namespace
+
+AdaptiveSampler::AdaptiveSampler(const Clock& clock, double target_per_second)
+    : clock_(clock),
+      target_per_second_(target_per_second),
+      window_start_(clock_().tick.time_since_epoch().count()) {}
+
+Rate AdaptiveSampler::rate(const SpanData& span) {
+  update_rates(clock_().tick);
+  Slot& slot = slots_[key_hash(span.service, span.resource) % num_slots];
+  slot.count.fetch_add(1, std::memory_order_relaxed);
+  return *Rate::from(slot.rate.load(std::memory_order_relaxed));
+}
+
+void AdaptiveSampler::update_rates(TimePoint now) {
+  const auto elapsed = [&]() {
+    return now - TimePoint(Duration(window_start_.load(
+                     std::memory_order_acquire)));
+  };
+
+  if (elapsed() < window) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Another thread might have computed new rates while we were waiting.
+  const auto duration = elapsed();
+  if (duration < window) {
+    return;
+  }
+
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(duration)
+          .count();
+  std::vector<Slot*> active;
+  for (Slot& slot : slots_) {
+    const auto count = slot.count.exchange(0, std::memory_order_relaxed);
+    slot.per_second =
+        smoothing * (count / seconds) + (1 - smoothing) * slot.per_second;
+    if (slot.per_second < min_per_second) {
+      slot.per_second = 0.0;
+      slot.rate.store(1.0, std::memory_order_relaxed);
+    } else {
+      active.push_back(&slot);
+    }
+  }
+
+  // Divide the target among the active slots, least busy first.  A slot whose
+  // traffic fits within an equal share of the remaining target keeps all of
+  // its traces, and leaves the rest of its share to the busier slots.
+  std::sort(active.begin(), active.end(),
+            [](const Slot* left, const Slot* right) {
+              return left->per_second < right->per_second;
+            });
+  double remaining = target_per_second_;
+  for (std::size_t i = 0; i < active.size(); ++i) {
+    Slot& slot = *active[i];
+    const double share = remaining / double(active.size() - i);
+    if (slot.per_second <= share) {
+      slot.rate.store(1.0, std::memory_order_relaxed);
+      remaining -= slot.per_second;
+    } else {
+      slot.rate.store(share / slot.per_second, std::memory_order_relaxed);
+      remaining -= share;
+    }
+  }
+
+  window_start_.store(now.time_since_epoch().count(),
+                      std::memory_order_release);
+}
+
+nlohmann::json AdaptiveSampler::config_json() const {
+  return nlohmann::json::object({
+      {"target_per_second", target_per_second_},
+      {"window_seconds", window.count()},
+      {"num_slots", num_slots},
+  });
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,90 @@
+#pragma once
+
+// This component provides a `class`, `AdaptiveSampler`, that chooses sample
+// rates for traces so that the number of traces kept per second stays near a
+// configured target, even as the volume of traces changes.
+//
+// Traces are counted by the service and resource name of their root span.
+// Once per window (one second), the counts are folded into a smoothed
+// estimate of each key's traces per second, and a new sample rate is
+// computed for each key.  The target is divided among the keys so that
+// low-volume keys keep all of their traces, and the remaining budget is
+// shared equally among the high-volume keys.  This way a spike in one
+// endpoint sheds its own traces instead of crowding out the others.
+//
+// Keys are hashed into a fixed number of slots.  Keys whose hashes share a
+// slot share a count and a sample rate.  A key seen for the first time has the
+// sample rate of its slot, which is one until traffic is counted in that slot.
+//
+// `AdaptiveSampler::rate` may be called concurrently from multiple threads.
+// Counting a trace and reading a sample rate are relaxed atomic operations.
+// A mutex is locked only to compute new rates, which happens at most once per
+// window, by whichever thread first notices that the window has elapsed.
+//
+// `TraceSampler` uses an `AdaptiveSampler`, if configured, for traces that no
+// sampling rule matches.  See `trace_sampler.h`.
+
+#include <datadog/clock.h>
+#include <datadog/rate.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+class AdaptiveSampler {
+ public:
+  // The number of distinct service/resource slots.
+  static constexpr std::size_t num_slots = 128;
+  // The interval at which sample rates are recomputed.
+  static constexpr std::chrono::seconds window{1};
+
+  AdaptiveSampler(const Clock& clock, double target_per_second);
+
+  AdaptiveSampler(const AdaptiveSampler&) = delete;
+
+  // Count the trace whose root is the specified `span`, and return the rate
+  // at which such traces are to be kept.
+  Rate rate(const SpanData& span);
+
+  nlohmann::json config_json() const;
+
+ private:
+  using Duration = std::chrono::steady_clock::duration;
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  struct Slot {
+    // The number of traces counted in the current window.
+    std::atomic<std::uint64_t> count{0};
+    // The current sample rate.
+    std::atomic<double> rate{1.0};
+    // The smoothed estimate of traces per second.  `per_second` is accessed
+    // only while `mutex_` is locked.
+    double per_second = 0.0;
+  };
+
+  // Compute new sample rates if the window has elapsed as of the specified
+  // `now`.
+  void update_rates(TimePoint now);
+
+  Clock clock_;
+  double target_per_second_;
+  std::array<Slot, num_slots> slots_;
+  // `window_start_` is a `TimePoint`, stored as the number of ticks since the
+  // steady clock's epoch.
+  std::atomic<Duration::rep> window_start_;
+  // `mutex_` serializes computing new rates.
+  std::mutex mutex_;
+};
+
+}  // namespace tracing
+}  // namespace datadog
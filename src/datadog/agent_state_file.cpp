@@ -0,0 +1,131 @@
+#include "agent_state_file.h"
+
+#include <datadog/error.h>
+#include <datadog/rate.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#include "platform_util.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr int format_version = 1;
+
+Error file_error(const std::string& path, const char* what) {
+  std::string message;
+  message += "Unable to ";
+  message += what;
+  message += " the Datadog Agent state file \"";
+  message += path;
+  message += '"';
+  return Error{Error::DATADOG_AGENT_STATE_FILE_FAILED, std::move(message)};
+}
+
+}  // namespace
+
+AgentStateFile::AgentStateFile(std::string path,
+                               std::shared_ptr<Logger> logger)
+    : path_(std::move(path)), logger_(std::move(logger)) {
+  std::ifstream file(path_, std::ios::binary);
+  if (!file) {
+    // There's no state yet.
+    return;
+  }
+
+  const std::string content{std::istreambuf_iterator<char>(file),
+                            std::istreambuf_iterator<char>()};
+  auto state = nlohmann::json::parse(content, /*parser_callback=*/nullptr,
+                                     /*allow_exceptions=*/false);
+  if (!state.is_object() || state.value("version", 0) != format_version) {
+    logger_->log_error(file_error(path_, "parse"));
+    return;
+  }
+  state_ = std::move(state);
+}
+
+Optional<CollectorResponse> AgentStateFile::rates() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto found = state_.find("rate_by_service");
+  if (found == state_.end() || !found->is_object()) {
+    return nullopt;
+  }
+
+  CollectorResponse response;
+  for (const auto& [key, value] : found->items()) {
+    if (!value.is_number()) {
+      continue;
+    }
+    auto rate = Rate::from(value.get<double>());
+    if (!rate) {
+      continue;
+    }
+    response.sample_rate_by_key.emplace(key, *rate);
+  }
+  if (response.sample_rate_by_key.empty()) {
+    return nullopt;
+  }
+  return response;
+}
+
+nlohmann::json AgentStateFile::remote_config() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return state_.value("remote_config", nlohmann::json{});
+}
+
+void AgentStateFile::save_rates(const CollectorResponse& response) {
+  auto rates = nlohmann::json::object();
+  for (const auto& [key, rate] : response.sample_rate_by_key) {
+    rates[key] = rate.value();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_["rate_by_service"] = std::move(rates);
+  save();
+}
+
+void AgentStateFile::save_remote_config(nlohmann::json state) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_["remote_config"] = std::move(state);
+  save();
+}
+
+void AgentStateFile::save() {
+  state_["version"] = format_version;
+
+  std::string content;
+  try {
+    content = state_.dump();
+  } catch (const nlohmann::json::exception&) {
+    // A remote configuration is not valid UTF-8.
+    logger_->log_error(file_error(path_, "serialize"));
+    return;
+  }
+
+  // Each process writes a temporary file of its own, so that processes
+  // sharing the state file do not write over each other's partial files.
+  std::string partial = path_;
+  partial += ".tmp.";
+  partial += std::to_string(get_process_id());
+  {
+    std::ofstream file(partial, std::ios::binary | std::ios::trunc);
+    file << content;
+    file.close();
+    if (!file) {
+      logger_->log_error(file_error(partial, "write"));
+      std::remove(partial.c_str());
+      return;
+    }
+  }
+  if (std::rename(partial.c_str(), path_.c_str()) != 0) {
+    logger_->log_error(file_error(path_, "replace"));
+    std::remove(partial.c_str());
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
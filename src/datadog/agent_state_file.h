@@ -0,0 +1,78 @@
+#pragma once
+
+// This component provides a class, `AgentStateFile`, that keeps what a
+// `DatadogAgent` learned from the Datadog Agent in a file, so that the next
+// process to use the file starts where this one left off.  See
+// `DatadogAgentConfig::state_file`.
+//
+// Until the Datadog Agent first responds to traces, the trace sampler keeps
+// traces at the default rate of 100%, and until the first Remote
+// Configuration response, the tracer uses only its local configuration.  When
+// many processes restart at once, e.g. during a rolling deploy, they all send
+// every trace for their first few flush intervals.  A process that loads the
+// state file instead samples with the rates, and the remote configuration,
+// that its predecessor last used.
+//
+// The file contains a JSON object:
+//
+//     {
+//       "version": 1,
+//       "rate_by_service": {"service:foo,env:prod": 0.25, ...},
+//       "remote_config": {...}
+//     }
+//
+// where "rate_by_service" is as in the Datadog Agent's response to traces,
+// and "remote_config" is as returned by `remote_config::Manager::state_json`.
+// Each is saved only when it changes, by writing a temporary file beside the
+// state file, and renaming it over the state file.  Processes that share a
+// state file thereby replace each other's state, but never see a partially
+// written file.
+
+#include <datadog/logger.h>
+#include <datadog/optional.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "collector_response.h"
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+
+class AgentStateFile {
+  const std::string path_;
+  const std::shared_ptr<Logger> logger_;
+  std::mutex mutex_;
+  nlohmann::json state_;
+
+ public:
+  // Load the state saved in the file at the specified `path`, if any.  If the
+  // file exists but cannot be read, log an error using the specified `logger`
+  // and start with no state.
+  AgentStateFile(std::string path, std::shared_ptr<Logger> logger);
+
+  const std::string& path() const { return path_; }
+
+  // Return the sample rates loaded from the file, or return null if there are
+  // none.  The `body_hash` of the result is zero, so that the first response
+  // from the Datadog Agent replaces it.
+  Optional<CollectorResponse> rates();
+  // Return the Remote Configuration state loaded from the file, or return a
+  // null JSON value if there is none.
+  nlohmann::json remote_config();
+
+  // Save the sample rates of the specified `response` to the file.
+  void save_rates(const CollectorResponse& response);
+  // Save the specified Remote Configuration `state` to the file.
+  void save_remote_config(nlohmann::json state);
+
+ private:
+  // Write `state_` to the file.  The behavior is undefined unless `mutex_` is
+  // locked.
+  void save();
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,312 @@
+#include "async_cerr_logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "platform_util.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Return the text written by the specified `write`, followed by a newline.
+// The text is formatted in a stream belonging to the calling thread, so that
+// logging threads do not contend with each other.
+std::string format(const Logger::LogFunc& write) {
+  thread_local std::ostringstream stream;
+  stream.clear();
+  // Copy an empty string in, don't move it.
+  // We want `stream` to keep its storage.
+  const std::string empty;
+  stream.str(empty);
+
+  write(stream);
+  stream << '\n';
+  return stream.str();
+}
+
+}  // namespace
+
+struct AsyncCerrLogger::State {
+  // `Slot` is an element of a bounded multiple-producer queue.  A slot whose
+  // `sequence` equals a producer's position is free for that producer, and a
+  // slot whose `sequence` is one past the consumer's position holds a
+  // message for the consumer.
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    std::string message;
+  };
+
+  const Options options;
+  const std::size_t capacity;
+  const std::unique_ptr<Slot[]> slots;
+  std::atomic<std::size_t> enqueue_position{0};
+  // The messages dropped because the queue was full.
+  std::atomic<std::size_t> dropped{0};
+  // Whether the writer thread is waiting, and so needs to be woken up.
+  std::atomic<bool> writer_waiting{false};
+  const unsigned fork_generation = tracing::fork_generation();
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable flushed;
+  std::uint64_t flushes_requested = 0;
+  std::uint64_t flushes_done = 0;
+  bool stopping = false;
+
+  // The remaining members are accessed only by the writer thread.
+  std::size_t dequeue_position = 0;
+  // The most recent message, whether it was written, and how many times it
+  // has been repeated since it was written.
+  std::string last_message;
+  bool last_written = false;
+  std::size_t repeats = 0;
+  // The start of the current one-second window of the rate limit, the number
+  // of messages written in that window, and the number of messages
+  // suppressed since the last summary.
+  std::chrono::steady_clock::time_point window_start;
+  std::size_t written_in_window = 0;
+  std::size_t suppressed = 0;
+
+  explicit State(const Options& options);
+
+  // Enqueue the specified `message`.  Return false if the queue is full.
+  bool push(std::string&& message);
+  // Dequeue the oldest message into the specified `message`.  Return false if
+  // the queue is empty.
+  bool pop(std::string& message);
+  bool empty() const;
+
+  void run();
+  // Write every queued message, and summaries if they are due or if
+  // `force_summary` is true.
+  void write_queued(std::string& out, bool force_summary);
+  void process(std::string& message, std::string& out);
+  // Append a line reporting the repetitions of the last message, if any.
+  void summarize_repeats(std::string& out);
+  // Also append a line reporting the messages suppressed, if any.
+  void summarize(std::string& out);
+};
+
+AsyncCerrLogger::State::State(const Options& options)
+    : options(options),
+      capacity(std::max<std::size_t>(options.capacity, 1)),
+      slots(new Slot[capacity]),
+      window_start(std::chrono::steady_clock::now()) {
+  for (std::size_t i = 0; i < capacity; ++i) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool AsyncCerrLogger::State::push(std::string&& message) {
+  std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots[position % capacity];
+    const std::size_t sequence =
+        slot->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (enqueue_position.compare_exchange_weak(position, position + 1,
+                                                 std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < position) {
+      // The slot still holds a message from the previous lap.
+      return false;
+    } else {
+      position = enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->message = std::move(message);
+  slot->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+bool AsyncCerrLogger::State::pop(std::string& message) {
+  Slot& slot = slots[dequeue_position % capacity];
+  if (slot.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+    return false;
+  }
+  message.swap(slot.message);
+  slot.sequence.store(dequeue_position + capacity, std::memory_order_release);
+  ++dequeue_position;
+  return true;
+}
+
+bool AsyncCerrLogger::State::empty() const {
+  return slots[dequeue_position % capacity].sequence.load(
+             std::memory_order_acquire) != dequeue_position + 1;
+}
+
+void AsyncCerrLogger::State::run() {
+  std::string out;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    const bool stop = stopping;
+    const std::uint64_t flush_target = flushes_requested;
+    lock.unlock();
+    write_queued(out, stop || flush_target != flushes_done);
+    lock.lock();
+    if (flush_target != flushes_done) {
+      flushes_done = flush_target;
+      flushed.notify_all();
+    }
+    if (stop) {
+      return;
+    }
+
+    // A producer notifies without locking `mutex`, so a notification can be
+    // missed.  `poll_interval` bounds the delay when that happens.
+    writer_waiting.store(true);
+    wake.wait_for(lock, options.poll_interval, [this]() {
+      return stopping || flushes_requested != flushes_done || !empty();
+    });
+    writer_waiting.store(false);
+  }
+}
+
+void AsyncCerrLogger::State::write_queued(std::string& out,
+                                          bool force_summary) {
+  std::string message;
+  while (pop(message)) {
+    process(message, out);
+  }
+
+  if (const std::size_t count = dropped.exchange(0)) {
+    out += "[dd-trace-cpp] ";
+    out += std::to_string(count);
+    out +=
+        " log message(s) were dropped because the logging queue was full.\n";
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  if (now - window_start >= std::chrono::seconds(1)) {
+    summarize(out);
+    window_start = now;
+    written_in_window = 0;
+  } else if (force_summary) {
+    summarize(out);
+  }
+
+  if (!out.empty()) {
+    std::cerr << out;
+    std::cerr.flush();
+    out.clear();
+  }
+}
+
+void AsyncCerrLogger::State::process(std::string& message, std::string& out) {
+  const auto now = std::chrono::steady_clock::now();
+  if (now - window_start >= std::chrono::seconds(1)) {
+    summarize(out);
+    window_start = now;
+    written_in_window = 0;
+  }
+
+  if (message == last_message) {
+    if (last_written) {
+      ++repeats;
+    } else {
+      ++suppressed;
+    }
+    return;
+  }
+
+  summarize_repeats(out);
+  last_message.swap(message);
+  if (written_in_window >= options.max_per_second) {
+    last_written = false;
+    ++suppressed;
+    return;
+  }
+  last_written = true;
+  ++written_in_window;
+  out += last_message;
+}
+
+void AsyncCerrLogger::State::summarize_repeats(std::string& out) {
+  if (repeats != 0) {
+    out += "[dd-trace-cpp] The previous message was repeated ";
+    out += std::to_string(repeats);
+    out += " more time(s).\n";
+    repeats = 0;
+  }
+}
+
+void AsyncCerrLogger::State::summarize(std::string& out) {
+  summarize_repeats(out);
+  if (suppressed != 0) {
+    out += "[dd-trace-cpp] ";
+    out += std::to_string(suppressed);
+    out += " log message(s) were suppressed by the limit of ";
+    out += std::to_string(options.max_per_second);
+    out += " per second.\n";
+    suppressed = 0;
+  }
+}
+
+AsyncCerrLogger::AsyncCerrLogger() : AsyncCerrLogger(Options{}) {}
+
+AsyncCerrLogger::AsyncCerrLogger(const Options& options)
+    : state_(std::make_shared<State>(options)),
+      writer_(start_thread(options.thread_factory, "dd-logger",
+                           [state = state_]() { state->run(); })) {}
+
+AsyncCerrLogger::~AsyncCerrLogger() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stopping = true;
+  }
+  state_->wake.notify_one();
+
+  if (state_->fork_generation != fork_generation()) {
+    // The writer thread doesn't exist in this process.
+    writer_.detach();
+  } else {
+    writer_.join();
+  }
+}
+
+void AsyncCerrLogger::log_error(const LogFunc& write) { log(write); }
+
+void AsyncCerrLogger::log_startup(const LogFunc& write) { log(write); }
+
+void AsyncCerrLogger::flush() {
+  if (state_->fork_generation != fork_generation()) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  const std::uint64_t target = ++state_->flushes_requested;
+  state_->wake.notify_one();
+  state_->flushed.wait(lock,
+                       [&]() { return state_->flushes_done >= target; });
+}
+
+void AsyncCerrLogger::log(const LogFunc& write) {
+  std::string message = format(write);
+
+  if (state_->fork_generation != fork_generation()) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::cerr << message;
+    return;
+  }
+
+  if (!state_->push(std::move(message))) {
+    state_->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (state_->writer_waiting.load()) {
+    state_->wake.notify_one();
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,79 @@
+#pragma once
+
+// This component provides a class, `AsyncCerrLogger`, that implements the
+// `Logger` interface from `logger.h`.  Like `CerrLogger`, `AsyncCerrLogger`
+// prints to `std::cerr`, but it does not do so on the thread that logs.
+//
+// A logging thread formats its message into a buffer of its own, and then
+// enqueues the message in a fixed-size ring without taking a lock.  A
+// dedicated thread writes the queued messages to `std::cerr`.  If the ring is
+// full, then the message is dropped, and the number of dropped messages is
+// reported later.
+//
+// The writer thread collapses a message that is identical to the one written
+// just before it into a count of repetitions, and writes at most
+// `Options::max_per_second` messages per second.  The repetitions and the
+// messages suppressed by the rate limit are summarized in a later line, so
+// that a burst of errors, such as one request failure per trace during an
+// outage of the Datadog Agent, costs the logging threads little and the
+// standard error file less.
+//
+// `AsyncCerrLogger` is used as the default logger instead of `CerrLogger` if
+// `TracerConfig::async_logging` is enabled.
+//
+// In the child of a `fork`, the writer thread does not exist, and so messages
+// are written to `std::cerr` by the thread that logs, as `CerrLogger` does.
+
+#include <datadog/logger.h>
+#include <datadog/thread_factory.h>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace datadog {
+namespace tracing {
+
+class AsyncCerrLogger : public Logger {
+ public:
+  struct Options {
+    // The number of messages that can be queued for the writer thread.
+    std::size_t capacity = 1024;
+    // The most messages written in any one second, not counting summaries.
+    std::size_t max_per_second = 100;
+    // How long the writer thread waits for more messages before checking
+    // whether a summary is due.
+    std::chrono::milliseconds poll_interval{100};
+    // Starts the writer thread, if not null.
+    ThreadFactory thread_factory;
+  };
+
+ private:
+  struct State;
+
+  std::shared_ptr<State> state_;
+  std::thread writer_;
+
+ public:
+  AsyncCerrLogger();
+  explicit AsyncCerrLogger(const Options&);
+  // Write the messages that are still queued, and stop the writer thread.
+  ~AsyncCerrLogger();
+
+  AsyncCerrLogger(const AsyncCerrLogger&) = delete;
+
+  void log_error(const LogFunc&) override;
+  void log_startup(const LogFunc&) override;
+  using Logger::log_error;  // expose the non-virtual overloads
+
+  // Block until every message logged so far has been written to `std::cerr`,
+  // or dropped, and any summary due has been written.
+  void flush();
+
+ private:
+  void log(const LogFunc&);
+};
+
+}  // namespace tracing
+}  // namespace datadog
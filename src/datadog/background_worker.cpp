@@ -0,0 +1,101 @@
+#include "background_worker.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+#include "platform_util.h"
+
+namespace datadog {
+namespace tracing {
+struct BackgroundWorker::State {
+  std::mutex mutex;
+  std::condition_variable has_tasks_or_stopping;
+  std::condition_variable idle;
+  std::deque<std::function<void()>> tasks;
+  // Whether a task is being invoked.
+  bool busy = false;
+  bool stopping = false;
+  const unsigned fork_generation = tracing::fork_generation();
+
+  static void run(const std::shared_ptr<State>& state);
+};
+
+void BackgroundWorker::State::run(const std::shared_ptr<State>& state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  for (;;) {
+    state->has_tasks_or_stopping.wait(
+        lock, [&]() { return state->stopping || !state->tasks.empty(); });
+    if (state->tasks.empty()) {
+      return;
+    }
+
+    auto task = std::move(state->tasks.front());
+    state->tasks.pop_front();
+    state->busy = true;
+    lock.unlock();
+    task();
+    // Destroy the task before locking, since destroying it might destroy the
+    // `BackgroundWorker`.
+    task = nullptr;
+    lock.lock();
+    state->busy = false;
+    if (state->tasks.empty()) {
+      state->idle.notify_all();
+    }
+  }
+}
+
+BackgroundWorker::BackgroundWorker(const ThreadFactory& thread_factory,
+                                   StringView name)
+    : state_(std::make_shared<State>()),
+      thread_(start_thread(thread_factory, name,
+                           [state = state_]() { State::run(state); })) {}
+
+BackgroundWorker::~BackgroundWorker() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stopping = true;
+  }
+  state_->has_tasks_or_stopping.notify_one();
+
+  if (thread_.get_id() == std::this_thread::get_id() ||
+      state_->fork_generation != fork_generation()) {
+    // Either we're being destroyed by one of our own tasks, or the thread
+    // doesn't exist in this process.
+    thread_.detach();
+  } else {
+    thread_.join();
+  }
+}
+
+bool BackgroundWorker::post(std::function<void()> task) {
+  if (state_->fork_generation != fork_generation()) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->stopping) {
+      return false;
+    }
+    state_->tasks.push_back(std::move(task));
+  }
+  state_->has_tasks_or_stopping.notify_one();
+  return true;
+}
+
+void BackgroundWorker::drain() {
+  if (state_->fork_generation != fork_generation()) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->idle.wait(
+      lock, [this]() { return state_->tasks.empty() && !state_->busy; });
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,51 @@
+#pragma once
+
+// This component provides a `class`, `BackgroundWorker`, that invokes posted
+// tasks, in order, on a dedicated thread.
+//
+// `TraceSegment` uses a `BackgroundWorker`, if configured to, to finalize a
+// finished trace segment and send it to the `Collector` without delaying the
+// thread that finished the segment's last span.
+//
+// The thread's state is shared by the thread and the `BackgroundWorker`, so
+// that a `BackgroundWorker` may be destroyed by one of its own tasks.  In that
+// case, the thread is detached rather than joined, and it exits once there
+// are no more tasks.  Otherwise, `~BackgroundWorker` waits for the tasks
+// already posted to finish.
+
+#include <datadog/thread_factory.h>
+
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace datadog {
+namespace tracing {
+
+class BackgroundWorker {
+  struct State;
+
+  std::shared_ptr<State> state_;
+  std::thread thread_;
+
+ public:
+  // Start the worker thread using the specified `thread_factory`, if it is
+  // not null, identifying the thread by the specified `name`.
+  explicit BackgroundWorker(const ThreadFactory& thread_factory = nullptr,
+                            StringView name = "dd-finalizer");
+  ~BackgroundWorker();
+
+  BackgroundWorker(const BackgroundWorker&) = delete;
+
+  // Invoke the specified `task` on the worker thread after any tasks posted
+  // before it, without blocking the caller.  Return whether the task was
+  // posted.  A task is not posted if the worker thread does not exist in this
+  // process, as is the case in the child of a `fork`.
+  bool post(std::function<void()> task);
+
+  // Block until every task posted so far has finished.
+  void drain();
+};
+
+}  // namespace tracing
+}  // namespace datadog
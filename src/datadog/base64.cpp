@@ -2,6 +2,12 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#endif
 
 namespace datadog {
 namespace tracing {
@@ -28,61 +34,157 @@ constexpr uint8_t k_base64_table[] = {
     _,  _,  _,  _,  _,  _,  _,  _,     _,  _,  _,  _,  _,  _,  _,  _,  _,  _,
     _,  _,  _,  _};
 
-std::string base64_decode(StringView input) {
-  const size_t in_size = input.size();
+namespace {
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define DD_BASE64_SSSE3 1
 
-  std::string output;
-  output.reserve(in_size);
+bool has_ssse3() {
+  static const bool result = __builtin_cpu_supports("ssse3");
+  return result;
+}
 
-  size_t i = 0;
+// Decode as many 16 character blocks of the specified `input` as possible
+// into the specified `output`, stopping at the first block that contains a
+// character other than the 64 of the base64 alphabet, including '='.  Decode
+// no more than the specified `size` characters.  Return the number of
+// characters decoded, which is a multiple of 16.  Each block decodes into 12
+// bytes.  See http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html for
+// the technique.
+__attribute__((target("ssse3"))) std::size_t decode_blocks_ssse3(
+    const unsigned char* input, std::size_t size, char* output) {
+  // Bits of `lut_lo`, indexed by the low nibble of a character, and of
+  // `lut_hi`, indexed by the high nibble, that have no bit in common exactly
+  // when the character is in the alphabet.
+  const __m128i lut_lo =
+      _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                    0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi =
+      _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  // The offset from a character to its value, indexed by its high nibble,
+  // except for '/', which is at index 1.
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+                                         0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2F);
+  // Move the three bytes of each 32-bit lane to the front, in order.
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                     -1, -1, -1, -1);
+
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i chars =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    const __m128i hi_nibbles =
+        _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+    const __m128i lo_nibbles = _mm_and_si128(chars, mask_2f);
+    const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                         _mm_setzero_si128())) != 0) {
+      break;
+    }
 
-  for (; i + 4 < in_size;) {
-    uint32_t c0 = k_base64_table[static_cast<size_t>(input[i++])];
-    uint32_t c1 = k_base64_table[static_cast<size_t>(input[i++])];
-    uint32_t c2 = k_base64_table[static_cast<size_t>(input[i++])];
-    uint32_t c3 = k_base64_table[static_cast<size_t>(input[i++])];
+    const __m128i eq_2f = _mm_cmpeq_epi8(chars, mask_2f);
+    const __m128i roll =
+        _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    chars = _mm_add_epi8(chars, roll);
+
+    // Each character is now a six bit value.  Combine pairs into 12 bits, and
+    // then pairs of those into 24 bits.
+    const __m128i merged =
+        _mm_maddubs_epi16(chars, _mm_set1_epi32(0x01400140));
+    const __m128i packed = _mm_shuffle_epi8(
+        _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000)), pack);
+
+    char bytes[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), packed);
+    std::memcpy(output + i / 4 * 3, bytes, 12);
+  }
+
+  return i;
+}
+#endif
+
+std::string decode(StringView input, bool vectorize) {
+  const std::size_t in_size = input.size();
+  // If padding is missing, return the empty string in lieu of an Error.
+  if (in_size == 0 || in_size % 4 != 0) return "";
+
+  // Decode directly into `output`, which is trimmed to size at the end.
+  std::string output(in_size / 4 * 3, '\0');
+  const auto* const in = reinterpret_cast<const unsigned char*>(input.data());
+  char* const out = &output[0];
+  // Every quadruplet but the last is decoded in the loop.  The last might be
+  // padded.
+  const std::size_t body_size = in_size - 4;
+
+  std::size_t i = 0;
+#ifdef DD_BASE64_SSSE3
+  if (vectorize && has_ssse3()) {
+    i = decode_blocks_ssse3(in, body_size, out);
+  }
+#else
+  (void)vectorize;
+#endif
+
+  for (; i < body_size; i += 4) {
+    uint32_t c0 = k_base64_table[in[i]];
+    uint32_t c1 = k_base64_table[in[i + 1]];
+    uint32_t c2 = k_base64_table[in[i + 2]];
+    uint32_t c3 = k_base64_table[in[i + 3]];
 
     if (c0 == k_sentinel || c1 == k_sentinel || c2 == k_sentinel ||
         c3 == k_sentinel) {
       return "";
     }
 
-    output.push_back(static_cast<char>(c0 << 2 | (c1 & 0xF0) >> 4));
-    output.push_back(static_cast<char>((c1 & 0x0F) << 4 | ((c2 & 0x3C) >> 2)));
-    output.push_back(static_cast<char>(((c2 & 0x03) << 6) | (c3 & 0x3F)));
+    char* const dest = out + i / 4 * 3;
+    dest[0] = static_cast<char>(c0 << 2 | (c1 & 0xF0) >> 4);
+    dest[1] = static_cast<char>((c1 & 0x0F) << 4 | ((c2 & 0x3C) >> 2));
+    dest[2] = static_cast<char>(((c2 & 0x03) << 6) | (c3 & 0x3F));
   }
 
-  // If padding is missing, return the empty string in lieu of an Error.
-  if ((in_size - i) < 4) return "";
-
-  uint32_t c0 = k_base64_table[static_cast<size_t>(input[i++])];
-  uint32_t c1 = k_base64_table[static_cast<size_t>(input[i++])];
-  uint32_t c2 = k_base64_table[static_cast<size_t>(input[i++])];
-  uint32_t c3 = k_base64_table[static_cast<size_t>(input[i++])];
+  uint32_t c0 = k_base64_table[in[i]];
+  uint32_t c1 = k_base64_table[in[i + 1]];
+  uint32_t c2 = k_base64_table[in[i + 2]];
+  uint32_t c3 = k_base64_table[in[i + 3]];
 
   if (c0 == k_sentinel || c1 == k_sentinel || c2 == k_sentinel ||
       c3 == k_sentinel) {
     return "";
   }
 
-  if (c2 == k_eol) {
+  char* const dest = out + i / 4 * 3;
+  dest[0] = static_cast<char>(c0 << 2 | (c1 & 0xF0) >> 4);
+  dest[1] = static_cast<char>((c1 & 0x0F) << 4 | ((c2 & 0x3C) >> 2));
+  dest[2] = static_cast<char>(((c2 & 0x03) << 6) | (c3 & 0x3F));
+
+  // Compare the characters, not their values, since 'A' is also zero.
+  if (in[i + 2] == '=') {
     // The last quadruplet is of the form "xx==", where only one character needs
     // to be decoded.
-    output.push_back(static_cast<char>(c0 << 2 | (c1 & 0xF0) >> 4));
-  } else if (c3 == k_eol) {
+    output.resize(output.size() - 2);
+  } else if (in[i + 3] == '=') {
     // The last quadruplet is of the form "xxx=", where only two character needs
     // to be decoded.
-    output.push_back(static_cast<char>(c0 << 2 | (c1 & 0xF0) >> 4));
-    output.push_back(static_cast<char>((c1 & 0x0F) << 4 | ((c2 & 0x3C) >> 2)));
-  } else {
-    // The last quadruplet is not padded -> common use case
-    output.push_back(static_cast<char>(c0 << 2 | (c1 & 0xF0) >> 4));
-    output.push_back(static_cast<char>((c1 & 0x0F) << 4 | ((c2 & 0x3C) >> 2)));
-    output.push_back(static_cast<char>(((c2 & 0x03) << 6) | (c3 & 0x3F)));
+    output.resize(output.size() - 1);
   }
+  // Otherwise, the last quadruplet is not padded -> common use case
 
   return output;
 }
 
+}  // namespace
+
+std::string base64_decode(StringView input) {
+  return decode(input, /*vectorize=*/true);
+}
+
+std::string base64_decode_scalar(StringView input) {
+  return decode(input, /*vectorize=*/false);
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -9,7 +9,15 @@ namespace tracing {
 
 // Return the result of decoding the specified padded base64-encoded `input`. If
 // `input` is not padded, then return the empty string instead.
+//
+// Where the CPU supports it (SSSE3 on x86), 16 characters are decoded at a
+// time.
 std::string base64_decode(StringView input);
 
+// Return the same result as `base64_decode`, but decode one quadruplet of
+// characters at a time.  This is the reference implementation against which
+// the vectorized decoder is tested.
+std::string base64_decode_scalar(StringView input);
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,42 @@
+#include <datadog/batch_sampling.h>
+
+#include <algorithm>
+
+#include "sampling_util.h"
+
+namespace datadog {
+namespace tracing {
+
+void keep_by_rate(const std::uint64_t* trace_ids, std::size_t count,
+                  Rate rate, std::uint64_t* keep) {
+  const std::uint64_t threshold = max_id_from_rate(rate);
+  for (std::size_t begin = 0; begin < count; begin += 64) {
+    const std::size_t size = std::min<std::size_t>(64, count - begin);
+    const std::uint64_t* const chunk = trace_ids + begin;
+    std::uint64_t bits = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+      bits |= std::uint64_t(knuth_hash(chunk[i]) < threshold) << i;
+    }
+    keep[begin / 64] = bits;
+  }
+}
+
+void keep_by_rates(const std::uint64_t* trace_ids, const Rate* rates,
+                   std::size_t count, std::uint64_t* keep) {
+  for (std::size_t begin = 0; begin < count; begin += 64) {
+    const std::size_t size = std::min<std::size_t>(64, count - begin);
+    std::uint64_t thresholds[64];
+    for (std::size_t i = 0; i < size; ++i) {
+      thresholds[i] = max_id_from_rate(rates[begin + i]);
+    }
+    const std::uint64_t* const chunk = trace_ids + begin;
+    std::uint64_t bits = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+      bits |= std::uint64_t(knuth_hash(chunk[i]) < thresholds[i]) << i;
+    }
+    keep[begin / 64] = bits;
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,137 @@
+#pragma once
+
+// This component provides a class template, `BlockCache`, that keeps freed
+// storage of one size for reuse by the same thread, and an allocator,
+// `CachingAllocator`, that allocates single objects using `BlockCache`.
+//
+// Objects that are allocated once per span or per trace, such as `SpanData`
+// and `TraceSegment`, are freed soon after their trace is sent to the
+// `Collector`.  Rather than return that storage to the global allocator,
+// which is contended when many threads create spans, freed storage is kept in
+// a bounded per-thread cache and reused by the next object of the same size
+// allocated on the same thread.
+//
+// Storage freed on a thread other than the one that allocated it goes to the
+// freeing thread's cache.  A cache that is full returns storage to the
+// process's `MemoryResource` (see `memory_resource.h`), which by default is
+// the global allocator.
+
+#include <datadog/expected.h>
+#include <datadog/memory_resource.h>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+// Return the `MemoryResource` from which blocks are allocated.  The first call
+// settles it: afterward, `install_memory_resource` can no longer install a
+// different one.
+MemoryResource& block_memory_resource();
+
+// Make the specified `resource` the `MemoryResource` from which blocks are
+// allocated, and keep it alive until the process exits.  Return an error if
+// a different `MemoryResource`, or the global allocator, is already in use.
+Expected<void> install_memory_resource(
+    const std::shared_ptr<MemoryResource>& resource);
+
+template <std::size_t Size, std::size_t MaxBlocks>
+class BlockCache {
+  std::vector<void*> blocks_;
+
+  // Storage might be freed on a thread whose cache has already been
+  // destroyed, e.g. by another thread-local object's destructor.  A trivially
+  // destructible flag remains usable in that case.
+  static inline thread_local bool destroyed_ = false;
+
+  BlockCache() { blocks_.reserve(MaxBlocks); }
+
+  ~BlockCache() {
+    destroyed_ = true;
+    MemoryResource& resource = block_memory_resource();
+    for (void* block : blocks_) {
+      resource.deallocate(block, Size);
+    }
+  }
+
+  static BlockCache& instance() {
+    thread_local BlockCache cache;
+    return cache;
+  }
+
+ public:
+  // Return `Size` bytes of storage, reusing storage freed on this thread if
+  // there is any.
+  static void* allocate() {
+    if (!destroyed_) {
+      auto& blocks = instance().blocks_;
+      if (!blocks.empty()) {
+        void* block = blocks.back();
+        blocks.pop_back();
+        return block;
+      }
+    }
+    return block_memory_resource().allocate(Size);
+  }
+
+  // Keep the specified `block`, which was returned by `allocate`, for reuse
+  // on this thread, or free it if this thread's cache is full.
+  static void deallocate(void* block) noexcept {
+    if (!destroyed_) {
+      auto& blocks = instance().blocks_;
+      if (blocks.size() < MaxBlocks) {
+        blocks.push_back(block);  // never reallocates
+        return;
+      }
+    }
+    block_memory_resource().deallocate(block, Size);
+  }
+};
+
+// `CachingAllocator` is an allocator, e.g. for `std::allocate_shared`, that
+// takes single objects from a `BlockCache` of at most `MaxBlocks` blocks.
+template <typename T, std::size_t MaxBlocks = 64>
+struct CachingAllocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = CachingAllocator<U, MaxBlocks>;
+  };
+
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+  CachingAllocator() = default;
+  template <typename U>
+  CachingAllocator(const CachingAllocator<U, MaxBlocks>&) {}
+
+  T* allocate(std::size_t n) {
+    if (n == 1) {
+      return static_cast<T*>(BlockCache<sizeof(T), MaxBlocks>::allocate());
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* pointer, std::size_t n) noexcept {
+    if (n == 1) {
+      BlockCache<sizeof(T), MaxBlocks>::deallocate(pointer);
+    } else {
+      ::operator delete(pointer);
+    }
+  }
+
+  template <typename U>
+  bool operator==(const CachingAllocator<U, MaxBlocks>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const CachingAllocator<U, MaxBlocks>&) const {
+    return false;
+  }
+};
+
+}  // namespace tracing
+}  // namespace datadog
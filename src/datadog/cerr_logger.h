@@ -7,6 +7,7 @@
 // `CerrLogger` is the default logger used by `Tracer` unless otherwise
 // configured in `TracerConfig`.
 
+#include <datadog/lock_statistics.h>
 #include <datadog/logger.h>
 
 #include <mutex>
@@ -16,7 +17,9 @@ namespace datadog {
 namespace tracing {
 
 class CerrLogger : public Logger {
-  std::mutex mutex_;
+  using Mutex = TracerMutex<TracerLock::cerr_logger>;
+
+  Mutex mutex_;
   std::ostringstream stream_;
 
  public:
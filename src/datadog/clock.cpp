@@ -1,12 +1,53 @@
 #include <datadog/clock.h>
 
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
 namespace datadog {
 namespace tracing {
+namespace {
+
+using SystemDuration = std::chrono::system_clock::duration;
+
+// `fast_clock` state: the system clock minus the steady clock, as a count of
+// `SystemDuration`, and the steady clock tick count at which to sample the
+// offset again.  `next_sample` is stored after `wall_offset`, with release
+// semantics, so that a reader that sees a sampled `next_sample` also sees its
+// offset.
+std::atomic<SystemDuration::rep> wall_offset{0};
+std::atomic<std::chrono::steady_clock::rep> next_sample{
+    std::numeric_limits<std::chrono::steady_clock::rep>::min()};
+
+constexpr auto sample_interval = std::chrono::seconds(1);
+
+}  // namespace
 
 const Clock default_clock = []() {
   return TimePoint{std::chrono::system_clock::now(),
                    std::chrono::steady_clock::now()};
 };
 
+const Clock fast_clock = []() {
+  const auto tick = std::chrono::steady_clock::now();
+  const auto since_tick_epoch =
+      std::chrono::duration_cast<SystemDuration>(tick.time_since_epoch());
+
+  if (tick.time_since_epoch().count() >=
+      next_sample.load(std::memory_order_acquire)) {
+    const auto wall = std::chrono::system_clock::now();
+    wall_offset.store((wall.time_since_epoch() - since_tick_epoch).count(),
+                      std::memory_order_relaxed);
+    next_sample.store((tick + sample_interval).time_since_epoch().count(),
+                      std::memory_order_release);
+    return TimePoint{wall, tick};
+  }
+
+  const SystemDuration offset{wall_offset.load(std::memory_order_relaxed)};
+  return TimePoint{std::chrono::system_clock::time_point(since_tick_epoch +
+                                                         offset),
+                   tick};
+};
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,21 @@
+#include <datadog/collector.h>
+
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+Expected<void> Collector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const ChunkTags& chunk_tags,
+    const std::shared_ptr<TraceSampler>& response_handler) {
+  for (const auto& span_ptr : spans) {
+    apply_chunk_tags(*span_ptr, chunk_tags);
+  }
+  return send(std::move(spans), response_handler);
+}
+
+Pressure Collector::pressure() const { return Pressure::NORMAL; }
+
+}  // namespace tracing
+}  // namespace datadog
@@ -2,16 +2,65 @@
 
 namespace datadog {
 namespace tracing {
+namespace {
+
+constexpr StringView service_prefix = "service:";
+constexpr StringView environment_prefix = ",env:";
+
+// Continue the FNV-1a hash `hash` with the specified `text`.
+std::uint64_t fnv1a(std::uint64_t hash, StringView text) {
+  for (const char c : text) {
+    hash ^= std::uint64_t((unsigned char)c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+constexpr std::uint64_t fnv1a_basis = 14695981039346656037ULL;
+
+// If the specified `text` begins with the specified `prefix`, remove the
+// prefix from `text` and return true.  Otherwise, return false.
+bool consume(StringView& text, StringView prefix) {
+  if (text.substr(0, prefix.size()) != prefix) {
+    return false;
+  }
+  text.remove_prefix(prefix.size());
+  return true;
+}
+
+}  // namespace
 
 std::string CollectorResponse::key(StringView service, StringView environment) {
   std::string result;
-  result += "service:";
+  append(result, service_prefix);
   append(result, service);
-  result += ",env:";
+  append(result, environment_prefix);
   append(result, environment);
   return result;
 }
 
+std::uint64_t CollectorResponse::key_hash(StringView service,
+                                          StringView environment) {
+  std::uint64_t hash = fnv1a(fnv1a_basis, service_prefix);
+  hash = fnv1a(hash, service);
+  hash = fnv1a(hash, environment_prefix);
+  return fnv1a(hash, environment);
+}
+
+std::uint64_t CollectorResponse::key_hash(StringView key) {
+  return fnv1a(fnv1a_basis, key);
+}
+
+bool CollectorResponse::key_equals(StringView key, StringView service,
+                                   StringView environment) {
+  return consume(key, service_prefix) && consume(key, service) &&
+         consume(key, environment_prefix) && key == environment;
+}
+
+std::uint64_t CollectorResponse::hash_body(StringView body) {
+  return fnv1a(fnv1a_basis, body);
+}
+
 const std::string CollectorResponse::key_of_default_rate =
     CollectorResponse::key("", "");
 
@@ -16,6 +16,7 @@
 #include <datadog/rate.h>
 #include <datadog/string_view.h>
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 
@@ -24,8 +25,24 @@ namespace tracing {
 
 struct CollectorResponse {
   static std::string key(StringView service, StringView environment);
+  // Return a hash of `key(service, environment)` for the specified `service`
+  // and `environment`, or return a hash of the specified `key`.  The two are
+  // equal when the keys are equal, but neither builds a key.
+  static std::uint64_t key_hash(StringView service, StringView environment);
+  static std::uint64_t key_hash(StringView key);
+  // Return whether the specified `key` is equal to
+  // `key(service, environment)`, without building the latter.
+  static bool key_equals(StringView key, StringView service,
+                         StringView environment);
   static const std::string key_of_default_rate;
+  // Return a hash of the specified response `body`.  Responses whose bodies
+  // have equal hashes are treated as the same response.
+  static std::uint64_t hash_body(StringView body);
+
   std::unordered_map<std::string, Rate> sample_rate_by_key;
+  // The `hash_body` of the response from which this was parsed, or zero if
+  // it is unknown.
+  std::uint64_t body_hash = 0;
 };
 
 }  // namespace tracing
@@ -0,0 +1,31 @@
+#include "compiled_span_matcher.h"
+
+#include <algorithm>
+
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+CompiledSpanMatcher::CompiledSpanMatcher(const SpanMatcher& matcher)
+    : service_(matcher.service),
+      name_(matcher.name),
+      resource_(matcher.resource) {
+  tags_.reserve(matcher.tags.size());
+  for (const auto& [name, pattern] : matcher.tags) {
+    tags_.emplace_back(name, Glob(pattern));
+  }
+}
+
+bool CompiledSpanMatcher::match(const SpanData& span) const {
+  return service_.match(span.service) && name_.match(span.name) &&
+         resource_.match(span.resource) &&
+         std::all_of(tags_.begin(), tags_.end(), [&](const auto& entry) {
+           const auto& [name, pattern] = entry;
+           const auto found = span.lookup_tag(name);
+           return found && pattern.match(*found);
+         });
+}
+
+}  // namespace tracing
+}  // namespace datadog
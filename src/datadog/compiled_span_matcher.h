@@ -0,0 +1,47 @@
+#pragma once
+
+// This component provides a `class`, `CompiledSpanMatcher`, that matches spans
+// in the same way as a `SpanMatcher`, but whose glob patterns have been
+// prepared in advance.  See `Glob` in `glob.h`.
+//
+// The samplers evaluate their rules against every trace or span, so they
+// compile each rule's `SpanMatcher` once, when the rules are configured.
+
+#include <datadog/span_matcher.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glob.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+class CompiledSpanMatcher {
+  Glob service_;
+  Glob name_;
+  Glob resource_;
+  std::vector<std::pair<std::string, Glob>> tags_;
+
+ public:
+  explicit CompiledSpanMatcher(const SpanMatcher&);
+
+  // Return whether the specified `span` matches.  The result is the same as
+  // that of `SpanMatcher::match` using the `SpanMatcher` that this object was
+  // compiled from.
+  bool match(const SpanData& span) const;
+
+  const Glob& service() const { return service_; }
+  const Glob& name() const { return name_; }
+
+  // Return whether this matcher has any tag patterns.  If it doesn't, then
+  // whether a span matches depends only on the span's service, operation
+  // name, and resource.
+  bool has_tags() const { return !tags_.empty(); }
+};
+
+}  // namespace tracing
+}  // namespace datadog
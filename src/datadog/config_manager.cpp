@@ -3,6 +3,7 @@
 #include "json_serializer.h"
 #include "parse_util.h"
 #include "string_util.h"
+#include "tags.h"
 #include "trace_sampler.h"
 
 namespace datadog {
@@ -23,6 +24,34 @@ nlohmann::json to_json(const SpanDefaults& defaults) {
   return result;
 }
 
+nlohmann::json to_json(const ConfigManager::PipelineOverrides& pipeline) {
+  auto result = nlohmann::json::object({});
+  if (pipeline.flush_interval) {
+    result["flush_interval_milliseconds"] = pipeline.flush_interval->count();
+  }
+  if (pipeline.max_buffered_bytes) {
+    result["max_buffered_bytes"] = *pipeline.max_buffered_bytes;
+  }
+  if (pipeline.max_spans_per_trace) {
+    result["max_spans_per_trace"] = *pipeline.max_spans_per_trace;
+  }
+  if (pipeline.compression_enabled) {
+    result["compression_enabled"] = *pipeline.compression_enabled;
+  }
+  return result;
+}
+
+// Return the positive integer at the specified `key` of the specified
+// object `j`, or return `nullopt` if there is none.
+Optional<std::uint64_t> positive_integer(const nlohmann::json& j,
+                                         StringView key) {
+  if (auto it = j.find(key);
+      it != j.cend() && it->is_number_unsigned() && *it != 0) {
+    return it->get<std::uint64_t>();
+  }
+  return nullopt;
+}
+
 using Rules = std::vector<TraceSamplerRule>;
 
 Expected<Rules> parse_trace_sampling_rules(const nlohmann::json& json_rules) {
@@ -116,6 +145,23 @@ ConfigManager::Update parse_dynamic_config(const nlohmann::json& j) {
     config_update.trace_sampling_rules = &(*tracing_sampling_rules_it);
   }
 
+  auto& pipeline = config_update.pipeline;
+  if (auto milliseconds =
+          positive_integer(j, "tracing_flush_interval_milliseconds")) {
+    pipeline.flush_interval = std::chrono::milliseconds(*milliseconds);
+  }
+  if (auto bytes = positive_integer(j, "tracing_max_buffered_bytes")) {
+    pipeline.max_buffered_bytes = *bytes;
+  }
+  if (auto max_spans_it = j.find("tracing_max_spans_per_trace");
+      max_spans_it != j.cend() && max_spans_it->is_number_unsigned()) {
+    pipeline.max_spans_per_trace = max_spans_it->get<std::size_t>();
+  }
+  if (auto compression_it = j.find("tracing_compression_enabled");
+      compression_it != j.cend() && compression_it->is_boolean()) {
+    pipeline.compression_enabled = compression_it->get<bool>();
+  }
+
   return config_update;
 }
 
@@ -131,10 +177,16 @@ ConfigManager::ConfigManager(const FinalizedTracerConfig& config,
       trace_sampler_(
           std::make_shared<TraceSampler>(config.trace_sampler, clock_)),
       rules_(config.trace_sampler.rules),
+      max_tag_value_length_(config.max_tag_value_length),
+      tag_value_length_limits_(config.tag_value_length_limits),
       span_defaults_(std::make_shared<SpanDefaults>(config.defaults)),
       report_traces_(config.report_traces),
+      snapshot_(nullptr),
       tracer_signature_(tracer_signature),
-      telemetry_(telemetry) {}
+      telemetry_(telemetry) {
+  std::lock_guard<Mutex> lock(mutex_);
+  publish();
+}
 
 rc::Products ConfigManager::get_products() { return rc::product::APM_TRACING; }
 
@@ -174,25 +226,47 @@ void ConfigManager::on_revert(const Configuration&) {
 }
 
 std::shared_ptr<TraceSampler> ConfigManager::trace_sampler() {
-  std::lock_guard<std::mutex> lock(mutex_);
+  // `trace_sampler_` itself never changes.  Its rules are updated in place.
   return trace_sampler_;
 }
 
 std::shared_ptr<const SpanDefaults> ConfigManager::span_defaults() {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return span_defaults_.value();
+  return snapshot_.load(std::memory_order_acquire)->span_defaults;
 }
 
 bool ConfigManager::report_traces() {
-  std::lock_guard<std::mutex> lock(mutex_);
-  return report_traces_.value();
+  return snapshot_.load(std::memory_order_acquire)->report_traces;
+}
+
+const ConfigManager::PipelineOverrides& ConfigManager::pipeline_overrides()
+    const {
+  return snapshot_.load(std::memory_order_acquire)->pipeline;
+}
+
+void ConfigManager::publish() {
+  const auto& span_defaults = span_defaults_.value();
+  const bool report_traces = report_traces_.value();
+
+  // Each update allocates new `SpanDefaults`, so compare them by value.
+  for (const auto& snapshot : snapshots_) {
+    if (snapshot->report_traces == report_traces &&
+        *snapshot->span_defaults == *span_defaults &&
+        snapshot->pipeline == pipeline_) {
+      snapshot_.store(snapshot.get(), std::memory_order_release);
+      return;
+    }
+  }
+
+  snapshots_.push_back(std::make_unique<const Snapshot>(
+      Snapshot{span_defaults, report_traces, pipeline_}));
+  snapshot_.store(snapshots_.back().get(), std::memory_order_release);
 }
 
 std::vector<ConfigMetadata> ConfigManager::apply_update(
     const ConfigManager::Update& conf) {
   std::vector<ConfigMetadata> metadata;
 
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
 
   // NOTE(@dmehala): Sampling rules are generally not well specified.
   //
@@ -262,6 +336,8 @@ std::vector<ConfigMetadata> ConfigManager::apply_update(
     if (auto error = parsed_tags.if_error()) {
       tags_metadata.error = *error;
     }
+    tags::truncate_tag_values(*parsed_tags, max_tag_value_length_,
+                              tag_value_length_limits_);
 
     if (*parsed_tags != span_defaults_.value()->tags) {
       auto new_span_defaults =
@@ -284,6 +360,29 @@ std::vector<ConfigMetadata> ConfigManager::apply_update(
     }
   }
 
+  const auto& pipeline = conf.pipeline;
+  override_config(
+      ConfigName::FLUSH_INTERVAL, pipeline_.flush_interval,
+      pipeline.flush_interval,
+      [](std::chrono::milliseconds value) {
+        return std::to_string(value.count());
+      },
+      metadata);
+  const auto size_to_string = [](std::size_t value) {
+    return std::to_string(value);
+  };
+  override_config(ConfigName::MAX_BUFFERED_BYTES, pipeline_.max_buffered_bytes,
+                  pipeline.max_buffered_bytes, size_to_string, metadata);
+  override_config(ConfigName::MAX_SPANS_PER_TRACE,
+                  pipeline_.max_spans_per_trace, pipeline.max_spans_per_trace,
+                  size_to_string, metadata);
+  override_config(
+      ConfigName::COMPRESSION_ENABLED, pipeline_.compression_enabled,
+      pipeline.compression_enabled,
+      [](bool value) { return to_string(value); }, metadata);
+
+  publish();
+  generation_.fetch_add(1, std::memory_order_release);
   return metadata;
 }
 
@@ -296,11 +395,33 @@ void ConfigManager::reset_config(ConfigName name, T& conf,
   metadata.emplace_back(default_metadata_[name]);
 }
 
+template <typename T, typename Format>
+void ConfigManager::override_config(ConfigName name, Optional<T>& current,
+                                    const Optional<T>& update, Format&& format,
+                                    std::vector<ConfigMetadata>& metadata) {
+  if (update == current) return;
+
+  current = update;
+  if (update) {
+    ConfigMetadata remote(name, format(*update),
+                          ConfigMetadata::Origin::REMOTE_CONFIG);
+    metadata.push_back(std::move(remote));
+  } else if (auto found = default_metadata_.find(name);
+             found != default_metadata_.cend()) {
+    metadata.push_back(found->second);
+  }
+}
+
+std::uint64_t ConfigManager::generation() const {
+  return generation_.load(std::memory_order_acquire);
+}
+
 nlohmann::json ConfigManager::config_json() const {
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   return nlohmann::json{{"defaults", to_json(*span_defaults_.value())},
                         {"trace_sampler", trace_sampler_->config_json()},
-                        {"report_traces", report_traces_.value()}};
+                        {"report_traces", report_traces_.value()},
+                        {"pipeline_overrides", to_json(pipeline_)}};
 }
 
 }  // namespace tracing
@@ -2,16 +2,32 @@
 
 // The `ConfigManager` class is designed to handle configuration update
 // and provide access to the current configuration.
-// It utilizes a mutex to ensure thread safety when updating or accessing
-// the configuration.
+// Updates are serialized by a mutex.  The configuration read on the hot path,
+// when spans are created and when traces are finished, is published as an
+// immutable snapshot that is read without locking.
+//
+// Remote configuration can also tune the trace pipeline at runtime: the flush
+// interval, buffer limit, and compression of the `DatadogAgent`, and the span
+// limit of each `TraceSegment`.  These are `PipelineOverrides`, which are part
+// of the snapshot.  An override that is absent leaves the value that was
+// configured when the tracer was created.
 
 #include <datadog/clock.h>
+#include <datadog/lock_statistics.h>
 #include <datadog/optional.h>
 #include <datadog/remote_config/listener.h>
 #include <datadog/span_defaults.h>
 #include <datadog/tracer_config.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "json.hpp"
 #include "tracer_telemetry.h"
@@ -21,6 +37,30 @@ namespace tracing {
 
 class ConfigManager : public remote_config::Listener {
  public:
+  // `PipelineOverrides` are the trace pipeline parameters that remote
+  // configuration may change.  Each replaces the corresponding configured
+  // value while it is present.
+  struct PipelineOverrides {
+    // The least time between scheduled flushes of the `DatadogAgent`.  The
+    // flush is still scheduled at the configured period, so a remote
+    // interval shorter than that has no effect.
+    Optional<std::chrono::milliseconds> flush_interval;
+    // Replaces `DatadogAgentConfig::max_buffered_bytes`.
+    Optional<std::size_t> max_buffered_bytes;
+    // Replaces `TracerConfig::max_spans_per_trace`.  Zero means no limit.
+    Optional<std::size_t> max_spans_per_trace;
+    // Replaces `DatadogAgentConfig::compression_enabled`.  Ignored if this
+    // library was built without zlib.
+    Optional<bool> compression_enabled;
+
+    bool operator==(const PipelineOverrides& other) const {
+      return flush_interval == other.flush_interval &&
+             max_buffered_bytes == other.max_buffered_bytes &&
+             max_spans_per_trace == other.max_spans_per_trace &&
+             compression_enabled == other.compression_enabled;
+    }
+  };
+
   // The `Update` struct serves as a container for configuration that can
   // exclusively be changed remotely.
   //
@@ -31,6 +71,7 @@ class ConfigManager : public remote_config::Listener {
     Optional<double> trace_sampling_rate;
     Optional<std::vector<StringView>> tags;
     const nlohmann::json* trace_sampling_rules = nullptr;
+    PipelineOverrides pipeline;
   };
 
  private:
@@ -66,15 +107,42 @@ class ConfigManager : public remote_config::Listener {
     void operator=(const Value& rhs) { current_value_ = rhs; }
   };
 
-  mutable std::mutex mutex_;
+  // `Snapshot` is the configuration read by `span_defaults`,
+  // `report_traces`, and `pipeline_overrides`.  A snapshot is never modified
+  // once published.
+  struct Snapshot {
+    std::shared_ptr<const SpanDefaults> span_defaults;
+    bool report_traces;
+    PipelineOverrides pipeline;
+  };
+
+  using Mutex = TracerMutex<TracerLock::config_manager>;
+
+  mutable Mutex mutex_;
   Clock clock_;
   std::unordered_map<ConfigName, ConfigMetadata> default_metadata_;
 
-  std::shared_ptr<TraceSampler> trace_sampler_;
+  const std::shared_ptr<TraceSampler> trace_sampler_;
   std::vector<TraceSamplerRule> rules_;
+  // The limits to which the values of default tags set by remote
+  // configuration are truncated.  See `TracerConfig::max_tag_value_length`.
+  std::size_t max_tag_value_length_;
+  std::unordered_map<std::string, std::size_t> tag_value_length_limits_;
 
   DynamicConfig<std::shared_ptr<const SpanDefaults>> span_defaults_;
   DynamicConfig<bool> report_traces_;
+  PipelineOverrides pipeline_;
+
+  // Every snapshot that has been published.  A reader might still be using
+  // any of them, so none is freed before this object.  A snapshot is reused
+  // when the configuration returns to an earlier value, and so there is one
+  // snapshot per distinct configuration, which remote configuration changes
+  // rarely.  `snapshots_` is guarded by `mutex_`.
+  std::vector<std::unique_ptr<const Snapshot>> snapshots_;
+  // The current element of `snapshots_`.
+  std::atomic<const Snapshot*> snapshot_;
+  // Incremented by each `apply_update`.  See `generation`.
+  std::atomic<std::uint64_t> generation_{0};
 
   const TracerSignature& tracer_signature_;
   std::shared_ptr<TracerTelemetry> telemetry_;
@@ -83,6 +151,18 @@ class ConfigManager : public remote_config::Listener {
   template <typename T>
   void reset_config(ConfigName name, T& conf,
                     std::vector<ConfigMetadata>& metadata);
+  // Replace the specified `current` override of the configuration having the
+  // specified `name` by the specified `update`, and append to `metadata` the
+  // resulting configuration if it changed.  The specified `format` converts
+  // an override's value to its telemetry representation.
+  template <typename T, typename Format>
+  void override_config(ConfigName name, Optional<T>& current,
+                       const Optional<T>& update, Format&& format,
+                       std::vector<ConfigMetadata>& metadata);
+  // Make the current values of `span_defaults_`, `report_traces_`, and
+  // `pipeline_` visible to readers.  The behavior is undefined unless
+  // `mutex_` is locked.
+  void publish();
 
  public:
   ConfigManager(const FinalizedTracerConfig& config,
@@ -99,18 +179,31 @@ class ConfigManager : public remote_config::Listener {
   void on_post_process() override{};
 
   // Return the `TraceSampler` consistent with the most recent configuration.
+  // This function does not lock.
   std::shared_ptr<TraceSampler> trace_sampler();
 
   // Return the `SpanDefaults` consistent with the most recent configuration.
+  // This function does not lock.
   std::shared_ptr<const SpanDefaults> span_defaults();
 
-  // Return whether traces should be sent to the collector.
+  // Return whether traces should be sent to the collector.  This function
+  // does not lock.
   bool report_traces();
 
+  // Return the trace pipeline parameters most recently set by remote
+  // configuration.  The returned reference is valid for the lifetime of this
+  // object.  This function does not lock.
+  const PipelineOverrides& pipeline_overrides() const;
+
   // Return a JSON representation of the current configuration managed by this
   // object.
   nlohmann::json config_json() const;
 
+  // Return a number that changes whenever the result of `config_json` might
+  // have changed, so that a caller can tell whether a copy of it is stale.
+  // This function does not lock.
+  std::uint64_t generation() const;
+
   std::vector<ConfigMetadata> apply_update(const ConfigManager::Update& conf);
 };
 
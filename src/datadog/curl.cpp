@@ -3,22 +3,28 @@
 #include <datadog/dict_reader.h>
 #include <datadog/dict_writer.h>
 #include <datadog/http_client.h>
+#include <datadog/lock_statistics.h>
 #include <datadog/logger.h>
+#include <datadog/optional.h>
+#include <datadog/reactor.h>
 #include <datadog/string_view.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <chrono>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
-#include <list>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <system_error>
-#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include "parse_util.h"
 #include "string_util.h"
 
 namespace datadog {
@@ -35,6 +41,8 @@ CURL *CurlLibrary::easy_init() { return curl_easy_init(); }
 
 void CurlLibrary::easy_cleanup(CURL *handle) { curl_easy_cleanup(handle); }
 
+void CurlLibrary::easy_reset(CURL *handle) { curl_easy_reset(handle); }
+
 CURLcode CurlLibrary::easy_getinfo_private(CURL *curl, char **user_data) {
   return curl_easy_getinfo(curl, CURLINFO_PRIVATE, user_data);
 }
@@ -61,6 +69,14 @@ CURLcode CurlLibrary::easy_setopt_httpheader(CURL *handle,
   return curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
 }
 
+CURLcode CurlLibrary::easy_setopt_http_version(CURL *handle, long version) {
+  return curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, version);
+}
+
+CURLcode CurlLibrary::easy_setopt_pipewait(CURL *handle, long wait) {
+  return curl_easy_setopt(handle, CURLOPT_PIPEWAIT, wait);
+}
+
 CURLcode CurlLibrary::easy_setopt_post(CURL *handle, long post) {
   return curl_easy_setopt(handle, CURLOPT_POST, post);
 }
@@ -141,6 +157,39 @@ CURLMcode CurlLibrary::multi_remove_handle(CURLM *multi_handle,
   return curl_multi_remove_handle(multi_handle, easy_handle);
 }
 
+CURLMcode CurlLibrary::multi_setopt_pipelining(CURLM *multi_handle,
+                                               long bitmask) {
+  return curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, bitmask);
+}
+
+CURLMcode CurlLibrary::multi_setopt_socketdata(CURLM *multi_handle,
+                                               void *data) {
+  return curl_multi_setopt(multi_handle, CURLMOPT_SOCKETDATA, data);
+}
+
+CURLMcode CurlLibrary::multi_setopt_socketfunction(CURLM *multi_handle,
+                                                   SocketCallback on_socket) {
+  return curl_multi_setopt(multi_handle, CURLMOPT_SOCKETFUNCTION, on_socket);
+}
+
+CURLMcode CurlLibrary::multi_setopt_timerdata(CURLM *multi_handle,
+                                              void *data) {
+  return curl_multi_setopt(multi_handle, CURLMOPT_TIMERDATA, data);
+}
+
+CURLMcode CurlLibrary::multi_setopt_timerfunction(CURLM *multi_handle,
+                                                  TimerCallback on_timer) {
+  return curl_multi_setopt(multi_handle, CURLMOPT_TIMERFUNCTION, on_timer);
+}
+
+CURLMcode CurlLibrary::multi_socket_action(CURLM *multi_handle,
+                                           curl_socket_t socket,
+                                           int ev_bitmask,
+                                           int *running_handles) {
+  return curl_multi_socket_action(multi_handle, socket, ev_bitmask,
+                                  running_handles);
+}
+
 const char *CurlLibrary::multi_strerror(CURLMcode error) {
   return curl_multi_strerror(error);
 }
@@ -157,64 +206,159 @@ void CurlLibrary::slist_free_all(curl_slist *list) {
   curl_slist_free_all(list);
 }
 
+curl_version_info_data *CurlLibrary::version_info(CURLversion age) {
+  return curl_version_info(age);
+}
+
 using ErrorHandler = HTTPClient::ErrorHandler;
 using HeadersSetter = HTTPClient::HeadersSetter;
 using ResponseHandler = HTTPClient::ResponseHandler;
+using SharedBody = HTTPClient::SharedBody;
 using URL = HTTPClient::URL;
 
 class CurlImpl {
-  std::mutex mutex_;
+  // An easy handle that is not in use, together with the request headers that
+  // it last sent.  The header list is reused, in whole or in part, by the next
+  // request made with the handle.
+  struct IdleHandle {
+    CURL *handle;
+    curl_slist *request_headers;
+  };
+
+  // At most this many idle handles are kept for reuse.  Any more are cleaned
+  // up as their requests finish.
+  static constexpr std::size_t max_idle_handles = 8;
+
+  struct Request;
+
+  // `ReactorLink` is shared with the callbacks given to `reactor_`, which
+  // might be invoked after this object is destroyed.  `mutex` serializes use
+  // of `multi_handle_` by those callbacks, and `impl` is null once this object
+  // is being destroyed.
+  struct ReactorLink {
+    std::mutex mutex;
+    CurlImpl *impl;
+  };
+
   CurlLibrary &curl_;
   const std::shared_ptr<Logger> logger_;
   Clock clock_;
+  // Whether requests use HTTP/2.  This is false if HTTP/2 was requested but
+  // libcurl does not support it.
+  bool http2_;
   CURLM *multi_handle_;
+  // Null unless libcurl is driven by the application's event loop rather than
+  // by `event_loop_`.
+  std::shared_ptr<Reactor> reactor_;
+  std::shared_ptr<ReactorLink> link_;
+  // The reactor timer that stands in for libcurl's timer, if libcurl has
+  // one.  `timer_generation_` distinguishes a timer from the ones it replaced.
+  Optional<Reactor::TimerID> reactor_timer_;
+  std::uint64_t timer_generation_ = 0;
+  // `request_handles_` is accessed only by the event loop thread, or with
+  // `link_->mutex` locked.
   std::unordered_set<CURL *> request_handles_;
-  std::list<CURL *> new_handles_;
-  bool shutting_down_;
-  int num_active_handles_;
+  // Requests that have been posted but not yet added to `multi_handle_`, most
+  // recent first, linked through `Request::next`.  `post` pushes onto this
+  // list without taking any lock.
+  std::atomic<Request *> new_requests_;
+  // The number of requests that have been posted but not yet finished.
+  std::atomic<std::size_t> num_pending_requests_;
+  std::atomic<bool> shutting_down_;
+  // `mutex_` and `no_requests_` are used by `drain` to wait for
+  // `num_pending_requests_` to become zero.
+  using Mutex = TracerMutex<TracerLock::curl>;
+  Mutex mutex_;
+#if defined(DD_TRACE_LOCK_STATISTICS)
+  std::condition_variable_any no_requests_;
+#else
   std::condition_variable no_requests_;
+#endif
+  std::mutex idle_mutex_;
+  std::vector<IdleHandle> idle_handles_;
   std::thread event_loop_;
 
+  // `HeaderField` is the extent of a response header within
+  // `Request::response_header_data`.
+  struct HeaderField {
+    std::size_t offset;
+    std::size_t key_size;
+    std::size_t value_size;
+  };
+
   struct Request {
     CurlLibrary *curl = nullptr;
+    CURL *handle = nullptr;
+    Request *next = nullptr;
     curl_slist *request_headers = nullptr;
-    std::string request_body;
+    SharedBody request_body;
     ResponseHandler on_response;
     ErrorHandler on_error;
     char error_buffer[CURL_ERROR_SIZE] = "";
-    std::unordered_map<std::string, std::string> response_headers_lower;
+    // The response headers are stored end to end in `response_header_data`,
+    // each as its lowercased key followed by its value, so that reading them
+    // allocates only as the buffer grows.
+    std::string response_header_data;
+    std::vector<HeaderField> response_headers;
     std::string response_body;
     std::chrono::steady_clock::time_point deadline;
 
     ~Request();
   };
 
+  // `HeaderWriter` builds a list of request headers.  It can be given a list
+  // built for an earlier request, in which case it reuses that list's nodes
+  // for as long as the headers being set match them, and allocates new nodes
+  // only from the first header that differs.  Most headers that the tracer
+  // sends are the same from one request to the next.
   class HeaderWriter : public DictWriter {
     curl_slist *list_ = nullptr;
+    curl_slist *last_ = nullptr;
+    // The nodes of the recycled list that have not yet been reused.
+    curl_slist *unused_ = nullptr;
     std::string buffer_;
     CurlLibrary &curl_;
 
    public:
-    explicit HeaderWriter(CurlLibrary &curl);
+    HeaderWriter(CurlLibrary &curl, curl_slist *recycled);
     ~HeaderWriter();
     curl_slist *release();
     void set(StringView key, StringView value) override;
   };
 
+  // `HeaderReader` looks up a `Request`'s response headers by comparing keys
+  // case-insensitively, rather than by building a lowercase copy of the key.
   class HeaderReader : public DictReader {
-    std::unordered_map<std::string, std::string> *response_headers_lower_;
-    mutable std::string buffer_;
+    const Request *request_;
 
    public:
-    explicit HeaderReader(
-        std::unordered_map<std::string, std::string> *response_headers_lower);
+    explicit HeaderReader(const Request *request);
     Optional<StringView> lookup(StringView key) const override;
-    void visit(const std::function<void(StringView key, StringView value)>
-                   &visitor) const override;
+    void visit(Visitor visitor) const override;
   };
 
   void run();
-  void handle_message(const CURLMsg &, std::unique_lock<std::mutex> &);
+  // Add the requests in `new_requests_` to `multi_handle_`, except for those
+  // whose deadline has already passed, which fail.
+  void add_new_requests();
+  // Handle every message that libcurl has queued about finished requests.
+  void handle_messages();
+  // Release the requests and handles that remain when shutting down.
+  void clean_up();
+  // Tell libcurl that the specified `socket` is ready for the specified
+  // `events` (`CURL_CSELECT_*` bits), or that its timer expired if `socket`
+  // is `CURL_SOCKET_TIMEOUT`, and then handle any finished requests.
+  void socket_action(curl_socket_t socket, int events);
+  // Remove and return the requests in `new_requests_`, oldest first, linked
+  // through `Request::next`.
+  Request *take_new_requests();
+  void handle_message(const CURLMsg &);
+  // Release the specified `request`, which has finished using the specified
+  // `handle`, and wake any `drain` that was waiting for it.
+  void finish(CURL *handle, Request *request);
+  // Make the specified `handle`, which has finished the specified `request`,
+  // available to later requests.
+  void recycle(CURL *handle, Request &request);
   CURLcode log_on_error(CURLcode result);
   CURLMcode log_on_error(CURLMcode result);
 
@@ -222,18 +366,25 @@ class CurlImpl {
                                     void *user_data);
   static std::size_t on_read_body(char *data, std::size_t, std::size_t length,
                                   void *user_data);
+  static int on_socket(CURL *, curl_socket_t socket, int what, void *user_data,
+                       void *);
+  static int on_timer(CURLM *, long timeout_ms, void *user_data);
 
  public:
   explicit CurlImpl(const std::shared_ptr<Logger> &, const Clock &,
-                    CurlLibrary &, const Curl::ThreadGenerator &);
+                    CurlLibrary &, const Curl::ThreadGenerator &,
+                    const Curl::Options &);
   ~CurlImpl();
 
   Expected<void> post(const URL &url, HeadersSetter set_headers,
-                      std::string body, ResponseHandler on_response,
+                      SharedBody body, ResponseHandler on_response,
                       ErrorHandler on_error,
                       std::chrono::steady_clock::time_point deadline);
 
   void drain(std::chrono::steady_clock::time_point deadline);
+
+  bool http2() const;
+  bool reactor() const;
 };
 
 namespace {
@@ -249,14 +400,30 @@ void throw_on_error(CURLcode result) {
 Curl::Curl(const std::shared_ptr<Logger> &logger, const Clock &clock)
     : Curl(logger, clock, libcurl) {}
 
+Curl::Curl(const std::shared_ptr<Logger> &logger, const Clock &clock,
+           const Options &options)
+    : Curl(logger, clock, libcurl, options) {}
+
 Curl::Curl(const std::shared_ptr<Logger> &logger, const Clock &clock,
            CurlLibrary &curl)
+    : Curl(logger, clock, curl, Options{}) {}
+
+Curl::Curl(const std::shared_ptr<Logger> &logger, const Clock &clock,
+           CurlLibrary &curl, const Options &options)
     : Curl(logger, clock, curl,
-           [](auto &&func) { return std::thread(std::move(func)); }) {}
+           [thread_factory = options.thread_factory](auto &&func) {
+             return start_thread(thread_factory, "dd-http", std::move(func));
+           },
+           options) {}
 
 Curl::Curl(const std::shared_ptr<Logger> &logger, const Clock &clock,
            CurlLibrary &curl, const Curl::ThreadGenerator &make_thread)
-    : impl_(new CurlImpl{logger, clock, curl, make_thread}) {}
+    : Curl(logger, clock, curl, make_thread, Options{}) {}
+
+Curl::Curl(const std::shared_ptr<Logger> &logger, const Clock &clock,
+           CurlLibrary &curl, const Curl::ThreadGenerator &make_thread,
+           const Options &options)
+    : impl_(new CurlImpl{logger, clock, curl, make_thread, options}) {}
 
 Curl::~Curl() { delete impl_; }
 
@@ -264,7 +431,17 @@ Expected<void> Curl::post(const URL &url, HeadersSetter set_headers,
                           std::string body, ResponseHandler on_response,
                           ErrorHandler on_error,
                           std::chrono::steady_clock::time_point deadline) {
-  return impl_->post(url, set_headers, body, on_response, on_error, deadline);
+  return impl_->post(url, std::move(set_headers),
+                     std::make_shared<const std::string>(std::move(body)),
+                     std::move(on_response), std::move(on_error), deadline);
+}
+
+Expected<void> Curl::post(const URL &url, HeadersSetter set_headers,
+                          SharedBody body, ResponseHandler on_response,
+                          ErrorHandler on_error,
+                          std::chrono::steady_clock::time_point deadline) {
+  return impl_->post(url, std::move(set_headers), std::move(body),
+                     std::move(on_response), std::move(on_error), deadline);
 }
 
 void Curl::drain(std::chrono::steady_clock::time_point deadline) {
@@ -272,16 +449,24 @@ void Curl::drain(std::chrono::steady_clock::time_point deadline) {
 }
 
 std::string Curl::config() const {
-  return nlohmann::json::object({{"type", "datadog::tracing::Curl"}}).dump();
+  return nlohmann::json::object(
+             {{"type", "datadog::tracing::Curl"},
+              {"config",
+               {{"http2", impl_->http2()}, {"reactor", impl_->reactor()}}}})
+      .dump();
 }
 
 CurlImpl::CurlImpl(const std::shared_ptr<Logger> &logger, const Clock &clock,
-                   CurlLibrary &curl, const Curl::ThreadGenerator &make_thread)
+                   CurlLibrary &curl, const Curl::ThreadGenerator &make_thread,
+                   const Curl::Options &options)
     : curl_(curl),
       logger_(logger),
       clock_(clock),
-      shutting_down_(false),
-      num_active_handles_(0) {
+      http2_(options.http2),
+      reactor_(options.reactor),
+      new_requests_(nullptr),
+      num_pending_requests_(0),
+      shutting_down_(false) {
   curl_.global_init(CURL_GLOBAL_ALL);
   multi_handle_ = curl_.multi_init();
   if (multi_handle_ == nullptr) {
@@ -291,6 +476,31 @@ CurlImpl::CurlImpl(const std::shared_ptr<Logger> &logger, const Clock &clock,
     return;
   }
 
+  if (http2_) {
+    const curl_version_info_data *const version =
+        curl_.version_info(CURLVERSION_NOW);
+    if (version == nullptr || !(version->features & CURL_VERSION_HTTP2)) {
+      logger_->log_error(
+          Error{Error::CURL_HTTP_CLIENT_SETUP_FAILED,
+                "HTTP/2 was requested, but libcurl was built without HTTP/2 "
+                "support.  HTTP/1.1 will be used instead."});
+      http2_ = false;
+    } else {
+      log_on_error(
+          curl_.multi_setopt_pipelining(multi_handle_, CURLPIPE_MULTIPLEX));
+    }
+  }
+
+  if (reactor_) {
+    link_ = std::make_shared<ReactorLink>();
+    link_->impl = this;
+    log_on_error(curl_.multi_setopt_socketfunction(multi_handle_, &on_socket));
+    log_on_error(curl_.multi_setopt_socketdata(multi_handle_, this));
+    log_on_error(curl_.multi_setopt_timerfunction(multi_handle_, &on_timer));
+    log_on_error(curl_.multi_setopt_timerdata(multi_handle_, this));
+    return;
+  }
+
   try {
     event_loop_ = make_thread([this]() { run(); });
   } catch (const std::system_error &error) {
@@ -313,19 +523,28 @@ CurlImpl::~CurlImpl() {
     return;
   }
 
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    shutting_down_ = true;
+  shutting_down_ = true;
+  if (reactor_) {
+    std::lock_guard<std::mutex> lock(link_->mutex);
+    clean_up();
+    // Cleaning up the multi-handle closes its connections, which unwatches
+    // their sockets.
+    log_on_error(curl_.multi_cleanup(multi_handle_));
+    if (reactor_timer_) {
+      reactor_->cancel_timer(*reactor_timer_);
+    }
+    link_->impl = nullptr;
+  } else {
+    log_on_error(curl_.multi_wakeup(multi_handle_));
+    event_loop_.join();
+    log_on_error(curl_.multi_cleanup(multi_handle_));
   }
-  log_on_error(curl_.multi_wakeup(multi_handle_));
-  event_loop_.join();
 
-  log_on_error(curl_.multi_cleanup(multi_handle_));
   curl_.global_cleanup();
 }
 
 Expected<void> CurlImpl::post(
-    const HTTPClient::URL &url, HeadersSetter set_headers, std::string body,
+    const HTTPClient::URL &url, HeadersSetter set_headers, SharedBody body,
     ResponseHandler on_response, ErrorHandler on_error,
     std::chrono::steady_clock::time_point deadline) try {
   if (multi_handle_ == nullptr) {
@@ -334,7 +553,25 @@ Expected<void> CurlImpl::post(
                  "failed to start."};
   }
 
-  HeaderWriter writer{curl_};
+  IdleHandle idle{nullptr, nullptr};
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    if (!idle_handles_.empty()) {
+      idle = idle_handles_.back();
+      idle_handles_.pop_back();
+    }
+  }
+
+  auto cleanup_handle = [&](auto handle) { curl_.easy_cleanup(handle); };
+  std::unique_ptr<CURL, decltype(cleanup_handle)> handle{
+      idle.handle ? idle.handle : curl_.easy_init(), std::move(cleanup_handle)};
+
+  if (!handle) {
+    return Error{Error::CURL_REQUEST_SETUP_FAILED,
+                 "unable to initialize a curl handle for request sending"};
+  }
+
+  HeaderWriter writer{curl_, idle.request_headers};
   set_headers(writer);
   auto cleanup_list = [&](auto list) { curl_.slist_free_all(list); };
   std::unique_ptr<curl_slist, decltype(cleanup_list)> headers{
@@ -343,21 +580,13 @@ Expected<void> CurlImpl::post(
   auto request = std::make_unique<Request>();
 
   request->curl = &curl_;
+  request->handle = handle.get();
   request->request_headers = headers.get();
   request->request_body = std::move(body);
   request->on_response = std::move(on_response);
   request->on_error = std::move(on_error);
   request->deadline = std::move(deadline);
 
-  auto cleanup_handle = [&](auto handle) { curl_.easy_cleanup(handle); };
-  std::unique_ptr<CURL, decltype(cleanup_handle)> handle{
-      curl_.easy_init(), std::move(cleanup_handle)};
-
-  if (!handle) {
-    return Error{Error::CURL_REQUEST_SETUP_FAILED,
-                 "unable to initialize a curl handle for request sending"};
-  }
-
   throw_on_error(
       curl_.easy_setopt_httpheader(handle.get(), request->request_headers));
   throw_on_error(curl_.easy_setopt_private(handle.get(), request.get()));
@@ -365,9 +594,11 @@ Expected<void> CurlImpl::post(
       curl_.easy_setopt_errorbuffer(handle.get(), request->error_buffer));
   throw_on_error(curl_.easy_setopt_post(handle.get(), 1));
   throw_on_error(curl_.easy_setopt_postfieldsize(
-      handle.get(), static_cast<long>(request->request_body.size())));
-  throw_on_error(
-      curl_.easy_setopt_postfields(handle.get(), request->request_body.data()));
+      handle.get(), static_cast<long>(request->request_body.data.size())));
+  // A null `CURLOPT_POSTFIELDS` would mean "use the read callback instead."
+  const StringView body_data = request->request_body.data;
+  throw_on_error(curl_.easy_setopt_postfields(
+      handle.get(), body_data.empty() ? "" : body_data.data()));
   throw_on_error(
       curl_.easy_setopt_headerfunction(handle.get(), &on_read_header));
   throw_on_error(curl_.easy_setopt_headerdata(handle.get(), request.get()));
@@ -385,19 +616,44 @@ Expected<void> CurlImpl::post(
     throw_on_error(curl_.easy_setopt_url(
         handle.get(), (url.scheme + "://" + url.authority + url.path).c_str()));
   }
-
-  std::list<CURL *> node;
-  node.push_back(handle.get());
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    new_handles_.splice(new_handles_.end(), node);
-
-    (void)headers.release();
-    (void)handle.release();
-    (void)request.release();
+  if (http2_) {
+    // Over TLS, HTTP/2 is negotiated using ALPN.  Otherwise, there is no
+    // negotiation: the connection starts out speaking HTTP/2.
+    const bool tls = url.scheme == "https" || url.scheme == "https+unix";
+    throw_on_error(curl_.easy_setopt_http_version(
+        handle.get(), tls ? CURL_HTTP_VERSION_2TLS
+                          : CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE));
+    // Wait for an existing connection to the endpoint to become available for
+    // multiplexing, rather than opening another connection.
+    throw_on_error(curl_.easy_setopt_pipewait(handle.get(), 1));
   }
 
-  log_on_error(curl_.multi_wakeup(multi_handle_));
+  (void)headers.release();
+  (void)handle.release();
+  Request *const pushed = request.release();
+  ++num_pending_requests_;
+  Request *head = new_requests_.load();
+  do {
+    pushed->next = head;
+  } while (!new_requests_.compare_exchange_weak(head, pushed));
+
+  // If `new_requests_` was not empty, then the event loop has already been
+  // woken up for the requests ahead of this one, and has yet to take them.
+  if (head == nullptr) {
+    if (reactor_) {
+      reactor_->post([link = link_]() {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        if (CurlImpl *const impl = link->impl) {
+          impl->add_new_requests();
+          // Let libcurl start on the new requests without waiting for its
+          // timer.
+          impl->socket_action(CURL_SOCKET_TIMEOUT, 0);
+        }
+      });
+    } else {
+      log_on_error(curl_.multi_wakeup(multi_handle_));
+    }
+  }
 
   return nullopt;
 } catch (CURLcode error) {
@@ -405,12 +661,15 @@ Expected<void> CurlImpl::post(
 }
 
 void CurlImpl::drain(std::chrono::steady_clock::time_point deadline) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  no_requests_.wait_until(lock, deadline, [this]() {
-    return num_active_handles_ == 0 && new_handles_.empty();
-  });
+  std::unique_lock<Mutex> lock(mutex_);
+  no_requests_.wait_until(lock, deadline,
+                          [this]() { return num_pending_requests_ == 0; });
 }
 
+bool CurlImpl::http2() const { return http2_; }
+
+bool CurlImpl::reactor() const { return reactor_ != nullptr; }
+
 std::size_t CurlImpl::on_read_header(char *data, std::size_t,
                                      std::size_t length, void *user_data) {
   const auto request = static_cast<Request *>(user_data);
@@ -437,7 +696,29 @@ std::size_t CurlImpl::on_read_header(char *data, std::size_t,
   const auto key = trim(sv.substr(0, colon_idx));
   const auto value = trim(sv.substr(colon_idx + 1));
 
-  request->response_headers_lower.emplace(to_lower(key), value);
+  // As with a map, the first of several headers having the same key wins.
+  HeaderReader reader(request);
+  if (reader.lookup(key)) {
+    return length;
+  }
+
+  auto &fields = request->response_header_data;
+  const std::size_t offset = fields.size();
+  std::transform(key.begin(), key.end(), std::back_inserter(fields),
+                 [](unsigned char ch) { return char(std::tolower(ch)); });
+  append(fields, value);
+  request->response_headers.push_back(
+      HeaderField{offset, key.size(), value.size()});
+
+  // Make room for the body up front, within reason.
+  constexpr std::size_t max_reserved_body_size = 16 * 1024 * 1024;
+  if (StringView(fields).substr(offset, key.size()) == "content-length") {
+    if (auto body_size = parse_uint64(value, 10)) {
+      request->response_body.reserve(
+          std::size_t(std::min<std::uint64_t>(*body_size,
+                                              max_reserved_body_size)));
+    }
+  }
   return length;
 }
 
@@ -464,75 +745,88 @@ CURLMcode CurlImpl::log_on_error(CURLMcode result) {
   return result;
 }
 
+CurlImpl::Request *CurlImpl::take_new_requests() {
+  Request *newest_first = new_requests_.exchange(nullptr);
+  Request *oldest_first = nullptr;
+  while (newest_first) {
+    Request *const next = newest_first->next;
+    newest_first->next = oldest_first;
+    oldest_first = newest_first;
+    newest_first = next;
+  }
+  return oldest_first;
+}
+
 void CurlImpl::run() {
-  int num_messages_remaining;
-  CURLMsg *message;
-  constexpr int max_wait_milliseconds = 10000;
-  std::unique_lock<std::mutex> lock(mutex_);
+  int num_active_handles;
+  // `multi_poll` returns as soon as there is socket activity, one of libcurl's
+  // own timers expires, or `post` or the destructor calls `multi_wakeup`.
+  // Nothing else needs the loop, so when there is nothing to do, it sleeps
+  // until one of those happens rather than waking up periodically.
+  constexpr int max_wait_milliseconds = std::numeric_limits<int>::max();
 
   for (;;) {
-    log_on_error(curl_.multi_perform(multi_handle_, &num_active_handles_));
-    if (num_active_handles_ == 0) {
-      no_requests_.notify_all();
-    }
-
-    // If a request is done or errored out, curl will enqueue a "message" for
-    // us to handle.  Handle any pending messages.
-    while ((message = curl_.multi_info_read(multi_handle_,
-                                            &num_messages_remaining))) {
-      handle_message(*message, lock);
-    }
-    lock.unlock();
+    log_on_error(curl_.multi_perform(multi_handle_, &num_active_handles));
+    handle_messages();
     log_on_error(curl_.multi_poll(multi_handle_, nullptr, 0,
                                   max_wait_milliseconds, nullptr));
-    lock.lock();
 
     // New requests might have been added while we were sleeping.
-    for (; !new_handles_.empty(); new_handles_.pop_front()) {
-      CURL *handle = new_handles_.front();
-      char *user_data;
-      if (log_on_error(curl_.easy_getinfo_private(handle, &user_data)) !=
-          CURLE_OK) {
-        curl_.easy_cleanup(handle);
-        continue;
-      }
-
-      auto *request = reinterpret_cast<Request *>(user_data);
-      const auto timeout = request->deadline - clock_().tick;
-      if (timeout <= std::chrono::steady_clock::time_point::duration::zero()) {
-        std::string error_message;
-        error_message +=
-            "Request deadline exceeded before request was even added to "
-            "libcurl "
-            "event loop. Deadline was ";
-        error_message += std::to_string(
-            -std::chrono::duration_cast<std::chrono::nanoseconds>(timeout)
-                 .count());
-        error_message += " nanoseconds ago.";
-        request->on_error(
-            Error{Error::CURL_DEADLINE_EXCEEDED_BEFORE_REQUEST_START,
-                  std::move(error_message)});
-
-        curl_.easy_cleanup(handle);
-        delete request;
-
-        continue;
-      }
-
-      log_on_error(curl_.easy_setopt_timeout_ms(
-          handle,
-          static_cast<long>(
-              std::chrono::duration_cast<std::chrono::milliseconds>(timeout)
-                  .count())));
-      log_on_error(curl_.multi_add_handle(multi_handle_, handle));
-      request_handles_.insert(handle);
-    }
+    add_new_requests();
 
     if (shutting_down_) {
       break;
     }
   }
 
+  clean_up();
+}
+
+void CurlImpl::add_new_requests() {
+  Request *next;
+  for (Request *request = take_new_requests(); request; request = next) {
+    next = request->next;
+    CURL *const handle = request->handle;
+    const auto timeout = request->deadline - clock_().tick;
+    if (timeout <= std::chrono::steady_clock::time_point::duration::zero()) {
+      std::string error_message;
+      error_message +=
+          "Request deadline exceeded before request was even added to "
+          "libcurl "
+          "event loop. Deadline was ";
+      error_message += std::to_string(
+          -std::chrono::duration_cast<std::chrono::nanoseconds>(timeout)
+               .count());
+      error_message += " nanoseconds ago.";
+      request->on_error(
+          Error{Error::CURL_DEADLINE_EXCEEDED_BEFORE_REQUEST_START,
+                std::move(error_message)});
+
+      finish(handle, request);
+      continue;
+    }
+
+    log_on_error(curl_.easy_setopt_timeout_ms(
+        handle,
+        static_cast<long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(timeout)
+                .count())));
+    log_on_error(curl_.multi_add_handle(multi_handle_, handle));
+    request_handles_.insert(handle);
+  }
+}
+
+void CurlImpl::handle_messages() {
+  // If a request is done or errored out, curl will enqueue a "message" for
+  // us to handle.  Handle any pending messages.
+  int num_messages_remaining;
+  while (CURLMsg *const message = curl_.multi_info_read(
+             multi_handle_, &num_messages_remaining)) {
+    handle_message(*message);
+  }
+}
+
+void CurlImpl::clean_up() {
   // We're shutting down.  Clean up any remaining request handles.
   for (const auto &handle : request_handles_) {
     char *user_data;
@@ -546,10 +840,90 @@ void CurlImpl::run() {
   }
 
   request_handles_.clear();
+
+  Request *next;
+  for (Request *request = take_new_requests(); request; request = next) {
+    next = request->next;
+    curl_.easy_cleanup(request->handle);
+    delete request;
+  }
+
+  for (const auto &idle : idle_handles_) {
+    curl_.slist_free_all(idle.request_headers);
+    curl_.easy_cleanup(idle.handle);
+  }
+
+  idle_handles_.clear();
 }
 
-void CurlImpl::handle_message(const CURLMsg &message,
-                              std::unique_lock<std::mutex> &lock) {
+void CurlImpl::socket_action(curl_socket_t socket, int events) {
+  int num_active_handles;
+  log_on_error(curl_.multi_socket_action(multi_handle_, socket, events,
+                                         &num_active_handles));
+  handle_messages();
+}
+
+int CurlImpl::on_socket(CURL *, curl_socket_t socket, int what,
+                        void *user_data, void *) {
+  auto *const impl = static_cast<CurlImpl *>(user_data);
+  const int fd = static_cast<int>(socket);
+  if (what == CURL_POLL_REMOVE) {
+    impl->reactor_->unwatch(fd);
+    return 0;
+  }
+
+  int events = 0;
+  if (what & CURL_POLL_IN) {
+    events |= Reactor::readable;
+  }
+  if (what & CURL_POLL_OUT) {
+    events |= Reactor::writable;
+  }
+  impl->reactor_->watch(fd, events, [link = impl->link_, socket](int ready) {
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (CurlImpl *const impl = link->impl) {
+      int events = 0;
+      if (ready & Reactor::readable) {
+        events |= CURL_CSELECT_IN;
+      }
+      if (ready & Reactor::writable) {
+        events |= CURL_CSELECT_OUT;
+      }
+      impl->socket_action(socket, events);
+    }
+  });
+  return 0;
+}
+
+int CurlImpl::on_timer(CURLM *, long timeout_ms, void *user_data) {
+  auto *const impl = static_cast<CurlImpl *>(user_data);
+  if (impl->reactor_timer_) {
+    impl->reactor_->cancel_timer(*impl->reactor_timer_);
+    impl->reactor_timer_.reset();
+  }
+  ++impl->timer_generation_;
+  if (timeout_ms < 0) {
+    // libcurl no longer has a timer.
+    return 0;
+  }
+
+  // libcurl must not be called back from within this function, so even a
+  // timeout of zero goes through the reactor.
+  impl->reactor_timer_ = impl->reactor_->set_timer(
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms),
+      [link = impl->link_, generation = impl->timer_generation_]() {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        CurlImpl *const impl = link->impl;
+        if (impl == nullptr || impl->timer_generation_ != generation) {
+          return;
+        }
+        impl->reactor_timer_.reset();
+        impl->socket_action(CURL_SOCKET_TIMEOUT, 0);
+      });
+  return 0;
+}
+
+void CurlImpl::handle_message(const CURLMsg &message) {
   if (message.msg != CURLMSG_DONE) {
     return;
   }
@@ -571,38 +945,65 @@ void CurlImpl::handle_message(const CURLMsg &message,
     error_message += curl_.easy_strerror(result);
     error_message += "): ";
     error_message += request.error_buffer;
-    lock.unlock();
     request.on_error(
         Error{Error::CURL_REQUEST_FAILURE, std::move(error_message)});
-    lock.lock();
   } else {
     long status;
     if (log_on_error(curl_.easy_getinfo_response_code(request_handle,
                                                       &status)) != CURLE_OK) {
       status = -1;
     }
-    HeaderReader reader(&request.response_headers_lower);
-    lock.unlock();
+    HeaderReader reader(&request);
     request.on_response(static_cast<int>(status), reader,
                         std::move(request.response_body));
-    lock.lock();
   }
 
   log_on_error(curl_.multi_remove_handle(multi_handle_, request_handle));
-  curl_.easy_cleanup(request_handle);
   request_handles_.erase(request_handle);
-  delete &request;
+  finish(request_handle, &request);
+}
+
+void CurlImpl::finish(CURL *handle, Request *request) {
+  recycle(handle, *request);
+  delete request;
+
+  std::lock_guard<Mutex> lock(mutex_);
+  if (--num_pending_requests_ == 0) {
+    no_requests_.notify_all();
+  }
+}
+
+void CurlImpl::recycle(CURL *handle, Request &request) {
+  // `easy_reset` restores the handle's options to their defaults, but keeps
+  // its connections, DNS cache, and TLS session cache.
+  curl_.easy_reset(handle);
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    if (idle_handles_.size() < max_idle_handles) {
+      idle_handles_.push_back(IdleHandle{handle, request.request_headers});
+      request.request_headers = nullptr;
+      return;
+    }
+  }
+  curl_.easy_cleanup(handle);
 }
 
 CurlImpl::Request::~Request() { curl->slist_free_all(request_headers); }
 
-CurlImpl::HeaderWriter::HeaderWriter(CurlLibrary &curl) : curl_(curl) {}
+CurlImpl::HeaderWriter::HeaderWriter(CurlLibrary &curl, curl_slist *recycled)
+    : unused_(recycled), curl_(curl) {}
 
-CurlImpl::HeaderWriter::~HeaderWriter() { curl_.slist_free_all(list_); }
+CurlImpl::HeaderWriter::~HeaderWriter() {
+  curl_.slist_free_all(list_);
+  curl_.slist_free_all(unused_);
+}
 
 curl_slist *CurlImpl::HeaderWriter::release() {
+  curl_.slist_free_all(unused_);
+  unused_ = nullptr;
   auto list = list_;
   list_ = nullptr;
+  last_ = nullptr;
   return list;
 }
 
@@ -612,28 +1013,51 @@ void CurlImpl::HeaderWriter::set(StringView key, StringView value) {
   buffer_ += ": ";
   buffer_ += value;
 
-  list_ = curl_.slist_append(list_, buffer_.c_str());
+  curl_slist *node = unused_;
+  if (node && node->data == buffer_) {
+    unused_ = node->next;
+    node->next = nullptr;
+  } else {
+    // The recycled list no longer matches, so none of the rest of it will be
+    // reused.
+    curl_.slist_free_all(unused_);
+    unused_ = nullptr;
+    node = curl_.slist_append(nullptr, buffer_.c_str());
+    if (node == nullptr) {
+      return;
+    }
+  }
+
+  if (last_) {
+    last_->next = node;
+  } else {
+    list_ = node;
+  }
+  last_ = node;
 }
 
-CurlImpl::HeaderReader::HeaderReader(
-    std::unordered_map<std::string, std::string> *response_headers_lower)
-    : response_headers_lower_(response_headers_lower) {}
+CurlImpl::HeaderReader::HeaderReader(const Request *request)
+    : request_(request) {}
 
 Optional<StringView> CurlImpl::HeaderReader::lookup(StringView key) const {
-  buffer_ = to_lower(key);
-
-  const auto found = response_headers_lower_->find(buffer_);
-  if (found == response_headers_lower_->end()) {
-    return nullopt;
+  const StringView data = request_->response_header_data;
+  for (const HeaderField &field : request_->response_headers) {
+    const StringView field_key = data.substr(field.offset, field.key_size);
+    if (std::equal(field_key.begin(), field_key.end(), key.begin(), key.end(),
+                   [](char lower, unsigned char ch) {
+                     return lower == char(std::tolower(ch));
+                   })) {
+      return data.substr(field.offset + field.key_size, field.value_size);
+    }
   }
-  return found->second;
+  return nullopt;
 }
 
-void CurlImpl::HeaderReader::visit(
-    const std::function<void(StringView key, StringView value)> &visitor)
-    const {
-  for (const auto &[key, value] : *response_headers_lower_) {
-    visitor(key, value);
+void CurlImpl::HeaderReader::visit(Visitor visitor) const {
+  const StringView data = request_->response_header_data;
+  for (const HeaderField &field : request_->response_headers) {
+    visitor(data.substr(field.offset, field.key_size),
+            data.substr(field.offset + field.key_size, field.value_size));
   }
 }
 
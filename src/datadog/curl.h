@@ -4,6 +4,27 @@
 // interface in terms of [libcurl][1].  `class Curl` manages a thread that is
 // used as the event loop for libcurl.
 //
+// Finished request handles are reset and kept for reuse by later requests,
+// along with their lists of request headers, so that a steady stream of
+// requests does not allocate a new handle and header list each time, and so
+// that TLS sessions are resumed rather than renegotiated.
+//
+// If `Curl::Options::http2` is true, then requests are sent using HTTP/2 and
+// are multiplexed: concurrent requests to the same endpoint share one
+// connection as separate streams, so that, for example, a remote
+// configuration poll need not wait behind a large trace payload, nor open a
+// connection of its own.  Cleartext endpoints ("http", "unix", and
+// "http+unix") are sent HTTP/2 without an upgrade, and so must support it.
+// If libcurl was built without HTTP/2 support, then an error is logged and
+// HTTP/1.1 is used instead.
+//
+// If `Curl::Options::reactor` is not null, then `Curl` does not run a thread.
+// Instead, it uses libcurl's multi-socket interface, and the application's
+// event loop, by way of the `Reactor`, tells libcurl when its sockets are
+// ready and when its timers expire.  See `reactor.h`.  In that mode, `drain`
+// must not be called on the reactor's thread, since requests make progress
+// only on that thread; it would wait until its deadline.
+//
 // If this library was built in a mode that does not include libcurl, then this
 // file and its implementation, `curl.cpp`, will not be included.
 //
@@ -12,6 +33,8 @@
 #include <curl/curl.h>
 #include <datadog/clock.h>
 #include <datadog/http_client.h>
+#include <datadog/reactor.h>
+#include <datadog/thread_factory.h>
 
 #include <chrono>
 #include <functional>
@@ -41,17 +64,23 @@ class CurlLibrary {
                                   void *userdata);
   typedef size_t (*HeaderCallback)(char *buffer, size_t size, size_t nitems,
                                    void *userdata);
+  typedef int (*SocketCallback)(CURL *easy, curl_socket_t socket, int what,
+                                void *userp, void *socketp);
+  typedef int (*TimerCallback)(CURLM *multi, long timeout_ms, void *userp);
 
   virtual ~CurlLibrary() = default;
 
   virtual void easy_cleanup(CURL *handle);
   virtual CURL *easy_init();
+  virtual void easy_reset(CURL *handle);
   virtual CURLcode easy_getinfo_private(CURL *curl, char **user_data);
   virtual CURLcode easy_getinfo_response_code(CURL *curl, long *code);
   virtual CURLcode easy_setopt_errorbuffer(CURL *handle, char *buffer);
   virtual CURLcode easy_setopt_headerdata(CURL *handle, void *data);
   virtual CURLcode easy_setopt_headerfunction(CURL *handle, HeaderCallback);
   virtual CURLcode easy_setopt_httpheader(CURL *handle, curl_slist *headers);
+  virtual CURLcode easy_setopt_http_version(CURL *handle, long version);
+  virtual CURLcode easy_setopt_pipewait(CURL *handle, long wait);
   virtual CURLcode easy_setopt_post(CURL *handle, long post);
   virtual CURLcode easy_setopt_postfields(CURL *handle, const char *data);
   virtual CURLcode easy_setopt_postfieldsize(CURL *handle, long size);
@@ -73,10 +102,21 @@ class CurlLibrary {
                                unsigned extra_nfds, int timeout_ms,
                                int *numfds);
   virtual CURLMcode multi_remove_handle(CURLM *multi_handle, CURL *easy_handle);
+  virtual CURLMcode multi_setopt_pipelining(CURLM *multi_handle, long bitmask);
+  virtual CURLMcode multi_setopt_socketdata(CURLM *multi_handle, void *data);
+  virtual CURLMcode multi_setopt_socketfunction(CURLM *multi_handle,
+                                                SocketCallback);
+  virtual CURLMcode multi_setopt_timerdata(CURLM *multi_handle, void *data);
+  virtual CURLMcode multi_setopt_timerfunction(CURLM *multi_handle,
+                                               TimerCallback);
+  virtual CURLMcode multi_socket_action(CURLM *multi_handle,
+                                        curl_socket_t socket, int ev_bitmask,
+                                        int *running_handles);
   virtual const char *multi_strerror(CURLMcode error);
   virtual CURLMcode multi_wakeup(CURLM *multi_handle);
   virtual curl_slist *slist_append(curl_slist *list, const char *string);
   virtual void slist_free_all(curl_slist *list);
+  virtual curl_version_info_data *version_info(CURLversion age);
 };
 
 class CurlImpl;
@@ -88,10 +128,27 @@ class Curl : public HTTPClient {
  public:
   using ThreadGenerator = std::function<std::thread(std::function<void()> &&)>;
 
+  struct Options {
+    // Whether to send requests using HTTP/2, multiplexed over shared
+    // connections.
+    bool http2 = false;
+    // The application's event loop, which drives libcurl instead of a thread
+    // of `Curl`'s own, or null to run a thread.
+    std::shared_ptr<Reactor> reactor;
+    // Starts the event loop's thread, if not null.  Ignored by the
+    // constructors that take a `ThreadGenerator`.
+    ThreadFactory thread_factory;
+  };
+
   explicit Curl(const std::shared_ptr<Logger> &, const Clock &);
+  Curl(const std::shared_ptr<Logger> &, const Clock &, const Options &);
   Curl(const std::shared_ptr<Logger> &, const Clock &, CurlLibrary &);
+  Curl(const std::shared_ptr<Logger> &, const Clock &, CurlLibrary &,
+       const Options &);
   Curl(const std::shared_ptr<Logger> &, const Clock &, CurlLibrary &,
        const ThreadGenerator &);
+  Curl(const std::shared_ptr<Logger> &, const Clock &, CurlLibrary &,
+       const ThreadGenerator &, const Options &);
   ~Curl();
 
   Curl(const Curl &) = delete;
@@ -101,6 +158,11 @@ class Curl : public HTTPClient {
                       ErrorHandler on_error,
                       std::chrono::steady_clock::time_point deadline) override;
 
+  Expected<void> post(const URL &url, HeadersSetter set_headers,
+                      SharedBody body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
   void drain(std::chrono::steady_clock::time_point deadline) override;
 
   std::string config() const override;
@@ -7,17 +7,33 @@
 #include <datadog/string_view.h>
 #include <datadog/tracer.h>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #include <cassert>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <future>
+#include <limits>
 #include <string>
 #include <typeinfo>
 #include <unordered_map>
+#include <utility>
 #include <unordered_set>
 
 #include "collector_response.h"
+#include "config_manager.h"
+#include "gzip.h"
 #include "json.hpp"
+#include "memory_budget.h"
 #include "msgpack.h"
+#include "platform_util.h"
+#include "probes.h"
+#include "random.h"
 #include "span_data.h"
+#include "tags.h"
 #include "trace_sampler.h"
 
 namespace datadog {
@@ -25,16 +41,84 @@ namespace tracing {
 namespace {
 
 constexpr StringView traces_api_path = "/v0.4/traces";
+constexpr StringView traces_v05_api_path = "/v0.5/traces";
+constexpr StringView traces_v07_api_path = "/v0.7/traces";
+constexpr StringView stats_api_path = "/v0.6/stats";
 constexpr StringView telemetry_v2_path = "/telemetry/proxy/api/v2/apmtelemetry";
 constexpr StringView remote_configuration_path = "/v0.7/config";
 
+// A failed trace request is retried after `initial_retry_backoff`, doubling
+// with each subsequent failure up to `max_retry_backoff`.  The actual delay is
+// chosen at random from the upper half of that range, so that tracers that
+// failed at the same time do not retry in lockstep.
+constexpr std::chrono::steady_clock::duration initial_retry_backoff =
+    std::chrono::milliseconds(500);
+constexpr std::chrono::steady_clock::duration max_retry_backoff =
+    std::chrono::seconds(30);
+
+// While the Datadog Agent is unreachable, probes are sent at most this far
+// apart.
+constexpr std::chrono::steady_clock::duration max_probe_interval =
+    std::chrono::minutes(1);
+
+// Return the beginning of a payload in the v0.7 trace format for the tracer
+// having the specified `signature`: a map of the tracer's attributes whose
+// last entry is the array of trace chunks, which follow it.  The header of the
+// array is left to be written once the number of chunks is known.
+std::string v07_payload_header(const TracerSignature& signature) {
+  std::vector<std::pair<StringView, StringView>> attributes{
+      {"language_name", signature.library_language},
+      {"language_version", signature.library_language_version},
+      {"tracer_version", signature.library_version},
+      {"runtime_id", signature.runtime_id.string()}};
+  if (!signature.default_environment.empty()) {
+    attributes.emplace_back("env", signature.default_environment);
+  }
+  if (!signature.default_version.empty()) {
+    attributes.emplace_back("app_version", signature.default_version);
+  }
+
+  std::string header;
+  msgpack::pack_map(header, attributes.size() + 1);
+  for (const auto& [key, value] : attributes) {
+    msgpack::pack_string(header, key);
+    msgpack::pack_string(header, value);
+  }
+  msgpack::pack_string(header, "chunks");
+  header.append(msgpack::fixed_array_header_size, '\0');
+  return header;
+}
+
+// Buffers smaller than this are not worth shrinking.
+constexpr std::size_t min_trimmed_bytes = 4096;
+
+// Shrink the specified `buffer`, a `std::string` or `std::vector`, to the
+// specified `needed` number of elements if its capacity is more than twice
+// that.  Return the number of bytes of capacity released.
+template <typename Buffer>
+std::size_t shrink(Buffer& buffer, std::size_t needed) {
+  constexpr std::size_t element_size = sizeof(typename Buffer::value_type);
+  needed = std::max(needed, buffer.size());
+  if (buffer.capacity() <=
+      2 * std::max(needed, min_trimmed_bytes / element_size)) {
+    return 0;
+  }
+  const std::size_t capacity = buffer.capacity();
+  Buffer trimmed;
+  trimmed.reserve(needed);
+  trimmed.insert(trimmed.end(), buffer.begin(), buffer.end());
+  buffer.swap(trimmed);
+  return (capacity - buffer.capacity()) * element_size;
+}
+
 void set_content_type_json(DictWriter& headers) {
   headers.set("Content-Type", "application/json");
 }
 
-HTTPClient::URL traces_endpoint(const HTTPClient::URL& agent_url) {
+HTTPClient::URL traces_endpoint(const HTTPClient::URL& agent_url,
+                                StringView api_path) {
   auto traces_url = agent_url;
-  append(traces_url.path, traces_api_path);
+  append(traces_url.path, api_path);
   return traces_url;
 }
 
@@ -51,21 +135,106 @@ HTTPClient::URL remote_configuration_endpoint(
   return remote_configuration;
 }
 
-Expected<void> msgpack_encode(
-    std::string& destination,
-    const std::vector<DatadogAgent::TraceChunk>& trace_chunks) {
-  return msgpack::pack_array(destination, trace_chunks,
-                             [](auto& destination, const auto& chunk) {
-                               return msgpack_encode(destination, chunk.spans);
-                             });
+// Return whether the trace of the chunk consisting of the specified `spans`
+// was dropped by sampling.  A chunk without a sampling decision is assumed to
+// be kept.
+bool is_dropped_trace(const std::vector<std::unique_ptr<SpanData>>& spans) {
+  if (spans.empty()) {
+    return false;
+  }
+  const auto& priority = spans.front()->sampling_priority;
+  return priority && *priority <= 0;
+}
+
+bool is_span_sampled(const SpanData& span) {
+  return span.numeric_tags.count(tags::internal::span_sampling_mechanism);
 }
 
-std::variant<CollectorResponse, std::string> parse_agent_traces_response(
-    StringView body) try {
-  nlohmann::json response = nlohmann::json::parse(body);
+// Return whether the trace chunk consisting of the specified `spans` is worth
+// keeping over chunks that were dropped by sampling.
+bool is_sampled(const std::vector<std::unique_ptr<SpanData>>& spans) {
+  // Spans kept by span sampling are sent even though their trace was dropped.
+  return !is_dropped_trace(spans) ||
+         std::any_of(spans.begin(), spans.end(),
+                     [](const auto& span) { return is_span_sampled(*span); });
+}
+
+// Return the rank of the trace chunk consisting of the specified `spans`,
+// given whether it is `sampled`.
+ChunkRank chunk_rank(const std::vector<std::unique_ptr<SpanData>>& spans,
+                     bool sampled) {
+  if (!sampled) {
+    return ChunkRank::UNSAMPLED;
+  }
+  if (spans.empty()) {
+    return ChunkRank::SAMPLED;
+  }
+  const auto& priority = spans.front()->sampling_priority;
+  if ((priority && *priority >= 2) ||
+      std::any_of(spans.begin(), spans.end(),
+                  [](const auto& span) { return span->error; })) {
+    return ChunkRank::IMPORTANT;
+  }
+  return ChunkRank::SAMPLED;
+}
+
+// Remove from the specified `spans`, a chunk whose trace was dropped by
+// sampling, every span that was not kept by span sampling.  The sampling
+// priority of the chunk is carried over to the first span that remains.
+void keep_span_sampled_only(std::vector<std::unique_ptr<SpanData>>& spans) {
+  const Optional<double> priority = spans.front()->sampling_priority;
+  spans.erase(std::remove_if(
+                  spans.begin(), spans.end(),
+                  [](const auto& span) { return !is_span_sampled(*span); }),
+              spans.end());
+  if (!spans.empty()) {
+    spans.front()->sampling_priority = priority;
+  }
+}
+
+// `RateParser` is an `nlohmann::json` SAX handler that parses the Datadog
+// Agent's response to traces we sent it.  The response is a JSON object whose
+// "rate_by_service" property, if present, is an object mapping keys to sample
+// rates.  The rates are stored directly into a `CollectorResponse` as they are
+// parsed, without building the document, and everything else is skipped.
+class RateParser {
+  static constexpr StringView sample_rates_property = "rate_by_service";
+
+  CollectorResponse& response_;
+  std::string& error_;
+  // The number of objects and arrays enclosing the value being parsed.  The
+  // properties of the response object are at depth one, and the rates at
+  // depth two.
+  std::size_t depth_ = 0;
+  // Whether the next value at depth one is the "rate_by_service" property.
+  bool next_is_rates_ = false;
+  // Whether the values at depth two are within the "rate_by_service" object.
+  bool in_rates_ = false;
+  std::string key_;
 
-  StringView type = response.type_name();
-  if (type != "object") {
+  bool fail(std::string message) {
+    error_ = std::move(message);
+    return false;
+  }
+
+  // Return whether parsing may continue after a value of the specified JSON
+  // `type`, where `rate` is the value if it is a number.
+  bool value(StringView type, double rate = 0) {
+    if (depth_ == 0) {
+      return type == "object" || wrong_response_type(type);
+    }
+    if (depth_ == 1) {
+      const bool is_rates = next_is_rates_;
+      next_is_rates_ = false;
+      return !is_rates || type == "object" || wrong_rates_type(type);
+    }
+    if (depth_ == 2 && in_rates_) {
+      return type == "number" ? add_rate(rate) : wrong_rate_type(type);
+    }
+    return true;
+  }
+
+  bool wrong_response_type(StringView type) {
     std::string message;
     message +=
         "Parsing the Datadog Agent's response to traces we sent it failed.  "
@@ -73,19 +242,10 @@ std::variant<CollectorResponse, std::string> parse_agent_traces_response(
         "value with type \"";
     append(message, type);
     message += '\"';
-    message += "\nError occurred for response body (begins on next line):\n";
-    append(message, body);
-    return message;
+    return fail(std::move(message));
   }
 
-  const StringView sample_rates_property = "rate_by_service";
-  const auto found = response.find(sample_rates_property);
-  if (found == response.end()) {
-    return CollectorResponse{};
-  }
-  const auto& rates_json = found.value();
-  type = rates_json.type_name();
-  if (type != "object") {
+  bool wrong_rates_type(StringView type) {
     std::string message;
     message +=
         "Parsing the Datadog Agent's response to traces we sent it failed.  "
@@ -96,82 +256,535 @@ std::variant<CollectorResponse, std::string> parse_agent_traces_response(
         "instead it's a JSON value with type \"";
     append(message, type);
     message += '\"';
-    message += "\nError occurred for response body (begins on next line):\n";
-    append(message, body);
-    return message;
+    return fail(std::move(message));
   }
 
-  std::unordered_map<std::string, Rate> sample_rates;
-  for (const auto& [key, value] : rates_json.items()) {
-    type = value.type_name();
-    if (type != "number") {
-      std::string message;
-      message +=
-          "Datadog Agent response to traces included an invalid sample rate "
-          "for the key \"";
-      message += key;
-      message += "\". Rate should be a number, but it's a \"";
-      append(message, type);
-      message += "\" instead.";
-      message += "\nError occurred for response body (begins on next line):\n";
-      append(message, body);
-      return message;
-    }
+  bool wrong_rate_type(StringView type) {
+    std::string message;
+    message +=
+        "Datadog Agent response to traces included an invalid sample rate "
+        "for the key \"";
+    message += key_;
+    message += "\". Rate should be a number, but it's a \"";
+    append(message, type);
+    message += "\" instead.";
+    return fail(std::move(message));
+  }
+
+  bool add_rate(double value) {
     auto maybe_rate = Rate::from(value);
     if (auto* error = maybe_rate.if_error()) {
       std::string message;
       message +=
           "Datadog Agent response trace traces included an invalid sample rate "
           "for the key \"";
-      message += key;
+      message += key_;
       message += "\": ";
       message += error->message;
-      message += "\nError occurred for response body (begins on next line):\n";
-      append(message, body);
-      return message;
+      return fail(std::move(message));
     }
-    sample_rates.emplace(key, *maybe_rate);
+    response_.sample_rate_by_key.insert_or_assign(std::move(key_),
+                                                  *maybe_rate);
+    key_.clear();
+    return true;
+  }
+
+  bool start(StringView type) {
+    // `value` clears `next_is_rates_`, so note it first.
+    const bool is_rates = depth_ == 1 && next_is_rates_;
+    if (!value(type)) {
+      return false;
+    }
+    in_rates_ = is_rates;
+    ++depth_;
+    return true;
+  }
+
+  bool end() {
+    --depth_;
+    if (depth_ == 1) {
+      in_rates_ = false;
+    }
+    return true;
+  }
+
+ public:
+  RateParser(CollectorResponse& response, std::string& error)
+      : response_(response), error_(error) {}
+
+  bool null() { return value("null"); }
+  bool boolean(bool) { return value("boolean"); }
+  bool number_integer(std::int64_t number) {
+    return value("number", double(number));
+  }
+  bool number_unsigned(std::uint64_t number) {
+    return value("number", double(number));
   }
-  return CollectorResponse{std::move(sample_rates)};
-} catch (const nlohmann::json::exception& error) {
-  std::string message;
-  message +=
-      "Parsing the Datadog Agent's response to traces we sent it failed with a "
-      "JSON error: ";
-  message += error.what();
-  message += "\nError occurred for response body (begins on next line):\n";
-  append(message, body);
-  return message;
+  bool number_float(double number, const std::string&) {
+    return value("number", number);
+  }
+  bool string(std::string&) { return value("string"); }
+  bool binary(nlohmann::json::binary_t&) { return value("binary"); }
+
+  bool start_object(std::size_t) { return start("object"); }
+  bool end_object() { return end(); }
+  bool start_array(std::size_t) { return start("array"); }
+  bool end_array() { return end(); }
+
+  bool key(std::string& key) {
+    if (depth_ == 1) {
+      next_is_rates_ = key == sample_rates_property;
+    } else if (depth_ == 2 && in_rates_) {
+      key_ = std::move(key);
+    }
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string&,
+                   const nlohmann::detail::exception& error) {
+    std::string message;
+    message +=
+        "Parsing the Datadog Agent's response to traces we sent it failed "
+        "with a JSON error: ";
+    message += error.what();
+    return fail(std::move(message));
+  }
+};
+
+// Parse the specified response `body`, whose `CollectorResponse::hash_body`
+// is the specified `body_hash`.  Return the response, or an error message.
+std::variant<CollectorResponse, std::string> parse_agent_traces_response(
+    StringView body, std::uint64_t body_hash) {
+  CollectorResponse response;
+  response.body_hash = body_hash;
+  std::string error;
+  RateParser parser{response, error};
+  if (!nlohmann::json::sax_parse(body.begin(), body.end(), &parser)) {
+    error += "\nError occurred for response body (begins on next line):\n";
+    append(error, body);
+    return error;
+  }
+  return response;
 }
 
 }  // namespace
 
 namespace rc = datadog::remote_config;
 
+DatadogAgent::PendingChunks::PendingChunks(TraceAPIVersion api_version)
+    : api_version(api_version),
+      payload(msgpack::fixed_array_header_size, '\0') {}
+
+DatadogAgent::RetryQueue::RetryQueue(
+    std::size_t max_retries, std::size_t max_bytes, Clock clock,
+    std::shared_ptr<MemoryBudget> budget,
+    std::shared_ptr<std::atomic<std::size_t>> buffered_bytes)
+    : max_retries(max_retries),
+      max_bytes(max_bytes),
+      clock(std::move(clock)),
+      budget(std::move(budget)),
+      buffered_bytes(std::move(buffered_bytes)) {}
+
+DatadogAgent::RetryQueue::~RetryQueue() { budget->release(bytes.load()); }
+
+bool DatadogAgent::RetryQueue::may_retry(const Payload& payload) const {
+  return payload.attempts <= max_retries;
+}
+
+void DatadogAgent::RetryQueue::add(Payload&& payload, Logger& logger) {
+  const std::size_t size = payload.body.size();
+  if (may_retry(payload)) {
+    auto backoff = max_retry_backoff;
+    if (payload.attempts - 1 < 16) {
+      backoff = std::min(max_retry_backoff,
+                         initial_retry_backoff * (1 << (payload.attempts - 1)));
+    }
+    const auto half = backoff / 2;
+    const auto jitter = std::chrono::steady_clock::duration(
+        random_uint64() % std::uint64_t(half.count() + 1));
+    const auto due = clock().tick + half + jitter;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Buffered trace chunks and retries share one budget, so that together
+    // they occupy no more than `max_bytes`.
+    if (bytes.load() + size + buffered_bytes->load() <= max_bytes.load()) {
+      bytes += size;
+      budget->charge(size);
+      retries.push_back(Retry{std::move(payload), due});
+      return;
+    }
+  }
+
+  logger.log_error([&](auto& stream) {
+    stream << "Dropping a request of " << payload.count
+           << " trace chunk(s) after " << payload.attempts
+           << " failed attempt(s) to send it to the Datadog Agent.";
+  });
+}
+
+void DatadogAgent::RetryQueue::take_due(
+    std::vector<Payload>& destination,
+    std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < retries.size(); ++i) {
+    Retry& retry = retries[i];
+    if (retry.due <= now) {
+      // Until it is sent, the payload counts against the buffer budget, as
+      // do the chunks of a deferred payload.  It is counted there before it
+      // is uncounted here, so that the two together never undercount it.
+      const std::size_t size = retry.payload.body.size();
+      retry.payload.buffered_bytes = size;
+      *buffered_bytes += size;
+      bytes -= size;
+      destination.push_back(std::move(retry.payload));
+    } else if (kept++ != i) {
+      retries[kept - 1] = std::move(retry);
+    }
+  }
+  retries.resize(kept);
+}
+
+DatadogAgent::FlushReporter::FlushReporter(
+    std::function<void(const FlushReport&)> on_flush)
+    : on_flush(std::move(on_flush)) {}
+
+void DatadogAgent::FlushReporter::report(FlushReport report) {
+  report.dropped_chunks = dropped_chunks.exchange(0);
+  on_flush(report);
+}
+
+DatadogAgent::AgentPool::AgentPool(const FinalizedDatadogAgentConfig& config)
+    : slow_response(config.request_timeout / 2) {
+  if (config.agentless_url) {
+    // The intake's URL is the trace endpoint itself.
+    agents.emplace_back();
+    agents.back().traces_endpoint = *config.agentless_url;
+    agents.back().traces_v05_endpoint = *config.agentless_url;
+    agents.back().traces_v07_endpoint = *config.agentless_url;
+    return;
+  }
+  if (config.trace_agent_urls.empty()) {
+    agents.emplace_back();
+    agents.back().traces_endpoint =
+        traces_endpoint(config.url, traces_api_path);
+    agents.back().traces_v05_endpoint =
+        traces_endpoint(config.url, traces_v05_api_path);
+    agents.back().traces_v07_endpoint =
+        traces_endpoint(config.url, traces_v07_api_path);
+  }
+  for (const auto& url : config.trace_agent_urls) {
+    agents.emplace_back();
+    agents.back().traces_endpoint = traces_endpoint(url, traces_api_path);
+    agents.back().traces_v05_endpoint =
+        traces_endpoint(url, traces_v05_api_path);
+    agents.back().traces_v07_endpoint =
+        traces_endpoint(url, traces_v07_api_path);
+  }
+}
+
+std::size_t DatadogAgent::AgentPool::pick(
+    std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::size_t soonest = next % agents.size();
+  for (std::size_t i = 0; i < agents.size(); ++i) {
+    const std::size_t index = (next + i) % agents.size();
+    if (agents[index].unhealthy_until <= now) {
+      next = index + 1;
+      return index;
+    }
+    if (agents[index].unhealthy_until < agents[soonest].unhealthy_until) {
+      soonest = index;
+    }
+  }
+  next = soonest + 1;
+  return soonest;
+}
+
+void DatadogAgent::AgentPool::record(
+    std::size_t agent, bool succeeded,
+    std::chrono::steady_clock::time_point now) {
+  // An agent is skipped after this many failures in a row, for a time that
+  // grows with further failures.
+  constexpr std::size_t max_failures = 3;
+  constexpr auto base_backoff = std::chrono::seconds(5);
+  constexpr auto max_backoff = std::chrono::minutes(1);
+  std::lock_guard<std::mutex> lock(mutex);
+  Agent& state = agents[agent];
+  if (succeeded) {
+    state.consecutive_failures = 0;
+    state.unhealthy_until = {};
+    return;
+  }
+  if (++state.consecutive_failures >= max_failures && agents.size() > 1) {
+    const std::size_t doublings =
+        std::min<std::size_t>(state.consecutive_failures - max_failures, 4);
+    state.unhealthy_until =
+        now + std::min<std::chrono::steady_clock::duration>(
+                  base_backoff * (std::size_t(1) << doublings), max_backoff);
+  }
+}
+
+bool DatadogAgent::AgentPool::has_response(std::size_t agent,
+                                           std::uint64_t body_hash) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return agents[agent].response_hash == body_hash;
+}
+
+CollectorResponse DatadogAgent::AgentPool::merge(
+    std::size_t agent, CollectorResponse&& response) {
+  std::lock_guard<std::mutex> lock(mutex);
+  agents[agent].response_hash = response.body_hash;
+  agents[agent].sample_rate_by_key = std::move(response.sample_rate_by_key);
+
+  struct Sum {
+    double total = 0;
+    std::size_t count = 0;
+  };
+  std::unordered_map<std::string, Sum> sums;
+  // The merged response is identified by the responses it was merged from.
+  std::string hashes;
+  for (const Agent& state : agents) {
+    if (state.response_hash == 0) {
+      continue;
+    }
+    hashes.append(reinterpret_cast<const char*>(&state.response_hash),
+                  sizeof state.response_hash);
+    for (const auto& [key, rate] : state.sample_rate_by_key) {
+      Sum& sum = sums[key];
+      sum.total += rate.value();
+      ++sum.count;
+    }
+  }
+
+  CollectorResponse merged;
+  merged.body_hash = CollectorResponse::hash_body(hashes);
+  for (const auto& [key, sum] : sums) {
+    if (auto rate = Rate::from(sum.total / double(sum.count))) {
+      merged.sample_rate_by_key.emplace(key, *rate);
+    }
+  }
+  return merged;
+}
+
+DatadogAgent::CircuitBreaker::CircuitBreaker(
+    std::size_t threshold,
+    std::chrono::steady_clock::duration min_probe_interval)
+    : threshold(threshold),
+      min_probe_interval(min_probe_interval),
+      probe_interval(min_probe_interval) {}
+
+void DatadogAgent::CircuitBreaker::record(
+    bool succeeded, bool probe, std::chrono::steady_clock::time_point now,
+    Logger& logger) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (probe) {
+    probe_in_flight = false;
+  }
+  if (succeeded) {
+    consecutive_failures = 0;
+    if (open.exchange(false)) {
+      const std::size_t dropped = dropped_chunks.exchange(0);
+      logger.log_error([&](auto& stream) {
+        stream << "The Datadog Agent is reachable again.  Resuming sending "
+                  "traces, after dropping "
+               << dropped << " trace chunk(s) while it was unreachable.";
+      });
+    }
+    return;
+  }
+  if (open) {
+    // Requests sent before the circuit opened might still be failing, but
+    // only a failed probe delays the next one.
+    if (probe) {
+      probe_interval = std::min(probe_interval * 2, max_probe_interval);
+      next_probe = now + probe_interval;
+    }
+    return;
+  }
+  if (threshold == 0 || ++consecutive_failures < threshold) {
+    return;
+  }
+  open = true;
+  probe_interval = min_probe_interval;
+  next_probe = now + probe_interval;
+  logger.log_error([&](auto& stream) {
+    stream << consecutive_failures.load()
+           << " trace requests in a row to the Datadog Agent failed.  Until "
+              "it is reachable again, new trace chunks will be dropped.";
+  });
+}
+
+bool DatadogAgent::CircuitBreaker::start_probe(
+    std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!open || probe_in_flight || now < next_probe) {
+    return false;
+  }
+  probe_in_flight = true;
+  return true;
+}
+
+DatadogAgent::HealthMetrics::HealthMetrics(
+    std::string url_arg, std::unique_ptr<DogStatsD> statsd_arg,
+    TracerTelemetry& telemetry, const TracerSignature& signature)
+    : url(std::move(url_arg)), statsd(std::move(statsd_arg)) {
+  using Type = DogStatsD::Type;
+  std::vector<std::string> tags;
+  if (!signature.default_service.empty()) {
+    tags.push_back("service:" + signature.default_service);
+  }
+  if (!signature.default_environment.empty()) {
+    tags.push_back("env:" + signature.default_environment);
+  }
+
+  const auto count = [&](StringView name, telemetry::CounterMetric& counter) {
+    auto count_tags = tags;
+    count_tags.insert(count_tags.end(), counter.tags().begin(),
+                      counter.tags().end());
+    counts.push_back(Count{&counter,
+                           statsd->define(name, Type::COUNT, count_tags),
+                           counter.total()});
+  };
+  auto& tracer = telemetry.metrics().tracer;
+  auto& trace_api = telemetry.metrics().trace_api;
+  count("datadog.tracer.queue.dropped.traces",
+        tracer.trace_chunks_dropped_overfull_buffer);
+  count("datadog.tracer.queue.dropped.traces",
+        tracer.trace_chunks_dropped_memory_budget);
+  count("datadog.tracer.api.requests", trace_api.requests);
+  count("datadog.tracer.api.responses", trace_api.responses_2xx);
+  count("datadog.tracer.api.responses", trace_api.responses_4xx);
+  count("datadog.tracer.api.responses", trace_api.responses_5xx);
+  count("datadog.tracer.api.errors", trace_api.errors_timeout);
+  count("datadog.tracer.api.errors", trace_api.errors_network);
+  count("datadog.tracer.api.errors", trace_api.errors_status_code);
+
+  queue_bytes = statsd->define("datadog.tracer.queue.bytes", Type::GAUGE, tags);
+  queue_spans = statsd->define("datadog.tracer.queue.spans", Type::GAUGE, tags);
+  flush_duration =
+      statsd->define("datadog.tracer.flush.duration_ms", Type::GAUGE, tags);
+  payload_bytes =
+      statsd->define("datadog.tracer.flush.bytes", Type::COUNT, tags);
+  keep_rate =
+      statsd->define("datadog.tracer.sampler.keep_rate", Type::GAUGE, tags);
+}
+
 DatadogAgent::DatadogAgent(
     const FinalizedDatadogAgentConfig& config,
     const std::shared_ptr<TracerTelemetry>& tracer_telemetry,
     const std::shared_ptr<Logger>& logger,
     const TracerSignature& tracer_signature,
-    const std::vector<std::shared_ptr<rc::Listener>>& rc_listeners)
+    const std::vector<std::shared_ptr<rc::Listener>>& rc_listeners,
+    const std::shared_ptr<WorkerPool>& workers,
+    const std::shared_ptr<ConfigManager>& config_manager)
     : tracer_telemetry_(tracer_telemetry),
       clock_(config.clock),
       logger_(logger),
-      traces_endpoint_(traces_endpoint(config.url)),
+      workers_(workers),
+      config_manager_(config_manager),
+      pending_chunks_(config.trace_api_version),
+      numa_nodes_(std::min(numa_node_count(), num_shards)),
+      trace_api_version_(config.trace_api_version),
+      trace_api_v05_rejected_(std::make_shared<std::atomic<bool>>(false)),
+      trace_api_v07_rejected_(std::make_shared<std::atomic<bool>>(false)),
+      max_buffered_bytes_(config.max_buffered_bytes),
+      max_buffered_spans_(config.max_buffered_spans.value_or(
+          std::numeric_limits<std::size_t>::max())),
+      buffer_overflow_policy_(config.buffer_overflow_policy),
+      buffered_bytes_(std::make_shared<std::atomic<std::size_t>>(0)),
+      flush_threshold_bytes_(config.flush_threshold_bytes),
+      max_payload_bytes_(config.max_payload_bytes),
+      early_flush_(std::make_shared<AgentHandle>()),
+      rc_application_(std::make_shared<AgentHandle>()),
+      compression_enabled_(config.compression_enabled),
+      compression_threshold_bytes_(config.compression_threshold_bytes),
+      max_in_flight_requests_(config.max_in_flight_requests),
+      in_flight_requests_(std::make_shared<std::atomic<std::size_t>>(0)),
+      retry_queue_(std::make_shared<RetryQueue>(
+          config.max_retries, config.max_buffered_bytes, config.clock,
+          tracer_telemetry_->memory_budget(), buffered_bytes_)),
+      flush_reporter_(config.on_flush ? std::make_shared<FlushReporter>(
+                                            config.on_flush)
+                                      : nullptr),
+      agents_(std::make_shared<AgentPool>(config)),
+      circuit_breaker_(std::make_shared<CircuitBreaker>(
+          config.circuit_breaker_threshold, config.flush_interval)),
+      health_metrics_interval_(config.health_metrics_interval),
+      memory_trim_interval_(config.memory_trim_interval),
+      last_memory_trim_(config.clock().tick),
+      agentless_(bool(config.agentless_url)),
+      api_key_(config.api_key),
+      stats_endpoint_(traces_endpoint(config.url, stats_api_path)),
       telemetry_endpoint_(telemetry_endpoint(config.url)),
       remote_configuration_endpoint_(remote_configuration_endpoint(config.url)),
       http_client_(config.http_client),
       event_scheduler_(config.event_scheduler),
+      idle_mode_(config.idle_mode_enabled &&
+                 !config.stats_computation_enabled),
       flush_interval_(config.flush_interval),
+      last_scheduled_flush_(config.clock().tick),
+      flush_controller_(config.adaptive_flush_enabled
+                            ? std::make_shared<FlushController>(
+                                  config.flush_interval,
+                                  config.min_flush_interval,
+                                  config.max_flush_interval,
+                                  config.flush_target_payload_bytes)
+                            : nullptr),
+      flush_period_(config.adaptive_flush_enabled ? config.min_flush_interval
+                                                  : config.flush_interval),
+      remote_configuration_enabled_(config.remote_configuration_enabled),
+      remote_configuration_poll_interval_(
+          config.remote_configuration_poll_interval),
       request_timeout_(config.request_timeout),
       shutdown_timeout_(config.shutdown_timeout),
       remote_config_(tracer_signature, rc_listeners, logger),
+      state_file_(config.state_file.empty()
+                      ? nullptr
+                      : std::make_shared<AgentStateFile>(config.state_file,
+                                                         logger)),
+      rc_max_poll_ticks_(
+          config.remote_configuration_poll_interval.count() > 0
+              ? std::max<std::uint64_t>(
+                    config.remote_configuration_max_poll_interval /
+                        config.remote_configuration_poll_interval,
+                    1)
+              : 1),
       tracer_signature_(tracer_signature) {
   assert(logger_);
   assert(tracer_telemetry_);
 
-  tasks_.emplace_back(event_scheduler_->schedule_recurring_event(
-      config.flush_interval, [this]() { flush(); }));
+  early_flush_->agent = this;
+  rc_application_->agent = this;
+
+  if (trace_api_version_ == TraceAPIVersion::V0_7) {
+    v07_payload_header_ = v07_payload_header(tracer_signature_);
+    v07_payload_tags_.env = tracer_signature_.default_environment;
+    v07_payload_tags_.version = tracer_signature_.default_version;
+  }
+
+  if (state_file_ && remote_configuration_enabled_) {
+    auto saved = state_file_->remote_config();
+    if (!saved.is_null()) {
+      remote_config_.restore_state(saved);
+    }
+  }
+
+  if (config.stats_computation_enabled) {
+    stats_ = std::make_unique<StatsConcentrator>(tracer_signature, logger_);
+  }
+
+  if (config.health_metrics_enabled) {
+    auto statsd = DogStatsD::open(config.dogstatsd_url);
+    if (auto* error = statsd.if_error()) {
+      logger_->log_error(
+          error->with_prefix("Health metrics will not be reported: "));
+    } else {
+      health_ = std::make_unique<HealthMetrics>(
+          config.dogstatsd_url, std::move(*statsd), *tracer_telemetry_,
+          tracer_signature_);
+    }
+  }
 
   if (tracer_telemetry_->enabled()) {
     // Callback for successful telemetry HTTP requests, to examine HTTP
@@ -194,36 +807,100 @@ DatadogAgent::DatadogAgent(
       logger->log_error(error.with_prefix(
           "Error occurred during HTTP request for telemetry: "));
     };
-
-    // Only schedule this if telemetry is enabled.
-    // Every 10 seconds, have the tracer telemetry capture the metrics
-    // values. Every 60 seconds, also report those values to the datadog
-    // agent.
-    tasks_.emplace_back(event_scheduler_->schedule_recurring_event(
-        std::chrono::seconds(10), [this, n = 0]() mutable {
-          n++;
-          tracer_telemetry_->capture_metrics();
-          if (n % 6 == 0) {
-            send_heartbeat_and_telemetry();
-          }
-        }));
   }
 
-  if (config.remote_configuration_enabled) {
-    tasks_.emplace_back(event_scheduler_->schedule_recurring_event(
-        config.remote_configuration_poll_interval,
-        [this] { get_and_apply_remote_configuration_updates(); }));
+  if (!config.lazy_start) {
+    start();
   }
 }
 
+void DatadogAgent::start() {
+  std::call_once(started_, [this]() {
+    telemetry_on_flush_ =
+        tracer_telemetry_->enabled() && !idle_mode_ &&
+        flush_period_ <= tracer_telemetry_->cadence().capture_interval;
+    const bool trim = memory_trim_interval_ != memory_trim_interval_.zero();
+    trim_on_flush_ =
+        trim && (idle_mode_ || flush_period_ <= memory_trim_interval_);
+    if (trim && !trim_on_flush_) {
+      tasks_.emplace_back(
+          event_scheduler_->schedule_recurring_event_async_cancel(
+              memory_trim_interval_, [this]() { trim_memory(); }));
+    }
+
+    if (!idle_mode_) {
+      tasks_.emplace_back(
+          event_scheduler_->schedule_recurring_event_async_cancel(
+              flush_period_, [this]() { scheduled_flush(); }));
+    }
+
+    if (tracer_telemetry_->enabled() && !telemetry_on_flush_) {
+      tasks_.emplace_back(
+          event_scheduler_->schedule_recurring_event_async_cancel(
+              tracer_telemetry_->cadence().capture_interval,
+              [this]() { poll_telemetry(); }));
+    }
+
+    if (remote_configuration_enabled_) {
+      tasks_.emplace_back(
+          event_scheduler_->schedule_recurring_event_async_cancel(
+              remote_configuration_poll_interval_,
+              [this] { poll_remote_configuration(); }));
+    }
+
+    if (health_) {
+      tasks_.emplace_back(
+          event_scheduler_->schedule_recurring_event_async_cancel(
+              health_metrics_interval_, [this]() { report_health(); }));
+    }
+  });
+}
+
 DatadogAgent::~DatadogAgent() {
   const auto deadline = clock_().tick + shutdown_timeout_;
 
+  // Wait for any early flush or Remote Configuration application in
+  // progress, and prevent any more.
+  for (const auto& handle : {early_flush_, rc_application_}) {
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    handle->agent = nullptr;
+  }
+
+  // Stop the recurring tasks without waiting for one that is running, and
+  // meanwhile send everything, including payloads deferred by earlier
+  // flushes.
+  std::vector<std::future<void>> cancellations;
   for (auto&& cancel_task : tasks_) {
-    cancel_task();
+    cancellations.push_back(cancel_task());
+  }
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    // Prevent the flush from being scheduled again.
+    flush_scheduled_ = true;
+    if (flush_task_) {
+      cancellations.push_back(flush_task_());
+      flush_task_ = nullptr;
+    }
+  }
+  flush(/*ignore_in_flight_limit=*/true);
+
+  bool task_was_running = false;
+  for (auto& cancellation : cancellations) {
+    if (cancellation.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready) {
+      task_was_running = true;
+      cancellation.wait();
+    }
+  }
+  if (task_was_running) {
+    // A flush that was running might have deferred payloads or buffered
+    // chunks that the flush above did not see.
+    flush(/*ignore_in_flight_limit=*/true);
   }
 
-  flush();
+  if (health_) {
+    report_health();
+  }
 
   if (tracer_telemetry_->enabled()) {
     tracer_telemetry_->capture_metrics();
@@ -233,80 +910,939 @@ DatadogAgent::~DatadogAgent() {
   }
 
   http_client_->drain(deadline);
+  // Whatever remains buffered is dropped.
+  tracer_telemetry_->memory_budget()->release(buffered_bytes_->load());
 }
 
 Expected<void> DatadogAgent::send(
     std::vector<std::unique_ptr<SpanData>>&& spans,
     const std::shared_ptr<TraceSampler>& response_handler) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  trace_chunks_.push_back(TraceChunk{std::move(spans), response_handler});
+  return send(std::move(spans), ChunkTags{}, response_handler);
+}
+
+Expected<void> DatadogAgent::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const ChunkTags& chunk_tags,
+    const std::shared_ptr<TraceSampler>& response_handler) {
+  if (health_) {
+    // `report_health` takes the sampled chunks first, so that the keep rate
+    // it reports seldom counts a sampled chunk without the chunk.
+    ++health_->unreported_chunks;
+    if (is_sampled(spans)) {
+      ++health_->unreported_sampled_chunks;
+    }
+  }
+
+  if (stats_) {
+    stats_->add(spans);
+    // The Datadog Agent would discard the spans of a trace dropped by sampling,
+    // other than those kept by span sampling, once it had computed stats from
+    // them.  Since the stats are computed here instead, those spans need not
+    // be encoded or sent at all.
+    if (is_dropped_trace(spans)) {
+      keep_span_sampled_only(spans);
+      if (spans.empty()) {
+        return nullopt;
+      }
+    }
+  }
+
+  if (circuit_breaker_->open.load()) {
+    // The Datadog Agent is unreachable, so don't spend time encoding a chunk
+    // that could not be sent.
+    ++circuit_breaker_->dropped_chunks;
+    return nullopt;
+  }
+
+  if (tracer_telemetry_->memory_budget()->state() == MemoryBudget::SHED) {
+    // The tracer holds all of the memory that it may, so don't buffer more.
+    ++shed_chunks_;
+    auto& metrics = tracer_telemetry_->metrics().tracer;
+    metrics.trace_chunks_dropped_memory_budget.inc();
+    return nullopt;
+  }
+
+  if (trace_api_version_ != TraceAPIVersion::V0_5 ||
+      trace_api_v05_rejected_->load()) {
+    // The v0.4 and v0.7 encodings of a chunk do not depend on any other
+    // chunk, so encode it on the calling thread before taking the lock.  Only
+    // appending the encoded bytes to this thread's shard is serialized.
+    thread_local std::string encoded;
+    encoded.clear();
+    const TraceAPIVersion api_version =
+        trace_api_version_ == TraceAPIVersion::V0_7 &&
+                !trace_api_v07_rejected_->load()
+            ? TraceAPIVersion::V0_7
+            : TraceAPIVersion::V0_4;
+    Expected<void> result;
+    {
+      StageTimer timer{
+          tracer_telemetry_->stage(&StageTimings::msgpack_encode)};
+      result = api_version == TraceAPIVersion::V0_7
+                   ? msgpack_encode_v07(encoded, spans, chunk_tags,
+                                        v07_payload_tags_, workers_.get())
+                   : msgpack_encode(encoded, spans, chunk_tags,
+                                    workers_.get());
+    }
+    if (result.if_error()) {
+      return result;
+    }
+    const bool sampled = is_sampled(spans);
+    const BufferedChunk chunk{encoded.size(), spans.size(), sampled,
+                              chunk_rank(spans, sampled), api_version};
+    if (reserve(chunk) || make_room(chunk)) {
+      Shard& shard = shard_for_this_thread();
+      std::lock_guard<ShardMutex> lock(shard.mutex);
+      shard.payload += encoded;
+      shard.chunks.push_back(chunk);
+      shard.response_handlers.insert(response_handler);
+    } else {
+      record_dropped(1, chunk.bytes);
+    }
+    // Don't let one unusually large chunk pin its memory to this thread.
+    constexpr std::size_t max_retained_capacity = 1 << 20;
+    if (encoded.capacity() > max_retained_capacity) {
+      std::string().swap(encoded);
+    }
+    schedule_flush_if_idle();
+    flush_early_if_needed();
+    return nullopt;
+  }
+
+  {
+    // The v0.5 encoding refers to the string table shared by all pending
+    // chunks, and so must be done while holding the lock.
+    std::lock_guard<Mutex> lock(mutex_);
+    fall_back_if_v05_rejected();
+    // Encode the chunk directly onto the end of the pending payload.  If
+    // encoding fails, then discard whatever was partially appended so that
+    // the payload remains a valid sequence of chunks.  Strings that a failed
+    // v0.5 encoding added to `pending_chunks_.strings` are harmless.
+    const std::size_t previous_size = pending_chunks_.payload.size();
+    Expected<void> result;
+    {
+      StageTimer timer{
+          tracer_telemetry_->stage(&StageTimings::msgpack_encode)};
+      result = pending_chunks_.api_version == TraceAPIVersion::V0_5
+                   ? msgpack_encode_v05(pending_chunks_.payload, spans,
+                                        chunk_tags, pending_chunks_.strings)
+                   : msgpack_encode(pending_chunks_.payload, spans,
+                                    chunk_tags);
+    }
+    if (result.if_error()) {
+      pending_chunks_.payload.resize(previous_size);
+      return result;
+    }
+    const BufferedChunk chunk{pending_chunks_.payload.size() - previous_size,
+                              spans.size(), true, ChunkRank::SAMPLED,
+                              pending_chunks_.api_version};
+    if (!reserve(chunk)) {
+      pending_chunks_.payload.resize(previous_size);
+      record_dropped(1, chunk.bytes);
+      return nullopt;
+    }
+    ++pending_chunks_.count;
+    pending_chunks_.span_count += spans.size();
+    pending_chunks_.response_handlers.insert(response_handler);
+  }
+  schedule_flush_if_idle();
+  flush_early_if_needed();
   return nullopt;
 }
 
+DatadogAgent::Shard& DatadogAgent::shard_for_this_thread() {
+  static std::atomic<std::size_t> next_thread{0};
+  thread_local const std::size_t thread_index = next_thread++;
+  if (numa_nodes_ == 1) {
+    return shards_[thread_index % num_shards];
+  }
+  // The thread might have moved to another node since its last chunk, so
+  // look up the node every time.
+  const std::size_t shards_per_node = num_shards / numa_nodes_;
+  const std::size_t node = current_numa_node() % numa_nodes_;
+  return shards_[node * shards_per_node + thread_index % shards_per_node];
+}
+
+void DatadogAgent::schedule_flush_if_idle() {
+  // `send` reserves its chunk's room in the buffer before checking
+  // `flush_scheduled_`, and `unschedule_flush_if_idle` clears
+  // `flush_scheduled_` before checking the buffer, so at least one of them
+  // sees the other's change, and a buffered chunk is never left without a
+  // flush.
+  if (!idle_mode_ || flush_scheduled_.load()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(idle_mutex_);
+  if (flush_scheduled_.load()) {
+    return;
+  }
+  flush_scheduled_ = true;
+  flush_task_ = event_scheduler_->schedule_recurring_event_async_cancel(
+      flush_period_, [this]() {
+        scheduled_flush();
+        unschedule_flush_if_idle();
+      });
+}
+
+void DatadogAgent::unschedule_flush_if_idle() {
+  std::lock_guard<std::mutex> lock(idle_mutex_);
+  if (!flush_task_) {
+    // The destructor has cancelled the flush.
+    return;
+  }
+  flush_scheduled_ = false;
+  if (!idle()) {
+    flush_scheduled_ = true;
+    return;
+  }
+  // The flush is running this very callback, so don't wait for it to return.
+  (void)flush_task_();
+  flush_task_ = nullptr;
+}
+
+bool DatadogAgent::idle() {
+  // A request's callbacks queue it for a retry, if need be, before they stop
+  // counting it as in flight, so `retry_queue_` is checked last.  The chunks
+  // of deferred payloads count as buffered until they are sent.
+  if (buffered_bytes_->load() != 0 || in_flight_requests_->load() != 0 ||
+      circuit_breaker_->open.load()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(retry_queue_->mutex);
+  return retry_queue_->retries.empty();
+}
+
+void DatadogAgent::flush_early_if_needed() {
+  const std::size_t buffered = buffered_bytes_->load();
+  if (buffered < flush_threshold_bytes_) {
+    // The buffer is not full enough to flush on its own account, but it might
+    // be on account of the tracer's memory budget.  A smaller flush would
+    // accomplish little but more requests.
+    const MemoryBudget& budget = *tracer_telemetry_->memory_budget();
+    if (budget.state() == MemoryBudget::NORMAL ||
+        buffered < budget.limit() / 8) {
+      return;
+    }
+  }
+  if (early_flush_scheduled_.exchange(true)) {
+    return;
+  }
+  const bool scheduled =
+      event_scheduler_->schedule_event([early_flush = early_flush_]() {
+        std::lock_guard<std::mutex> lock(early_flush->mutex);
+        if (early_flush->agent) {
+          early_flush->agent->flush();
+        }
+      });
+  if (!scheduled) {
+    // The event scheduler does not support one-off events, so the chunks will
+    // wait for the next flush interval.
+    early_flush_scheduled_ = false;
+  }
+}
+
+void DatadogAgent::fall_back_if_v05_rejected() {
+  if (pending_chunks_.api_version != TraceAPIVersion::V0_5 ||
+      !trace_api_v05_rejected_->load()) {
+    return;
+  }
+
+  // The pending chunks were encoded in a format that the Datadog Agent does
+  // not accept, and the spans from which they were encoded are gone.
+  if (pending_chunks_.count != 0) {
+    logger_->log_error([&](auto& stream) {
+      stream << "Discarding " << pending_chunks_.count
+             << " trace chunk(s) encoded for the Datadog Agent's v0.5 trace "
+                "API, which the Agent does not support.";
+    });
+  }
+  release(pending_chunks_.payload.size() - msgpack::fixed_array_header_size,
+          pending_chunks_.span_count);
+  pending_chunks_ = PendingChunks{TraceAPIVersion::V0_4};
+}
+
+bool DatadogAgent::reserve(const BufferedChunk& chunk) {
+  tracer_telemetry_->memory_budget()->charge(chunk.bytes);
+  const std::size_t bytes =
+      buffered_bytes_->fetch_add(chunk.bytes) + chunk.bytes;
+  const std::size_t spans =
+      buffered_spans_.fetch_add(chunk.spans) + chunk.spans;
+  // Requests awaiting a retry count against the same budget.
+  if (bytes + retry_queue_->bytes.load() <= max_buffered_bytes() &&
+      spans <= max_buffered_spans_) {
+    return true;
+  }
+  release(chunk.bytes, chunk.spans);
+  return false;
+}
+
+void DatadogAgent::release(std::size_t bytes, std::size_t spans) {
+  *buffered_bytes_ -= bytes;
+  buffered_spans_ -= spans;
+  tracer_telemetry_->memory_budget()->release(bytes);
+}
+
+bool DatadogAgent::make_room(const BufferedChunk& chunk) {
+  if (buffer_overflow_policy_ == BufferOverflowPolicy::DROP_NEWEST ||
+      chunk.bytes + retry_queue_->bytes.load() > max_buffered_bytes() ||
+      chunk.spans > max_buffered_spans_) {
+    return false;
+  }
+  if (buffer_overflow_policy_ == BufferOverflowPolicy::DROP_UNSAMPLED_FIRST &&
+      !chunk.sampled) {
+    return false;
+  }
+
+  // Drop buffered chunks for which `droppable` returns true, oldest first
+  // within each shard, until there is room.  The payload of a shard is
+  // compacted in place around the chunks that remain.
+  std::size_t dropped_chunks = 0;
+  std::size_t dropped_bytes = 0;
+  bool reserved = false;
+  const auto drop = [&](const auto& droppable) {
+    for (Shard& shard : shards_) {
+      std::lock_guard<ShardMutex> lock(shard.mutex);
+      std::size_t read = 0;
+      std::size_t write = 0;
+      std::size_t kept = 0;
+      for (std::size_t i = 0; i < shard.chunks.size(); ++i) {
+        const BufferedChunk buffered = shard.chunks[i];
+        if (!reserved && droppable(buffered)) {
+          release(buffered.bytes, buffered.spans);
+          ++dropped_chunks;
+          dropped_bytes += buffered.bytes;
+          reserved = reserve(chunk);
+        } else {
+          if (write != read) {
+            std::copy_n(shard.payload.begin() + read, buffered.bytes,
+                        shard.payload.begin() + write);
+          }
+          write += buffered.bytes;
+          shard.chunks[kept++] = buffered;
+        }
+        read += buffered.bytes;
+      }
+      shard.payload.resize(write);
+      shard.chunks.resize(kept);
+      if (reserved) {
+        break;
+      }
+    }
+  };
+
+  switch (buffer_overflow_policy_) {
+    case BufferOverflowPolicy::DROP_LOWEST_PRIORITY:
+      // One pass per rank below the new chunk's, lowest first.
+      for (unsigned rank = 0; !reserved && rank < unsigned(chunk.rank);
+           ++rank) {
+        drop([rank](const BufferedChunk& buffered) {
+          return unsigned(buffered.rank) == rank;
+        });
+      }
+      break;
+    case BufferOverflowPolicy::DROP_UNSAMPLED_FIRST:
+      drop([](const BufferedChunk& buffered) { return !buffered.sampled; });
+      break;
+    default:
+      drop([](const BufferedChunk&) { return true; });
+  }
+
+  record_dropped(dropped_chunks, dropped_bytes);
+  return reserved;
+}
+
+void DatadogAgent::record_dropped(std::size_t chunks, std::size_t bytes) {
+  if (chunks == 0) {
+    return;
+  }
+  dropped_chunks_ += chunks;
+  dropped_bytes_ += bytes;
+  auto& metrics = tracer_telemetry_->metrics().tracer;
+  metrics.trace_chunks_dropped_overfull_buffer.add(chunks);
+  metrics.trace_chunk_bytes_dropped_overfull_buffer.add(bytes);
+}
+
+Optional<CollectorResponse> DatadogAgent::saved_rates() const {
+  if (!state_file_) {
+    return nullopt;
+  }
+  return state_file_->rates();
+}
+
 std::string DatadogAgent::config() const {
   // clang-format off
-  return nlohmann::json::object({
+  const auto url = [&](const AgentPool::Agent& agent) {
+    const auto& traces_url = trace_api_version_ == TraceAPIVersion::V0_5 ? agent.traces_v05_endpoint : trace_api_version_ == TraceAPIVersion::V0_7 ? agent.traces_v07_endpoint : agent.traces_endpoint;
+    return traces_url.scheme + "://" + traces_url.authority + traces_url.path;
+  };
+  auto result = nlohmann::json::object({
     {"type", "datadog::tracing::DatadogAgent"},
     {"config", nlohmann::json::object({
-      {"traces_url", (traces_endpoint_.scheme + "://" + traces_endpoint_.authority + traces_endpoint_.path)},
+      {"traces_url", url(agents_->agents.front())},
+      {"trace_api_version", trace_api_version_ == TraceAPIVersion::V0_5 ? "v0.5" : trace_api_version_ == TraceAPIVersion::V0_7 ? "v0.7" : "v0.4"},
+      {"max_buffered_bytes", max_buffered_bytes_},
+      {"flush_threshold_bytes", flush_threshold_bytes_},
+      {"max_payload_bytes", max_payload_bytes_},
+      {"max_in_flight_requests", max_in_flight_requests_},
+      {"max_retries", retry_queue_->max_retries},
+      {"circuit_breaker_threshold", circuit_breaker_->threshold},
+      {"compression_enabled", compression_enabled_},
+      {"compression_threshold_bytes", compression_threshold_bytes_},
+      {"stats_computation_enabled", bool(stats_)},
+      {"buffer_overflow_policy", buffer_overflow_policy_ == BufferOverflowPolicy::DROP_OLDEST ? "drop_oldest" : buffer_overflow_policy_ == BufferOverflowPolicy::DROP_UNSAMPLED_FIRST ? "drop_unsampled_first" : buffer_overflow_policy_ == BufferOverflowPolicy::DROP_LOWEST_PRIORITY ? "drop_lowest_priority" : "drop_newest"},
       {"telemetry_url", (telemetry_endpoint_.scheme + "://" + telemetry_endpoint_.authority + telemetry_endpoint_.path)},
       {"remote_configuration_url", (remote_configuration_endpoint_.scheme + "://" + remote_configuration_endpoint_.authority + remote_configuration_endpoint_.path)},
       {"flush_interval_milliseconds", std::chrono::duration_cast<std::chrono::milliseconds>(flush_interval_).count() },
       {"request_timeout_milliseconds", std::chrono::duration_cast<std::chrono::milliseconds>(request_timeout_).count() },
       {"shutdown_timeout_milliseconds", std::chrono::duration_cast<std::chrono::milliseconds>(shutdown_timeout_).count() },
+      {"memory_trim_interval_milliseconds", std::chrono::duration_cast<std::chrono::milliseconds>(memory_trim_interval_).count() },
       {"http_client", nlohmann::json::parse(http_client_->config())},
       {"event_scheduler", nlohmann::json::parse(event_scheduler_->config())},
     })},
-  }).dump();
+  });
   // clang-format on
+  if (state_file_) {
+    result["config"]["state_file"] = state_file_->path();
+  }
+  if (agentless_) {
+    result["config"]["agentless"] = true;
+  }
+  if (flush_controller_) {
+    result["config"]["adaptive_flush"] = flush_controller_->config_json();
+  }
+  if (health_) {
+    result["config"]["health_metrics"] = nlohmann::json::object(
+        {{"dogstatsd_url", health_->url},
+         {"interval_milliseconds",
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              health_metrics_interval_)
+              .count()}});
+  }
+  if (agents_->agents.size() > 1) {
+    auto& urls = result["config"]["trace_agent_urls"] = nlohmann::json::array();
+    for (const auto& agent : agents_->agents) {
+      urls.push_back(url(agent));
+    }
+  }
+  return result.dump();
 }
 
-void DatadogAgent::flush() {
-  std::vector<TraceChunk> trace_chunks;
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    using std::swap;
-    swap(trace_chunks, trace_chunks_);
+Pressure DatadogAgent::pressure() const {
+  const std::size_t bytes = buffered_bytes_->load();
+  const std::size_t spans = buffered_spans_.load();
+  const auto flush_duration = last_flush_duration_.load();
+  const std::size_t max_bytes = max_buffered_bytes();
+  const auto interval = flush_interval();
+  if (circuit_breaker_->open.load() || dropped_chunks_.load() != 0 ||
+      bytes >= max_bytes / 4 * 3 || spans >= max_buffered_spans_ / 4 * 3 ||
+      flush_duration >= interval) {
+    return Pressure::HIGH;
+  }
+  if (bytes >= max_bytes / 2 || spans >= max_buffered_spans_ / 2 ||
+      flush_duration >= interval / 2 ||
+      circuit_breaker_->consecutive_failures.load() != 0 ||
+      in_flight_requests_->load() >= max_in_flight_requests_) {
+    return Pressure::ELEVATED;
+  }
+  return Pressure::NORMAL;
+}
+
+void DatadogAgent::flush(bool ignore_in_flight_limit) {
+  StageTimer timer{tracer_telemetry_->stage(&StageTimings::flush)};
+  const auto flush_start = clock_().tick;
+  DD_TRACE_PROBE(flush__start);
+  // Chunks sent from now on may schedule another early flush.
+  early_flush_scheduled_ = false;
+
+  if (const std::size_t dropped_chunks = dropped_chunks_.exchange(0)) {
+    if (flush_reporter_) {
+      flush_reporter_->dropped_chunks += dropped_chunks;
+    }
+    const std::size_t dropped_bytes = dropped_bytes_.exchange(0);
+    logger_->log_error([&](auto& stream) {
+      stream << "Dropped " << dropped_chunks << " trace chunk(s) totaling "
+             << dropped_bytes
+             << " bytes because the buffer of traces awaiting submission to "
+                "the Datadog Agent was full.";
+    });
+  }
+  if (const std::size_t shed_chunks = shed_chunks_.exchange(0)) {
+    if (flush_reporter_) {
+      flush_reporter_->dropped_chunks += shed_chunks;
+    }
+    logger_->log_error([&](auto& stream) {
+      stream << "Dropped " << shed_chunks
+             << " trace chunk(s) because the tracer's memory budget of "
+             << tracer_telemetry_->memory_budget()->limit()
+             << " bytes was exhausted.";
+    });
   }
 
-  if (trace_chunks.empty()) {
-    return;
+  if (stats_) {
+    // When shutting down, there will be no later chance to send the buckets
+    // that have not yet ended.
+    flush_stats(/*force=*/ignore_in_flight_limit);
   }
 
-  std::string body;
-  auto encode_result = msgpack_encode(body, trace_chunks);
-  if (auto* error = encode_result.if_error()) {
-    logger_->log_error(*error);
-    return;
+  // While the Datadog Agent is unreachable, payloads are kept rather than
+  // sent, except when shutting down, and failed requests stay in the retry
+  // queue.
+  const bool circuit_open =
+      !ignore_in_flight_limit && circuit_breaker_->open.load();
+
+  std::unique_lock<Mutex> lock(mutex_);
+  fall_back_if_v05_rejected();
+  const TraceAPIVersion api_version = pending_chunks_.api_version;
+  PendingChunks chunks =
+      std::exchange(pending_chunks_, PendingChunks{api_version});
+  // Expect the next batch to be about as large as this one, so that the
+  // pending payload does not have to be regrown piecemeal after every flush.
+  pending_chunks_.payload.reserve(chunks.payload.size());
+  // Payloads deferred by an earlier flush go first, followed by failed
+  // requests that are due to be retried.  When shutting down, there will be no
+  // later chance to retry, so every failed request is due.
+  std::vector<Payload> payloads = std::move(deferred_payloads_);
+  deferred_payloads_.clear();
+  lock.unlock();
+  retry_queue_->max_bytes = max_buffered_bytes();
+  if (!circuit_open) {
+    retry_queue_->take_due(payloads,
+                           ignore_in_flight_limit
+                               ? std::chrono::steady_clock::time_point::max()
+                               : clock_().tick);
+  }
+
+  if (api_version == TraceAPIVersion::V0_5) {
+    // The chunks are already encoded.  All that remains is to fill in the
+    // header of the array that contains them.  A v0.5 payload is an array of
+    // two elements: the string table, followed by the array of chunks.  The
+    // chunks all refer to the same string table, so the payload is not split.
+    const std::size_t buffered_bytes =
+        chunks.payload.size() - msgpack::fixed_array_header_size;
+    std::string body;
+    Expected<void> encode_result;
+    if (chunks.count != 0) {
+      body.reserve(msgpack::fixed_array_header_size + chunks.payload.size());
+      encode_result =
+          msgpack::overwrite_array_header(chunks.payload.data(), chunks.count);
+      if (encode_result) {
+        encode_result = msgpack::pack_array(body, 2);
+      }
+      if (encode_result) {
+        encode_result = chunks.strings.msgpack_encode(body);
+      }
+    }
+    if (auto* error = encode_result.if_error()) {
+      logger_->log_error(*error);
+      release(buffered_bytes, chunks.span_count);
+    } else if (chunks.count != 0) {
+      body += chunks.payload;
+      payloads.push_back(Payload{
+          TraceAPIVersion::V0_5, std::move(body), chunks.count,
+          buffered_bytes, chunks.span_count,
+          std::make_shared<const std::unordered_set<
+              std::shared_ptr<TraceSampler>>>(
+              std::move(chunks.response_handlers))});
+      payloads.back().spans = chunks.span_count;
+    }
+  } else {
+    // Collect the chunks from every shard into payloads of at most
+    // `max_payload_bytes_`, if possible.  Chunks are appended to the last of
+    // the deferred and retried payloads, if it has the same version and has
+    // room, so that a retry travels together with new chunks.  Each v0.4
+    // payload begins with room for the header of the array that contains its
+    // chunks, and each v0.7 payload with `v07_payload_header_`, which ends
+    // with such room.  Any v0.4 chunks in `pending_chunks_` start off the
+    // first new payload.  Clearing a shard's payload keeps its capacity for
+    // the next batch.
+    const std::string v04_payload_header(msgpack::fixed_array_header_size,
+                                         '\0');
+    const auto add_chunks = [&](StringView encoded, std::size_t count,
+                                std::size_t spans,
+                                TraceAPIVersion chunk_version) {
+      const std::string& header = chunk_version == TraceAPIVersion::V0_7
+                                      ? v07_payload_header_
+                                      : v04_payload_header;
+      if (payloads.empty() || payloads.back().api_version != chunk_version ||
+          (payloads.back().count != 0 &&
+           payloads.back().body.size() + encoded.size() >
+               max_payload_bytes_ + header.size())) {
+        payloads.push_back(
+            Payload{chunk_version, header, 0, 0, 0, nullptr});
+      }
+      Payload& payload = payloads.back();
+      append(payload.body, encoded);
+      payload.count += count;
+      payload.buffered_bytes += encoded.size();
+      payload.buffered_spans += spans;
+      payload.spans += spans;
+      payload.has_new_chunks = true;
+    };
+
+    if (chunks.count != 0) {
+      add_chunks(StringView(chunks.payload)
+                     .substr(msgpack::fixed_array_header_size),
+                 chunks.count, chunks.span_count, TraceAPIVersion::V0_4);
+    }
+    // Under `BufferOverflowPolicy::DROP_LOWEST_PRIORITY`, chunks are first
+    // gathered by rank, and then added highest rank first, so that if not
+    // every payload can be sent now, the ones sent first carry the chunks
+    // most worth keeping.
+    const bool by_rank =
+        buffer_overflow_policy_ == BufferOverflowPolicy::DROP_LOWEST_PRIORITY;
+    struct RankedChunks {
+      std::string payload;
+      std::vector<BufferedChunk> chunks;
+    };
+    std::array<RankedChunks, num_chunk_ranks> ranked;
+    // v0.7 chunks that were buffered before the Datadog Agent rejected v0.7
+    // are dropped, as was the rejected request.
+    const bool v07_rejected = trace_api_v07_rejected_->load();
+    for (Shard& shard : shards_) {
+      std::lock_guard<ShardMutex> shard_lock(shard.mutex);
+      if (shard.chunks.empty()) {
+        continue;
+      }
+      std::size_t offset = 0;
+      for (const BufferedChunk& chunk : shard.chunks) {
+        const StringView encoded =
+            StringView(shard.payload).substr(offset, chunk.bytes);
+        if (v07_rejected && chunk.api_version == TraceAPIVersion::V0_7) {
+          release(chunk.bytes, chunk.spans);
+        } else if (by_rank) {
+          RankedChunks& same_rank = ranked[std::size_t(chunk.rank)];
+          append(same_rank.payload, encoded);
+          same_rank.chunks.push_back(chunk);
+        } else {
+          add_chunks(encoded, 1, chunk.spans, chunk.api_version);
+        }
+        offset += chunk.bytes;
+      }
+      chunks.response_handlers.merge(shard.response_handlers);
+      shard.peak_bytes = std::max(shard.peak_bytes, shard.payload.size());
+      shard.peak_chunks = std::max(shard.peak_chunks, shard.chunks.size());
+      shard.payload.clear();
+      shard.chunks.clear();
+      shard.response_handlers.clear();
+    }
+    for (auto same_rank = ranked.rbegin(); same_rank != ranked.rend();
+         ++same_rank) {
+      std::size_t offset = 0;
+      for (const BufferedChunk& chunk : same_rank->chunks) {
+        add_chunks(StringView(same_rank->payload).substr(offset, chunk.bytes),
+                   1, chunk.spans, chunk.api_version);
+        offset += chunk.bytes;
+      }
+    }
+
+    // Every payload with new chunks might carry a chunk from any of the
+    // samplers.
+    const auto samplers = std::make_shared<
+        const std::unordered_set<std::shared_ptr<TraceSampler>>>(
+        std::move(chunks.response_handlers));
+    for (Payload& payload : payloads) {
+      if (!payload.has_new_chunks) {
+        continue;
+      }
+      payload.has_new_chunks = false;
+      if (!payload.samplers) {
+        payload.samplers = samplers;
+      } else if (payload.samplers != samplers) {
+        auto merged = std::make_shared<
+            std::unordered_set<std::shared_ptr<TraceSampler>>>(
+            *payload.samplers);
+        merged->insert(samplers->begin(), samplers->end());
+        payload.samplers = std::move(merged);
+      }
+    }
+  }
+
+  // Send as many payloads as the limit on requests in flight allows, oldest
+  // first, and keep the rest for the next flush.
+  auto unsent = payloads.begin();
+  for (; unsent != payloads.end(); ++unsent) {
+    if (unsent->api_version != TraceAPIVersion::V0_5) {
+      // The number of chunks might have changed since the payload was last
+      // sent, so the header is written just before sending.
+      const std::size_t header_offset =
+          unsent->api_version == TraceAPIVersion::V0_7
+              ? v07_payload_header_.size() - msgpack::fixed_array_header_size
+              : 0;
+      auto encode_result = msgpack::overwrite_array_header(
+          unsent->body.data() + header_offset, unsent->count);
+      if (auto* error = encode_result.if_error()) {
+        logger_->log_error(*error);
+        release(unsent->buffered_bytes, unsent->buffered_spans);
+        continue;
+      }
+    }
+    if (circuit_open) {
+      break;
+    }
+    if (ignore_in_flight_limit) {
+      ++*in_flight_requests_;
+    } else if (!acquire_in_flight_request()) {
+      break;
+    }
+    release(unsent->buffered_bytes, unsent->buffered_spans);
+    unsent->buffered_bytes = 0;
+    unsent->buffered_spans = 0;
+    post_traces(std::move(*unsent), flush_start);
+  }
+  if (unsent != payloads.end()) {
+    lock.lock();
+    deferred_payloads_.insert(deferred_payloads_.begin(),
+                              std::make_move_iterator(unsent),
+                              std::make_move_iterator(payloads.end()));
+  }
+  if (circuit_open && circuit_breaker_->start_probe(clock_().tick)) {
+    post_probe();
+  }
+  const auto flush_duration = clock_().tick - flush_start;
+  last_flush_duration_ = flush_duration;
+  DD_TRACE_PROBE(flush__end, flush_duration.count());
+  tracer_telemetry_->metrics().trace_api.flush_us.add(
+      std::chrono::duration_cast<std::chrono::microseconds>(flush_duration)
+          .count());
+}
+
+void DatadogAgent::scheduled_flush() {
+  const auto start = clock_().tick;
+  // The flush is scheduled every `flush_period_`, so a flush interval set by
+  // remote configuration can only make some of the scheduled flushes wait.
+  const auto interval = flush_interval();
+  const bool elapsed =
+      interval == flush_interval_ || start - last_scheduled_flush_ >= interval;
+  if (elapsed && (!flush_controller_ || flush_controller_->due(start))) {
+    const std::size_t buffered_bytes = buffered_bytes_->load();
+    flush();
+    last_scheduled_flush_ = start;
+    if (flush_controller_) {
+      flush_controller_->record_flush(start, buffered_bytes,
+                                      last_flush_duration_.load());
+    }
+  }
+  if (telemetry_on_flush_) {
+    poll_telemetry();
+  }
+  if (trim_on_flush_) {
+    trim_memory_if_due();
+  }
+}
+
+std::chrono::steady_clock::duration DatadogAgent::flush_interval() const {
+  if (config_manager_) {
+    if (const auto& interval =
+            config_manager_->pipeline_overrides().flush_interval) {
+      return *interval;
+    }
+  }
+  return flush_interval_;
+}
+
+std::size_t DatadogAgent::max_buffered_bytes() const {
+  if (config_manager_) {
+    return config_manager_->pipeline_overrides().max_buffered_bytes.value_or(
+        max_buffered_bytes_);
+  }
+  return max_buffered_bytes_;
+}
+
+bool DatadogAgent::compression_enabled() const {
+  if (config_manager_) {
+    if (const auto& enabled =
+            config_manager_->pipeline_overrides().compression_enabled) {
+      return *enabled && gzip_available();
+    }
+  }
+  return compression_enabled_;
+}
+
+void DatadogAgent::trim_memory_if_due() {
+  const auto now = clock_().tick;
+  if (now - last_memory_trim_ >= memory_trim_interval_) {
+    last_memory_trim_ = now;
+    trim_memory();
+  }
+}
+
+std::size_t DatadogAgent::trim_memory() {
+  // Each shard's buffers are regrown by the next burst, if there is one, so
+  // they are shrunk only to what the last interval needed.
+  std::size_t released = 0;
+  for (Shard& shard : shards_) {
+    std::lock_guard<ShardMutex> lock(shard.mutex);
+    released += shrink(shard.payload, shard.peak_bytes);
+    released += shrink(shard.chunks, shard.peak_chunks);
+    shard.peak_bytes = shard.payload.size();
+    shard.peak_chunks = shard.chunks.size();
+  }
+#ifdef __GLIBC__
+  // The spans of a burst, and the payloads made from them, have been freed
+  // by now, but glibc keeps the memory for reuse.
+  if (released != 0) {
+    ::malloc_trim(0);
   }
+#endif
+  return released;
+}
 
-  // One HTTP request to the Agent could possibly involve trace chunks from
-  // multiple tracers, and thus multiple trace samplers might need to have
-  // their rates updated. Unlikely, but possible.
-  std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
-  for (auto& chunk : trace_chunks) {
-    response_handlers.insert(std::move(chunk.response_handler));
+void DatadogAgent::poll_telemetry() {
+  if (tracer_telemetry_->poll(clock_().tick)) {
+    send_heartbeat_and_telemetry();
   }
+}
+
+void DatadogAgent::report_health() {
+  HealthMetrics& health = *health_;
+  DogStatsD& statsd = *health.statsd;
+  statsd.add(health.queue_bytes, double(buffered_bytes_->load()));
+  statsd.add(health.queue_spans, double(buffered_spans_.load()));
+  statsd.add(health.flush_duration,
+             std::chrono::duration<double, std::milli>(
+                 last_flush_duration_.load())
+                 .count());
+  statsd.add(health.payload_bytes, double(health.unreported_bytes.exchange(0)));
+  for (HealthMetrics::Count& count : health.counts) {
+    const std::uint64_t total = count.counter->total();
+    statsd.add(count.metric, double(total - count.reported));
+    count.reported = total;
+  }
+  const std::uint64_t sampled = health.unreported_sampled_chunks.exchange(0);
+  const std::uint64_t chunks = health.unreported_chunks.exchange(0);
+  if (chunks != 0) {
+    statsd.add(health.keep_rate, std::min(1.0, double(sampled) / chunks));
+  }
+  statsd.send();
+}
+
+bool DatadogAgent::acquire_in_flight_request() {
+  std::size_t in_flight = in_flight_requests_->load();
+  do {
+    if (in_flight >= max_in_flight_requests_) {
+      return false;
+    }
+  } while (!in_flight_requests_->compare_exchange_weak(in_flight,
+                                                       in_flight + 1));
+  return true;
+}
+
+void DatadogAgent::post_traces(
+    Payload&& payload, std::chrono::steady_clock::time_point flush_start) {
+  const std::size_t count = payload.count;
+  FlushReport report;
+  report.chunks = count;
+  report.spans = payload.spans;
+  // Set if the Datadog Agent might not support the payload's version, in
+  // which case the tracer falls back to v0.4.
+  std::shared_ptr<std::atomic<bool>> rejected;
+  const char* rejected_version = nullptr;
+  const std::size_t agent = agents_->pick(clock_().tick);
+  const HTTPClient::URL* endpoint = &agents_->agents[agent].traces_endpoint;
+  if (payload.api_version == TraceAPIVersion::V0_5) {
+    endpoint = &agents_->agents[agent].traces_v05_endpoint;
+    rejected = trace_api_v05_rejected_;
+    rejected_version = "v0.5";
+  } else if (payload.api_version == TraceAPIVersion::V0_7) {
+    endpoint = &agents_->agents[agent].traces_v07_endpoint;
+    rejected = trace_api_v07_rejected_;
+    rejected_version = "v0.7";
+  }
+  auto samplers = payload.samplers;
+  ++payload.attempts;
+  auto compressed_body = compress(payload.body);
+  const bool compressed = bool(compressed_body);
+  // Keep the uncompressed payload in case the request has to be retried.  If
+  // the body is sent uncompressed, then the request shares it with `retained`
+  // rather than copying it.
+  std::shared_ptr<Payload> retained;
+  if (retry_queue_->may_retry(payload)) {
+    retained = std::make_shared<Payload>(std::move(payload));
+  }
+  HTTPClient::SharedBody body;
+  if (compressed_body) {
+    body = std::make_shared<const std::string>(std::move(*compressed_body));
+  } else if (retained) {
+    body = std::shared_ptr<const std::string>(retained, &retained->body);
+  } else {
+    body = std::make_shared<const std::string>(std::move(payload.body));
+  }
+  // The request's buffers are charged to the memory budget until both
+  // callbacks, which share them, are destroyed.
+  auto charge = std::make_shared<MemoryCharge>(
+      tracer_telemetry_->memory_budget(),
+      body.data.size() + (retained && compressed ? retained->body.size() : 0));
 
   // This is the callback for setting request headers.
   // It's invoked synchronously (before `post` returns).
   auto set_request_headers = [&](DictWriter& headers) {
     headers.set("Content-Type", "application/msgpack");
+    if (compressed) {
+      headers.set("Content-Encoding", "gzip");
+    }
     headers.set("Datadog-Meta-Lang", "cpp");
     headers.set("Datadog-Meta-Lang-Version",
                 tracer_signature_.library_language_version);
     headers.set("Datadog-Meta-Tracer-Version",
                 tracer_signature_.library_version);
-    headers.set("X-Datadog-Trace-Count", std::to_string(trace_chunks.size()));
+    headers.set("X-Datadog-Trace-Count", std::to_string(count));
+    if (agentless_) {
+      headers.set("DD-API-KEY", api_key_);
+    }
+    if (stats_) {
+      // The Datadog Agent need not compute stats from these traces, nor
+      // determine which of their spans are top-level.
+      headers.set("Datadog-Client-Computed-Stats", "yes");
+      headers.set("Datadog-Client-Computed-Top-Level", "yes");
+    }
   };
 
   // This is the callback for the HTTP response.  It's invoked
   // asynchronously.
-  auto on_response = [telemetry = tracer_telemetry_,
-                      samplers = std::move(response_handlers),
-                      logger = logger_](int response_status,
+  const auto request_start = clock_().tick;
+  report.bytes = body.data.size();
+  report.encode_duration = request_start - flush_start;
+  auto on_response = [telemetry = tracer_telemetry_, clock = clock_,
+                      request_start, samplers = std::move(samplers),
+                      rejected = std::move(rejected), rejected_version,
+                      in_flight_requests = in_flight_requests_,
+                      retained, retry_queue = retry_queue_,
+                      agents = agents_, agent,
+                      circuit_breaker = circuit_breaker_, logger = logger_,
+                      state_file = state_file_, agentless = agentless_,
+                      flush_controller = flush_controller_,
+                      reporter = flush_reporter_, report,
+                      charge](int response_status,
                                         const DictReader& /*response_headers*/,
                                         std::string response_body) {
+    const auto now = clock().tick;
+    DD_TRACE_PROBE(http__response, response_status,
+                   (now - request_start).count());
+    telemetry->metrics().trace_api.ms.add(
+        std::chrono::duration_cast<std::chrono::milliseconds>(now -
+                                                              request_start)
+            .count());
+    const bool transient = response_status == 408 ||
+                           response_status == 429 || response_status >= 500;
+    agents->record(agent,
+                   !transient && now - request_start <= agents->slow_response,
+                   now);
+    circuit_breaker->record(!transient, /*probe=*/false, now, *logger);
+    if (flush_controller) {
+      flush_controller->record_response(now - request_start);
+    }
+    if (reporter) {
+      FlushReport completed = report;
+      completed.latency = now - request_start;
+      completed.status = response_status;
+      reporter->report(completed);
+    }
+    if (transient && retained) {
+      retry_queue->add(std::move(*retained), *logger);
+    }
+    // The request stops counting as in flight only once it has been queued
+    // for a retry, so that an idle check never misses it.
+    --*in_flight_requests;
     if (response_status >= 500) {
       telemetry->metrics().trace_api.responses_5xx.inc();
     } else if (response_status >= 400) {
@@ -318,6 +1854,23 @@ void DatadogAgent::flush() {
     } else if (response_status >= 100) {
       telemetry->metrics().trace_api.responses_1xx.inc();
     }
+    if (response_status == 404 && rejected) {
+      // The Datadog Agent predates the payload's trace API.  Subsequent
+      // chunks will be sent using v0.4.
+      if (!rejected->exchange(true)) {
+        logger->log_error([&](auto& stream) {
+          stream << "The Datadog Agent does not support the "
+                 << rejected_version
+                 << " trace API.  Traces in this request were dropped, and "
+                    "subsequent traces will be sent using the v0.4 trace API.";
+        });
+      }
+      return;
+    }
+    if (agentless && response_status >= 200 && response_status < 300) {
+      // The intake accepted the traces, and has no sample rates to send.
+      return;
+    }
     if (response_status != 200) {
       logger->log_error([&](auto& stream) {
         stream << "Unexpected response status " << response_status
@@ -337,43 +1890,213 @@ void DatadogAgent::flush() {
       return;
     }
 
-    auto result = parse_agent_traces_response(response_body);
+    // The Agent sends the same rates until they change, so usually every
+    // sampler already has them, and the response need not be parsed.  With
+    // several agents, the samplers have the rates merged from all of them,
+    // so compare with the agent's previous response instead.
+    const bool merging = agents->agents.size() > 1;
+    const std::uint64_t body_hash =
+        CollectorResponse::hash_body(response_body);
+    if (merging ? agents->has_response(agent, body_hash)
+                : std::all_of(samplers->begin(), samplers->end(),
+                              [&](const auto& sampler) {
+                                return !sampler ||
+                                       sampler->has_collector_response(
+                                           body_hash);
+                              })) {
+      return;
+    }
+
+    auto result = parse_agent_traces_response(response_body, body_hash);
     if (const auto* error_message = std::get_if<std::string>(&result)) {
       logger->log_error(*error_message);
       return;
     }
-    const auto& response = std::get<CollectorResponse>(result);
-    for (const auto& sampler : samplers) {
+    auto& response = std::get<CollectorResponse>(result);
+    if (merging) {
+      response = agents->merge(agent, std::move(response));
+    }
+    for (const auto& sampler : *samplers) {
       if (sampler) {
         sampler->handle_collector_response(response);
       }
     }
+    // The rates seldom change, so the file is seldom written.
+    if (state_file) {
+      state_file->save_rates(response);
+    }
   };
 
   // This is the callback for if something goes wrong sending the
   // request or retrieving the response.  It's invoked
   // asynchronously.
-  auto on_error = [telemetry = tracer_telemetry_,
-                   logger = logger_](Error error) {
+  auto on_error = [telemetry = tracer_telemetry_, clock = clock_,
+                   request_start, in_flight_requests = in_flight_requests_,
+                   retained, retry_queue = retry_queue_, agents = agents_,
+                   agent, circuit_breaker = circuit_breaker_,
+                   logger = logger_, reporter = flush_reporter_, report,
+                   charge](Error error) {
+    const auto now = clock().tick;
+    DD_TRACE_PROBE(http__error, (now - request_start).count());
+    telemetry->metrics().trace_api.ms.add(
+        std::chrono::duration_cast<std::chrono::milliseconds>(now -
+                                                              request_start)
+            .count());
+    agents->record(agent, false, now);
+    circuit_breaker->record(false, /*probe=*/false, now, *logger);
+    if (retained) {
+      retry_queue->add(std::move(*retained), *logger);
+    }
+    --*in_flight_requests;
+    if (reporter) {
+      FlushReport failed = report;
+      failed.latency = now - request_start;
+      reporter->report(failed);
+    }
     telemetry->metrics().trace_api.errors_network.inc();
     logger->log_error(error.with_prefix(
         "Error occurred during HTTP request for submitting traces: "));
   };
 
   tracer_telemetry_->metrics().trace_api.requests.inc();
+  tracer_telemetry_->metrics().trace_api.bytes.add(body.data.size());
+  if (health_) {
+    health_->unreported_bytes += body.data.size();
+  }
+  DD_TRACE_PROBE(http__post, body.data.size(), count);
   auto post_result =
-      http_client_->post(traces_endpoint_, std::move(set_request_headers),
+      http_client_->post(*endpoint, std::move(set_request_headers),
                          std::move(body), std::move(on_response),
                          std::move(on_error), clock_().tick + request_timeout_);
   if (auto* error = post_result.if_error()) {
+    // Neither callback will be invoked.
+    --*in_flight_requests_;
     logger_->log_error(
         error->with_prefix("Unexpected error submitting traces: "));
   }
 }
 
+void DatadogAgent::post_probe() {
+  const std::size_t agent = agents_->pick(clock_().tick);
+  // An empty v0.4 array of trace chunks.
+  auto body = std::make_shared<const std::string>(1, '\x90');
+
+  auto set_request_headers = [&](DictWriter& headers) {
+    headers.set("Content-Type", "application/msgpack");
+    headers.set("Datadog-Meta-Lang", "cpp");
+    headers.set("Datadog-Meta-Lang-Version",
+                tracer_signature_.library_language_version);
+    headers.set("Datadog-Meta-Tracer-Version",
+                tracer_signature_.library_version);
+    headers.set("X-Datadog-Trace-Count", "0");
+    if (agentless_) {
+      headers.set("DD-API-KEY", api_key_);
+    }
+  };
+
+  auto on_response = [clock = clock_, agents = agents_, agent,
+                      circuit_breaker = circuit_breaker_, logger = logger_](
+                         int response_status,
+                         const DictReader& /*response_headers*/,
+                         std::string /*response_body*/) {
+    const bool transient = response_status == 408 ||
+                           response_status == 429 || response_status >= 500;
+    const auto now = clock().tick;
+    agents->record(agent, !transient, now);
+    circuit_breaker->record(!transient, /*probe=*/true, now, *logger);
+  };
+
+  auto on_error = [clock = clock_, agents = agents_, agent,
+                   circuit_breaker = circuit_breaker_,
+                   logger = logger_](Error /*error*/) {
+    const auto now = clock().tick;
+    agents->record(agent, false, now);
+    circuit_breaker->record(false, /*probe=*/true, now, *logger);
+  };
+
+  auto post_result = http_client_->post(
+      agents_->agents[agent].traces_endpoint, std::move(set_request_headers),
+      std::move(body), std::move(on_response), std::move(on_error),
+      clock_().tick + request_timeout_);
+  if (!post_result) {
+    // Neither callback will be invoked.
+    circuit_breaker_->record(false, /*probe=*/true, clock_().tick, *logger_);
+  }
+}
+
+void DatadogAgent::flush_stats(bool force) {
+  for (std::string& payload : stats_->flush(clock_().wall, force)) {
+    auto compressed_payload = compress(payload);
+    const bool compressed = bool(compressed_payload);
+    if (compressed_payload) {
+      payload = std::move(*compressed_payload);
+    }
+    auto set_request_headers = [&](DictWriter& headers) {
+      headers.set("Content-Type", "application/msgpack");
+      if (compressed) {
+        headers.set("Content-Encoding", "gzip");
+      }
+      headers.set("Datadog-Meta-Lang", "cpp");
+      headers.set("Datadog-Meta-Lang-Version",
+                  tracer_signature_.library_language_version);
+      headers.set("Datadog-Meta-Tracer-Version",
+                  tracer_signature_.library_version);
+    };
+    auto on_response = [logger = logger_](
+                           int response_status,
+                           const DictReader& /*response_headers*/,
+                           std::string response_body) {
+      if (response_status < 200 || response_status >= 300) {
+        logger->log_error([&](auto& stream) {
+          stream << "Unexpected response status " << response_status
+                 << " in Datadog Agent response to APM stats, with body (if "
+                    "any, starts on next line):\n"
+                 << response_body;
+        });
+      }
+    };
+    auto on_error = [logger = logger_](Error error) {
+      logger->log_error(error.with_prefix(
+          "Error occurred during HTTP request for submitting APM stats: "));
+    };
+    auto post_result = http_client_->post(
+        stats_endpoint_, std::move(set_request_headers), std::move(payload),
+        std::move(on_response), std::move(on_error),
+        clock_().tick + request_timeout_);
+    if (auto* error = post_result.if_error()) {
+      logger_->log_error(
+          error->with_prefix("Unexpected error submitting APM stats: "));
+    }
+  }
+}
+
+Optional<std::string> DatadogAgent::compress(StringView body) {
+  if (!compression_enabled() || body.size() < compression_threshold_bytes_) {
+    return nullopt;
+  }
+  std::string compressed;
+  auto result = gzip_compress(compressed, body);
+  if (auto* error = result.if_error()) {
+    // Send the body uncompressed instead.
+    logger_->log_error(*error);
+    return nullopt;
+  }
+  return compressed;
+}
+
 void DatadogAgent::send_telemetry(StringView request_type,
                                   std::string payload) {
+  if (agentless_) {
+    // Telemetry is proxied by the Datadog Agent, and there is none.
+    return;
+  }
+  auto compressed_payload = compress(payload);
+  const bool compressed = bool(compressed_payload);
+  if (compressed_payload) {
+    payload = std::move(*compressed_payload);
+  }
   auto set_telemetry_headers = [request_type, payload_size = payload.size(),
+                                compressed,
                                 debug_enabled = tracer_telemetry_->debug(),
                                 tracer_signature =
                                     &tracer_signature_](DictWriter& headers) {
@@ -382,6 +2105,9 @@ void DatadogAgent::send_telemetry(StringView request_type,
         Datadog-Container-ID
     */
     headers.set("Content-Type", "application/json");
+    if (compressed) {
+      headers.set("Content-Encoding", "gzip");
+    }
     headers.set("Content-Length", std::to_string(payload_size));
     headers.set("DD-Telemetry-API-Version", "v2");
     headers.set("DD-Client-Library-Language", "cpp");
@@ -422,7 +2148,56 @@ void DatadogAgent::send_app_closing() {
   send_telemetry("app-closing", tracer_telemetry_->app_closing());
 }
 
+void DatadogAgent::poll_remote_configuration() {
+  if (++rc_ticks_since_poll_ < rc_poll_ticks_.load()) {
+    return;
+  }
+  rc_ticks_since_poll_ = 0;
+  get_and_apply_remote_configuration_updates();
+}
+
+void DatadogAgent::adapt_remote_configuration_poll(bool changed) {
+  if (changed) {
+    rc_poll_ticks_.store(1);
+  } else {
+    rc_poll_ticks_.store(
+        std::min(rc_poll_ticks_.load() * 2, rc_max_poll_ticks_));
+  }
+}
+
+void DatadogAgent::apply_remote_configuration(
+    const std::string& response_body) {
+  const auto response_json =
+      nlohmann::json::parse(/* input = */ response_body,
+                            /* parser_callback = */ nullptr,
+                            /* allow_exceptions = */ false);
+  if (response_json.is_discarded()) {
+    logger_->log_error([](auto& stream) {
+      stream << "Could not parse Remote Configuration response body";
+    });
+    return;
+  }
+
+  adapt_remote_configuration_poll(!response_json.empty());
+  if (!response_json.empty()) {
+    remote_config_.process_response(response_json);
+    // NOTE(@dmehala): Not ideal but it mimics the old behavior.
+    // In the future, I would prefer telemetry pushing to the agent
+    // and not the agent pulling from telemetry. That way telemetry will
+    // be more flexible and could support env var to customize how often
+    // it captures metrics.
+    send_configuration_change();
+    if (state_file_) {
+      state_file_->save_remote_config(remote_config_.state_json());
+    }
+  }
+}
+
 void DatadogAgent::get_and_apply_remote_configuration_updates() {
+  // The response handler runs on the HTTP client's thread, which would
+  // otherwise be unable to send or receive anything else while the response
+  // is parsed and the listeners reconfigure the tracer.  So the handler only
+  // checks the status, and schedules the rest.
   auto remote_configuration_on_response =
       [this](int response_status, const DictReader& /*response_headers*/,
              std::string response_body) {
@@ -434,6 +2209,7 @@ void DatadogAgent::get_and_apply_remote_configuration_updates() {
              * feature could be enabled, so the tracer must continuously check
              * for new remote configuration.
              */
+            adapt_remote_configuration_poll(/*changed=*/false);
             return;
           }
 
@@ -447,25 +2223,18 @@ void DatadogAgent::get_and_apply_remote_configuration_updates() {
           return;
         }
 
-        const auto response_json =
-            nlohmann::json::parse(/* input = */ response_body,
-                                  /* parser_callback = */ nullptr,
-                                  /* allow_exceptions = */ false);
-        if (response_json.is_discarded()) {
-          logger_->log_error([](auto& stream) {
-            stream << "Could not parse Remote Configuration response body";
-          });
-          return;
-        }
-
-        if (!response_json.empty()) {
-          remote_config_.process_response(response_json);
-          // NOTE(@dmehala): Not ideal but it mimics the old behavior.
-          // In the future, I would prefer telemetry pushing to the agent
-          // and not the agent pulling from telemetry. That way telemetry will
-          // be more flexible and could support env var to customize how often
-          // it captures metrics.
-          send_configuration_change();
+        auto body = std::make_shared<std::string>(std::move(response_body));
+        const bool scheduled = event_scheduler_->schedule_event(
+            [handle = rc_application_, body]() {
+              std::lock_guard<std::mutex> lock(handle->mutex);
+              if (handle->agent) {
+                handle->agent->apply_remote_configuration(*body);
+              }
+            });
+        if (!scheduled) {
+          // The event scheduler does not support one-off events.
+          std::lock_guard<std::mutex> lock(rc_application_->mutex);
+          apply_remote_configuration(*body);
         }
       };
 
@@ -474,11 +2243,15 @@ void DatadogAgent::get_and_apply_remote_configuration_updates() {
         "Error occurred during HTTP request for Remote Configuration: "));
   };
 
+  std::string request_body;
+  {
+    std::lock_guard<std::mutex> lock(rc_application_->mutex);
+    request_body = remote_config_.make_request_body();
+  }
   auto post_result = http_client_->post(
       remote_configuration_endpoint_, set_content_type_json,
-      remote_config_.make_request_payload().dump(),
-      remote_configuration_on_response, remote_configuration_on_error,
-      clock_().tick + request_timeout_);
+      std::move(request_body), remote_configuration_on_response,
+      remote_configuration_on_error, clock_().tick + request_timeout_);
   if (auto error = post_result.if_error()) {
     logger_->log_error(
         error->with_prefix("Unexpected error while requesting Remote "
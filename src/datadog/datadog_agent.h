@@ -5,51 +5,456 @@
 //
 // `DatadogAgent` is configured by `DatadogAgentConfig`.  See
 // `datadog_agent_config.h`.
+//
+// If `DatadogAgentConfig::agentless_url` is set, then `DatadogAgent` instead
+// sends traces directly to that intake, authenticated by an API key, using the
+// same buffering, batching, and retries.
 
 #include <datadog/clock.h>
 #include <datadog/collector.h>
+#include <datadog/datadog_agent_config.h>
 #include <datadog/event_scheduler.h>
 #include <datadog/http_client.h>
+#include <datadog/lock_statistics.h>
 #include <datadog/telemetry/metrics.h>
 #include <datadog/tracer_signature.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "agent_state_file.h"
+#include "collector_response.h"
 #include "config_manager.h"
+#include "dogstatsd.h"
+#include "flush_controller.h"
 #include "remote_config/remote_config.h"
+#include "span_data.h"
+#include "stats_concentrator.h"
 #include "tracer_telemetry.h"
 
 namespace datadog {
 namespace tracing {
 
-class FinalizedDatadogAgentConfig;
 class Logger;
-struct SpanData;
+class ConfigManager;
 class TraceSampler;
 struct TracerSignature;
+class WorkerPool;
+
+// How much a buffered trace chunk is worth keeping under
+// `BufferOverflowPolicy::DROP_LOWEST_PRIORITY`, from least to most.
+enum class ChunkRank : unsigned char {
+  // The chunk's trace was not sampled.
+  UNSAMPLED,
+  SAMPLED,
+  // The chunk's trace was kept by the user, or the chunk contains an error.
+  IMPORTANT,
+};
 
 class DatadogAgent : public Collector {
- public:
-  struct TraceChunk {
-    std::vector<std::unique_ptr<SpanData>> spans;
-    std::shared_ptr<TraceSampler> response_handler;
+  // Trace chunks are MessagePack encoded as soon as they are `send`-ed, and
+  // accumulate until the next `flush`, which gathers them into a
+  // `PendingChunks`.
+  struct PendingChunks {
+    // The format in which the chunks are encoded.
+    TraceAPIVersion api_version;
+    // The encoded chunks, preceded by `msgpack::fixed_array_header_size`
+    // bytes reserved for the header of the array that will contain them.
+    std::string payload;
+    std::size_t count = 0;
+    // The total number of spans in the chunks.  Used only by
+    // `TraceAPIVersion::V0_5`.
+    std::size_t span_count = 0;
+    // The strings referred to by `payload`.  Used only by
+    // `TraceAPIVersion::V0_5`.
+    StringTable strings;
+    // One HTTP request to the Agent could possibly involve trace chunks from
+    // multiple tracers, and thus multiple trace samplers might need to have
+    // their rates updated. Unlikely, but possible.
+    std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
+
+    explicit PendingChunks(TraceAPIVersion);
+  };
+
+  static constexpr std::size_t num_chunk_ranks = 3;
+
+  // What is remembered about each buffered v0.4 trace chunk, so that chunks
+  // can be chosen for dropping when the buffer is full.
+  struct BufferedChunk {
+    // The size of the chunk's encoding.
+    std::size_t bytes;
+    std::size_t spans;
+    // Whether the chunk's trace was kept by sampling.
+    bool sampled;
+    ChunkRank rank;
+    // Either `TraceAPIVersion::V0_4` or `TraceAPIVersion::V0_7`.
+    TraceAPIVersion api_version;
+  };
+
+  // v0.4 trace chunks are appended to one of several `Shard`s, chosen per
+  // thread, so that threads finishing traces at the same time seldom contend
+  // for the same lock.  `flush` drains every shard.  On a host with several
+  // NUMA nodes, the shards are divided among the nodes, and a thread appends
+  // to a shard of the node on which it is running, so that a shard's memory
+  // is touched, and so allocated, by one node.  Only the copy of the chunks
+  // into a payload, when flushing, crosses nodes.
+  using ShardMutex = TracerMutex<TracerLock::datadog_agent_shard>;
+  struct alignas(64) Shard {
+    ShardMutex mutex;
+    // Encoded chunks, without any array header.
+    std::string payload;
+    // The chunks in `payload`, in the order in which they were appended.
+    std::vector<BufferedChunk> chunks;
+    std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
+    // The most bytes and chunks that `payload` and `chunks` held when
+    // flushed since the last `trim_memory`.
+    std::size_t peak_bytes = 0;
+    std::size_t peak_chunks = 0;
+  };
+  static constexpr std::size_t num_shards = 16;
+
+  // One-off events, such as flushes scheduled early because many trace chunks
+  // accumulated, refer to the `DatadogAgent` through an `AgentHandle` so that
+  // they do nothing once the `DatadogAgent` is being destroyed.  An event
+  // holds `mutex` while it runs, so events of the same handle do not overlap.
+  struct AgentHandle {
+    std::mutex mutex;
+    DatadogAgent* agent;
+  };
+
+  // A request body ready to be sent to the Datadog Agent.  Its chunks still
+  // count against the buffer budget until it is sent.
+  struct Payload {
+    TraceAPIVersion api_version;
+    std::string body;
+    std::size_t count;
+    // The buffer budget used by the chunks in `body`.
+    std::size_t buffered_bytes;
+    std::size_t buffered_spans;
+    std::shared_ptr<const std::unordered_set<std::shared_ptr<TraceSampler>>>
+        samplers;
+    // How many times `body` has been sent already.
+    std::size_t attempts = 0;
+    // Whether chunks were added to `body` by the current `flush`.
+    bool has_new_chunks = false;
+    // The number of spans in `body`, for `FlushReport`.
+    std::size_t spans = 0;
+  };
+
+  // Reports trace requests to `FinalizedDatadogAgentConfig::on_flush`.
+  // Shared with the requests' callbacks, which might outlive the
+  // `DatadogAgent`.
+  struct FlushReporter {
+    const std::function<void(const FlushReport&)> on_flush;
+    // Trace chunks dropped since the last report.
+    std::atomic<std::size_t> dropped_chunks{0};
+
+    explicit FlushReporter(std::function<void(const FlushReport&)> on_flush);
+
+    // Invoke `on_flush` with the specified `report`, after setting its
+    // `dropped_chunks`.
+    void report(FlushReport report);
+  };
+
+  // Trace requests that failed, awaiting another attempt.  Shared with the
+  // requests' callbacks, which might outlive the `DatadogAgent`.
+  struct RetryQueue {
+    struct Retry {
+      Payload payload;
+      // The payload is not sent again until this time.
+      std::chrono::steady_clock::time_point due;
+    };
+
+    const std::size_t max_retries;
+    // The most memory that `retries` and the trace chunks counted by
+    // `buffered_bytes` may occupy together, in bytes.  The `DatadogAgent`
+    // keeps it in step with its `max_buffered_bytes()`.
+    std::atomic<std::size_t> max_bytes;
+    const Clock clock;
+    // Charged for the payloads in `retries`.
+    const std::shared_ptr<MemoryBudget> budget;
+    // The bytes of trace chunks that the `DatadogAgent` is buffering,
+    // including those of payloads taken by `take_due` but not yet sent.
+    const std::shared_ptr<std::atomic<std::size_t>> buffered_bytes;
+    std::mutex mutex;
+    std::vector<Retry> retries;
+    // The size of the payloads in `retries`.  Modified only while `mutex` is
+    // locked, but read without it by `DatadogAgent::reserve`.
+    std::atomic<std::size_t> bytes{0};
+
+    RetryQueue(std::size_t max_retries, std::size_t max_bytes, Clock clock,
+               std::shared_ptr<MemoryBudget> budget,
+               std::shared_ptr<std::atomic<std::size_t>> buffered_bytes);
+    ~RetryQueue();
+
+    // Whether a failed attempt to send the specified `payload` may be
+    // followed by another.
+    bool may_retry(const Payload& payload) const;
+    // Queue the specified `payload`, whose latest attempt failed, to be sent
+    // again after a jittered exponential backoff.  If the payload has been
+    // attempted too many times, or if there is no room for it, then drop it
+    // and log an error using the specified `logger`.
+    void add(Payload&& payload, Logger& logger);
+    // Move the payloads that are due at the specified `now` to the end of the
+    // specified `destination`, oldest first.  Their bytes move from `bytes`
+    // to `buffered_bytes`, and remain charged to `budget`, so that they are
+    // released as buffered chunks are once the payloads are sent.
+    void take_due(std::vector<Payload>& destination,
+                  std::chrono::steady_clock::time_point now);
   };
 
- private:
-  std::mutex mutex_;
+  // The Datadog Agents to which trace requests are sent, and what is known of
+  // their health and sample rates.  Shared with the requests' callbacks,
+  // which might outlive the `DatadogAgent`.
+  struct AgentPool {
+    struct Agent {
+      HTTPClient::URL traces_endpoint;
+      HTTPClient::URL traces_v05_endpoint;
+      HTTPClient::URL traces_v07_endpoint;
+      // The rest are guarded by `AgentPool::mutex`.
+      std::size_t consecutive_failures = 0;
+      // The agent is not sent requests until this time, unless every agent
+      // is unhealthy.
+      std::chrono::steady_clock::time_point unhealthy_until;
+      // The `CollectorResponse::hash_body` of the agent's latest response, and
+      // the sample rates in it.
+      std::uint64_t response_hash = 0;
+      std::unordered_map<std::string, Rate> sample_rate_by_key;
+    };
+
+    // A response slower than this counts as a failure.
+    const std::chrono::steady_clock::duration slow_response;
+    // Not resized after construction, so the endpoints may be read without
+    // locking `mutex`.
+    std::vector<Agent> agents;
+    std::mutex mutex;
+    // The agent after the one most recently picked.
+    std::size_t next = 0;
+
+    explicit AgentPool(const FinalizedDatadogAgentConfig& config);
+
+    // Return the index of the agent to send the next request to, as of the
+    // specified `now`: the next healthy agent in turn, or, if there is none,
+    // the agent that will be healthy soonest.
+    std::size_t pick(std::chrono::steady_clock::time_point now);
+    // Update the health of the specified `agent` according to whether a
+    // request to it `succeeded`, as of the specified `now`.
+    void record(std::size_t agent, bool succeeded,
+                std::chrono::steady_clock::time_point now);
+    // Return whether the specified `body_hash` is that of the latest response
+    // from the specified `agent`.
+    bool has_response(std::size_t agent, std::uint64_t body_hash);
+    // Store the sample rates in the specified `response` from the specified
+    // `agent`, and return the average, for each key, of the latest rates from
+    // every agent that has responded.
+    CollectorResponse merge(std::size_t agent, CollectorResponse&& response);
+  };
+
+  // Whether the Datadog Agent is considered unreachable.  After `threshold`
+  // trace requests in a row fail, the circuit "opens": trace chunks are
+  // dropped without being encoded, and payloads already made stay buffered.
+  // Meanwhile, an empty probe request is sent at intervals that double up to
+  // a limit, and the circuit closes when any trace request succeeds.  Shared
+  // with the requests' callbacks, which might outlive the `DatadogAgent`.
+  struct CircuitBreaker {
+    // Zero if the circuit never opens.
+    const std::size_t threshold;
+    const std::chrono::steady_clock::duration min_probe_interval;
+    std::atomic<bool> open{false};
+    // Trace chunks dropped while the circuit was open.
+    std::atomic<std::size_t> dropped_chunks{0};
+    // Modified only while `mutex` is locked, but may be read without it.
+    std::atomic<std::size_t> consecutive_failures{0};
+    // The rest are guarded by `mutex`.
+    std::mutex mutex;
+    bool probe_in_flight = false;
+    std::chrono::steady_clock::duration probe_interval;
+    std::chrono::steady_clock::time_point next_probe;
+
+    CircuitBreaker(std::size_t threshold,
+                   std::chrono::steady_clock::duration min_probe_interval);
+
+    // Update the circuit according to whether a trace request, or a probe if
+    // `probe` is true, `succeeded`, as of the specified `now`.  Log using the
+    // specified `logger` when the circuit opens or closes.
+    void record(bool succeeded, bool probe,
+                std::chrono::steady_clock::time_point now, Logger& logger);
+    // Return whether the circuit is open and a probe is due as of the
+    // specified `now`.  If so, the probe is considered in flight until it is
+    // `record`ed.
+    bool start_probe(std::chrono::steady_clock::time_point now);
+  };
+
+  // The metrics that `report_health` sends to DogStatsD.  See
+  // `DatadogAgentConfig::health_metrics_enabled`.
+  struct HealthMetrics {
+    // A telemetry counter, and its total as of the previous report.  The
+    // difference is reported as a DogStatsD count.
+    struct Count {
+      telemetry::CounterMetric* counter;
+      DogStatsD::Metric metric;
+      std::uint64_t reported;
+    };
+
+    const std::string url;
+    const std::unique_ptr<DogStatsD> statsd;
+    std::vector<Count> counts;
+    DogStatsD::Metric queue_bytes;
+    DogStatsD::Metric queue_spans;
+    DogStatsD::Metric flush_duration;
+    DogStatsD::Metric payload_bytes;
+    DogStatsD::Metric keep_rate;
+    // Bytes of trace requests sent, and trace chunks sent, and how many of
+    // those were kept by sampling, since the previous report.
+    std::atomic<std::uint64_t> unreported_bytes{0};
+    std::atomic<std::uint64_t> unreported_chunks{0};
+    std::atomic<std::uint64_t> unreported_sampled_chunks{0};
+
+    // Define the metrics, tagged with the service and environment of the
+    // specified `signature`, that are sent by the specified `statsd`, which
+    // was opened with the specified `url`, and that include the counters of
+    // the specified `telemetry`.
+    HealthMetrics(std::string url, std::unique_ptr<DogStatsD> statsd,
+                  TracerTelemetry& telemetry,
+                  const TracerSignature& signature);
+  };
+
+  using Mutex = TracerMutex<TracerLock::datadog_agent>;
+
+  Mutex mutex_;
   std::shared_ptr<TracerTelemetry> tracer_telemetry_;
   Clock clock_;
   std::shared_ptr<Logger> logger_;
-  std::vector<TraceChunk> trace_chunks_;
-  HTTPClient::URL traces_endpoint_;
+  // Null unless `TracerConfig::parallel_finalization_min_spans` is nonzero.
+  // Encodes the spans of large v0.4 and v0.7 chunks concurrently.
+  std::shared_ptr<WorkerPool> workers_;
+  // Null if this object was not created by a `Tracer`.  Otherwise, its
+  // `pipeline_overrides` replace the flush interval, buffer limit, and
+  // compression configured here, while they are present.
+  std::shared_ptr<ConfigManager> config_manager_;
+  // v0.5 trace chunks, and the v0.4 trace chunks being flushed.
+  PendingChunks pending_chunks_;
+  std::array<Shard, num_shards> shards_;
+  // The number of NUMA nodes among which `shards_` are divided.
+  std::size_t numa_nodes_;
+  // The configured trace API version.  `pending_chunks_.api_version` is the
+  // version actually in use, which differs if the Datadog Agent rejected v0.5.
+  // v0.7 chunks are buffered in `shards_`, as are v0.4 chunks.
+  TraceAPIVersion trace_api_version_;
+  // Set by HTTP response handlers when the Datadog Agent does not support the
+  // v0.5 trace API.
+  std::shared_ptr<std::atomic<bool>> trace_api_v05_rejected_;
+  // Set by HTTP response handlers when the Datadog Agent does not support the
+  // v0.7 trace API.
+  std::shared_ptr<std::atomic<bool>> trace_api_v07_rejected_;
+  // The beginning of every v0.7 payload: the map of the tracer's attributes,
+  // ending with the key of the array of chunks and room for its header.
+  std::string v07_payload_header_;
+  // The tags that every v0.7 payload carries for all of its spans.  They
+  // refer to `tracer_signature_`.
+  PayloadTags v07_payload_tags_;
+  // The budget of trace chunks awaiting the next flush, and how much of it is
+  // in use by `shards_` and `pending_chunks_`.
+  std::size_t max_buffered_bytes_;
+  std::size_t max_buffered_spans_;
+  BufferOverflowPolicy buffer_overflow_policy_;
+  // Shared with `retry_queue_`, whose payloads count against the same
+  // budget.
+  const std::shared_ptr<std::atomic<std::size_t>> buffered_bytes_;
+  std::atomic<std::size_t> buffered_spans_{0};
+  // Buffering this many bytes schedules a flush before the next interval.
+  std::size_t flush_threshold_bytes_;
+  // The largest v0.4 request body that `flush` prefers to send.
+  std::size_t max_payload_bytes_;
+  std::shared_ptr<AgentHandle> early_flush_;
+  // Remote configuration responses are applied by one-off events, off the
+  // HTTP client's thread.  `remote_config_` is accessed only while
+  // `rc_application_->mutex` is locked.
+  std::shared_ptr<AgentHandle> rc_application_;
+  // Whether an early flush has been scheduled but has not yet begun.
+  std::atomic<bool> early_flush_scheduled_{false};
+  bool compression_enabled_;
+  std::size_t compression_threshold_bytes_;
+  // Payloads that `flush` did not send because `max_in_flight_requests_`
+  // requests were already in flight, oldest first.  Guarded by `mutex_`.
+  std::vector<Payload> deferred_payloads_;
+  std::size_t max_in_flight_requests_;
+  // The number of trace requests sent but not yet completed.  Shared with
+  // the requests' callbacks, which might outlive this object.
+  std::shared_ptr<std::atomic<std::size_t>> in_flight_requests_;
+  std::shared_ptr<RetryQueue> retry_queue_;
+  // Null unless `FinalizedDatadogAgentConfig::stats_computation_enabled`.
+  std::unique_ptr<StatsConcentrator> stats_;
+  // Trace chunks dropped since the last flush, for logging.
+  std::atomic<std::size_t> dropped_chunks_{0};
+  std::atomic<std::size_t> dropped_bytes_{0};
+  // Trace chunks dropped since the last flush because the tracer's memory
+  // budget was exhausted, for logging.
+  std::atomic<std::size_t> shed_chunks_{0};
+  // Null unless there is an `on_flush` callback.
+  std::shared_ptr<FlushReporter> flush_reporter_;
+  // How long the most recent flush took.
+  std::atomic<std::chrono::steady_clock::duration> last_flush_duration_{
+      std::chrono::steady_clock::duration::zero()};
+  std::shared_ptr<AgentPool> agents_;
+  std::shared_ptr<CircuitBreaker> circuit_breaker_;
+  // Null unless `FinalizedDatadogAgentConfig::health_metrics_enabled` and a
+  // DogStatsD socket could be opened.
+  std::unique_ptr<HealthMetrics> health_;
+  std::chrono::steady_clock::duration health_metrics_interval_;
+  // Zero if memory is not trimmed.  Memory is trimmed by the recurring flush
+  // if `trim_on_flush_`, and otherwise by a recurring event of its own.  It
+  // is in idle mode, so that an idle process is not woken to trim, and when
+  // the flush runs at least as often as memory is trimmed.
+  // `last_memory_trim_` is accessed only by the recurring flush.
+  std::chrono::steady_clock::duration memory_trim_interval_;
+  bool trim_on_flush_ = false;
+  std::chrono::steady_clock::time_point last_memory_trim_;
+  // Whether traces are sent to an intake rather than to a Datadog Agent, and
+  // the API key with which they are sent if so.
+  const bool agentless_;
+  const std::string api_key_;
+  HTTPClient::URL stats_endpoint_;
   HTTPClient::URL telemetry_endpoint_;
   HTTPClient::URL remote_configuration_endpoint_;
   std::shared_ptr<HTTPClient> http_client_;
   std::shared_ptr<EventScheduler> event_scheduler_;
-  std::vector<EventScheduler::Cancel> tasks_;
+  std::vector<EventScheduler::AsyncCancel> tasks_;
+  // In idle mode, the recurring flush is not among `tasks_`.  It is scheduled
+  // by `send` and unscheduled by itself, as needed.  `flush_task_` cancels
+  // it, and is guarded by `idle_mutex_`.  `flush_scheduled_` is true while
+  // the flush is scheduled, and may be read without the lock.
+  const bool idle_mode_;
+  std::mutex idle_mutex_;
+  EventScheduler::AsyncCancel flush_task_;
+  std::atomic<bool> flush_scheduled_{false};
+  std::once_flag started_;
   std::chrono::steady_clock::duration flush_interval_;
+  // When `scheduled_flush` last flushed, or when this object was created.
+  // Used only by `scheduled_flush`.
+  std::chrono::steady_clock::time_point last_scheduled_flush_;
+  // Null unless `FinalizedDatadogAgentConfig::adaptive_flush_enabled`.  If
+  // not null, the recurring flush runs every `flush_period_` and flushes only
+  // when `flush_controller_` says that a flush is due.  Shared with the
+  // requests' callbacks, which report response latencies to it.
+  std::shared_ptr<FlushController> flush_controller_;
+  std::chrono::steady_clock::duration flush_period_;
+  // Whether telemetry is polled by the recurring flush, rather than by a
+  // recurring event of its own.  It is when the flush is always scheduled,
+  // and runs at least as often as telemetry captures metrics.
+  bool telemetry_on_flush_ = false;
+  const bool remote_configuration_enabled_;
+  const std::chrono::steady_clock::duration remote_configuration_poll_interval_;
   // Callbacks for submitting telemetry data
   HTTPClient::ResponseHandler telemetry_on_response_;
   HTTPClient::ErrorHandler telemetry_on_error_;
@@ -57,25 +462,127 @@ class DatadogAgent : public Collector {
   std::chrono::steady_clock::duration shutdown_timeout_;
 
   remote_config::Manager remote_config_;
+  // Null if there is no state file.
+  const std::shared_ptr<AgentStateFile> state_file_;
+  // Remote configuration is queried every `rc_poll_ticks_` ticks of the
+  // recurring poll event.  `rc_poll_ticks_` doubles, up to
+  // `rc_max_poll_ticks_`, with each response that reports no change, and
+  // returns to one when a change arrives.  `rc_ticks_since_poll_` is accessed
+  // only by the poll event.
+  const std::uint64_t rc_max_poll_ticks_;
+  std::atomic<std::uint64_t> rc_poll_ticks_{1};
+  std::uint64_t rc_ticks_since_poll_ = 0;
   TracerSignature tracer_signature_;
 
-  void flush();
+  // Send the buffered trace chunks to the Datadog Agent, as several requests
+  // if necessary.  Unless `ignore_in_flight_limit` is true, requests beyond
+  // `max_in_flight_requests_` are deferred until a later `flush`.
+  void flush(bool ignore_in_flight_limit = false);
+  // Flush, as the recurring flush does: unconditionally, or, if the flush
+  // interval is adaptive, only if a flush is due.  In either case, don't
+  // flush before a flush interval set by remote configuration has elapsed.
+  // Then poll telemetry if `telemetry_on_flush_`.
+  void scheduled_flush();
+  // Return the flush interval, buffer limit, and whether compression is
+  // enabled, as configured or as overridden by remote configuration.
+  std::chrono::steady_clock::duration flush_interval() const;
+  std::size_t max_buffered_bytes() const;
+  bool compression_enabled() const;
+  // Have telemetry capture metrics if they are due, and send a heartbeat if
+  // one is due.
+  void poll_telemetry();
+  // Send the health metrics to DogStatsD.  Called by a recurring event.
+  void report_health();
+  // `trim_memory` if `memory_trim_interval_` has elapsed since the recurring
+  // flush last did.
+  void trim_memory_if_due();
+  // Schedule a flush if the buffered chunks have reached
+  // `flush_threshold_bytes_`, or an eighth of the tracer's memory budget while
+  // at least half of the budget is in use, and a flush is not already
+  // scheduled.
+  void flush_early_if_needed();
+  // In idle mode, schedule the recurring flush if it is not scheduled.
+  void schedule_flush_if_idle();
+  // In idle mode, unschedule the recurring flush if there is nothing left for
+  // it to do.  Called by the recurring flush.
+  void unschedule_flush_if_idle();
+  // Return whether nothing is buffered, deferred, awaiting a retry, or in
+  // flight, and the circuit is closed.
+  bool idle();
+  // Return the shard to which the calling thread appends v0.4 chunks.
+  Shard& shard_for_this_thread();
+  // Claim one of `max_in_flight_requests_`.  Return whether one was free.
+  bool acquire_in_flight_request();
+  // Send the specified `payload` to the Datadog Agent, on behalf of the flush
+  // that began at the specified `flush_start`.  The caller must have
+  // accounted for the request in `in_flight_requests_`.
+  void post_traces(Payload&& payload,
+                   std::chrono::steady_clock::time_point flush_start);
+  // Send an empty trace request to find out whether the Datadog Agent is
+  // reachable again.
+  void post_probe();
+  // Send to the Datadog Agent the APM stats of the buckets that have ended,
+  // or of every bucket if `force` is true.
+  void flush_stats(bool force);
+  // Return the gzip compressed form of the specified `body` if compression is
+  // enabled and `body` is large enough.  Otherwise, return `nullopt`, meaning
+  // that `body` is to be sent uncompressed.
+  Optional<std::string> compress(StringView body);
+  // Switch `pending_chunks_` to `TraceAPIVersion::V0_4` if the Datadog Agent
+  // rejected v0.5, discarding any chunks already encoded as v0.5.  The
+  // behavior is undefined unless `mutex_` is locked.
+  void fall_back_if_v05_rejected();
+  // Claim room in the buffer for the specified `chunk`, and charge it to the
+  // tracer's memory budget.  Return whether there was enough room.
+  bool reserve(const BufferedChunk& chunk);
+  // Return the specified number of `bytes` and `spans` to the buffer, and
+  // release the `bytes` from the tracer's memory budget.
+  void release(std::size_t bytes, std::size_t spans);
+  // Drop buffered v0.4 chunks as permitted by `buffer_overflow_policy_` until
+  // there is room for the specified `chunk`, and then `reserve` that room.
+  // Return whether room was reserved.
+  bool make_room(const BufferedChunk& chunk);
+  // Account for the specified number of dropped `chunks` totaling the
+  // specified number of `bytes`.
+  void record_dropped(std::size_t chunks, std::size_t bytes);
   void send_telemetry(StringView, std::string);
   void send_heartbeat_and_telemetry();
   void send_app_closing();
+  // Query remote configuration if this tick of the poll event is due, as
+  // determined by `rc_poll_ticks_`.
+  void poll_remote_configuration();
+  // Adjust `rc_poll_ticks_` according to whether the most recent response
+  // reported a change.
+  void adapt_remote_configuration_poll(bool changed);
+  // Parse the specified successful Remote Configuration `response_body`, and
+  // apply whatever changed.  The behavior is undefined unless
+  // `rc_application_->mutex` is locked.
+  void apply_remote_configuration(const std::string& response_body);
 
  public:
   DatadogAgent(const FinalizedDatadogAgentConfig&,
                const std::shared_ptr<TracerTelemetry>&,
                const std::shared_ptr<Logger>&, const TracerSignature& id,
                const std::vector<std::shared_ptr<remote_config::Listener>>&
-                   rc_listeners);
+                   rc_listeners,
+               const std::shared_ptr<WorkerPool>& workers = nullptr,
+               const std::shared_ptr<ConfigManager>& config_manager = nullptr);
   ~DatadogAgent();
 
+  // Schedule the recurring flush, telemetry, and remote configuration tasks,
+  // unless they are already scheduled.  The constructor calls `start` unless
+  // `FinalizedDatadogAgentConfig::lazy_start` is true.
+  void start();
+
   Expected<void> send(
       std::vector<std::unique_ptr<SpanData>>&& spans,
       const std::shared_ptr<TraceSampler>& response_handler) override;
 
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const ChunkTags& chunk_tags,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+
   void send_app_started(
       const std::unordered_map<ConfigName, ConfigMetadata>& config_metadata);
 
@@ -83,6 +590,26 @@ class DatadogAgent : public Collector {
 
   void get_and_apply_remote_configuration_updates();
 
+  // Return the sample rates loaded from the state file, or return null if
+  // there are none.  See `DatadogAgentConfig::state_file`.
+  Optional<CollectorResponse> saved_rates() const;
+
+  // Return `Pressure::HIGH` if chunks were dropped since the last flush, if
+  // the buffer is at least three quarters full, if the last flush took at
+  // least `flush_interval()`, or if the Datadog Agent is unreachable.
+  // Otherwise, return `Pressure::ELEVATED` if the buffer is at least half
+  // full, if the last flush took at least half of `flush_interval()`, if the
+  // most recent trace request failed, or if the most requests allowed are in
+  // flight.  Otherwise, return `Pressure::NORMAL`.
+  Pressure pressure() const override;
+
+  // Shrink each buffer of trace chunks whose capacity is more than twice the
+  // most that it held since the previous call, and then, if any buffer was
+  // shrunk, have the allocator return free memory to the operating system.
+  // Return the number of bytes of capacity released by the buffers.  Called
+  // every `FinalizedDatadogAgentConfig::memory_trim_interval`.
+  std::size_t trim_memory();
+
   std::string config() const override;
 };
 
@@ -4,13 +4,59 @@
 #include <algorithm>
 #include <chrono>
 #include <cstddef>
+#include <string>
+#include <tuple>
 
 #include "default_http_client.h"
+#include "gzip.h"
+#include "lazy_http_client.h"
 #include "parse_util.h"
+#include "reactor_event_scheduler.h"
+#include "shared_runtime.h"
+#include "string_util.h"
 #include "threaded_event_scheduler.h"
 
 namespace datadog {
 namespace tracing {
+namespace {
+
+// Return the HTTP client that is used if the user does not specify one and
+// there is no reactor, or return null if there is no default HTTP client.
+std::shared_ptr<HTTPClient> make_default_http_client(
+    const FinalizedDatadogAgentConfig& config,
+    const std::shared_ptr<Logger>& logger) {
+  const Clock& clock = config.clock;
+  const bool http2 = config.http2_enabled;
+  const ThreadFactory& thread_factory = config.thread_factory;
+  if (config.lazy_start && has_default_http_client()) {
+    return std::make_shared<LazyHTTPClient>(
+        [logger, clock, http2, thread_factory,
+         shared = config.shared_runtime_enabled]() {
+          return shared ? shared_http_client(logger, clock, http2,
+                                             thread_factory)
+                        : default_http_client(logger, clock, http2, nullptr,
+                                              thread_factory);
+        });
+  }
+  if (config.shared_runtime_enabled) {
+    return shared_http_client(logger, clock, http2, thread_factory);
+  }
+  return default_http_client(logger, clock, http2, nullptr, thread_factory);
+}
+
+// Return the event scheduler that is used if the user does not specify one
+// and there is no reactor.
+std::shared_ptr<EventScheduler> make_default_event_scheduler(
+    const FinalizedDatadogAgentConfig& config) {
+  if (config.shared_runtime_enabled) {
+    return shared_event_scheduler(config.scheduler_workers,
+                                  config.thread_factory);
+  }
+  return std::make_shared<ThreadedEventScheduler>(config.scheduler_workers,
+                                                  config.thread_factory);
+}
+
+}  // namespace
 
 Expected<DatadogAgentConfig> load_datadog_agent_env_config() {
   DatadogAgentConfig env_config;
@@ -30,6 +76,170 @@ Expected<DatadogAgentConfig> load_datadog_agent_env_config() {
     env_config.remote_configuration_poll_interval_seconds = *res;
   }
 
+  if (auto raw_rc_max_poll_interval_value =
+          lookup(environment::DD_REMOTE_CONFIG_MAX_POLL_INTERVAL_SECONDS)) {
+    auto res = parse_double(*raw_rc_max_poll_interval_value);
+    if (auto error = res.if_error()) {
+      return error->with_prefix(
+          "DatadogAgent: Remote Configuration maximum poll interval error ");
+    }
+
+    env_config.remote_configuration_max_poll_interval_seconds = *res;
+  }
+
+  if (auto trace_api_version = lookup(environment::DD_TRACE_API_VERSION)) {
+    env_config.trace_api_version = std::string{*trace_api_version};
+  }
+
+  if (auto raw_max_bytes =
+          lookup(environment::DD_TRACE_WRITER_BUFFER_SIZE_BYTES)) {
+    auto res = parse_uint64(*raw_max_bytes, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix("DatadogAgent: Buffer size in bytes error ");
+    }
+    env_config.max_buffered_bytes = *res;
+  }
+
+  if (auto raw_max_spans =
+          lookup(environment::DD_TRACE_WRITER_BUFFER_SIZE_SPANS)) {
+    auto res = parse_uint64(*raw_max_spans, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix("DatadogAgent: Buffer size in spans error ");
+    }
+    env_config.max_buffered_spans = *res;
+  }
+
+  if (auto policy =
+          lookup(environment::DD_TRACE_WRITER_BUFFER_OVERFLOW_POLICY)) {
+    env_config.buffer_overflow_policy = std::string{*policy};
+  }
+
+  if (auto raw_flush_threshold =
+          lookup(environment::DD_TRACE_WRITER_FLUSH_THRESHOLD_BYTES)) {
+    auto res = parse_uint64(*raw_flush_threshold, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix("DatadogAgent: Flush threshold error ");
+    }
+    env_config.flush_threshold_bytes = *res;
+  }
+
+  if (auto raw_max_payload =
+          lookup(environment::DD_TRACE_WRITER_MAX_PAYLOAD_SIZE_BYTES)) {
+    auto res = parse_uint64(*raw_max_payload, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix("DatadogAgent: Maximum payload size error ");
+    }
+    env_config.max_payload_bytes = *res;
+  }
+
+  if (auto raw_max_in_flight =
+          lookup(environment::DD_TRACE_WRITER_MAX_IN_FLIGHT_REQUESTS)) {
+    auto res = parse_uint64(*raw_max_in_flight, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix(
+          "DatadogAgent: Maximum in-flight requests error ");
+    }
+    env_config.max_in_flight_requests = *res;
+  }
+
+  if (auto raw_scheduler_workers =
+          lookup(environment::DD_TRACE_SCHEDULER_WORKERS)) {
+    auto res = parse_uint64(*raw_scheduler_workers, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix("DatadogAgent: Scheduler workers error ");
+    }
+    env_config.scheduler_workers = *res;
+  }
+
+  if (auto raw_max_retries = lookup(environment::DD_TRACE_WRITER_MAX_RETRIES)) {
+    auto res = parse_uint64(*raw_max_retries, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix("DatadogAgent: Maximum retries error ");
+    }
+    env_config.max_retries = *res;
+  }
+
+  if (auto raw_threshold =
+          lookup(environment::DD_TRACE_WRITER_CIRCUIT_BREAKER_THRESHOLD)) {
+    auto res = parse_uint64(*raw_threshold, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix(
+          "DatadogAgent: Circuit breaker threshold error ");
+    }
+    env_config.circuit_breaker_threshold = *res;
+  }
+
+  if (auto http2_enabled = lookup(environment::DD_TRACE_AGENT_HTTP2_ENABLED)) {
+    env_config.http2_enabled = !falsy(*http2_enabled);
+  }
+
+  if (auto shared_runtime_enabled =
+          lookup(environment::DD_TRACE_SHARED_RUNTIME_ENABLED)) {
+    env_config.shared_runtime_enabled = !falsy(*shared_runtime_enabled);
+  }
+
+  if (auto lazy_start =
+          lookup(environment::DD_TRACE_AGENT_LAZY_START_ENABLED)) {
+    env_config.lazy_start = !falsy(*lazy_start);
+  }
+
+  if (auto idle_mode_enabled =
+          lookup(environment::DD_TRACE_AGENT_IDLE_MODE_ENABLED)) {
+    env_config.idle_mode_enabled = !falsy(*idle_mode_enabled);
+  }
+
+  if (auto adaptive_flush_enabled =
+          lookup(environment::DD_TRACE_AGENT_ADAPTIVE_FLUSH_ENABLED)) {
+    env_config.adaptive_flush_enabled = !falsy(*adaptive_flush_enabled);
+  }
+
+  if (auto state_file = lookup(environment::DD_TRACE_AGENT_STATE_FILE)) {
+    env_config.state_file = std::string{*state_file};
+  }
+
+  if (auto health_metrics_enabled =
+          lookup(environment::DD_TRACE_HEALTH_METRICS_ENABLED)) {
+    env_config.health_metrics_enabled = !falsy(*health_metrics_enabled);
+  }
+
+  if (auto dogstatsd_url = lookup(environment::DD_DOGSTATSD_URL)) {
+    env_config.dogstatsd_url = std::string{*dogstatsd_url};
+  }
+
+  if (auto compression_enabled =
+          lookup(environment::DD_TRACE_WRITER_COMPRESSION_ENABLED)) {
+    env_config.compression_enabled = !falsy(*compression_enabled);
+  }
+
+  if (auto raw_compression_threshold =
+          lookup(environment::DD_TRACE_WRITER_COMPRESSION_THRESHOLD_BYTES)) {
+    auto res = parse_uint64(*raw_compression_threshold, 10);
+    if (auto error = res.if_error()) {
+      return error->with_prefix("DatadogAgent: Compression threshold error ");
+    }
+    env_config.compression_threshold_bytes = *res;
+  }
+
+  if (auto stats_computation_enabled =
+          lookup(environment::DD_TRACE_STATS_COMPUTATION_ENABLED)) {
+    env_config.stats_computation_enabled = !falsy(*stats_computation_enabled);
+  }
+
+  if (auto urls = lookup(environment::DD_TRACE_AGENT_URLS)) {
+    auto& parsed = env_config.trace_agent_urls.emplace();
+    for (const StringView url : parse_list(*urls)) {
+      parsed.emplace_back(url);
+    }
+  }
+
+  if (auto agentless_url = lookup(environment::DD_TRACE_AGENTLESS_URL)) {
+    env_config.agentless_url = std::string{*agentless_url};
+  }
+
+  if (auto api_key = lookup(environment::DD_API_KEY)) {
+    env_config.api_key = std::string{*api_key};
+  }
+
   auto env_host = lookup(environment::DD_AGENT_HOST);
   auto env_port = lookup(environment::DD_TRACE_AGENT_PORT);
 
@@ -50,6 +260,13 @@ Expected<DatadogAgentConfig> load_datadog_agent_env_config() {
 Expected<FinalizedDatadogAgentConfig> finalize_config(
     const DatadogAgentConfig& user_config,
     const std::shared_ptr<Logger>& logger, const Clock& clock) {
+  return finalize_config(user_config, logger, clock, nullptr);
+}
+
+Expected<FinalizedDatadogAgentConfig> finalize_config(
+    const DatadogAgentConfig& user_config,
+    const std::shared_ptr<Logger>& logger, const Clock& clock,
+    const ThreadFactory& thread_factory) {
   Expected<DatadogAgentConfig> env_config = load_datadog_agent_env_config();
   if (auto error = env_config.if_error()) {
     return *error;
@@ -58,9 +275,63 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
   FinalizedDatadogAgentConfig result;
 
   result.clock = clock;
+  result.thread_factory = thread_factory;
+
+  result.http2_enabled =
+      value_or(env_config->http2_enabled, user_config.http2_enabled, false);
 
-  if (!user_config.http_client) {
-    result.http_client = default_http_client(logger, clock);
+  result.shared_runtime_enabled =
+      value_or(env_config->shared_runtime_enabled,
+               user_config.shared_runtime_enabled, false);
+
+  result.lazy_start =
+      value_or(env_config->lazy_start, user_config.lazy_start, false);
+
+  result.idle_mode_enabled = value_or(env_config->idle_mode_enabled,
+                                      user_config.idle_mode_enabled, false);
+
+  result.state_file =
+      value_or(env_config->state_file, user_config.state_file, "");
+
+  result.health_metrics_enabled =
+      value_or(env_config->health_metrics_enabled,
+               user_config.health_metrics_enabled, false);
+  result.dogstatsd_url = value_or(env_config->dogstatsd_url,
+                                  user_config.dogstatsd_url,
+                                  "udp://localhost:8125");
+  if (const double health_metrics_interval_seconds =
+          user_config.health_metrics_interval_seconds.value_or(10.0);
+      health_metrics_interval_seconds > 0.0) {
+    result.health_metrics_interval =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::duration<double>(health_metrics_interval_seconds));
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_HEALTH_METRICS_INTERVAL,
+                 "DatadogAgent: Health metrics interval must be a positive "
+                 "number of seconds."};
+  }
+  if (const double memory_trim_interval_seconds =
+          user_config.memory_trim_interval_seconds.value_or(60.0);
+      memory_trim_interval_seconds >= 0.0) {
+    result.memory_trim_interval =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::duration<double>(memory_trim_interval_seconds));
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_MEMORY_TRIM_INTERVAL,
+                 "DatadogAgent: Memory trim interval must be a nonnegative "
+                 "number of seconds."};
+  }
+
+  result.default_http_client = !user_config.http_client && !user_config.reactor;
+  if (user_config.http_client) {
+    result.http_client = user_config.http_client;
+  } else {
+    if (user_config.reactor) {
+      result.http_client = default_http_client(
+          logger, clock, result.http2_enabled, user_config.reactor);
+    } else {
+      result.http_client = make_default_http_client(result, logger);
+    }
     // `default_http_client` might return a `Curl` instance depending on how
     // this library was built.  If it returns `nullptr`, then there's no
     // built-in default, and so the user must provide a value.
@@ -68,23 +339,30 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
       return Error{Error::DATADOG_AGENT_NULL_HTTP_CLIENT,
                    "DatadogAgent: HTTP client cannot be null."};
     }
-  } else {
-    result.http_client = user_config.http_client;
   }
 
-  if (!user_config.event_scheduler) {
-    result.event_scheduler = std::make_shared<ThreadedEventScheduler>();
-  } else {
+  result.scheduler_workers = value_or(env_config->scheduler_workers,
+                                      user_config.scheduler_workers, 0);
+
+  result.default_event_scheduler =
+      !user_config.event_scheduler && !user_config.reactor;
+  if (user_config.event_scheduler) {
     result.event_scheduler = user_config.event_scheduler;
+  } else if (user_config.reactor) {
+    result.event_scheduler =
+        std::make_shared<ReactorEventScheduler>(user_config.reactor);
+  } else {
+    result.event_scheduler = make_default_event_scheduler(result);
   }
 
   result.remote_configuration_listeners =
       user_config.remote_configuration_listeners;
+  result.on_flush = user_config.on_flush;
 
-  if (auto flush_interval_milliseconds =
-          value_or(env_config->flush_interval_milliseconds,
-                   user_config.flush_interval_milliseconds, 2000);
-      flush_interval_milliseconds > 0) {
+  const auto [flush_interval_origin, flush_interval_milliseconds] =
+      pick(env_config->flush_interval_milliseconds,
+           user_config.flush_interval_milliseconds, 2000);
+  if (flush_interval_milliseconds > 0) {
     result.flush_interval =
         std::chrono::milliseconds(flush_interval_milliseconds);
   } else {
@@ -92,6 +370,43 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
                  "DatadogAgent: Flush interval must be a positive number of "
                  "milliseconds."};
   }
+  result.metadata[ConfigName::FLUSH_INTERVAL] =
+      ConfigMetadata(ConfigName::FLUSH_INTERVAL,
+                     std::to_string(flush_interval_milliseconds),
+                     flush_interval_origin);
+
+  result.adaptive_flush_enabled =
+      value_or(env_config->adaptive_flush_enabled,
+               user_config.adaptive_flush_enabled, false);
+
+  const int min_flush_interval_milliseconds =
+      value_or(env_config->min_flush_interval_milliseconds,
+               user_config.min_flush_interval_milliseconds, 100);
+  const int max_flush_interval_milliseconds =
+      value_or(env_config->max_flush_interval_milliseconds,
+               user_config.max_flush_interval_milliseconds, 10000);
+  if (min_flush_interval_milliseconds <= 0 ||
+      max_flush_interval_milliseconds < min_flush_interval_milliseconds) {
+    return Error{Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL,
+                 "DatadogAgent: Minimum flush interval must be a positive "
+                 "number of milliseconds no greater than the maximum flush "
+                 "interval."};
+  }
+  result.min_flush_interval =
+      std::chrono::milliseconds(min_flush_interval_milliseconds);
+  result.max_flush_interval =
+      std::chrono::milliseconds(max_flush_interval_milliseconds);
+
+  if (const std::size_t flush_target_payload_bytes =
+          value_or(env_config->flush_target_payload_bytes,
+                   user_config.flush_target_payload_bytes, 1024 * 1024);
+      flush_target_payload_bytes > 0) {
+    result.flush_target_payload_bytes = flush_target_payload_bytes;
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_FLUSH_THRESHOLD,
+                 "DatadogAgent: Flush target payload size must be a positive "
+                 "number of bytes."};
+  }
 
   if (auto request_timeout_milliseconds =
           value_or(env_config->request_timeout_milliseconds,
@@ -117,10 +432,10 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
                  "milliseconds."};
   }
 
-  if (double rc_poll_interval_seconds =
-          value_or(env_config->remote_configuration_poll_interval_seconds,
-                   user_config.remote_configuration_poll_interval_seconds, 5.0);
-      rc_poll_interval_seconds >= 0.0) {
+  const double rc_poll_interval_seconds =
+      value_or(env_config->remote_configuration_poll_interval_seconds,
+               user_config.remote_configuration_poll_interval_seconds, 5.0);
+  if (rc_poll_interval_seconds >= 0.0) {
     result.remote_configuration_poll_interval =
         std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::duration<double>(rc_poll_interval_seconds));
@@ -130,10 +445,168 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
                  "positive number of seconds."};
   }
 
+  if (double rc_max_poll_interval_seconds =
+          value_or(env_config->remote_configuration_max_poll_interval_seconds,
+                   user_config.remote_configuration_max_poll_interval_seconds,
+                   rc_poll_interval_seconds);
+      rc_max_poll_interval_seconds >= rc_poll_interval_seconds) {
+    result.remote_configuration_max_poll_interval =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::duration<double>(rc_max_poll_interval_seconds));
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_REMOTE_CONFIG_POLL_INTERVAL,
+                 "DatadogAgent: Remote Configuration maximum poll interval "
+                 "must not be less than the poll interval."};
+  }
+
   result.remote_configuration_enabled =
       value_or(env_config->remote_configuration_enabled,
                user_config.remote_configuration_enabled, true);
 
+  const std::string trace_api_version = value_or(
+      env_config->trace_api_version, user_config.trace_api_version, "v0.4");
+  if (trace_api_version == "v0.4") {
+    result.trace_api_version = TraceAPIVersion::V0_4;
+  } else if (trace_api_version == "v0.5") {
+    result.trace_api_version = TraceAPIVersion::V0_5;
+  } else if (trace_api_version == "v0.7") {
+    result.trace_api_version = TraceAPIVersion::V0_7;
+  } else {
+    std::string message;
+    message += "DatadogAgent: Unsupported trace API version \"";
+    message += trace_api_version;
+    message += "\". Expected one of \"v0.4\", \"v0.5\", or \"v0.7\".";
+    return Error{Error::DATADOG_AGENT_INVALID_TRACE_API_VERSION,
+                 std::move(message)};
+  }
+
+  const auto [max_buffered_bytes_origin, max_buffered_bytes] =
+      pick(env_config->max_buffered_bytes, user_config.max_buffered_bytes,
+           std::size_t(25 * 1024 * 1024));
+  if (max_buffered_bytes > 0) {
+    result.max_buffered_bytes = max_buffered_bytes;
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_MAX_BUFFERED_BYTES,
+                 "DatadogAgent: Buffer size must be a positive number of "
+                 "bytes."};
+  }
+  result.metadata[ConfigName::MAX_BUFFERED_BYTES] =
+      ConfigMetadata(ConfigName::MAX_BUFFERED_BYTES,
+                     std::to_string(max_buffered_bytes),
+                     max_buffered_bytes_origin);
+
+  result.max_buffered_spans =
+      env_config->max_buffered_spans ? env_config->max_buffered_spans
+                                     : user_config.max_buffered_spans;
+  if (result.max_buffered_spans == std::size_t(0)) {
+    return Error{Error::DATADOG_AGENT_INVALID_MAX_BUFFERED_SPANS,
+                 "DatadogAgent: Buffer size must be a positive number of "
+                 "spans."};
+  }
+
+  const std::string buffer_overflow_policy =
+      value_or(env_config->buffer_overflow_policy,
+               user_config.buffer_overflow_policy, "drop_newest");
+  if (buffer_overflow_policy == "drop_newest") {
+    result.buffer_overflow_policy = BufferOverflowPolicy::DROP_NEWEST;
+  } else if (buffer_overflow_policy == "drop_oldest") {
+    result.buffer_overflow_policy = BufferOverflowPolicy::DROP_OLDEST;
+  } else if (buffer_overflow_policy == "drop_unsampled_first") {
+    result.buffer_overflow_policy = BufferOverflowPolicy::DROP_UNSAMPLED_FIRST;
+  } else if (buffer_overflow_policy == "drop_lowest_priority") {
+    result.buffer_overflow_policy = BufferOverflowPolicy::DROP_LOWEST_PRIORITY;
+  } else {
+    std::string message;
+    message += "DatadogAgent: Unsupported buffer overflow policy \"";
+    message += buffer_overflow_policy;
+    message +=
+        "\". Expected one of \"drop_newest\", \"drop_oldest\", "
+        "\"drop_unsampled_first\", or \"drop_lowest_priority\".";
+    return Error{Error::DATADOG_AGENT_INVALID_BUFFER_OVERFLOW_POLICY,
+                 std::move(message)};
+  }
+
+  if (const std::size_t flush_threshold_bytes =
+          value_or(env_config->flush_threshold_bytes,
+                   user_config.flush_threshold_bytes, 4 * 1024 * 1024);
+      flush_threshold_bytes > 0) {
+    result.flush_threshold_bytes = flush_threshold_bytes;
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_FLUSH_THRESHOLD,
+                 "DatadogAgent: Flush threshold must be a positive number of "
+                 "bytes."};
+  }
+
+  if (const std::size_t max_payload_bytes =
+          value_or(env_config->max_payload_bytes, user_config.max_payload_bytes,
+                   8 * 1024 * 1024);
+      max_payload_bytes > 0) {
+    result.max_payload_bytes = max_payload_bytes;
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_MAX_PAYLOAD_SIZE,
+                 "DatadogAgent: Maximum payload size must be a positive number "
+                 "of bytes."};
+  }
+
+  if (const std::size_t max_in_flight_requests =
+          value_or(env_config->max_in_flight_requests,
+                   user_config.max_in_flight_requests, 4);
+      max_in_flight_requests > 0) {
+    result.max_in_flight_requests = max_in_flight_requests;
+  } else {
+    return Error{Error::DATADOG_AGENT_INVALID_MAX_IN_FLIGHT_REQUESTS,
+                 "DatadogAgent: Maximum number of in-flight requests must be "
+                 "positive."};
+  }
+
+  result.max_retries =
+      value_or(env_config->max_retries, user_config.max_retries, 3);
+
+  result.circuit_breaker_threshold =
+      value_or(env_config->circuit_breaker_threshold,
+               user_config.circuit_breaker_threshold, 5);
+
+  if (const auto& agentless_url = env_config->agentless_url
+                                      ? env_config->agentless_url
+                                      : user_config.agentless_url) {
+    auto parsed = HTTPClient::URL::parse(*agentless_url);
+    if (auto* error = parsed.if_error()) {
+      return error->with_prefix("DatadogAgent: Agentless URL error ");
+    }
+    result.api_key = value_or(env_config->api_key, user_config.api_key, "");
+    if (result.api_key.empty()) {
+      return Error{Error::DATADOG_AGENT_MISSING_API_KEY,
+                   "DatadogAgent: An API key is required to send traces "
+                   "without a Datadog Agent.  Set DD_API_KEY."};
+    }
+    result.agentless_url = std::move(*parsed);
+    // The intake offers none of the Datadog Agent's other endpoints.
+    result.remote_configuration_enabled = false;
+    result.trace_api_version = TraceAPIVersion::V0_4;
+  }
+
+  ConfigMetadata::Origin compression_origin;
+  std::tie(compression_origin, result.compression_enabled) =
+      pick(env_config->compression_enabled, user_config.compression_enabled,
+           result.agentless_url && gzip_available());
+  result.metadata[ConfigName::COMPRESSION_ENABLED] =
+      ConfigMetadata(ConfigName::COMPRESSION_ENABLED,
+                     to_string(result.compression_enabled),
+                     compression_origin);
+  if (result.compression_enabled && !gzip_available()) {
+    return Error{Error::DATADOG_AGENT_COMPRESSION_UNAVAILABLE,
+                 "DatadogAgent: Compression cannot be enabled, because this "
+                 "library was built without zlib."};
+  }
+  result.compression_threshold_bytes =
+      value_or(env_config->compression_threshold_bytes,
+               user_config.compression_threshold_bytes, 8 * 1024);
+
+  result.stats_computation_enabled =
+      !result.agentless_url &&
+      value_or(env_config->stats_computation_enabled,
+               user_config.stats_computation_enabled, false);
+
   const auto [origin, url] =
       pick(env_config->url, user_config.url, "http://localhost:8126");
   auto parsed_url = HTTPClient::URL::parse(url);
@@ -144,8 +617,30 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
   result.metadata[ConfigName::AGENT_URL] =
       ConfigMetadata(ConfigName::AGENT_URL, url, origin);
 
+  if (const auto& urls =
+          env_config->trace_agent_urls ? env_config->trace_agent_urls
+                                       : user_config.trace_agent_urls) {
+    for (const auto& trace_agent_url : *urls) {
+      auto parsed = HTTPClient::URL::parse(trace_agent_url);
+      if (auto* error = parsed.if_error()) {
+        return error->with_prefix("DatadogAgent: Trace agent URL error ");
+      }
+      result.trace_agent_urls.push_back(std::move(*parsed));
+    }
+  }
+
   return result;
 }
 
+void renew_default_runtime(FinalizedDatadogAgentConfig& config,
+                           const std::shared_ptr<Logger>& logger) {
+  if (config.default_http_client) {
+    config.http_client = make_default_http_client(config, logger);
+  }
+  if (config.default_event_scheduler) {
+    config.event_scheduler = make_default_event_scheduler(config);
+  }
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,268 @@
+#include "ddsketch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Protocol buffer wire types.
+constexpr std::uint8_t varint = 0;
+constexpr std::uint8_t fixed64 = 1;
+constexpr std::uint8_t length_delimited = 2;
+
+void put_varint(std::string& destination, std::uint64_t value) {
+  while (value >= 0x80) {
+    destination.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  destination.push_back(static_cast<char>(value));
+}
+
+void put_tag(std::string& destination, std::uint32_t field,
+             std::uint8_t wire_type) {
+  put_varint(destination, (field << 3) | wire_type);
+}
+
+// Append the specified `value` as eight little-endian bytes.
+void put_double(std::string& destination, double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  for (int i = 0; i < 8; ++i) {
+    destination.push_back(static_cast<char>(bits & 0xFF));
+    bits >>= 8;
+  }
+}
+
+// Append the specified `field` having the length-delimited `contents`.
+void put_message(std::string& destination, std::uint32_t field,
+                 const std::string& contents) {
+  put_tag(destination, field, length_delimited);
+  put_varint(destination, contents.size());
+  destination += contents;
+}
+
+std::uint32_t zigzag(std::int32_t value) {
+  return (static_cast<std::uint32_t>(value) << 1) ^
+         static_cast<std::uint32_t>(value >> 31);
+}
+
+}  // namespace
+
+DDSketch::DDSketch(double relative_accuracy)
+    : gamma_((1 + relative_accuracy) / (1 - relative_accuracy)),
+      multiplier_(1 / std::log(gamma_)),
+      min_indexable_value_(std::max(
+          std::exp((std::numeric_limits<std::int32_t>::min() + 1) /
+                   multiplier_),
+          DBL_MIN * gamma_)) {
+  assert(relative_accuracy > 0 && relative_accuracy < 1);
+}
+
+std::int32_t DDSketch::index(double value) const {
+  const double index = std::floor(std::log(value) * multiplier_);
+  if (index >= std::numeric_limits<std::int32_t>::max()) {
+    return std::numeric_limits<std::int32_t>::max();
+  }
+  return static_cast<std::int32_t>(index);
+}
+
+void DDSketch::add(double value) {
+  ++count_;
+  if (!(value >= min_indexable_value_)) {
+    ++zero_count_;
+    return;
+  }
+  const std::int32_t i = index(value);
+  if (bins_.empty() || i < offset_ ||
+      std::int64_t(i) >= std::int64_t(offset_) + std::int64_t(bins_.size())) {
+    extend(i, i);
+  }
+  increment(i, 1);
+}
+
+void DDSketch::add(const double* values, std::size_t count) {
+  // The values are indexed a batch at a time.  Computing the indices of a
+  // batch is a loop without dependencies between iterations, which the
+  // compiler can vectorize, and the bins need be extended at most once per
+  // batch.
+  constexpr std::size_t batch_size = 64;
+  constexpr std::int32_t zero = std::numeric_limits<std::int32_t>::min();
+  std::int32_t indices[batch_size];
+  count_ += count;
+  while (count != 0) {
+    const std::size_t size = std::min(count, batch_size);
+    for (std::size_t i = 0; i < size; ++i) {
+      indices[i] = values[i] >= min_indexable_value_ ? index(values[i]) : zero;
+    }
+
+    std::int32_t low = std::numeric_limits<std::int32_t>::max();
+    std::int32_t high = zero;
+    for (std::size_t i = 0; i < size; ++i) {
+      if (indices[i] == zero) {
+        ++zero_count_;
+        continue;
+      }
+      low = std::min(low, indices[i]);
+      high = std::max(high, indices[i]);
+    }
+    if (high != zero) {
+      extend(low, high);
+      for (std::size_t i = 0; i < size; ++i) {
+        if (indices[i] != zero) {
+          increment(indices[i], 1);
+        }
+      }
+    }
+
+    values += size;
+    count -= size;
+  }
+}
+
+void DDSketch::merge(const DDSketch& other) {
+  assert(other.gamma_ == gamma_);
+  count_ += other.count_;
+  zero_count_ += other.zero_count_;
+  if (other.bins_.empty()) {
+    return;
+  }
+  const std::int32_t other_high =
+      other.offset_ + std::int32_t(other.bins_.size()) - 1;
+  extend(other.offset_, other_high);
+  for (std::size_t i = 0; i < other.bins_.size(); ++i) {
+    if (other.bins_[i] != 0) {
+      increment(other.offset_ + std::int32_t(i), other.bins_[i]);
+    }
+  }
+}
+
+void DDSketch::extend(std::int32_t low, std::int32_t high) {
+  std::int64_t new_low = low;
+  std::int64_t new_high = high;
+  if (!bins_.empty()) {
+    new_low = std::min<std::int64_t>(new_low, offset_);
+    new_high = std::max<std::int64_t>(
+        new_high, std::int64_t(offset_) + std::int64_t(bins_.size()) - 1);
+  }
+  // Keep the highest `max_bins` bins.
+  const std::int64_t kept_low =
+      std::max(new_low, new_high - std::int64_t(max_bins) + 1);
+
+  if (bins_.empty()) {
+    offset_ = static_cast<std::int32_t>(kept_low);
+  } else if (kept_low > offset_) {
+    // Merge the bins below `kept_low` into it.
+    const std::size_t dropped =
+        std::min<std::size_t>(bins_.size(), std::size_t(kept_low - offset_));
+    std::uint64_t merged = 0;
+    for (std::size_t i = 0; i < dropped; ++i) {
+      merged += bins_[i];
+    }
+    bins_.erase(bins_.begin(), bins_.begin() + dropped);
+    if (bins_.empty()) {
+      bins_.push_back(0);
+    }
+    bins_.front() += merged;
+    offset_ = static_cast<std::int32_t>(kept_low);
+  } else if (kept_low < offset_) {
+    bins_.insert(bins_.begin(), std::size_t(offset_ - kept_low), 0);
+    offset_ = static_cast<std::int32_t>(kept_low);
+  }
+
+  const std::size_t size = std::size_t(new_high - offset_ + 1);
+  if (size > bins_.size()) {
+    bins_.resize(size, 0);
+  }
+}
+
+void DDSketch::increment(std::int32_t index, std::uint64_t count) {
+  // An index below the lowest bin is one whose bin was merged into it.
+  bins_[std::size_t(std::max(index, offset_) - offset_)] += count;
+}
+
+std::uint64_t DDSketch::count() const { return count_; }
+
+double DDSketch::relative_accuracy() const {
+  return (gamma_ - 1) / (gamma_ + 1);
+}
+
+double DDSketch::quantile(double q) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  const double rank = std::min(std::max(q, 0.0), 1.0) * double(count_ - 1);
+  double seen = double(zero_count_);
+  if (rank < seen) {
+    return 0;
+  }
+  std::size_t i = 0;
+  for (; i + 1 < bins_.size(); ++i) {
+    seen += double(bins_[i]);
+    if (rank < seen) {
+      break;
+    }
+  }
+  return std::pow(gamma_, double(offset_) + double(i)) *
+         (1 + relative_accuracy());
+}
+
+double DDSketch::representative(double value) const {
+  if (!(value >= min_indexable_value_)) {
+    return 0;
+  }
+  return std::pow(gamma_, index(value)) * (1 + relative_accuracy());
+}
+
+void DDSketch::encode(std::string& destination) const {
+  // message DDSketch {
+  //   IndexMapping mapping = 1;
+  //   Store positiveValues = 2;
+  //   Store negativeValues = 3;
+  //   double zeroCount = 4;
+  // }
+  // Fields having their default value are omitted.
+  std::string message;
+
+  // message IndexMapping {
+  //   double gamma = 1;
+  //   double indexOffset = 2;
+  //   Interpolation interpolation = 3;
+  // }
+  put_tag(message, 1, fixed64);
+  put_double(message, gamma_);
+  put_message(destination, 1, message);
+
+  if (!bins_.empty()) {
+    // message Store {
+    //   map<sint32, double> binCounts = 1;
+    //   repeated double contiguousBinCounts = 2 [packed = true];
+    //   sint32 contiguousBinIndexOffset = 3;
+    // }
+    std::string counts;
+    counts.reserve(bins_.size() * sizeof(double));
+    for (const std::uint64_t count : bins_) {
+      put_double(counts, double(count));
+    }
+    message.clear();
+    put_message(message, 2, counts);
+    if (offset_ != 0) {
+      put_tag(message, 3, varint);
+      put_varint(message, zigzag(offset_));
+    }
+    put_message(destination, 2, message);
+  }
+
+  if (zero_count_ != 0) {
+    put_tag(destination, 4, fixed64);
+    put_double(destination, double(zero_count_));
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
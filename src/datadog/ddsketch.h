@@ -0,0 +1,100 @@
+#pragma once
+
+// This component provides a `class`, `DDSketch`, that summarizes a
+// distribution of positive values, such as span durations, with bounded
+// relative error.
+//
+// A value `x` is counted in the bin having index `floor(log(x) / log(gamma))`,
+// where `gamma = (1 + a) / (1 - a)` for a relative accuracy `a`.  Every value
+// in a bin is within `a` of the bin's representative value, so any quantile
+// read back from the sketch is within `a` of the true quantile.  Values too
+// small to be indexed, including zero, are counted separately.
+//
+// The bins are stored densely, from the lowest index in use to the highest.
+// A sketch spans at most `max_bins` bins.  When a value would widen it beyond
+// that, the lowest bins are merged ("collapsed"), which sacrifices the
+// accuracy of the lowest quantiles rather than of the highest, which matter
+// more for latency.  With the default accuracy, `max_bins` covers a ratio of
+// about 10^17 between the smallest and largest values, so collapsing is rare.
+//
+// Sketches having the same relative accuracy can be merged, e.g. to combine
+// sketches computed on different threads.
+//
+// A sketch is serialized as the protocol buffer message `DDSketch` of the
+// [sketches-go][1] library, which is what the Datadog Agent expects, e.g. in
+// the client-side computation of APM stats (see `stats_concentrator.h`).  That
+// encoding is embedded in MessagePack as a "bin" value.
+//
+// [1]: https://github.com/DataDog/sketches-go
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+class DDSketch {
+  double gamma_;
+  // `1 / log(gamma_)`
+  double multiplier_;
+  // Values smaller than this are counted in `zero_count_`.
+  double min_indexable_value_;
+  // `bins_[i]` is the count of the bin having index `offset_ + i`.
+  std::vector<std::uint64_t> bins_;
+  std::int32_t offset_ = 0;
+  std::uint64_t zero_count_ = 0;
+  std::uint64_t count_ = 0;
+
+ public:
+  // The relative accuracy used when none is specified.
+  static constexpr double default_relative_accuracy = 0.01;
+  // The most bins that a sketch spans.
+  static constexpr std::size_t max_bins = 2048;
+
+  explicit DDSketch(double relative_accuracy = default_relative_accuracy);
+
+  // Count the specified `value`.  Negative values are counted as zero.
+  void add(double value);
+  // Count each of the specified `count` values beginning at the specified
+  // `values`.  This is faster than adding the values one at a time.
+  void add(const double* values, std::size_t count);
+
+  // Add the values counted by the specified `other` to this sketch.  The
+  // behavior is undefined unless `other` has the same relative accuracy as
+  // this sketch.
+  void merge(const DDSketch& other);
+
+  // Return the number of values added.
+  std::uint64_t count() const;
+
+  // Return an estimate of the specified quantile `q` of the values added,
+  // where `q` is between 0 and 1.  Return zero if no values have been added.
+  double quantile(double q) const;
+
+  // Return an upper bound on the relative error of a quantile read back
+  // from this sketch, i.e. on `|estimate - actual| / actual`.
+  double relative_accuracy() const;
+
+  // Return the representative value of the bin containing the specified
+  // `value`, i.e. the value that a quantile falling in that bin is estimated
+  // as.  Return zero if `value` is too small to be indexed.
+  double representative(double value) const;
+
+  // Append to the specified `destination` the protocol buffer encoding of
+  // this sketch.
+  void encode(std::string& destination) const;
+
+ private:
+  std::int32_t index(double value) const;
+  // Widen `bins_` to span the indices from the specified `low` through the
+  // specified `high`, collapsing the lowest bins to stay within `max_bins`.
+  void extend(std::int32_t low, std::int32_t high);
+  // Add the specified `count` to the bin having the specified `index`, or to
+  // the lowest bin if `index` is below it.
+  void increment(std::int32_t index, std::uint64_t count);
+};
+
+}  // namespace tracing
+}  // namespace datadog
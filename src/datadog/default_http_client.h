@@ -1,13 +1,34 @@
 #pragma once
 
-// This component defines a function, `default_http_client`, that returns either
-// a `Curl` instance or `nullptr` depending on whether libcurl was included in
-// the build.
+// This component defines a function, `default_http_client`, that returns a
+// `Curl` instance, a `SocketHTTPClient` instance, a `WinHTTPClient` instance,
+// or `nullptr`, depending on the `DD_TRACE_TRANSPORT` that the library was
+// built with.
 //
-// `default_http_client` is implemented in either `default_http_client_curl.cpp`
-// or `default_http_client_null.cpp`.
+// `default_http_client` is implemented in one of
+// `default_http_client_curl.cpp`, `default_http_client_socket.cpp`,
+// `default_http_client_io_uring.cpp`, `default_http_client_winhttp.cpp`, or
+// `default_http_client_null.cpp`.  The "io_uring" transport is a
+// `SocketHTTPClient` that does its socket I/O through an io_uring, and is
+// available only on Linux.  The "winhttp" transport is available only on
+// Windows.
+//
+// If `http2` is true and the returned client is a `Curl` instance, then the
+// client negotiates HTTP/2 and multiplexes requests over shared connections.
+// Other clients ignore `http2`.
+//
+// If `reactor` is not null and the returned client is a `Curl` instance, then
+// the client is driven by the application's event loop instead of by a thread
+// of its own.  See `reactor.h`.  Other clients ignore `reactor`.
+//
+// The client starts its thread, if it has one, using `thread_factory`, if it
+// is not null.  See `thread_factory.h`.
+//
+// `has_default_http_client` returns whether `default_http_client` returns a
+// client rather than `nullptr`, without creating one.
 
 #include <datadog/clock.h>
+#include <datadog/thread_factory.h>
 
 #include <memory>
 
@@ -16,9 +37,14 @@ namespace tracing {
 
 class HTTPClient;
 class Logger;
+class Reactor;
 
 std::shared_ptr<HTTPClient> default_http_client(
-    const std::shared_ptr<Logger>& logger, const Clock& clock);
+    const std::shared_ptr<Logger>& logger, const Clock& clock, bool http2,
+    const std::shared_ptr<Reactor>& reactor = nullptr,
+    const ThreadFactory& thread_factory = nullptr);
+
+bool has_default_http_client();
 
 }  // namespace tracing
 }  // namespace datadog
@@ -12,9 +12,17 @@ namespace datadog {
 namespace tracing {
 
 std::shared_ptr<HTTPClient> default_http_client(
-    const std::shared_ptr<Logger>& logger, const Clock& clock) {
-  return std::make_shared<Curl>(logger, clock);
+    const std::shared_ptr<Logger>& logger, const Clock& clock, bool http2,
+    const std::shared_ptr<Reactor>& reactor,
+    const ThreadFactory& thread_factory) {
+  Curl::Options options;
+  options.http2 = http2;
+  options.reactor = reactor;
+  options.thread_factory = thread_factory;
+  return std::make_shared<Curl>(logger, clock, options);
 }
 
+bool has_default_http_client() { return true; }
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,25 @@
+#include "default_http_client.h"
+#include "socket_http_client.h"
+
+// This file is included in the build when `DD_TRACE_TRANSPORT` is "io_uring".
+// It provides an implementation of `default_http_client` that returns a
+// `SocketHTTPClient` instance that does its socket I/O through an io_uring.
+// As with the "socket" transport, the `http2` and `reactor` options are
+// ignored.
+
+namespace datadog {
+namespace tracing {
+
+std::shared_ptr<HTTPClient> default_http_client(
+    const std::shared_ptr<Logger>& logger, const Clock& clock, bool,
+    const std::shared_ptr<Reactor>&, const ThreadFactory& thread_factory) {
+  SocketHTTPClient::Options options;
+  options.io_uring = true;
+  options.thread_factory = thread_factory;
+  return std::make_shared<SocketHTTPClient>(logger, clock, options);
+}
+
+bool has_default_http_client() { return true; }
+
+}  // namespace tracing
+}  // namespace datadog
@@ -9,10 +9,13 @@
 namespace datadog {
 namespace tracing {
 
-std::shared_ptr<HTTPClient> default_http_client(const std::shared_ptr<Logger> &,
-                                                const Clock &) {
+std::shared_ptr<HTTPClient> default_http_client(
+    const std::shared_ptr<Logger> &, const Clock &, bool,
+    const std::shared_ptr<Reactor> &, const ThreadFactory &) {
   return nullptr;
 }
 
+bool has_default_http_client() { return false; }
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,26 @@
+#include "default_http_client.h"
+#include "socket_http_client.h"
+
+// This file is included in the build when `DD_TRACE_TRANSPORT` is "socket".
+// It provides an implementation of `default_http_client` that returns a
+// `SocketHTTPClient` instance, which talks to the Datadog Agent without
+// libcurl.
+// `SocketHTTPClient` speaks only HTTP/1.1, and so the `http2` option is
+// ignored, and so is the `reactor` option: `SocketHTTPClient` always runs a
+// thread of its own.
+
+namespace datadog {
+namespace tracing {
+
+std::shared_ptr<HTTPClient> default_http_client(
+    const std::shared_ptr<Logger>& logger, const Clock& clock, bool,
+    const std::shared_ptr<Reactor>&, const ThreadFactory& thread_factory) {
+  SocketHTTPClient::Options options;
+  options.thread_factory = thread_factory;
+  return std::make_shared<SocketHTTPClient>(logger, clock, options);
+}
+
+bool has_default_http_client() { return true; }
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,23 @@
+#include "default_http_client.h"
+#include "winhttp_client.h"
+
+// This file is included in the build when `DD_TRACE_TRANSPORT` is "winhttp".
+// It provides an implementation of `default_http_client` that returns a
+// `WinHTTPClient` instance, which talks to the Datadog Agent without libcurl.
+// `WinHTTPClient` is driven by WinHTTP's own thread pool, and so the
+// `reactor` and `thread_factory` options are ignored, and so is the `http2`
+// option.
+
+namespace datadog {
+namespace tracing {
+
+std::shared_ptr<HTTPClient> default_http_client(
+    const std::shared_ptr<Logger>& logger, const Clock& clock, bool,
+    const std::shared_ptr<Reactor>&, const ThreadFactory&) {
+  return std::make_shared<WinHTTPClient>(logger, clock);
+}
+
+bool has_default_http_client() { return true; }
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,192 @@
+#include "dogstatsd.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "string_util.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// The usual limits of DogStatsD clients: a UDP datagram that fits in an
+// Ethernet frame, and the Datadog Agent's default buffer for Unix domain
+// socket datagrams.
+constexpr std::size_t max_udp_datagram_bytes = 1432;
+constexpr std::size_t max_unix_datagram_bytes = 8192;
+
+Error invalid_url(StringView url) {
+  std::string message;
+  message += "Invalid DogStatsD URL \"";
+  append(message, url);
+  message +=
+      "\".  Expected \"udp://<host>:<port>\" or \"unix://<path>\".";
+  return Error{Error::DOGSTATSD_INVALID_URL, std::move(message)};
+}
+
+}  // namespace
+
+#ifndef _WIN32
+
+struct DogStatsD::Address {
+  sockaddr_storage storage;
+  socklen_t size;
+};
+
+DogStatsD::DogStatsD(int socket, std::unique_ptr<Address> address,
+                     std::size_t max_datagram_bytes)
+    : socket_(socket),
+      address_(std::move(address)),
+      max_datagram_bytes_(max_datagram_bytes) {
+  batch_.reserve(max_datagram_bytes_);
+}
+
+DogStatsD::~DogStatsD() { ::close(socket_); }
+
+Expected<std::unique_ptr<DogStatsD>> DogStatsD::open(StringView url) {
+  auto address = std::make_unique<Address>();
+  std::memset(&address->storage, 0, sizeof address->storage);
+  std::size_t max_datagram_bytes;
+
+  if (starts_with(url, "unix://")) {
+    const StringView path = url.substr(7);
+    sockaddr_un unix_address{};
+    if (path.empty() || path.size() >= sizeof unix_address.sun_path) {
+      return invalid_url(url);
+    }
+    unix_address.sun_family = AF_UNIX;
+    std::memcpy(unix_address.sun_path, path.data(), path.size());
+    std::memcpy(&address->storage, &unix_address, sizeof unix_address);
+    address->size = sizeof unix_address;
+    max_datagram_bytes = max_unix_datagram_bytes;
+  } else if (starts_with(url, "udp://")) {
+    // The authority is "host:port" or "[ipv6]:port".
+    const StringView authority = url.substr(6);
+    const auto colon = authority.rfind(':');
+    if (colon == StringView::npos || colon == 0 ||
+        colon + 1 == authority.size()) {
+      return invalid_url(url);
+    }
+    StringView host = authority.substr(0, colon);
+    if (starts_with(host, "[") && host.back() == ']') {
+      host = host.substr(1, host.size() - 2);
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* addresses = nullptr;
+    const std::string host_string(host);
+    const std::string port_string(authority.substr(colon + 1));
+    const int rc = ::getaddrinfo(host_string.c_str(), port_string.c_str(),
+                                 &hints, &addresses);
+    if (rc != 0) {
+      std::string message;
+      message += "Unable to resolve DogStatsD host \"";
+      message += host_string;
+      message += "\": ";
+      message += ::gai_strerror(rc);
+      return Error{Error::DOGSTATSD_SOCKET_FAILED, std::move(message)};
+    }
+    std::memcpy(&address->storage, addresses->ai_addr,
+                addresses->ai_addrlen);
+    address->size = addresses->ai_addrlen;
+    ::freeaddrinfo(addresses);
+    max_datagram_bytes = max_udp_datagram_bytes;
+  } else {
+    return invalid_url(url);
+  }
+
+  const int fd = ::socket(address->storage.ss_family, SOCK_DGRAM, 0);
+  if (fd == -1) {
+    std::string message;
+    message += "Unable to open a socket for DogStatsD: ";
+    message += std::strerror(errno);
+    return Error{Error::DOGSTATSD_SOCKET_FAILED, std::move(message)};
+  }
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  return std::unique_ptr<DogStatsD>(
+      new DogStatsD(fd, std::move(address), max_datagram_bytes));
+}
+
+void DogStatsD::send() {
+  if (batch_.empty()) {
+    return;
+  }
+  // The batch ends with a newline, which is not sent.
+  const ssize_t rc = ::sendto(
+      socket_, batch_.data(), batch_.size() - 1, 0,
+      reinterpret_cast<const sockaddr*>(&address_->storage), address_->size);
+  if (rc == -1) {
+    ++dropped_datagrams_;
+  }
+  batch_.clear();
+}
+
+#else  // _WIN32
+
+struct DogStatsD::Address {};
+
+DogStatsD::DogStatsD(int socket, std::unique_ptr<Address> address,
+                     std::size_t max_datagram_bytes)
+    : socket_(socket),
+      address_(std::move(address)),
+      max_datagram_bytes_(max_datagram_bytes) {}
+
+DogStatsD::~DogStatsD() = default;
+
+Expected<std::unique_ptr<DogStatsD>> DogStatsD::open(StringView) {
+  return Error{Error::DOGSTATSD_SOCKET_FAILED,
+               "DogStatsD is not supported on Windows."};
+}
+
+void DogStatsD::send() { batch_.clear(); }
+
+#endif  // _WIN32
+
+DogStatsD::Metric DogStatsD::define(StringView name, Type type,
+                                    const std::vector<std::string>& tags) {
+  Line line;
+  append(line.before_value, name);
+  line.before_value += ':';
+  line.after_value += type == Type::COUNT ? "|c" : "|g";
+  const char* separator = "|#";
+  for (const std::string& tag : tags) {
+    line.after_value += separator;
+    line.after_value += tag;
+    separator = ",";
+  }
+  line.after_value += '\n';
+  lines_.push_back(std::move(line));
+  return lines_.size() - 1;
+}
+
+void DogStatsD::add(Metric metric, double value) {
+  const Line& line = lines_[metric];
+  char formatted[32];
+  const int length = std::snprintf(formatted, sizeof formatted, "%.15g", value);
+  const std::size_t size =
+      line.before_value.size() + length + line.after_value.size();
+  // The final newline of a batch is not sent, so it need not fit.
+  if (batch_.size() + size - 1 > max_datagram_bytes_) {
+    send();
+  }
+  batch_ += line.before_value;
+  batch_.append(formatted, length);
+  batch_ += line.after_value;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,85 @@
+#pragma once
+
+// This component provides a `class`, `DogStatsD`, that sends metrics to a
+// DogStatsD server, such as the one in the Datadog Agent, over UDP or a Unix
+// domain datagram socket.  `DatadogAgent` uses it to report the health of the
+// trace pipeline.  See `DatadogAgentConfig::health_metrics_enabled`.
+//
+// Metrics are `define`d once, and each metric's line is formatted then, but
+// for its value: "<name>:" before the value, and "|<type>|#<tags>" after.
+// `add` appends a value to the batch, between its metric's two parts, and
+// `send` sends the batch as one datagram.  If a line would make the batch
+// larger than a datagram may be, then `add` sends the batch first.
+//
+// The socket is non-blocking.  A datagram that cannot be sent at once, e.g.
+// because the socket's buffer is full, or because no server is listening on
+// the Unix domain socket, is dropped rather than waited for, and is counted
+// in `dropped_datagrams`.
+//
+// DogStatsD is not supported on Windows, where `open` returns an error.
+
+#include <datadog/expected.h>
+#include <datadog/string_view.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+class DogStatsD {
+ public:
+  enum class Type { COUNT, GAUGE };
+  // Identifies a metric returned by `define`.
+  using Metric = std::size_t;
+
+ private:
+  struct Line {
+    std::string before_value;
+    std::string after_value;
+  };
+
+  struct Address;
+
+  int socket_;
+  std::unique_ptr<Address> address_;
+  std::size_t max_datagram_bytes_;
+  std::vector<Line> lines_;
+  std::string batch_;
+  std::size_t dropped_datagrams_ = 0;
+
+  DogStatsD(int socket, std::unique_ptr<Address> address,
+            std::size_t max_datagram_bytes);
+
+ public:
+  // Return a `DogStatsD` that sends to the server at the specified `url`,
+  // which is either "udp://<host>:<port>" or "unix://<path>", or return an
+  // error if the URL is invalid or a socket cannot be opened.  The host of a
+  // UDP URL is resolved once, here.
+  static Expected<std::unique_ptr<DogStatsD>> open(StringView url);
+
+  ~DogStatsD();
+
+  DogStatsD(const DogStatsD&) = delete;
+  DogStatsD& operator=(const DogStatsD&) = delete;
+
+  // Return the metric having the specified `name`, `type`, and `tags`.
+  Metric define(StringView name, Type type,
+                const std::vector<std::string>& tags);
+
+  // Append to the batch a line reporting the specified `value` of the
+  // specified `metric`.
+  void add(Metric metric, double value);
+  // Send the batch, if it is not empty, and clear it.
+  void send();
+
+  // Return the number of datagrams that could not be sent.
+  std::size_t dropped_datagrams() const { return dropped_datagrams_; }
+  // Return the largest datagram that this object sends, in bytes.
+  std::size_t max_datagram_bytes() const { return max_datagram_bytes_; }
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -20,6 +20,11 @@ struct ExtractedData {
   Optional<std::uint64_t> parent_id;
   Optional<std::string> origin;
   std::vector<std::pair<std::string, std::string>> trace_tags;
+  // The "x-datadog-tags" header value from which `trace_tags` were decoded,
+  // if encoding `trace_tags` would reproduce it exactly, i.e. if every tag in
+  // it was kept.  Otherwise, `raw_trace_tags` is null.  See
+  // `TraceSegment::extracted_trace_tags_`.
+  Optional<std::string> raw_trace_tags;
   bool delegate_sampling_decision = false;
   Optional<int> sampling_priority;
   // If this `ExtractedData` was created on account of `PropagationStyle::W3C`,
@@ -42,10 +47,12 @@ struct ExtractedData {
   // `style` is the extraction style used to obtain this `ExtractedData`. It's
   // for diagnostics.
   Optional<PropagationStyle> style;
-  // `headers_examined` are the name/value pairs of HTTP headers (or equivalent
-  // request meta-data) that were looked up and had values during the
-  // preparation of this `ExtractedData`. It's for diagnostics.
-  std::vector<std::pair<std::string, std::string>> headers_examined;
+  // If this `ExtractedData` was merged with the `ExtractedData` of another
+  // style, then `merged_style` is that other style.  It's for diagnostics.
+  // Headers examined are not recorded during extraction.  Instead, when a
+  // diagnostic is needed, `headers_examined` in `extraction_util.h` repeats
+  // extraction in `style` and `merged_style` to find them.
+  Optional<PropagationStyle> merged_style;
 };
 
 }  // namespace tracing
@@ -3,10 +3,11 @@
 #include <datadog/logger.h>
 
 #include <algorithm>
+#include <cassert>
 #include <cstdint>
+#include <iterator>
 #include <sstream>
 #include <string>
-#include <unordered_map>
 
 #include "extracted_data.h"
 #include "hex.h"
@@ -14,6 +15,7 @@
 #include "string_util.h"
 #include "tag_propagation.h"
 #include "tags.h"
+#include "w3c_propagation.h"
 
 namespace datadog {
 namespace tracing {
@@ -24,26 +26,29 @@ namespace {
 // to the specified `span_tags` and log a diagnostic using the specified
 // `logger`.
 void handle_trace_tags(StringView trace_tags, ExtractedData& result,
-                       std::unordered_map<std::string, std::string>& span_tags,
+                       FlatMap<std::string>& span_tags,
                        Logger& logger) {
-  auto maybe_trace_tags = decode_tags(trace_tags);
-  if (auto* error = maybe_trace_tags.if_error()) {
-    logger.log_error(*error);
-    span_tags[tags::internal::propagation_error] = "decoding_error";
-    return;
-  }
-
-  for (auto& [key, value] : *maybe_trace_tags) {
+  // Only the propagated ("_dd.p.") tags are kept, so decode views into
+  // `trace_tags` and copy only those.  If every tag is kept, and nothing but
+  // the tags and their separators is in `trace_tags`, then `trace_tags` is
+  // also kept, to be injected as is.
+  bool verbatim = true;
+  std::size_t encoded_size = 0;
+  auto decoded = visit_tags(trace_tags, [&](StringView key, StringView value) {
     if (!starts_with(key, "_dd.p.")) {
-      continue;
+      verbatim = false;
+      return;
     }
 
     if (key == tags::internal::trace_id_high) {
       // _dd.p.tid contains the high 64 bits of the trace ID.
       const Optional<std::uint64_t> high = parse_trace_id_high(value);
       if (!high) {
-        span_tags[tags::internal::propagation_error] = "malformed_tid " + value;
-        continue;
+        std::string message = "malformed_tid ";
+        append(message, value);
+        span_tags[tags::internal::propagation_error] = std::move(message);
+        verbatim = false;
+        return;
       }
 
       if (result.trace_id) {
@@ -53,7 +58,15 @@ void handle_trace_tags(StringView trace_tags, ExtractedData& result,
       }
     }
 
-    result.trace_tags.emplace_back(std::move(key), std::move(value));
+    result.trace_tags.emplace_back(std::string(key), std::string(value));
+    encoded_size += (encoded_size != 0) + key.size() + 1 + value.size();
+  });
+  if (auto* error = decoded.if_error()) {
+    logger.log_error(*error);
+    span_tags[tags::internal::propagation_error] = "decoding_error";
+  } else if (verbatim && encoded_size == trace_tags.size() &&
+             encoded_size != 0) {
+    result.raw_trace_tags = std::string(trace_tags);
   }
 }
 
@@ -93,7 +106,7 @@ Expected<Optional<std::uint64_t>> extract_id_header(const DictReader& headers,
 
 }  // namespace
 
-Optional<std::uint64_t> parse_trace_id_high(const std::string& value) {
+Optional<std::uint64_t> parse_trace_id_high(StringView value) {
   if (value.size() != 16) {
     return nullopt;
   }
@@ -108,7 +121,7 @@ Optional<std::uint64_t> parse_trace_id_high(const std::string& value) {
 
 Expected<ExtractedData> extract_datadog(
     const DictReader& headers,
-    std::unordered_map<std::string, std::string>& span_tags, Logger& logger) {
+    FlatMap<std::string>& span_tags, Logger& logger) {
   ExtractedData result;
   result.style = PropagationStyle::DATADOG;
 
@@ -162,7 +175,7 @@ Expected<ExtractedData> extract_datadog(
 }
 
 Expected<ExtractedData> extract_b3(
-    const DictReader& headers, std::unordered_map<std::string, std::string>&,
+    const DictReader& headers, FlatMap<std::string>&,
     Logger&) {
   ExtractedData result;
   result.style = PropagationStyle::B3;
@@ -204,7 +217,7 @@ Expected<ExtractedData> extract_b3(
 }
 
 Expected<ExtractedData> extract_none(
-    const DictReader&, std::unordered_map<std::string, std::string>&, Logger&) {
+    const DictReader&, FlatMap<std::string>&, Logger&) {
   ExtractedData result;
   result.style = PropagationStyle::NONE;
   return result;
@@ -243,21 +256,131 @@ Optional<StringView> AuditedReader::lookup(StringView key) const {
   return value;
 }
 
-void AuditedReader::visit(
-    const std::function<void(StringView key, StringView value)>& visitor)
-    const {
+void AuditedReader::visit(Visitor visitor) const {
   underlying.visit([&, this](StringView key, StringView value) {
     entries_found.emplace_back(key, value);
     visitor(key, value);
   });
 }
 
-ExtractedData merge(
-    const PropagationStyle first_style,
-    const std::unordered_map<PropagationStyle, ExtractedData>& contexts) {
+const StringView PrefetchedReader::keys[] = {
+    "x-datadog-trace-id",
+    "x-datadog-parent-id",
+    "x-datadog-sampling-priority",
+    "x-datadog-delegate-trace-sampling",
+    "x-datadog-origin",
+    "x-datadog-tags",
+    "x-b3-traceid",
+    "x-b3-spanid",
+    "x-b3-sampled",
+    "traceparent",
+    "tracestate",
+};
+
+namespace {
+
+// Return whether the specified `key` is equal to the specified `lower`, which
+// is in lower case, ignoring the case of ASCII letters in `key`.
+bool equals_lower(StringView key, StringView lower) {
+  if (key.size() != lower.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < key.size(); ++i) {
+    char c = key[i];
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    if (c != lower[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+PrefetchedReader::PrefetchedReader(const DictReader& underlying)
+    : underlying_(underlying) {
+  underlying_.visit([this](StringView key, StringView value) {
+    for (std::size_t i = 0; i < std::size(keys); ++i) {
+      if (!values_[i] && equals_lower(key, keys[i])) {
+        values_[i] = value;
+        return;
+      }
+    }
+  });
+}
+
+Optional<StringView> PrefetchedReader::lookup(StringView key) const {
+  for (std::size_t i = 0; i < std::size(keys); ++i) {
+    if (key == keys[i]) {
+      return values_[i];
+    }
+  }
+  return underlying_.lookup(key);
+}
+
+void PrefetchedReader::visit(Visitor visitor) const {
+  underlying_.visit(visitor);
+}
+
+namespace {
+
+// `DiscardingLogger` is a `Logger` that ignores everything.  It's used when
+// extraction is repeated for diagnostics, so that warnings are not logged
+// twice.
+class DiscardingLogger : public Logger {
+ public:
+  void log_error(const LogFunc&) override {}
+  void log_startup(const LogFunc&) override {}
+  void log_error(const Error&) override {}
+  void log_error(StringView) override {}
+};
+
+}  // namespace
+
+Extractor extractor(PropagationStyle style) {
+  switch (style) {
+    case PropagationStyle::DATADOG:
+      return &extract_datadog;
+    case PropagationStyle::B3:
+      return &extract_b3;
+    case PropagationStyle::W3C:
+      return &extract_w3c;
+    default:
+      assert(style == PropagationStyle::NONE);
+      return &extract_none;
+  }
+}
+
+std::vector<std::pair<std::string, std::string>> headers_examined(
+    const DictReader& headers, PropagationStyle style) {
+  AuditedReader audited_reader{headers};
+  FlatMap<std::string> span_tags;
+  DiscardingLogger logger;
+  (void)extractor(style)(audited_reader, span_tags, logger);
+  return std::move(audited_reader.entries_found);
+}
+
+std::vector<std::pair<std::string, std::string>> headers_examined(
+    const DictReader& headers, const ExtractedData& data) {
+  std::vector<std::pair<std::string, std::string>> result;
+  if (data.style) {
+    result = headers_examined(headers, *data.style);
+  }
+  if (data.merged_style) {
+    auto merged = headers_examined(headers, *data.merged_style);
+    result.insert(result.end(), std::make_move_iterator(merged.begin()),
+                  std::make_move_iterator(merged.end()));
+  }
+  return result;
+}
+
+ExtractedData merge(const PropagationStyle first_style,
+                    ExtractedContexts&& contexts) {
   ExtractedData result;
-  const auto found = contexts.find(first_style);
-  if (found == contexts.end()) {
+  ExtractedData* const found = contexts.find(first_style);
+  if (!found) {
     return result;
   }
 
@@ -268,30 +391,34 @@ ExtractedData merge(
   // context with tracestate information that we want to include in `result`. We
   // may also need to use Datadog header information (only when the trace-id
   // matches).
-  result = found->second;
+  result = std::move(*found);
+
+  // If the main context is the W3C context, then it already has its own
+  // tracestate information.
+  if (first_style == PropagationStyle::W3C) {
+    return result;
+  }
 
-  const auto w3c = contexts.find(PropagationStyle::W3C);
-  const auto dd = contexts.find(PropagationStyle::DATADOG);
+  ExtractedData* const w3c = contexts.find(PropagationStyle::W3C);
+  const ExtractedData* const dd = contexts.find(PropagationStyle::DATADOG);
 
-  if (w3c != contexts.end() && w3c->second.trace_id == result.trace_id) {
-    result.additional_w3c_tracestate = w3c->second.additional_w3c_tracestate;
+  if (w3c && w3c->trace_id == result.trace_id) {
+    result.additional_w3c_tracestate =
+        std::move(w3c->additional_w3c_tracestate);
     result.additional_datadog_w3c_tracestate =
-        w3c->second.additional_datadog_w3c_tracestate;
-    result.headers_examined.insert(result.headers_examined.end(),
-                                   w3c->second.headers_examined.begin(),
-                                   w3c->second.headers_examined.end());
-
-    if (result.parent_id != w3c->second.parent_id) {
-      if (w3c->second.datadog_w3c_parent_id &&
-          w3c->second.datadog_w3c_parent_id != "0000000000000000") {
-        result.datadog_w3c_parent_id = w3c->second.datadog_w3c_parent_id;
-      } else if (dd != contexts.end() &&
-                 dd->second.trace_id == result.trace_id &&
-                 dd->second.parent_id.has_value()) {
-        result.datadog_w3c_parent_id = hex_padded(dd->second.parent_id.value());
+        std::move(w3c->additional_datadog_w3c_tracestate);
+    result.merged_style = PropagationStyle::W3C;
+
+    if (result.parent_id != w3c->parent_id) {
+      if (w3c->datadog_w3c_parent_id &&
+          w3c->datadog_w3c_parent_id != "0000000000000000") {
+        result.datadog_w3c_parent_id = std::move(w3c->datadog_w3c_parent_id);
+      } else if (dd && dd->trace_id == result.trace_id &&
+                 dd->parent_id.has_value()) {
+        result.datadog_w3c_parent_id = hex_padded(dd->parent_id.value());
       }
 
-      result.parent_id = w3c->second.parent_id;
+      result.parent_id = w3c->parent_id;
     }
   }
 
@@ -8,40 +8,43 @@
 #include <datadog/optional.h>
 #include <datadog/propagation_style.h>
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "extracted_data.h"
+#include "flat_map.h"
+
 namespace datadog {
 namespace tracing {
 
-struct ExtractedData;
 class Logger;
 
 // Parse the high 64 bits of a trace ID from the specified `value`. If `value`
 // is correctly formatted, then return the resulting bits. If `value` is
 // incorrectly formatted, then return `nullopt`.
-Optional<std::uint64_t> parse_trace_id_high(const std::string& value);
+Optional<std::uint64_t> parse_trace_id_high(StringView value);
 
 // Return trace information parsed from the specified `headers` in the Datadog
 // propagation style. Use the specified `span_tags` and `logger` to report
 // warnings. If an error occurs, return an `Error`.
 Expected<ExtractedData> extract_datadog(
     const DictReader& headers,
-    std::unordered_map<std::string, std::string>& span_tags, Logger& logger);
+    FlatMap<std::string>& span_tags, Logger& logger);
 
 // Return trace information parsed from the specified `headers` in the B3
 // multi-header propagation style. If an error occurs, return an `Error`.
 Expected<ExtractedData> extract_b3(
-    const DictReader& headers, std::unordered_map<std::string, std::string>&,
+    const DictReader& headers, FlatMap<std::string>&,
     Logger&);
 
 // Return an `ExtractedData` whose only non-default field is
 // `style = PropagationStyle::NONE`.
 Expected<ExtractedData> extract_none(
-    const DictReader&, std::unordered_map<std::string, std::string>&, Logger&);
+    const DictReader&, FlatMap<std::string>&, Logger&);
 
 // Return a string that can be used as the argument to `Error::with_prefix` for
 // errors occurring while extracting trace information in the specified `style`
@@ -50,10 +53,32 @@ std::string extraction_error_prefix(
     const Optional<PropagationStyle>& style,
     const std::vector<std::pair<std::string, std::string>>& headers_examined);
 
+// `Extractor` is the type of a function that extracts trace information in a
+// particular propagation style, e.g. `extract_datadog`.
+using Extractor = Expected<ExtractedData> (*)(const DictReader&,
+                                              FlatMap<std::string>&, Logger&);
+
+// Return the `Extractor` for the specified `style`.
+Extractor extractor(PropagationStyle style);
+
+// Return the key/value pairs of the specified `headers` that extraction in the
+// specified `style` looks up and finds.  Extraction is repeated, and its
+// results discarded, to find them.  This way extraction that succeeds does not
+// pay for diagnostics that are needed only when an error occurs.
+std::vector<std::pair<std::string, std::string>> headers_examined(
+    const DictReader& headers, PropagationStyle style);
+
+// Return the key/value pairs of the specified `headers` that were looked up and
+// found while extracting the specified `data`, including those of the style
+// that `data` was merged with, if any.
+std::vector<std::pair<std::string, std::string>> headers_examined(
+    const DictReader& headers, const ExtractedData& data);
+
 // `AuditedReader` is a `DictReader` that remembers all key/value pairs looked
 // up or visited through it. It remembers a lookup only if it yielded a non-null
 // value. This is used for error diagnostic messages in trace extraction (i.e.
-// an error occurred, but which HTTP request headers were we looking at?).
+// an error occurred, but which HTTP request headers were we looking at?).  See
+// `headers_examined`.
 struct AuditedReader : public DictReader {
   const DictReader& underlying;
   mutable std::vector<std::pair<std::string, std::string>> entries_found;
@@ -62,8 +87,59 @@ struct AuditedReader : public DictReader {
 
   Optional<StringView> lookup(StringView key) const override;
 
-  void visit(const std::function<void(StringView key, StringView value)>&
-                 visitor) const override;
+  void visit(Visitor visitor) const override;
+};
+
+// `PrefetchedReader` is a `DictReader` that visits another `DictReader` once,
+// remembering the values of the keys that the extractors look up, and then
+// answers lookups of those keys from what it remembered.  Keys are matched
+// case-insensitively, and the first value visited for a key is the one
+// remembered.  Lookups of other keys, and visits, are forwarded to the other
+// `DictReader`.
+//
+// This way extracting several propagation styles costs one pass over the
+// headers, rather than a lookup per header per style.  It requires that the
+// values passed to the visitor remain valid for as long as the
+// `PrefetchedReader`.
+class PrefetchedReader : public DictReader {
+ public:
+  // The keys whose values are remembered, in lower case.
+  static const StringView keys[11];
+
+ private:
+  const DictReader& underlying_;
+  Optional<StringView> values_[std::size(keys)];
+
+ public:
+  explicit PrefetchedReader(const DictReader& underlying);
+
+  Optional<StringView> lookup(StringView key) const override;
+
+  void visit(Visitor visitor) const override;
+};
+
+// `ExtractedContexts` holds at most one `ExtractedData` per propagation
+// style.  Since there are only a few styles, the contexts are stored inline,
+// indexed by style, rather than in a node-based map.
+class ExtractedContexts {
+  static constexpr std::size_t capacity =
+      static_cast<std::size_t>(PropagationStyle::NONE) + 1;
+
+  Optional<ExtractedData> contexts_[capacity];
+
+ public:
+  // Store the specified `data` as the context extracted in the specified
+  // `style`, replacing any previous context for `style`.
+  void emplace(PropagationStyle style, ExtractedData&& data) {
+    contexts_[static_cast<std::size_t>(style)] = std::move(data);
+  }
+
+  // Return a pointer to the context extracted in the specified `style`, or
+  // return `nullptr` if there is none.
+  ExtractedData* find(PropagationStyle style) {
+    auto& context = contexts_[static_cast<std::size_t>(style)];
+    return context ? &*context : nullptr;
+  }
 };
 
 // Combine the specified trace `contexts`, each of which was extracted in a
@@ -71,10 +147,10 @@ struct AuditedReader : public DictReader {
 // from compatible elements of `contexts`, and return the resulting
 // `ExtractedData`. The `first_style` specifies the first configured extraction
 // propagation style that has been extracted and the other contexts will be
-// merged with it, so long as the trace-ids match.
-ExtractedData merge(
-    const PropagationStyle first_style,
-    const std::unordered_map<PropagationStyle, ExtractedData>& contexts);
+// merged with it, so long as the trace-ids match.  `contexts` is consumed:
+// strings and vectors are moved out of it rather than copied.
+ExtractedData merge(const PropagationStyle first_style,
+                    ExtractedContexts&& contexts);
 
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,294 @@
+#include <datadog/file_spool_collector.h>
+#include <datadog/logger.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "json.hpp"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr char file_magic[8] = {'D', 'D', 'S', 'P', 'O', 'O', 'L', '\0'};
+constexpr std::uint32_t file_version = 1;
+constexpr std::size_t file_header_size = 16;
+constexpr std::size_t record_header_size = 8;
+constexpr std::size_t min_file_bytes = 64 * 1024;
+
+// CRC-32C (Castagnoli), reflected, as used by iSCSI, ext4, and most storage
+// formats.
+constexpr std::array<std::uint32_t, 256> make_crc32c_table() {
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t i = 0; i < 256; ++i) {
+    std::uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr auto crc32c_table = make_crc32c_table();
+
+std::uint32_t crc32c(const char* data, std::size_t size) {
+  std::uint32_t crc = 0xFFFFFFFFu;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc = (crc >> 8) ^ crc32c_table[(crc ^ std::uint8_t(data[i])) & 0xFF];
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+void put_little_endian(char* destination, std::uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    destination[i] = char(value & 0xFF);
+    value >>= 8;
+  }
+}
+
+Error file_error(const std::string& path, const char* what, int error_number) {
+  std::string message;
+  message += "Unable to write the spool file \"";
+  message += path;
+  message += "\": ";
+  message += what;
+  message += ": ";
+  message += std::generic_category().message(error_number);
+  return Error{Error::FILE_SPOOL_COLLECTOR_FILE_FAILED, std::move(message)};
+}
+
+const char* to_string(FileSpoolSync sync) {
+  switch (sync) {
+    case FileSpoolSync::NEVER:
+      return "never";
+    case FileSpoolSync::ON_ROTATE:
+      return "on_rotate";
+    case FileSpoolSync::EVERY_CHUNK:
+      return "every_chunk";
+  }
+  return "";
+}
+
+}  // namespace
+
+FileSpoolCollector::FileSpoolCollector(const FileSpoolCollectorConfig& config,
+                                       const std::shared_ptr<Logger>& logger)
+    : logger_(logger),
+      directory_(config.directory),
+      max_file_bytes_(config.max_file_bytes),
+      sync_(config.sync) {}
+
+Expected<std::shared_ptr<FileSpoolCollector>> FileSpoolCollector::create(
+    const FileSpoolCollectorConfig& config,
+    const std::shared_ptr<Logger>& logger) {
+  if (config.max_file_bytes < min_file_bytes) {
+    std::string message;
+    message += "The maximum size of a spool file must be at least ";
+    message += std::to_string(min_file_bytes);
+    message += " bytes, but ";
+    message += std::to_string(config.max_file_bytes);
+    message += " was specified.";
+    return Error{Error::FILE_SPOOL_COLLECTOR_FILE_FAILED, std::move(message)};
+  }
+
+  std::shared_ptr<FileSpoolCollector> collector{
+      new FileSpoolCollector(config, logger)};
+  // Begin the first file now, so that an unusable directory is reported
+  // before any traces are lost to it.
+  std::lock_guard<std::mutex> lock(collector->mutex_);
+  auto begun = collector->begin_file();
+  if (auto* error = begun.if_error()) {
+    return *error;
+  }
+  return collector;
+}
+
+FileSpoolCollector::~FileSpoolCollector() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ != -1) {
+    finish_file();
+  }
+}
+
+Expected<void> FileSpoolCollector::begin_file() {
+  const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+  path_ = directory_;
+  path_ += "/traces-";
+  path_ += std::to_string(::getpid());
+  path_ += '-';
+  path_ += std::to_string(now.count());
+  path_ += '-';
+  path_ += std::to_string(sequence_++);
+  path_ += ".spool";
+  const std::string partial = path_ + ".partial";
+
+  const int fd = ::open(partial.c_str(),
+                        O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return file_error(partial, "open", errno);
+  }
+  // Allocate the whole file up front.  Writing to a mapped page that the file
+  // system cannot allocate would raise `SIGBUS`, but running out of space
+  // here is only an error.
+#if defined(__linux__)
+  const int rc = ::posix_fallocate(fd, 0, off_t(max_file_bytes_));
+  const char* const operation = "posix_fallocate";
+#else
+  const int rc =
+      ::ftruncate(fd, off_t(max_file_bytes_)) == 0 ? 0 : errno;
+  const char* const operation = "ftruncate";
+#endif
+  void* mapping = MAP_FAILED;
+  if (rc == 0) {
+    mapping = ::mmap(nullptr, max_file_bytes_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+  }
+  if (rc != 0 || mapping == MAP_FAILED) {
+    const int error_number = rc != 0 ? rc : errno;
+    ::close(fd);
+    ::unlink(partial.c_str());
+    return file_error(partial, rc != 0 ? operation : "mmap", error_number);
+  }
+
+  fd_ = fd;
+  mapping_ = static_cast<char*>(mapping);
+  std::memcpy(mapping_, file_magic, sizeof file_magic);
+  put_little_endian(mapping_ + sizeof file_magic, file_version);
+  size_ = file_header_size;
+  return nullopt;
+}
+
+void FileSpoolCollector::finish_file() {
+  const std::string partial = path_ + ".partial";
+  const bool sync = sync_ != FileSpoolSync::NEVER;
+  if (sync && ::msync(mapping_, size_, MS_SYNC) != 0) {
+    logger_->log_error(file_error(partial, "msync", errno));
+  }
+  ::munmap(mapping_, max_file_bytes_);
+  mapping_ = nullptr;
+  if (::ftruncate(fd_, off_t(size_)) != 0) {
+    logger_->log_error(file_error(partial, "ftruncate", errno));
+  }
+  if (sync && ::fsync(fd_) != 0) {
+    logger_->log_error(file_error(partial, "fsync", errno));
+  }
+  ::close(fd_);
+  fd_ = -1;
+
+  if (size_ == file_header_size) {
+    ::unlink(partial.c_str());
+    return;
+  }
+  if (::rename(partial.c_str(), path_.c_str()) != 0) {
+    logger_->log_error(file_error(partial, "rename", errno));
+    return;
+  }
+  if (sync) {
+    // Make the rename itself durable.
+    const int directory = ::open(directory_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (directory != -1) {
+      ::fsync(directory);
+      ::close(directory);
+    }
+  }
+}
+
+Expected<void> FileSpoolCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler) {
+  return send(std::move(spans), ChunkTags{}, response_handler);
+}
+
+Expected<void> FileSpoolCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const ChunkTags& chunk_tags, const std::shared_ptr<TraceSampler>&) {
+  // Encode the chunk before taking the lock, so that only copying it into
+  // the file is serialized.
+  thread_local std::string encoded;
+  encoded.clear();
+  auto result = msgpack_encode(encoded, spans, chunk_tags);
+  if (result.if_error()) {
+    return result;
+  }
+  // Don't let one unusually large chunk pin its memory to this thread.
+  struct Trim {
+    ~Trim() {
+      constexpr std::size_t max_retained_capacity = 1 << 20;
+      if (encoded.capacity() > max_retained_capacity) {
+        std::string().swap(encoded);
+      }
+    }
+  } trim;
+
+  const std::size_t record_size =
+      (record_header_size + encoded.size() + 7) & ~std::size_t(7);
+  if (file_header_size + record_size > max_file_bytes_ ||
+      encoded.size() > UINT32_MAX) {
+    std::string message;
+    message += "A trace chunk of ";
+    message += std::to_string(encoded.size());
+    message += " bytes does not fit in a spool file of ";
+    message += std::to_string(max_file_bytes_);
+    message += " bytes.";
+    return Error{Error::FILE_SPOOL_COLLECTOR_CHUNK_TOO_LARGE,
+                 std::move(message)};
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ != -1 && size_ + record_size > max_file_bytes_) {
+    finish_file();
+  }
+  if (fd_ == -1) {
+    auto begun = begin_file();
+    if (begun.if_error()) {
+      return begun;
+    }
+  }
+
+  // Write the payload, and then the header that makes it part of the file.
+  char* const record = mapping_ + size_;
+  std::memcpy(record + record_header_size, encoded.data(), encoded.size());
+  put_little_endian(record + 4, crc32c(encoded.data(), encoded.size()));
+  std::atomic_thread_fence(std::memory_order_release);
+  put_little_endian(record, std::uint32_t(encoded.size()));
+  size_ += record_size;
+
+  if (sync_ == FileSpoolSync::EVERY_CHUNK) {
+    // `msync` requires a page-aligned address.
+    const std::size_t page_size = std::size_t(::sysconf(_SC_PAGESIZE));
+    const std::size_t begin = (size_ - record_size) / page_size * page_size;
+    if (::msync(mapping_ + begin, size_ - begin, MS_SYNC) != 0) {
+      return file_error(path_ + ".partial", "msync", errno);
+    }
+  }
+  return nullopt;
+}
+
+std::string FileSpoolCollector::config() const {
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::FileSpoolCollector"},
+    {"config", nlohmann::json::object({
+      {"directory", directory_},
+      {"max_file_bytes", max_file_bytes_},
+      {"sync", to_string(sync_)},
+    })},
+  }).dump();
+  // clang-format on
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,273 @@
+#pragma once
+
+// This component provides a class template, `FlatMap`, that is an associative
+// container from string keys to values of a specified type.  It is used for
+// the tags of `SpanData`.  Keys are `std::string` by default.  A `FlatMap`
+// whose keys are `StringView` does not own its keys; `SpanData::static_tags`
+// is one.
+//
+// Spans typically have a handful of tags.  A node-based hash map, such as
+// `std::unordered_map`, allocates once per entry and scatters its entries
+// across the heap, which makes it slow to build and slow to iterate.
+// `FlatMap` instead keeps its entries contiguous and sorted by key.  Up to
+// `InlineCapacity` entries are stored inline, within the `FlatMap` object
+// itself, so small maps do not allocate at all (other than for keys and values
+// too large for the small string optimization).  Beyond that, the entries move
+// to a `std::vector`.  Lookups scan small maps linearly and binary search large
+// ones.
+//
+// The interface of `FlatMap` is a subset of that of `std::unordered_map`,
+// except that lookups accept a `StringView`, and iterators are invalidated by
+// any insertion or removal.
+
+#include <datadog/string_view.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+template <typename Value, std::size_t InlineCapacity = 8,
+          typename KeyType = std::string>
+class FlatMap {
+ public:
+  using key_type = KeyType;
+  using mapped_type = Value;
+  using value_type = std::pair<KeyType, Value>;
+  using size_type = std::size_t;
+  using iterator = value_type*;
+  using const_iterator = const value_type*;
+
+ private:
+  // Maps no larger than this are searched linearly.
+  static constexpr std::size_t linear_search_max_size = 16;
+
+  std::size_t size_ = 0;
+  // Whether the entries are in `heap_` rather than in `inline_`.  Once a map
+  // has outgrown `inline_`, it stays on the heap until it is `clear`ed.
+  bool on_heap_ = false;
+  std::array<value_type, InlineCapacity> inline_;
+  std::vector<value_type> heap_;
+
+  value_type* data() { return on_heap_ ? heap_.data() : inline_.data(); }
+  const value_type* data() const {
+    return on_heap_ ? heap_.data() : inline_.data();
+  }
+
+  void move_to_heap(std::size_t capacity) {
+    heap_.reserve(std::max(capacity, 2 * InlineCapacity));
+    for (std::size_t i = 0; i < size_; ++i) {
+      heap_.push_back(std::move(inline_[i]));
+      inline_[i] = value_type{};
+    }
+    on_heap_ = true;
+  }
+
+  // Return the position of the first entry whose key is not less than the
+  // specified `key`.
+  iterator lower_bound(StringView key) {
+    return const_cast<iterator>(std::as_const(*this).lower_bound(key));
+  }
+  const_iterator lower_bound(StringView key) const {
+    const_iterator first = begin();
+    const_iterator last = end();
+    if (size_ <= linear_search_max_size) {
+      while (first != last && StringView(first->first) < key) {
+        ++first;
+      }
+      return first;
+    }
+    return std::lower_bound(first, last, key,
+                            [](const value_type& entry, StringView key) {
+                              return StringView(entry.first) < key;
+                            });
+  }
+
+  // Insert an entry having the specified `key` and `value` at the specified
+  // `position`, and return an iterator to the new entry.
+  template <typename Key, typename Mapped>
+  iterator insert_at(iterator position, Key&& key, Mapped&& value) {
+    const std::size_t index = position - begin();
+    value_type entry{KeyType(std::forward<Key>(key)),
+                     Value(std::forward<Mapped>(value))};
+    if (!on_heap_ && size_ == InlineCapacity) {
+      move_to_heap(size_ + 1);
+    }
+    if (on_heap_) {
+      heap_.insert(heap_.begin() + index, std::move(entry));
+    } else {
+      std::move_backward(inline_.begin() + index, inline_.begin() + size_,
+                         inline_.begin() + size_ + 1);
+      inline_[index] = std::move(entry);
+    }
+    ++size_;
+    return begin() + index;
+  }
+
+ public:
+  FlatMap() = default;
+  FlatMap(const FlatMap&) = default;
+  FlatMap& operator=(const FlatMap&) = default;
+
+  FlatMap(FlatMap&& other) noexcept
+      : size_(other.size_),
+        on_heap_(other.on_heap_),
+        inline_(std::move(other.inline_)),
+        heap_(std::move(other.heap_)) {
+    other.size_ = 0;
+    other.on_heap_ = false;
+    other.heap_.clear();
+  }
+
+  FlatMap& operator=(FlatMap&& other) noexcept {
+    if (this != &other) {
+      size_ = other.size_;
+      on_heap_ = other.on_heap_;
+      inline_ = std::move(other.inline_);
+      heap_ = std::move(other.heap_);
+      other.size_ = 0;
+      other.on_heap_ = false;
+      other.heap_.clear();
+    }
+    return *this;
+  }
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + size_; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size_; }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Prepare this map to hold at least the specified `capacity` entries
+  // without further allocation.
+  void reserve(std::size_t capacity) {
+    if (on_heap_) {
+      heap_.reserve(capacity);
+    } else if (capacity > InlineCapacity) {
+      move_to_heap(capacity);
+    }
+  }
+
+  void clear() {
+    if (!on_heap_) {
+      std::fill(inline_.begin(), inline_.begin() + size_, value_type{});
+    }
+    heap_.clear();
+    on_heap_ = false;
+    size_ = 0;
+  }
+
+  iterator find(StringView key) {
+    const auto found = lower_bound(key);
+    return found != end() && found->first == key ? found : end();
+  }
+  const_iterator find(StringView key) const {
+    const auto found = lower_bound(key);
+    return found != end() && found->first == key ? found : end();
+  }
+
+  std::size_t count(StringView key) const { return find(key) != end(); }
+
+  Value& at(StringView key) {
+    return const_cast<Value&>(std::as_const(*this).at(key));
+  }
+  const Value& at(StringView key) const {
+    const auto found = find(key);
+    if (found == end()) {
+      throw std::out_of_range("FlatMap::at");
+    }
+    return found->second;
+  }
+
+  Value& operator[](StringView key) {
+    auto position = lower_bound(key);
+    if (position == end() || position->first != key) {
+      position = insert_at(position, key, Value{});
+    }
+    return position->second;
+  }
+
+  // Insert an entry having the specified `key` and `value` unless an entry
+  // having `key` is already present.  Return an iterator to the entry having
+  // `key`, and whether the insertion took place.
+  template <typename Key, typename Mapped>
+  std::pair<iterator, bool> emplace(Key&& key, Mapped&& value) {
+    const StringView key_view{key};
+    const auto position = lower_bound(key_view);
+    if (position != end() && position->first == key_view) {
+      return {position, false};
+    }
+    return {insert_at(position, std::forward<Key>(key),
+                      std::forward<Mapped>(value)),
+            true};
+  }
+
+  template <typename Pair>
+  std::pair<iterator, bool> insert(Pair&& entry) {
+    return emplace(std::forward<Pair>(entry).first,
+                   std::forward<Pair>(entry).second);
+  }
+
+  template <typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    for (; first != last; ++first) {
+      emplace(first->first, first->second);
+    }
+  }
+
+  // Insert an entry having the specified `key` and `value`, or assign `value`
+  // to the existing entry having `key`.  Return an iterator to the entry
+  // having `key`, and whether an insertion took place.
+  template <typename Key, typename Mapped>
+  std::pair<iterator, bool> insert_or_assign(Key&& key, Mapped&& value) {
+    const StringView key_view{key};
+    const auto position = lower_bound(key_view);
+    if (position != end() && position->first == key_view) {
+      position->second = std::forward<Mapped>(value);
+      return {position, false};
+    }
+    return {insert_at(position, std::forward<Key>(key),
+                      std::forward<Mapped>(value)),
+            true};
+  }
+
+  iterator erase(const_iterator position) {
+    const std::size_t index = position - begin();
+    if (on_heap_) {
+      heap_.erase(heap_.begin() + index);
+    } else {
+      std::move(inline_.begin() + index + 1, inline_.begin() + size_,
+                inline_.begin() + index);
+      inline_[size_ - 1] = value_type{};
+    }
+    --size_;
+    return begin() + index;
+  }
+
+  std::size_t erase(StringView key) {
+    const auto found = find(key);
+    if (found == end()) {
+      return 0;
+    }
+    erase(found);
+    return 1;
+  }
+
+  friend bool operator==(const FlatMap& left, const FlatMap& right) {
+    return std::equal(left.begin(), left.end(), right.begin(), right.end());
+  }
+  friend bool operator!=(const FlatMap& left, const FlatMap& right) {
+    return !(left == right);
+  }
+};
+
+}  // namespace tracing
+}  // namespace datadog
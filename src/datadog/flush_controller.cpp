@@ -0,0 +1,70 @@
+#include "flush_controller.h"
+
+#include <algorithm>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// The most that one flush may shorten or lengthen the interval, as a factor.
+constexpr double max_adjustment = 2.0;
+
+}  // namespace
+
+FlushController::FlushController(Duration initial_interval,
+                                 Duration min_interval, Duration max_interval,
+                                 std::size_t target_payload_bytes)
+    : min_interval_(min_interval),
+      max_interval_(max_interval),
+      target_payload_bytes_(target_payload_bytes),
+      interval_(std::clamp(initial_interval, min_interval, max_interval)) {}
+
+bool FlushController::due(TimePoint now) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !flushed_ || now - last_flush_ >= interval_;
+}
+
+void FlushController::record_flush(TimePoint start,
+                                   std::size_t buffered_bytes,
+                                   Duration duration) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  flushed_ = true;
+  last_flush_ = start;
+
+  // An empty flush lengthens the interval as much as a nearly empty one.
+  double factor = max_adjustment;
+  if (buffered_bytes != 0) {
+    factor = std::clamp(double(target_payload_bytes_) / buffered_bytes,
+                        1 / max_adjustment, max_adjustment);
+  }
+  auto interval = std::chrono::duration_cast<Duration>(interval_ * factor);
+  interval = std::max(interval, std::chrono::duration_cast<Duration>(
+                                    duration / max_duty_cycle));
+  interval = std::max(interval, response_latency_.load());
+  interval_ = std::clamp(interval, min_interval_, max_interval_);
+}
+
+void FlushController::record_response(Duration latency) {
+  response_latency_ = latency;
+}
+
+FlushController::Duration FlushController::interval() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return interval_;
+}
+
+nlohmann::json FlushController::config_json() const {
+  const auto milliseconds = [](Duration duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+        .count();
+  };
+  return nlohmann::json::object({
+      {"min_flush_interval_milliseconds", milliseconds(min_interval_)},
+      {"max_flush_interval_milliseconds", milliseconds(max_interval_)},
+      {"target_payload_bytes", target_payload_bytes_},
+      {"max_duty_cycle", max_duty_cycle},
+  });
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,73 @@
+#pragma once
+
+// This component provides a `class`, `FlushController`, that chooses how long
+// `DatadogAgent` waits between its periodic flushes when
+// `DatadogAgentConfig::adaptive_flush_enabled` is true.
+//
+// A `FlushController` aims for flushes that each send about a target number
+// of bytes.  After each flush, the interval is scaled by the ratio of the
+// target to the number of bytes that the flush found buffered, but by no more
+// than a factor of two either way, so that a single burst or lull does not
+// swing the interval from one bound to the other.  The interval is then kept
+// long enough that flushing occupies at most `max_duty_cycle` of the flushing
+// thread's time, and no shorter than the latency of the most recent response
+// from the Datadog Agent, so that requests do not pile up behind a slow
+// Agent.  Finally, the interval is clamped to the configured bounds.
+//
+// `DatadogAgent` runs its recurring flush every minimum interval, and the
+// flush proceeds only if `due`.
+//
+// The member functions of `FlushController` may be called concurrently.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+
+class FlushController {
+ public:
+  using Duration = std::chrono::steady_clock::duration;
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  // The largest fraction of the interval that a flush may take.
+  static constexpr double max_duty_cycle = 0.1;
+
+  FlushController(Duration initial_interval, Duration min_interval,
+                  Duration max_interval, std::size_t target_payload_bytes);
+
+  FlushController(const FlushController&) = delete;
+
+  // Return whether a flush is due at the specified `now`, i.e. whether the
+  // current interval has elapsed since the last flush.  The first flush is
+  // always due.
+  bool due(TimePoint now) const;
+  // Record a flush that began at the specified `start`, found the specified
+  // `buffered_bytes`, and took the specified `duration`, and choose the
+  // interval until the next flush.
+  void record_flush(TimePoint start, std::size_t buffered_bytes,
+                    Duration duration);
+  // Record the specified `latency` of a response from the Datadog Agent.
+  void record_response(Duration latency);
+  // Return the current interval between flushes.
+  Duration interval() const;
+
+  nlohmann::json config_json() const;
+
+ private:
+  const Duration min_interval_;
+  const Duration max_interval_;
+  const std::size_t target_payload_bytes_;
+  std::atomic<Duration> response_latency_{Duration::zero()};
+  mutable std::mutex mutex_;
+  Duration interval_;
+  bool flushed_ = false;
+  TimePoint last_flush_;
+};
+
+}  // namespace tracing
+}  // namespace datadog
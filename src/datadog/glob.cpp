@@ -1,60 +1,245 @@
 #include "glob.h"
 
-#include <cctype>
+#include <cstdint>
+#include <cstring>
 
 namespace datadog {
 namespace tracing {
+namespace {
+
+// Matching is case-insensitive for ASCII letters only.  Unlike `std::tolower`,
+// this does not consult the locale, and so can be inlined and vectorized.
+char lower(char c) { return c >= 'A' && c <= 'Z' ? char(c + ('a' - 'A')) : c; }
+
+// Return the specified eight `bytes` with each ASCII upper case letter
+// replaced by its lower case counterpart.
+std::uint64_t lower_word(std::uint64_t bytes) {
+  const std::uint64_t ones = 0x0101010101010101ULL;
+  const std::uint64_t high_bits = 0x8080808080808080ULL;
+  // For each byte `b` below 0x80, the high bit of `at_least_a` is set if
+  // `b >= 'A'`, and the high bit of `above_z` is set if `b > 'Z'`.
+  const std::uint64_t low_bits = bytes & ~high_bits;
+  const std::uint64_t at_least_a = low_bits + ones * (0x80 - 'A');
+  const std::uint64_t above_z = low_bits + ones * (0x80 - 'Z' - 1);
+  const std::uint64_t upper = at_least_a & ~above_z & ~bytes & high_bits;
+  // The high bit of each upper case byte, shifted to 0x20, is the difference
+  // between upper and lower case.
+  return bytes | (upper >> 2);
+}
+
+// Return whether the specified `subject` is equal to the specified lower case
+// `literal`, ignoring case.  The comparison is made eight bytes at a time.
+bool equal_lower(StringView literal, StringView subject) {
+  const std::size_t size = literal.size();
+  if (size != subject.size()) {
+    return false;
+  }
+
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t expected;
+    std::uint64_t actual;
+    std::memcpy(&expected, literal.data() + i, 8);
+    std::memcpy(&actual, subject.data() + i, 8);
+    if (lower_word(actual) != expected) {
+      return false;
+    }
+  }
+  for (; i < size; ++i) {
+    if (lower(subject[i]) != literal[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
 
 bool glob_match(StringView pattern, StringView subject) {
-  // This is a backtracking implementation of the glob matching algorithm.
-  // The glob pattern language supports `*` and `?`, but no escape sequences.
-  //
-  // Based off of a Go example in <https://research.swtch.com/glob> accessed
-  // February 3, 2022.
-
-  using Index = std::size_t;
-  Index p = 0;       // [p]attern index
-  Index s = 0;       // [s]ubject index
-  Index next_p = 0;  // next [p]attern index
-  Index next_s = 0;  // next [s]ubject index
-
-  const size_t p_size = pattern.size();
-  const size_t s_size = subject.size();
-
-  while (p < p_size || s < s_size) {
-    if (p < p_size) {
-      const char pattern_char = pattern[p];
-      switch (pattern_char) {
-        case '*':
-          // Try to match at `s`.  If that doesn't work out, restart at
-          // `s + 1` next.
-          next_p = p;
-          next_s = s + 1;
-          ++p;
-          continue;
-        case '?':
-          if (s < s_size) {
-            ++p;
-            ++s;
-            continue;
-          }
-          break;
-        default:
-          if (s < s_size && tolower(subject[s]) == tolower(pattern_char)) {
-            ++p;
-            ++s;
-            continue;
-          }
+  return Glob(pattern).match(subject);
+}
+
+Glob::Glob(StringView pattern) {
+  pattern_.reserve(pattern.size());
+  for (const char c : pattern) {
+    if (c == '*' && !pattern_.empty() && pattern_.back() == '*') {
+      continue;
+    }
+    pattern_.push_back(lower(c));
+  }
+
+  const auto wildcard = pattern_.find_first_of("*?");
+  if (wildcard == std::string::npos) {
+    kind_ = Kind::LITERAL;
+  } else if (pattern_ == "*") {
+    kind_ = Kind::ANY;
+  } else if (pattern_.find('?') != std::string::npos) {
+    kind_ = Kind::GENERAL;
+  } else if (wildcard == pattern_.size() - 1) {
+    kind_ = Kind::PREFIX;
+    pattern_.pop_back();
+  } else if (wildcard == 0 && pattern_.find('*', 1) == std::string::npos) {
+    kind_ = Kind::SUFFIX;
+    pattern_.erase(0, 1);
+  } else {
+    kind_ = Kind::GENERAL;
+  }
+
+  if (kind_ != Kind::GENERAL) {
+    return;
+  }
+
+  runs_.resize(pattern_.size());
+  std::size_t run = 0;
+  for (std::size_t i = pattern_.size(); i-- > 0;) {
+    run = pattern_[i] == '*' || pattern_[i] == '?' ? 0 : run + 1;
+    runs_[i] = run;
+  }
+
+  const std::size_t first_star = pattern_.find('*');
+  if (first_star == std::string::npos) {
+    // The pattern is all head, e.g. "mysql??".
+    head_size_ = pattern_.size();
+    return;
+  }
+  const std::size_t last_star = pattern_.rfind('*');
+  head_size_ = first_star;
+  tail_size_ = pattern_.size() - last_star - 1;
+
+  // Runs of "*" were collapsed, so no segment is empty.
+  std::size_t begin = first_star + 1;
+  while (begin < last_star) {
+    const std::size_t end = pattern_.find('*', begin);
+    Segment segment;
+    segment.offset = begin;
+    segment.size = end - begin;
+    segment.words = (segment.size + 63) / 64;
+    segment.rows.fill(0);
+    // Row zero, for characters not in the segment, has bits only for "?".
+    std::size_t num_rows = 1;
+    for (std::size_t i = begin; i < end; ++i) {
+      const auto c = std::uint8_t(pattern_[i]);
+      if (c != '?' && segment.rows[c] == 0) {
+        segment.rows[c] = std::uint8_t(num_rows++);
+      }
+    }
+    segment.masks.assign(num_rows * segment.words, 0);
+    for (std::size_t i = 0; i < segment.size; ++i) {
+      const char c = pattern_[begin + i];
+      const std::uint64_t bit = std::uint64_t(1) << (i % 64);
+      if (c != '?') {
+        segment.masks[segment.rows[std::uint8_t(c)] * segment.words + i / 64] |=
+            bit;
+        continue;
+      }
+      for (std::size_t row = 0; row < num_rows; ++row) {
+        segment.masks[row * segment.words + i / 64] |= bit;
       }
     }
-    // Mismatch.  Maybe restart.
-    if (0 < next_s && next_s <= s_size) {
-      p = next_p;
-      s = next_s;
+    // The subject is not converted to lower case, so upper case letters
+    // share the rows of their lower case counterparts.
+    for (char c = 'A'; c <= 'Z'; ++c) {
+      segment.rows[std::uint8_t(c)] = segment.rows[std::uint8_t(lower(c))];
+    }
+    segments_.push_back(std::move(segment));
+    begin = end + 1;
+  }
+}
+
+bool Glob::equal_at(std::size_t offset, StringView subject) const {
+  std::size_t i = 0;
+  while (i < subject.size()) {
+    if (pattern_[offset + i] == '?') {
+      ++i;
       continue;
     }
+    // Each run of literal characters is compared at once.
+    const std::size_t run = runs_[offset + i];
+    if (!equal_lower(StringView(pattern_).substr(offset + i, run),
+                     subject.substr(i, run))) {
+      return false;
+    }
+    i += run;
+  }
+  return true;
+}
+
+std::size_t Glob::find(const Segment& segment, StringView subject,
+                       std::size_t begin) {
+  // Bit `i` of `state` is set if the `i + 1` characters of the subject ending
+  // at the current one match the first `i + 1` characters of the segment.
+  const std::size_t last_bit = (segment.size - 1) % 64;
+  const std::uint64_t* const masks = segment.masks.data();
+  if (segment.words == 1) {
+    std::uint64_t state = 0;
+    for (std::size_t s = begin; s < subject.size(); ++s) {
+      const std::uint8_t row = segment.rows[std::uint8_t(subject[s])];
+      state = ((state << 1) | 1) & masks[row];
+      if (state >> last_bit & 1) {
+        return s + 1;
+      }
+    }
+    return std::string::npos;
+  }
+
+  const std::size_t words = segment.words;
+  std::vector<std::uint64_t> state(words, 0);
+  for (std::size_t s = begin; s < subject.size(); ++s) {
+    const std::uint64_t* const mask =
+        masks + segment.rows[std::uint8_t(subject[s])] * words;
+    std::uint64_t carry = 1;
+    for (std::size_t w = 0; w < words; ++w) {
+      const std::uint64_t next_carry = state[w] >> 63;
+      state[w] = ((state[w] << 1) | carry) & mask[w];
+      carry = next_carry;
+    }
+    if (state[words - 1] >> last_bit & 1) {
+      return s + 1;
+    }
+  }
+  return std::string::npos;
+}
+
+bool Glob::match(StringView subject) const {
+  switch (kind_) {
+    case Kind::ANY:
+      return true;
+    case Kind::LITERAL:
+      return equal_lower(pattern_, subject);
+    case Kind::PREFIX:
+      return subject.size() >= pattern_.size() &&
+             equal_lower(pattern_, subject.substr(0, pattern_.size()));
+    case Kind::SUFFIX:
+      return subject.size() >= pattern_.size() &&
+             equal_lower(pattern_,
+                         subject.substr(subject.size() - pattern_.size()));
+    case Kind::GENERAL:
+    default:
+      break;
+  }
+
+  if (head_size_ == pattern_.size()) {
+    // There is no "*".
+    return subject.size() == head_size_ && equal_at(0, subject);
+  }
+  if (subject.size() < head_size_ + tail_size_ ||
+      !equal_at(0, subject.substr(0, head_size_)) ||
+      !equal_at(pattern_.size() - tail_size_,
+                subject.substr(subject.size() - tail_size_))) {
     return false;
   }
+  // Each segment must occur, after the previous one, between the head and
+  // the tail.  Taking the leftmost occurrence leaves the most room for the
+  // rest, so there is never a reason to go back.
+  const StringView middle =
+      subject.substr(head_size_, subject.size() - head_size_ - tail_size_);
+  std::size_t position = 0;
+  for (const Segment& segment : segments_) {
+    position = find(segment, middle, position);
+    if (position == std::string::npos) {
+      return false;
+    }
+  }
   return true;
 }
 
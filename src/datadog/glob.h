@@ -10,16 +10,110 @@
 //
 // The patterns are here called "glob patterns," though they are different from
 // the patterns used in Unix shells.
+//
+// Matching is case-insensitive for ASCII letters.
+//
+// This component also provides a `class`, `Glob`, that is a glob pattern
+// prepared for matching many subjects.  A `Glob` recognizes common shapes of
+// pattern, such as a literal string or a prefix followed by "*", and matches
+// those with a single comparison.
+//
+// Matching never backtracks, so its cost is linear in the length of the
+// subject, whatever the pattern.  Patterns can arrive through remote
+// configuration, and subjects can be long SQL resource names, so a pattern
+// such as "*a*a*a*b" must not cost the product of the two lengths.  Between
+// its first and last "*", a pattern is a sequence of segments that must occur
+// in the subject in order, and the leftmost occurrence of each segment after
+// the previous one is as good as any.  Each segment is found by a
+// bit-parallel scan (the "shift-and" algorithm) that looks at each character
+// of the subject once, for every 64 characters of the segment.
 
 #include <datadog/string_view.h>
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace datadog {
 namespace tracing {
 
 // Return whether the specified `subject` matches the specified glob `pattern`,
 // i.e.  whether `subject` is a member of the set of strings represented by the
-// glob `pattern`.
+// glob `pattern`.  This prepares a `Glob` for the one match, so prefer `Glob`
+// when matching a pattern more than once.
 bool glob_match(StringView pattern, StringView subject);
 
+class Glob {
+ public:
+  enum class Kind {
+    // The pattern consists only of "*", and matches anything.
+    ANY,
+    // The pattern has no "*" or "?", and matches only itself.
+    LITERAL,
+    // The pattern is a literal followed by "*".
+    PREFIX,
+    // The pattern is "*" followed by a literal.
+    SUFFIX,
+    // Any other pattern.
+    GENERAL
+  };
+
+ private:
+  // A part of a `GENERAL` pattern between two "*", which is searched for in
+  // the subject.
+  struct Segment {
+    // The position and length of the segment in `pattern_`.
+    std::size_t offset;
+    std::size_t size;
+    // The number of 64-bit words that hold one bit for each character of the
+    // segment.
+    std::size_t words;
+    // `rows[c]` is the row of `masks` for the subject character `c`.  Row
+    // zero is for characters that the segment does not contain.
+    std::array<std::uint8_t, 256> rows;
+    // Bit `i` of row `r` (`words` words at `masks[r * words]`) is set if
+    // `pattern_[offset + i]` matches the characters of row `r`.
+    std::vector<std::uint64_t> masks;
+  };
+
+  Kind kind_;
+  // `pattern_` is the lower case pattern, without the leading or trailing "*"
+  // of a `PREFIX` or `SUFFIX` pattern, and with runs of "*" collapsed.
+  std::string pattern_;
+  // For a `GENERAL` pattern, `runs_[i]` is the length of the run of
+  // characters other than "*" and "?" that begins at `pattern_[i]`.
+  std::vector<std::size_t> runs_;
+  // For a `GENERAL` pattern that contains "*", the number of characters
+  // before the first "*" and after the last, which are compared with the
+  // beginning and the end of the subject, and the segments in between.
+  std::size_t head_size_ = 0;
+  std::size_t tail_size_ = 0;
+  std::vector<Segment> segments_;
+
+  // Return whether the specified `subject` is equal to the part of `pattern_`
+  // at the specified `offset` having the same length, where "?" matches any
+  // character.
+  bool equal_at(std::size_t offset, StringView subject) const;
+  // Return the position just past the leftmost occurrence of the specified
+  // `segment` in the specified `subject` that begins at or after the
+  // specified `begin`, or return `std::string::npos` if there is none.
+  static std::size_t find(const Segment& segment, StringView subject,
+                          std::size_t begin);
+
+ public:
+  explicit Glob(StringView pattern);
+
+  // Return whether the specified `subject` matches this pattern.  The result
+  // is the same as that of `glob_match` with the original pattern.
+  bool match(StringView subject) const;
+
+  Kind kind() const { return kind_; }
+  // Return the lower case pattern.  If `kind()` is `LITERAL`, then this is
+  // the literal that the pattern matches, ignoring case.
+  StringView lower_pattern() const { return pattern_; }
+};
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,29 @@
+#pragma once
+
+// This component provides functions for compressing HTTP request bodies in the
+// gzip format, so that `DatadogAgent` can send them with
+// "Content-Encoding: gzip".
+//
+// Compression requires zlib, which is optional.  If this library was built
+// with zlib, then `gzip_zlib.cpp` implements these functions.  Otherwise,
+// `gzip_null.cpp` implements them, and `gzip_available` returns `false`.
+
+#include <datadog/expected.h>
+#include <datadog/string_view.h>
+
+#include <string>
+
+namespace datadog {
+namespace tracing {
+
+// Return whether this library was built with support for gzip compression.
+bool gzip_available();
+
+// Append the gzip compressed form of the specified `source` to the specified
+// `destination`.  Compression favors speed over size.  Return an error if
+// compression is not available or if it fails, in which case `destination` is
+// left unchanged.
+Expected<void> gzip_compress(std::string& destination, StringView source);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,19 @@
+#include "gzip.h"
+
+// This file is included in the build when zlib is not included in the build.
+// It provides an implementation of the gzip functions that always fails, which
+// means that `DatadogAgentConfig::compression_enabled` cannot be set.
+
+namespace datadog {
+namespace tracing {
+
+bool gzip_available() { return false; }
+
+Expected<void> gzip_compress(std::string&, StringView) {
+  return Error{Error::GZIP_COMPRESSION_FAILED,
+               "gzip compression is not available, because this library was "
+               "built without zlib."};
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,58 @@
+#include "gzip.h"
+
+#include <zlib.h>
+
+#include <limits>
+#include <string>
+
+// This file is included in the build when zlib is included in the build.  It
+// implements the gzip functions in terms of zlib's "deflate" API.
+
+namespace datadog {
+namespace tracing {
+
+bool gzip_available() { return true; }
+
+Expected<void> gzip_compress(std::string& destination, StringView source) {
+  if (source.size() > std::numeric_limits<uInt>::max()) {
+    return Error{Error::GZIP_COMPRESSION_FAILED,
+                 "Input is too large for gzip compression."};
+  }
+
+  z_stream stream{};
+  // A window of 2^15 bytes, plus 16 to select the gzip format rather than the
+  // zlib format.
+  const int window_bits = 15 + 16;
+  const int memory_level = 8;
+  if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, window_bits,
+                   memory_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return Error{Error::GZIP_COMPRESSION_FAILED,
+                 "Unable to initialize zlib for gzip compression."};
+  }
+
+  // Compress in one step, into space sufficient for any input.
+  const std::size_t offset = destination.size();
+  destination.resize(offset + deflateBound(&stream, uLong(source.size())));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(source.data()));
+  stream.avail_in = uInt(source.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&destination[offset]);
+  stream.avail_out = uInt(destination.size() - offset);
+  const int rc = deflate(&stream, Z_FINISH);
+  const std::size_t compressed_size = stream.total_out;
+  std::string message;
+  if (rc != Z_STREAM_END) {
+    message = "gzip compression failed: ";
+    message += stream.msg ? stream.msg : "zlib error " + std::to_string(rc);
+  }
+  deflateEnd(&stream);
+
+  if (!message.empty()) {
+    destination.resize(offset);
+    return Error{Error::GZIP_COMPRESSION_FAILED, std::move(message)};
+  }
+  destination.resize(offset + compressed_size);
+  return nullopt;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,165 @@
+#include <datadog/header_map.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+char lower(char c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+
+// Return the 32-bit FNV-1a hash of the specified `name` in lower case.
+std::uint32_t hash_lower(StringView name) {
+  std::uint32_t hash = 2166136261u;
+  for (const char c : name) {
+    hash ^= std::uint8_t(lower(c));
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Return whether the specified `left` and `right` are equal, ignoring the case
+// of ASCII letters.
+bool equals_ignoring_case(StringView left, StringView right) {
+  if (left.size() != right.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < left.size(); ++i) {
+    if (lower(left[i]) != lower(right[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+HeaderMap::Field& HeaderMap::field(std::size_t index) {
+  return index < inline_capacity ? inline_[index]
+                                 : overflow_[index - inline_capacity];
+}
+
+const HeaderMap::Field& HeaderMap::field(std::size_t index) const {
+  return index < inline_capacity ? inline_[index]
+                                 : overflow_[index - inline_capacity];
+}
+
+StringView HeaderMap::name(const Field& field) const {
+  return StringView(chars_.data() + field.offset, field.name_size);
+}
+
+StringView HeaderMap::value(const Field& field) const {
+  return StringView(chars_.data() + field.offset + field.name_size,
+                    field.value_size);
+}
+
+HeaderMap::Field* HeaderMap::find(std::uint32_t hash, StringView name) {
+  return const_cast<Field*>(
+      static_cast<const HeaderMap&>(*this).find(hash, name));
+}
+
+const HeaderMap::Field* HeaderMap::find(std::uint32_t hash,
+                                        StringView name) const {
+  for (std::size_t i = 0; i < size_; ++i) {
+    const Field& candidate = field(i);
+    if (candidate.hash == hash &&
+        equals_ignoring_case(this->name(candidate), name)) {
+      return &candidate;
+    }
+  }
+  return nullptr;
+}
+
+void HeaderMap::push(std::uint32_t hash, StringView name, StringView value) {
+  assert(chars_.size() + name.size() + value.size() <=
+         std::numeric_limits<std::uint32_t>::max());
+  Field added;
+  added.hash = hash;
+  added.offset = std::uint32_t(chars_.size());
+  added.name_size = std::uint32_t(name.size());
+  added.value_size = std::uint32_t(value.size());
+  chars_.append(name.data(), name.size());
+  chars_.append(value.data(), value.size());
+  if (size_ < inline_capacity) {
+    inline_[size_] = added;
+  } else {
+    overflow_.push_back(added);
+  }
+  ++size_;
+}
+
+std::size_t HeaderMap::size() const { return size_; }
+
+bool HeaderMap::empty() const { return size_ == 0; }
+
+void HeaderMap::clear() {
+  chars_.clear();
+  overflow_.clear();
+  size_ = 0;
+}
+
+void HeaderMap::reserve(std::size_t count, std::size_t chars) {
+  chars_.reserve(chars_.size() + chars);
+  if (size_ + count > inline_capacity) {
+    overflow_.reserve(size_ + count - inline_capacity);
+  }
+}
+
+void HeaderMap::append(StringView name, StringView value) {
+  push(hash_lower(name), name, value);
+}
+
+Optional<StringView> HeaderMap::lookup(StringView key) const {
+  if (const Field* found = find(hash_lower(key), key)) {
+    return value(*found);
+  }
+  return nullopt;
+}
+
+void HeaderMap::visit(Visitor visitor) const {
+  for (std::size_t i = 0; i < size_; ++i) {
+    const Field& current = field(i);
+    visitor(name(current), value(current));
+  }
+}
+
+void HeaderMap::set(StringView key, StringView value) {
+  const std::uint32_t hash = hash_lower(key);
+  Field* const found = find(hash, key);
+  if (!found) {
+    push(hash, key, value);
+    return;
+  }
+  if (value.size() <= found->value_size) {
+    // The new value fits where the old one was.
+    chars_.replace(found->offset + found->name_size, value.size(), value.data(),
+                   value.size());
+    found->value_size = std::uint32_t(value.size());
+    return;
+  }
+  // Otherwise, store the header again at the end of `chars_`, and leave the
+  // old characters unused.  The hash of the name is unchanged.
+  const std::size_t offset = chars_.size();
+  chars_.append(key.data(), key.size());
+  chars_.append(value.data(), value.size());
+  found->offset = std::uint32_t(offset);
+  found->name_size = std::uint32_t(key.size());
+  found->value_size = std::uint32_t(value.size());
+}
+
+void HeaderMap::set_all(const Entry* entries, std::size_t count) {
+  std::size_t chars = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    chars += entries[i].first.size() + entries[i].second.size();
+  }
+  reserve(count, chars);
+  for (std::size_t i = 0; i < count; ++i) {
+    set(entries[i].first, entries[i].second);
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
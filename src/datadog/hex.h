@@ -5,7 +5,10 @@
 
 #include <cassert>
 #include <charconv>
+#include <cstddef>
+#include <iterator>
 #include <limits>
+#include <string>
 #include <system_error>
 #include <utility>
 
@@ -29,24 +32,46 @@ std::string hex(UnsignedInteger value) {
   return std::string{std::begin(buffer), result.ptr};
 }
 
-// Return the specified unsigned `value` formatted as a lower-case hexadecimal
-// string with leading zeroes.
+// `HexDigitPairs` is a table of the two lower-case hexadecimal digits of each
+// byte value, so that a byte can be formatted with one lookup.
+struct HexDigitPairs {
+  char digits[256 * 2];
+
+  constexpr HexDigitPairs() : digits() {
+    const char hex_digits[] = "0123456789abcdef";
+    for (int byte = 0; byte < 256; ++byte) {
+      digits[2 * byte] = hex_digits[byte >> 4];
+      digits[2 * byte + 1] = hex_digits[byte & 0xf];
+    }
+  }
+};
+
+inline constexpr HexDigitPairs hex_digit_pairs{};
+
+// Write the specified unsigned `value` as lower-case hexadecimal with leading
+// zeroes into the specified `destination`, which must have room for two
+// characters per byte of `UnsignedInteger`.  Return a pointer to the character
+// following the last character written.
 template <typename UnsignedInteger>
-std::string hex_padded(UnsignedInteger value) {
+char* write_hex_padded(char* destination, UnsignedInteger value) {
   static_assert(!std::numeric_limits<UnsignedInteger>::is_signed);
 
-  // 4 bits per hex digit char.
-  char buffer[std::numeric_limits<UnsignedInteger>::digits / 4];
-
-  const int base = 16;
-  auto result =
-      std::to_chars(std::begin(buffer), std::end(buffer), value, base);
-  assert(result.ec == std::errc());
+  const std::size_t num_bytes = sizeof(UnsignedInteger);
+  for (std::size_t i = num_bytes; i > 0; --i) {
+    const char* const pair = hex_digit_pairs.digits + 2 * (value & 0xff);
+    destination[2 * i - 2] = pair[0];
+    destination[2 * i - 1] = pair[1];
+    value >>= 8;
+  }
+  return destination + 2 * num_bytes;
+}
 
-  const auto num_zeroes = sizeof(buffer) - (result.ptr - std::begin(buffer));
-  std::string padded(num_zeroes, '0');
-  padded.append(std::begin(buffer), result.ptr);
-  return padded;
+// Return the specified unsigned `value` formatted as a lower-case hexadecimal
+// string with leading zeroes.
+template <typename UnsignedInteger>
+std::string hex_padded(UnsignedInteger value) {
+  char buffer[2 * sizeof(UnsignedInteger)];
+  return std::string(buffer, write_hex_padded(buffer, value));
 }
 
 }  // namespace tracing
@@ -78,5 +78,13 @@ Expected<HTTPClient::URL> HTTPClient::URL::parse(StringView input) {
           : std::string(authority_and_path.substr(after_authority))};
 }
 
+Expected<void> HTTPClient::post(
+    const URL& url, HeadersSetter set_headers, SharedBody body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  return post(url, std::move(set_headers), std::string(body.data),
+              std::move(on_response), std::move(on_error), deadline);
+}
+
 }  // namespace tracing
 }  // namespace datadog
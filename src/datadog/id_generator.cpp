@@ -1,6 +1,5 @@
 #include <datadog/id_generator.h>
 
-#include <bitset>
 #include <chrono>
 
 #include "random.h"
@@ -9,6 +8,9 @@ namespace datadog {
 namespace tracing {
 namespace {
 
+// The largest value whose most significant bit, out of 64, is zero.
+constexpr std::uint64_t max_63_bit = 0x7fffffffffffffff;
+
 class DefaultIDGenerator : public IDGenerator {
   const bool trace_id_128_bit_;
 
@@ -31,9 +33,7 @@ class DefaultIDGenerator : public IDGenerator {
       // In 64-bit mode, zero the most significant bit for compatibility with
       // older tracers that can't accept values above
       // `numeric_limits<int64_t>::max()`.
-      std::bitset<64> bits = result.low;
-      bits[63] = 0;
-      result.low = bits.to_ullong();
+      result.low &= max_63_bit;
     }
     return result;
   }
@@ -41,14 +41,25 @@ class DefaultIDGenerator : public IDGenerator {
   std::uint64_t span_id() const override {
     // Zero the most significant bit for compatibility with older tracers that
     // can't accept values above `numeric_limits<int64_t>::max()`.
-    std::bitset<64> bits = random_uint64();
-    bits[63] = 0;
-    return bits.to_ullong();
+    return random_uint64() & max_63_bit;
+  }
+
+  void span_ids(std::uint64_t* ids, std::size_t count) const override {
+    random_uint64s(ids, count);
+    for (std::size_t i = 0; i < count; ++i) {
+      ids[i] &= max_63_bit;
+    }
   }
 };
 
 }  // namespace
 
+void IDGenerator::span_ids(std::uint64_t* ids, std::size_t count) const {
+  for (std::size_t i = 0; i < count; ++i) {
+    ids[i] = span_id();
+  }
+}
+
 std::shared_ptr<const IDGenerator> default_id_generator(bool trace_id_128_bit) {
   return std::make_shared<DefaultIDGenerator>(trace_id_128_bit);
 }
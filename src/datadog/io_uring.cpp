@@ -0,0 +1,291 @@
+#include "io_uring.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <system_error>
+#endif
+
+namespace datadog {
+namespace tracing {
+
+#if defined(__linux__)
+namespace {
+
+// The ring indices are shared with the kernel.  The head of the submission
+// ring and the tail of the completion ring are written by the kernel, and the
+// others by us.
+unsigned load_acquire(const unsigned* index) {
+  return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned* index, unsigned value) {
+  __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+Error setup_error(const char* what, int error_number) {
+  std::string message;
+  message += "Unable to set up io_uring: ";
+  message += what;
+  message += ": ";
+  message += std::generic_category().message(error_number);
+  return Error{Error::SOCKET_HTTP_CLIENT_SETUP_FAILED, std::move(message)};
+}
+
+void* map(int fd, std::size_t size, off_t offset) {
+  void* result = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, offset);
+  return result == MAP_FAILED ? nullptr : result;
+}
+
+}  // namespace
+
+Expected<std::unique_ptr<IoUring>> IoUring::create(unsigned entries) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof params);
+  const int fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+  if (fd < 0) {
+    return setup_error("io_uring_setup", errno);
+  }
+
+  std::unique_ptr<IoUring> ring{new IoUring};
+  ring->fd_ = fd;
+  if (!(params.features & IORING_FEAT_EXT_ARG)) {
+    return Error{Error::SOCKET_HTTP_CLIENT_SETUP_FAILED,
+                 "Unable to set up io_uring: the kernel does not support "
+                 "IORING_FEAT_EXT_ARG."};
+  }
+
+  ring->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(__u32);
+  ring->cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->sq_ring_size_ = ring->cq_ring_size_ =
+        std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+  }
+  ring->sq_ring_ = map(fd, ring->sq_ring_size_, IORING_OFF_SQ_RING);
+  if (!ring->sq_ring_) {
+    return setup_error("mmap", errno);
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ring_ = ring->sq_ring_;
+  } else {
+    ring->cq_ring_ = map(fd, ring->cq_ring_size_, IORING_OFF_CQ_RING);
+    if (!ring->cq_ring_) {
+      return setup_error("mmap", errno);
+    }
+  }
+  ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  ring->sqes_ = map(fd, ring->sqes_size_, IORING_OFF_SQES);
+  if (!ring->sqes_) {
+    return setup_error("mmap", errno);
+  }
+
+  char* const sq = static_cast<char*>(ring->sq_ring_);
+  ring->sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  ring->sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  ring->sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  ring->sq_entries_ =
+      *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+  ring->sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  char* const cq = static_cast<char*>(ring->cq_ring_);
+  ring->cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  ring->cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  ring->cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  ring->cqes_ = cq + params.cq_off.cqes;
+
+  return ring;
+}
+
+IoUring::~IoUring() {
+  // Closing the ring cancels the operations still pending.
+  if (sqes_) {
+    ::munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ && cq_ring_ != sq_ring_) {
+    ::munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_) {
+    ::munmap(sq_ring_, sq_ring_size_);
+  }
+  if (fd_ != -1) {
+    ::close(fd_);
+  }
+}
+
+Expected<void> IoUring::register_buffer(void* data, std::size_t size) {
+  iovec buffer{data, size};
+  if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, &buffer,
+                1) != 0) {
+    return setup_error("IORING_REGISTER_BUFFERS", errno);
+  }
+  buffer_ = data;
+  return nullopt;
+}
+
+void* IoUring::next_entry() {
+  const unsigned tail = *sq_tail_ + num_queued_;
+  if (tail - load_acquire(sq_head_) >= sq_entries_) {
+    return nullptr;
+  }
+  const unsigned index = tail & sq_mask_;
+  auto* entry = static_cast<io_uring_sqe*>(sqes_) + index;
+  std::memset(entry, 0, sizeof *entry);
+  sq_array_[index] = index;
+  ++num_queued_;
+  return entry;
+}
+
+bool IoUring::sendmsg(int fd, const msghdr* message, int flags,
+                      std::uint64_t user_data) {
+  auto* entry = static_cast<io_uring_sqe*>(next_entry());
+  if (!entry) {
+    return false;
+  }
+  entry->opcode = IORING_OP_SENDMSG;
+  entry->fd = fd;
+  entry->addr = reinterpret_cast<std::uintptr_t>(message);
+  entry->len = 1;
+  entry->msg_flags = unsigned(flags);
+  entry->user_data = user_data;
+  return true;
+}
+
+bool IoUring::read_fixed(int fd, void* data, unsigned size,
+                         std::uint64_t user_data) {
+  auto* entry = static_cast<io_uring_sqe*>(next_entry());
+  if (!entry) {
+    return false;
+  }
+  entry->opcode = IORING_OP_READ_FIXED;
+  entry->fd = fd;
+  entry->addr = reinterpret_cast<std::uintptr_t>(data);
+  entry->len = size;
+  // Sockets have no file offset.  -1 means "the current position."
+  entry->off = std::uint64_t(-1);
+  entry->buf_index = 0;
+  entry->user_data = user_data;
+  return true;
+}
+
+bool IoUring::poll(int fd, short events, std::uint64_t user_data) {
+  auto* entry = static_cast<io_uring_sqe*>(next_entry());
+  if (!entry) {
+    return false;
+  }
+  entry->opcode = IORING_OP_POLL_ADD;
+  entry->fd = fd;
+  entry->poll32_events = unsigned(events);
+  entry->user_data = user_data;
+  return true;
+}
+
+bool IoUring::cancel(std::uint64_t target, std::uint64_t user_data) {
+  auto* entry = static_cast<io_uring_sqe*>(next_entry());
+  if (!entry) {
+    return false;
+  }
+  entry->opcode = IORING_OP_ASYNC_CANCEL;
+  entry->fd = -1;
+  entry->addr = target;
+  entry->user_data = user_data;
+  return true;
+}
+
+Expected<void> IoUring::submit_and_wait(std::chrono::nanoseconds timeout) {
+  store_release(sq_tail_, *sq_tail_ + num_queued_);
+  unsigned to_submit = num_queued_;
+  num_queued_ = 0;
+
+  const auto seconds =
+      std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  __kernel_timespec time{seconds.count(), (timeout - seconds).count()};
+  if (timeout.count() < 0) {
+    time = __kernel_timespec{0, 0};
+  }
+  io_uring_getevents_arg arg;
+  std::memset(&arg, 0, sizeof arg);
+  arg.ts = reinterpret_cast<std::uintptr_t>(&time);
+
+  for (;;) {
+    const long rc =
+        ::syscall(__NR_io_uring_enter, fd_, to_submit, 1,
+                  IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                  sizeof arg);
+    if (rc >= 0) {
+      to_submit -= unsigned(rc);
+      if (to_submit == 0) {
+        return nullopt;
+      }
+      continue;
+    }
+    if (errno == ETIME || (errno == EINTR && to_submit == 0)) {
+      return nullopt;
+    }
+    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+      continue;
+    }
+    std::string message;
+    message += "io_uring_enter failed: ";
+    message += std::generic_category().message(errno);
+    return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                 std::move(message)};
+  }
+}
+
+bool IoUring::pop(Completion& completion) {
+  const unsigned head = *cq_head_;
+  if (head == load_acquire(cq_tail_)) {
+    return false;
+  }
+  const auto& entry = static_cast<const io_uring_cqe*>(cqes_)[head & cq_mask_];
+  completion.user_data = entry.user_data;
+  completion.result = entry.res;
+  store_release(cq_head_, head + 1);
+  return true;
+}
+
+#else
+
+Expected<std::unique_ptr<IoUring>> IoUring::create(unsigned) {
+  return Error{Error::SOCKET_HTTP_CLIENT_SETUP_FAILED,
+               "io_uring is available only on Linux."};
+}
+
+IoUring::~IoUring() {}
+
+Expected<void> IoUring::register_buffer(void*, std::size_t) {
+  return Error{Error::SOCKET_HTTP_CLIENT_SETUP_FAILED,
+               "io_uring is available only on Linux."};
+}
+
+void* IoUring::next_entry() { return nullptr; }
+
+bool IoUring::sendmsg(int, const msghdr*, int, std::uint64_t) { return false; }
+
+bool IoUring::read_fixed(int, void*, unsigned, std::uint64_t) { return false; }
+
+bool IoUring::poll(int, short, std::uint64_t) { return false; }
+
+bool IoUring::cancel(std::uint64_t, std::uint64_t) { return false; }
+
+Expected<void> IoUring::submit_and_wait(std::chrono::nanoseconds) {
+  return nullopt;
+}
+
+bool IoUring::pop(Completion&) { return false; }
+
+#endif
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,108 @@
+#pragma once
+
+// This component provides a `class`, `IoUring`, that is a minimal wrapper
+// around a Linux io_uring instance: a pair of ring buffers shared with the
+// kernel, one on which I/O operations are submitted and one on which their
+// completions are delivered.  Submitting any number of operations and waiting
+// for their completions is a single system call, and operations on a buffer
+// registered with `register_buffer` need not map the buffer into the kernel
+// each time.
+//
+// Only what `SocketHTTPClient` needs is provided: socket sends and reads,
+// polls, and cancellation.  An `IoUring` is not thread-safe.  The kernel must
+// support `IORING_FEAT_EXT_ARG` (Linux 5.11), so that waiting for completions
+// can time out without a timeout operation.
+//
+// On platforms other than Linux, `IoUring::create` always fails.
+
+#include <datadog/expected.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+struct msghdr;
+
+namespace datadog {
+namespace tracing {
+
+class IoUring {
+ public:
+  struct Completion {
+    // The `user_data` of the completed operation.
+    std::uint64_t user_data;
+    // The result of the operation, e.g. the number of bytes transferred, or a
+    // negated `errno` value.
+    int result;
+  };
+
+ private:
+  int fd_ = -1;
+  // The mappings of the rings, which might be the same mapping.
+  void* sq_ring_ = nullptr;
+  std::size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  std::size_t cq_ring_size_ = 0;
+  void* sqes_ = nullptr;
+  std::size_t sqes_size_ = 0;
+  // Pointers into the submission ring.
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned* sq_array_ = nullptr;
+  // Pointers into the completion ring.
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  void* cqes_ = nullptr;
+  // The number of operations queued but not yet submitted to the kernel.
+  unsigned num_queued_ = 0;
+  // The buffer registered by `register_buffer`, if any.
+  const void* buffer_ = nullptr;
+
+  IoUring() = default;
+  // Return the next submission queue entry, zeroed, or null if the queue is
+  // full.
+  void* next_entry();
+
+ public:
+  // Return a new instance having room for at least the specified `entries`
+  // queued operations, or return an error if io_uring is not available.
+  static Expected<std::unique_ptr<IoUring>> create(unsigned entries);
+  ~IoUring();
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  // Register the specified buffer of `size` bytes beginning at `data`, which
+  // must outlive this object, for use by `read_fixed`.
+  Expected<void> register_buffer(void* data, std::size_t size);
+
+  // Queue an operation, to be identified in its completion by `user_data`.
+  // Return false if the submission queue is full.  The operation is submitted
+  // by the next call to `submit_and_wait`, and the memory it refers to must
+  // remain valid until it completes.
+  bool sendmsg(int fd, const msghdr* message, int flags,
+               std::uint64_t user_data);
+  // Read into the specified `size` bytes at `data`, which must be within the
+  // buffer registered by `register_buffer`.
+  bool read_fixed(int fd, void* data, unsigned size, std::uint64_t user_data);
+  bool poll(int fd, short events, std::uint64_t user_data);
+  // Cancel the pending operation identified by `target`.  The cancelled
+  // operation completes as usual, likely with `-ECANCELED`.
+  bool cancel(std::uint64_t target, std::uint64_t user_data);
+
+  // Submit the queued operations, and then wait until a completion is
+  // available or until the specified `timeout` elapses.  Return an error
+  // only if the operations could not be submitted.
+  Expected<void> submit_and_wait(std::chrono::nanoseconds timeout);
+
+  // If a completion is available, then remove the oldest into the specified
+  // `completion` and return true.  Otherwise, return false.
+  bool pop(Completion& completion);
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,107 @@
+#include "json_writer.h"
+
+namespace datadog {
+namespace tracing {
+
+void JSONWriter::write_string(StringView text) {
+  static const char hex_digits[] = "0123456789abcdef";
+  std::string& buffer = *buffer_;
+  buffer += '"';
+  // Copy runs of characters that need no escape all at once.
+  const char* run = text.data();
+  const char* const end = text.data() + text.size();
+  for (const char* current = run; current != end; ++current) {
+    const unsigned char c = *current;
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    buffer.append(run, current - run);
+    run = current + 1;
+    buffer += '\\';
+    switch (c) {
+      case '"':
+      case '\\':
+        buffer += char(c);
+        break;
+      case '\b':
+        buffer += 'b';
+        break;
+      case '\f':
+        buffer += 'f';
+        break;
+      case '\n':
+        buffer += 'n';
+        break;
+      case '\r':
+        buffer += 'r';
+        break;
+      case '\t':
+        buffer += 't';
+        break;
+      default:
+        buffer += "u00";
+        buffer += hex_digits[c >> 4];
+        buffer += hex_digits[c & 0xF];
+    }
+  }
+  buffer.append(run, end - run);
+  buffer += '"';
+}
+
+void JSONWriter::begin_object() {
+  separate();
+  *buffer_ += '{';
+  after_value_ = false;
+}
+
+void JSONWriter::end_object() {
+  *buffer_ += '}';
+  after_value_ = true;
+}
+
+void JSONWriter::begin_array() {
+  separate();
+  *buffer_ += '[';
+  after_value_ = false;
+}
+
+void JSONWriter::end_array() {
+  *buffer_ += ']';
+  after_value_ = true;
+}
+
+void JSONWriter::key(StringView key) {
+  separate();
+  write_string(key);
+  *buffer_ += ':';
+  after_value_ = false;
+}
+
+void JSONWriter::value(StringView text) {
+  separate();
+  write_string(text);
+  after_value_ = true;
+}
+
+void JSONWriter::value(bool boolean) {
+  separate();
+  *buffer_ += boolean ? "true" : "false";
+  after_value_ = true;
+}
+
+void JSONWriter::raw(StringView json) {
+  separate();
+  buffer_->append(json.data(), json.size());
+  after_value_ = true;
+}
+
+void JSONWriter::value(const std::vector<std::string>& texts) {
+  begin_array();
+  for (const auto& text : texts) {
+    value(text);
+  }
+  end_array();
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,84 @@
+#pragma once
+
+// This component provides a class, `JSONWriter`, that appends JSON to a
+// `std::string` as each value is written, rather than building a
+// `nlohmann::json` value and then serializing it.
+//
+// Values are written in document order.  `JSONWriter` inserts the commas and
+// colons between keys and values, but does not otherwise check that the calls
+// produce valid JSON, e.g. that each `begin_object` has a matching
+// `end_object`.
+//
+// Strings are written with the escapes that JSON requires.  Other bytes,
+// including UTF-8 encoded characters, are copied unchanged.
+
+#include <datadog/string_view.h>
+
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+class JSONWriter {
+  std::string* buffer_;
+  // Whether the next key or value must be preceded by a comma.
+  bool after_value_ = false;
+
+  void separate() {
+    if (after_value_) {
+      *buffer_ += ',';
+    }
+  }
+  void write_string(StringView text);
+
+ public:
+  // Create a writer that appends to the specified `buffer`.
+  explicit JSONWriter(std::string& buffer) : buffer_(&buffer) {}
+
+  void begin_object();
+  void end_object();
+  void begin_array();
+  void end_array();
+
+  // Write the specified `key` of an object member.  The next value written is
+  // the member's value.
+  void key(StringView key);
+
+  void value(StringView text);
+  void value(const char* text) { value(StringView(text)); }
+  void value(const std::string& text) { value(StringView(text)); }
+  void value(bool boolean);
+  template <typename Integer>
+  std::enable_if_t<std::is_integral<Integer>::value &&
+                   !std::is_same<Integer, bool>::value>
+  value(Integer integer);
+  // Write an array of the specified `texts`.
+  void value(const std::vector<std::string>& texts);
+  // Write the specified `json`, which must be a complete JSON value, as is.
+  void raw(StringView json);
+
+  // Write an object member having the specified `key` and `value`.
+  template <typename Value>
+  void member(StringView key, const Value& value) {
+    this->key(key);
+    this->value(value);
+  }
+};
+
+template <typename Integer>
+std::enable_if_t<std::is_integral<Integer>::value &&
+                 !std::is_same<Integer, bool>::value>
+JSONWriter::value(Integer integer) {
+  separate();
+  char digits[24];
+  const auto result = std::to_chars(digits, digits + sizeof digits, integer);
+  buffer_->append(digits, result.ptr - digits);
+  after_value_ = true;
+}
+
+}  // namespace tracing
+}  // namespace datadog
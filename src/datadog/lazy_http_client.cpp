@@ -0,0 +1,74 @@
+#include "lazy_http_client.h"
+
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+Error null_client() {
+  return Error{Error::DATADOG_AGENT_NULL_HTTP_CLIENT,
+               "LazyHTTPClient: HTTP client cannot be null."};
+}
+
+}  // namespace
+
+LazyHTTPClient::LazyHTTPClient(Factory make_client)
+    : make_client_(std::move(make_client)) {}
+
+std::shared_ptr<HTTPClient> LazyHTTPClient::client() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!client_ && make_client_) {
+    client_ = make_client_();
+    make_client_ = nullptr;
+  }
+  return client_;
+}
+
+Expected<void> LazyHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  const auto delegate = client();
+  if (!delegate) {
+    return null_client();
+  }
+  return delegate->post(url, std::move(set_headers), std::move(body),
+                        std::move(on_response), std::move(on_error), deadline);
+}
+
+Expected<void> LazyHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, SharedBody body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  const auto delegate = client();
+  if (!delegate) {
+    return null_client();
+  }
+  return delegate->post(url, std::move(set_headers), std::move(body),
+                        std::move(on_response), std::move(on_error), deadline);
+}
+
+void LazyHTTPClient::drain(std::chrono::steady_clock::time_point deadline) {
+  std::shared_ptr<HTTPClient> delegate;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    delegate = client_;
+  }
+  if (delegate) {
+    delegate->drain(deadline);
+  }
+}
+
+std::string LazyHTTPClient::config() const {
+  return nlohmann::json::object({{"type", "datadog::tracing::LazyHTTPClient"}})
+      .dump();
+}
+
+bool LazyHTTPClient::started() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return client_ != nullptr;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,58 @@
+#pragma once
+
+// This component provides a class, `LazyHTTPClient`, that implements the
+// `HTTPClient` interface by forwarding to another `HTTPClient` that it creates
+// when the first request is sent.  It is used instead of the default HTTP
+// client if `DatadogAgentConfig::lazy_start` is enabled, so that a tracer that
+// never sends anything never starts the client's thread.
+//
+// `drain` does nothing before the client is created, since then there are no
+// requests to wait for.
+
+#include <datadog/http_client.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace datadog {
+namespace tracing {
+
+class LazyHTTPClient : public HTTPClient {
+ public:
+  using Factory = std::function<std::shared_ptr<HTTPClient>()>;
+
+ private:
+  mutable std::mutex mutex_;
+  Factory make_client_;
+  std::shared_ptr<HTTPClient> client_;
+
+  // Return the client, creating it if necessary.  Return null if the factory
+  // returned null.
+  std::shared_ptr<HTTPClient> client();
+
+ public:
+  explicit LazyHTTPClient(Factory make_client);
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      SharedBody body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override;
+
+  // Return the type of this object.  The configuration of the client is not
+  // included, so that the result does not change when the client is created.
+  std::string config() const override;
+
+  // Return whether the client has been created.
+  bool started() const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -22,8 +22,10 @@ Limiter::Limiter(const Clock& clock, int max_tokens, double refresh_rate,
                       tokens_per_refresh_;
 
   auto now = clock_().tick;
-  next_refresh_ = now + refresh_interval_;
-  current_period_ = std::chrono::time_point_cast<std::chrono::seconds>(now);
+  next_refresh_ = (now + refresh_interval_).time_since_epoch().count();
+  current_period_ = std::chrono::time_point_cast<std::chrono::seconds>(now)
+                        .time_since_epoch()
+                        .count();
   previous_rates_sum_ =
       std::accumulate(previous_rates_.begin(), previous_rates_.end(), 0.0);
 }
@@ -37,62 +39,110 @@ Limiter::Result Limiter::allow() { return allow(1); }
 Limiter::Result Limiter::allow(int tokens_requested) {
   auto now = clock_().tick;
 
-  // update effective rate calculations
-  auto intervals = std::chrono::duration_cast<std::chrono::seconds>(
-                       std::chrono::time_point_cast<std::chrono::seconds>(now) -
-                       current_period_)
-                       .count();
-  if (intervals > 0) {
-    if (std::size_t(intervals) >= previous_rates_.size()) {
-      std::fill(previous_rates_.begin() + 1, previous_rates_.end(), 1.0);
+  rotate_periods(now);
+  const int num_requested = ++num_requested_;
+  refill(now);
+  // determine if allowed or not
+  const bool allowed = take(tokens_requested);
+  int num_allowed;
+  if (allowed) {
+    num_allowed = ++num_allowed_;
+  } else {
+    num_allowed = num_allowed_.load(std::memory_order_relaxed);
+  }
+
+  // Another thread might have started a new period since we counted our
+  // request, so clamp the current period's rate.
+  double current_rate = 1.0;
+  if (num_requested > 0 && num_allowed < num_requested) {
+    current_rate = double(num_allowed) / double(num_requested);
+  }
+  // `effective_rate` is guaranteed to be between 0.0 and 1.0.
+  double effective_rate = (previous_rates_sum_ + current_rate) /
+                          (previous_rates_.size() + 1);
+
+  return {allowed, *Rate::from(effective_rate)};
+}
+
+void Limiter::rotate_periods(TimePoint now) {
+  const auto intervals_since = [&](Duration::rep period) {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::time_point_cast<std::chrono::seconds>(now) -
+               TimePoint(Duration(period)))
+        .count();
+  };
+
+  if (intervals_since(current_period_.load(std::memory_order_acquire)) <= 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(periods_mutex_);
+  // Another thread might have updated the history while we were waiting.
+  const auto intervals = intervals_since(current_period_);
+  if (intervals <= 0) {
+    return;
+  }
+
+  const int num_allowed = num_allowed_.exchange(0);
+  const int num_requested = num_requested_.exchange(0);
+  if (std::size_t(intervals) >= previous_rates_.size()) {
+    std::fill(previous_rates_.begin() + 1, previous_rates_.end(), 1.0);
+  } else {
+    std::move_backward(previous_rates_.begin(),
+                       previous_rates_.end() - intervals,
+                       previous_rates_.end());
+    if (num_requested > 0) {
+      previous_rates_[intervals - 1] =
+          std::min(1.0, double(num_allowed) / double(num_requested));
     } else {
-      std::move_backward(previous_rates_.begin(),
-                         previous_rates_.end() - intervals,
-                         previous_rates_.end());
-      if (num_requested_ > 0) {
-        previous_rates_[intervals - 1] =
-            double(num_allowed_) / double(num_requested_);
-      } else {
-        previous_rates_[intervals - 1] = 1.0;
-      }
-      if (intervals - 2 > 0) {
-        std::fill(previous_rates_.begin(),
-                  previous_rates_.begin() + intervals - 2, 1.0);
-      }
+      previous_rates_[intervals - 1] = 1.0;
+    }
+    if (intervals - 2 > 0) {
+      std::fill(previous_rates_.begin(),
+                previous_rates_.begin() + intervals - 2, 1.0);
     }
-    previous_rates_sum_ =
-        std::accumulate(previous_rates_.begin(), previous_rates_.end(), 0.0);
-    num_allowed_ = 0;
-    num_requested_ = 0;
-    current_period_ = now;
   }
+  previous_rates_sum_ =
+      std::accumulate(previous_rates_.begin(), previous_rates_.end(), 0.0);
+  current_period_.store(now.time_since_epoch().count(),
+                        std::memory_order_release);
+}
 
-  num_requested_++;
+void Limiter::refill(TimePoint now) {
   // refill "tokens"
-  if (now >= next_refresh_) {
-    intervals = (now - next_refresh_).count() / refresh_interval_.count() + 1;
-    if (intervals > 0) {
-      next_refresh_ += refresh_interval_ * intervals;
-      num_tokens_ += static_cast<int>(intervals * tokens_per_refresh_);
-      if (num_tokens_ > max_tokens_) {
-        num_tokens_ = max_tokens_;
-      }
+  const auto now_ticks = now.time_since_epoch().count();
+  auto next_refresh = next_refresh_.load(std::memory_order_relaxed);
+  while (now_ticks >= next_refresh) {
+    const auto intervals =
+        (now_ticks - next_refresh) / refresh_interval_.count() + 1;
+    // Only the thread that advances `next_refresh_` adds the tokens for the
+    // elapsed intervals.
+    if (!next_refresh_.compare_exchange_weak(
+            next_refresh, next_refresh + refresh_interval_.count() * intervals,
+            std::memory_order_relaxed)) {
+      continue;
     }
-  }
-  // determine if allowed or not
-  bool allowed = false;
-  if (num_tokens_ >= tokens_requested) {
-    allowed = true;
-    num_allowed_++;
-    num_tokens_ -= tokens_requested;
-  }
 
-  // `effective_rate` is guaranteed to be between 0.0 and 1.0.
-  double effective_rate =
-      (previous_rates_sum_ + double(num_allowed_) / double(num_requested_)) /
-      (previous_rates_.size() + 1);
+    const auto added = intervals * tokens_per_refresh_;
+    int num_tokens = num_tokens_.load(std::memory_order_relaxed);
+    int refilled;
+    do {
+      refilled = int(std::min<Duration::rep>(max_tokens_, num_tokens + added));
+    } while (!num_tokens_.compare_exchange_weak(num_tokens, refilled,
+                                                std::memory_order_relaxed));
+    return;
+  }
+}
 
-  return {allowed, *Rate::from(effective_rate)};
+bool Limiter::take(int tokens) {
+  int num_tokens = num_tokens_.load(std::memory_order_relaxed);
+  while (num_tokens >= tokens) {
+    if (num_tokens_.compare_exchange_weak(num_tokens, num_tokens - tokens,
+                                          std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 }  // namespace tracing
@@ -6,11 +6,21 @@
 // `Limiter` is used by the `TraceSampler` and the `SpanSampler` to enforce
 // their respective `max_per_second` configuration parameters.
 //
+// `Limiter::allow` may be called concurrently from multiple threads.  Taking
+// and refilling tokens are compare-and-swap operations on atomic counters, so
+// that threads making sampling decisions at the same time do not serialize on
+// a lock.  A mutex is locked only to update the effective rate history, which
+// happens at most once per second.  Under contention, the effective rate is
+// approximate, but no more tokens are taken than the bucket provides.
+//
 // [1]: https://en.wikipedia.org/wiki/Token_bucket
 
 #include <datadog/clock.h>
 #include <datadog/rate.h>
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <vector>
 
 namespace datadog {
@@ -27,22 +37,41 @@ class Limiter {
           int tokens_per_refresh);
   Limiter(const Clock& clock, double allowed_per_second);
 
+  Limiter(const Limiter&) = delete;
+
   Result allow();
   Result allow(int tokens);
 
  private:
+  using Duration = std::chrono::steady_clock::duration;
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  // Add tokens for each refresh interval that has elapsed as of the specified
+  // `now`.
+  void refill(TimePoint now);
+  // Take the specified number of `tokens`, if available.  Return whether the
+  // tokens were taken.
+  bool take(int tokens);
+  // Update the effective rate history if the specified `now` is in a later
+  // period than the current one.
+  void rotate_periods(TimePoint now);
+
   Clock clock_;
-  int num_tokens_;
+  std::atomic<int> num_tokens_;
   int max_tokens_;
-  std::chrono::steady_clock::duration refresh_interval_;
+  Duration refresh_interval_;
   int tokens_per_refresh_;
-  std::chrono::steady_clock::time_point next_refresh_;
+  // `next_refresh_` and `current_period_` are `TimePoint`s, stored as the
+  // number of ticks since the steady clock's epoch.
+  std::atomic<Duration::rep> next_refresh_;
   // effective rate fields
+  // `periods_mutex_` protects `previous_rates_`.
+  std::mutex periods_mutex_;
   std::vector<double> previous_rates_;
-  double previous_rates_sum_;
-  std::chrono::steady_clock::time_point current_period_;
-  int num_allowed_ = 0;
-  int num_requested_ = 0;
+  std::atomic<double> previous_rates_sum_;
+  std::atomic<Duration::rep> current_period_;
+  std::atomic<int> num_allowed_{0};
+  std::atomic<int> num_requested_{0};
 };
 
 }  // namespace tracing
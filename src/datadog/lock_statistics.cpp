@@ -0,0 +1,52 @@
+#include <datadog/lock_statistics.h>
+
+#include <cstddef>
+
+namespace datadog {
+namespace tracing {
+
+#if defined(DD_TRACE_LOCK_STATISTICS)
+
+namespace {
+
+// The names of the `TracerLock`s, in the order declared.
+const StringView lock_names[] = {
+    "TraceSegment::mutex_", "TraceSegment::flush_mutex_",
+    "DatadogAgent::mutex_", "DatadogAgent::Shard::mutex",
+    "ConfigManager::mutex_", "CurlImpl::mutex_",
+    "CerrLogger::mutex_",
+};
+
+constexpr std::size_t num_locks = sizeof lock_names / sizeof lock_names[0];
+
+LockCounters counters[num_locks];
+
+}  // namespace
+
+LockCounters& lock_counters(TracerLock lock) {
+  return counters[std::size_t(lock)];
+}
+
+std::vector<LockStatistics> lock_statistics() {
+  std::vector<LockStatistics> result(num_locks);
+  for (std::size_t i = 0; i < num_locks; ++i) {
+    LockStatistics& statistics = result[i];
+    statistics.name = lock_names[i];
+    statistics.acquisitions =
+        counters[i].acquisitions.load(std::memory_order_relaxed);
+    statistics.contentions =
+        counters[i].contentions.load(std::memory_order_relaxed);
+    statistics.wait_time = std::chrono::nanoseconds(
+        counters[i].wait_nanoseconds.load(std::memory_order_relaxed));
+  }
+  return result;
+}
+
+#else
+
+std::vector<LockStatistics> lock_statistics() { return {}; }
+
+#endif
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,73 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// The most that a shard can drift before the state is refreshed.  For small
+// limits, a sixty-fourth of the limit is used instead.
+constexpr std::int64_t max_granularity = 64 * 1024;
+
+}  // namespace
+
+MemoryBudget::MemoryBudget(std::size_t limit)
+    : limit_(limit),
+      granularity_(std::clamp<std::int64_t>(std::int64_t(limit / 64), 1,
+                                            max_granularity)) {}
+
+MemoryBudget::Shard& MemoryBudget::shard() {
+  static std::atomic<std::size_t> next_shard{0};
+  thread_local const std::size_t shard_index = next_shard++ % num_shards;
+  return shards_[shard_index];
+}
+
+void MemoryBudget::add(std::int64_t bytes) {
+  const std::int64_t before =
+      shard().bytes.fetch_add(bytes, std::memory_order_relaxed);
+  if (limit_ != 0 && before / granularity_ != (before + bytes) / granularity_) {
+    refresh();
+  }
+}
+
+void MemoryBudget::charge(std::size_t bytes) { add(std::int64_t(bytes)); }
+
+void MemoryBudget::release(std::size_t bytes) { add(-std::int64_t(bytes)); }
+
+std::size_t MemoryBudget::limit() const { return limit_; }
+
+std::size_t MemoryBudget::bytes() const {
+  std::int64_t total = 0;
+  for (const Shard& shard : shards_) {
+    total += shard.bytes.load(std::memory_order_relaxed);
+  }
+  return total < 0 ? 0 : std::size_t(total);
+}
+
+MemoryBudget::State MemoryBudget::state() const {
+  return state_.load(std::memory_order_relaxed);
+}
+
+MemoryBudget::State MemoryBudget::refresh() {
+  if (limit_ == 0) {
+    return NORMAL;
+  }
+  const std::size_t total = bytes();
+  const State state =
+      total >= limit_ ? SHED : (total >= limit_ / 2 ? FLUSH : NORMAL);
+  state_.store(state, std::memory_order_relaxed);
+  return state;
+}
+
+MemoryCharge::MemoryCharge(std::shared_ptr<MemoryBudget> budget,
+                           std::size_t bytes)
+    : budget_(std::move(budget)), bytes_(bytes) {
+  budget_->charge(bytes_);
+}
+
+MemoryCharge::~MemoryCharge() { budget_->release(bytes_); }
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,91 @@
+#pragma once
+
+// This component provides a class, `MemoryBudget`, that accounts for the
+// memory held by a tracer, and compares it against a configured limit.  See
+// `TracerConfig::memory_budget`.
+//
+// The memory accounted for is that of the spans and trace segments in
+// progress, the trace chunks buffered by the `DatadogAgent` collector, the
+// trace request bodies in flight, and the requests awaiting retry.  Spans are
+// counted at their fixed size, i.e. not including the heap allocated contents
+// of their tags, so the total is an estimate from below.
+//
+// Charges and releases are made on many threads, so they are added to one of
+// several shards, chosen per thread, so that threads seldom contend for the
+// same cache line.  The `state` of the budget is recomputed from the sum of the
+// shards only when a shard's total crosses a multiple of a granularity that
+// is a small fraction of the limit, and so `state` may lag the true total by
+// up to `num_shards` times that granularity.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace datadog {
+namespace tracing {
+
+class MemoryBudget {
+ public:
+  enum State {
+    // Less than half of the budget is in use.
+    NORMAL,
+    // At least half of the budget is in use.  Buffered trace chunks are
+    // flushed early.
+    FLUSH,
+    // The whole budget is in use.  New child spans are not recorded, and
+    // trace chunks are dropped.
+    SHED,
+  };
+
+ private:
+  struct alignas(64) Shard {
+    // Signed, because memory charged on one thread might be released on
+    // another.
+    std::atomic<std::int64_t> bytes{0};
+  };
+  static constexpr std::size_t num_shards = 16;
+
+  // Zero if there is no limit.
+  const std::size_t limit_;
+  const std::int64_t granularity_;
+  Shard shards_[num_shards];
+  std::atomic<State> state_{NORMAL};
+
+  Shard& shard();
+  void add(std::int64_t bytes);
+
+ public:
+  // Create a budget of the specified `limit` bytes, or with no limit if
+  // `limit` is zero.  Memory is accounted for either way.
+  explicit MemoryBudget(std::size_t limit);
+
+  // Account for the specified number of `bytes` having been allocated or
+  // freed, respectively.
+  void charge(std::size_t bytes);
+  void release(std::size_t bytes);
+
+  std::size_t limit() const;
+  // Return the number of bytes in use.
+  std::size_t bytes() const;
+  // Return the state of the budget as of the most recent refresh.
+  State state() const;
+  // Recompute `state` from the number of bytes in use, and return it.
+  State refresh();
+};
+
+// `MemoryCharge` charges a `MemoryBudget` for some bytes for as long as it
+// exists, e.g. for the lifetime of the callbacks of an HTTP request.
+class MemoryCharge {
+  std::shared_ptr<MemoryBudget> budget_;
+  std::size_t bytes_;
+
+ public:
+  MemoryCharge(std::shared_ptr<MemoryBudget> budget, std::size_t bytes);
+  ~MemoryCharge();
+  MemoryCharge(const MemoryCharge&) = delete;
+  MemoryCharge& operator=(const MemoryCharge&) = delete;
+};
+
+}  // namespace tracing
+}  // namespace datadog
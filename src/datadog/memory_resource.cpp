@@ -0,0 +1,78 @@
+#include <datadog/memory_resource.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "block_cache.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+class GlobalMemoryResource : public MemoryResource {
+ public:
+  void* allocate(std::size_t size) override { return ::operator new(size); }
+  void deallocate(void* block, std::size_t) noexcept override {
+    ::operator delete(block);
+  }
+};
+
+// The `MemoryResource` from which blocks are allocated, or null if no block
+// has been allocated and none has been installed.  Once not null, it never
+// changes.
+std::atomic<MemoryResource*> block_resource{nullptr};
+
+// Block caches are destroyed with their threads, possibly after static
+// objects, so the resources that they return blocks to are never destroyed.
+MemoryResource& global_memory_resource() {
+  static auto* const resource = new GlobalMemoryResource;
+  return *resource;
+}
+
+std::shared_ptr<MemoryResource>* installed_resource = nullptr;
+
+}  // namespace
+
+MemoryResource& block_memory_resource() {
+  MemoryResource* resource = block_resource.load(std::memory_order_acquire);
+  if (resource) {
+    return *resource;
+  }
+  MemoryResource* const global = &global_memory_resource();
+  if (block_resource.compare_exchange_strong(resource, global,
+                                             std::memory_order_acq_rel)) {
+    return *global;
+  }
+  // Another thread settled it first.
+  return *resource;
+}
+
+Expected<void> install_memory_resource(
+    const std::shared_ptr<MemoryResource>& resource) {
+  MemoryResource* previous = nullptr;
+  if (block_resource.compare_exchange_strong(previous, resource.get(),
+                                             std::memory_order_acq_rel)) {
+    installed_resource = new std::shared_ptr<MemoryResource>(resource);
+    return nullopt;
+  }
+  if (previous == resource.get()) {
+    return nullopt;
+  }
+
+  std::string message;
+  message +=
+      "Unable to install the configured memory resource, because spans or "
+      "trace segments have already been allocated from ";
+  message += previous == &global_memory_resource()
+                 ? "the global allocator"
+                 : "a different memory resource";
+  message +=
+      ".  A memory resource must be configured in the first Tracer, before "
+      "any span is created.";
+  return Error{Error::MEMORY_RESOURCE_CONFLICT, std::move(message)};
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -4,6 +4,8 @@
 
 #include <cassert>
 #include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <type_traits>
 
@@ -11,13 +13,40 @@ namespace datadog {
 namespace tracing {
 namespace msgpack {
 namespace {
-// MessagePack values are prefixed by a byte naming their type.
+// MessagePack values are prefixed by a byte naming their type.  The "fix"
+// types instead carry a small value or size in the low bits of that byte.
 namespace types {
+constexpr auto ARRAY16 = std::byte(0xDC);
 constexpr auto ARRAY32 = std::byte(0xDD);
+constexpr auto BIN8 = std::byte(0xC4);
+constexpr auto BIN16 = std::byte(0xC5);
+constexpr auto BIN32 = std::byte(0xC6);
+constexpr auto BOOLEAN_FALSE = std::byte(0xC2);
+constexpr auto BOOLEAN_TRUE = std::byte(0xC3);
 constexpr auto DOUBLE = std::byte(0xCB);
+constexpr auto EXT8 = std::byte(0xC7);
+constexpr auto EXT16 = std::byte(0xC8);
+constexpr auto EXT32 = std::byte(0xC9);
+constexpr auto FIXEXT1 = std::byte(0xD4);
+constexpr auto FIXEXT16 = std::byte(0xD8);
+constexpr auto FIXARRAY = std::byte(0x90);
+constexpr auto FIXMAP = std::byte(0x80);
+constexpr auto FIXSTR = std::byte(0xA0);
+constexpr auto FLOAT = std::byte(0xCA);
+constexpr auto INT8 = std::byte(0xD0);
+constexpr auto INT16 = std::byte(0xD1);
+constexpr auto INT32 = std::byte(0xD2);
 constexpr auto INT64 = std::byte(0xD3);
+constexpr auto MAP16 = std::byte(0xDE);
 constexpr auto MAP32 = std::byte(0xDF);
+constexpr auto NEGATIVE_FIXINT = std::byte(0xE0);
+constexpr auto NIL = std::byte(0xC0);
+constexpr auto STR8 = std::byte(0xD9);
+constexpr auto STR16 = std::byte(0xDA);
 constexpr auto STR32 = std::byte(0xDB);
+constexpr auto UINT8 = std::byte(0xCC);
+constexpr auto UINT16 = std::byte(0xCD);
+constexpr auto UINT32 = std::byte(0xCE);
 constexpr auto UINT64 = std::byte(0xCF);
 }  // namespace types
 
@@ -34,45 +63,256 @@ std::string make_overflow_message(StringView type, std::size_t actual,
   return message;
 }
 
+// Return the specified `value` with the order of its bytes reversed.
+template <typename Unsigned>
+Unsigned byte_swap(Unsigned value) {
+  static_assert(std::is_unsigned_v<Unsigned>);
+  if constexpr (sizeof value == 1) {
+    return value;
+  } else if constexpr (sizeof value == 2) {
+#if defined(_MSC_VER)
+    return _byteswap_ushort(value);
+#else
+    return __builtin_bswap16(value);
+#endif
+  } else if constexpr (sizeof value == 4) {
+#if defined(_MSC_VER)
+    return _byteswap_ulong(value);
+#else
+    return __builtin_bswap32(value);
+#endif
+  } else {
+    static_assert(sizeof value == 8);
+#if defined(_MSC_VER)
+    return _byteswap_uint64(value);
+#else
+    return __builtin_bswap64(value);
+#endif
+  }
+}
+
+// Return the specified `value` with its bytes in big endian order, i.e. the
+// most significant byte at the lowest address.
+template <typename Unsigned>
+Unsigned to_big_endian(Unsigned value) {
+#if defined(_MSC_VER) || (defined(__BYTE_ORDER__) && \
+                          __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  return byte_swap(value);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return value;
+#else
+  // The byte order is not known at compile time.
+  unsigned char bytes[sizeof value];
+  for (std::size_t i = 0; i < sizeof value; ++i) {
+    bytes[i] = (value >> (CHAR_BIT * (sizeof value - 1 - i))) & 0xFF;
+  }
+  std::memcpy(&value, bytes, sizeof value);
+  return value;
+#endif
+}
+
 template <typename Integer>
-void push_number_big_endian(std::string& buffer, Integer integer) {
+void write_number_big_endian(char* destination, Integer integer) {
   // Assume two's complement.
-  const std::make_unsigned_t<Integer> value = integer;
+  const auto value = to_big_endian(std::make_unsigned_t<Integer>(integer));
+  std::memcpy(destination, &value, sizeof value);
+}
 
-  // The loop below is more likely to unroll if we don't call any functions
-  // within it.
-  char buf[sizeof value];
+// Append to the specified `buffer` the specified `type` byte followed by the
+// specified `integer` in big endian order.  The bytes are assembled locally so
+// that `buffer` is appended to only once.
+template <typename Integer>
+void push_typed_number(std::string& buffer, std::byte type, Integer integer) {
+  char bytes[1 + sizeof integer];
+  bytes[0] = static_cast<char>(type);
+  write_number_big_endian(bytes + 1, integer);
+  buffer.append(bytes, sizeof bytes);
+}
 
-  // The most significant byte of `value` goes to the front of `buf`, and the
-  // least significant byte of `value` goes
-  // to the back of `buf`, and so on in between.
-  // On a big endian architecture, this is just a complicated way to copy
-  // `value`. On a little endian architecture, which is much more common, this
-  // effectively copies the bytes of `value` backwards.
-  const int size = sizeof value;
-  for (int i = 0; i < size; ++i) {
-    const char byte = (value >> (CHAR_BIT * ((size - 1) - i))) & 0xFF;
-    buf[i] = byte;
+// Append to the specified `buffer` the header of an array or map having the
+// specified `size`, using the narrowest of the specified `fix` type (whose
+// size limit is `fix_max`), `type16`, and `type32`.  The behavior is undefined
+// if `size` does not fit in 32 bits.
+void push_header(std::string& buffer, std::size_t size, std::byte fix,
+                 std::size_t fix_max, std::byte type16, std::byte type32) {
+  if (size <= fix_max) {
+    buffer.push_back(static_cast<char>(fix | std::byte(size)));
+  } else if (size <= std::numeric_limits<std::uint16_t>::max()) {
+    push_typed_number(buffer, type16, static_cast<std::uint16_t>(size));
+  } else {
+    push_typed_number(buffer, type32, static_cast<std::uint32_t>(size));
   }
+}
 
-  buffer.append(buf, sizeof buf);
+Error make_decode_error(StringView expected, StringView problem) {
+  std::string message;
+  message += "Cannot msgpack decode ";
+  append(message, expected);
+  message += ": ";
+  append(message, problem);
+  return Error{Error::MESSAGEPACK_DECODE_FAILURE, std::move(message)};
+}
+
+// Read from the beginning of the specified `input` a big endian integer of
+// type `Unsigned`, and advance `input` past it.  Return false if `input` is
+// too short.
+template <typename Unsigned>
+bool read_big_endian(StringView& input, Unsigned& value) {
+  if (input.size() < sizeof value) {
+    return false;
+  }
+  std::memcpy(&value, input.data(), sizeof value);
+  // Reversing the bytes is its own inverse.
+  value = to_big_endian(value);
+  input.remove_prefix(sizeof value);
+  return true;
+}
+
+// Read from the beginning of the specified `input` the type byte of a value,
+// and advance `input` past it.  Return false if `input` is empty.
+bool read_type(StringView& input, std::byte& type) {
+  if (input.empty()) {
+    return false;
+  }
+  type = std::byte(input.front());
+  input.remove_prefix(1);
+  return true;
+}
+
+// Read the size of an array, map, string, or binary value whose `type` byte
+// was just read from the specified `input`, where the size is stored in a
+// big endian integer of type `Unsigned`.
+template <typename Unsigned>
+Expected<std::size_t> read_size(StringView& input, StringView expected) {
+  Unsigned size;
+  if (!read_big_endian(input, size)) {
+    return make_decode_error(expected, "the input ends within the header");
+  }
+  return std::size_t(size);
+}
+
+// Read the header of an array or map from the specified `input`.  A header of
+// the "fix" kind has the specified `fix` type in its high four bits.
+Expected<std::size_t> read_header(StringView& input, std::byte fix,
+                                  std::byte type16, std::byte type32,
+                                  StringView expected) {
+  std::byte type;
+  if (!read_type(input, type)) {
+    return make_decode_error(expected, "the input is empty");
+  }
+  if ((type & std::byte(0xF0)) == fix) {
+    return std::size_t(type & std::byte(0x0F));
+  }
+  if (type == type16) {
+    return read_size<std::uint16_t>(input, expected);
+  }
+  if (type == type32) {
+    return read_size<std::uint32_t>(input, expected);
+  }
+  return make_decode_error(expected, "the value has a different type");
+}
+
+// An integer as read by `read_integer`.  If `negative`, then `bits` is the
+// two's complement of the value.
+struct Integer {
+  bool negative;
+  std::uint64_t bits;
+};
+
+// Read from the beginning of the specified `input` the integer stored in
+// `sizeof(Unsigned)` bytes, which is signed if `is_signed` is true.
+template <typename Unsigned>
+Expected<Integer> read_integer_bytes(StringView& input, bool is_signed,
+                                     StringView expected) {
+  Unsigned value;
+  if (!read_big_endian(input, value)) {
+    return make_decode_error(expected, "the input ends within the integer");
+  }
+  using Signed = std::make_signed_t<Unsigned>;
+  if (is_signed && Signed(value) < 0) {
+    return Integer{true, std::uint64_t(std::int64_t(Signed(value)))};
+  }
+  return Integer{false, std::uint64_t(value)};
+}
+
+Expected<Integer> read_integer(StringView& input, StringView expected) {
+  std::byte type;
+  if (!read_type(input, type)) {
+    return make_decode_error(expected, "the input is empty");
+  }
+  if ((type & std::byte(0x80)) == std::byte(0)) {
+    // positive fixint
+    return Integer{false, std::uint64_t(type)};
+  }
+  if ((type & std::byte(0xE0)) == types::NEGATIVE_FIXINT) {
+    return Integer{true, std::uint64_t(std::int64_t(std::int8_t(type)))};
+  }
+  if (type == types::UINT8) {
+    return read_integer_bytes<std::uint8_t>(input, false, expected);
+  }
+  if (type == types::UINT16) {
+    return read_integer_bytes<std::uint16_t>(input, false, expected);
+  }
+  if (type == types::UINT32) {
+    return read_integer_bytes<std::uint32_t>(input, false, expected);
+  }
+  if (type == types::UINT64) {
+    return read_integer_bytes<std::uint64_t>(input, false, expected);
+  }
+  if (type == types::INT8) {
+    return read_integer_bytes<std::uint8_t>(input, true, expected);
+  }
+  if (type == types::INT16) {
+    return read_integer_bytes<std::uint16_t>(input, true, expected);
+  }
+  if (type == types::INT32) {
+    return read_integer_bytes<std::uint32_t>(input, true, expected);
+  }
+  if (type == types::INT64) {
+    return read_integer_bytes<std::uint64_t>(input, true, expected);
+  }
+  return make_decode_error(expected, "the value has a different type");
 }
 
 }  // namespace
 
 void pack_integer(std::string& buffer, std::int64_t value) {
-  buffer.push_back(static_cast<char>(types::INT64));
-  push_number_big_endian(buffer, static_cast<std::int64_t>(value));
+  if (value >= 0) {
+    pack_integer(buffer, static_cast<std::uint64_t>(value));
+  } else if (value >= -32) {
+    // negative fixint
+    buffer.push_back(static_cast<char>(value));
+  } else if (value >= std::numeric_limits<std::int8_t>::min()) {
+    push_typed_number(buffer, types::INT8, static_cast<std::int8_t>(value));
+  } else if (value >= std::numeric_limits<std::int16_t>::min()) {
+    push_typed_number(buffer, types::INT16, static_cast<std::int16_t>(value));
+  } else if (value >= std::numeric_limits<std::int32_t>::min()) {
+    push_typed_number(buffer, types::INT32, static_cast<std::int32_t>(value));
+  } else {
+    push_typed_number(buffer, types::INT64, value);
+  }
 }
 
 void pack_integer(std::string& buffer, std::uint64_t value) {
-  buffer.push_back(static_cast<char>(types::UINT64));
-  push_number_big_endian(buffer, static_cast<std::uint64_t>(value));
+  if (value <= 0x7F) {
+    // positive fixint
+    buffer.push_back(static_cast<char>(value));
+  } else if (value <= std::numeric_limits<std::uint8_t>::max()) {
+    push_typed_number(buffer, types::UINT8, static_cast<std::uint8_t>(value));
+  } else if (value <= std::numeric_limits<std::uint16_t>::max()) {
+    push_typed_number(buffer, types::UINT16, static_cast<std::uint16_t>(value));
+  } else if (value <= std::numeric_limits<std::uint32_t>::max()) {
+    push_typed_number(buffer, types::UINT32, static_cast<std::uint32_t>(value));
+  } else {
+    push_typed_number(buffer, types::UINT64, value);
+  }
 }
 
-void pack_double(std::string& buffer, double value) {
-  buffer.push_back(static_cast<char>(types::DOUBLE));
+void pack_integer(std::string& buffer, std::uint32_t value) {
+  pack_integer(buffer, std::uint64_t(value));
+}
 
+void pack_double(std::string& buffer, double value) {
   // The following is lifted from the "msgpack-c" project.
   // See "pack_double" in
   // <https://github.com/msgpack/msgpack-c/blob/cpp_master/include/msgpack/v1/pack.hpp>
@@ -91,7 +331,12 @@ void pack_double(std::string& buffer, double value) {
       (memory.as_integer & 0xFFFFFFFFUL) << 32UL | (memory.as_integer >> 32UL);
 #endif
 
-  push_number_big_endian(buffer, memory.as_integer);
+  push_typed_number(buffer, types::DOUBLE, memory.as_integer);
+}
+
+void pack_bool(std::string& buffer, bool value) {
+  buffer.push_back(
+      static_cast<char>(value ? types::BOOLEAN_TRUE : types::BOOLEAN_FALSE));
 }
 
 Expected<void> pack_string(std::string& buffer, const char* begin,
@@ -101,20 +346,57 @@ Expected<void> pack_string(std::string& buffer, const char* begin,
     return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
                  make_overflow_message("string", size, max)};
   }
-  buffer.push_back(static_cast<char>(types::STR32));
-  push_number_big_endian(buffer, static_cast<std::uint32_t>(size));
+  if (size <= 31) {
+    buffer.push_back(static_cast<char>(types::FIXSTR | std::byte(size)));
+  } else if (size <= std::numeric_limits<std::uint8_t>::max()) {
+    push_typed_number(buffer, types::STR8, static_cast<std::uint8_t>(size));
+  } else if (size <= std::numeric_limits<std::uint16_t>::max()) {
+    push_typed_number(buffer, types::STR16, static_cast<std::uint16_t>(size));
+  } else {
+    push_typed_number(buffer, types::STR32, static_cast<std::uint32_t>(size));
+  }
   buffer.append(begin, size);
   return {};
 }
 
+Expected<void> pack_binary(std::string& buffer, StringView bytes) {
+  const std::size_t size = bytes.size();
+  const auto max = std::numeric_limits<std::uint32_t>::max();
+  if (size > max) {
+    return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
+                 make_overflow_message("binary", size, max)};
+  }
+  if (size <= std::numeric_limits<std::uint8_t>::max()) {
+    push_typed_number(buffer, types::BIN8, static_cast<std::uint8_t>(size));
+  } else if (size <= std::numeric_limits<std::uint16_t>::max()) {
+    push_typed_number(buffer, types::BIN16, static_cast<std::uint16_t>(size));
+  } else {
+    push_typed_number(buffer, types::BIN32, static_cast<std::uint32_t>(size));
+  }
+  append(buffer, bytes);
+  return {};
+}
+
 Expected<void> pack_array(std::string& buffer, std::size_t size) {
   const auto max = std::numeric_limits<std::uint32_t>::max();
   if (size > max) {
     return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
                  make_overflow_message("array", size, max)};
   }
-  buffer.push_back(static_cast<char>(types::ARRAY32));
-  push_number_big_endian(buffer, static_cast<std::uint32_t>(size));
+  push_header(buffer, size, types::FIXARRAY, 15, types::ARRAY16,
+              types::ARRAY32);
+  return {};
+}
+
+Expected<void> overwrite_array_header(char* destination, std::size_t size) {
+  const auto max = std::numeric_limits<std::uint32_t>::max();
+  if (size > max) {
+    return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
+                 make_overflow_message("array", size, max)};
+  }
+  static_assert(fixed_array_header_size == 1 + sizeof(std::uint32_t));
+  destination[0] = static_cast<char>(types::ARRAY32);
+  write_number_big_endian(destination + 1, static_cast<std::uint32_t>(size));
   return {};
 }
 
@@ -124,8 +406,200 @@ Expected<void> pack_map(std::string& buffer, std::size_t size) {
     return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
                  make_overflow_message("map", size, max)};
   }
-  buffer.push_back(static_cast<char>(types::MAP32));
-  push_number_big_endian(buffer, static_cast<std::uint32_t>(size));
+  push_header(buffer, size, types::FIXMAP, 15, types::MAP16, types::MAP32);
+  return {};
+}
+
+Expected<std::size_t> unpack_array(StringView& input) {
+  return read_header(input, types::FIXARRAY, types::ARRAY16, types::ARRAY32,
+                     "array");
+}
+
+Expected<std::size_t> unpack_map(StringView& input) {
+  return read_header(input, types::FIXMAP, types::MAP16, types::MAP32, "map");
+}
+
+Expected<StringView> unpack_string(StringView& input) {
+  std::byte type;
+  if (!read_type(input, type)) {
+    return make_decode_error("string", "the input is empty");
+  }
+  Expected<std::size_t> size;
+  if ((type & std::byte(0xE0)) == types::FIXSTR) {
+    size = std::size_t(type & std::byte(0x1F));
+  } else if (type == types::STR8) {
+    size = read_size<std::uint8_t>(input, "string");
+  } else if (type == types::STR16) {
+    size = read_size<std::uint16_t>(input, "string");
+  } else if (type == types::STR32) {
+    size = read_size<std::uint32_t>(input, "string");
+  } else {
+    return make_decode_error("string", "the value has a different type");
+  }
+  if (!size) {
+    return size.error();
+  }
+  if (input.size() < *size) {
+    return make_decode_error("string", "the input ends within the string");
+  }
+  const StringView result = input.substr(0, *size);
+  input.remove_prefix(*size);
+  return result;
+}
+
+Expected<std::int64_t> unpack_integer(StringView& input) {
+  auto integer = read_integer(input, "integer");
+  if (!integer) {
+    return integer.error();
+  }
+  if (!integer->negative &&
+      integer->bits > std::uint64_t(std::numeric_limits<std::int64_t>::max())) {
+    return make_decode_error("integer", "the value is too large");
+  }
+  return std::int64_t(integer->bits);
+}
+
+Expected<std::uint64_t> unpack_unsigned(StringView& input) {
+  auto integer = read_integer(input, "unsigned integer");
+  if (!integer) {
+    return integer.error();
+  }
+  if (integer->negative) {
+    return make_decode_error("unsigned integer", "the value is negative");
+  }
+  return integer->bits;
+}
+
+Expected<double> unpack_double(StringView& input) {
+  if (!input.empty() && std::byte(input.front()) == types::DOUBLE) {
+    input.remove_prefix(1);
+    std::uint64_t bits;
+    if (!read_big_endian(input, bits)) {
+      return make_decode_error("double", "the input ends within the number");
+    }
+    double value;
+    std::memcpy(&value, &bits, sizeof value);
+    return value;
+  }
+  if (!input.empty() && std::byte(input.front()) == types::FLOAT) {
+    input.remove_prefix(1);
+    std::uint32_t bits;
+    if (!read_big_endian(input, bits)) {
+      return make_decode_error("double", "the input ends within the number");
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof value);
+    return double(value);
+  }
+  auto integer = read_integer(input, "double");
+  if (!integer) {
+    return integer.error();
+  }
+  if (integer->negative) {
+    return double(std::int64_t(integer->bits));
+  }
+  return double(integer->bits);
+}
+
+Expected<bool> unpack_bool(StringView& input) {
+  std::byte type;
+  if (!read_type(input, type)) {
+    return make_decode_error("boolean", "the input is empty");
+  }
+  if (type == types::BOOLEAN_TRUE) {
+    return true;
+  }
+  if (type == types::BOOLEAN_FALSE) {
+    return false;
+  }
+  return make_decode_error("boolean", "the value has a different type");
+}
+
+Expected<void> skip(StringView& input) {
+  // Arrays and maps add their elements to `remaining` rather than being
+  // skipped recursively, so that deeply nested input cannot exhaust the
+  // stack.
+  std::uint64_t remaining = 1;
+  while (remaining) {
+    --remaining;
+    if (input.empty()) {
+      return make_decode_error("value", "the input ends early");
+    }
+    const auto type = std::byte(input.front());
+    const auto byte = static_cast<unsigned char>(type);
+    // The number of bytes that follow the type byte, if known from the type
+    // alone.
+    std::size_t length = 0;
+    if (byte <= 0x7F || byte >= 0xE0 || type == types::NIL ||
+        type == types::BOOLEAN_FALSE || type == types::BOOLEAN_TRUE) {
+      // fixint, nil, or boolean
+    } else if ((type & std::byte(0xF0)) == types::FIXMAP ||
+               (type & std::byte(0xF0)) == types::FIXARRAY ||
+               type == types::ARRAY16 || type == types::ARRAY32 ||
+               type == types::MAP16 || type == types::MAP32) {
+      const bool is_map = (type & std::byte(0xF0)) == types::FIXMAP ||
+                          type == types::MAP16 || type == types::MAP32;
+      Expected<std::size_t> size =
+          is_map ? unpack_map(input) : unpack_array(input);
+      if (!size) {
+        return size.error();
+      }
+      remaining += is_map ? 2 * std::uint64_t(*size) : *size;
+      continue;
+    } else if ((type & std::byte(0xE0)) == types::FIXSTR ||
+               type == types::STR8 || type == types::STR16 ||
+               type == types::STR32) {
+      auto result = unpack_string(input);
+      if (!result) {
+        return result.error();
+      }
+      continue;
+    } else if (type == types::BIN8 || type == types::BIN16 ||
+               type == types::BIN32 || type == types::EXT8 ||
+               type == types::EXT16 || type == types::EXT32) {
+      input.remove_prefix(1);
+      Expected<std::size_t> size;
+      if (type == types::BIN8 || type == types::EXT8) {
+        size = read_size<std::uint8_t>(input, "value");
+      } else if (type == types::BIN16 || type == types::EXT16) {
+        size = read_size<std::uint16_t>(input, "value");
+      } else {
+        size = read_size<std::uint32_t>(input, "value");
+      }
+      if (!size) {
+        return size.error();
+      }
+      // An extension's data is preceded by a byte naming its type.
+      const bool is_extension = type == types::EXT8 || type == types::EXT16 ||
+                                type == types::EXT32;
+      length = *size + is_extension;
+      if (input.size() < length) {
+        return make_decode_error("value", "the input ends early");
+      }
+      input.remove_prefix(length);
+      continue;
+    } else if (type >= types::FIXEXT1 && type <= types::FIXEXT16) {
+      // fixext 1, 2, 4, 8, or 16, preceded by a byte naming the extension
+      length = 1 + (std::size_t(1)
+                    << (byte - static_cast<unsigned char>(types::FIXEXT1)));
+    } else if (type == types::UINT8 || type == types::INT8) {
+      length = 1;
+    } else if (type == types::UINT16 || type == types::INT16) {
+      length = 2;
+    } else if (type == types::UINT32 || type == types::INT32 ||
+               type == types::FLOAT) {
+      length = 4;
+    } else if (type == types::UINT64 || type == types::INT64 ||
+               type == types::DOUBLE) {
+      length = 8;
+    } else {
+      return make_decode_error("value", "the type is not valid");
+    }
+    if (input.size() < 1 + length) {
+      return make_decode_error("value", "the input ends early");
+    }
+    input.remove_prefix(1 + length);
+  }
   return {};
 }
 
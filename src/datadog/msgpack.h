@@ -1,13 +1,23 @@
 #pragma once
 
-// This component provides encoding routines for [MessagePack][1].
+// This component provides encoding and decoding routines for
+// [MessagePack][1].
 //
-// Each function is in `namespace msgpack` and appends a specified value to a
-// `std::string`.  For example, `msgpack::pack_integer(destination, -42)`
-// MessagePack encodes the number `-42` and appends the result to `destination`.
+// Each encoding function is in `namespace msgpack` and appends a specified
+// value to a `std::string`.  For example,
+// `msgpack::pack_integer(destination, -42)` MessagePack encodes the number
+// `-42` and appends the result to `destination`.
 //
-// Only encoding is provided, and only for the types required by `SpanData` and
-// `DatadogAgent`.
+// Encoding is provided only for the types required by `SpanData` and
+// `DatadogAgent`.  Decoding, which is used by tools that read trace payloads
+// back, such as the benchmark's replay of captured traces, is provided for
+// the same types, and any value can be skipped.
+//
+// Integers, strings, arrays, and maps are encoded in the narrowest format that
+// can represent them, e.g. "fixstr" for strings of fewer than 32 bytes and
+// "positive fixint" for integers from 0 to 127.  The exception is
+// `overwrite_array_header`, which always writes the widest array header so
+// that its space can be reserved before the array's size is known.
 //
 // [1]: https://msgpack.org/index.html
 
@@ -26,15 +36,56 @@ namespace msgpack {
 void pack_integer(std::string& buffer, std::int64_t value);
 void pack_integer(std::string& buffer, std::uint64_t value);
 void pack_integer(std::string& buffer, std::int32_t value);
+void pack_integer(std::string& buffer, std::uint32_t value);
 
 void pack_double(std::string& buffer, double value);
 
+void pack_bool(std::string& buffer, bool value);
+
 Expected<void> pack_string(std::string& buffer, StringView value);
 Expected<void> pack_string(std::string& buffer, const char* begin,
                            std::size_t size);
 
+// Append to the specified `buffer` the specified `bytes` as a MessagePack
+// "bin" value, i.e. as uninterpreted bytes rather than as a string.
+Expected<void> pack_binary(std::string& buffer, StringView bytes);
+
+// `FixedString` is the MessagePack encoding, in the compact "fixstr" format,
+// of a string that is known at compile time.  Use `fixstr` to produce a
+// `FixedString` from a string literal, e.g.
+//
+//     constexpr auto key = msgpack::fixstr("service");
+//
+// Appending a `FixedString` to a buffer (see `pack_fixed`) is a single copy,
+// with no length computation or bounds checking at runtime.
+template <std::size_t Length>
+struct FixedString {
+  char bytes[1 + Length];
+
+  constexpr StringView encoded() const {
+    return StringView(bytes, sizeof bytes);
+  }
+};
+
+template <std::size_t Size>
+constexpr FixedString<Size - 1> fixstr(const char (&literal)[Size]);
+
+template <std::size_t Length>
+void pack_fixed(std::string& buffer, const FixedString<Length>& value);
+
 Expected<void> pack_array(std::string& buffer, std::size_t size);
 
+// The number of bytes occupied by an array header written by
+// `overwrite_array_header`.
+constexpr std::size_t fixed_array_header_size = 5;
+
+// Overwrite the `fixed_array_header_size` bytes starting at the specified
+// `destination` with a MessagePack array header for an array of the specified
+// `size`.  Unlike `pack_array`, the header written always has the same width,
+// so space for it can be reserved in a buffer before the number of array
+// elements is known.  Return an error if `size` cannot be represented.
+Expected<void> overwrite_array_header(char* destination, std::size_t size);
+
 // Append to the specified `buffer` a MessagePack encoded array having the
 // specified `values`, where for each element of `values` the specified
 // `pack_value` function appends the value.  `pack_value` is invoked with two
@@ -75,11 +126,62 @@ template <typename PackValue, typename... Rest>
 Expected<void> pack_map(std::string& buffer, StringView key,
                         PackValue&& pack_value, Rest&&... rest);
 
+// As above, except that the first key, and optionally any of the following
+// keys, are pre-encoded `FixedString`s rather than `StringView`s.
+template <std::size_t Length, typename PackValue, typename... Rest>
+Expected<void> pack_map(std::string& buffer, const FixedString<Length>& key,
+                        PackValue&& pack_value, Rest&&... rest);
+
 template <typename PackValue, typename... Rest>
 Expected<void> pack_map_suffix(std::string& buffer, StringView key,
                                PackValue&& pack_value, Rest&&... rest);
+template <std::size_t Length, typename PackValue, typename... Rest>
+Expected<void> pack_map_suffix(std::string& buffer,
+                               const FixedString<Length>& key,
+                               PackValue&& pack_value, Rest&&... rest);
 Expected<void> pack_map_suffix(std::string& buffer);
 
+// Each of the following decoding functions reads a value from the beginning of
+// the specified `input`, and advances `input` past it.  If `input` does not
+// begin with a value of the required type, then an error is returned and the
+// value of `input` is unspecified.  Integers are read from any of the integer
+// formats, provided that the value fits in the result.  `StringView`s
+// returned refer to the input.
+
+// Return the number of elements of the array whose header begins `input`.
+// The elements follow.
+Expected<std::size_t> unpack_array(StringView& input);
+// Return the number of entries of the map whose header begins `input`.  The
+// entries, each a key followed by its value, follow.
+Expected<std::size_t> unpack_map(StringView& input);
+Expected<StringView> unpack_string(StringView& input);
+Expected<std::int64_t> unpack_integer(StringView& input);
+Expected<std::uint64_t> unpack_unsigned(StringView& input);
+// Read a floating point number, or an integer, as a `double`.
+Expected<double> unpack_double(StringView& input);
+Expected<bool> unpack_bool(StringView& input);
+// Advance `input` past one value of any type, including all of the elements
+// of an array or map.
+Expected<void> skip(StringView& input);
+
+template <std::size_t Size>
+constexpr FixedString<Size - 1> fixstr(const char (&literal)[Size]) {
+  constexpr std::size_t length = Size - 1;
+  static_assert(length <= 31,
+                "fixstr can encode strings of at most 31 characters.");
+  FixedString<length> result{};
+  result.bytes[0] = static_cast<char>(0xA0 | length);
+  for (std::size_t i = 0; i < length; ++i) {
+    result.bytes[1 + i] = literal[i];
+  }
+  return result;
+}
+
+template <std::size_t Length>
+void pack_fixed(std::string& buffer, const FixedString<Length>& value) {
+  buffer.append(value.bytes, sizeof value.bytes);
+}
+
 template <typename Iterable, typename PackValue>
 Expected<void> pack_array(std::string& buffer, Iterable&& values,
                           PackValue&& pack_value) {
@@ -133,6 +235,18 @@ Expected<void> pack_map(std::string& buffer, StringView key,
                          std::forward<Rest>(rest)...);
 }
 
+template <std::size_t Length, typename PackValue, typename... Rest>
+Expected<void> pack_map(std::string& buffer, const FixedString<Length>& key,
+                        PackValue&& pack_value, Rest&&... rest) {
+  static_assert(
+      sizeof...(rest) % 2 == 0,
+      "pack_map must receive an even number of arguments after the first.");
+  (void)pack_map(buffer, 1 + sizeof...(rest) / 2);
+
+  return pack_map_suffix(buffer, key, std::forward<PackValue>(pack_value),
+                         std::forward<Rest>(rest)...);
+}
+
 template <typename PackValue, typename... Rest>
 Expected<void> pack_map_suffix(std::string& buffer, StringView key,
                                PackValue&& pack_value, Rest&&... rest) {
@@ -149,6 +263,19 @@ Expected<void> pack_map_suffix(std::string& buffer, StringView key,
   return result;
 }
 
+template <std::size_t Length, typename PackValue, typename... Rest>
+Expected<void> pack_map_suffix(std::string& buffer,
+                               const FixedString<Length>& key,
+                               PackValue&& pack_value, Rest&&... rest) {
+  pack_fixed(buffer, key);
+  Expected<void> result = pack_value(buffer);
+  if (!result) {
+    return result;
+  }
+  result = pack_map_suffix(buffer, std::forward<Rest>(rest)...);
+  return result;
+}
+
 inline Expected<void> pack_map_suffix(std::string&) {
   // base case does nothing
   return {};
@@ -7,6 +7,7 @@
 #include <charconv>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <sstream>
 #include <string>
 
@@ -44,6 +45,82 @@ Expected<Integer> parse_integer(StringView input, int base, StringView kind) {
   return value;
 }
 
+// `HexDigitValues` is a table of the value of each character as a hexadecimal
+// digit, or `invalid` if the character is not a hexadecimal digit.  Upper and
+// lower case digits are accepted, as they are by `std::from_chars`.
+struct HexDigitValues {
+  static constexpr unsigned char invalid = 0xff;
+
+  unsigned char values[256];
+
+  constexpr HexDigitValues() : values() {
+    for (int c = 0; c < 256; ++c) {
+      if (c >= '0' && c <= '9') {
+        values[c] = static_cast<unsigned char>(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        values[c] = static_cast<unsigned char>(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        values[c] = static_cast<unsigned char>(c - 'A' + 10);
+      } else {
+        values[c] = invalid;
+      }
+    }
+  }
+};
+
+constexpr HexDigitValues hex_digit_values{};
+
+// Propagated IDs are almost always either decimal numbers that fit in 64 bits
+// or exactly 16 hexadecimal digits.  The following functions parse those
+// shapes without branching on each character.  They return `nullopt` for any
+// other input, which is then parsed by `parse_integer`.
+
+// Return the value of the specified `input` if it consists of exactly 16
+// hexadecimal digits.  Otherwise, return `nullopt`.
+Optional<std::uint64_t> parse_hex16(StringView input) {
+  if (input.size() != 16) {
+    return nullopt;
+  }
+
+  std::uint64_t value = 0;
+  unsigned char invalid = 0;
+  for (std::size_t i = 0; i < 16; ++i) {
+    const unsigned char digit =
+        hex_digit_values.values[static_cast<unsigned char>(input[i])];
+    // Only `HexDigitValues::invalid` has the high bit set.
+    invalid |= digit;
+    value = (value << 4) | (digit & 0xf);
+  }
+
+  if (invalid & 0x80) {
+    return nullopt;
+  }
+  return value;
+}
+
+// Return the value of the specified `input` if it consists of between one and
+// 19 decimal digits, and so cannot overflow 64 bits.  Otherwise, return
+// `nullopt`.
+Optional<std::uint64_t> parse_short_decimal(StringView input) {
+  const std::size_t max_digits = std::numeric_limits<std::uint64_t>::digits10;
+  if (input.empty() || input.size() > max_digits) {
+    return nullopt;
+  }
+
+  std::uint64_t value = 0;
+  bool invalid = false;
+  for (const char c : input) {
+    const unsigned digit = static_cast<unsigned char>(c) - unsigned('0');
+    invalid |= digit > 9;
+    value = value * 10 + digit;
+  }
+
+  if (invalid) {
+    return nullopt;
+  }
+  return value;
+}
+
 }  // namespace
 
 bool falsy(StringView input) {
@@ -53,6 +130,16 @@ bool falsy(StringView input) {
 }
 
 Expected<std::uint64_t> parse_uint64(StringView input, int base) {
+  if (base == 16) {
+    if (auto value = parse_hex16(input)) {
+      return *value;
+    }
+  } else if (base == 10) {
+    if (auto value = parse_short_decimal(input)) {
+      return *value;
+    }
+  }
+
   return parse_integer<std::uint64_t>(input, base, "64-bit unsigned");
 }
 
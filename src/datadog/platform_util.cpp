@@ -1,5 +1,7 @@
 #include "platform_util.h"
 
+#include <atomic>
+
 // clang-format off
 #if defined(__x86_64__) || defined(_M_X64)
 #  define DD_SDK_CPU_ARCH "x86_64"
@@ -23,8 +25,11 @@
 #  elif defined(__linux__) || defined(__unix__)
 #    define DD_SDK_OS "GNU/Linux"
 #    define DD_SDK_KERNEL "Linux"
+#    include "parse_util.h"
 #    include "string_util.h"
 #    include <fstream>
+#    include <sched.h>
+#    include <sys/syscall.h>
 #  endif
 #elif defined(_MSC_VER)
 #  include <windows.h>
@@ -224,5 +229,63 @@ int at_fork_in_child(void (*on_fork)()) {
 #endif
 }
 
+namespace {
+
+std::atomic<unsigned> forks{0};
+
+void count_fork() { ++forks; }
+
+}  // namespace
+
+unsigned fork_generation() {
+  static const int registered = at_fork_in_child(&count_fork);
+  (void)registered;
+  return forks.load(std::memory_order_relaxed);
+}
+
+std::size_t numa_node_count() {
+#if defined(__linux__)
+  // The file lists the nodes as ranges, e.g. "0" or "0-1", so the count is
+  // one more than the last number.
+  std::ifstream possible("/sys/devices/system/node/possible");
+  std::string nodes;
+  if (!std::getline(possible, nodes)) {
+    return 1;
+  }
+  StringView last = nodes;
+  const auto separator = last.find_last_of("-,");
+  if (separator != StringView::npos) {
+    last.remove_prefix(separator + 1);
+  }
+  const auto result = parse_uint64(last, 10);
+  if (!result) {
+    return 1;
+  }
+  return std::size_t(*result) + 1;
+#else
+  return 1;
+#endif
+}
+
+std::size_t current_numa_node() {
+#if defined(__linux__)
+  unsigned cpu = 0;
+  unsigned node = 0;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 29)
+  // `getcpu` uses the vDSO, and so does not enter the kernel.
+  if (getcpu(&cpu, &node) != 0) {
+    return 0;
+  }
+#else
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return 0;
+  }
+#endif
+  return node;
+#else
+  return 0;
+#endif
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -2,6 +2,7 @@
 
 // This component provides platform-dependent miscellanea.
 
+#include <cstddef>
 #include <string>
 
 namespace datadog {
@@ -30,5 +31,20 @@ std::string get_process_name();
 
 int at_fork_in_child(void (*on_fork)());
 
+// Return the number of times that a `fork` has created this process or one of
+// its ancestors since this function was first called.  A thread started when
+// `fork_generation` returned a different value does not exist in this
+// process.
+unsigned fork_generation();
+
+// Return the number of NUMA nodes that the host can have, or one if that is
+// not known.
+std::size_t numa_node_count();
+
+// Return the NUMA node of the CPU on which the calling thread is running, or
+// zero if that is not known.  The thread might be moved to another node at
+// any time.
+std::size_t current_numa_node();
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,49 @@
+#pragma once
+
+// This component provides a macro, `DD_TRACE_PROBE`, that marks a point in the
+// tracer as a USDT (user statically defined tracing) probe.  Tools such as
+// `bpftrace` and `perf` can attach to the probes of a running process to
+// measure the tracer, e.g. the distribution of flush durations, without the
+// process having been rebuilt or restarted.
+//
+// The probes are compiled in only when the library is configured with
+// `-DDD_TRACE_ENABLE_USDT=ON`, which requires `<sys/sdt.h>` (from, e.g., the
+// "systemtap-sdt-dev" package).  Otherwise `DD_TRACE_PROBE` expands to
+// nothing, and its arguments are not evaluated.  A probe that is compiled in
+// is a single `nop` instruction until a tool attaches to it, but its arguments
+// are evaluated, and so they must be cheap: integers that are already at hand.
+//
+// The first argument of `DD_TRACE_PROBE` is the name of the probe, and the
+// rest, at most 12, are its arguments.  All probes have the provider
+// "dd_trace_cpp".  The double underscore in a name becomes a hyphen in the
+// probe's name, e.g.
+//
+//     bpftrace -e 'usdt:/path/to/libdd_trace_cpp.so:dd_trace_cpp:flush-end
+//                  { @flush_ns = hist(arg0); }'
+//
+// These are the probes and their arguments:
+//
+// - `span__create(trace_id_low, span_id)`: a span was created.
+// - `span__finish(trace_id_low, span_id, duration_ns)`: a span finished.
+// - `segment__close(trace_id_low, num_spans)`: the last span of a trace
+//   segment finished, and the segment's spans are about to be finalized.
+// - `sampling__decision(trace_id_low, priority, mechanism)`: the trace
+//   sampler made a sampling decision for a trace segment.
+// - `flush__start()` and `flush__end(duration_ns)`: `DatadogAgent` began and
+//   finished a flush of buffered traces.
+// - `http__post(body_bytes, num_chunks)`: `DatadogAgent` sent a request of
+//   traces to the Datadog Agent.
+// - `http__response(status, latency_ns)` and `http__error(latency_ns)`: a
+//   request of traces received a response, or failed.
+
+#if defined(DD_TRACE_ENABLE_USDT)
+
+#include <sys/sdt.h>
+
+#define DD_TRACE_PROBE(...) STAP_PROBEV(dd_trace_cpp, __VA_ARGS__)
+
+#else
+
+#define DD_TRACE_PROBE(...) static_cast<void>(0)
+
+#endif
@@ -12,26 +12,81 @@ namespace {
 
 extern "C" void on_fork();
 
+// `Uint64Generator` is an implementation of xoshiro256** by David Blackman and
+// Sebastiano Vigna (https://prng.di.unimi.it/).  Its 32 bytes of state are
+// much smaller than those of `std::mt19937_64`, it is faster, and it passes
+// the usual statistical test suites.  It is not cryptographically secure,
+// which is not required of trace and span IDs.
+//
+// The generator is trivially constructible, so that a `thread_local` one is
+// zero-initialized rather than dynamically initialized, and accessing it does
+// not call the thread-local initialization function every time.  Instead, it
+// seeds itself when first used.
 class Uint64Generator {
-  std::mt19937_64 generator_;
-  std::uniform_int_distribution<std::uint64_t> distribution_;
+  std::uint64_t state_[4];
+  bool seeded_;
+
+  static std::uint64_t rotate_left(std::uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+  }
+
+  // Return the next value of the splitmix64 sequence having the specified
+  // `state`, which is used to expand a seed into the generator's state.
+  static std::uint64_t splitmix64(std::uint64_t &state) {
+    std::uint64_t result = (state += 0x9e3779b97f4a7c15);
+    result = (result ^ (result >> 30)) * 0xbf58476d1ce4e5b9;
+    result = (result ^ (result >> 27)) * 0x94d049bb133111eb;
+    return result ^ (result >> 31);
+  }
 
  public:
-  Uint64Generator() {
+  Uint64Generator() = default;
+
+  void seed_if_unseeded() {
+    if (seeded_) {
+      return;
+    }
     seed_with_random();
     // If a process links to this library and then calls `fork`, the
-    // `generator_` in the parent and child processes will produce the exact
+    // generator in the parent and child processes will produce the exact
     // same sequence of values, which is bad.
     // A subsequent call to `exec` would remedy this, but nginx in particular
     // does not call `exec` after forking its worker processes.
-    // So, we use `at_fork_in_child` to re-seed `generator_` in the child
-    // process after `fork`.
-    (void)at_fork_in_child(&on_fork);
+    // So, we use `at_fork_in_child` to re-seed the generator in the child
+    // process after `fork`.  Only the thread that called `fork` exists in the
+    // child, so the handler need be registered only once per process.
+    static const int registered = at_fork_in_child(&on_fork);
+    (void)registered;
+  }
+
+  std::uint64_t operator()() {
+    seed_if_unseeded();
+    return next();
   }
 
-  std::uint64_t operator()() { return distribution_(generator_); }
+  // Return the next value without checking whether the generator is seeded.
+  std::uint64_t next() {
+    const std::uint64_t result = rotate_left(state_[1] * 5, 7) * 9;
+    const std::uint64_t shifted = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= shifted;
+    state_[3] = rotate_left(state_[3], 45);
+    return result;
+  }
 
-  void seed_with_random() { generator_.seed(std::random_device{}()); }
+  void seed_with_random() {
+    // `std::random_device` produces 32 bits at a time.  Use 64 bits of it to
+    // seed splitmix64, whose output is never all zeros across four values.
+    std::random_device device;
+    std::uint64_t seed = (std::uint64_t(device()) << 32) | device();
+    for (std::uint64_t &word : state_) {
+      word = splitmix64(seed);
+    }
+    seeded_ = true;
+  }
 };
 
 thread_local Uint64Generator thread_local_generator;
@@ -42,6 +97,14 @@ void on_fork() { thread_local_generator.seed_with_random(); }
 
 std::uint64_t random_uint64() { return thread_local_generator(); }
 
+void random_uint64s(std::uint64_t *values, std::size_t count) {
+  Uint64Generator &generator = thread_local_generator;
+  generator.seed_if_unseeded();
+  for (std::size_t i = 0; i < count; ++i) {
+    values[i] = generator.next();
+  }
+}
+
 std::string uuid() {
   // clang-format off
   // It's not all random.  From most significant to least significant, the
@@ -0,0 +1,149 @@
+#include "reactor_event_scheduler.h"
+
+#include <datadog/reactor.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+
+struct ReactorEventScheduler::Event {
+  std::shared_ptr<Reactor> reactor;
+  std::function<void()> callback;
+  std::chrono::steady_clock::duration interval;
+  // When the event is next due.
+  std::chrono::steady_clock::time_point when;
+
+  std::mutex mutex;
+  Reactor::TimerID timer = 0;
+  bool cancelled = false;
+  // Whether `callback` is running, and if so, on which thread.
+  bool running = false;
+  std::thread::id running_thread;
+  // Promises to fulfill once the callback, which was running when the event
+  // was cancelled, returns.
+  std::vector<std::promise<void>> cancel_waiters;
+};
+
+ReactorEventScheduler::ReactorEventScheduler(std::shared_ptr<Reactor> reactor)
+    : reactor_(std::move(reactor)) {}
+
+ReactorEventScheduler::~ReactorEventScheduler() {
+  std::vector<std::shared_ptr<Event>> events;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& weak : events_) {
+      if (auto event = weak.lock()) {
+        events.push_back(std::move(event));
+      }
+    }
+  }
+  for (const auto& event : events) {
+    cancel(*event).wait();
+  }
+}
+
+std::shared_ptr<ReactorEventScheduler::Event>
+ReactorEventScheduler::add_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  auto event = std::make_shared<Event>();
+  event->reactor = reactor_;
+  event->callback = std::move(callback);
+  event->interval = interval;
+  event->when = std::chrono::steady_clock::now() + interval;
+  {
+    std::lock_guard<std::mutex> lock(event->mutex);
+    arm(event);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.erase(std::remove_if(events_.begin(), events_.end(),
+                               [](const std::weak_ptr<Event>& weak) {
+                                 return weak.expired();
+                               }),
+                events_.end());
+  events_.push_back(event);
+  return event;
+}
+
+void ReactorEventScheduler::arm(const std::shared_ptr<Event>& event) {
+  // The timer's callback keeps the event alive until the timer fires or is
+  // cancelled, so that the event need not outlive this scheduler.
+  event->timer =
+      event->reactor->set_timer(event->when, [event]() { fire(event); });
+}
+
+void ReactorEventScheduler::fire(const std::shared_ptr<Event>& event) {
+  std::unique_lock<std::mutex> lock(event->mutex);
+  if (event->cancelled) {
+    return;
+  }
+  event->running = true;
+  event->running_thread = std::this_thread::get_id();
+  lock.unlock();
+  event->callback();
+  lock.lock();
+  event->running = false;
+  for (auto& waiter : event->cancel_waiters) {
+    waiter.set_value();
+  }
+  event->cancel_waiters.clear();
+
+  if (!event->cancelled) {
+    // If the event is behind schedule, then it runs again as soon as
+    // possible, rather than catching up on the invocations it missed.
+    event->when = std::max(event->when + event->interval,
+                           std::chrono::steady_clock::now());
+    arm(event);
+  }
+}
+
+std::future<void> ReactorEventScheduler::cancel(Event& event) {
+  std::lock_guard<std::mutex> lock(event.mutex);
+  std::promise<void> done;
+  auto result = done.get_future();
+  if (!event.cancelled) {
+    event.cancelled = true;
+    event.reactor->cancel_timer(event.timer);
+  }
+  // A callback that cancels its own event cannot wait for itself.
+  if (event.running && event.running_thread != std::this_thread::get_id()) {
+    event.cancel_waiters.push_back(std::move(done));
+    return result;
+  }
+  done.set_value();
+  return result;
+}
+
+EventScheduler::Cancel ReactorEventScheduler::schedule_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  auto event = add_recurring_event(interval, std::move(callback));
+  return [event = std::move(event)]() { cancel(*event).wait(); };
+}
+
+EventScheduler::AsyncCancel
+ReactorEventScheduler::schedule_recurring_event_async_cancel(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  auto event = add_recurring_event(interval, std::move(callback));
+  return [event = std::move(event)]() { return cancel(*event); };
+}
+
+bool ReactorEventScheduler::schedule_event(std::function<void()> callback) {
+  reactor_->post(std::move(callback));
+  return true;
+}
+
+std::string ReactorEventScheduler::config() const {
+  return nlohmann::json::object(
+             {{"type", "datadog::tracing::ReactorEventScheduler"}})
+      .dump();
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,65 @@
+#pragma once
+
+// This component provides a `class`, `ReactorEventScheduler`, that implements
+// the `EventScheduler` interface in terms of the timers of an
+// application-provided `Reactor` (see `reactor.h`).  It is used instead of
+// `ThreadedEventScheduler` if `DatadogAgentConfig::reactor` is specified.
+//
+// Each recurring event has one reactor timer at a time, and callbacks run on
+// the reactor's thread.  One-off events are posted to the reactor.
+
+#include <datadog/event_scheduler.h>
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+class Reactor;
+
+class ReactorEventScheduler : public EventScheduler {
+  struct Event;
+
+  std::shared_ptr<Reactor> reactor_;
+  std::mutex mutex_;
+  // The recurring events that have been scheduled.  Expired pointers are
+  // removed as events are added.
+  std::vector<std::weak_ptr<Event>> events_;
+
+  std::shared_ptr<Event> add_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback);
+  // Set a timer for the next invocation of the specified `event`.  The
+  // behavior is undefined unless `event->mutex` is locked.
+  static void arm(const std::shared_ptr<Event>& event);
+  static void fire(const std::shared_ptr<Event>& event);
+  // Prevent subsequent invocations of the specified `event`, and return a
+  // future that is ready once its callback is not running on another thread.
+  static std::future<void> cancel(Event& event);
+
+ public:
+  explicit ReactorEventScheduler(std::shared_ptr<Reactor> reactor);
+  // Cancel every recurring event, and wait for any callback that is running
+  // on another thread.
+  ~ReactorEventScheduler();
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
+                                  std::function<void()> callback) override;
+
+  AsyncCancel schedule_recurring_event_async_cancel(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override;
+
+  bool schedule_event(std::function<void()> callback) override;
+
+  std::string config() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -6,6 +6,8 @@
 
 #include <cassert>
 #include <regex>
+#include <stdexcept>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "base64.h"
@@ -90,24 +92,25 @@ Manager::Manager(const TracerSignature& tracer_signature,
   capabilities_ = capabilities_byte_array(capabilities);
 }
 
-bool Manager::is_new_config(StringView config_path,
-                            const nlohmann::json& config_meta) {
-  auto it = applied_config_.find(std::string{config_path});
-  if (it == applied_config_.cend()) return true;
-
-  return it->second.hash !=
-         config_meta.at("/hashes/sha256"_json_pointer).get<StringView>();
-}
-
 void Manager::error(std::string message) {
   logger_->log_error(Error{Error::REMOTE_CONFIGURATION_INVALID_INPUT, message});
   state_.error_message = std::move(message);
 }
 
 nlohmann::json Manager::make_request_payload() {
-  // clang-format off
-  auto j = nlohmann::json{
-    {"client", {
+  return nlohmann::json::parse(make_request_body());
+}
+
+const std::string& Manager::make_request_body() {
+  if (!request_body_stale_) {
+    return request_body_;
+  }
+
+  if (request_prefix_.empty()) {
+    // The client's identity doesn't change, so it is serialized once.  The
+    // closing brace is replaced by the "state" that follows.
+    // clang-format off
+    auto client = nlohmann::json{
       {"id", client_id_},
       {"products", products_},
       {"is_tracer", true},
@@ -118,24 +121,31 @@ nlohmann::json Manager::make_request_payload() {
         {"tracer_version", tracer_signature_.library_version},
         {"service", tracer_signature_.default_service},
         {"env", tracer_signature_.default_environment}
-      }},
-      {"state", {
-        {"root_version", 1},
-        {"targets_version", state_.targets_version},
-        {"backend_client_state", state_.opaque_backend_state}
       }}
-    }}
+    };
+    // clang-format on
+    request_prefix_ = "{\"client\":";
+    request_prefix_ += client.dump();
+    request_prefix_.back() = ',';
+    request_prefix_ += "\"state\":";
+  }
+
+  // clang-format off
+  auto state = nlohmann::json{
+    {"root_version", 1},
+    {"targets_version", state_.targets_version},
+    {"backend_client_state", state_.opaque_backend_state}
   };
   // clang-format on
 
   if (state_.error_message) {
-    j["client"]["state"]["has_error"] = true;
-    j["client"]["state"]["error"] = *state_.error_message;
+    state["has_error"] = true;
+    state["error"] = *state_.error_message;
   }
 
+  auto cached_target_files = nlohmann::json::array();
   if (!applied_config_.empty()) {
     auto config_states = nlohmann::json::array();
-    auto cached_target_files = nlohmann::json::array();
 
     for (const auto& [_, config] : applied_config_) {
       nlohmann::json config_state = {
@@ -159,19 +169,36 @@ nlohmann::json Manager::make_request_payload() {
       cached_target_files.emplace_back(std::move(cached_file));
     }
 
-    j["cached_target_files"] = cached_target_files;
-    j["client"]["state"]["config_states"] = config_states;
+    state["config_states"] = std::move(config_states);
   }
 
-  return j;
+  request_body_ = request_prefix_;
+  request_body_ += state.dump();
+  request_body_ += '}';
+  if (!cached_target_files.empty()) {
+    request_body_ += ",\"cached_target_files\":";
+    request_body_ += cached_target_files.dump();
+  }
+  request_body_ += '}';
+
+  request_body_stale_ = false;
+  return request_body_;
 }
 
 void Manager::process_response(const nlohmann::json& json) {
+  // Any response might change the state reported in the next request.
+  request_body_stale_ = true;
   state_.error_message = nullopt;
 
   try {
-    const auto targets = nlohmann::json::parse(
-        base64_decode(json.at("targets").get<StringView>()));
+    // The agent sends the same `targets` until a configuration changes, so
+    // decode and parse it only when it differs from the previous response.
+    const auto encoded_targets = json.at("targets").get<StringView>();
+    if (encoded_targets != encoded_targets_) {
+      targets_ = nlohmann::json::parse(base64_decode(encoded_targets));
+      encoded_targets_ = std::string{encoded_targets};
+    }
+    const auto& targets = targets_;
 
     const auto client_configs_it = json.find("client_configs");
 
@@ -202,10 +229,26 @@ void Manager::process_response(const nlohmann::json& json) {
 
     // Keep track of config path received to know which ones to revert.
     std::unordered_set<std::string> visited_config;
+    // `target_files`, indexed by path.  It is built when the first new
+    // configuration is encountered.
+    std::unordered_map<StringView, const nlohmann::json*> target_files_by_path;
+    bool target_files_indexed = false;
 
     for (const auto& client_config : *client_configs_it) {
       auto config_path = client_config.get<StringView>();
-      visited_config.emplace(config_path);
+      const auto [path_it, _] = visited_config.emplace(config_path);
+
+      // A configuration that is already applied has a valid path.  Skip it
+      // unless its hash changed.
+      const auto applied_it = applied_config_.find(*path_it);
+      if (applied_it != applied_config_.cend() &&
+          applied_it->second.hash ==
+              targets.at("/signed/targets"_json_pointer)
+                  .at(config_path)
+                  .at("/hashes/sha256"_json_pointer)
+                  .get<StringView>()) {
+        continue;
+      }
 
       const auto config_key_metadata = parse_config_path(config_path);
       if (!config_key_metadata) {
@@ -221,18 +264,22 @@ void Manager::process_response(const nlohmann::json& json) {
       const auto& config_metadata =
           targets.at("/signed/targets"_json_pointer).at(config_path);
 
-      if (!is_new_config(config_path, config_metadata)) {
-        continue;
+      if (!target_files_indexed) {
+        const auto& target_files = json.at("/target_files"_json_pointer);
+        if (!target_files.is_array()) {
+          error("\"target_files\" is not an array");
+          return;
+        }
+        for (const auto& target_file : target_files) {
+          target_files_by_path.emplace(
+              target_file.at("/path"_json_pointer).get<StringView>(),
+              &target_file);
+        }
+        target_files_indexed = true;
       }
 
-      const auto& target_files = json.at("/target_files"_json_pointer);
-      auto target_it = std::find_if(
-          target_files.cbegin(), target_files.cend(),
-          [&config_path](const nlohmann::json& j) {
-            return j.at("/path"_json_pointer).get<StringView>() == config_path;
-          });
-
-      if (target_it == target_files.cend()) {
+      const auto target_it = target_files_by_path.find(config_path);
+      if (target_it == target_files_by_path.cend()) {
         std::string reason{"Target \""};
         append(reason, config_path);
         reason += "\" missing from the list of targets";
@@ -241,7 +288,7 @@ void Manager::process_response(const nlohmann::json& json) {
         return;
       }
 
-      auto raw_data = target_it->at("raw").get<StringView>();
+      auto raw_data = target_it->second->at("raw").get<StringView>();
       auto decoded_config = base64_decode(raw_data);
 
       Configuration new_config;
@@ -298,5 +345,74 @@ void Manager::process_response(const nlohmann::json& json) {
   }
 }
 
+nlohmann::json Manager::state_json() const {
+  auto configs = nlohmann::json::array();
+  for (const auto& [path, config] : applied_config_) {
+    if (config.state == Configuration::State::error) {
+      continue;
+    }
+    configs.push_back({{"path", path},
+                       {"hash", config.hash},
+                       {"version", config.version},
+                       {"content", config.content}});
+  }
+
+  return {{"targets_version", state_.targets_version},
+          {"opaque_backend_state", state_.opaque_backend_state},
+          {"configs", std::move(configs)}};
+}
+
+void Manager::restore_state(const nlohmann::json& state) {
+  State restored_state;
+  std::vector<Configuration> restored_configs;
+  try {
+    restored_state.targets_version =
+        state.at("targets_version").get<std::uint64_t>();
+    restored_state.opaque_backend_state =
+        state.at("opaque_backend_state").get<std::string>();
+    for (const auto& saved : state.at("configs")) {
+      Configuration config;
+      config.path = saved.at("path").get<std::string>();
+      const auto metadata = parse_config_path(config.path);
+      if (!metadata) {
+        throw std::runtime_error(config.path +
+                                 " is an invalid configuration path");
+      }
+      config.id = std::string{metadata->config_id};
+      config.product = metadata->product;
+      config.hash = saved.at("hash").get<std::string>();
+      config.version = saved.at("version").get<std::size_t>();
+      config.content = saved.at("content").get<std::string>();
+      restored_configs.push_back(std::move(config));
+    }
+  } catch (const std::exception& e) {
+    std::string message = "Unable to restore Remote Configuration state: ";
+    message += e.what();
+    logger_->log_error(
+        Error{Error::REMOTE_CONFIGURATION_INVALID_INPUT, std::move(message)});
+    return;
+  }
+
+  for (auto& config : restored_configs) {
+    config.state = Configuration::State::acknowledged;
+    for (const auto& listener : listeners_per_product_[config.product]) {
+      if (auto error_message = listener->on_update(config)) {
+        config.state = Configuration::State::error;
+        config.error_message = std::move(*error_message);
+      }
+    }
+    std::string path = config.path;
+    applied_config_[std::move(path)] = std::move(config);
+  }
+  if (!restored_configs.empty()) {
+    for (const auto& listener : listeners_) {
+      listener->on_post_process();
+    }
+  }
+
+  state_ = std::move(restored_state);
+  request_body_stale_ = true;
+}
+
 }  // namespace remote_config
 }  // namespace datadog
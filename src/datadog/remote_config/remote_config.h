@@ -25,6 +25,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 
 #include "json.hpp"
 
@@ -64,6 +65,16 @@ class Manager {
 
   State state_;
   std::unordered_map<std::string, Configuration> applied_config_;
+  // The base64-encoded "targets" of the most recent response, and its
+  // decoded and parsed value.
+  std::string encoded_targets_;
+  nlohmann::json targets_;
+  // The serialized request payload up to the client's "state", which does not
+  // change, and the most recent payload, which is rebuilt only after a
+  // response is processed.
+  std::string request_prefix_;
+  std::string request_body_;
+  bool request_body_stale_ = true;
 
  public:
   Manager(const tracing::TracerSignature& tracer_signature,
@@ -74,15 +85,26 @@ class Manager {
   // configuration request.
   nlohmann::json make_request_payload();
 
+  // Return the serialized payload to be sent in a remote configuration
+  // request.  The returned reference is valid until the next call to
+  // `make_request_body` or `process_response`.
+  const std::string& make_request_body();
+
   // Handles the response received from a remote source and udates the internal
   // state accordingly.
   void process_response(const nlohmann::json& json);
 
- private:
-  // Tell if a `config_path` is a new configuration update.
-  bool is_new_config(tracing::StringView config_path,
-                     const nlohmann::json& config_meta);
+  // Return the targets version and the applied configurations, as a JSON
+  // object that `restore_state` accepts.
+  nlohmann::json state_json() const;
 
+  // Apply the configurations of the specified `state`, as returned by
+  // `state_json` of a previous `Manager`, and resume from its targets
+  // version, so that the remote source sends only what changed since.  If
+  // `state` is invalid, log an error and change nothing.
+  void restore_state(const nlohmann::json& state);
+
+ private:
   void error(std::string message);
 };
 
@@ -0,0 +1,56 @@
+#include "rule_index.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Return the FNV-1a hash of the lower case version of the specified `text`.
+// Only ASCII letters are folded, as in `Glob`.
+std::uint64_t lower_hash(StringView text) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (char c : text) {
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    hash ^= std::uint64_t((unsigned char)c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+RuleIndex::RuleIndex(const std::vector<const CompiledSpanMatcher*>& matchers)
+    : num_rules_(matchers.size()),
+      indexed_(matchers.size() >= min_indexed_rules) {
+  if (!indexed_) {
+    return;
+  }
+
+  for (std::size_t i = 0; i < matchers.size(); ++i) {
+    const auto& matcher = *matchers[i];
+    if (matcher.service().kind() == Glob::Kind::LITERAL) {
+      by_service_[lower_hash(matcher.service().lower_pattern())].push_back(i);
+    } else if (matcher.name().kind() == Glob::Kind::LITERAL) {
+      by_name_[lower_hash(matcher.name().lower_pattern())].push_back(i);
+    } else {
+      residual_.push_back(i);
+    }
+  }
+}
+
+const RuleIndex::Bucket* RuleIndex::find(
+    const std::unordered_map<std::uint64_t, Bucket>& buckets,
+    StringView subject) {
+  if (buckets.empty()) {
+    return nullptr;
+  }
+  const auto found = buckets.find(lower_hash(subject));
+  if (found == buckets.end()) {
+    return nullptr;
+  }
+  return &found->second;
+}
+
+}  // namespace tracing
+}  // namespace datadog
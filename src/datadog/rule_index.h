@@ -0,0 +1,117 @@
+#pragma once
+
+// This component provides a `class`, `RuleIndex`, that finds the first of a
+// sequence of sampling rules that matches a span, without evaluating every
+// rule.
+//
+// Each rule whose service pattern is a literal, e.g. "checkout", is filed
+// under that service.  Each other rule whose operation name pattern is a
+// literal is filed under that name.  The remaining rules are "residual."  For
+// a given span, only the rules filed under the span's service, those filed
+// under the span's name, and the residual rules can match, so only those are
+// evaluated, in their original order.  The first matching rule is therefore
+// the same as it would be for a linear scan.
+//
+// Rules are filed under a hash of the lower case literal.  Two literals that
+// hash equally share a bucket, which is harmless because every candidate rule
+// is evaluated in full.
+//
+// Small rule sets are not indexed, and are instead scanned linearly.
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "compiled_span_matcher.h"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+class RuleIndex {
+  using Bucket = std::vector<std::size_t>;
+
+  std::size_t num_rules_;
+  bool indexed_;
+  std::unordered_map<std::uint64_t, Bucket> by_service_;
+  std::unordered_map<std::uint64_t, Bucket> by_name_;
+  Bucket residual_;
+
+  // Return the bucket for the specified `subject` in the specified `buckets`,
+  // or return null if there isn't one.
+  static const Bucket* find(
+      const std::unordered_map<std::uint64_t, Bucket>& buckets,
+      StringView subject);
+
+ public:
+  // Rule sets with fewer than this many rules are scanned linearly.
+  static constexpr std::size_t min_indexed_rules = 8;
+
+  // Create an index of the specified `matchers`, which are the matchers of a
+  // sequence of rules, in order.
+  explicit RuleIndex(const std::vector<const CompiledSpanMatcher*>& matchers);
+
+  // Create an index of the specified `rules`, where the specified `matcher`
+  // returns a reference to the `CompiledSpanMatcher` of a rule.
+  template <typename Rules, typename GetMatcher>
+  RuleIndex(const Rules& rules, GetMatcher&& matcher);
+
+  // Return the offset of the first rule that the specified `span` matches, or
+  // return the number of rules if there is no such rule.  The specified
+  // `matches` is invoked with the offset of a rule, and must return whether
+  // `span` matches that rule.
+  template <typename Matches>
+  std::size_t find_first(const SpanData& span, Matches&& matches) const;
+};
+
+template <typename Rules, typename GetMatcher>
+RuleIndex::RuleIndex(const Rules& rules, GetMatcher&& matcher)
+    : RuleIndex([&]() {
+        std::vector<const CompiledSpanMatcher*> matchers;
+        matchers.reserve(rules.size());
+        for (const auto& rule : rules) {
+          matchers.push_back(&matcher(rule));
+        }
+        return matchers;
+      }()) {}
+
+template <typename Matches>
+std::size_t RuleIndex::find_first(const SpanData& span,
+                                  Matches&& matches) const {
+  if (!indexed_) {
+    for (std::size_t i = 0; i < num_rules_; ++i) {
+      if (matches(i)) {
+        return i;
+      }
+    }
+    return num_rules_;
+  }
+
+  // Merge the candidate buckets, which are each sorted, in rule order.  Each
+  // rule is in at most one bucket.
+  const Bucket* buckets[] = {find(by_service_, span.service),
+                             find(by_name_, span.name), &residual_};
+  std::size_t positions[] = {0, 0, 0};
+  for (;;) {
+    std::size_t next = num_rules_;
+    std::size_t next_bucket = 0;
+    for (std::size_t b = 0; b < 3; ++b) {
+      if (buckets[b] && positions[b] < buckets[b]->size() &&
+          (*buckets[b])[positions[b]] < next) {
+        next = (*buckets[b])[positions[b]];
+        next_bucket = b;
+      }
+    }
+    if (next == num_rules_) {
+      return num_rules_;
+    }
+    if (matches(next)) {
+      return next;
+    }
+    ++positions[next_bucket];
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
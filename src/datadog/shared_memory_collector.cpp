@@ -0,0 +1,287 @@
+#include <datadog/logger.h>
+#include <datadog/shared_memory_collector.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "json.hpp"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SharedMemoryCollector::Header {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t capacity;
+  alignas(64) std::atomic<std::uint64_t> write_position;
+  alignas(64) std::atomic<std::uint64_t> read_position;
+  alignas(64) std::atomic<std::uint32_t> doorbell;
+  std::atomic<std::uint32_t> waiting;
+};
+
+namespace {
+
+constexpr std::uint32_t ring_magic = 0x42524444;  // "DDRB", little-endian
+constexpr std::uint32_t ring_version = 1;
+constexpr std::size_t header_size = 4096;
+constexpr std::size_t min_capacity = 64 * 1024;
+constexpr std::size_t record_header_size = 8;
+constexpr std::uint32_t padding_record = 0;
+constexpr std::uint32_t trace_chunk_record = 1;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "The ring's positions are shared with another process.");
+
+Error setup_error(const std::string& path, const char* what,
+                  int error_number) {
+  std::string message;
+  message += "Unable to set up the shared memory ring at \"";
+  message += path;
+  message += "\": ";
+  message += what;
+  message += ": ";
+  message += std::generic_category().message(error_number);
+  return Error{Error::SHARED_MEMORY_COLLECTOR_SETUP_FAILED,
+               std::move(message)};
+}
+
+bool is_power_of_two(std::uint64_t value) {
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+void put_record_header(char* destination, std::uint32_t size,
+                       std::uint32_t type) {
+  std::memcpy(destination, &size, sizeof size);
+  std::memcpy(destination + sizeof size, &type, sizeof type);
+}
+
+// Wake every process waiting on the specified futex `word`.
+void wake(std::atomic<std::uint32_t>& word) {
+#if defined(__linux__)
+  // Not `FUTEX_PRIVATE_FLAG`: the waiter is another process.
+  ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE,
+            INT_MAX, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+}  // namespace
+
+SharedMemoryCollector::SharedMemoryCollector(
+    const std::shared_ptr<Logger>& logger, std::string path, void* mapping,
+    std::size_t mapping_size)
+    : logger_(logger),
+      path_(std::move(path)),
+      mapping_(mapping),
+      mapping_size_(mapping_size),
+      header_(static_cast<Header*>(mapping)),
+      data_(static_cast<char*>(mapping) + header_size),
+      capacity_(header_->capacity) {
+  static_assert(sizeof(Header) <= header_size, "");
+}
+
+Expected<std::shared_ptr<SharedMemoryCollector>> SharedMemoryCollector::create(
+    const SharedMemoryCollectorConfig& config,
+    const std::shared_ptr<Logger>& logger) {
+  if (!is_power_of_two(config.capacity) || config.capacity < min_capacity) {
+    std::string message;
+    message += "The capacity of a shared memory ring must be a power of two ";
+    message += "of at least ";
+    message += std::to_string(min_capacity);
+    message += " bytes, but ";
+    message += std::to_string(config.capacity);
+    message += " was specified.";
+    return Error{Error::SHARED_MEMORY_COLLECTOR_SETUP_FAILED,
+                 std::move(message)};
+  }
+
+  const int fd =
+      ::open(config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+  if (fd == -1) {
+    return setup_error(config.path, "open", errno);
+  }
+  // The lock serializes initialization with any other process opening the
+  // file at the same time.  The mapping outlives the descriptor.
+  struct Closer {
+    int fd;
+    ~Closer() { ::close(fd); }
+  } closer{fd};
+  if (::flock(fd, LOCK_EX) != 0) {
+    return setup_error(config.path, "flock", errno);
+  }
+
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    return setup_error(config.path, "fstat", errno);
+  }
+  const bool is_new = status.st_size == 0;
+  std::size_t size = header_size + config.capacity;
+  if (is_new) {
+    if (::ftruncate(fd, off_t(size)) != 0) {
+      return setup_error(config.path, "ftruncate", errno);
+    }
+  } else {
+    size = std::size_t(status.st_size);
+  }
+  if (size < header_size) {
+    return Error{Error::SHARED_MEMORY_COLLECTOR_SETUP_FAILED,
+                 "The file \"" + config.path +
+                     "\" is too small to contain a shared memory ring."};
+  }
+
+  void* mapping =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return setup_error(config.path, "mmap", errno);
+  }
+
+  auto* header = static_cast<Header*>(mapping);
+  if (is_new) {
+    // The file was zero-filled by `ftruncate`, so the positions are zero.
+    header->version = ring_version;
+    header->capacity = config.capacity;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = ring_magic;
+  } else if (header->magic != ring_magic || header->version != ring_version ||
+             !is_power_of_two(header->capacity) ||
+             header->capacity + header_size != size) {
+    ::munmap(mapping, size);
+    return Error{Error::SHARED_MEMORY_COLLECTOR_SETUP_FAILED,
+                 "The file \"" + config.path +
+                     "\" does not contain a compatible shared memory ring."};
+  }
+
+  return std::shared_ptr<SharedMemoryCollector>(
+      new SharedMemoryCollector(logger, config.path, mapping, size));
+}
+
+SharedMemoryCollector::~SharedMemoryCollector() {
+  ::munmap(mapping_, mapping_size_);
+}
+
+Expected<void> SharedMemoryCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler) {
+  return send(std::move(spans), ChunkTags{}, response_handler);
+}
+
+Expected<void> SharedMemoryCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const ChunkTags& chunk_tags, const std::shared_ptr<TraceSampler>&) {
+  // Encode the chunk before taking the lock, so that only copying it into
+  // the ring is serialized.
+  thread_local std::string encoded;
+  encoded.clear();
+  auto result = msgpack_encode(encoded, spans, chunk_tags);
+  if (result.if_error()) {
+    return result;
+  }
+  // Don't let one unusually large chunk pin its memory to this thread.
+  struct Trim {
+    ~Trim() {
+      constexpr std::size_t max_retained_capacity = 1 << 20;
+      if (encoded.capacity() > max_retained_capacity) {
+        std::string().swap(encoded);
+      }
+    }
+  } trim;
+
+  const std::uint64_t record_size =
+      (record_header_size + encoded.size() + 7) & ~std::uint64_t(7);
+  if (record_size > capacity_ || encoded.size() > UINT32_MAX) {
+    std::string message;
+    message += "A trace chunk of ";
+    message += std::to_string(encoded.size());
+    message += " bytes does not fit in the shared memory ring of ";
+    message += std::to_string(capacity_);
+    message += " bytes.";
+    return Error{Error::SHARED_MEMORY_COLLECTOR_CHUNK_TOO_LARGE,
+                 std::move(message)};
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Only this process writes `write_position`.
+  std::uint64_t write = header_->write_position.load(std::memory_order_relaxed);
+  const std::uint64_t read =
+      header_->read_position.load(std::memory_order_acquire);
+  std::uint64_t offset = write & (capacity_ - 1);
+  // A record does not wrap around the end of the data region.  Instead, the
+  // rest of the region is padding.
+  const std::uint64_t padding =
+      offset + record_size > capacity_ ? capacity_ - offset : 0;
+  if (write - read > capacity_ ||
+      write - read + padding + record_size > capacity_) {
+    if (dropped_chunks_++ == 0) {
+      logger_->log_error([&](auto& stream) {
+        stream << "The shared memory ring at \"" << path_
+               << "\" is full.  Dropping trace chunks until its reader "
+                  "catches up.";
+      });
+    }
+    return nullopt;
+  }
+
+  if (padding) {
+    put_record_header(data_ + offset,
+                      std::uint32_t(padding - record_header_size),
+                      padding_record);
+    write += padding;
+    offset = 0;
+  }
+  put_record_header(data_ + offset, std::uint32_t(encoded.size()),
+                    trace_chunk_record);
+  std::memcpy(data_ + offset + record_header_size, encoded.data(),
+              encoded.size());
+  write += record_size;
+
+  // The reader sets `waiting` and then checks `write_position`, so one of us
+  // sees the other's store.
+  header_->write_position.store(write, std::memory_order_seq_cst);
+  header_->doorbell.fetch_add(1, std::memory_order_seq_cst);
+  if (header_->waiting.load(std::memory_order_seq_cst)) {
+    wake(header_->doorbell);
+  }
+
+  if (dropped_chunks_ != 0) {
+    logger_->log_error([&](auto& stream) {
+      stream << "The shared memory ring at \"" << path_
+             << "\" has room again, after " << dropped_chunks_
+             << " trace chunk(s) were dropped.";
+    });
+    dropped_chunks_ = 0;
+  }
+  return nullopt;
+}
+
+std::string SharedMemoryCollector::config() const {
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::SharedMemoryCollector"},
+    {"config", nlohmann::json::object({
+      {"path", path_},
+      {"capacity", capacity_},
+    })},
+  }).dump();
+  // clang-format on
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,65 @@
+#include "shared_runtime.h"
+
+#include <datadog/event_scheduler.h>
+#include <datadog/http_client.h>
+
+#include <mutex>
+
+#include "default_http_client.h"
+#include "platform_util.h"
+#include "threaded_event_scheduler.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+std::mutex mutex;
+std::weak_ptr<EventScheduler> event_scheduler;
+// Indexed by whether the client uses HTTP/2.
+std::weak_ptr<HTTPClient> http_clients[2];
+// The `fork_generation` in which the shared instances were created.
+unsigned generation = fork_generation();
+
+// Forget the shared instances if they were created in the parent of this
+// process.  The behavior is undefined unless `mutex` is locked.
+void forget_if_forked() {
+  const unsigned current = fork_generation();
+  if (current != generation) {
+    event_scheduler.reset();
+    http_clients[0].reset();
+    http_clients[1].reset();
+    generation = current;
+  }
+}
+
+}  // namespace
+
+std::shared_ptr<EventScheduler> shared_event_scheduler(
+    std::size_t max_workers, const ThreadFactory& thread_factory) {
+  std::lock_guard<std::mutex> lock(mutex);
+  forget_if_forked();
+  auto result = event_scheduler.lock();
+  if (!result) {
+    result =
+        std::make_shared<ThreadedEventScheduler>(max_workers, thread_factory);
+    event_scheduler = result;
+  }
+  return result;
+}
+
+std::shared_ptr<HTTPClient> shared_http_client(
+    const std::shared_ptr<Logger>& logger, const Clock& clock, bool http2,
+    const ThreadFactory& thread_factory) {
+  std::lock_guard<std::mutex> lock(mutex);
+  forget_if_forked();
+  std::weak_ptr<HTTPClient>& slot = http_clients[http2];
+  auto result = slot.lock();
+  if (!result) {
+    result = default_http_client(logger, clock, http2, nullptr, thread_factory);
+    slot = result;
+  }
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
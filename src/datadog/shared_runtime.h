@@ -0,0 +1,51 @@
+#pragma once
+
+// This component provides functions that return the process-wide default
+// `EventScheduler` and `HTTPClient`, shared by every `DatadogAgent` that is
+// configured with `DatadogAgentConfig::shared_runtime_enabled`.
+//
+// By default, each `DatadogAgent` gets its own `ThreadedEventScheduler` and
+// its own default HTTP client, and so each `Tracer` runs two threads of its
+// own.  A process that creates many tracers can instead have them share one
+// scheduler thread, on which each agent schedules its own flushes, and one
+// HTTP client, on whose event loop each agent's requests are multiplexed.
+// Each agent keeps its own buffer, limits, and telemetry.
+//
+// The shared instances are held by the agents that use them.  When the last
+// such agent is destroyed, the shared instances are destroyed with it, and
+// the next call creates new ones.  The next call in the child of a `fork`
+// also creates new ones, since the threads of the parent's instances do not
+// exist in the child.
+
+#include <datadog/clock.h>
+#include <datadog/thread_factory.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace datadog {
+namespace tracing {
+
+class EventScheduler;
+class HTTPClient;
+class Logger;
+
+// Return the shared `ThreadedEventScheduler`, creating it with the specified
+// `max_workers` and `thread_factory` (see `ThreadedEventScheduler`) if
+// necessary.  A shared scheduler keeps the `max_workers` and `thread_factory`
+// of the call that created it.
+std::shared_ptr<EventScheduler> shared_event_scheduler(
+    std::size_t max_workers, const ThreadFactory& thread_factory);
+
+// Return the shared default HTTP client, creating it with the specified
+// `logger`, `clock`, `http2`, and `thread_factory` (see
+// `default_http_client`) if necessary.  There is one shared client for each
+// value of `http2`.  A shared client keeps the `logger`, `clock`, and
+// `thread_factory` of the call that created it.  Return null if this library
+// was built without a default HTTP client.
+std::shared_ptr<HTTPClient> shared_http_client(
+    const std::shared_ptr<Logger>& logger, const Clock& clock, bool http2,
+    const ThreadFactory& thread_factory);
+
+}  // namespace tracing
+}  // namespace datadog
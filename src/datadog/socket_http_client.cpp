@@ -0,0 +1,1026 @@
+#include "socket_http_client.h"
+
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <datadog/logger.h>
+#include <datadog/optional.h>
+#include <datadog/string_view.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+
+#include "io_uring.h"
+#include "json.hpp"
+#include "parse_util.h"
+#include "string_util.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+// Platforms without `MSG_NOSIGNAL` use the `SO_NOSIGPIPE` socket option
+// instead.  See `open_connection`.
+constexpr int send_flags = 0;
+#endif
+
+bool is_unix_scheme(StringView scheme) {
+  return scheme == "unix" || scheme == "http+unix";
+}
+
+// Return a string that identifies the socket that the specified `url` refers
+// to.  Requests having the same endpoint can share a connection.
+std::string endpoint_of(const HTTPClient::URL& url) {
+  if (is_unix_scheme(url.scheme)) {
+    return "unix://" + url.authority;
+  }
+  return url.scheme + "://" + url.authority;
+}
+
+std::string system_error_message(StringView what, int error_number) {
+  std::string message;
+  append(message, what);
+  message += ": ";
+  message += std::system_category().message(error_number);
+  return message;
+}
+
+// Return the number of milliseconds from the specified `now` until the
+// specified `deadline`, rounded up, for use as a `poll` timeout.
+int poll_timeout(std::chrono::steady_clock::time_point deadline,
+                 std::chrono::steady_clock::time_point now) {
+  if (deadline <= now) {
+    return 0;
+  }
+  const auto milliseconds =
+      std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+  return milliseconds > INT_MAX ? INT_MAX : int(milliseconds);
+}
+
+// Wait until the specified `fd` is ready for any of the specified `events`,
+// until the specified `wakeup_fd` is readable, or until the specified
+// `timeout_ms` elapses.  Return the events that occurred on `fd`, or zero if
+// none did.  Set the specified `woken` to whether `wakeup_fd` is readable.
+short wait_for(int fd, short events, int wakeup_fd, int timeout_ms,
+               bool& woken) {
+  pollfd fds[] = {{fd, events, 0}, {wakeup_fd, POLLIN, 0}};
+  int rc;
+  do {
+    rc = ::poll(fds, 2, timeout_ms);
+  } while (rc < 0 && errno == EINTR);
+  woken = fds[1].revents != 0;
+  if (rc < 0) {
+    return POLLERR;
+  }
+  return fds[0].revents;
+}
+
+void set_nonblocking(int fd) {
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  ::fcntl(fd, F_SETFD, ::fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+// Return a socket connected to the specified `address`, or return an error if
+// the connection cannot be made by the specified `deadline` or before the
+// specified `wakeup_fd` becomes readable.  Use the specified `description` of
+// the endpoint in error messages.
+Expected<int> open_connection(int family, const sockaddr* address,
+                              socklen_t address_length,
+                              std::chrono::steady_clock::time_point deadline,
+                              const Clock& clock, int wakeup_fd,
+                              StringView description) {
+  const int fd = ::socket(family, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                 system_error_message("Unable to create a socket", errno)};
+  }
+  set_nonblocking(fd);
+#ifdef SO_NOSIGPIPE
+  const int enable = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof enable);
+#endif
+
+  std::string what = "Unable to connect to ";
+  append(what, description);
+  if (::connect(fd, address, address_length) != 0) {
+    if (errno != EINPROGRESS) {
+      const int error_number = errno;
+      ::close(fd);
+      return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                   system_error_message(what, error_number)};
+    }
+
+    bool woken;
+    const short revents = wait_for(fd, POLLOUT, wakeup_fd,
+                                   poll_timeout(deadline, clock().tick), woken);
+    if (revents == 0) {
+      ::close(fd);
+      what += ": ";
+      what += woken ? "The HTTP client is shutting down."
+                    : "Request deadline exceeded.";
+      return Error{Error::SOCKET_HTTP_CLIENT_DEADLINE_EXCEEDED,
+                   std::move(what)};
+    }
+
+    int error_number = 0;
+    socklen_t length = sizeof error_number;
+    ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error_number, &length);
+    if (error_number != 0) {
+      ::close(fd);
+      return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                   system_error_message(what, error_number)};
+    }
+  }
+
+  return fd;
+}
+
+// Return whether the connected socket `fd` can still be used to send a
+// request, i.e. whether the server has not closed it.
+bool is_alive(int fd) {
+  pollfd poll_fd{fd, POLLIN, 0};
+  if (::poll(&poll_fd, 1, 0) == 0) {
+    return true;
+  }
+  // The socket is readable, but no response is outstanding, so either the
+  // server has closed the connection or it has sent something unexpected.
+  // Either way, don't reuse it.
+  return false;
+}
+
+// `RequestHeaderWriter` appends header fields to the head of an HTTP request.
+// It omits "Content-Length", which `SocketHTTPClient` always sets itself.
+class RequestHeaderWriter : public DictWriter {
+  std::string& head_;
+
+ public:
+  explicit RequestHeaderWriter(std::string& head) : head_(head) {}
+
+  void set(StringView key, StringView value) override {
+    if (to_lower(key) == "content-length") {
+      return;
+    }
+    append(head_, key);
+    head_ += ": ";
+    append(head_, value);
+    head_ += "\r\n";
+  }
+};
+
+class ResponseHeaderReader : public DictReader {
+  const std::unordered_map<std::string, std::string>& headers_lower_;
+  mutable std::string buffer_;
+
+ public:
+  explicit ResponseHeaderReader(
+      const std::unordered_map<std::string, std::string>& headers_lower)
+      : headers_lower_(headers_lower) {}
+
+  Optional<StringView> lookup(StringView key) const override {
+    buffer_ = to_lower(key);
+    const auto found = headers_lower_.find(buffer_);
+    if (found == headers_lower_.end()) {
+      return nullopt;
+    }
+    return found->second;
+  }
+
+  void visit(Visitor visitor) const override {
+    for (const auto& [key, value] : headers_lower_) {
+      visitor(key, value);
+    }
+  }
+};
+
+struct Response {
+  int status = 0;
+  std::unordered_map<std::string, std::string> headers_lower;
+  std::string body;
+  // Whether the server will close the connection after this response.
+  bool close = false;
+};
+
+enum class Parse { INCOMPLETE, COMPLETE, MALFORMED };
+
+// Parse the chunked transfer coding at the beginning of the specified
+// `input`, appending the decoded data to the specified `body`.  If parsing is
+// complete, set the specified `consumed` to the length of the encoding.
+Parse parse_chunked(StringView input, std::string& body,
+                    std::size_t& consumed) {
+  std::size_t position = 0;
+  for (;;) {
+    const auto line_end = input.find("\r\n", position);
+    if (line_end == StringView::npos) {
+      return Parse::INCOMPLETE;
+    }
+    StringView size_field = input.substr(position, line_end - position);
+    // Ignore any chunk extensions.
+    size_field = trim(size_field.substr(0, size_field.find(';')));
+    const auto size = parse_uint64(size_field, 16);
+    if (!size) {
+      return Parse::MALFORMED;
+    }
+    position = line_end + 2;
+
+    if (*size == 0) {
+      // Skip any trailer fields, up to and including the empty line that ends
+      // the message.
+      for (;;) {
+        const auto trailer_end = input.find("\r\n", position);
+        if (trailer_end == StringView::npos) {
+          return Parse::INCOMPLETE;
+        }
+        const bool empty = trailer_end == position;
+        position = trailer_end + 2;
+        if (empty) {
+          consumed = position;
+          return Parse::COMPLETE;
+        }
+      }
+    }
+
+    if (*size > input.size() || input.size() - position < *size + 2) {
+      return Parse::INCOMPLETE;
+    }
+    if (input.substr(position + *size, 2) != "\r\n") {
+      return Parse::MALFORMED;
+    }
+    body.append(input.data() + position, *size);
+    position += *size + 2;
+  }
+}
+
+// Parse the HTTP response at the beginning of the specified `input` into the
+// specified `response`.  If parsing is complete, set the specified `consumed`
+// to the length of the response.  The specified `eof` indicates whether the
+// server has closed the connection, i.e. whether `input` is all there is.
+Parse parse_response(StringView input, bool eof, Response& response,
+                     std::size_t& consumed) {
+  const auto head_end = input.find("\r\n\r\n");
+  if (head_end == StringView::npos) {
+    return eof ? Parse::MALFORMED : Parse::INCOMPLETE;
+  }
+  const StringView head = input.substr(0, head_end);
+
+  // e.g. "HTTP/1.1 200 OK"
+  const auto status_line_end = head.find("\r\n");
+  const StringView status_line = head.substr(0, status_line_end);
+  const auto space = status_line.find(' ');
+  if (!starts_with(status_line, "HTTP/1.") || space == StringView::npos) {
+    return Parse::MALFORMED;
+  }
+  const auto status = parse_int(status_line.substr(space + 1, 3), 10);
+  if (!status) {
+    return Parse::MALFORMED;
+  }
+  response.status = *status;
+
+  bool chunked = false;
+  bool keep_alive = false;
+  Optional<std::uint64_t> content_length;
+  StringView fields = status_line_end == StringView::npos
+                          ? StringView()
+                          : head.substr(status_line_end + 2);
+  while (!fields.empty()) {
+    const auto line_end = fields.find("\r\n");
+    const StringView line = fields.substr(0, line_end);
+    fields = line_end == StringView::npos ? StringView()
+                                          : fields.substr(line_end + 2);
+    const auto colon = line.find(':');
+    if (colon == StringView::npos) {
+      return Parse::MALFORMED;
+    }
+    std::string key = to_lower(trim(line.substr(0, colon)));
+    const StringView value = trim(line.substr(colon + 1));
+    const std::string value_lower = to_lower(value);
+    if (key == "content-length") {
+      const auto length = parse_uint64(value, 10);
+      if (!length) {
+        return Parse::MALFORMED;
+      }
+      content_length = *length;
+    } else if (key == "transfer-encoding") {
+      chunked = value_lower.find("chunked") != std::string::npos;
+    } else if (key == "connection") {
+      response.close = value_lower.find("close") != std::string::npos;
+      keep_alive = value_lower.find("keep-alive") != std::string::npos;
+    }
+    response.headers_lower.emplace(std::move(key), std::string(value));
+  }
+  if (starts_with(status_line, "HTTP/1.0") && !keep_alive) {
+    response.close = true;
+  }
+
+  const std::size_t body_begin = head_end + 4;
+  const StringView rest = input.substr(body_begin);
+  if (response.status / 100 == 1 || response.status == 204 ||
+      response.status == 304) {
+    consumed = body_begin;
+    return Parse::COMPLETE;
+  }
+
+  if (chunked) {
+    std::size_t length = 0;
+    const auto result = parse_chunked(rest, response.body, length);
+    if (result == Parse::INCOMPLETE) {
+      return eof ? Parse::MALFORMED : Parse::INCOMPLETE;
+    }
+    // `length` is set only if the body is complete.
+    if (result == Parse::COMPLETE) {
+      consumed = body_begin + length;
+    }
+    return result;
+  }
+
+  if (content_length) {
+    if (rest.size() < *content_length) {
+      return eof ? Parse::MALFORMED : Parse::INCOMPLETE;
+    }
+    response.body.assign(rest.data(), *content_length);
+    consumed = body_begin + *content_length;
+    return Parse::COMPLETE;
+  }
+
+  // The body extends until the server closes the connection.
+  response.close = true;
+  if (!eof) {
+    return Parse::INCOMPLETE;
+  }
+  response.body.assign(rest.data(), rest.size());
+  consumed = input.size();
+  return Parse::COMPLETE;
+}
+
+}  // namespace
+
+struct SocketHTTPClient::Request {
+  URL url;
+  // The request line and header fields, including the empty line that ends
+  // them.
+  std::string head;
+  SharedBody body;
+  ResponseHandler on_response;
+  ErrorHandler on_error;
+  std::chrono::steady_clock::time_point deadline;
+  // How many bytes of `head`, followed by `body`, have been sent.
+  std::size_t sent = 0;
+
+  std::size_t size() const { return head.size() + body.data.size(); }
+
+  // Point the specified `parts` at what remains to be sent of this request,
+  // and return how many of them were used.
+  std::size_t unsent_parts(iovec (&parts)[2]) const {
+    const StringView body_data = body.data;
+    if (sent < head.size()) {
+      parts[0] = {const_cast<char*>(head.data()) + sent, head.size() - sent};
+      parts[1] = {const_cast<char*>(body_data.data()), body_data.size()};
+      return 2;
+    }
+    const std::size_t offset = sent - head.size();
+    parts[0] = {const_cast<char*>(body_data.data()) + offset,
+                body_data.size() - offset};
+    return 1;
+  }
+};
+
+struct SocketHTTPClient::Connection {
+  int fd = -1;
+  // The `endpoint_of` the URL that `fd` is connected to.
+  std::string endpoint;
+  // Data received that has not yet been parsed into responses.
+  std::string received;
+
+  ~Connection() { close(); }
+
+  void close() {
+    if (fd != -1) {
+      ::close(fd);
+      fd = -1;
+    }
+    endpoint.clear();
+    received.clear();
+  }
+};
+
+// `Ring` is the state of I/O done through an io_uring.  At most one send and
+// one receive are pending at a time.  A poll of the wakeup pipe is kept
+// pending, so that waiting for I/O also waits for a wakeup.
+struct SocketHTTPClient::Ring {
+  // The `user_data` of each kind of operation.
+  enum Operation : std::uint64_t { SEND = 1, RECEIVE, WAKEUP, CANCEL };
+
+  // The buffer into which responses are read.  It is registered with
+  // `uring`, and so is declared before it, to outlive it.
+  std::unique_ptr<char[]> buffer;
+  std::size_t buffer_size = 64 * 1024;
+  std::unique_ptr<IoUring> uring;
+  // The pending send refers to `message`, which refers to `parts`.
+  msghdr message{};
+  iovec parts[2];
+  bool sending = false;
+  bool receiving = false;
+  bool watching_wakeup = false;
+};
+
+SocketHTTPClient::SocketHTTPClient(const std::shared_ptr<Logger>& logger,
+                                   const Clock& clock)
+    : SocketHTTPClient(logger, clock, Options{}) {}
+
+SocketHTTPClient::SocketHTTPClient(const std::shared_ptr<Logger>& logger,
+                                   const Clock& clock, const Options& options)
+    : logger_(logger),
+      clock_(clock),
+      wakeup_{-1, -1},
+      num_pending_requests_(0),
+      shutting_down_(false),
+      running_(false) {
+  if (::pipe(wakeup_) != 0) {
+    logger_->log_error(
+        Error{Error::SOCKET_HTTP_CLIENT_SETUP_FAILED,
+              system_error_message("Unable to create a pipe", errno)});
+    wakeup_[0] = wakeup_[1] = -1;
+    return;
+  }
+  set_nonblocking(wakeup_[0]);
+  set_nonblocking(wakeup_[1]);
+
+  if (options.io_uring) {
+    auto ring = std::make_unique<Ring>();
+    ring->buffer = std::make_unique<char[]>(ring->buffer_size);
+    auto uring = IoUring::create(8);
+    Expected<void> registered;
+    if (uring) {
+      registered = (*uring)->register_buffer(ring->buffer.get(),
+                                             ring->buffer_size);
+    }
+    if (auto* error = uring ? registered.if_error() : uring.if_error()) {
+      logger_->log_error(
+          error->with_prefix("Falling back to poll for socket I/O.  "));
+    } else {
+      ring->uring = std::move(*uring);
+      ring_ = std::move(ring);
+    }
+  }
+
+  try {
+    worker_ = start_thread(options.thread_factory, "dd-http",
+                           [this]() { run(); });
+    running_ = true;
+  } catch (const std::system_error& error) {
+    logger_->log_error(
+        Error{Error::SOCKET_HTTP_CLIENT_SETUP_FAILED, error.what()});
+  }
+}
+
+SocketHTTPClient::~SocketHTTPClient() {
+  if (running_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutting_down_ = true;
+    }
+    has_requests_.notify_one();
+    const char byte = 0;
+    const auto rc = ::write(wakeup_[1], &byte, 1);
+    (void)rc;
+    worker_.join();
+  }
+
+  for (const int fd : wakeup_) {
+    if (fd != -1) {
+      ::close(fd);
+    }
+  }
+}
+
+Expected<void> SocketHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  return post(url, std::move(set_headers),
+              std::make_shared<const std::string>(std::move(body)),
+              std::move(on_response), std::move(on_error), deadline);
+}
+
+Expected<void> SocketHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, SharedBody body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  if (!running_) {
+    return Error{Error::SOCKET_HTTP_CLIENT_NOT_RUNNING,
+                 "Unable to send request because the HTTP client failed to "
+                 "start."};
+  }
+  if (url.scheme != "http" && !is_unix_scheme(url.scheme)) {
+    std::string message;
+    message += "SocketHTTPClient does not support the \"";
+    message += url.scheme;
+    message += "\" URL scheme.";
+    return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_SETUP_FAILED,
+                 std::move(message)};
+  }
+
+  auto request = std::make_unique<Request>();
+  request->url = url;
+  std::string& head = request->head;
+  head += "POST ";
+  head += url.path.empty() ? "/" : url.path;
+  head += " HTTP/1.1\r\nHost: ";
+  // The authority of a Unix domain socket URL is a file path, not a host.
+  head += is_unix_scheme(url.scheme) ? "localhost" : url.authority;
+  head += "\r\n";
+  RequestHeaderWriter writer{head};
+  set_headers(writer);
+  head += "Content-Length: ";
+  head += std::to_string(body.data.size());
+  head += "\r\n\r\n";
+  request->body = std::move(body);
+  request->on_response = std::move(on_response);
+  request->on_error = std::move(on_error);
+  request->deadline = deadline;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(request));
+    ++num_pending_requests_;
+  }
+  has_requests_.notify_one();
+
+  return nullopt;
+}
+
+void SocketHTTPClient::drain(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  no_requests_.wait_until(lock, deadline,
+                          [this]() { return num_pending_requests_ == 0; });
+}
+
+std::string SocketHTTPClient::config() const {
+  return nlohmann::json::object(
+             {{"type", "datadog::tracing::SocketHTTPClient"},
+              {"io_uring", ring_ != nullptr}})
+      .dump();
+}
+
+bool SocketHTTPClient::stopping() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return shutting_down_;
+}
+
+void SocketHTTPClient::run() {
+  Connection connection;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    has_requests_.wait(lock,
+                       [this]() { return shutting_down_ || !queue_.empty(); });
+    if (shutting_down_) {
+      // Requests that have not been sent are abandoned, as they are by
+      // `Curl`.
+      break;
+    }
+
+    std::vector<std::unique_ptr<Request>> requests;
+    requests.swap(queue_);
+    lock.unlock();
+    send(connection, requests);
+    lock.lock();
+
+    num_pending_requests_ -= requests.size();
+    if (num_pending_requests_ == 0) {
+      no_requests_.notify_all();
+    }
+  }
+}
+
+void SocketHTTPClient::send(Connection& connection,
+                            std::vector<std::unique_ptr<Request>>& requests) {
+  std::size_t i = 0;
+  while (i < requests.size() && !stopping()) {
+    Request& request = *requests[i];
+    if (request.deadline <= clock_().tick) {
+      request.on_error(Error{Error::SOCKET_HTTP_CLIENT_DEADLINE_EXCEEDED,
+                             "Request deadline exceeded before the request "
+                             "was sent."});
+      ++i;
+      continue;
+    }
+
+    // Consecutive requests to the same endpoint share a connection.
+    const std::string endpoint = endpoint_of(request.url);
+    std::size_t count = 1;
+    while (i + count < requests.size() &&
+           endpoint_of(requests[i + count]->url) == endpoint) {
+      ++count;
+    }
+
+    if (connection.endpoint != endpoint || !is_alive(connection.fd)) {
+      connection.close();
+      auto result = connect(connection, request.url, request.deadline);
+      if (auto* error = result.if_error()) {
+        for (std::size_t j = i; j < i + count; ++j) {
+          requests[j]->on_error(*error);
+        }
+        i += count;
+        continue;
+      }
+      if (ring_) {
+        // io_uring operations on a nonblocking socket fail with `EAGAIN`
+        // rather than wait in the kernel for the socket to be ready.
+        ::fcntl(connection.fd, F_SETFL,
+                ::fcntl(connection.fd, F_GETFL) & ~O_NONBLOCK);
+      }
+      connection.endpoint = endpoint;
+    }
+
+    const std::size_t finished = pipeline(connection, &requests[i], count);
+    if (finished == 0) {
+      // We're shutting down.
+      return;
+    }
+    i += finished;
+  }
+}
+
+Expected<void> SocketHTTPClient::connect(
+    Connection& connection, const URL& url,
+    std::chrono::steady_clock::time_point deadline) {
+  if (is_unix_scheme(url.scheme)) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (url.authority.size() >= sizeof address.sun_path) {
+      std::string message;
+      message += "Unix domain socket path is too long: ";
+      message += url.authority;
+      return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                   std::move(message)};
+    }
+    std::memcpy(address.sun_path, url.authority.c_str(),
+                url.authority.size() + 1);
+    auto fd = open_connection(
+        AF_UNIX, reinterpret_cast<const sockaddr*>(&address), sizeof address,
+        deadline, clock_, wakeup_[0], url.authority);
+    if (auto* error = fd.if_error()) {
+      return *error;
+    }
+    connection.fd = *fd;
+    return nullopt;
+  }
+
+  // The authority is "host", "host:port", "[ipv6]", or "[ipv6]:port".
+  const StringView authority = url.authority;
+  StringView host = authority;
+  StringView port = "80";
+  if (starts_with(authority, "[")) {
+    const auto bracket = authority.find(']');
+    if (bracket == StringView::npos) {
+      std::string message;
+      message += "Invalid authority in URL: ";
+      message += url.authority;
+      return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                   std::move(message)};
+    }
+    host = authority.substr(1, bracket - 1);
+    if (authority.substr(bracket + 1, 1) == ":") {
+      port = authority.substr(bracket + 2);
+    }
+  } else if (const auto colon = authority.rfind(':');
+             colon != StringView::npos) {
+    host = authority.substr(0, colon);
+    port = authority.substr(colon + 1);
+  }
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  const std::string host_string(host);
+  const std::string port_string(port);
+  const int rc = ::getaddrinfo(host_string.c_str(), port_string.c_str(),
+                               &hints, &addresses);
+  if (rc != 0) {
+    std::string message;
+    message += "Unable to resolve \"";
+    message += host_string;
+    message += "\": ";
+    message += ::gai_strerror(rc);
+    return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                 std::move(message)};
+  }
+  std::unique_ptr<addrinfo, decltype(&::freeaddrinfo)> cleanup{
+      addresses, &::freeaddrinfo};
+
+  Error error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+              "No addresses found for " + host_string};
+  for (const addrinfo* address = addresses; address;
+       address = address->ai_next) {
+    auto fd = open_connection(address->ai_family, address->ai_addr,
+                              address->ai_addrlen, deadline, clock_,
+                              wakeup_[0], url.authority);
+    if (fd) {
+      connection.fd = *fd;
+      return nullopt;
+    }
+    error = fd.error();
+  }
+  return error;
+}
+
+std::size_t SocketHTTPClient::pipeline(Connection& connection,
+                                       std::unique_ptr<Request>* requests,
+                                       std::size_t count) {
+  // Requests before `num_sent` have been sent entirely.  Requests before
+  // `num_answered` are finished.
+  std::size_t num_sent = 0;
+  std::size_t num_answered = 0;
+  // Whether the server has closed the connection, or will close it after its
+  // last response.
+  bool closed = false;
+
+  // Fail the requests that were sent, in whole or in part, but not answered,
+  // and close the connection.  If the specified `include_next` is true, then
+  // also fail the next request, even if none of it was sent.  Return the
+  // number of finished requests.  Requests that weren't sent can be sent
+  // over another connection.
+  const auto fail = [&](const Error& error, bool include_next) {
+    std::size_t num_started = num_sent;
+    if (num_started < count && requests[num_started]->sent != 0) {
+      ++num_started;
+    }
+    if (include_next && num_started == num_answered) {
+      ++num_started;
+    }
+    if (ring_) {
+      settle(connection);
+    }
+    for (; num_answered < num_started; ++num_answered) {
+      requests[num_answered]->on_error(error);
+    }
+    connection.close();
+    return num_answered;
+  };
+
+  while (num_answered < count) {
+    const Request& awaited = *requests[num_answered];
+    const bool may_send = num_sent < count && !closed;
+    bool eof = false;
+    const auto round =
+        ring_ ? ring_round(connection, requests, count, num_sent, may_send,
+                           awaited.deadline, eof)
+              : poll_round(connection, requests, count, num_sent, may_send,
+                           awaited.deadline, eof);
+    if (auto* error = round.if_error()) {
+      return fail(*error, true);
+    }
+    if (*round == Round::WOKEN) {
+      // We're shutting down.  Abandon the remaining requests.
+      if (ring_) {
+        settle(connection);
+      }
+      connection.close();
+      return num_answered;
+    }
+    if (*round == Round::TIMED_OUT) {
+      return fail(Error{Error::SOCKET_HTTP_CLIENT_DEADLINE_EXCEEDED,
+                        "Request deadline exceeded while waiting for a "
+                        "response."},
+                  true);
+    }
+
+    while (num_answered < count && !closed) {
+      Response response;
+      std::size_t consumed = 0;
+      const auto result =
+          parse_response(connection.received, eof, response, consumed);
+      if (result == Parse::INCOMPLETE) {
+        break;
+      }
+      if (result == Parse::MALFORMED) {
+        return fail(Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                          "Received a malformed HTTP response."},
+                    true);
+      }
+      connection.received.erase(0, consumed);
+      if (response.status / 100 == 1) {
+        // Skip interim responses, e.g. "100 Continue".
+        continue;
+      }
+      closed = response.close;
+      Request& answered = *requests[num_answered++];
+      const ResponseHeaderReader headers{response.headers_lower};
+      answered.on_response(response.status, headers, std::move(response.body));
+    }
+
+    if ((closed || eof) && num_answered < count) {
+      return fail(Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                        "The connection was closed before a response was "
+                        "received."},
+                  num_answered == 0);
+    }
+  }
+
+  if (ring_) {
+    // A send might be pending if the server answered before reading all of
+    // the request.
+    settle(connection);
+  }
+  if (closed || num_sent < count) {
+    // A request that was answered before it was sent entirely leaves the
+    // connection in an unknown state.
+    connection.close();
+  }
+  return num_answered;
+}
+
+Expected<SocketHTTPClient::Round> SocketHTTPClient::poll_round(
+    Connection& connection, std::unique_ptr<Request>* requests,
+    std::size_t count, std::size_t& num_sent, bool may_send,
+    std::chrono::steady_clock::time_point deadline, bool& eof) {
+  short events = POLLIN;
+  if (may_send) {
+    events |= POLLOUT;
+  }
+  bool woken;
+  const short revents =
+      wait_for(connection.fd, events, wakeup_[0],
+               poll_timeout(deadline, clock_().tick), woken);
+  if (woken) {
+    return Round::WOKEN;
+  }
+  if (revents == 0) {
+    return Round::TIMED_OUT;
+  }
+
+  if (revents & POLLOUT) {
+    while (num_sent < count) {
+      Request& request = *requests[num_sent];
+      iovec parts[2];
+      msghdr message{};
+      message.msg_iov = parts;
+      message.msg_iovlen = request.unsent_parts(parts);
+      const ssize_t rc = ::sendmsg(connection.fd, &message, send_flags);
+      if (rc < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        return Error{
+            Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+            system_error_message("Unable to send request", errno)};
+      }
+      request.sent += rc;
+      if (request.sent == request.size()) {
+        ++num_sent;
+      }
+    }
+  }
+
+  if (!(revents & (POLLIN | POLLHUP | POLLERR))) {
+    return Round::PROGRESS;
+  }
+
+  char buffer[4096];
+  for (;;) {
+    const ssize_t rc = ::recv(connection.fd, buffer, sizeof buffer, 0);
+    if (rc > 0) {
+      connection.received.append(buffer, rc);
+    } else if (rc == 0) {
+      eof = true;
+      break;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else {
+      return Error{Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+                   system_error_message("Unable to read response", errno)};
+    }
+  }
+  return Round::PROGRESS;
+}
+
+Expected<SocketHTTPClient::Round> SocketHTTPClient::ring_round(
+    Connection& connection, std::unique_ptr<Request>* requests,
+    std::size_t count, std::size_t& num_sent, bool may_send,
+    std::chrono::steady_clock::time_point deadline, bool& eof) {
+  Ring& ring = *ring_;
+  IoUring& uring = *ring.uring;
+  // The submission queue has room for every operation queued here.
+  if (!ring.watching_wakeup) {
+    uring.poll(wakeup_[0], POLLIN, Ring::WAKEUP);
+    ring.watching_wakeup = true;
+  }
+  if (may_send && !ring.sending && num_sent < count) {
+    ring.message.msg_iov = ring.parts;
+    ring.message.msg_iovlen = requests[num_sent]->unsent_parts(ring.parts);
+    uring.sendmsg(connection.fd, &ring.message, send_flags, Ring::SEND);
+    ring.sending = true;
+  }
+  if (!ring.receiving) {
+    uring.read_fixed(connection.fd, ring.buffer.get(),
+                     unsigned(ring.buffer_size), Ring::RECEIVE);
+    ring.receiving = true;
+  }
+
+  const auto now = clock_().tick;
+  auto result = uring.submit_and_wait(
+      std::max(deadline - now, std::chrono::steady_clock::duration::zero()));
+  if (auto* error = result.if_error()) {
+    return *error;
+  }
+
+  bool completed = false;
+  IoUring::Completion completion;
+  while (uring.pop(completion)) {
+    completed = true;
+    const int rc = completion.result;
+    switch (completion.user_data) {
+      case Ring::WAKEUP:
+        ring.watching_wakeup = false;
+        return Round::WOKEN;
+      case Ring::SEND:
+        ring.sending = false;
+        if (rc >= 0) {
+          Request& request = *requests[num_sent];
+          request.sent += rc;
+          if (request.sent == request.size()) {
+            ++num_sent;
+          }
+        } else if (rc != -EINTR && rc != -EAGAIN) {
+          return Error{
+              Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+              system_error_message("Unable to send request", -rc)};
+        }
+        break;
+      case Ring::RECEIVE:
+        ring.receiving = false;
+        if (rc > 0) {
+          connection.received.append(ring.buffer.get(), rc);
+        } else if (rc == 0) {
+          eof = true;
+        } else if (rc != -EINTR && rc != -EAGAIN) {
+          return Error{
+              Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE,
+              system_error_message("Unable to read response", -rc)};
+        }
+        break;
+    }
+  }
+
+  if (!completed && clock_().tick >= deadline) {
+    return Round::TIMED_OUT;
+  }
+  return Round::PROGRESS;
+}
+
+void SocketHTTPClient::settle(Connection& connection) {
+  Ring& ring = *ring_;
+  IoUring& uring = *ring.uring;
+  if (ring.sending) {
+    uring.cancel(Ring::SEND, Ring::CANCEL);
+  }
+  if (ring.receiving) {
+    uring.cancel(Ring::RECEIVE, Ring::CANCEL);
+  }
+  while (ring.sending || ring.receiving) {
+    if (!uring.submit_and_wait(std::chrono::seconds(1))) {
+      break;
+    }
+    IoUring::Completion completion;
+    while (uring.pop(completion)) {
+      switch (completion.user_data) {
+        case Ring::WAKEUP:
+          ring.watching_wakeup = false;
+          break;
+        case Ring::SEND:
+          ring.sending = false;
+          break;
+        case Ring::RECEIVE:
+          ring.receiving = false;
+          if (completion.result > 0) {
+            connection.received.append(ring.buffer.get(), completion.result);
+          }
+          break;
+      }
+    }
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,150 @@
+#pragma once
+
+// This component provides a `class`, `SocketHTTPClient`, that implements the
+// `HTTPClient` interface directly in terms of POSIX sockets, without libcurl.
+//
+// `SocketHTTPClient` speaks the subset of HTTP/1.1 needed to talk to a Datadog
+// Agent, over a persistent connection either to a Unix domain socket
+// ("unix://", "http+unix://") or to a TCP endpoint ("http://").  HTTPS is not
+// supported.  It is intended for the common setup where the Agent is local,
+// and where starting libcurl is a noticeable part of the cost of a
+// short-lived process.
+//
+// `SocketHTTPClient` manages a thread that sends requests and reads their
+// responses.  Requests that are posted while the thread is busy are queued,
+// and the queued requests are then pipelined: they are written to the
+// connection back-to-back, and their responses are read in order.  If the
+// connection fails, or if the Agent closes it, then requests that were sent
+// but not answered are failed rather than sent again, since a POST is not safe
+// to repeat.
+//
+// If `SocketHTTPClient::Options::io_uring` is true, then on Linux the thread
+// does its socket I/O through an io_uring (see `io_uring.h`) instead of
+// `poll`, `sendmsg`, and `recv`.  Each round of sending and receiving is then
+// one system call, and responses are read into a buffer registered with the
+// kernel.  If io_uring is unavailable, e.g. on an older kernel or where it is
+// disabled, then an error is logged and `poll` is used instead.
+//
+// This file and its implementation, `socket_http_client.cpp`, are included
+// only in builds for POSIX platforms.  If this library was built with
+// `DD_TRACE_TRANSPORT` set to "socket", then `default_http_client` returns a
+// `SocketHTTPClient`.  If it was built with `DD_TRACE_TRANSPORT` set to
+// "io_uring", then `default_http_client` returns a `SocketHTTPClient` that
+// uses io_uring.
+
+#include <datadog/clock.h>
+#include <datadog/http_client.h>
+#include <datadog/thread_factory.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+class Logger;
+
+class SocketHTTPClient : public HTTPClient {
+ public:
+  struct Options {
+    // Whether to do socket I/O through an io_uring, where available.
+    bool io_uring = false;
+    // Starts the worker thread, if not null.
+    ThreadFactory thread_factory;
+  };
+
+ private:
+  struct Connection;
+  struct Request;
+  struct Ring;
+  // The outcome of a round of I/O on a connection.
+  enum class Round { PROGRESS, WOKEN, TIMED_OUT };
+
+  const std::shared_ptr<Logger> logger_;
+  const Clock clock_;
+  // `wakeup_` is a pipe used to interrupt the worker thread while it waits on
+  // a socket.  `wakeup_[0]` is the read end, and `wakeup_[1]` is the write
+  // end.
+  int wakeup_[2];
+  std::mutex mutex_;
+  std::condition_variable has_requests_;
+  std::condition_variable no_requests_;
+  std::vector<std::unique_ptr<Request>> queue_;
+  // The number of requests that have been posted but not yet finished.
+  std::size_t num_pending_requests_;
+  bool shutting_down_;
+  bool running_;
+  // `ring_` is null unless I/O is done through an io_uring.
+  std::unique_ptr<Ring> ring_;
+  std::thread worker_;
+
+  void run();
+  // Send the specified `requests` and deliver their responses, reusing the
+  // specified `connection` where possible.
+  void send(Connection &connection,
+            std::vector<std::unique_ptr<Request>> &requests);
+  // Send the specified `count` requests starting at the specified `first`
+  // over `connection`, which must be connected to their endpoint.  Return the
+  // number of requests that were finished, i.e. for which a callback was
+  // invoked.  The remaining requests were not written to the connection, and
+  // may be sent over another connection.
+  std::size_t pipeline(Connection &connection, std::unique_ptr<Request> *first,
+                       std::size_t count);
+  // Wait until `connection` can make progress, the specified `deadline`
+  // passes, or the worker thread is woken.  Then send as much as possible of
+  // the requests from the one at the specified `num_sent` up to the specified
+  // `count`, unless `may_send` is false, and append what is received to
+  // `connection.received`.  Update `num_sent`, and set `eof` if the server
+  // closed the connection.  `poll_round` uses `poll`, and `ring_round` uses
+  // `ring_`.
+  Expected<Round> poll_round(Connection &connection,
+                             std::unique_ptr<Request> *requests,
+                             std::size_t count, std::size_t &num_sent,
+                             bool may_send,
+                             std::chrono::steady_clock::time_point deadline,
+                             bool &eof);
+  Expected<Round> ring_round(Connection &connection,
+                             std::unique_ptr<Request> *requests,
+                             std::size_t count, std::size_t &num_sent,
+                             bool may_send,
+                             std::chrono::steady_clock::time_point deadline,
+                             bool &eof);
+  // Cancel the operations that `ring_` has pending on `connection`, and wait
+  // for them to finish.
+  void settle(Connection &connection);
+  Expected<void> connect(Connection &connection, const URL &url,
+                         std::chrono::steady_clock::time_point deadline);
+  // Return whether the worker thread has been asked to stop.
+  bool stopping();
+
+ public:
+  SocketHTTPClient(const std::shared_ptr<Logger> &, const Clock &);
+  SocketHTTPClient(const std::shared_ptr<Logger> &, const Clock &,
+                   const Options &);
+  ~SocketHTTPClient();
+
+  SocketHTTPClient(const SocketHTTPClient &) = delete;
+
+  Expected<void> post(const URL &url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  Expected<void> post(const URL &url, HeadersSetter set_headers,
+                      SharedBody body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override;
+
+  std::string config() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
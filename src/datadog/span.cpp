@@ -1,31 +1,125 @@
 #include <datadog/dict_writer.h>
+#include <datadog/id_generator.h>
 #include <datadog/optional.h>
 #include <datadog/span.h>
 #include <datadog/span_config.h>
+#include <datadog/span_template.h>
 #include <datadog/string_view.h>
+#include <datadog/trace_context.h>
 #include <datadog/trace_segment.h>
 
 #include <cassert>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
+#include "probes.h"
 #include "span_data.h"
 #include "tags.h"
 
 namespace datadog {
 namespace tracing {
+namespace {
 
-Span::Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment,
-           const std::function<std::uint64_t()>& generate_span_id,
-           const Clock& clock)
+// Return the `SpanConfig` of the specified `config`.
+const SpanConfig& span_config(const SpanConfig& config) { return config; }
+const SpanConfig& span_config(const SpanTemplate& config) {
+  return config.config();
+}
+
+// Error stacks are interned: each distinct stack is stored once, for the life
+// of the process, and spans refer to it as a static tag rather than copying
+// it.  During an error storm, many spans carry the same multi-kilobyte stack.
+// Interning stops once `max_interned_stacks` stacks, or
+// `max_interned_stack_bytes` bytes of them, are stored, after which new stacks
+// are copied into each span.
+constexpr std::size_t max_interned_stacks = 1024;
+constexpr std::size_t max_interned_stack_bytes = 4 * 1024 * 1024;
+
+struct StringViewHash {
+  std::size_t operator()(StringView text) const {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (const char c : text) {
+      hash ^= std::uint64_t((unsigned char)c);
+      hash *= 1099511628211ULL;
+    }
+    return std::size_t(hash);
+  }
+};
+
+class ErrorStacks {
+  std::shared_mutex mutex_;
+  // A `std::deque` does not move its elements when it grows, so the views in
+  // `index_` remain valid.
+  std::deque<std::string> stacks_;
+  std::unordered_set<StringView, StringViewHash> index_;
+  std::size_t bytes_ = 0;
+
+ public:
+  // Return the interned copy of the specified `stack`, interning it if
+  // there is room, or return null if there is not.
+  Optional<StringView> intern(StringView stack) {
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      const auto found = index_.find(stack);
+      if (found != index_.end()) {
+        return *found;
+      }
+      if (stacks_.size() == max_interned_stacks ||
+          bytes_ + stack.size() > max_interned_stack_bytes) {
+        return nullopt;
+      }
+    }
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    const auto found = index_.find(stack);
+    if (found != index_.end()) {
+      return *found;
+    }
+    if (stacks_.size() == max_interned_stacks ||
+        bytes_ + stack.size() > max_interned_stack_bytes) {
+      return nullopt;
+    }
+    const StringView interned = stacks_.emplace_back(stack);
+    index_.insert(interned);
+    bytes_ += stack.size();
+    return interned;
+  }
+};
+
+ErrorStacks& error_stacks() {
+  // Never destroyed, since spans might refer to its stacks at exit.
+  static ErrorStacks* const stacks = new ErrorStacks;
+  return *stacks;
+}
+
+}  // namespace
+
+Span::Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment)
     : trace_segment_(trace_segment),
       data_(data),
-      generate_span_id_(generate_span_id),
-      clock_(clock),
-      expecting_delegated_sampling_decision_(false) {
+      expecting_delegated_sampling_decision_(false),
+      recorded_(trace_segment->records_spans()),
+      owns_data_(false) {
+  assert(trace_segment_);
+  assert(data_);
+  DD_TRACE_PROBE(span__create, data_->trace_id.low, data_->span_id);
+}
+
+Span::Span(std::unique_ptr<SpanData> data,
+           const std::shared_ptr<TraceSegment>& trace_segment)
+    : trace_segment_(trace_segment),
+      data_(data.release()),
+      expecting_delegated_sampling_decision_(false),
+      recorded_(false),
+      owns_data_(true) {
   assert(trace_segment_);
   assert(data_);
-  assert(generate_span_id_);
-  assert(clock_);
+  DD_TRACE_PROBE(span__create, data_->trace_id.low, data_->span_id);
 }
 
 Span::~Span() {
@@ -33,31 +127,169 @@ Span::~Span() {
     // We were moved from.
     return;
   }
+  if (!recorded_) {
+    if (owns_data_) {
+      delete data_;
+    }
+    return;
+  }
 
   if (end_time_) {
     data_->duration = *end_time_ - data_->start.tick;
   } else {
-    const auto now = clock_();
-    data_->duration = now - data_->start;
+    data_->duration = trace_segment_->now_tick() - data_->start.tick;
   }
 
-  trace_segment_->span_finished();
+  trace_segment_->span_finished(*data_);
 }
 
-Span Span::create_child(const SpanConfig& config) const {
+void Span::finish_all(std::vector<Span>& spans) {
+  std::vector<SpanData*> finished;
+  std::size_t begin = 0;
+  while (begin < spans.size()) {
+    TraceSegment* const segment = spans[begin].trace_segment_.get();
+    std::size_t end = begin + 1;
+    while (end < spans.size() && spans[end].trace_segment_.get() == segment) {
+      ++end;
+    }
+    if (!segment) {
+      // Moved-from spans.
+      begin = end;
+      continue;
+    }
+
+    finished.clear();
+    Optional<std::chrono::steady_clock::time_point> now;
+    for (std::size_t i = begin; i < end; ++i) {
+      Span& span = spans[i];
+      if (!span.recorded_) {
+        if (span.owns_data_) {
+          delete span.data_;
+        }
+        continue;
+      }
+      if (span.end_time_) {
+        span.data_->duration = *span.end_time_ - span.data_->start.tick;
+      } else {
+        if (!now) {
+          now = segment->now_tick();
+        }
+        span.data_->duration = *now - span.data_->start.tick;
+      }
+      finished.push_back(span.data_);
+    }
+    segment->spans_finished(finished.data(), finished.size());
+
+    // The spans are finished, so their destructors must do nothing more.
+    for (std::size_t i = begin; i < end; ++i) {
+      spans[i].trace_segment_.reset();
+    }
+    begin = end;
+  }
+  spans.clear();
+}
+
+template <typename Config>
+Span Span::create_child_from(Config&& config) const {
+  if (!recorded_ || !trace_segment_->records_new_spans() ||
+      trace_segment_->reserve_spans(1) == 0) {
+    return create_unrecorded_child(span_config(config),
+                                   trace_segment_->id_generator().span_id());
+  }
+
   auto span_data = std::make_unique<SpanData>();
-  span_data->apply_config(trace_segment_->defaults(), config, clock_);
+  span_data->apply_config(
+      trace_segment_->shared_defaults(), std::forward<Config>(config),
+      [this]() { return trace_segment_->now(); },
+      [this](StringView name) {
+        return trace_segment_->tag_value_limit(name);
+      });
   span_data->trace_id = data_->trace_id;
   span_data->parent_id = data_->span_id;
-  span_data->span_id = generate_span_id_();
+  span_data->span_id = trace_segment_->id_generator().span_id();
 
   const auto span_data_ptr = span_data.get();
   trace_segment_->register_span(std::move(span_data));
-  return Span(span_data_ptr, trace_segment_, generate_span_id_, clock_);
+  return Span(span_data_ptr, trace_segment_);
+}
+
+Span Span::create_child(const SpanConfig& config) const {
+  return create_child_from(config);
+}
+
+Span Span::create_child(SpanConfig&& config) const {
+  return create_child_from(std::move(config));
+}
+
+Span Span::create_child(const SpanTemplate& span_template) const {
+  return create_child_from(span_template);
 }
 
 Span Span::create_child() const { return create_child(SpanConfig{}); }
 
+std::vector<Span> Span::create_children(std::size_t count,
+                                        const SpanConfig& config) const {
+  std::vector<std::uint64_t> ids(count);
+  trace_segment_->id_generator().span_ids(ids.data(), count);
+
+  // The first `recorded` children are recorded, and the rest, if any, are
+  // not.
+  const std::size_t recorded =
+      recorded_ && trace_segment_->records_new_spans()
+          ? trace_segment_->reserve_spans(count)
+          : 0;
+
+  std::vector<std::unique_ptr<SpanData>> span_datas;
+  span_datas.reserve(recorded);
+  for (std::size_t i = 0; i < recorded; ++i) {
+    const std::uint64_t id = ids[i];
+    auto span_data = std::make_unique<SpanData>();
+    span_data->apply_config(
+        trace_segment_->shared_defaults(), config,
+        [this]() { return trace_segment_->now(); },
+        [this](StringView name) {
+          return trace_segment_->tag_value_limit(name);
+        });
+    span_data->trace_id = data_->trace_id;
+    span_data->parent_id = data_->span_id;
+    span_data->span_id = id;
+    span_datas.push_back(std::move(span_data));
+  }
+
+  // Reserve space for the children before registering their data, so that
+  // nothing can fail between registering a span and creating it.
+  std::vector<Span> children;
+  children.reserve(count);
+  std::vector<SpanData*> span_data_ptrs;
+  span_data_ptrs.reserve(count);
+  for (const auto& span_data : span_datas) {
+    span_data_ptrs.push_back(span_data.get());
+  }
+  trace_segment_->register_spans(std::move(span_datas));
+  for (SpanData* const span_data : span_data_ptrs) {
+    children.emplace_back(span_data, trace_segment_);
+  }
+  for (std::size_t i = recorded; i < count; ++i) {
+    children.push_back(create_unrecorded_child(config, ids[i]));
+  }
+  return children;
+}
+
+Span Span::create_unrecorded_child(const SpanConfig& config,
+                                   std::uint64_t id) const {
+  // Only what is needed to identify the span and to time it.
+  auto span_data = std::make_unique<SpanData>();
+  span_data->start = config.start ? *config.start : trace_segment_->now();
+  span_data->trace_id = data_->trace_id;
+  span_data->parent_id = data_->span_id;
+  span_data->span_id = id;
+  return Span(std::move(span_data), trace_segment_);
+}
+
+std::vector<Span> Span::create_children(std::size_t count) const {
+  return create_children(count, SpanConfig{});
+}
+
 void Span::inject(DictWriter& writer) const {
   expecting_delegated_sampling_decision_ =
       trace_segment_->inject(writer, *data_);
@@ -68,6 +300,10 @@ void Span::inject(DictWriter& writer, const InjectionOptions& options) const {
       trace_segment_->inject(writer, *data_, options);
 }
 
+TraceContext Span::export_trace_context() const {
+  return trace_segment_->export_context(*data_);
+}
+
 Expected<void> Span::read_sampling_delegation_response(
     const DictReader& reader) {
   if (!expecting_delegated_sampling_decision_) return {};
@@ -76,10 +312,17 @@ Expected<void> Span::read_sampling_delegation_response(
   return trace_segment_->read_sampling_delegation_response(reader);
 }
 
+bool Span::recorded() const { return recorded_; }
+
 std::uint64_t Span::id() const { return data_->span_id; }
 
 TraceID Span::trace_id() const { return data_->trace_id; }
 
+SpanContext Span::context() const {
+  return SpanContext(trace_segment_, data_->trace_id, data_->span_id,
+                     recorded_);
+}
+
 Optional<std::uint64_t> Span::parent_id() const {
   if (data_->parent_id == 0) {
     return nullopt;
@@ -100,15 +343,11 @@ const std::string& Span::name() const { return data_->name; }
 const std::string& Span::resource_name() const { return data_->resource; }
 
 Optional<StringView> Span::lookup_tag(StringView name) const {
-  const auto found = data_->tags.find(std::string(name));
-  if (found == data_->tags.end()) {
-    return nullopt;
-  }
-  return found->second;
+  return data_->lookup_tag(name);
 }
 
 Optional<double> Span::lookup_metric(StringView name) const {
-  const auto found = data_->numeric_tags.find(std::string(name));
+  const auto found = data_->numeric_tags.find(name);
   if (found == data_->numeric_tags.end()) {
     return nullopt;
   }
@@ -116,55 +355,153 @@ Optional<double> Span::lookup_metric(StringView name) const {
 }
 
 void Span::set_tag(StringView name, StringView value) {
-  data_->tags.insert_or_assign(std::string(name), std::string(value));
+  if (!recorded_) {
+    return;
+  }
+  // Reuse the existing value's storage if the tag is already present.
+  tags::assign_tag_value(data_->tags[name], value,
+                         trace_segment_->tag_value_limit(name));
+}
+
+void Span::set_tag(StaticString name, StaticString value) {
+  if (!recorded_) {
+    return;
+  }
+  const std::size_t limit = trace_segment_->tag_value_limit(name);
+  if (limit != 0 && value.view().size() > limit) {
+    set_tag(name.view(), value.view());
+    return;
+  }
+  // An own tag of the same name would take precedence.
+  data_->tags.erase(name.view());
+  data_->static_tags.insert_or_assign(name.view(), value.view());
 }
 
 void Span::set_metric(StringView name, double value) {
-  data_->numeric_tags.insert_or_assign(std::string(name), value);
+  if (!recorded_) {
+    return;
+  }
+  data_->numeric_tags[name] = value;
 }
 
-void Span::remove_tag(StringView name) { data_->tags.erase(std::string(name)); }
+void Span::set_tags(
+    std::initializer_list<std::pair<StringView, StringView>> tags) {
+  if (!recorded_) {
+    return;
+  }
+  data_->tags.reserve(data_->tags.size() + tags.size());
+  for (const auto& [name, value] : tags) {
+    tags::assign_tag_value(data_->tags[name], value,
+                           trace_segment_->tag_value_limit(name));
+  }
+}
+
+void Span::set_metrics(
+    std::initializer_list<std::pair<StringView, double>> metrics) {
+  if (!recorded_) {
+    return;
+  }
+  data_->numeric_tags.reserve(data_->numeric_tags.size() + metrics.size());
+  for (const auto& [name, value] : metrics) {
+    data_->numeric_tags[name] = value;
+  }
+}
+
+void Span::remove_tag(StringView name) {
+  if (!recorded_) {
+    return;
+  }
+  data_->remove_tag(name);
+}
 
 void Span::remove_metric(StringView name) {
-  data_->numeric_tags.erase(std::string(name));
+  if (!recorded_) {
+    return;
+  }
+  data_->numeric_tags.erase(name);
 }
 
 void Span::set_service_name(StringView service) {
+  if (!recorded_) {
+    return;
+  }
   assign(data_->service, service);
 }
 
 void Span::set_service_type(StringView type) {
+  if (!recorded_) {
+    return;
+  }
   assign(data_->service_type, type);
 }
 
 void Span::set_resource_name(StringView resource) {
-  assign(data_->resource, resource);
+  if (!recorded_) {
+    return;
+  }
+  tags::assign_tag_value(data_->resource, resource,
+                         trace_segment_->tag_value_limit(tags::resource_name));
 }
 
 void Span::set_error(bool is_error) {
+  if (!recorded_) {
+    return;
+  }
   data_->error = is_error;
   if (!is_error) {
-    data_->tags.erase("error.message");
-    data_->tags.erase("error.type");
+    data_->remove_tag("error.message");
+    data_->remove_tag("error.type");
   }
 }
 
 void Span::set_error_message(StringView message) {
+  if (!recorded_) {
+    return;
+  }
   data_->error = true;
-  data_->tags.insert_or_assign("error.message", std::string(message));
+  tags::assign_tag_value(data_->tags["error.message"], message,
+                         trace_segment_->tag_value_limit("error.message"));
 }
 
 void Span::set_error_type(StringView type) {
+  if (!recorded_) {
+    return;
+  }
   data_->error = true;
-  data_->tags.insert_or_assign("error.type", std::string(type));
+  tags::assign_tag_value(data_->tags["error.type"], type,
+                         trace_segment_->tag_value_limit("error.type"));
 }
 
-void Span::set_error_stack(StringView type) {
+void Span::set_error_stack(StringView stack) {
+  if (!recorded_) {
+    return;
+  }
   data_->error = true;
-  data_->tags.insert_or_assign("error.stack", std::string(type));
+  // A long stack is truncated before it is interned, so that the interned
+  // copy is bounded too.
+  const std::size_t limit = trace_segment_->tag_value_limit("error.stack");
+  std::string truncated;
+  if (limit != 0 && stack.size() > limit) {
+    tags::assign_tag_value(truncated, stack, limit);
+    stack = truncated;
+  }
+  if (const auto interned = error_stacks().intern(stack)) {
+    // The span's own tags would take precedence over the static tag.
+    data_->tags.erase("error.stack");
+    data_->static_tags.insert_or_assign("error.stack", *interned);
+  } else {
+    data_->static_tags.erase("error.stack");
+    data_->tags.insert_or_assign("error.stack", std::string(stack));
+  }
 }
 
-void Span::set_name(StringView value) { assign(data_->name, value); }
+void Span::set_name(StringView value) {
+  if (!recorded_) {
+    return;
+  }
+  tags::assign_tag_value(data_->name, value,
+                         trace_segment_->tag_value_limit(tags::operation_name));
+}
 
 void Span::set_end_time(std::chrono::steady_clock::time_point end_time) {
   end_time_ = end_time;
@@ -0,0 +1,72 @@
+#include <datadog/id_generator.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/span_context.h>
+#include <datadog/trace_segment.h>
+
+#include <memory>
+#include <utility>
+
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+SpanContext::SpanContext(const std::shared_ptr<TraceSegment>& trace_segment,
+                         TraceID trace_id, std::uint64_t span_id,
+                         bool recorded)
+    : trace_segment_(trace_segment),
+      trace_id_(trace_id),
+      span_id_(span_id),
+      recorded_(recorded) {}
+
+TraceID SpanContext::trace_id() const { return trace_id_; }
+
+std::uint64_t SpanContext::span_id() const { return span_id_; }
+
+Optional<Span> SpanContext::create_child() const {
+  return create_child(SpanConfig{});
+}
+
+template <typename Config>
+Optional<Span> SpanContext::create_child_from(Config&& config) const {
+  const auto trace_segment = trace_segment_.lock();
+  if (!trace_segment) {
+    return nullopt;
+  }
+
+  auto span_data = std::make_unique<SpanData>();
+  span_data->trace_id = trace_id_;
+  span_data->parent_id = span_id_;
+  span_data->span_id = trace_segment->id_generator().span_id();
+  if (recorded_ && trace_segment->records_new_spans() &&
+      trace_segment->reserve_spans(1) != 0) {
+    span_data->apply_config(
+        trace_segment->shared_defaults(), std::forward<Config>(config),
+        [&]() { return trace_segment->now(); },
+        [&](StringView name) { return trace_segment->tag_value_limit(name); });
+    SpanData* const span_data_ptr = span_data.get();
+    if (trace_segment->register_span_if_unfinished(span_data)) {
+      return Span(span_data_ptr, trace_segment);
+    }
+    // The segment finished in the meantime.  `config` might have been moved
+    // from, but the start time is already set.
+    return Span(std::move(span_data), trace_segment);
+  }
+
+  // Only what is needed to identify the span and to time it, as for an
+  // unrecorded child of a `Span`.
+  span_data->start = config.start ? *config.start : trace_segment->now();
+  return Span(std::move(span_data), trace_segment);
+}
+
+Optional<Span> SpanContext::create_child(const SpanConfig& config) const {
+  return create_child_from(config);
+}
+
+Optional<Span> SpanContext::create_child(SpanConfig&& config) const {
+  return create_child_from(std::move(config));
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -3,132 +3,762 @@
 #include <datadog/error.h>
 #include <datadog/span_config.h>
 #include <datadog/span_defaults.h>
+#include <datadog/span_template.h>
 #include <datadog/string_view.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <type_traits>
+#include <utility>
 
+#include "block_cache.h"
 #include "msgpack.h"
+#include "parse_util.h"
 #include "tags.h"
+#include "worker_pool.h"
 
 namespace datadog {
 namespace tracing {
 namespace {
 
-Optional<StringView> lookup(
-    const std::string& key,
-    const std::unordered_map<std::string, std::string>& map) {
-  const auto found = map.find(key);
-  if (found != map.end()) {
-    return found->second;
+// The keys of the MessagePack map that represents a span, encoded at compile
+// time.
+namespace keys {
+constexpr auto service = msgpack::fixstr("service");
+constexpr auto name = msgpack::fixstr("name");
+constexpr auto resource = msgpack::fixstr("resource");
+constexpr auto trace_id = msgpack::fixstr("trace_id");
+constexpr auto span_id = msgpack::fixstr("span_id");
+constexpr auto parent_id = msgpack::fixstr("parent_id");
+constexpr auto start = msgpack::fixstr("start");
+constexpr auto duration = msgpack::fixstr("duration");
+constexpr auto error = msgpack::fixstr("error");
+constexpr auto meta = msgpack::fixstr("meta");
+constexpr auto metrics = msgpack::fixstr("metrics");
+constexpr auto type = msgpack::fixstr("type");
+}  // namespace keys
+
+// The keys of the MessagePack map that represents a trace chunk in the v0.7
+// trace format.
+namespace chunk_keys {
+constexpr auto priority = msgpack::fixstr("priority");
+constexpr auto origin = msgpack::fixstr("origin");
+constexpr auto spans = msgpack::fixstr("spans");
+}  // namespace chunk_keys
+
+// The following constants describe the largest sizes of the MessagePack
+// encodings produced by `namespace msgpack`. Other than the `keys` above,
+// strings, arrays, and maps are encoded with at most a 32-bit length prefix,
+// and integers with at most 64 bits.
+constexpr std::size_t type_byte_size = 1;
+constexpr std::size_t length_prefixed_size = type_byte_size + 4;
+constexpr std::size_t number_size = type_byte_size + 8;
+
+constexpr std::size_t string_size(std::size_t length) {
+  return length_prefixed_size + length;
+}
+
+// The encoded size of the span map's keys, and of those of its values whose
+// sizes do not depend on the span.
+constexpr std::size_t fixed_span_size =
+    length_prefixed_size + keys::service.encoded().size() +
+    keys::name.encoded().size() + keys::resource.encoded().size() +
+    keys::trace_id.encoded().size() + number_size +
+    keys::span_id.encoded().size() + number_size +
+    keys::parent_id.encoded().size() + number_size +
+    keys::start.encoded().size() + number_size +
+    keys::duration.encoded().size() + number_size +
+    keys::error.encoded().size() + number_size + keys::meta.encoded().size() +
+    length_prefixed_size + keys::metrics.encoded().size() +
+    length_prefixed_size + keys::type.encoded().size();
+
+// The string tags in `ChunkTags`, paired with their names.
+using ChunkMeta =
+    std::array<std::pair<const std::string*, const Optional<StringView>*>, 3>;
+
+ChunkMeta chunk_meta(const ChunkTags& chunk_tags) {
+  return {{{&tags::internal::origin, &chunk_tags.origin},
+           {&tags::internal::language, &chunk_tags.language},
+           {&tags::internal::runtime_id, &chunk_tags.runtime_id}}};
+}
+
+// The string tags in `PayloadTags`, paired with their names.
+using PayloadMeta = std::array<std::pair<const std::string*, StringView>, 2>;
+
+PayloadMeta payload_meta(const PayloadTags& payload_tags) {
+  return {{{&tags::environment, payload_tags.env},
+           {&tags::version, payload_tags.version}}};
+}
+
+// Return whether the specified string tag, `key` and `value`, is carried
+// instead by the specified `payload_tags`, if any.
+bool is_payload_tag(StringView key, StringView value,
+                    const PayloadTags* payload_tags) {
+  if (!payload_tags) {
+    return false;
   }
-  return nullopt;
+  for (const auto& [name, hoisted] : payload_meta(*payload_tags)) {
+    if (!hoisted.empty() && key == *name && value == hoisted) {
+      return true;
+    }
+  }
+  return false;
 }
 
-}  // namespace
+// `InheritedMeta` is the MessagePack encoding, as "meta" map entries, of the
+// string tags that spans inherit from a `SpanDefaults`.  The defaults change
+// only when the tracer is configured, so the entries are encoded once per
+// `SpanDefaults`, rather than for every span, and copied into each span that
+// does not override any of them.
+struct InheritedMeta {
+  // Holding the defaults keeps `keys` valid, and keeps any other
+  // `SpanDefaults` from taking their address.
+  std::shared_ptr<const SpanDefaults> defaults;
+  std::vector<StringView> keys;
+  std::string encoded;
+  // Whether any of `keys` is also the name of a tag in `ChunkTags`.
+  bool has_chunk_meta_key = false;
+};
 
-Optional<StringView> SpanData::environment() const {
-  return lookup(tags::environment, tags);
+// Return the `InheritedMeta` of the tags inherited by the specified `span`,
+// which must have `defaults`.  The encoding is cached per thread for each
+// combination of inheriting the environment and the version.
+const InheritedMeta& inherited_meta(const SpanData& span) {
+  thread_local std::array<InheritedMeta, 4> cache;
+  InheritedMeta& entry =
+      cache[2 * span.inherit_environment + span.inherit_version];
+  if (entry.defaults == span.defaults) {
+    return entry;
+  }
+
+  SpanData heir;
+  heir.defaults = span.defaults;
+  heir.inherit_environment = span.inherit_environment;
+  heir.inherit_version = span.inherit_version;
+  entry.defaults = span.defaults;
+  entry.keys.clear();
+  entry.encoded.clear();
+  entry.has_chunk_meta_key = false;
+  heir.for_each_tag([&](StringView key, StringView value) {
+    entry.keys.push_back(key);
+    msgpack::pack_string(entry.encoded, key);
+    msgpack::pack_string(entry.encoded, value);
+    if (key == tags::internal::origin || key == tags::internal::language ||
+        key == tags::internal::runtime_id) {
+      entry.has_chunk_meta_key = true;
+    }
+  });
+  return entry;
 }
 
-Optional<StringView> SpanData::version() const {
-  return lookup(tags::version, tags);
+// Return the `InheritedMeta` of the specified `span` if it can be copied
+// into the span's encoding with the specified `chunk_tags`, or return null
+// otherwise.  It cannot be if the span overrides any of the inherited tags.
+const InheritedMeta* copyable_inherited_meta(const SpanData& span,
+                                             const ChunkTags& chunk_tags) {
+  if (!span.defaults) {
+    return nullptr;
+  }
+  const InheritedMeta& inherited = inherited_meta(span);
+  if (inherited.has_chunk_meta_key &&
+      (chunk_tags.origin || chunk_tags.language || chunk_tags.runtime_id)) {
+    return nullptr;
+  }
+  if (span.tags.empty() && span.static_tags.empty()) {
+    return &inherited;
+  }
+  for (const StringView key : inherited.keys) {
+    if (span.tags.count(key) || span.static_tags.count(key)) {
+      return nullptr;
+    }
+  }
+  return &inherited;
 }
 
-void SpanData::apply_config(const SpanDefaults& defaults,
-                            const SpanConfig& config, const Clock& clock) {
-  std::string version;
-  if (config.service) {
-    service = *config.service;
-    version = config.version.value_or("");
+// Return the number of entries in the "meta" map of the specified `span` when
+// encoded with the specified `chunk_tags`, and without the tags carried by the
+// optionally specified `payload_tags`.  If the optionally specified
+// `inherited` is not null, then it is the span's inherited tags.
+std::size_t meta_size(const SpanData& span, const ChunkTags& chunk_tags,
+                      const PayloadTags* payload_tags = nullptr,
+                      const InheritedMeta* inherited = nullptr) {
+  std::size_t size = 0;
+  if (inherited) {
+    span.for_each_own_tag([&](StringView, StringView) { ++size; });
+    size += inherited->keys.size();
   } else {
-    service = defaults.service;
-    version = defaults.version;
+    size = span.tag_count();
+  }
+  for (const auto& [key, value] : chunk_meta(chunk_tags)) {
+    if (*value && !span.lookup_tag(*key)) {
+      ++size;
+    }
   }
+  if (payload_tags) {
+    for (const auto& [key, value] : payload_meta(*payload_tags)) {
+      const auto found = span.lookup_tag(*key);
+      if (found && is_payload_tag(*key, *found, payload_tags)) {
+        --size;
+      }
+    }
+  }
+  return size;
+}
 
-  if (!version.empty()) {
-    tags.insert_or_assign(tags::version, version);
+// Return the number of entries in the "metrics" map of the specified `span`
+// when encoded with the specified `chunk_tags`.
+std::size_t metrics_size(const SpanData& span, const ChunkTags& chunk_tags) {
+  std::size_t size = span.numeric_tags.size();
+  if (chunk_tags.process_id &&
+      span.numeric_tags.count(tags::internal::process_id) == 0) {
+    ++size;
+  }
+  if (span.sampling_priority &&
+      span.numeric_tags.count(tags::internal::sampling_priority) == 0) {
+    ++size;
   }
+  return size;
+}
 
-  name = config.name.value_or(defaults.name);
+// Invoke the specified `visit` with the name and value of each string tag of
+// the specified `span`, skipping the tags named by the specified `chunk_tags`
+// and the tags carried by the optionally specified `payload_tags`.  If the
+// optionally specified `own_only` is true, then skip the span's inherited
+// tags.  Return the first error that `visit` returns, if any.
+template <typename Visit>
+Expected<void> for_each_span_meta(const SpanData& span,
+                                  const ChunkTags& chunk_tags, Visit&& visit,
+                                  const PayloadTags* payload_tags = nullptr,
+                                  bool own_only = false) {
+  const ChunkMeta chunk = chunk_meta(chunk_tags);
+  const bool any_chunk_meta =
+      chunk_tags.origin || chunk_tags.language || chunk_tags.runtime_id;
+  Expected<void> result;
+  const auto visit_tag = [&](StringView key, StringView value) {
+    if (!result ||
+        (any_chunk_meta &&
+         std::any_of(chunk.begin(), chunk.end(),
+                     [&](const auto& entry) {
+                       return *entry.second && key == *entry.first;
+                     })) ||
+        is_payload_tag(key, value, payload_tags)) {
+      return;
+    }
+    result = visit(key, value);
+  };
+  if (own_only) {
+    span.for_each_own_tag(visit_tag);
+  } else {
+    span.for_each_tag(visit_tag);
+  }
+  return result;
+}
 
-  for (const auto& item : defaults.tags) {
-    tags.insert(item);
+// Invoke the specified `visit` with the name and value of each string tag of
+// the specified `span`, with the specified `chunk_tags` taking precedence over
+// the span's own tags, and skipping the tags carried by the optionally
+// specified `payload_tags`.  If the optionally specified `own_only` is true,
+// then skip the span's inherited tags.  Return the first error that `visit`
+// returns, if any.
+template <typename Visit>
+Expected<void> for_each_meta(const SpanData& span, const ChunkTags& chunk_tags,
+                             Visit&& visit,
+                             const PayloadTags* payload_tags = nullptr,
+                             bool own_only = false) {
+  if (auto result =
+          for_each_span_meta(span, chunk_tags, visit, payload_tags, own_only);
+      result.if_error()) {
+    return result;
   }
-  std::string environment = config.environment.value_or(defaults.environment);
-  if (!environment.empty()) {
-    tags.insert_or_assign(tags::environment, environment);
+  for (const auto& [key, value] : chunk_meta(chunk_tags)) {
+    if (!*value) {
+      continue;
+    }
+    if (auto result = visit(*key, **value); result.if_error()) {
+      return result;
+    }
   }
+  return {};
+}
 
-  for (const auto& [key, value] : config.tags) {
-    tags.insert_or_assign(key, value);
+// Invoke the specified `visit` with the name and value of each numeric tag of
+// the specified `span`, including its `sampling_priority`, and skipping the
+// tags named by the specified `chunk_tags`.  Return the first error that
+// `visit` returns, if any.
+template <typename Visit>
+Expected<void> for_each_span_metric(const SpanData& span,
+                                    const ChunkTags& chunk_tags,
+                                    Visit&& visit) {
+  for (const auto& [key, value] : span.numeric_tags) {
+    if ((chunk_tags.process_id && key == tags::internal::process_id) ||
+        (span.sampling_priority && key == tags::internal::sampling_priority)) {
+      continue;
+    }
+    if (auto result = visit(key, value); result.if_error()) {
+      return result;
+    }
+  }
+  if (span.sampling_priority) {
+    return visit(tags::internal::sampling_priority, *span.sampling_priority);
   }
+  return {};
+}
+
+// Invoke the specified `visit` with the name and value of each numeric tag of
+// the specified `span`, with the specified `chunk_tags` taking precedence over
+// the span's own tags.  Return the first error that `visit` returns, if any.
+template <typename Visit>
+Expected<void> for_each_metric(const SpanData& span,
+                               const ChunkTags& chunk_tags, Visit&& visit) {
+  if (auto result = for_each_span_metric(span, chunk_tags, visit);
+      result.if_error()) {
+    return result;
+  }
+  if (chunk_tags.process_id) {
+    return visit(tags::internal::process_id, *chunk_tags.process_id);
+  }
+  return {};
+}
 
-  resource = config.resource.value_or(name);
-  service_type = config.service_type.value_or(defaults.service_type);
+// Return an upper bound on the number of bytes that the specified `chunk_tags`
+// add to an encoded span.
+std::size_t chunk_tags_size_bound(const ChunkTags& chunk_tags) {
+  std::size_t size = 0;
+  for (const auto& [key, value] : chunk_meta(chunk_tags)) {
+    if (*value) {
+      size += string_size(key->size()) + string_size((*value)->size());
+    }
+  }
+  if (chunk_tags.process_id) {
+    size += string_size(tags::internal::process_id.size()) + number_size;
+  }
+  return size;
+}
+
+// Enough to absorb the spans of a typical trace segment, without letting an
+// idle thread hold on to much memory.
+using SpanDataCache = BlockCache<sizeof(SpanData), 256>;
+
+// Return the specified `value`, a member of a `SpanConfig`, as an rvalue if
+// the `SpanConfig` is an rvalue, i.e. if `Config` is not a reference.
+template <typename Config, typename Value>
+decltype(auto) forward_member(Value& value) {
+  if constexpr (std::is_lvalue_reference_v<Config>) {
+    return static_cast<const Value&>(value);
+  } else {
+    return std::move(value);
+  }
+}
+
+// Assign the specified `value`, a member of a `SpanConfig`, to the specified
+// `destination`, truncated to the specified `limit` as by
+// `tags::assign_tag_value`.  `value` is moved rather than copied if it fits
+// and the `SpanConfig` is an rvalue.
+template <typename Config, typename Value>
+void assign_member(std::string& destination, Value& value, std::size_t limit) {
+  if (limit != 0 && value.size() > limit) {
+    tags::assign_tag_value(destination, value, limit);
+  } else {
+    destination = forward_member<Config>(value);
+  }
+}
+
+// Store the specified `value` as the tag having the specified `key` in the
+// specified `tags`, truncated to the specified `limit` as by
+// `tags::assign_tag_value`.  `key` and `value` are moved rather than copied
+// if `value` fits and they are members of an rvalue `SpanConfig`.
+template <typename Config, typename Key, typename Value>
+void store_tag(FlatMap<std::string>& tags, Key& key, Value& value,
+               std::size_t limit) {
+  if (limit != 0 && value.size() > limit) {
+    tags::assign_tag_value(tags[key], value, limit);
+  } else {
+    tags.insert_or_assign(forward_member<Config>(key),
+                          forward_member<Config>(value));
+  }
+}
+
+template <typename Config>
+void apply_config_to(SpanData& span,
+                     const std::shared_ptr<const SpanDefaults>& from,
+                     Config&& config, FunctionRef<TimePoint()> now,
+                     FunctionRef<std::size_t(StringView)> tag_value_limit) {
+  // Tags are inherited from `from` rather than copied.  Only values that
+  // `config` overrides are stored in this span's own `tags`.
+  span.defaults = from;
+  if (config.service) {
+    span.service = forward_member<Config>(*config.service);
+    span.inherit_version = false;
+    if (config.version && !config.version->empty()) {
+      store_tag<Config>(span.tags, tags::version, *config.version,
+                        tag_value_limit(tags::version));
+    }
+  } else {
+    span.service = from->service;
+    span.inherit_version = true;
+  }
+
+  if (config.name) {
+    assign_member<Config>(span.name, *config.name,
+                          tag_value_limit(tags::operation_name));
+  } else {
+    span.name = from->name;
+  }
+
+  span.inherit_environment = !config.environment;
+  if (config.environment && !config.environment->empty()) {
+    store_tag<Config>(span.tags, tags::environment, *config.environment,
+                      tag_value_limit(tags::environment));
+  }
+
+  if constexpr (std::is_lvalue_reference_v<Config>) {
+    for (const auto& [key, value] : config.tags) {
+      store_tag<Config>(span.tags, key, value, tag_value_limit(key));
+    }
+  } else {
+    // Take the keys as well as the values.
+    while (!config.tags.empty()) {
+      auto node = config.tags.extract(config.tags.begin());
+      store_tag<Config>(span.tags, node.key(), node.mapped(),
+                        tag_value_limit(node.key()));
+    }
+  }
+
+  const std::size_t resource_limit = tag_value_limit(tags::resource_name);
+  if (config.resource) {
+    assign_member<Config>(span.resource, *config.resource, resource_limit);
+  } else {
+    tags::assign_tag_value(span.resource, span.name, resource_limit);
+  }
+  span.service_type = config.service_type
+                          ? forward_member<Config>(*config.service_type)
+                          : from->service_type;
   if (config.start) {
-    start = *config.start;
+    span.start = *config.start;
+  } else {
+    span.start = now();
+  }
+}
+
+}  // namespace
+
+void* SpanData::operator new(std::size_t size) {
+  if (size == sizeof(SpanData)) {
+    return SpanDataCache::allocate();
+  }
+  return ::operator new(size);
+}
+
+void SpanData::operator delete(void* pointer, std::size_t size) noexcept {
+  if (size == sizeof(SpanData)) {
+    SpanDataCache::deallocate(pointer);
   } else {
-    start = clock();
+    ::operator delete(pointer);
+  }
+}
+
+Optional<StringView> SpanData::environment() const {
+  return lookup_tag(tags::environment);
+}
+
+Optional<StringView> SpanData::version() const {
+  return lookup_tag(tags::version);
+}
+
+const std::string* SpanData::inherited_environment() const {
+  if (inherit_environment && defaults && !defaults->environment.empty()) {
+    return &defaults->environment;
+  }
+  return nullptr;
+}
+
+const std::string* SpanData::inherited_version() const {
+  if (inherit_version && defaults && !defaults->version.empty()) {
+    return &defaults->version;
+  }
+  return nullptr;
+}
+
+Optional<StringView> SpanData::lookup_tag(StringView name) const {
+  const auto found = tags.find(name);
+  if (found != tags.end()) {
+    return found->second;
+  }
+  const auto found_static = static_tags.find(name);
+  if (found_static != static_tags.end()) {
+    return found_static->second;
+  }
+  if (!defaults) {
+    return nullopt;
+  }
+  // The inherited environment and version take precedence over entries of the
+  // same name in `defaults->tags`.
+  if (name == tags::environment) {
+    if (const std::string* environment = inherited_environment()) {
+      return *environment;
+    }
+  } else if (name == tags::version) {
+    if (const std::string* version = inherited_version()) {
+      return *version;
+    }
+  }
+  // Search linearly rather than call `find`, which would require that `name`
+  // be copied into a `std::string`.
+  for (const auto& [key, value] : defaults->tags) {
+    if (key == name) {
+      return value;
+    }
+  }
+  return nullopt;
+}
+
+void SpanData::remove_tag(StringView name) {
+  tags.erase(name);
+  static_tags.erase(name);
+  if (!defaults || !lookup_tag(name)) {
+    return;
+  }
+  // An inherited tag cannot be hidden without copying the other inherited
+  // tags.  This is expected to be rare.
+  FlatMap<std::string> own_and_inherited;
+  own_and_inherited.reserve(tag_count());
+  for_each_tag([&](StringView key, StringView value) {
+    own_and_inherited.emplace(key, value);
+  });
+  tags = std::move(own_and_inherited);
+  static_tags.clear();
+  defaults.reset();
+  tags.erase(name);
+}
+
+std::size_t SpanData::tag_count() const {
+  std::size_t count = 0;
+  for_each_tag([&](StringView, StringView) { ++count; });
+  return count;
+}
+
+void SpanData::apply_config(
+    const std::shared_ptr<const SpanDefaults>& from, const SpanConfig& config,
+    FunctionRef<TimePoint()> now,
+    FunctionRef<std::size_t(StringView)> tag_value_limit) {
+  apply_config_to(*this, from, config, now, tag_value_limit);
+}
+
+void SpanData::apply_config(
+    const std::shared_ptr<const SpanDefaults>& from, SpanConfig&& config,
+    FunctionRef<TimePoint()> now,
+    FunctionRef<std::size_t(StringView)> tag_value_limit) {
+  apply_config_to(*this, from, std::move(config), now, tag_value_limit);
+}
+
+void SpanData::apply_config(
+    const std::shared_ptr<const SpanDefaults>& from, const SpanTemplate& config,
+    FunctionRef<TimePoint()> now,
+    FunctionRef<std::size_t(StringView)> tag_value_limit) {
+  const auto prototype = config.prototype(from, tag_value_limit);
+  defaults = prototype->defaults;
+  inherit_environment = prototype->inherit_environment;
+  inherit_version = prototype->inherit_version;
+  service = prototype->service;
+  service_type = prototype->service_type;
+  name = prototype->name;
+  resource = prototype->resource;
+  tags = prototype->tags;
+  const auto& start_time = config.config().start;
+  start = start_time ? *start_time : now();
+}
+
+void apply_chunk_tags(SpanData& span, const ChunkTags& chunk_tags) {
+  for (const auto& [key, value] : chunk_meta(chunk_tags)) {
+    if (*value) {
+      span.tags.insert_or_assign(*key, **value);
+    }
+  }
+  if (chunk_tags.process_id) {
+    span.numeric_tags.insert_or_assign(tags::internal::process_id,
+                                       *chunk_tags.process_id);
+  }
+  if (span.sampling_priority) {
+    span.numeric_tags.insert_or_assign(tags::internal::sampling_priority,
+                                       *span.sampling_priority);
+  }
+}
+
+std::size_t msgpack_encoded_size_bound(const SpanData& span,
+                                       const ChunkTags& chunk_tags) {
+  std::size_t size = chunk_tags_size_bound(chunk_tags) + fixed_span_size +
+                     string_size(span.service.size()) +
+                     string_size(span.name.size()) +
+                     string_size(span.resource.size()) +
+                     string_size(span.service_type.size());
+  span.for_each_tag([&](StringView key, StringView value) {
+    size += string_size(key.size()) + string_size(value.size());
+  });
+  for (const auto& entry : span.numeric_tags) {
+    size += string_size(entry.first.size()) + number_size;
   }
+  if (span.sampling_priority) {
+    size +=
+        string_size(tags::internal::sampling_priority.size()) + number_size;
+  }
+  return size;
+}
+
+std::size_t msgpack_encoded_size_bound(
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags) {
+  std::size_t size = length_prefixed_size;
+  for (const auto& span_ptr : spans) {
+    assert(span_ptr);
+    size += msgpack_encoded_size_bound(*span_ptr, chunk_tags);
+  }
+  return size;
 }
 
-Expected<void> msgpack_encode(std::string& destination, const SpanData& span) {
+namespace {
+
+// The MessagePack representation of the map entries that a chunk's
+// `ChunkTags` add to each of its spans, so that spans in the same chunk can
+// copy them instead of encoding them again.
+struct EncodedChunkTags {
+  std::string meta;
+  std::string metrics;
+};
+
+// Store into the specified `encoded` the MessagePack representation of the
+// specified `chunk_tags`.  Return the first error that occurs, if any.
+Expected<void> encode_chunk_tags(EncodedChunkTags& encoded,
+                                 const ChunkTags& chunk_tags) {
+  encoded.meta.clear();
+  encoded.metrics.clear();
+  for (const auto& [key, value] : chunk_meta(chunk_tags)) {
+    if (!*value) {
+      continue;
+    }
+    auto result = msgpack::pack_string(encoded.meta, *key);
+    if (result) {
+      result = msgpack::pack_string(encoded.meta, **value);
+    }
+    if (!result) {
+      return result;
+    }
+  }
+  if (chunk_tags.process_id) {
+    auto result =
+        msgpack::pack_string(encoded.metrics, tags::internal::process_id);
+    if (!result) {
+      return result;
+    }
+    msgpack::pack_double(encoded.metrics, *chunk_tags.process_id);
+  }
+  return {};
+}
+
+// Append to the specified `destination` the MessagePack representation of the
+// specified `span`, including the specified `chunk_tags` and excluding the
+// tags carried by the optionally specified `payload_tags`.  If the optionally
+// specified `encoded_chunk_tags` is not null, then it is the representation of
+// `chunk_tags`, and is copied instead of encoding `chunk_tags` again.
+Expected<void> encode_span(
+    std::string& destination, const SpanData& span,
+    const ChunkTags& chunk_tags, const PayloadTags* payload_tags,
+    const EncodedChunkTags* encoded_chunk_tags = nullptr) {
   // clang-format off
   msgpack::pack_map(
       destination,
-      "service", [&](auto& destination) {
+      keys::service, [&](auto& destination) {
          return msgpack::pack_string(destination, span.service);
        },
-      "name", [&](auto& destination) {
+      keys::name, [&](auto& destination) {
          return msgpack::pack_string(destination, span.name);
        },
-      "resource", [&](auto& destination) {
+      keys::resource, [&](auto& destination) {
          return msgpack::pack_string(destination, span.resource);
        },
-      "trace_id", [&](auto& destination) {
+      keys::trace_id, [&](auto& destination) {
          msgpack::pack_integer(destination, span.trace_id.low);
          return Expected<void>{};
        },
-      "span_id", [&](auto& destination) {
+      keys::span_id, [&](auto& destination) {
          msgpack::pack_integer(destination, span.span_id);
          return Expected<void>{};
        },
-      "parent_id", [&](auto& destination) {
+      keys::parent_id, [&](auto& destination) {
          msgpack::pack_integer(destination, span.parent_id);
          return Expected<void>{};
        },
-      "start", [&](auto& destination) {
+      keys::start, [&](auto& destination) {
          msgpack::pack_integer(
              destination, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
                               span.start.wall.time_since_epoch())
                               .count()));
          return Expected<void>{};
        },
-      "duration", [&](auto& destination) {
+      keys::duration, [&](auto& destination) {
          msgpack::pack_integer(
              destination,
              std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(span.duration)
                  .count()));
         return Expected<void>{};
        },
-      "error", [&](auto& destination) {
+      keys::error, [&](auto& destination) {
          msgpack::pack_integer(destination, std::int32_t(span.error));
          return Expected<void>{};
        },
-      "meta", [&](auto& destination) {
-         return msgpack::pack_map(destination, span.tags,
-                           [](std::string& destination, const auto& value) {
-                             return msgpack::pack_string(destination, value);
-                           });
-       }, "metrics",
+      keys::meta, [&](auto& destination) {
+         // The v0.7 encoding omits some inherited tags, so it does not copy
+         // them.
+         const InheritedMeta* const inherited =
+             payload_tags ? nullptr : copyable_inherited_meta(span, chunk_tags);
+         auto result = msgpack::pack_map(
+             destination, meta_size(span, chunk_tags, payload_tags, inherited));
+         if (!result) {
+           return result;
+         }
+         const auto visit = [&](StringView key, StringView value) {
+           auto result = msgpack::pack_string(destination, key);
+           if (!result) {
+             return result;
+           }
+           return msgpack::pack_string(destination, value);
+         };
+         if (encoded_chunk_tags) {
+           result = for_each_span_meta(span, chunk_tags, visit, payload_tags, inherited != nullptr);
+           if (result) {
+             destination += encoded_chunk_tags->meta;
+           }
+         } else {
+           result = for_each_meta(span, chunk_tags, visit, payload_tags, inherited != nullptr);
+         }
+         if (result && inherited) {
+           destination += inherited->encoded;
+         }
+         return result;
+       }, keys::metrics,
        [&](auto& destination) {
-         return msgpack::pack_map(destination, span.numeric_tags,
-                           [](std::string& destination, const auto& value) {
-                             msgpack::pack_double(destination, value);
-                             return Expected<void>{};
-                           });
-       }, "type", [&](auto& destination) {
+         auto result = msgpack::pack_map(destination, metrics_size(span, chunk_tags));
+         if (!result) {
+           return result;
+         }
+         const auto visit = [&](const std::string& key, double value) {
+           auto result = msgpack::pack_string(destination, key);
+           if (result) {
+             msgpack::pack_double(destination, value);
+           }
+           return result;
+         };
+         if (!encoded_chunk_tags) {
+           return for_each_metric(span, chunk_tags, visit);
+         }
+         result = for_each_span_metric(span, chunk_tags, visit);
+         if (result) {
+           destination += encoded_chunk_tags->metrics;
+         }
+         return result;
+       }, keys::type, [&](auto& destination) {
          return msgpack::pack_string(destination, span.service_type);
        });
   // clang-format on
@@ -136,15 +766,394 @@ Expected<void> msgpack_encode(std::string& destination, const SpanData& span) {
   return nullopt;
 }
 
+// Append to the specified `destination` a MessagePack array containing each
+// of the specified `spans`, where the specified `encode` appends the span at a
+// given index to a given string.  The spans are divided among the specified
+// `workers`: the first range is encoded onto `destination`, and each other
+// range onto a string of its own, which is appended to `destination`
+// afterward.  Return the error of the earliest range that failed, if any.
+template <typename Encode>
+Expected<void> encode_spans_in_parallel(
+    std::string& destination,
+    const std::vector<std::unique_ptr<SpanData>>& spans, WorkerPool& workers,
+    Encode&& encode) {
+  auto result = msgpack::pack_array(destination, spans.size());
+  if (!result) {
+    return result;
+  }
+  const std::size_t ranges = workers.ranges(spans.size());
+  std::vector<std::string> parts(ranges - 1);
+  std::vector<Expected<void>> results(ranges);
+  workers.for_each_range(
+      spans.size(), [&](std::size_t range, std::size_t begin, std::size_t end) {
+        std::string& part = range == 0 ? destination : parts[range - 1];
+        for (std::size_t i = begin; i != end; ++i) {
+          assert(spans[i]);
+          results[range] = encode(part, i);
+          if (!results[range]) {
+            return;
+          }
+        }
+      });
+  for (auto& range_result : results) {
+    if (!range_result) {
+      return std::move(range_result);
+    }
+  }
+  for (const std::string& part : parts) {
+    destination += part;
+  }
+  return {};
+}
+
+}  // namespace
+
+Expected<void> msgpack_encode(std::string& destination, const SpanData& span,
+                              const ChunkTags& chunk_tags) {
+  return encode_span(destination, span, chunk_tags, nullptr);
+}
+
 Expected<void> msgpack_encode(
     std::string& destination,
-    const std::vector<std::unique_ptr<SpanData>>& spans) {
-  return msgpack::pack_array(destination, spans,
-                             [](auto& destination, const auto& span_ptr) {
-                               assert(span_ptr);
-                               return msgpack_encode(destination, *span_ptr);
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags, WorkerPool* workers) {
+  // Grow `destination` geometrically, even if `reserve` is exact, because
+  // `destination` might be accumulating many arrays of spans.
+  const std::size_t required =
+      destination.size() + msgpack_encoded_size_bound(spans, chunk_tags);
+  if (required > destination.capacity()) {
+    destination.reserve(std::max(required, 2 * destination.capacity()));
+  }
+  // The chunk tags are the same for every span in the chunk, so encode them
+  // once.  The buffer is reused across calls on the same thread.
+  thread_local EncodedChunkTags encoded_chunk_tags;
+  if (auto result = encode_chunk_tags(encoded_chunk_tags, chunk_tags);
+      result.if_error()) {
+    return result;
+  }
+  if (workers && workers->ranges(spans.size()) > 1) {
+    // The workers share this thread's encoding of the chunk tags, which does
+    // not change until they are done.  A `thread_local` named within the
+    // lambda would be the worker's own, so refer to this thread's instead.
+    const EncodedChunkTags& shared_chunk_tags = encoded_chunk_tags;
+    return encode_spans_in_parallel(
+        destination, spans, *workers, [&](std::string& part, std::size_t i) {
+          return encode_span(part, *spans[i], chunk_tags, nullptr,
+                             &shared_chunk_tags);
+        });
+  }
+  return msgpack::pack_array(
+      destination, spans, [&](auto& destination, const auto& span_ptr) {
+        assert(span_ptr);
+        return encode_span(destination, *span_ptr, chunk_tags, nullptr,
+                           &encoded_chunk_tags);
+      });
+}
+
+Expected<void> msgpack_encode_v07(
+    std::string& destination,
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags, const PayloadTags& payload_tags,
+    WorkerPool* workers) {
+  const std::size_t required =
+      destination.size() + msgpack_encoded_size_bound(spans, chunk_tags) +
+      chunk_keys::priority.encoded().size() + number_size +
+      chunk_keys::origin.encoded().size() +
+      string_size(chunk_tags.origin ? chunk_tags.origin->size() : 0) +
+      chunk_keys::spans.encoded().size();
+  if (required > destination.capacity()) {
+    destination.reserve(std::max(required, 2 * destination.capacity()));
+  }
+
+  Optional<double> priority;
+  if (!spans.empty()) {
+    priority = spans.front()->sampling_priority;
+  }
+  auto result = msgpack::pack_map(destination, priority ? 3 : 2);
+  if (!result) {
+    return result;
+  }
+  if (priority) {
+    msgpack::pack_fixed(destination, chunk_keys::priority);
+    msgpack::pack_integer(destination, std::int32_t(*priority));
+  }
+  msgpack::pack_fixed(destination, chunk_keys::origin);
+  result = msgpack::pack_string(
+      destination, chunk_tags.origin ? *chunk_tags.origin : StringView{});
+  if (!result) {
+    return result;
+  }
+  msgpack::pack_fixed(destination, chunk_keys::spans);
+
+  // The origin is the chunk's, and the language and runtime ID are the
+  // payload's, so only the process ID remains, and only on the local root.
+  ChunkTags root_chunk_tags;
+  root_chunk_tags.process_id = chunk_tags.process_id;
+  const ChunkTags other_chunk_tags{};
+  if (workers && workers->ranges(spans.size()) > 1) {
+    return encode_spans_in_parallel(
+        destination, spans, *workers, [&](std::string& part, std::size_t i) {
+          return encode_span(part, *spans[i],
+                             i == 0 ? root_chunk_tags : other_chunk_tags,
+                             &payload_tags);
+        });
+  }
+  bool root = true;
+  return msgpack::pack_array(
+      destination, spans, [&](auto& destination, const auto& span_ptr) {
+        assert(span_ptr);
+        const ChunkTags& span_chunk_tags =
+            root ? root_chunk_tags : other_chunk_tags;
+        root = false;
+        return encode_span(destination, *span_ptr, span_chunk_tags,
+                           &payload_tags);
+      });
+}
+
+Expected<void> msgpack_decode(StringView& input, SpanData& span) {
+  const auto is = [](StringView key, const auto& fixed) {
+    // The encoded key is preceded by its one byte "fixstr" header.
+    return key == fixed.encoded().substr(1);
+  };
+  const auto entries = msgpack::unpack_map(input);
+  if (!entries) {
+    return entries.error();
+  }
+  for (std::size_t i = 0; i < *entries; ++i) {
+    const auto key = msgpack::unpack_string(input);
+    if (!key) {
+      return key.error();
+    }
+    const auto unpack_string_into = [&](std::string& destination) {
+      auto value = msgpack::unpack_string(input);
+      if (!value) {
+        return Expected<void>{value.error()};
+      }
+      assign(destination, *value);
+      return Expected<void>{};
+    };
+    const auto unpack_unsigned_into = [&](std::uint64_t& destination) {
+      auto value = msgpack::unpack_unsigned(input);
+      if (!value) {
+        return Expected<void>{value.error()};
+      }
+      destination = *value;
+      return Expected<void>{};
+    };
+
+    Expected<void> result;
+    if (is(*key, keys::service)) {
+      result = unpack_string_into(span.service);
+    } else if (is(*key, keys::name)) {
+      result = unpack_string_into(span.name);
+    } else if (is(*key, keys::resource)) {
+      result = unpack_string_into(span.resource);
+    } else if (is(*key, keys::type)) {
+      result = unpack_string_into(span.service_type);
+    } else if (is(*key, keys::trace_id)) {
+      result = unpack_unsigned_into(span.trace_id.low);
+    } else if (is(*key, keys::span_id)) {
+      result = unpack_unsigned_into(span.span_id);
+    } else if (is(*key, keys::parent_id)) {
+      result = unpack_unsigned_into(span.parent_id);
+    } else if (is(*key, keys::start) || is(*key, keys::duration)) {
+      auto nanoseconds = msgpack::unpack_integer(input);
+      if (!nanoseconds) {
+        return nanoseconds.error();
+      }
+      const std::chrono::nanoseconds value{*nanoseconds};
+      if (is(*key, keys::start)) {
+        span.start.wall = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                value));
+      } else {
+        span.duration = std::chrono::duration_cast<Duration>(value);
+      }
+    } else if (is(*key, keys::error)) {
+      auto error = msgpack::unpack_integer(input);
+      if (!error) {
+        return error.error();
+      }
+      span.error = *error != 0;
+    } else if (is(*key, keys::meta)) {
+      auto size = msgpack::unpack_map(input);
+      if (!size) {
+        return size.error();
+      }
+      for (std::size_t j = 0; j < *size; ++j) {
+        auto name = msgpack::unpack_string(input);
+        if (!name) {
+          return name.error();
+        }
+        auto value = msgpack::unpack_string(input);
+        if (!value) {
+          return value.error();
+        }
+        span.tags[*name] = std::string(*value);
+      }
+    } else if (is(*key, keys::metrics)) {
+      auto size = msgpack::unpack_map(input);
+      if (!size) {
+        return size.error();
+      }
+      for (std::size_t j = 0; j < *size; ++j) {
+        auto name = msgpack::unpack_string(input);
+        if (!name) {
+          return name.error();
+        }
+        auto value = msgpack::unpack_double(input);
+        if (!value) {
+          return value.error();
+        }
+        if (*name == tags::internal::sampling_priority) {
+          span.sampling_priority = *value;
+        } else {
+          span.numeric_tags[*name] = *value;
+        }
+      }
+    } else {
+      result = msgpack::skip(input);
+    }
+    if (!result) {
+      return result;
+    }
+  }
+
+  // The high 64 bits of a 128-bit trace ID are encoded as a tag.
+  if (const auto high = span.tags.find(tags::internal::trace_id_high);
+      high != span.tags.end()) {
+    if (auto parsed = parse_uint64(high->second, 16)) {
+      span.trace_id.high = *parsed;
+    }
+  }
+  return {};
+}
+
+Expected<std::vector<std::unique_ptr<SpanData>>> msgpack_decode_spans(
+    StringView& input) {
+  const auto size = msgpack::unpack_array(input);
+  if (!size) {
+    return size.error();
+  }
+  std::vector<std::unique_ptr<SpanData>> spans;
+  // Each span occupies at least one byte, which bounds what an invalid size
+  // can make us reserve.
+  spans.reserve(std::min(*size, input.size()));
+  for (std::size_t i = 0; i < *size; ++i) {
+    auto span = std::make_unique<SpanData>();
+    auto result = msgpack_decode(input, *span);
+    if (!result) {
+      return result.error();
+    }
+    spans.push_back(std::move(span));
+  }
+  return spans;
+}
+
+StringTable::StringTable() { id(std::string()); }
+
+std::uint32_t StringTable::id(const std::string& value) {
+  const auto [entry, inserted] =
+      ids_.emplace(value, static_cast<std::uint32_t>(strings_.size()));
+  if (inserted) {
+    strings_.push_back(&entry->first);
+  }
+  return entry->second;
+}
+
+std::uint32_t StringTable::id(StringView value) {
+  // `std::unordered_map` has no heterogeneous lookup before C++20.
+  return id(std::string(value));
+}
+
+std::size_t StringTable::size() const { return strings_.size(); }
+
+Expected<void> StringTable::msgpack_encode(std::string& destination) const {
+  return msgpack::pack_array(destination, strings_,
+                             [](auto& destination, const std::string* value) {
+                               return msgpack::pack_string(destination, *value);
                              });
 }
 
+Expected<void> msgpack_encode_v05(
+    std::string& destination,
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags, StringTable& strings) {
+  // Every field of a v0.5 span is encoded in at most a fixed number of bytes,
+  // except for `meta` and `metrics`, whose entries are also bounded in size.
+  constexpr std::size_t id_size = type_byte_size + 4;
+  constexpr std::size_t fixed_size = length_prefixed_size + 4 * id_size +
+                                     5 * number_size + 2 * length_prefixed_size;
+  std::size_t required = destination.size() + length_prefixed_size;
+  for (const auto& span_ptr : spans) {
+    assert(span_ptr);
+    required += fixed_size + meta_size(*span_ptr, chunk_tags) * 2 * id_size +
+                metrics_size(*span_ptr, chunk_tags) * (id_size + number_size);
+  }
+  if (required > destination.capacity()) {
+    destination.reserve(std::max(required, 2 * destination.capacity()));
+  }
+
+  const auto pack_id = [&](std::string& destination, const auto& value) {
+    msgpack::pack_integer(destination, strings.id(value));
+  };
+
+  return msgpack::pack_array(
+      destination, spans,
+      [&](std::string& destination, const auto& span_ptr) -> Expected<void> {
+        assert(span_ptr);
+        const SpanData& span = *span_ptr;
+        // The order of the elements is defined by the Datadog Agent.
+        if (auto result = msgpack::pack_array(destination, 12);
+            result.if_error()) {
+          return result;
+        }
+        pack_id(destination, span.service);
+        pack_id(destination, span.name);
+        pack_id(destination, span.resource);
+        msgpack::pack_integer(destination, span.trace_id.low);
+        msgpack::pack_integer(destination, span.span_id);
+        msgpack::pack_integer(destination, span.parent_id);
+        msgpack::pack_integer(
+            destination,
+            std::int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             span.start.wall.time_since_epoch())
+                             .count()));
+        msgpack::pack_integer(
+            destination,
+            std::int64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    span.duration)
+                    .count()));
+        msgpack::pack_integer(destination, std::int32_t(span.error));
+        if (auto result =
+                msgpack::pack_map(destination, meta_size(span, chunk_tags));
+            result.if_error()) {
+          return result;
+        }
+        (void)for_each_meta(
+            span, chunk_tags,
+            [&](StringView key, StringView value) -> Expected<void> {
+              pack_id(destination, key);
+              pack_id(destination, value);
+              return {};
+            });
+        if (auto result =
+                msgpack::pack_map(destination, metrics_size(span, chunk_tags));
+            result.if_error()) {
+          return result;
+        }
+        (void)for_each_metric(
+            span, chunk_tags,
+            [&](const std::string& key, double value) -> Expected<void> {
+              pack_id(destination, key);
+              msgpack::pack_double(destination, value);
+              return {};
+            });
+        pack_id(destination, span.service_type);
+        return {};
+      });
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -2,59 +2,320 @@
 
 // This component provides a `struct`, `SpanData`, that contains all data fields
 // relevant to `Span`. `SpanData` is what is consumed by `Collector`.
+//
+// The string tags of a span are those in its `tags` and its `static_tags`,
+// together with the tags that it inherits from its `defaults`: the
+// `SpanDefaults::tags`, and the default environment and version.  Inherited
+// tags are not copied into each span, since they are the same for every span
+// and can be numerous.  Nor are static tags, whose names and values are
+// string literals or the like (see `static_string.h`).  Use `lookup_tag`,
+// `for_each_tag`, and `remove_tag` to consider all of them.
 
 #include <datadog/clock.h>
 #include <datadog/expected.h>
+#include <datadog/function_ref.h>
 #include <datadog/optional.h>
+#include <datadog/span_defaults.h>
 #include <datadog/string_view.h>
 #include <datadog/trace_id.h>
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "flat_map.h"
+#include "tags.h"
+
 namespace datadog {
 namespace tracing {
 
 struct SpanConfig;
-struct SpanDefaults;
+class SpanTemplate;
+class WorkerPool;
 
 struct SpanData {
+  // The scalar fields come first, so that the loops over a segment's spans
+  // that use only them, such as those of registration and partial flushing,
+  // touch the first cache line of each span rather than lines scattered among
+  // the strings and tags.
+
+  // The span registered with the same `TraceSegment` just before this one.
+  // This is used by `TraceSegment` until the span is sent.
+  SpanData* next_registered = nullptr;
+  // Whether the span is finished, for `TraceSegment`'s partial flushing.
+  std::atomic<bool> finished{false};
+  bool error = false;
+  // Whether `defaults->environment` and `defaults->version`, respectively,
+  // are inherited as tags, if not empty.
+  bool inherit_environment = false;
+  bool inherit_version = false;
+  std::uint64_t span_id = 0;
+  std::uint64_t parent_id = 0;
+  TraceID trace_id;
+  Duration duration = Duration::zero();
+  TimePoint start;
+  // The sampling priority of the trace, which is set on the first span of
+  // each chunk.  It is encoded as the numeric tag
+  // `tags::internal::sampling_priority`, taking precedence over an entry of
+  // that name in `numeric_tags`, but is kept here rather than in
+  // `numeric_tags` because it is set and read for every chunk.
+  Optional<double> sampling_priority;
+
   std::string service;
   std::string service_type;
   std::string name;
   std::string resource;
-  TraceID trace_id;
-  std::uint64_t span_id = 0;
-  std::uint64_t parent_id = 0;
-  TimePoint start;
-  Duration duration = Duration::zero();
-  bool error = false;
-  std::unordered_map<std::string, std::string> tags;
-  std::unordered_map<std::string, double> numeric_tags;
+  // The span's own string tags, which take precedence over static and
+  // inherited tags.
+  FlatMap<std::string> tags;
+  // The span's own string tags whose names and values have static storage
+  // duration, and so are referred to rather than copied.  They take
+  // precedence over inherited tags.
+  FlatMap<StringView, 4, StringView> static_tags;
+  FlatMap<double> numeric_tags;
+  // The defaults from which this span inherits string tags, or null if it
+  // inherits none.
+  std::shared_ptr<const SpanDefaults> defaults;
 
   Optional<StringView> environment() const;
   Optional<StringView> version() const;
 
+  // Return the value of the string tag having the specified `name`, whether
+  // it is the span's own or inherited, or return null if there is no such
+  // tag.
+  Optional<StringView> lookup_tag(StringView name) const;
+  // Delete the string tag having the specified `name`, if any.  If the tag is
+  // inherited, then the span's inherited tags are first copied into `tags`,
+  // and the span no longer refers to its `defaults`.
+  void remove_tag(StringView name);
+  // Invoke the specified `visit` with the name and value, as `StringView`s, of
+  // each string tag of this span: own tags first, then static tags, and then
+  // inherited tags.
+  template <typename Visit>
+  void for_each_tag(Visit&& visit) const;
+  // Invoke the specified `visit` as `for_each_tag` does, but only for the own
+  // and static string tags of this span, and not for its inherited tags.
+  template <typename Visit>
+  void for_each_own_tag(Visit&& visit) const;
+  // Return the number of string tags of this span, own and inherited.
+  std::size_t tag_count() const;
+
   // Modify the properties of this object to honor the specified `config` and
   // `defaults`.  The properties of `config`, if set, override the properties of
-  // `defaults`. Use the specified `clock` to provide a start none of none is
-  // specified in `config`.
-  void apply_config(const SpanDefaults& defaults, const SpanConfig& config,
-                    const Clock& clock);
+  // `defaults`. Use the specified `now` to provide a start time if none is
+  // specified in `config`.  `now` is a `Clock`, or e.g. `TraceSegment::now`.
+  // The tags, name, and resource taken from `config` are truncated to the
+  // limit that the specified `tag_value_limit` returns for their tag names,
+  // e.g. `TraceSegment::tag_value_limit`.  Tags in `defaults` are inherited
+  // rather than copied.  If `config` is an rvalue, then its strings and tags
+  // are moved rather than copied.
+  void apply_config(const std::shared_ptr<const SpanDefaults>& defaults,
+                    const SpanConfig& config, FunctionRef<TimePoint()> now,
+                    FunctionRef<std::size_t(StringView)> tag_value_limit);
+  void apply_config(const std::shared_ptr<const SpanDefaults>& defaults,
+                    SpanConfig&& config, FunctionRef<TimePoint()> now,
+                    FunctionRef<std::size_t(StringView)> tag_value_limit);
+  // Modify the properties of this object as `apply_config` would with the
+  // `SpanConfig` of the specified `config`, but by copying the properties
+  // that `config` prepared for `defaults` and `tag_value_limit`.
+  void apply_config(const std::shared_ptr<const SpanDefaults>& defaults,
+                    const SpanTemplate& config, FunctionRef<TimePoint()> now,
+                    FunctionRef<std::size_t(StringView)> tag_value_limit);
+
+  // A `SpanData` is allocated for every span and freed soon after its trace
+  // segment is sent to the `Collector`.  Rather than return that storage to
+  // the global allocator, which is contended when many threads create spans,
+  // freed storage is kept in a bounded per-thread cache and reused by the next
+  // `SpanData` allocated on the same thread.
+  static void* operator new(std::size_t size);
+  static void operator delete(void* pointer, std::size_t size) noexcept;
+
+ private:
+  // Return the inherited environment, or null if none is inherited.
+  const std::string* inherited_environment() const;
+  // Return the inherited version, or null if none is inherited.
+  const std::string* inherited_version() const;
+};
+
+template <typename Visit>
+void SpanData::for_each_own_tag(Visit&& visit) const {
+  for (const auto& [key, value] : tags) {
+    visit(StringView(key), StringView(value));
+  }
+  for (const auto& [key, value] : static_tags) {
+    if (!tags.count(key)) {
+      visit(key, value);
+    }
+  }
+}
+
+template <typename Visit>
+void SpanData::for_each_tag(Visit&& visit) const {
+  for_each_own_tag(visit);
+  if (!defaults) {
+    return;
+  }
+  const auto is_own = [&](StringView key) {
+    return tags.count(key) || static_tags.count(key);
+  };
+  const std::string* const environment = inherited_environment();
+  if (environment && !is_own(tags::environment)) {
+    visit(StringView(tags::environment), StringView(*environment));
+  }
+  const std::string* const version = inherited_version();
+  if (version && !is_own(tags::version)) {
+    visit(StringView(tags::version), StringView(*version));
+  }
+  for (const auto& [key, value] : defaults->tags) {
+    if (is_own(key) || (environment && key == tags::environment) ||
+        (version && key == tags::version)) {
+      continue;
+    }
+    visit(StringView(key), StringView(value));
+  }
+}
+
+// `ChunkTags` contains the tags that have the same value on every span of a
+// trace chunk.  Rather than being copied into the `tags` and `numeric_tags` of
+// each span, they accompany the chunk to the `Collector`, and `msgpack_encode`
+// writes them into each encoded span.  A tag in `ChunkTags` takes precedence
+// over a span's own tag of the same name.
+//
+// `ChunkTags` refers to strings that it does not own.  They are valid only for
+// the duration of the `Collector::send` to which the `ChunkTags` is passed, so
+// that the same strings, such as the runtime ID, are not copied for every
+// chunk.
+struct ChunkTags {
+  // `tags::internal::origin`
+  Optional<StringView> origin;
+  // `tags::internal::language`
+  Optional<StringView> language;
+  // `tags::internal::runtime_id`
+  Optional<StringView> runtime_id;
+  // `tags::internal::process_id`
+  Optional<double> process_id;
 };
 
+// Add the specified `chunk_tags`, and the `sampling_priority` of the
+// specified `span` if it has one, to the `tags` and `numeric_tags` of `span`,
+// overwriting any existing values.
+void apply_chunk_tags(SpanData& span, const ChunkTags& chunk_tags);
+
+// Return an upper bound on the number of bytes that `msgpack_encode` appends
+// when encoding the specified `span` with the specified `chunk_tags`.
+std::size_t msgpack_encoded_size_bound(const SpanData& span,
+                                       const ChunkTags& chunk_tags);
+
+// Return an upper bound on the number of bytes that `msgpack_encode` appends
+// when encoding an array containing each of the specified `spans` with the
+// specified `chunk_tags`.  The behavior is undefined if any span is `nullptr`.
+std::size_t msgpack_encoded_size_bound(
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags);
+
 // Append to the specified `destination` the MessagePack representation of the
-// specified `span`.
-Expected<void> msgpack_encode(std::string& destination, const SpanData& span);
+// specified `span`, including the specified `chunk_tags`.
+Expected<void> msgpack_encode(std::string& destination, const SpanData& span,
+                              const ChunkTags& chunk_tags);
 
 // Append to the specified `destination` the MessagePack representation of an
-// array containing each of the specified `spans`.  The behavior is undefined
-// if any span is `nullptr`.
+// array containing each of the specified `spans`, each including the specified
+// `chunk_tags`.  `destination` is grown at most once, according to
+// `msgpack_encoded_size_bound`.  If the optionally specified `workers` is not
+// null and divides the spans into more than one range, then the ranges are
+// encoded concurrently and appended in order.  The behavior is undefined if
+// any span is `nullptr`.
 Expected<void> msgpack_encode(
     std::string& destination,
-    const std::vector<std::unique_ptr<SpanData>>& spans);
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags, WorkerPool* workers = nullptr);
+
+// `PayloadTags` contains the string tags that a payload in the Datadog
+// Agent's v0.7 trace format carries once for all of its spans.  A span whose
+// tag has the same value as one in `PayloadTags` is encoded without it.  An
+// empty value is carried by no span.
+struct PayloadTags {
+  // `tags::environment`
+  StringView env;
+  // `tags::version`
+  StringView version;
+};
+
+// Append to the specified `destination` the MessagePack representation of the
+// specified `spans` as a trace chunk in the Datadog Agent's v0.7 trace format.
+// The chunk is a map of its "priority", the sampling priority of the first
+// span, its "origin", that of the specified `chunk_tags`, and its "spans".
+// The other `chunk_tags` are not written into every span: the language and
+// runtime ID are carried by the payload, and the process ID is written into
+// the first span only.  Neither are the tags carried by the specified
+// `payload_tags`.  Each span still has its trace ID, which the Datadog Agent
+// requires of every span.  The optionally specified `workers` are used as by
+// `msgpack_encode`.  The behavior is undefined if any span is `nullptr`.
+Expected<void> msgpack_encode_v07(
+    std::string& destination,
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags, const PayloadTags& payload_tags,
+    WorkerPool* workers = nullptr);
+
+// Read from the beginning of the specified `input` the MessagePack
+// representation of a span, as written by `msgpack_encode`, into the
+// specified `span`, and advance `input` past it.  The span's tags, including
+// those that were chunk tags or inherited tags when it was encoded, are read
+// into its own `tags` and `numeric_tags`, except for the sampling priority,
+// which is read into its `sampling_priority`.  Map entries other than those
+// that `msgpack_encode` writes are skipped.  Return an error if `input` does
+// not begin with such a representation.
+Expected<void> msgpack_decode(StringView& input, SpanData& span);
+
+// Read from the beginning of the specified `input` a MessagePack array of
+// spans, i.e. a trace chunk in the v0.4 trace format, as written by the
+// `msgpack_encode` of an array of spans, and advance `input` past it.
+Expected<std::vector<std::unique_ptr<SpanData>>> msgpack_decode_spans(
+    StringView& input);
+
+// `StringTable` is the dictionary of strings referred to by spans encoded in
+// the Datadog Agent's v0.5 trace format.  Each distinct string is assigned an
+// index in the order that it was first seen.  The empty string always has
+// index zero.
+class StringTable {
+  std::unordered_map<std::string, std::uint32_t> ids_;
+  // `strings_[i]` is the key in `ids_` whose value is `i`.
+  std::vector<const std::string*> strings_;
+
+ public:
+  StringTable();
+  StringTable(const StringTable&) = delete;
+  StringTable(StringTable&&) = default;
+  StringTable& operator=(const StringTable&) = delete;
+  StringTable& operator=(StringTable&&) = default;
+
+  // Return the index of the specified `value`, adding `value` to this table
+  // if it is not already present.
+  std::uint32_t id(const std::string& value);
+  std::uint32_t id(StringView value);
+
+  // Return the number of distinct strings in this table.
+  std::size_t size() const;
+
+  // Append to the specified `destination` the MessagePack representation of
+  // an array containing each string in this table, in index order.
+  Expected<void> msgpack_encode(std::string& destination) const;
+};
+
+// Append to the specified `destination` the v0.5 MessagePack representation of
+// an array containing each of the specified `spans`, each including the
+// specified `chunk_tags`.  Each span is encoded as a fixed-length array whose
+// strings are replaced by their index in the specified `strings`, to which any
+// previously unseen strings are added.  The behavior is undefined if any span
+// is `nullptr`.
+Expected<void> msgpack_encode_v05(
+    std::string& destination,
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const ChunkTags& chunk_tags, StringTable& strings);
 
 }  // namespace tracing
 }  // namespace datadog
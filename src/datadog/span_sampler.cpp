@@ -3,22 +3,25 @@
 #include <datadog/sampling_mechanism.h>
 #include <datadog/sampling_priority.h>
 
+#include <algorithm>
+
 #include "sampling_util.h"
 #include "span_data.h"
 
 namespace datadog {
 namespace tracing {
 
-SpanSampler::SynchronizedLimiter::SynchronizedLimiter(const Clock& clock,
-                                                      double max_per_second)
-    : limiter(clock, max_per_second) {}
-
 SpanSampler::Rule::Rule(const FinalizedSpanSamplerConfig::Rule& rule,
                         const Clock& clock)
     : FinalizedSpanSamplerConfig::Rule(rule),
-      limiter_(max_per_second ? std::make_unique<SynchronizedLimiter>(
-                                    clock, *max_per_second)
-                              : nullptr) {}
+      matcher_(rule),
+      limiter_(max_per_second
+                   ? std::make_unique<Limiter>(clock, *max_per_second)
+                   : nullptr) {}
+
+bool SpanSampler::Rule::match(const SpanData& span) const {
+  return matcher_.match(span);
+}
 
 SamplingDecision SpanSampler::Rule::decide(const SpanData& span) {
   SamplingDecision decision;
@@ -38,8 +41,7 @@ SamplingDecision SpanSampler::Rule::decide(const SpanData& span) {
     return decision;
   }
 
-  std::lock_guard<std::mutex> lock(limiter_->mutex);
-  const auto result = limiter_->limiter.allow();
+  const auto result = limiter_->allow();
   if (result.allowed) {
     decision.priority = int(SamplingPriority::USER_KEEP);
   } else {
@@ -50,22 +52,81 @@ SamplingDecision SpanSampler::Rule::decide(const SpanData& span) {
   return decision;
 }
 
-SpanSampler::SpanSampler(const FinalizedSpanSamplerConfig& config,
-                         const Clock& clock) {
+namespace {
+
+std::vector<SpanSampler::Rule> make_rules(
+    const FinalizedSpanSamplerConfig& config, const Clock& clock) {
+  std::vector<SpanSampler::Rule> rules;
+  rules.reserve(config.rules.size());
   for (const auto& rule : config.rules) {
-    rules_.push_back(Rule{rule, clock});
+    rules.push_back(SpanSampler::Rule{rule, clock});
   }
+  return rules;
 }
 
+}  // namespace
+
+SpanSampler::SpanSampler(const FinalizedSpanSamplerConfig& config,
+                         const Clock& clock)
+    : rules_(make_rules(config, clock)),
+      index_(rules_, [](const Rule& rule) -> const CompiledSpanMatcher& {
+        return rule.matcher();
+      }),
+      any_rule_has_tags_(
+          std::any_of(rules_.begin(), rules_.end(), [](const Rule& rule) {
+            return rule.matcher().has_tags();
+          })) {}
+
 SpanSampler::Rule* SpanSampler::match(const SpanData& span) {
-  const auto found = std::find_if(rules_.begin(), rules_.end(),
-                                  [&](Rule& rule) { return rule.match(span); });
-  if (found != rules_.end()) {
-    return &*found;
+  const auto found = index_.find_first(
+      span, [&](std::size_t i) { return rules_[i].match(span); });
+  if (found != rules_.size()) {
+    return &rules_[found];
+  }
+  return nullptr;
+}
+
+SpanSampler::Rule* SpanSampler::match(const SpanData& span,
+                                       MatchCache& cache) {
+  if (any_rule_has_tags_) {
+    return match(span);
+  }
+  if (const auto* entry = cache.find(span)) {
+    return entry->rule;
+  }
+  Rule* const rule = match(span);
+  cache.insert(span, rule);
+  return rule;
+}
+
+const SpanSampler::MatchCache::Entry* SpanSampler::MatchCache::find(
+    const SpanData& span) const {
+  for (std::size_t i = 0; i < size_; ++i) {
+    const Entry& entry = entries_[i];
+    if (entry.service == span.service && entry.name == span.name &&
+        entry.resource == span.resource) {
+      return &entry;
+    }
   }
   return nullptr;
 }
 
+void SpanSampler::MatchCache::insert(const SpanData& span, Rule* rule) {
+  Entry* entry;
+  if (size_ < capacity) {
+    entry = &entries_[size_++];
+  } else {
+    entry = &entries_[next_];
+    next_ = (next_ + 1) % capacity;
+  }
+  entry->service = span.service;
+  entry->name = span.name;
+  entry->resource = span.resource;
+  entry->rule = rule;
+}
+
+bool SpanSampler::has_rules() const { return !rules_.empty(); }
+
 nlohmann::json SpanSampler::config_json() const {
   std::vector<nlohmann::json> rules;
   for (const auto& rule : rules_) {
@@ -22,36 +22,75 @@
 #include <datadog/sampling_decision.h>
 #include <datadog/span_sampler_config.h>
 
+#include <cstddef>
 #include <memory>
-#include <mutex>
+#include <string>
 
+#include "compiled_span_matcher.h"
 #include "json.hpp"
 #include "limiter.h"
+#include "rule_index.h"
 
 namespace datadog {
 namespace tracing {
 
 class SpanSampler {
  public:
-  struct SynchronizedLimiter {
-    std::mutex mutex;
-    Limiter limiter;
-
-    SynchronizedLimiter(const Clock&, double max_per_second);
-  };
-
   class Rule : public FinalizedSpanSamplerConfig::Rule {
-    std::unique_ptr<SynchronizedLimiter> limiter_;
+    CompiledSpanMatcher matcher_;
+    std::unique_ptr<Limiter> limiter_;
 
    public:
     explicit Rule(const FinalizedSpanSamplerConfig::Rule&, const Clock&);
 
+    // Return whether the specified span matches this rule.  This hides
+    // `SpanMatcher::match` in favor of the compiled matcher.
+    bool match(const SpanData&) const;
+
+    const CompiledSpanMatcher& matcher() const { return matcher_; }
+
     // Return a sampling decision for the specified span.
     SamplingDecision decide(const SpanData&);
   };
 
+  // `MatchCache` remembers which rule, if any, matched spans having a
+  // particular service, operation name, and resource.  Spans in a trace often
+  // share those fields, e.g. hundreds of identical database queries, and so a
+  // cache that lives as long as one call to `TraceSegment::sample_spans` saves
+  // matching the same span against the rules over and over.
+  //
+  // A `MatchCache` refers to the rules of the `SpanSampler` that filled it,
+  // and so must be used with only that `SpanSampler`.  The rules of a
+  // `SpanSampler` do not change, so the cache never needs to be invalidated.
+  class MatchCache {
+    friend class SpanSampler;
+
+    struct Entry {
+      std::string service;
+      std::string name;
+      std::string resource;
+      Rule* rule;
+    };
+
+    static constexpr std::size_t capacity = 8;
+
+    Entry entries_[capacity];
+    std::size_t size_ = 0;
+    // Offset of the entry to replace next once the cache is full.
+    std::size_t next_ = 0;
+
+    // Return a pointer to the entry for the specified `span`, or return null
+    // if there isn't one.
+    const Entry* find(const SpanData& span) const;
+    void insert(const SpanData& span, Rule* rule);
+  };
+
  private:
   std::vector<Rule> rules_;
+  RuleIndex index_;
+  // Whether any rule has tag patterns, in which case match results cannot be
+  // cached by service, operation name, and resource.
+  bool any_rule_has_tags_;
 
  public:
   explicit SpanSampler(const FinalizedSpanSamplerConfig& config,
@@ -61,6 +100,13 @@ class SpanSampler {
   // return null if there is no match.
   Rule* match(const SpanData&);
 
+  // Return the same result as `match(span)`, but consult the specified `cache`
+  // first, and record the result in `cache` afterward.
+  Rule* match(const SpanData& span, MatchCache& cache);
+
+  // Return whether there are any rules, i.e. whether any span could match.
+  bool has_rules() const;
+
   nlohmann::json config_json() const;
 };
 
@@ -0,0 +1,131 @@
+#include "span_summary.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "span_data.h"
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+const std::string summary_count = "_dd.summary.count";
+const std::string summary_duration_total = "_dd.summary.duration.total";
+const std::string summary_duration_max = "_dd.summary.duration.max";
+const std::string summary_errors = "_dd.summary.errors";
+
+// Spans are grouped by their parent and the fields that identify what they
+// did.
+struct GroupHash {
+  std::size_t operator()(const SpanData* span) const {
+    const std::hash<std::string> hash;
+    std::size_t result = std::hash<std::uint64_t>()(span->parent_id);
+    for (const std::string* field :
+         {&span->service, &span->service_type, &span->name, &span->resource}) {
+      result = result * 31 + hash(*field);
+    }
+    return result;
+  }
+};
+
+struct GroupEqual {
+  bool operator()(const SpanData* left, const SpanData* right) const {
+    return left->parent_id == right->parent_id &&
+           left->service == right->service &&
+           left->service_type == right->service_type &&
+           left->name == right->name && left->resource == right->resource;
+  }
+};
+
+// Collapse the specified `group` of indices into the specified `spans` into
+// the span at the first index having an error, or else at the first index.
+// Reset the other elements of `spans` in `group` to null.
+void summarize_group(std::vector<std::unique_ptr<SpanData>>& spans,
+                     const std::vector<std::size_t>& group) {
+  std::size_t summary_index = group.front();
+  TimePoint start = spans[group.front()]->start;
+  auto end = start.tick + spans[group.front()]->duration;
+  Duration total = Duration::zero();
+  Duration longest = Duration::zero();
+  std::size_t errors = 0;
+  for (const std::size_t index : group) {
+    const SpanData& span = *spans[index];
+    if (span.error && errors++ == 0) {
+      summary_index = index;
+    }
+    if (span.start.tick < start.tick) {
+      start = span.start;
+    }
+    end = std::max(end, span.start.tick + span.duration);
+    total += span.duration;
+    longest = std::max(longest, span.duration);
+  }
+
+  SpanData& summary = *spans[summary_index];
+  summary.start = start;
+  summary.duration = end - start.tick;
+  const auto nanoseconds = [](Duration duration) {
+    return double(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  };
+  summary.numeric_tags[summary_count] = double(group.size());
+  summary.numeric_tags[summary_duration_total] = nanoseconds(total);
+  summary.numeric_tags[summary_duration_max] = nanoseconds(longest);
+  summary.numeric_tags[summary_errors] = double(errors);
+
+  for (const std::size_t index : group) {
+    if (index != summary_index) {
+      spans[index].reset();
+    }
+  }
+}
+
+}  // namespace
+
+std::size_t summarize_spans(std::vector<std::unique_ptr<SpanData>>& spans,
+                            std::size_t min_spans) {
+  // The local root is never summarized, so there must be at least
+  // `min_spans` others.
+  if (min_spans == 0 || spans.size() <= min_spans) {
+    return 0;
+  }
+
+  std::unordered_set<std::uint64_t> parents;
+  parents.reserve(spans.size());
+  for (const auto& span : spans) {
+    parents.insert(span->parent_id);
+  }
+
+  std::unordered_map<const SpanData*, std::vector<std::size_t>, GroupHash,
+                     GroupEqual>
+      groups;
+  for (std::size_t i = 1; i < spans.size(); ++i) {
+    const SpanData& span = *spans[i];
+    if (parents.count(span.span_id) ||
+        span.numeric_tags.find(tags::internal::span_sampling_mechanism) !=
+            span.numeric_tags.end()) {
+      continue;
+    }
+    groups[&span].push_back(i);
+  }
+
+  std::size_t removed = 0;
+  for (const auto& [_, group] : groups) {
+    if (group.size() >= min_spans) {
+      summarize_group(spans, group);
+      removed += group.size() - 1;
+    }
+  }
+  if (removed) {
+    spans.erase(std::remove(spans.begin(), spans.end(), nullptr), spans.end());
+  }
+  return removed;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,41 @@
+#pragma once
+
+// This component provides a function, `summarize_spans`, that collapses
+// groups of identical leaf spans in a finished trace segment into one summary
+// span per group.  See `TracerConfig::span_summary_min_spans`.
+//
+// Leaf spans are identical if they have the same parent, service, service
+// type, operation name, and resource name, e.g. the hundreds of cache reads,
+// or per-row callbacks, made by one request.  A group of at least the
+// configured number of identical leaf spans is replaced by one of its spans:
+// the first one that has an error, if any, or else the first one.  That span
+// is extended to cover the whole group, from the earliest start to the
+// latest end, and receives the following numeric tags:
+//
+// - "_dd.summary.count": the number of spans in the group;
+// - "_dd.summary.duration.total": the sum of their durations, in nanoseconds;
+// - "_dd.summary.duration.max": the longest duration, in nanoseconds;
+// - "_dd.summary.errors": the number of spans that have an error.
+//
+// The local root span, and spans kept by the span sampler, are never
+// summarized.  Only spans sent when a segment finishes are summarized, since
+// a span sent earlier by a partial flush might yet acquire children.
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+// Replace each group of at least the specified `min_spans` identical leaf
+// spans among the specified `spans`, whose first element is the local root
+// span, with a summary span, as described above.  Return the number of spans
+// removed.
+std::size_t summarize_spans(std::vector<std::unique_ptr<SpanData>>& spans,
+                            std::size_t min_spans);
+
+}  // namespace tracing
+}  // namespace datadog
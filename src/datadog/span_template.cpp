@@ -0,0 +1,36 @@
+#include <datadog/span_template.h>
+
+#include <utility>
+
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+SpanTemplate::SpanTemplate(SpanConfig config) : config_(std::move(config)) {}
+
+SpanTemplate::SpanTemplate(const SpanTemplate& other)
+    : config_(other.config_), prototype_(std::atomic_load(&other.prototype_)) {}
+
+SpanTemplate::~SpanTemplate() = default;
+
+std::shared_ptr<const SpanData> SpanTemplate::prototype(
+    const std::shared_ptr<const SpanDefaults>& defaults,
+    FunctionRef<std::size_t(StringView)> tag_value_limit) const {
+  auto prototype = std::atomic_load(&prototype_);
+  if (prototype && prototype->defaults == defaults) {
+    return prototype;
+  }
+
+  // Threads that find the prototype stale at the same time each prepare
+  // one, and the last one stored wins.  They are equivalent.
+  auto prepared = std::make_shared<SpanData>();
+  prepared->apply_config(
+      defaults, config_, []() { return TimePoint{}; }, tag_value_limit);
+  prototype = std::move(prepared);
+  std::atomic_store(&prototype_, prototype);
+  return prototype;
+}
+
+}  // namespace tracing
+}  // namespace datadog
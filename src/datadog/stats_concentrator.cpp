@@ -0,0 +1,288 @@
+#include "stats_concentrator.h"
+
+#include <datadog/logger.h>
+#include <datadog/tracer_signature.h>
+
+#include <functional>
+#include <utility>
+
+#include "msgpack.h"
+#include "parse_util.h"
+#include "span_data.h"
+#include "string_util.h"
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Return whether the specified `span` is top-level, given the specified
+// `services`, which maps the ID of each span in its trace chunk to the span's
+// service.
+bool is_top_level(
+    const SpanData& span,
+    const std::unordered_map<std::uint64_t, const std::string*>& services) {
+  if (span.parent_id == 0) {
+    return true;
+  }
+  const auto found = services.find(span.parent_id);
+  return found == services.end() || *found->second != span.service;
+}
+
+bool is_measured(const SpanData& span) {
+  const auto found = span.numeric_tags.find(tags::internal::measured);
+  return found != span.numeric_tags.end() && found->second == 1;
+}
+
+std::uint32_t http_status_code(const SpanData& span) {
+  if (auto status = span.lookup_tag(tags::http_status_code)) {
+    auto code = parse_uint64(*status, 10);
+    if (code && *code <= 999) {
+      return static_cast<std::uint32_t>(*code);
+    }
+    return 0;
+  }
+  const auto found = span.numeric_tags.find(tags::http_status_code);
+  if (found != span.numeric_tags.end() && found->second >= 0 &&
+      found->second <= 999) {
+    return static_cast<std::uint32_t>(found->second);
+  }
+  return 0;
+}
+
+Expected<void> pack_sketch(std::string& destination, const DDSketch& sketch) {
+  thread_local std::string encoded;
+  encoded.clear();
+  sketch.encode(encoded);
+  return msgpack::pack_binary(destination, encoded);
+}
+
+}  // namespace
+
+bool StatsConcentrator::GroupKey::operator==(const GroupKey& other) const {
+  return http_status_code == other.http_status_code &&
+         synthetics == other.synthetics && service == other.service &&
+         name == other.name && resource == other.resource &&
+         type == other.type;
+}
+
+std::size_t StatsConcentrator::GroupKeyHash::operator()(
+    const GroupKey& key) const {
+  std::size_t seed = std::hash<std::uint32_t>{}(key.http_status_code) ^
+                     std::size_t(key.synthetics);
+  const auto combine = [&](const std::string& value) {
+    seed ^= std::hash<std::string>{}(value) + 0x9e3779b9 + (seed << 6) +
+            (seed >> 2);
+  };
+  combine(key.service);
+  combine(key.name);
+  combine(key.resource);
+  combine(key.type);
+  return seed;
+}
+
+StatsConcentrator::StatsConcentrator(const TracerSignature& signature,
+                                     const std::shared_ptr<Logger>& logger,
+                                     std::chrono::nanoseconds bucket_duration)
+    : bucket_duration_(bucket_duration.count()),
+      runtime_id_(signature.runtime_id.string()),
+      default_service_(signature.default_service),
+      tracer_version_(signature.library_version),
+      logger_(logger) {}
+
+void StatsConcentrator::add(
+    const std::vector<std::unique_ptr<SpanData>>& spans) {
+  std::unordered_map<std::uint64_t, const std::string*> services;
+  services.reserve(spans.size());
+  for (const auto& span : spans) {
+    services.emplace(span->span_id, &span->service);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& span : spans) {
+    const bool top_level = is_top_level(*span, services);
+    if (top_level) {
+      span->numeric_tags[tags::internal::top_level] = 1;
+    } else if (!is_measured(*span)) {
+      continue;
+    }
+
+    const auto end = span->start.wall + span->duration;
+    const std::uint64_t end_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end.time_since_epoch())
+            .count();
+    const std::uint64_t bucket_start = end_ns - end_ns % bucket_duration_;
+
+    Environment environment{std::string(span->environment().value_or("")),
+                            std::string(span->version().value_or(""))};
+    const auto origin = span->lookup_tag(tags::internal::origin);
+    GroupKey key{span->service,
+                 span->name,
+                 span->resource,
+                 span->service_type,
+                 http_status_code(*span),
+                 origin && starts_with(*origin, "synthetics")};
+    GroupStats& stats =
+        buckets_[std::move(environment)][bucket_start][std::move(key)];
+
+    const std::uint64_t duration =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(span->duration)
+            .count();
+    ++stats.hits;
+    stats.top_level_hits += top_level;
+    stats.duration += duration;
+    if (span->error) {
+      ++stats.errors;
+      stats.error_summary.add(double(duration));
+    } else {
+      stats.ok_summary.add(double(duration));
+    }
+  }
+}
+
+std::vector<std::string> StatsConcentrator::flush(
+    std::chrono::system_clock::time_point now, bool force) {
+  const std::uint64_t now_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          now.time_since_epoch())
+          .count();
+
+  std::map<Environment, Buckets> ready;
+  std::vector<std::uint64_t> sequences;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto entry = buckets_.begin(); entry != buckets_.end();) {
+      Buckets& buckets = entry->second;
+      auto end = buckets.begin();
+      while (end != buckets.end() &&
+             (force || end->first + bucket_duration_ <= now_ns)) {
+        ++end;
+      }
+      if (end != buckets.begin()) {
+        Buckets& destination = ready[entry->first];
+        destination.insert(std::make_move_iterator(buckets.begin()),
+                           std::make_move_iterator(end));
+        buckets.erase(buckets.begin(), end);
+        sequences.push_back(++sequence_);
+      }
+      if (buckets.empty()) {
+        entry = buckets_.erase(entry);
+      } else {
+        ++entry;
+      }
+    }
+  }
+
+  std::vector<std::string> bodies;
+  auto sequence = sequences.begin();
+  for (const auto& [environment, buckets] : ready) {
+    const auto& [env, version] = environment;
+    std::string body;
+    // clang-format off
+    auto result = msgpack::pack_map(
+        body,
+        msgpack::fixstr("Hostname"), [&](auto& destination) {
+          return msgpack::pack_string(destination, "");
+        },
+        msgpack::fixstr("Env"), [&](auto& destination) {
+          return msgpack::pack_string(destination, env);
+        },
+        msgpack::fixstr("Version"), [&](auto& destination) {
+          return msgpack::pack_string(destination, version);
+        },
+        msgpack::fixstr("Stats"), [&](auto& destination) {
+          return msgpack::pack_array(destination, buckets, [&](auto& destination, const auto& entry) {
+            const auto& [start, groups] = entry;
+            return msgpack::pack_map(
+                destination,
+                msgpack::fixstr("Start"), [&](auto& destination) {
+                  msgpack::pack_integer(destination, start);
+                  return Expected<void>{};
+                },
+                msgpack::fixstr("Duration"), [&](auto& destination) {
+                  msgpack::pack_integer(destination, bucket_duration_);
+                  return Expected<void>{};
+                },
+                msgpack::fixstr("Stats"), [&](auto& destination) {
+                  return msgpack::pack_array(destination, groups, [&](auto& destination, const auto& group) {
+                    const auto& [key, stats] = group;
+                    return msgpack::pack_map(
+                        destination,
+                        msgpack::fixstr("Service"), [&](auto& destination) {
+                          return msgpack::pack_string(destination, key.service);
+                        },
+                        msgpack::fixstr("Name"), [&](auto& destination) {
+                          return msgpack::pack_string(destination, key.name);
+                        },
+                        msgpack::fixstr("Resource"), [&](auto& destination) {
+                          return msgpack::pack_string(destination, key.resource);
+                        },
+                        msgpack::fixstr("HTTPStatusCode"), [&](auto& destination) {
+                          msgpack::pack_integer(destination, key.http_status_code);
+                          return Expected<void>{};
+                        },
+                        msgpack::fixstr("Type"), [&](auto& destination) {
+                          return msgpack::pack_string(destination, key.type);
+                        },
+                        msgpack::fixstr("Hits"), [&](auto& destination) {
+                          msgpack::pack_integer(destination, stats.hits);
+                          return Expected<void>{};
+                        },
+                        msgpack::fixstr("Errors"), [&](auto& destination) {
+                          msgpack::pack_integer(destination, stats.errors);
+                          return Expected<void>{};
+                        },
+                        msgpack::fixstr("Duration"), [&](auto& destination) {
+                          msgpack::pack_integer(destination, stats.duration);
+                          return Expected<void>{};
+                        },
+                        msgpack::fixstr("OkSummary"), [&](auto& destination) {
+                          return pack_sketch(destination, stats.ok_summary);
+                        },
+                        msgpack::fixstr("ErrorSummary"), [&](auto& destination) {
+                          return pack_sketch(destination, stats.error_summary);
+                        },
+                        msgpack::fixstr("Synthetics"), [&](auto& destination) {
+                          msgpack::pack_bool(destination, key.synthetics);
+                          return Expected<void>{};
+                        },
+                        msgpack::fixstr("TopLevelHits"), [&](auto& destination) {
+                          msgpack::pack_integer(destination, stats.top_level_hits);
+                          return Expected<void>{};
+                        });
+                  });
+                });
+          });
+        },
+        msgpack::fixstr("Lang"), [&](auto& destination) {
+          return msgpack::pack_string(destination, "cpp");
+        },
+        msgpack::fixstr("TracerVersion"), [&](auto& destination) {
+          return msgpack::pack_string(destination, tracer_version_);
+        },
+        msgpack::fixstr("RuntimeID"), [&](auto& destination) {
+          return msgpack::pack_string(destination, runtime_id_);
+        },
+        msgpack::fixstr("Sequence"), [&](auto& destination) {
+          msgpack::pack_integer(destination, *sequence);
+          return Expected<void>{};
+        },
+        msgpack::fixstr("Service"), [&](auto& destination) {
+          return msgpack::pack_string(destination, default_service_);
+        });
+    // clang-format on
+    ++sequence;
+    if (auto* error = result.if_error()) {
+      logger_->log_error(
+          error->with_prefix("Unable to encode APM stats for the Datadog "
+                             "Agent: "));
+      continue;
+    }
+    bodies.push_back(std::move(body));
+  }
+  return bodies;
+}
+
+}  // namespace tracing
+}  // namespace datadog
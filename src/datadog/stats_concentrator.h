@@ -0,0 +1,108 @@
+#pragma once
+
+// This component provides a `class`, `StatsConcentrator`, that computes APM
+// stats (hits, errors, and latency distributions) from finished spans, so that
+// the Datadog Agent need not compute them from every span.
+//
+// The spans considered are those that are "top-level", i.e. whose parent is
+// not in the same trace chunk or belongs to another service, and those marked
+// as measured by the `_dd.measured` numeric tag.  They are aggregated by
+// service, operation name, resource, span type, HTTP status code, and whether
+// the trace is a synthetics test, into buckets of `bucket_duration` according
+// to the time at which each span ended.  Within a group, the durations of
+// successful and of erroneous spans are each summarized by a `DDSketch`.
+//
+// `DatadogAgent` adds each trace chunk that it is sent to its
+// `StatsConcentrator`, and with each flush sends the buckets that have ended
+// to the Datadog Agent's `/v0.6/stats` endpoint.  The encoding of the request
+// body is the MessagePack form of the Agent's `ClientStatsPayload`.
+
+#include <datadog/clock.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "ddsketch.h"
+
+namespace datadog {
+namespace tracing {
+
+class Logger;
+struct SpanData;
+struct TracerSignature;
+
+class StatsConcentrator {
+ public:
+  // The width of the buckets used by the Datadog Agent itself.
+  static constexpr std::chrono::seconds default_bucket_duration{10};
+
+ private:
+  struct GroupKey {
+    std::string service;
+    std::string name;
+    std::string resource;
+    std::string type;
+    std::uint32_t http_status_code;
+    bool synthetics;
+
+    bool operator==(const GroupKey&) const;
+  };
+
+  struct GroupKeyHash {
+    std::size_t operator()(const GroupKey&) const;
+  };
+
+  struct GroupStats {
+    std::uint64_t hits = 0;
+    std::uint64_t top_level_hits = 0;
+    std::uint64_t errors = 0;
+    // The total duration of the spans, in nanoseconds.
+    std::uint64_t duration = 0;
+    DDSketch ok_summary;
+    DDSketch error_summary;
+  };
+
+  using Bucket = std::unordered_map<GroupKey, GroupStats, GroupKeyHash>;
+  // Stats are reported for each combination of environment and version.  The
+  // buckets of each are keyed by their start time, in nanoseconds since the
+  // epoch.
+  using Buckets = std::map<std::uint64_t, Bucket>;
+  using Environment = std::tuple<std::string, std::string>;
+
+  const std::uint64_t bucket_duration_;
+  const std::string runtime_id_;
+  const std::string default_service_;
+  const std::string tracer_version_;
+  const std::shared_ptr<Logger> logger_;
+  std::mutex mutex_;
+  std::map<Environment, Buckets> buckets_;
+  std::uint64_t sequence_ = 0;
+
+ public:
+  StatsConcentrator(const TracerSignature&, const std::shared_ptr<Logger>&,
+                    std::chrono::nanoseconds bucket_duration =
+                        default_bucket_duration);
+
+  // Aggregate the top-level and measured spans among the specified `spans`,
+  // which are a trace chunk.  Mark each top-level span with the
+  // `_dd.top_level` numeric tag, so that the Datadog Agent need not determine
+  // which spans are top-level either.
+  void add(const std::vector<std::unique_ptr<SpanData>>& spans);
+
+  // Remove the buckets that ended at or before the specified `now`, or every
+  // bucket if `force` is true, and return the request bodies that report them,
+  // one for each environment and version.  A body that cannot be encoded is
+  // logged and omitted.
+  std::vector<std::string> flush(std::chrono::system_clock::time_point now,
+                                 bool force);
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -30,25 +30,15 @@ namespace tracing {
 
 namespace {
 
-// Insert into the specified `destination` a tag decoded from the specified
-// `entry`.  Return an `Error` if an error occurs.
-Expected<void> decode_tag(
-    std::vector<std::pair<std::string, std::string>>& destination,
-    StringView entry) {
-  const auto separator = std::find(entry.begin(), entry.end(), '=');
-  if (separator == entry.end()) {
+// Return an `Error` if the specified `entry` is not a "<key>=<value>" pair.
+Expected<void> validate_tag(StringView entry) {
+  if (entry.find('=') == StringView::npos) {
     std::string message;
     message += "invalid key=value pair for encoded tag: missing \"=\" in: ";
     append(message, entry);
     return Error{Error::MALFORMED_TRACE_TAGS, std::move(message)};
   }
 
-  const StringView key = entry.substr(0, separator - entry.cbegin());
-  const StringView value =
-      entry.substr(separator - entry.cbegin() + 1,
-                   separator - entry.cbegin() + entry.size());
-  destination.emplace_back(std::string(key), std::string(value));
-
   return nullopt;
 }
 
@@ -61,17 +51,13 @@ void append_tag(std::string& serialized_tags, StringView tag_key,
 
 }  // namespace
 
-Expected<std::vector<std::pair<std::string, std::string>>> decode_tags(
-    StringView header_value) {
-  std::vector<std::pair<std::string, std::string>> tags;
-  tags.reserve(header_value.size());
-
-  if (header_value.empty()) return tags;
+Expected<void> validate_tags(StringView header_value) {
+  if (header_value.empty()) return nullopt;
 
   std::size_t beg = 0;
   for (std::size_t i = 0; i < header_value.size(); ++i) {
     if (header_value[i] == ',') {
-      auto result = decode_tag(tags, header_value.substr(beg, i - beg));
+      auto result = validate_tag(header_value.substr(beg, i - beg));
       if (auto* error = result.if_error()) {
         std::string prefix;
         prefix += "Error decoding trace tags \"";
@@ -86,7 +72,7 @@ Expected<std::vector<std::pair<std::string, std::string>>> decode_tags(
 
   if (beg != header_value.size()) {
     auto result =
-        decode_tag(tags, header_value.substr(beg, header_value.size() - beg));
+        validate_tag(header_value.substr(beg, header_value.size() - beg));
     if (auto* error = result.if_error()) {
       std::string prefix;
       prefix += "Error decoding trace tags \"";
@@ -96,6 +82,19 @@ Expected<std::vector<std::pair<std::string, std::string>>> decode_tags(
     }
   }
 
+  return nullopt;
+}
+
+Expected<std::vector<std::pair<std::string, std::string>>> decode_tags(
+    StringView header_value) {
+  std::vector<std::pair<std::string, std::string>> tags;
+  auto result = visit_tags(header_value, [&](StringView key, StringView value) {
+    tags.emplace_back(std::string(key), std::string(value));
+  });
+  if (auto* error = result.if_error()) {
+    return std::move(*error);
+  }
+
   return tags;
 }
 
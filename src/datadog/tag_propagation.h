@@ -14,6 +14,8 @@
 #include <datadog/expected.h>
 #include <datadog/string_view.h>
 
+#include <algorithm>
+#include <cstddef>
 #include <string>
 #include <utility>
 #include <vector>
@@ -21,6 +23,17 @@
 namespace datadog {
 namespace tracing {
 
+// Return an `Error` if the specified `header_value` is not a valid encoding of
+// trace tags.  Otherwise, return a non-error.
+Expected<void> validate_tags(StringView header_value);
+
+// Invoke the specified `visitor` with the name and value of each tag encoded
+// in the specified `header_value`, in order.  The names and values refer to
+// the characters of `header_value`; nothing is copied.  If `header_value` is
+// invalid, then return an `Error` without invoking `visitor`.
+template <typename Visitor>
+Expected<void> visit_tags(StringView header_value, Visitor&& visitor);
+
 // Return a name->value mapping of tags parsed from the specified
 // `header_value`, or return an `Error` if an error occurs.
 Expected<std::vector<std::pair<std::string, std::string>>> decode_tags(
@@ -31,5 +44,29 @@ Expected<std::vector<std::pair<std::string, std::string>>> decode_tags(
 std::string encode_tags(
     const std::vector<std::pair<std::string, std::string>>& trace_tags);
 
+template <typename Visitor>
+Expected<void> visit_tags(StringView header_value, Visitor&& visitor) {
+  auto valid = validate_tags(header_value);
+  if (valid.if_error()) {
+    return valid;
+  }
+
+  // Each entry is "<name>=<value>", and entries are separated by commas.  A
+  // trailing comma is allowed.  `validate_tags` guarantees that each entry
+  // contains an equal sign.
+  while (!header_value.empty()) {
+    std::size_t end = header_value.find(',');
+    if (end == StringView::npos) {
+      end = header_value.size();
+    }
+    const StringView entry = header_value.substr(0, end);
+    const std::size_t separator = entry.find('=');
+    visitor(entry.substr(0, separator), entry.substr(separator + 1));
+    header_value.remove_prefix(std::min(end + 1, header_value.size()));
+  }
+
+  return nullopt;
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -1,5 +1,7 @@
 #include "tags.h"
 
+#include <cstdint>
+
 namespace datadog {
 namespace tracing {
 namespace tags {
@@ -10,6 +12,7 @@ const std::string span_type = "span.type";
 const std::string operation_name = "operation";
 const std::string resource_name = "resource.name";
 const std::string version = "version";
+const std::string http_status_code = "http.status_code";
 
 namespace internal {
 
@@ -31,9 +34,29 @@ const std::string language = "language";
 const std::string runtime_id = "runtime-id";
 const std::string sampling_decider = "_dd.is_sampling_decider";
 const std::string w3c_parent_id = "_dd.parent_id";
+const std::string measured = "_dd.measured";
+const std::string top_level = "_dd.top_level";
+const std::string spans_over_limit = "_dd.trace_span_limit.dropped";
 
 }  // namespace internal
 
+void assign_tag_value(std::string& destination, StringView value,
+                      std::size_t limit) {
+  if (limit == 0 || value.size() <= limit) {
+    destination.assign(value.data(), value.size());
+    return;
+  }
+  const StringView marker = "...";
+  std::size_t kept = limit > marker.size() ? limit - marker.size() : limit;
+  while (kept != 0 && (std::uint8_t(value[kept]) & 0xC0) == 0x80) {
+    --kept;
+  }
+  destination.assign(value.data(), kept);
+  if (limit > marker.size()) {
+    append(destination, marker);
+  }
+}
+
 }  // namespace tags
 }  // namespace tracing
 }  // namespace datadog
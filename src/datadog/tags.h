@@ -5,7 +5,9 @@
 
 #include <datadog/string_view.h>
 
+#include <cstddef>
 #include <string>
+#include <utility>
 
 #include "string_util.h"
 
@@ -19,6 +21,7 @@ extern const std::string span_type;
 extern const std::string operation_name;
 extern const std::string resource_name;
 extern const std::string version;
+extern const std::string http_status_code;
 
 namespace internal {
 extern const std::string propagation_error;
@@ -39,6 +42,9 @@ extern const std::string language;
 extern const std::string runtime_id;
 extern const std::string sampling_decider;
 extern const std::string w3c_parent_id;
+extern const std::string measured;
+extern const std::string top_level;
+extern const std::string spans_over_limit;
 }  // namespace internal
 
 // Return whether the specified `tag_name` is reserved for use internal to this
@@ -47,6 +53,46 @@ inline bool is_internal(StringView tag_name) {
   return starts_with(tag_name, "_dd.");
 }
 
+// Return the greatest length of a value of the tag having the specified
+// `name`, or zero if there is no limit.  The limit is the one paired with
+// `name` in the specified `limits`, a range of (name, length) pairs, if any.
+// Otherwise it is the specified `max_length`, unless `name` is internal.  See
+// `TracerConfig::max_tag_value_length`.
+template <typename Limits>
+std::size_t tag_value_limit(StringView name, std::size_t max_length,
+                            const Limits& limits) {
+  for (const auto& [tag_name, limit] : limits) {
+    if (tag_name == name) {
+      return limit;
+    }
+  }
+  return is_internal(name) ? 0 : max_length;
+}
+
+// Assign the specified `value` to the specified `destination`.  If `value` is
+// longer than the specified `limit`, then assign instead as much of it as
+// fits, followed by "...", within `limit` bytes, without splitting a UTF-8
+// sequence.  A `limit` of zero means no limit.  `destination` must not refer
+// to the characters of `value`.
+void assign_tag_value(std::string& destination, StringView value,
+                      std::size_t limit);
+
+// Truncate each value of the specified `tags`, a map from tag names to
+// values, as `assign_tag_value` would with the limit that `tag_value_limit`
+// returns for its name, given the specified `max_length` and `limits`.
+template <typename Tags, typename Limits>
+void truncate_tag_values(Tags& tags, std::size_t max_length,
+                         const Limits& limits) {
+  for (auto& [name, value] : tags) {
+    const std::size_t limit = tag_value_limit(name, max_length, limits);
+    if (limit != 0 && value.size() > limit) {
+      std::string truncated;
+      assign_tag_value(truncated, value, limit);
+      value = std::move(truncated);
+    }
+  }
+}
+
 }  // namespace tags
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,44 @@
+#include "tail_sampling_policy.h"
+
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+TailSamplingPolicy::TailSamplingPolicy(
+    const TraceSamplerConfig::TailPolicy& config)
+    : config_(config) {}
+
+bool TailSamplingPolicy::keeps(
+    const std::vector<std::unique_ptr<SpanData>>& spans) const {
+  if (spans.empty()) {
+    return false;
+  }
+
+  if (config_.min_span_count && spans.size() >= *config_.min_span_count) {
+    return true;
+  }
+
+  const SpanData& root = *spans.front();
+  Optional<std::chrono::milliseconds> threshold = config_.latency_threshold;
+  const auto found = config_.resource_latency_thresholds.find(root.resource);
+  if (found != config_.resource_latency_thresholds.end()) {
+    threshold = found->second;
+  }
+  if (threshold && root.duration >= *threshold) {
+    return true;
+  }
+
+  if (config_.keep_errors) {
+    for (const auto& span : spans) {
+      if (span->error) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,38 @@
+#pragma once
+
+// This component provides a `class`, `TailSamplingPolicy`, that decides
+// whether to keep a finished trace segment that the trace sampler dropped,
+// based on what happened in the segment: whether any span had an error, how
+// long the local root span lasted, and how many spans there were.
+//
+// `TraceSegment` consults the policy when it finishes, after the sampler's
+// decision and before the span sampler.  If the policy keeps the segment, the
+// decision is changed to "user keep" with the "manual" mechanism.  Spans
+// sent earlier by a partial flush, and services to which the trace context
+// was propagated, still have the sampler's decision.
+//
+// The policy is configured by `TraceSamplerConfig::tail_policy`.
+
+#include <datadog/trace_sampler_config.h>
+
+#include <memory>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+class TailSamplingPolicy {
+  TraceSamplerConfig::TailPolicy config_;
+
+ public:
+  explicit TailSamplingPolicy(const TraceSamplerConfig::TailPolicy&);
+
+  // Return whether to keep the trace segment consisting of the specified
+  // `spans`, the first of which is the local root span.
+  bool keeps(const std::vector<std::unique_ptr<SpanData>>& spans) const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -90,6 +90,17 @@ tracing::Expected<FinalizedConfiguration> finalize_config(
       std::chrono::duration_cast<std::chrono::milliseconds>(
           std::chrono::duration<double>(metrics_interval.second));
 
+  // metrics_capture_interval_seconds
+  const double metrics_capture_interval_seconds =
+      user_config.metrics_capture_interval_seconds.value_or(10);
+  if (metrics_capture_interval_seconds <= 0.) {
+    return Error{Error::Code::OUT_OF_RANGE_INTEGER,
+                 "Telemetry metrics capture interval must be a positive value"};
+  }
+  result.metrics_capture_interval =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::duration<double>(metrics_capture_interval_seconds));
+
   // heartbeat_interval_seconds
   auto heartbeat_interval = pick(env_config->heartbeat_interval_seconds,
                                  user_config.heartbeat_interval_seconds, 10);
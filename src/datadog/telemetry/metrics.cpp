@@ -1,32 +1,67 @@
 #include <datadog/telemetry/metrics.h>
 
+#include "json_writer.h"
+
 namespace datadog {
 namespace telemetry {
 
-Metric::Metric(std::string name, std::string type, std::string scope,
+Metric::Metric(std::string name, MetricType type, std::string scope,
                std::vector<std::string> tags, bool common)
     : name_(std::move(name)),
-      type_(std::move(type)),
+      type_(type),
       scope_(std::move(scope)),
       tags_(std::move(tags)),
-      common_(common) {}
-std::string Metric::name() { return name_; }
-std::string Metric::type() { return type_; }
-std::string Metric::scope() { return scope_; }
-std::vector<std::string> Metric::tags() { return tags_; }
-bool Metric::common() { return common_; }
+      common_(common) {
+  tracing::JSONWriter writer{tags_json_};
+  writer.value(tags_);
+}
+const std::string& Metric::name() const { return name_; }
+MetricType Metric::kind() const { return type_; }
+const std::string& Metric::type() const {
+  static const std::string names[] = {"count", "gauge", "distribution"};
+  return names[int(type_)];
+}
+const std::string& Metric::scope() const { return scope_; }
+const std::vector<std::string>& Metric::tags() const { return tags_; }
+const std::string& Metric::tags_json() const { return tags_json_; }
+bool Metric::common() const { return common_; }
 uint64_t Metric::value() { return value_; }
 uint64_t Metric::capture_and_reset_value() { return value_.exchange(0); }
 
 CounterMetric::CounterMetric(std::string name, std::string scope,
                              std::vector<std::string> tags, bool common)
-    : Metric(name, "count", scope, tags, common) {}
+    : Metric(std::move(name), MetricType::COUNT, std::move(scope),
+             std::move(tags), common) {}
 void CounterMetric::inc() { add(1); }
-void CounterMetric::add(uint64_t amount) { value_ += amount; }
+void CounterMetric::add(uint64_t amount) {
+  static std::atomic<std::size_t> next_shard{0};
+  thread_local const std::size_t shard_index = next_shard++ % num_shards;
+  shards_[shard_index].value.fetch_add(amount, std::memory_order_relaxed);
+}
+uint64_t CounterMetric::value() {
+  // `captured_` is loaded first, so that the shards are at least as recent as
+  // the sum that it was set to.
+  const uint64_t captured = captured_.load(std::memory_order_acquire);
+  return total() - captured;
+}
+uint64_t CounterMetric::capture_and_reset_value() {
+  const uint64_t captured = captured_.load(std::memory_order_relaxed);
+  const uint64_t sum = total();
+  captured_.store(sum, std::memory_order_release);
+  return sum - captured;
+}
+uint64_t CounterMetric::total() const {
+  uint64_t sum = 0;
+  for (const Shard& shard : shards_) {
+    sum += shard.value.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
 
 GaugeMetric::GaugeMetric(std::string name, std::string scope,
                          std::vector<std::string> tags, bool common)
-    : Metric(name, "gauge", scope, tags, common) {}
+    : Metric(std::move(name), MetricType::GAUGE, std::move(scope),
+             std::move(tags), common) {}
 void GaugeMetric::set(uint64_t value) { value_ = value; }
 void GaugeMetric::inc() { add(1); }
 void GaugeMetric::add(uint64_t amount) { value_ += amount; }
@@ -39,5 +74,174 @@ void GaugeMetric::sub(uint64_t amount) {
   }
 }
 
+DistributionMetric::DistributionMetric(std::string name, std::string scope,
+                                       std::vector<std::string> tags,
+                                       bool common)
+    : Metric(std::move(name), MetricType::DISTRIBUTION, std::move(scope),
+             std::move(tags), common) {}
+void DistributionMetric::add(uint64_t value) {
+  buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+}
+uint64_t DistributionMetric::value() {
+  uint64_t total = 0;
+  for (const auto& bucket : buckets_) {
+    total += bucket.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+uint64_t DistributionMetric::capture_and_reset_value() {
+  uint64_t total = 0;
+  for (auto& bucket : buckets_) {
+    if (bucket.load(std::memory_order_relaxed) != 0) {
+      total += bucket.exchange(0, std::memory_order_relaxed);
+    }
+  }
+  return total;
+}
+std::vector<DistributionMetric::Bucket>
+DistributionMetric::capture_and_reset_buckets() {
+  std::vector<Bucket> result;
+  for (std::size_t i = 0; i < num_buckets; ++i) {
+    // Most buckets are empty, so check before writing to them.
+    if (buckets_[i].load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    if (const uint64_t count =
+            buckets_[i].exchange(0, std::memory_order_relaxed)) {
+      result.emplace_back(bucket_value(i), count);
+    }
+  }
+  return result;
+}
+
+std::size_t DistributionMetric::bucket_index(uint64_t value) {
+  if (value < 2 * sub_buckets) {
+    return value;
+  }
+  // `exponent` is the index of the highest set bit in `value`, at least 5.
+  // The four bits below it choose among the 16 buckets for that power of two.
+  int exponent = 0;
+  for (int shift = 32; shift != 0; shift /= 2) {
+    if (value >> (exponent + shift)) {
+      exponent += shift;
+    }
+  }
+  const int scale = exponent - 4;
+  return scale * sub_buckets + (value >> scale);
+}
+uint64_t DistributionMetric::bucket_value(std::size_t index) {
+  if (index < 2 * sub_buckets) {
+    return index;
+  }
+  const std::size_t scale = index / sub_buckets - 1;
+  const uint64_t lower = uint64_t(index - scale * sub_buckets) << scale;
+  return lower + (uint64_t(1) << (scale - 1));
+}
+
+namespace {
+
+// Return the FNV-1a hash of the specified `tags`.
+std::uint64_t tags_hash(const std::vector<std::string>& tags) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (const auto& tag : tags) {
+    for (const char c : tag) {
+      hash ^= std::uint64_t((unsigned char)c);
+      hash *= 1099511628211ULL;
+    }
+    // Separate the tags, so that e.g. {"ab", "c"} and {"a", "bc"} differ.
+    hash ^= 0xff;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+struct CounterFamily::Cell {
+  std::uint64_t hash;
+  CounterMetric counter;
+
+  Cell(std::uint64_t hash, const CounterFamily& family,
+       std::vector<std::string> tags)
+      : hash(hash),
+        counter(family.name_, family.scope_, std::move(tags), family.common_) {}
+};
+
+CounterFamily::CounterFamily(std::string name, std::string scope, bool common,
+                             std::size_t max_counters)
+    : name_(std::move(name)),
+      scope_(std::move(scope)),
+      common_(common),
+      max_counters_(max_counters) {
+  std::size_t slots = 2;
+  while (slots < 2 * max_counters_) {
+    slots *= 2;
+  }
+  slot_mask_ = slots - 1;
+  slots_ = std::make_unique<std::atomic<Cell*>[]>(slots);
+  for (std::size_t i = 0; i < slots; ++i) {
+    slots_[i].store(nullptr, std::memory_order_relaxed);
+  }
+  cells_ = std::make_unique<std::unique_ptr<Cell>[]>(max_counters_ + 1);
+}
+
+CounterFamily::~CounterFamily() = default;
+
+CounterFamily::Cell* CounterFamily::find(const std::vector<std::string>& tags,
+                                         std::uint64_t hash,
+                                         std::size_t& slot) const {
+  for (slot = hash & slot_mask_;; slot = (slot + 1) & slot_mask_) {
+    Cell* const cell = slots_[slot].load(std::memory_order_acquire);
+    if (cell == nullptr) {
+      return nullptr;
+    }
+    if (cell->hash == hash && cell->counter.tags() == tags) {
+      return cell;
+    }
+  }
+}
+
+CounterMetric& CounterFamily::counter(const std::vector<std::string>& tags) {
+  const std::uint64_t hash = tags_hash(tags);
+  std::size_t slot;
+  if (Cell* const cell = find(tags, hash, slot)) {
+    return cell->counter;
+  }
+  if (Cell* const overflow = overflow_.load(std::memory_order_acquire)) {
+    return overflow->counter;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Another thread might have created the counter in the meantime.
+  if (Cell* const cell = find(tags, hash, slot)) {
+    return cell->counter;
+  }
+  const std::size_t size = size_.load(std::memory_order_relaxed);
+  if (Cell* const overflow = overflow_.load(std::memory_order_relaxed)) {
+    return overflow->counter;
+  }
+  if (size == max_counters_) {
+    cells_[size] = std::make_unique<Cell>(
+        0, *this, std::vector<std::string>{"overflow:true"});
+    overflow_.store(cells_[size].get(), std::memory_order_release);
+    size_.store(size + 1, std::memory_order_release);
+    return cells_[size]->counter;
+  }
+  cells_[size] = std::make_unique<Cell>(hash, *this, tags);
+  slots_[slot].store(cells_[size].get(), std::memory_order_release);
+  size_.store(size + 1, std::memory_order_release);
+  return cells_[size]->counter;
+}
+
+const std::string& CounterFamily::name() const { return name_; }
+
+std::size_t CounterFamily::size() const {
+  return size_.load(std::memory_order_acquire);
+}
+
+CounterMetric& CounterFamily::at(std::size_t index) const {
+  return cells_[index]->counter;
+}
+
 }  // namespace telemetry
 }  // namespace datadog
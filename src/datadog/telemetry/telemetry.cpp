@@ -12,7 +12,8 @@ namespace telemetry {
 
 Telemetry::Telemetry(FinalizedConfiguration config,
                      std::shared_ptr<tracing::Logger> logger,
-                     std::vector<std::shared_ptr<Metric>> metrics)
+                     std::vector<std::shared_ptr<Metric>> metrics,
+                     std::vector<std::shared_ptr<CounterFamily>> families)
     : config_(std::move(config)), logger_(std::move(logger)) {
   if (!config_.enabled) {
     return;
@@ -23,7 +24,11 @@ Telemetry::Telemetry(FinalizedConfiguration config,
 
   tracer_telemetry_ = std::make_shared<tracing::TracerTelemetry>(
       config_.enabled, tracing::default_clock, logger_, tracer_signature,
-      config_.integration_name, config_.integration_version, metrics);
+      config_.integration_name, config_.integration_version, metrics,
+      nullptr, 0, std::move(families),
+      tracing::TelemetryCadence{config_.metrics_capture_interval,
+                                config_.metrics_interval,
+                                config_.report_metrics});
 
   tracing::DatadogAgentConfig dd_config;
   dd_config.remote_configuration_enabled = false;
@@ -0,0 +1,17 @@
+#include <datadog/thread_factory.h>
+
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+
+std::thread start_thread(const ThreadFactory& factory, StringView name,
+                         std::function<void()> body) {
+  if (factory) {
+    return factory(name, std::move(body));
+  }
+  return std::thread(std::move(body));
+}
+
+}  // namespace tracing
+}  // namespace datadog
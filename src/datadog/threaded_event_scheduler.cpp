@@ -1,114 +1,272 @@
 #include "threaded_event_scheduler.h"
 
+#include <algorithm>
+#include <memory>
 #include <thread>
+#include <utility>
 
 #include "json.hpp"
 
 namespace datadog {
 namespace tracing {
 
-ThreadedEventScheduler::EventConfig::EventConfig(
-    std::function<void()> callback,
-    std::chrono::steady_clock::duration interval)
-    : callback(callback), interval(interval), cancelled(false) {}
+ThreadedEventScheduler::Event::Event(std::function<void()> callback,
+                                     Clock::duration interval,
+                                     Clock::time_point when, bool recurring)
+    : callback(std::move(callback)),
+      interval(interval),
+      when(when),
+      recurring(recurring) {}
 
-bool ThreadedEventScheduler::GreaterThan::operator()(
-    const ScheduledRun& left, const ScheduledRun& right) const {
-  return left.when > right.when;
-}
-
-ThreadedEventScheduler::ThreadedEventScheduler()
-    : running_current_(false),
-      shutting_down_(false),
-      dispatcher_([this]() { run(); }) {}
+ThreadedEventScheduler::ThreadedEventScheduler(std::size_t max_workers,
+                                               ThreadFactory thread_factory)
+    : origin_(Clock::now()),
+      max_workers_(max_workers),
+      thread_factory_(std::move(thread_factory)),
+      idle_workers_(0),
+      wake_tick_(0),
+      shutting_down_(false) {}
 
 ThreadedEventScheduler::~ThreadedEventScheduler() {
   {
     std::lock_guard guard(mutex_);
     shutting_down_ = true;
     schedule_or_shutdown_.notify_one();
+    ready_or_shutdown_.notify_all();
+  }
+  if (dispatcher_.joinable()) {
+    dispatcher_.join();
+  }
+  // The dispatching thread starts workers, so once it has stopped, no more
+  // are started.
+  for (std::thread& worker : workers_) {
+    worker.join();
   }
-  dispatcher_.join();
 }
 
-EventScheduler::Cancel ThreadedEventScheduler::schedule_recurring_event(
+std::uint64_t ThreadedEventScheduler::ticks_until(
+    Clock::time_point time) const {
+  if (time <= origin_) {
+    return 0;
+  }
+  return std::chrono::ceil<Tick>(time - origin_).count();
+}
+
+std::uint64_t ThreadedEventScheduler::coalesce(std::uint64_t deadline,
+                                               std::uint64_t slack) {
+  if (slack == 0 || deadline == 0) {
+    return deadline;
+  }
+  // The highest bit in which `deadline - 1` and `last` differ is the largest
+  // power of two of which some tick in `[deadline, last]` is a multiple, and
+  // `last` with the lower bits cleared is the latest such tick.
+  const std::uint64_t last = deadline + slack;
+  std::uint64_t differing = (deadline - 1) ^ last;
+  std::uint64_t power = 1;
+  while (differing >>= 1) {
+    power <<= 1;
+  }
+  return last & ~(power - 1);
+}
+
+void ThreadedEventScheduler::schedule(Event& event,
+                                      std::uint64_t min_deadline) {
+  std::uint64_t deadline = std::max(ticks_until(event.when), min_deadline);
+  if (event.recurring) {
+    constexpr std::uint64_t max_slack = 1000;
+    deadline = coalesce(
+        deadline,
+        std::min<std::uint64_t>(
+            std::chrono::duration_cast<Tick>(event.interval).count() / 16,
+            max_slack));
+  }
+  wheel_.insert(event, deadline);
+  if (!dispatcher_.joinable()) {
+    dispatcher_ =
+        start_thread(thread_factory_, "dd-scheduler", [this]() { run(); });
+  } else if (event.deadline() < wake_tick_) {
+    wake_tick_ = event.deadline();
+    schedule_or_shutdown_.notify_one();
+  }
+}
+
+std::shared_ptr<ThreadedEventScheduler::Handle>
+ThreadedEventScheduler::add_recurring_event(
     std::chrono::steady_clock::duration interval,
     std::function<void()> callback) {
-  const auto now = std::chrono::steady_clock::now();
-  auto config = std::make_shared<EventConfig>(std::move(callback), interval);
+  const auto now = Clock::now();
+  auto handle = std::make_shared<Handle>();
 
-  {
-    std::lock_guard<std::mutex> guard(mutex_);
-    upcoming_.push(ScheduledRun{now + interval, config});
-    schedule_or_shutdown_.notify_one();
+  std::lock_guard<std::mutex> guard(mutex_);
+  Event& event = events_.emplace_back(std::move(callback), interval,
+                                      now + interval, /*recurring=*/true);
+  event.position = std::prev(events_.end());
+  event.handle = handle;
+  handle->event = &event;
+  schedule(event, 0);
+  return handle;
+}
+
+std::future<void> ThreadedEventScheduler::cancel(Handle& handle) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  std::promise<void> done;
+  auto result = done.get_future();
+  Event* const event = handle.event;
+  if (event != nullptr && event->running) {
+    // The event is not in `wheel_` while it runs.  `run_event` erases it once
+    // its callback returns.
+    event->cancelled = true;
+    event->cancel_waiters.push_back(std::move(done));
+    return result;
   }
 
-  // Return a cancellation function.
-  return [this, config = std::move(config)]() mutable {
-    if (!config) {
-      return;
+  if (event != nullptr) {
+    if (event->queued) {
+      ready_.erase(std::find(ready_.begin(), ready_.end(), event));
+    } else {
+      wheel_.remove(*event);
     }
+    erase(*event);
+  }
+  done.set_value();
+  return result;
+}
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    config->cancelled = true;
-    current_done_.wait(lock, [this, &config]() {
-      return !running_current_ || current_.config != config;
-    });
-    config.reset();
-  };
+void ThreadedEventScheduler::erase(Event& event) {
+  if (event.handle) {
+    event.handle->event = nullptr;
+  }
+  events_.erase(event.position);
 }
 
-std::string ThreadedEventScheduler::config() const {
-  return nlohmann::json::object(
-             {{"type", "datadog::tracing::ThreadedEventScheduler"}})
-      .dump();
+EventScheduler::Cancel ThreadedEventScheduler::schedule_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  // Copies of the cancellation function share `handle`, so that the event is
+  // erased at most once.
+  auto handle = add_recurring_event(interval, std::move(callback));
+  return [this, handle = std::move(handle)]() { cancel(*handle).wait(); };
 }
 
-void ThreadedEventScheduler::run() {
-  std::unique_lock<std::mutex> lock(mutex_);
+EventScheduler::AsyncCancel
+ThreadedEventScheduler::schedule_recurring_event_async_cancel(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  auto handle = add_recurring_event(interval, std::move(callback));
+  return [this, handle = std::move(handle)]() { return cancel(*handle); };
+}
 
-  for (;;) {
-    schedule_or_shutdown_.wait(
-        lock, [this]() { return shutting_down_ || !upcoming_.empty(); });
-    if (shutting_down_) {
-      return;
-    }
+bool ThreadedEventScheduler::schedule_event(std::function<void()> callback) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (shutting_down_) {
+    return false;
+  }
+  // The event is due at `origin_`, so that it runs as soon as the dispatching
+  // thread gets to it, even if that thread is behind the clock.
+  Event& event = events_.emplace_back(std::move(callback),
+                                      Clock::duration::zero(), origin_,
+                                      /*recurring=*/false);
+  event.position = std::prev(events_.end());
+  schedule(event, 0);
+  return true;
+}
 
-    current_ = upcoming_.top();
+std::string ThreadedEventScheduler::config() const {
+  auto result = nlohmann::json::object(
+      {{"type", "datadog::tracing::ThreadedEventScheduler"}});
+  if (max_workers_ != 0) {
+    result["config"] = nlohmann::json::object({{"max_workers", max_workers_}});
+  }
+  return result.dump();
+}
+
+void ThreadedEventScheduler::run_event(Event& event,
+                                       std::unique_lock<std::mutex>& lock) {
+  event.running = true;
+  lock.unlock();
+  event.callback();
+  lock.lock();
+  event.running = false;
 
-    if (current_.config->cancelled) {
-      upcoming_.pop();
-      continue;
+  if (event.cancelled) {
+    for (auto& waiter : event.cancel_waiters) {
+      waiter.set_value();
     }
+    erase(event);
+  } else if (!event.recurring) {
+    erase(event);
+  } else {
+    // If the event is behind schedule, then it runs again at the next tick,
+    // but not within this one.
+    event.when += event.interval;
+    schedule(event, wheel_.now() + 1);
+  }
+}
 
-    const bool changed =
-        schedule_or_shutdown_.wait_until(lock, current_.when, [this]() {
-          return shutting_down_ || upcoming_.top().config != current_.config;
-        });
+void ThreadedEventScheduler::dispatch(Event& event,
+                                      std::unique_lock<std::mutex>& lock) {
+  if (max_workers_ == 0) {
+    run_event(event, lock);
+    return;
+  }
+  event.queued = true;
+  ready_.push_back(&event);
+  if (ready_.size() > idle_workers_ && workers_.size() < max_workers_) {
+    workers_.push_back(start_thread(thread_factory_, "dd-scheduler-worker",
+                                    [this]() { run_worker(); }));
+  } else {
+    ready_or_shutdown_.notify_one();
+  }
+}
 
+void ThreadedEventScheduler::run_worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    ++idle_workers_;
+    ready_or_shutdown_.wait(
+        lock, [this]() { return shutting_down_ || !ready_.empty(); });
+    --idle_workers_;
     if (shutting_down_) {
-      return;
+      break;
     }
+    Event& event = *ready_.front();
+    ready_.pop_front();
+    event.queued = false;
+    run_event(event, lock);
+  }
+}
 
-    if (changed) {
-      // A more recent event has been scheduled.
-      continue;
-    }
+void ThreadedEventScheduler::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
 
-    // We waited for `current_` and now it's its turn.
-    upcoming_.pop();
-    if (current_.config->cancelled) {
-      continue;
+  while (!shutting_down_) {
+    // Run, or hand to the workers, every event that is due by now.
+    const std::uint64_t current =
+        std::chrono::duration_cast<Tick>(Clock::now() - origin_).count();
+    while (!shutting_down_) {
+      TimerWheel::Node* node = wheel_.pop_expired(current);
+      if (node == nullptr) {
+        break;
+      }
+      dispatch(static_cast<Event&>(*node), lock);
+    }
+    if (shutting_down_) {
+      break;
     }
 
-    upcoming_.push(ScheduledRun{current_.when + current_.config->interval,
-                                current_.config});
-    running_current_ = true;
-    lock.unlock();
-    current_.config->callback();
-    lock.lock();
-    running_current_ = false;
-    current_done_.notify_all();
+    // Sleep until the next event is due, an earlier event is scheduled, or
+    // we're shutting down.
+    const std::uint64_t wake_tick = wheel_.next_tick();
+    wake_tick_ = wake_tick;
+    const auto woken = [this, wake_tick]() {
+      return shutting_down_ || wake_tick_ != wake_tick;
+    };
+    if (wake_tick == TimerWheel::never) {
+      schedule_or_shutdown_.wait(lock, woken);
+    } else {
+      schedule_or_shutdown_.wait_until(lock, origin_ + Tick(wake_tick), woken);
+    }
+    wake_tick_ = 0;
   }
 }
 
@@ -4,59 +4,162 @@
 // the `EventScheduler` interface in terms of a dedicated event dispatching
 // thread. It is the default implementation used if
 // `DatadogAgent::event_scheduler` is not specified.
+//
+// Upcoming events are kept in a `TimerWheel` (see `timer_wheel.h`) having a
+// tick of one millisecond, so scheduling and cancelling an event take constant
+// time however many events there are.  The dispatching thread sleeps until the
+// next tick at which an event is due, and then runs every event due by then,
+// so events due within the same millisecond share one wake-up.
+//
+// Recurring events are also coalesced: each invocation of a recurring event
+// may be delayed by up to a sixteenth of its interval, at most one second, to
+// a tick that is a multiple of the largest possible power of two.  Events
+// whose invocations fall near each other, such as those of `DatadogAgent`,
+// thereby tend to be due at the same tick, and share a wake-up.  The delay
+// does not accumulate, because each invocation is scheduled relative to when
+// the previous one was due rather than to when it ran.
+//
+// The dispatching thread is started when the first event is scheduled, so
+// that a scheduler that is never used costs no thread.
+//
+// By default, callbacks run on the dispatching thread, one at a time, so a
+// slow callback, such as a large `DatadogAgent` flush, delays every event
+// due while it runs.  A scheduler constructed with `max_workers` greater than
+// zero instead hands each due event to a pool of worker threads, and the
+// dispatching thread only keeps time.  Workers are started as needed, when an
+// event is due and every worker is busy, up to `max_workers`.  Either way, an
+// invocation of a recurring event does not begin until the previous one has
+// returned.
 
 #include <datadog/event_scheduler.h>
+#include <datadog/thread_factory.h>
 
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
+#include <list>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
 
+#include "timer_wheel.h"
+
 namespace datadog {
 namespace tracing {
 
 class ThreadedEventScheduler : public EventScheduler {
-  struct EventConfig {
-    std::function<void()> callback;
-    std::chrono::steady_clock::duration interval;
-    bool cancelled;
+  using Clock = std::chrono::steady_clock;
+  using Tick = std::chrono::milliseconds;
 
-    EventConfig(std::function<void()> callback,
-                std::chrono::steady_clock::duration interval);
-  };
+  struct Event;
 
-  struct ScheduledRun {
-    std::chrono::steady_clock::time_point when;
-    std::shared_ptr<const EventConfig> config;
+  // A `Handle` is shared by a recurring event and the functions that cancel
+  // it.  `event` is null once the event has been erased.
+  struct Handle {
+    Event* event = nullptr;
   };
 
-  struct GreaterThan {
-    bool operator()(const ScheduledRun&, const ScheduledRun&) const;
+  struct Event : public TimerWheel::Node {
+    std::function<void()> callback;
+    Clock::duration interval;
+    // When the event is next due.
+    Clock::time_point when;
+    // Whether the event is run again after each `interval`, as opposed to
+    // only once.
+    bool recurring;
+    bool cancelled = false;
+    // Whether the event is in `ready_`, awaiting a worker.
+    bool queued = false;
+    // Whether the event's callback is running.
+    bool running = false;
+    // Promises to fulfill once the callback, which was running when the event
+    // was cancelled, returns.
+    std::vector<std::promise<void>> cancel_waiters;
+    // This event's position in `events_`.
+    std::list<Event>::iterator position;
+    // Null for a one-off event.
+    std::shared_ptr<Handle> handle;
+
+    Event(std::function<void()> callback, Clock::duration interval,
+          Clock::time_point when, bool recurring);
   };
 
   std::mutex mutex_;
-  ScheduledRun current_;
+  // Ticks are counted from `origin_`.
+  const Clock::time_point origin_;
+  TimerWheel wheel_;
+  // `events_` owns every event that has been scheduled and has neither run
+  // (if it's a one-off) nor been cancelled.
+  std::list<Event> events_;
+  // Events that are due, in the order in which they became due, awaiting a
+  // worker.  Empty unless `max_workers_` is greater than zero.
+  std::deque<Event*> ready_;
+  const std::size_t max_workers_;
+  const ThreadFactory thread_factory_;
+  std::vector<std::thread> workers_;
+  // The number of workers waiting for an event.
+  std::size_t idle_workers_;
+  std::condition_variable ready_or_shutdown_;
+  // The tick until which the dispatching thread is sleeping, or zero if it is
+  // not sleeping.
+  std::uint64_t wake_tick_;
   std::condition_variable schedule_or_shutdown_;
-  bool running_current_;
-  std::condition_variable current_done_;
-  std::priority_queue<ScheduledRun, std::vector<ScheduledRun>, GreaterThan>
-      upcoming_;
   bool shutting_down_;
+  // Not joinable until the first event is scheduled.
   std::thread dispatcher_;
 
+  // Return the number of whole ticks from `origin_` until the specified
+  // `time`, rounded up.
+  std::uint64_t ticks_until(Clock::time_point time) const;
+  // Return the tick, within the specified `slack` ticks after the specified
+  // `deadline`, that is a multiple of the largest power of two.
+  static std::uint64_t coalesce(std::uint64_t deadline, std::uint64_t slack);
+  // Add the specified `event` to `wheel_`, to expire no earlier than the
+  // specified `min_deadline`, and start the dispatching thread if it has not
+  // started, or wake it if it would otherwise sleep past the event.
+  void schedule(Event& event, std::uint64_t min_deadline);
+  // Add a recurring event to `events_` and `wheel_`, and return its handle.
+  std::shared_ptr<Handle> add_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback);
+  // Prevent subsequent invocations of the event having the specified
+  // `handle`, and return a future that is ready once its callback is not
+  // running.
+  std::future<void> cancel(Handle& handle);
+  // Remove the specified `event` from `events_`, which destroys it.
+  void erase(Event& event);
+  // Run the specified `event`, and then reschedule or erase it.  `lock` is
+  // unlocked while the event's callback runs.
+  void run_event(Event& event, std::unique_lock<std::mutex>& lock);
+  // Run the specified `event` on the calling thread if there are no workers,
+  // or otherwise queue it for a worker, starting one if every worker is busy.
+  void dispatch(Event& event, std::unique_lock<std::mutex>& lock);
   void run();
+  void run_worker();
 
  public:
-  ThreadedEventScheduler();
+  // Create a scheduler that runs callbacks on at most the specified
+  // `max_workers` worker threads, or on its dispatching thread if
+  // `max_workers` is zero.  Start threads using the specified
+  // `thread_factory`, if it is not null.
+  explicit ThreadedEventScheduler(std::size_t max_workers = 0,
+                                  ThreadFactory thread_factory = nullptr);
   ~ThreadedEventScheduler();
 
   Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
                                   std::function<void()> callback) override;
 
+  AsyncCancel schedule_recurring_event_async_cancel(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override;
+
+  bool schedule_event(std::function<void()> callback) override;
+
   std::string config() const override;
 };
 
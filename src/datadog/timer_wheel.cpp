@@ -0,0 +1,168 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr std::uint64_t slot_mask = TimerWheel::slots_per_level - 1;
+
+// Return the index of the lowest set bit in the specified `bits`, which must
+// not be zero.
+int lowest_set_bit(std::uint64_t bits) {
+  assert(bits != 0);
+  int index = 0;
+  for (int width = 32; width != 0; width /= 2) {
+    const std::uint64_t low = (std::uint64_t(1) << width) - 1;
+    if ((bits & low) == 0) {
+      bits >>= width;
+      index += width;
+    }
+  }
+  return index;
+}
+
+std::uint64_t rotate_right(std::uint64_t bits, int shift) {
+  return shift == 0 ? bits : (bits >> shift) | (bits << (64 - shift));
+}
+
+}  // namespace
+
+TimerWheel::TimerWheel(std::uint64_t now) : now_(now) {}
+
+void TimerWheel::insert(Node& node, std::uint64_t deadline) {
+  assert(!node.linked());
+  node.deadline_ = std::max(deadline, now_);
+  link(node);
+}
+
+void TimerWheel::remove(Node& node) {
+  if (node.linked()) {
+    unlink(node);
+  }
+}
+
+std::uint64_t TimerWheel::next_tick() const {
+  std::uint64_t result = never;
+  for (int level = 0; level < num_levels; ++level) {
+    if (occupied_[level] == 0) {
+      continue;
+    }
+    const int shift = bits_per_level * level;
+    const std::uint64_t position = now_ >> shift;
+    const int digit = int(position & slot_mask);
+    // A slot is cascaded at the start of its span.  If `now_` is already past
+    // the start of the current slot's span, then the current slot is next due
+    // when the level comes around again.
+    const bool at_start = (now_ & ((std::uint64_t(1) << shift) - 1)) == 0;
+    const int start = at_start ? digit : digit + 1;
+    const int offset = lowest_set_bit(
+        rotate_right(occupied_[level], start & int(slot_mask)));
+    const std::uint64_t tick = (position + (start - digit) + offset) << shift;
+    result = std::min(result, tick);
+  }
+  return result;
+}
+
+TimerWheel::Node* TimerWheel::pop_expired(std::uint64_t current) {
+  while (now_ <= current) {
+    const std::size_t index = now_ & slot_mask;
+    if (index == 0) {
+      cascade(now_);
+    }
+    if (Node* node = slots_[0][index]) {
+      unlink(*node);
+      return node;
+    }
+    // Skip the ticks that have nothing to do: up to the next occupied slot of
+    // the lowest level, or to the start of the next span, when there might be
+    // timers to cascade.
+    std::uint64_t next = (now_ | slot_mask) + 1;
+    if (index != slot_mask) {
+      const std::uint64_t later =
+          occupied_[0] & (~std::uint64_t(0) << (index + 1));
+      if (later != 0) {
+        next = (now_ & ~slot_mask) + lowest_set_bit(later);
+      }
+    }
+    now_ = std::min(next, current + 1);
+  }
+  return nullptr;
+}
+
+void TimerWheel::link(Node& node) {
+  const std::uint64_t delta = node.deadline_ - now_;
+  int level = 0;
+  while (level < num_levels - 1 &&
+         delta >= (std::uint64_t(1) << (bits_per_level * (level + 1)))) {
+    ++level;
+  }
+  std::uint64_t target = node.deadline_;
+  const std::uint64_t span = std::uint64_t(1) << (bits_per_level * num_levels);
+  if (delta >= span) {
+    // Park the node in the last slot of the highest level.  It is placed
+    // again when that slot is cascaded.
+    target = now_ + span - 1;
+  }
+  const int slot = int((target >> (bits_per_level * level)) & slot_mask);
+
+  node.level_ = level;
+  node.slot_ = slot;
+  // Each slot is a circular list.  Append the node, so that nodes having the
+  // same deadline are popped in the order they were inserted.
+  Node*& head = slots_[level][slot];
+  if (head == nullptr) {
+    node.prev_ = node.next_ = &node;
+    head = &node;
+    occupied_[level] |= std::uint64_t(1) << slot;
+  } else {
+    node.next_ = head;
+    node.prev_ = head->prev_;
+    head->prev_->next_ = &node;
+    head->prev_ = &node;
+  }
+}
+
+void TimerWheel::unlink(Node& node) {
+  Node*& head = slots_[node.level_][node.slot_];
+  if (node.next_ == &node) {
+    head = nullptr;
+    occupied_[node.level_] &= ~(std::uint64_t(1) << node.slot_);
+  } else {
+    node.prev_->next_ = node.next_;
+    node.next_->prev_ = node.prev_;
+    if (head == &node) {
+      head = node.next_;
+    }
+  }
+  node.prev_ = node.next_ = nullptr;
+  node.level_ = -1;
+}
+
+void TimerWheel::cascade(std::uint64_t tick) {
+  for (int level = 1; level < num_levels; ++level) {
+    const int slot = int((tick >> (bits_per_level * level)) & slot_mask);
+    Node* head = slots_[level][slot];
+    if (head != nullptr) {
+      slots_[level][slot] = nullptr;
+      occupied_[level] &= ~(std::uint64_t(1) << slot);
+      // Break the circle, and place each node again.
+      head->prev_->next_ = nullptr;
+      for (Node* node = head; node != nullptr;) {
+        Node* const next = node->next_;
+        node->level_ = -1;
+        link(*node);
+        node = next;
+      }
+    }
+    if (slot != 0) {
+      // The higher levels come due only when this level wraps around.
+      break;
+    }
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,101 @@
+#pragma once
+
+// This component provides a class, `TimerWheel`, that orders timers by their
+// deadlines, measured in ticks.  `ThreadedEventScheduler` uses a `TimerWheel`
+// to decide which event to run next.  See `threaded_event_scheduler.h`.
+//
+// `TimerWheel` is a hierarchical timing wheel.  Each of its `num_levels`
+// levels is a ring of `slots_per_level` slots, and each slot is a list of
+// timers.  A slot in the lowest level covers one tick, a slot in the next level
+// covers `slots_per_level` ticks, and so on.  A timer is linked into the lowest
+// level whose span reaches its deadline.  As time advances, the timers in a
+// slot of a higher level are moved ("cascaded") down into the lower levels
+// once the lower levels come around to their span.  A timer whose deadline is
+// beyond the span of the highest level is parked in the highest level and
+// moved again when that slot is cascaded.
+//
+// Inserting and removing a timer are constant time.  Each level keeps a bit per
+// slot that indicates whether the slot is occupied, so the next tick at which
+// there is something to do can be found without visiting the ticks in between.
+//
+// Timers are intrusive: a timer is a `TimerWheel::Node`, typically a base class
+// of the caller's own type.  `TimerWheel` does not own its nodes, and is not
+// thread-safe.
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace datadog {
+namespace tracing {
+
+class TimerWheel {
+ public:
+  static constexpr int bits_per_level = 6;
+  static constexpr std::size_t slots_per_level = 1 << bits_per_level;
+  static constexpr int num_levels = 4;
+  // `never` is returned by `next_tick` when there are no timers.
+  static constexpr std::uint64_t never =
+      std::numeric_limits<std::uint64_t>::max();
+
+  class Node {
+    friend class TimerWheel;
+
+    std::uint64_t deadline_ = 0;
+    Node* prev_ = nullptr;
+    Node* next_ = nullptr;
+    // The level and slot that contain this node, or -1 if this node is not
+    // in a `TimerWheel`.
+    int level_ = -1;
+    int slot_ = 0;
+
+   public:
+    std::uint64_t deadline() const { return deadline_; }
+    bool linked() const { return level_ != -1; }
+  };
+
+  explicit TimerWheel(std::uint64_t now = 0);
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Return the next tick to be processed by `pop_expired`.  Timers having
+  // earlier deadlines have already been popped.
+  std::uint64_t now() const { return now_; }
+
+  // Link the specified `node` into this wheel, to expire at the specified
+  // `deadline`.  A `deadline` earlier than `now()` is treated as `now()`.  The
+  // behavior is undefined if `node` is already linked.
+  void insert(Node& node, std::uint64_t deadline);
+
+  // Unlink the specified `node` from this wheel, if it is linked.
+  void remove(Node& node);
+
+  // Return the earliest tick at which `pop_expired` might return a node or
+  // cascade timers from a higher level, or return `never` if there are no
+  // timers.
+  std::uint64_t next_tick() const;
+
+  // Advance `now()` toward the specified `current` tick, and return an
+  // unlinked node whose deadline is at or before `current`, or return null if
+  // there is no such node.  When null is returned, `now()` is `current + 1`.
+  // Timers inserted between calls with a deadline at or before `current` are
+  // returned by later calls.
+  Node* pop_expired(std::uint64_t current);
+
+ private:
+  void link(Node& node);
+  void unlink(Node& node);
+  // Move the timers of each higher level slot that comes due at the specified
+  // `tick` down into the lower levels.  `tick` is a multiple of
+  // `slots_per_level`.
+  void cascade(std::uint64_t tick);
+
+  std::uint64_t now_;
+  Node* slots_[num_levels][slots_per_level] = {};
+  // Bit `i` of `occupied_[level]` is set if `slots_[level][i]` is not empty.
+  std::uint64_t occupied_[num_levels] = {};
+};
+
+}  // namespace tracing
+}  // namespace datadog
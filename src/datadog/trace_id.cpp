@@ -15,14 +15,9 @@ TraceID::TraceID(std::uint64_t low, std::uint64_t high)
     : low(low), high(high) {}
 
 std::string TraceID::hex_padded() const {
-  std::string result;
-  if (high) {
-    result += ::datadog::tracing::hex_padded(high);
-  } else {
-    result.append(16, '0');
-  }
-  result += ::datadog::tracing::hex_padded(low);
-  return result;
+  char buffer[32];
+  write_hex_padded(write_hex_padded(buffer, high), low);
+  return std::string(buffer, sizeof buffer);
 }
 
 Expected<TraceID> TraceID::parse_hex(StringView input) {
@@ -6,7 +6,9 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <iterator>
 #include <limits>
+#include <string>
 
 #include "collector_response.h"
 #include "json_serializer.h"
@@ -20,6 +22,9 @@ namespace {
 nlohmann::json to_json(const TraceSamplerRule& rule) {
   nlohmann::json j = rule.matcher;
   j["sample_rate"] = rule.rate.value();
+  if (rule.max_per_second) {
+    j["max_per_second"] = *rule.max_per_second;
+  }
   return j;
 }
 
@@ -27,13 +32,64 @@ nlohmann::json to_json(const TraceSamplerRule& rule) {
 
 TraceSampler::TraceSampler(const FinalizedTraceSamplerConfig& config,
                            const Clock& clock)
-    : rules_(config.rules),
+    : rules_(std::make_shared<const RuleSet>(config.rules, clock)),
+      collector_rates_(std::make_shared<const CollectorRates>()),
+      collector_response_hash_(0),
+      clock_(clock),
       limiter_(clock, config.max_per_second),
-      limiter_max_per_second_(config.max_per_second) {}
+      limiter_max_per_second_(config.max_per_second),
+      adaptive_(config.adaptive_target_per_second
+                    ? std::make_unique<AdaptiveSampler>(
+                          clock, *config.adaptive_target_per_second)
+                    : nullptr) {}
+
+TraceSampler::Rule::Rule(TraceSamplerRule rule, const Clock& clock)
+    : config(std::move(rule)),
+      matcher(config.matcher),
+      limiter(config.max_per_second
+                  ? std::make_unique<Limiter>(clock, *config.max_per_second)
+                  : nullptr) {}
+
+namespace {
+
+template <typename Rule>
+std::vector<Rule> make_rules(std::vector<TraceSamplerRule> configs,
+                             const Clock& clock) {
+  std::vector<Rule> rules;
+  rules.reserve(configs.size());
+  for (auto& config : configs) {
+    rules.emplace_back(std::move(config), clock);
+  }
+  return rules;
+}
+
+}  // namespace
+
+TraceSampler::RuleSet::RuleSet(std::vector<TraceSamplerRule> configs,
+                               const Clock& clock)
+    : rules(make_rules<Rule>(std::move(configs), clock)),
+      index(rules, [](const Rule& rule) -> const CompiledSpanMatcher& {
+        return rule.matcher;
+      }) {}
 
 void TraceSampler::set_rules(std::vector<TraceSamplerRule> rules) {
-  std::lock_guard lock(mutex_);
-  rules_ = std::move(rules);
+  std::atomic_store(&rules_,
+                    std::make_shared<const RuleSet>(std::move(rules), clock_));
+}
+
+const Rate* TraceSampler::CollectorRates::find(StringView service,
+                                               StringView environment) const {
+  const auto found =
+      rate_by_key.find(CollectorResponse::key_hash(service, environment));
+  if (found == rate_by_key.end()) {
+    return nullptr;
+  }
+  for (const auto& [key, rate] : found->second) {
+    if (CollectorResponse::key_equals(key, service, environment)) {
+      return &rate;
+    }
+  }
+  return nullptr;
 }
 
 SamplingDecision TraceSampler::decide(const SpanData& span) {
@@ -41,22 +97,23 @@ SamplingDecision TraceSampler::decide(const SpanData& span) {
   decision.origin = SamplingDecision::Origin::LOCAL;
 
   // First check sampling rules.
-  const auto found_rule =
-      std::find_if(rules_.cbegin(), rules_.cend(),
-                   [&](const auto& it) { return it.matcher.match(span); });
-
-  // `mutex_` protects `limiter_`, `collector_sample_rates_`, and
-  // `collector_default_sample_rate_`, so let's lock it here.
-  std::lock_guard lock(mutex_);
-
-  if (found_rule != rules_.end()) {
-    const auto& rule = *found_rule;
+  const auto rule_set = std::atomic_load(&rules_);
+  const auto& rules = rule_set->rules;
+  const auto found_rule = rule_set->index.find_first(
+      span, [&](std::size_t i) { return rules[i].matcher.match(span); });
+
+  if (found_rule != rules.size()) {
+    const auto& rule = rules[found_rule].config;
+    // A rule having its own limit is limited by its own limiter.
+    Limiter& limiter =
+        rules[found_rule].limiter ? *rules[found_rule].limiter : limiter_;
     decision.mechanism = int(rule.mechanism);
-    decision.limiter_max_per_second = limiter_max_per_second_;
+    decision.limiter_max_per_second =
+        rule.max_per_second.value_or(limiter_max_per_second_);
     decision.configured_rate = rule.rate;
     const std::uint64_t threshold = max_id_from_rate(rule.rate);
     if (knuth_hash(span.trace_id.low) < threshold) {
-      const auto result = limiter_.allow();
+      const auto result = limiter.allow();
       if (result.allowed) {
         decision.priority = int(SamplingPriority::USER_KEEP);
       } else {
@@ -70,16 +127,31 @@ SamplingDecision TraceSampler::decide(const SpanData& span) {
     return decision;
   }
 
-  // No sampling rule matched.  Find the appropriate collector-controlled
-  // sample rate.
-  auto found_rate = collector_sample_rates_.find(
-      CollectorResponse::key(span.service, span.environment().value_or("")));
-  if (found_rate != collector_sample_rates_.end()) {
-    decision.configured_rate = found_rate->second;
+  // No sampling rule matched.  If adaptive sampling is configured, then it
+  // chooses the sample rate.
+  if (adaptive_) {
+    decision.mechanism = int(SamplingMechanism::REMOTE_ADAPTIVE_RULE);
+    decision.configured_rate = adaptive_->rate(span);
+    const std::uint64_t threshold =
+        max_id_from_rate(*decision.configured_rate);
+    if (knuth_hash(span.trace_id.low) < threshold) {
+      decision.priority = int(SamplingPriority::USER_KEEP);
+    } else {
+      decision.priority = int(SamplingPriority::USER_DROP);
+    }
+    return decision;
+  }
+
+  // Find the appropriate collector-controlled sample rate.
+  const auto rates = std::atomic_load(&collector_rates_);
+  const Rate* const found_rate =
+      rates->find(span.service, span.environment().value_or(""));
+  if (found_rate) {
+    decision.configured_rate = *found_rate;
     decision.mechanism = int(SamplingMechanism::AGENT_RATE);
   } else {
-    if (collector_default_sample_rate_) {
-      decision.configured_rate = *collector_default_sample_rate_;
+    if (rates->default_rate) {
+      decision.configured_rate = *rates->default_rate;
       decision.mechanism = int(SamplingMechanism::AGENT_RATE);
     } else {
       // We have yet to receive a default rate from the collector.  This
@@ -101,27 +173,50 @@ SamplingDecision TraceSampler::decide(const SpanData& span) {
 
 void TraceSampler::handle_collector_response(
     const CollectorResponse& response) {
+  if (has_collector_response(response.body_hash)) {
+    return;
+  }
+
+  auto rates = std::make_shared<CollectorRates>();
+  for (const auto& [key, rate] : response.sample_rate_by_key) {
+    rates->rate_by_key[CollectorResponse::key_hash(key)].emplace_back(key,
+                                                                     rate);
+  }
+
   const auto found =
       response.sample_rate_by_key.find(response.key_of_default_rate);
-  std::lock_guard<std::mutex> lock(mutex_);
-
   if (found != response.sample_rate_by_key.end()) {
-    collector_default_sample_rate_ = found->second;
+    rates->default_rate = found->second;
+  } else {
+    // Keep the previous default rate.
+    rates->default_rate = std::atomic_load(&collector_rates_)->default_rate;
   }
 
-  collector_sample_rates_ = response.sample_rate_by_key;
+  std::atomic_store(&collector_rates_,
+                    std::shared_ptr<const CollectorRates>(std::move(rates)));
+  collector_response_hash_.store(response.body_hash,
+                                 std::memory_order_relaxed);
+}
+
+bool TraceSampler::has_collector_response(std::uint64_t body_hash) const {
+  return body_hash != 0 &&
+         collector_response_hash_.load(std::memory_order_relaxed) == body_hash;
 }
 
 nlohmann::json TraceSampler::config_json() const {
   std::vector<nlohmann::json> rules;
-  for (const auto& rule : rules_) {
-    rules.push_back(to_json(rule));
+  for (const auto& rule : std::atomic_load(&rules_)->rules) {
+    rules.push_back(to_json(rule.config));
   }
 
-  return nlohmann::json::object({
+  auto result = nlohmann::json::object({
       {"rules", rules},
       {"max_per_second", limiter_max_per_second_},
   });
+  if (adaptive_) {
+    result["adaptive"] = adaptive_->config_json();
+  }
+  return result;
 }
 
 }  // namespace tracing
@@ -82,18 +82,47 @@
 // rate) is limited by a configurable number of traces-per-second.  The limit is
 // configured via `TraceSamplerConfig::max_per_second` or the
 // `DD_TRACE_RATE_LIMIT` environment variable.
+//
+// A sampling rule may instead have a limit of its own, its "max_per_second"
+// property.  Traces kept by such a rule are limited separately, and do not
+// count against the limit above.  This way a rule matching a noisy service
+// cannot use up the limit shared by the other rules.
+//
+// Adaptive Sampling
+// -----------------
+// If `TraceSamplerConfig::adaptive_target_per_second` is given a value, or if
+// the `DD_TRACE_ADAPTIVE_SAMPLING_TARGET` environment variable has a value,
+// then traces that no sampling rule matches are sampled by an
+// `AdaptiveSampler` instead of at the Agent provided rates (section 1).  The
+// `AdaptiveSampler` adjusts the sample rate of each service and resource once
+// per second, so that about the configured number of traces are kept per
+// second, even during traffic spikes.  See `adaptive_sampler.h`.
+//
+// Adaptive sampling decisions have the `REMOTE_ADAPTIVE_RULE` sampling
+// mechanism.  Sampling rules, including adaptive rules delivered by remote
+// configuration, still take precedence.  Since the adaptive sampler itself
+// targets a volume of traces, its decisions are not subject to the limit
+// above.
 
 #include <datadog/clock.h>
 #include <datadog/optional.h>
 #include <datadog/rate.h>
+#include <datadog/string_view.h>
 #include <datadog/trace_sampler_config.h>
 
-#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "adaptive_sampler.h"
+#include "compiled_span_matcher.h"
 #include "json.hpp"
 #include "limiter.h"
+#include "rule_index.h"
 
 namespace datadog {
 namespace tracing {
@@ -104,26 +133,78 @@ struct SpanData;
 
 class TraceSampler {
  private:
-  std::mutex mutex_;
+  // `CollectorRates` are the sample rates most recently provided by the
+  // collector.
+  struct CollectorRates {
+    Optional<Rate> default_rate;
+    // Each entry of `rate_by_key` is a `CollectorResponse` key and its rate,
+    // filed under `CollectorResponse::key_hash` of the key.  This way a span's
+    // rate is found without building the span's key.  Keys whose hashes are
+    // equal share a bucket.
+    std::unordered_map<std::uint64_t,
+                       std::vector<std::pair<std::string, Rate>>>
+        rate_by_key;
+
+    // Return the rate for the specified `service` and `environment`, or
+    // return null if there isn't one.
+    const Rate* find(StringView service, StringView environment) const;
+  };
+
+  // `Rule` is a `TraceSamplerRule` together with its compiled matcher, and
+  // its own limiter if the rule has a `max_per_second`.
+  struct Rule {
+    TraceSamplerRule config;
+    CompiledSpanMatcher matcher;
+    std::unique_ptr<Limiter> limiter;
+
+    Rule(TraceSamplerRule, const Clock&);
+  };
 
-  Optional<Rate> collector_default_sample_rate_;
-  std::unordered_map<std::string, Rate> collector_sample_rates_;
-  std::vector<TraceSamplerRule> rules_;
+  // `RuleSet` is a sequence of `Rule`s together with their index.
+  struct RuleSet {
+    std::vector<Rule> rules;
+    RuleIndex index;
+
+    RuleSet(std::vector<TraceSamplerRule>, const Clock&);
+  };
+
+  // `rules_` and `collector_rates_` are immutable snapshots that are replaced
+  // as a whole, using `std::atomic_load` and `std::atomic_store`, when they
+  // change.  This way `decide` reads them without locking.
+  std::shared_ptr<const RuleSet> rules_;
+  std::shared_ptr<const CollectorRates> collector_rates_;
+  // The `CollectorResponse::body_hash` of the response from which
+  // `collector_rates_` was made, or zero.
+  std::atomic<std::uint64_t> collector_response_hash_;
+
+  Clock clock_;
   Limiter limiter_;
   double limiter_max_per_second_;
+  // `adaptive_` is null unless adaptive sampling is configured.
+  std::unique_ptr<AdaptiveSampler> adaptive_;
 
  public:
   TraceSampler(const FinalizedTraceSamplerConfig& config, const Clock& clock);
 
+  // Replace this sampler's rules with the specified `rules`.  Decisions that
+  // are already being made continue to use the previous rules, and are not
+  // blocked by the update.
   void set_rules(std::vector<TraceSamplerRule> rules);
 
-  // Return a sampling decision for the specified root span.
+  // Return a sampling decision for the specified root span.  This may be
+  // called concurrently with `set_rules` and `handle_collector_response`.
   SamplingDecision decide(const SpanData&);
 
   // Update this sampler's Agent-provided sample rates using the specified
-  // collector response.
+  // collector response.  Do nothing if the response has the same nonzero
+  // `body_hash` as the response most recently handled.
   void handle_collector_response(const CollectorResponse&);
 
+  // Return whether the collector response most recently handled had the
+  // specified nonzero `body_hash`, i.e. whether handling a response having
+  // that hash would change nothing.
+  bool has_collector_response(std::uint64_t body_hash) const;
+
   nlohmann::json config_json() const;
 };
 
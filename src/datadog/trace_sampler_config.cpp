@@ -45,7 +45,8 @@ Expected<TraceSamplerConfig> load_trace_sampler_env_config() {
     }
 
     const std::unordered_set<std::string> allowed_properties{
-        "service", "name", "resource", "tags", "sample_rate"};
+        "service", "name",        "resource",
+        "tags",    "sample_rate", "max_per_second"};
 
     for (const auto &json_rule : json_rules) {
       auto matcher = from_json(json_rule);
@@ -81,6 +82,26 @@ Expected<TraceSamplerConfig> load_trace_sampler_env_config() {
         rule.sample_rate = *sample_rate;
       }
 
+      auto max_per_second = json_rule.find("max_per_second");
+      if (max_per_second != json_rule.end()) {
+        type = max_per_second->type_name();
+        if (type != "number") {
+          std::string message;
+          message += "Unable to parse a rule from ";
+          append(message, name(environment::DD_TRACE_SAMPLING_RULES));
+          message += " value ";
+          append(message, *rules_env);
+          message += ".  The \"max_per_second\" property of the rule ";
+          message += json_rule.dump();
+          message += " is not a number, but instead has type \"";
+          message += type;
+          message += "\".";
+          return Error{Error::TRACE_SAMPLING_RULES_MAX_PER_SECOND_WRONG_TYPE,
+                       std::move(message)};
+        }
+        rule.max_per_second = *max_per_second;
+      }
+
       // Look for unexpected properties.
       for (const auto &[key, value] : json_rule.items()) {
         if (allowed_properties.count(key)) {
@@ -129,6 +150,19 @@ Expected<TraceSamplerConfig> load_trace_sampler_env_config() {
     env_config.max_per_second = *maybe_max_per_second;
   }
 
+  if (auto target_env =
+          lookup(environment::DD_TRACE_ADAPTIVE_SAMPLING_TARGET)) {
+    auto maybe_target = parse_double(*target_env);
+    if (auto *error = maybe_target.if_error()) {
+      std::string prefix;
+      prefix += "While parsing ";
+      append(prefix, name(environment::DD_TRACE_ADAPTIVE_SAMPLING_TARGET));
+      prefix += ": ";
+      return error->with_prefix(prefix);
+    }
+    env_config.adaptive_target_per_second = *maybe_target;
+  }
+
   return env_config;
 }
 
@@ -137,6 +171,9 @@ std::string to_string(const std::vector<TraceSamplerConfig::Rule> &rules) {
   for (const auto &r : rules) {
     auto j = nlohmann::json(static_cast<SpanMatcher>(r));
     j["sample_rate"] = r.sample_rate;
+    if (r.max_per_second) {
+      j["max_per_second"] = *r.max_per_second;
+    }
     res.emplace_back(std::move(j));
   }
 
@@ -182,9 +219,22 @@ Expected<FinalizedTraceSamplerConfig> finalize_config(
       return error->with_prefix(prefix);
     }
 
+    if (rule.max_per_second && !(*rule.max_per_second > 0 &&
+                                 std::isfinite(*rule.max_per_second))) {
+      std::string message;
+      message += "Trace sampling rule with root span pattern ";
+      message += nlohmann::json(static_cast<SpanMatcher>(rule)).dump();
+      message +=
+          " should have a max_per_second value greater than zero, but the "
+          "following value was given: ";
+      message += std::to_string(*rule.max_per_second);
+      return Error{Error::MAX_PER_SECOND_OUT_OF_RANGE, std::move(message)};
+    }
+
     TraceSamplerRule finalized_rule;
     finalized_rule.matcher = rule;
     finalized_rule.rate = *maybe_rate;
+    finalized_rule.max_per_second = rule.max_per_second;
     finalized_rule.mechanism = SamplingMechanism::RULE;
     result.rules.emplace_back(std::move(finalized_rule));
   }
@@ -241,6 +291,42 @@ Expected<FinalizedTraceSamplerConfig> finalize_config(
   }
   result.max_per_second = max_per_second;
 
+  const auto &adaptive_target = env_config->adaptive_target_per_second
+                                    ? env_config->adaptive_target_per_second
+                                    : config.adaptive_target_per_second;
+  if (adaptive_target) {
+    if (!(*adaptive_target > 0) ||
+        std::find(std::begin(allowed_types), std::end(allowed_types),
+                  std::fpclassify(*adaptive_target)) ==
+            std::end(allowed_types)) {
+      std::string message;
+      message +=
+          "Adaptive sampling target_per_second must be greater than zero, "
+          "but the following value was given: ";
+      message += std::to_string(*adaptive_target);
+      return Error{Error::ADAPTIVE_SAMPLING_TARGET_OUT_OF_RANGE,
+                   std::move(message)};
+    }
+    result.adaptive_target_per_second = adaptive_target;
+  }
+
+  if (const auto &policy = config.tail_policy) {
+    bool valid = !policy->min_span_count || *policy->min_span_count > 0;
+    valid = valid && (!policy->latency_threshold ||
+                      policy->latency_threshold->count() >= 0);
+    for (const auto &[resource, threshold] :
+         policy->resource_latency_thresholds) {
+      (void)resource;
+      valid = valid && threshold.count() >= 0;
+    }
+    if (!valid) {
+      return Error{Error::INVALID_TAIL_SAMPLING_POLICY,
+                   "Tail sampling policy latency thresholds must not be "
+                   "negative, and its min_span_count must be positive."};
+    }
+    result.tail_policy = policy;
+  }
+
   return result;
 }
 
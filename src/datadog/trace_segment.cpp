@@ -2,32 +2,45 @@
 #include <datadog/dict_reader.h>
 #include <datadog/dict_writer.h>
 #include <datadog/error.h>
+#include <datadog/id_generator.h>
 #include <datadog/injection_options.h>
 #include <datadog/logger.h>
 #include <datadog/optional.h>
 #include <datadog/span_defaults.h>
 #include <datadog/telemetry/metrics.h>
+#include <datadog/trace_context.h>
 #include <datadog/trace_segment.h>
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "background_worker.h"
 #include "collector_response.h"
 #include "config_manager.h"
 #include "hex.h"
 #include "json.hpp"
+#include "memory_budget.h"
 #include "platform_util.h"
+#include "probes.h"
 #include "random.h"
 #include "span_data.h"
 #include "span_sampler.h"
+#include "span_summary.h"
 #include "tag_propagation.h"
 #include "tags.h"
+#include "tail_sampling_policy.h"
 #include "trace_sampler.h"
 #include "tracer_telemetry.h"
 #include "w3c_propagation.h"
+#include "worker_pool.h"
 
 namespace datadog {
 namespace tracing {
@@ -54,19 +67,32 @@ int Cache::process_id;
 // `cache_singleton.process_id`.
 Cache cache_singleton;
 
-// Encode the specified `trace_tags`. If the encoded value is not longer than
-// the specified `tags_header_max_size`, then set it as the "x-datadog-tags"
-// header using the specified `writer`. If the encoded value is oversized, then
-// write a diagnostic to the specified `logger` and set a propagation error tag
-// on the specified `local_root_tags`.
-void inject_trace_tags(
-    DictWriter& writer,
-    const std::vector<std::pair<std::string, std::string>>& trace_tags,
-    std::size_t tags_header_max_size,
-    std::unordered_map<std::string, std::string>& local_root_tags,
-    Logger& logger) {
-  const std::string encoded_trace_tags = encode_tags(trace_tags);
+// `HeaderBatch` accumulates the headers written by `TraceSegment::inject`, so
+// that they can be passed to `DictWriter::set_all` at once.  The keys and
+// values are views, and so must outlive the batch.
+class HeaderBatch {
+  // Each style is written at most once.  The Datadog style writes at most six
+  // headers, B3 five, and W3C two.
+  DictWriter::Entry entries_[13];
+  std::size_t size_ = 0;
+
+ public:
+  void add(StringView key, StringView value) {
+    assert(size_ < std::size(entries_));
+    entries_[size_++] = DictWriter::Entry(key, value);
+  }
+
+  void write_to(DictWriter& writer) const { writer.set_all(entries_, size_); }
+};
 
+// If the specified `encoded_trace_tags` is not longer than the specified
+// `tags_header_max_size`, then add it as the "x-datadog-tags" header to the
+// specified `headers`. If the encoded value is oversized, then write a
+// diagnostic to the specified `logger` and set the specified `oversized`.
+void inject_trace_tags(HeaderBatch& headers,
+                       const std::string& encoded_trace_tags,
+                       std::size_t tags_header_max_size,
+                       std::atomic<bool>& oversized, Logger& logger) {
   if (encoded_trace_tags.size() > tags_header_max_size) {
     std::string message;
     message +=
@@ -77,9 +103,9 @@ void inject_trace_tags(
     message += std::to_string(encoded_trace_tags.size());
     message += " bytes.";
     logger.log_error(message);
-    local_root_tags[tags::internal::propagation_error] = "inject_max_size";
+    oversized.store(true, std::memory_order_relaxed);
   } else if (!encoded_trace_tags.empty()) {
-    writer.set("x-datadog-tags", encoded_trace_tags);
+    headers.add("x-datadog-tags", encoded_trace_tags);
   }
 }
 
@@ -103,130 +129,378 @@ Expected<SamplingDecision> parse_sampling_delegation_response(
 
 }  // namespace
 
+// `InjectionHeaders` contains the values of the headers injected by `inject`
+// that depend only on the trace ID, the sampling decision, and trace-level
+// tags, so that they are encoded once per sampling decision rather than once
+// per injection.  The "traceparent" and "tracestate" values contain a span ID
+// of zero, which `inject` overwrites with the injected span's ID.
+struct TraceSegment::InjectionHeaders {
+  TraceID trace_id;
+  int sampling_priority;
+  // The "x-datadog-trace-id" value.
+  std::string datadog_trace_id;
+  // The "x-datadog-sampling-priority" value.
+  std::string datadog_sampling_priority;
+  // The "x-b3-traceid" value.
+  std::string b3_trace_id;
+  // The "x-datadog-tags" value.
+  std::string trace_tags;
+  std::string traceparent;
+  std::size_t traceparent_span_id_offset;
+  std::string tracestate;
+  std::size_t tracestate_span_id_offset;
+};
+
 TraceSegment::TraceSegment(
-    const std::shared_ptr<Logger>& logger,
-    const std::shared_ptr<Collector>& collector,
-    const std::shared_ptr<TracerTelemetry>& tracer_telemetry,
+    const std::shared_ptr<const TraceSegmentContext>& context,
     const std::shared_ptr<TraceSampler>& trace_sampler,
-    const std::shared_ptr<SpanSampler>& span_sampler,
     const std::shared_ptr<const SpanDefaults>& defaults,
-    const std::shared_ptr<ConfigManager>& config_manager,
-    const RuntimeID& runtime_id, bool sampling_delegation_enabled,
-    bool sampling_decision_was_delegated_to_me,
-    const std::vector<PropagationStyle>& injection_styles,
-    const Optional<std::string>& hostname, Optional<std::string> origin,
-    std::size_t tags_header_max_size,
+    bool sampling_decision_was_delegated_to_me, Optional<std::string> origin,
     std::vector<std::pair<std::string, std::string>> trace_tags,
+    Optional<std::string> extracted_trace_tags,
     Optional<SamplingDecision> sampling_decision,
     Optional<std::string> additional_w3c_tracestate,
     Optional<std::string> additional_datadog_w3c_tracestate,
     std::unique_ptr<SpanData> local_root)
-    : logger_(logger),
-      collector_(collector),
-      tracer_telemetry_(tracer_telemetry),
+    : context_(context),
       trace_sampler_(trace_sampler),
-      span_sampler_(span_sampler),
       defaults_(defaults),
-      runtime_id_(runtime_id),
-      injection_styles_(injection_styles),
-      hostname_(hostname),
       origin_(std::move(origin)),
-      tags_header_max_size_(tags_header_max_size),
       trace_tags_(std::move(trace_tags)),
+      extracted_trace_tags_(std::move(extracted_trace_tags)),
+      local_root_(std::move(local_root)),
+      anchor_(local_root_->start),
+      local_root_id_(local_root_->span_id),
+      trace_tags_oversized_(false),
+      registered_spans_(nullptr),
+      num_unfinished_spans_(1),
       num_finished_spans_(0),
+      num_spans_(1),
+      num_capped_spans_(0),
       sampling_decision_(std::move(sampling_decision)),
+      records_new_spans_(true),
+      records_spans_(true),
       additional_w3c_tracestate_(std::move(additional_w3c_tracestate)),
       additional_datadog_w3c_tracestate_(
-          std::move(additional_datadog_w3c_tracestate)),
-      config_manager_(config_manager) {
-  assert(logger_);
-  assert(collector_);
-  assert(tracer_telemetry_);
+          std::move(additional_datadog_w3c_tracestate)) {
+  assert(context_);
+  assert(context_->logger);
+  assert(context_->collector);
+  assert(context_->tracer_telemetry);
   assert(trace_sampler_);
-  assert(span_sampler_);
+  assert(context_->span_sampler);
   assert(defaults_);
-  assert(config_manager_);
+  assert(context_->id_generator);
+  assert(context_->clock);
+  assert(context_->config_manager);
+  assert(local_root_);
 
-  sampling_delegation_.enabled = sampling_delegation_enabled;
   sampling_delegation_.decision_was_delegated_to_me =
       sampling_decision_was_delegated_to_me;
 
-  register_span(std::move(local_root));
+  context_->tracer_telemetry->metrics().tracer.spans_created.inc();
+  context_->tracer_telemetry->memory_budget()->charge(sizeof(TraceSegment) +
+                                                      sizeof(SpanData));
+}
+
+TraceSegment::~TraceSegment() {
+  // Spans that were not sent to the collector are still ours.
+  std::size_t unsent = local_root_ ? 1 : 0;
+  SpanData* span = registered_spans_.load();
+  while (span) {
+    SpanData* const next = span->next_registered;
+    delete span;
+    span = next;
+    ++unsent;
+  }
+  context_->tracer_telemetry->memory_budget()->release(
+      sizeof(TraceSegment) + unsent * sizeof(SpanData));
 }
 
 const SpanDefaults& TraceSegment::defaults() const { return *defaults_; }
 
+const std::shared_ptr<const SpanDefaults>& TraceSegment::shared_defaults()
+    const {
+  return defaults_;
+}
+
+const IDGenerator& TraceSegment::id_generator() const {
+  return *context_->id_generator;
+}
+
+const Clock& TraceSegment::clock() const { return context_->clock; }
+
+TimePoint TraceSegment::now() const {
+  if (!context_->steady_clock_ticks) {
+    return context_->clock();
+  }
+  const auto tick = std::chrono::steady_clock::now();
+  return TimePoint{
+      anchor_.wall +
+          std::chrono::duration_cast<std::chrono::system_clock::duration>(
+              tick - anchor_.tick),
+      tick};
+}
+
+std::chrono::steady_clock::time_point TraceSegment::now_tick() const {
+  if (!context_->steady_clock_ticks) {
+    return context_->clock().tick;
+  }
+  return std::chrono::steady_clock::now();
+}
+
 const Optional<std::string>& TraceSegment::hostname() const {
-  return hostname_;
+  return context_->hostname;
 }
 
 const Optional<std::string>& TraceSegment::origin() const { return origin_; }
 
 Optional<SamplingDecision> TraceSegment::sampling_decision() const {
   // `sampling_decision_` can change, so we need a lock.
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   return sampling_decision_;
 }
 
-Logger& TraceSegment::logger() const { return *logger_; }
+bool TraceSegment::records_new_spans() const {
+  return records_new_spans_.load(std::memory_order_relaxed);
+}
+
+bool TraceSegment::records_spans() const { return records_spans_; }
+
+std::uint64_t TraceSegment::local_root_id() const { return local_root_id_; }
+
+Logger& TraceSegment::logger() const { return *context_->logger; }
+
+std::size_t TraceSegment::tag_value_limit(StringView name) const {
+  return tags::tag_value_limit(name, context_->max_tag_value_length,
+                               context_->tag_value_length_limits);
+}
+
+std::size_t TraceSegment::reserve_spans(std::size_t count) {
+  if (context_->tracer_telemetry->memory_budget()->state() ==
+      MemoryBudget::SHED) {
+    num_capped_spans_.fetch_add(count, std::memory_order_relaxed);
+    return 0;
+  }
+  const std::size_t max_spans =
+      context_->config_manager->pipeline_overrides()
+          .max_spans_per_trace.value_or(context_->max_spans_per_trace);
+  if (max_spans == 0) {
+    return count;
+  }
+  std::size_t recorded = num_spans_.load(std::memory_order_relaxed);
+  std::size_t granted;
+  do {
+    granted = recorded >= max_spans ? 0 : std::min(count, max_spans - recorded);
+  } while (granted != 0 &&
+           !num_spans_.compare_exchange_weak(recorded, recorded + granted,
+                                             std::memory_order_relaxed));
+  if (granted != count) {
+    num_capped_spans_.fetch_add(count - granted, std::memory_order_relaxed);
+  }
+  return granted;
+}
 
 void TraceSegment::register_span(std::unique_ptr<SpanData> span) {
-  tracer_telemetry_->metrics().tracer.spans_created.inc();
+  context_->tracer_telemetry->metrics().tracer.spans_created.inc();
+  SpanData* const node = span.release();
+  push_registered(node, node, 1);
+}
 
-  std::lock_guard<std::mutex> lock(mutex_);
-  assert(spans_.empty() || num_finished_spans_ < spans_.size());
-  spans_.emplace_back(std::move(span));
+bool TraceSegment::register_span_if_unfinished(
+    std::unique_ptr<SpanData>& span) {
+  // Once the count of unfinished spans reaches zero, the segment is being
+  // finalized, and it must not grow again.
+  std::size_t unfinished =
+      num_unfinished_spans_.load(std::memory_order_relaxed);
+  do {
+    if (unfinished == 0) {
+      return false;
+    }
+  } while (!num_unfinished_spans_.compare_exchange_weak(
+      unfinished, unfinished + 1, std::memory_order_relaxed));
+  context_->tracer_telemetry->metrics().tracer.spans_created.inc();
+  context_->tracer_telemetry->memory_budget()->charge(sizeof(SpanData));
+  SpanData* const node = span.release();
+  push_list(node, node);
+  return true;
 }
 
-void TraceSegment::span_finished() {
-  {
-    tracer_telemetry_->metrics().tracer.spans_finished.inc();
-    std::lock_guard<std::mutex> lock(mutex_);
-    ++num_finished_spans_;
-    assert(num_finished_spans_ <= spans_.size());
-    if (num_finished_spans_ < spans_.size()) {
+void TraceSegment::register_spans(
+    std::vector<std::unique_ptr<SpanData>> spans) {
+  if (spans.empty()) {
+    return;
+  }
+  context_->tracer_telemetry->metrics().tracer.spans_created.add(spans.size());
+  // Link the spans most recent first, so that they are pushed all at once.
+  SpanData* const oldest = spans.front().release();
+  SpanData* newest = oldest;
+  for (std::size_t i = 1; i < spans.size(); ++i) {
+    SpanData* const node = spans[i].release();
+    node->next_registered = newest;
+    newest = node;
+  }
+  push_registered(newest, oldest, spans.size());
+}
+
+void TraceSegment::push_registered(SpanData* newest, SpanData* oldest,
+                                   std::size_t count) {
+  // A span is registered only by the local root or by an unfinished
+  // descendant of it, so the count of unfinished spans cannot concurrently
+  // reach zero.
+  const std::size_t previous =
+      num_unfinished_spans_.fetch_add(count, std::memory_order_relaxed);
+  assert(previous > 0);
+  (void)previous;
+  context_->tracer_telemetry->memory_budget()->charge(count * sizeof(SpanData));
+  push_list(newest, oldest);
+}
+
+void TraceSegment::push_list(SpanData* newest, SpanData* oldest) {
+  SpanData* head = registered_spans_.load(std::memory_order_relaxed);
+  do {
+    oldest->next_registered = head;
+  } while (!registered_spans_.compare_exchange_weak(
+      head, newest, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void TraceSegment::span_finished(SpanData& span) {
+  SpanData* const spans[] = {&span};
+  spans_finished(spans, 1);
+}
+
+void TraceSegment::spans_finished(SpanData* const* finished_spans,
+                                  std::size_t finished_count) {
+  if (finished_count == 0) {
+    return;
+  }
+  StageTimer timer{
+      context_->tracer_telemetry->stage(&StageTimings::span_finished)};
+  context_->tracer_telemetry->metrics().tracer.spans_finished.add(
+      finished_count);
+  for (std::size_t i = 0; i < finished_count; ++i) {
+    DD_TRACE_PROBE(span__finish, finished_spans[i]->trace_id.low,
+                   finished_spans[i]->span_id,
+                   finished_spans[i]->duration.count());
+  }
+  std::size_t num_finished = 0;
+  if (context_->partial_flush_min_spans) {
+    std::size_t non_root = 0;
+    for (std::size_t i = 0; i < finished_count; ++i) {
+      non_root += finished_spans[i] != local_root_.get();
+    }
+    // Count the spans before marking them finished, so that a flush that
+    // sees a mark never subtracts more than has been counted.
+    if (non_root) {
+      num_finished =
+          num_finished_spans_.fetch_add(non_root, std::memory_order_relaxed) +
+          non_root;
+      for (std::size_t i = 0; i < finished_count; ++i) {
+        if (finished_spans[i] != local_root_.get()) {
+          finished_spans[i]->finished.store(true, std::memory_order_release);
+        }
+      }
+    }
+  }
+  const std::size_t previous = num_unfinished_spans_.fetch_sub(
+      finished_count, std::memory_order_acq_rel);
+  assert(previous >= finished_count);
+  if (previous != finished_count) {
+    if (num_finished && num_finished >= context_->partial_flush_min_spans) {
+      flush_finished_spans();
+    }
+    return;
+  }
+
+  // All of our spans are finished, and there's nobody left to call our
+  // methods, except perhaps a partial flush that is in progress.  Take the
+  // unsent spans in the order in which they were registered, leaving room at
+  // the front for the local root.
+  std::lock_guard<FlushMutex> flush_lock(flush_mutex_);
+  std::size_t count = 1;
+  SpanData* head =
+      registered_spans_.exchange(nullptr, std::memory_order_acquire);
+  for (SpanData* span = head; span; span = span->next_registered) {
+    ++count;
+  }
+  DD_TRACE_PROBE(segment__close, local_root_->trace_id.low, count);
+  std::vector<std::unique_ptr<SpanData>> spans(count);
+  while (head) {
+    SpanData* const next = head->next_registered;
+    head->next_registered = nullptr;
+    spans[--count].reset(head);
+    head = next;
+  }
+
+  if (context_->finalizer) {
+    // `std::function` must be copyable, so the spans are shared.
+    auto shared_spans =
+        std::make_shared<std::vector<std::unique_ptr<SpanData>>>(
+            std::move(spans));
+    if (context_->finalizer->post([self = shared_from_this(), shared_spans]() {
+          self->finalize(std::move(*shared_spans));
+        })) {
       return;
     }
+    spans = std::move(*shared_spans);
+  }
+  finalize(std::move(spans));
+}
+
+void TraceSegment::finalize(std::vector<std::unique_ptr<SpanData>>&& spans) {
+  // Unrecorded spans can outlive the recorded ones, and they might inject,
+  // or override the sampling decision, on other threads.  So, the decision
+  // and the state that goes with it are settled while `mutex_` is locked.
+  SamplingDecision decision;
+  std::vector<std::pair<std::string, std::string>> trace_tags;
+  bool decided_for_parent;
+  {
+    std::lock_guard<Mutex> lock(mutex_);
+    make_sampling_decision_if_null();
+    assert(sampling_decision_);
+    spans.front() = std::move(local_root_);
+
+    if (context_->tail_policy && sampling_decision_->priority <= 0 &&
+        sampling_decision_->origin == SamplingDecision::Origin::LOCAL &&
+        sampling_decision_->mechanism != int(SamplingMechanism::MANUAL) &&
+        context_->tail_policy->keeps(spans)) {
+      // The sampler dropped the trace, but now that we know how it turned
+      // out, it's worth keeping.  A manual drop is left alone.
+      SamplingDecision keep;
+      keep.priority = int(SamplingPriority::USER_KEEP);
+      keep.mechanism = int(SamplingMechanism::MANUAL);
+      keep.origin = SamplingDecision::Origin::LOCAL;
+      sampling_decision_ = keep;
+      update_decision_maker_trace_tag();
+    }
+
+    decision = *sampling_decision_;
+    trace_tags = trace_tags_;
+    const SamplingDelegation& delegation = sampling_delegation_;
+    decided_for_parent = delegation.decision_was_delegated_to_me &&
+                         delegation.sent_response_header &&
+                         !delegation.received_matching_response_header;
   }
-  // We don't need the lock anymore.  There's nobody left to call our methods.
-  // On the other hand, there's nobody left to contend for the mutex, so it
-  // doesn't make any difference.
-  make_sampling_decision_if_null();
-  assert(sampling_decision_);
 
   // All of our spans are finished.  Run the span sampler, finalize the spans,
   // and then send the spans to the collector.
-  if (sampling_decision_->priority <= 0) {
+  if (decision.priority <= 0) {
     // Span sampling happens when the trace is dropped.
-    for (const auto& span_ptr : spans_) {
-      SpanData& span = *span_ptr;
-      auto* rule = span_sampler_->match(span);
-      if (!rule) {
-        continue;
-      }
-      const SamplingDecision decision = rule->decide(span);
-      if (decision.priority <= 0) {
-        continue;
-      }
-      span.numeric_tags[tags::internal::span_sampling_mechanism] =
-          *decision.mechanism;
-      span.numeric_tags[tags::internal::span_sampling_rule_rate] =
-          *decision.configured_rate;
-      if (decision.limiter_max_per_second) {
-        span.numeric_tags[tags::internal::span_sampling_limit] =
-            *decision.limiter_max_per_second;
-      }
-    }
+    sample_spans(spans);
   }
 
-  const SamplingDecision& decision = *sampling_decision_;
-
-  auto& local_root = *spans_.front();
-  local_root.tags.insert(trace_tags_.begin(), trace_tags_.end());
-  local_root.numeric_tags[tags::internal::sampling_priority] =
-      decision.priority;
-  if (hostname_) {
-    local_root.tags[tags::internal::hostname] = *hostname_;
+  auto& local_root = *spans.front();
+  local_root.tags.insert(trace_tags.begin(), trace_tags.end());
+  local_root.sampling_priority = decision.priority;
+  if (context_->hostname) {
+    local_root.tags[tags::internal::hostname] = *context_->hostname;
+  }
+  if (trace_tags_oversized_.load(std::memory_order_relaxed)) {
+    local_root.tags[tags::internal::propagation_error] = "inject_max_size";
+  }
+  if (const std::size_t capped =
+          num_capped_spans_.load(std::memory_order_relaxed)) {
+    local_root.numeric_tags[tags::internal::spans_over_limit] = double(capped);
   }
   if (decision.origin == SamplingDecision::Origin::LOCAL) {
     if (decision.mechanism == int(SamplingMechanism::AGENT_RATE) ||
@@ -251,10 +525,7 @@ void TraceSegment::span_finished() {
     // the sampling decision and so are not the "sampling decider."
     local_root.tags[tags::internal::sampling_decider] = "0";
   }
-  if (local_root.parent_id != 0 &&
-      sampling_delegation_.decision_was_delegated_to_me &&
-      sampling_delegation_.sent_response_header &&
-      !sampling_delegation_.received_matching_response_header) {
+  if (local_root.parent_id != 0 && decided_for_parent) {
     // Convey the fact that, while we are not the root service, somebody
     // delegated the trace sampling decision to us, we did not then delegate it
     // to someone else, and we ultimately conveyed our decision back to the
@@ -262,26 +533,159 @@ void TraceSegment::span_finished() {
     local_root.tags[tags::internal::sampling_decider] = "1";
   }
 
-  // Some tags are repeated on all spans.
-  for (const auto& span_ptr : spans_) {
-    SpanData& span = *span_ptr;
-    if (origin_) {
-      span.tags[tags::internal::origin] = *origin_;
+  if (const std::size_t removed =
+          summarize_spans(spans, context_->span_summary_min_spans)) {
+    context_->tracer_telemetry->memory_budget()->release(removed *
+                                                         sizeof(SpanData));
+  }
+
+  send(std::move(spans));
+  context_->tracer_telemetry->metrics().tracer.trace_segments_closed.inc();
+}
+
+void TraceSegment::flush_finished_spans() {
+  std::unique_lock<FlushMutex> flush_lock(flush_mutex_, std::try_to_lock);
+  if (!flush_lock.owns_lock()) {
+    // Somebody else is flushing.
+    return;
+  }
+
+  // Take the unsent spans, keep the unfinished ones, and put them back.
+  // Spans registered in the meantime are unaffected.  The finished spans
+  // counted so far are nearly always the ones taken, so reserve room for them
+  // rather than grow the vector span by span.
+  std::vector<std::unique_ptr<SpanData>> spans;
+  spans.reserve(num_finished_spans_.load(std::memory_order_relaxed));
+  SpanData* newest_kept = nullptr;
+  SpanData* oldest_kept = nullptr;
+  SpanData* head =
+      registered_spans_.exchange(nullptr, std::memory_order_acquire);
+  while (head) {
+    SpanData* const next = head->next_registered;
+    head->next_registered = nullptr;
+    if (head->finished.load(std::memory_order_acquire)) {
+      spans.emplace_back(head);
+    } else if (oldest_kept) {
+      oldest_kept->next_registered = head;
+      oldest_kept = head;
+    } else {
+      newest_kept = oldest_kept = head;
     }
-    span.numeric_tags[tags::internal::process_id] = Cache::process_id;
-    span.tags[tags::internal::language] = "cpp";
-    span.tags[tags::internal::runtime_id] = runtime_id_.string();
+    head = next;
   }
+  if (newest_kept) {
+    push_list(newest_kept, oldest_kept);
+  }
+  if (spans.empty()) {
+    return;
+  }
+  num_finished_spans_.fetch_sub(spans.size(), std::memory_order_relaxed);
+  std::reverse(spans.begin(), spans.end());
 
-  if (config_manager_->report_traces()) {
-    const auto result = collector_->send(std::move(spans_), trace_sampler_);
-    if (auto* error = result.if_error()) {
-      logger_->log_error(
-          error->with_prefix("Error sending spans to collector: "));
+  // The spans of every chunk of the trace convey the sampling decision and
+  // the trace tags, so the decision is made now if it hasn't been already.
+  int sampling_priority;
+  std::vector<std::pair<std::string, std::string>> trace_tags;
+  {
+    std::lock_guard<Mutex> lock(mutex_);
+    make_sampling_decision_if_null();
+    assert(sampling_decision_);
+    sampling_priority = sampling_decision_->priority;
+    trace_tags = trace_tags_;
+  }
+
+  if (sampling_priority <= 0) {
+    sample_spans(spans);
+  }
+  auto& chunk_root = *spans.front();
+  chunk_root.tags.insert(trace_tags.begin(), trace_tags.end());
+  chunk_root.sampling_priority = sampling_priority;
+
+  send(std::move(spans));
+}
+
+void TraceSegment::sample_spans(
+    const std::vector<std::unique_ptr<SpanData>>& spans) {
+  // Matching is read-only and the rules' limiters are safe to share, so a
+  // large segment's spans can be sampled by several threads, each with a
+  // `MatchCache` of its own.
+  const auto sample_range = [&](std::size_t begin, std::size_t end) {
+    SpanSampler::MatchCache cache;
+    for (std::size_t i = begin; i != end; ++i) {
+      SpanData& span = *spans[i];
+      auto* rule = context_->span_sampler->match(span, cache);
+      if (!rule) {
+        continue;
+      }
+      const SamplingDecision decision = rule->decide(span);
+      if (decision.priority <= 0) {
+        continue;
+      }
+      span.numeric_tags[tags::internal::span_sampling_mechanism] =
+          *decision.mechanism;
+      span.numeric_tags[tags::internal::span_sampling_rule_rate] =
+          *decision.configured_rate;
+      if (decision.limiter_max_per_second) {
+        span.numeric_tags[tags::internal::span_sampling_limit] =
+            *decision.limiter_max_per_second;
+      }
     }
+  };
+
+  WorkerPool* const workers = context_->workers.get();
+  if (!workers || workers->ranges(spans.size()) == 1) {
+    sample_range(0, spans.size());
+    return;
+  }
+  workers->for_each_range(
+      spans.size(), [&](std::size_t, std::size_t begin, std::size_t end) {
+        sample_range(begin, end);
+      });
+}
+
+void TraceSegment::send(std::vector<std::unique_ptr<SpanData>>&& spans) {
+  // The spans are the collector's, or nobody's, from now on.
+  context_->tracer_telemetry->memory_budget()->release(spans.size() *
+                                                       sizeof(SpanData));
+  if (!context_->config_manager->report_traces()) {
+    return;
   }
 
-  tracer_telemetry_->metrics().tracer.trace_segments_closed.inc();
+  // Some tags are repeated on all spans.  The collector adds them to each
+  // span, which for `DatadogAgent` means writing them directly into the
+  // encoded spans.
+  ChunkTags chunk_tags;
+  if (origin_) {
+    chunk_tags.origin = *origin_;
+  }
+  chunk_tags.process_id = Cache::process_id;
+  chunk_tags.language = "cpp";
+  chunk_tags.runtime_id = context_->runtime_id;
+  const auto result =
+      context_->collector->send(std::move(spans), chunk_tags, trace_sampler_);
+  if (auto* error = result.if_error()) {
+    context_->logger->log_error(
+        error->with_prefix("Error sending spans to collector: "));
+  }
+}
+
+void TraceSegment::make_early_sampling_decision() {
+  std::lock_guard<Mutex> lock(mutex_);
+  if (context_->sampling_delegation_enabled) {
+    // A delegated decision might replace ours.
+    return;
+  }
+  make_sampling_decision_if_null();
+  assert(sampling_decision_);
+  if (sampling_decision_->priority <= 0 &&
+      !context_->span_sampler->has_rules() && !context_->tail_policy) {
+    records_new_spans_.store(false, std::memory_order_relaxed);
+  }
+}
+
+void TraceSegment::disable_recording() {
+  records_spans_ = false;
+  records_new_spans_.store(false, std::memory_order_relaxed);
 }
 
 void TraceSegment::override_sampling_priority(SamplingPriority priority) {
@@ -294,9 +698,12 @@ void TraceSegment::override_sampling_priority(int priority) {
   decision.mechanism = int(SamplingMechanism::MANUAL);
   decision.origin = SamplingDecision::Origin::LOCAL;
 
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   sampling_decision_ = decision;
   update_decision_maker_trace_tag();
+  if (priority > 0 && records_spans_) {
+    records_new_spans_.store(true, std::memory_order_relaxed);
+  }
 }
 
 void TraceSegment::make_sampling_decision_if_null() {
@@ -306,8 +713,16 @@ void TraceSegment::make_sampling_decision_if_null() {
     return;
   }
 
-  const SpanData& local_root = *spans_.front();
-  sampling_decision_ = trace_sampler_->decide(local_root);
+  // `local_root_` is null only after `finalize`, which makes a decision.
+  const SpanData& local_root = *local_root_;
+  {
+    StageTimer timer{
+        context_->tracer_telemetry->stage(&StageTimings::sampler_decide)};
+    sampling_decision_ = trace_sampler_->decide(local_root);
+  }
+  DD_TRACE_PROBE(sampling__decision, local_root.trace_id.low,
+                 sampling_decision_->priority,
+                 sampling_decision_->mechanism.value_or(-1));
 
   update_decision_maker_trace_tag();
 }
@@ -317,6 +732,9 @@ void TraceSegment::update_decision_maker_trace_tag() {
 
   assert(sampling_decision_);
 
+  // The sampling decision, and so maybe the trace tags, changed.
+  injection_headers_.reset();
+
   // Note that `found` might be erased below (in case you refactor this code).
   const auto found = std::find_if(
       trace_tags_.begin(), trace_tags_.end(), [](const auto& entry) {
@@ -326,6 +744,7 @@ void TraceSegment::update_decision_maker_trace_tag() {
   if (sampling_decision_->priority <= 0) {
     if (found != trace_tags_.end()) {
       trace_tags_.erase(found);
+      extracted_trace_tags_.reset();
     }
     return;
   }
@@ -334,119 +753,199 @@ void TraceSegment::update_decision_maker_trace_tag() {
   auto value = "-" + std::to_string(*sampling_decision_->mechanism);
   if (found == trace_tags_.end()) {
     trace_tags_.emplace_back(tags::internal::decision_maker, std::move(value));
-  } else {
+    extracted_trace_tags_.reset();
+  } else if (found->second != value) {
     found->second = std::move(value);
+    extracted_trace_tags_.reset();
   }
 }
 
+std::shared_ptr<const TraceSegment::InjectionHeaders>
+TraceSegment::injection_headers(TraceID trace_id) {
+  // `mutex_` is already locked.
+  assert(sampling_decision_);
+
+  if (injection_headers_ && injection_headers_->trace_id == trace_id) {
+    return injection_headers_;
+  }
+
+  auto headers = std::make_shared<InjectionHeaders>();
+  headers->trace_id = trace_id;
+  headers->sampling_priority = sampling_decision_->priority;
+  headers->datadog_trace_id = std::to_string(trace_id.low);
+  headers->datadog_sampling_priority =
+      std::to_string(headers->sampling_priority);
+  headers->b3_trace_id =
+      trace_id.high ? trace_id.hex_padded() : hex_padded(trace_id.low);
+  headers->trace_tags = extracted_trace_tags_ ? *extracted_trace_tags_
+                                              : encode_tags(trace_tags_);
+  // The span ID follows "00-<32 hex digits>-" in "traceparent".
+  headers->traceparent =
+      encode_traceparent(trace_id, 0, headers->sampling_priority);
+  headers->traceparent_span_id_offset = 36;
+  // The span ID follows "dd=s:<priority>;p:" in "tracestate".  Truncation of
+  // an oversized "tracestate" never removes it.
+  headers->tracestate = encode_tracestate(
+      0, headers->sampling_priority, origin_, trace_tags_,
+      additional_datadog_w3c_tracestate_, additional_w3c_tracestate_);
+  headers->tracestate_span_id_offset =
+      5 + headers->datadog_sampling_priority.size() + 3;
+
+  injection_headers_ = headers;
+  return headers;
+}
+
 bool TraceSegment::inject(DictWriter& writer, const SpanData& span) {
   return inject(writer, span, InjectionOptions{});
 }
 
 bool TraceSegment::inject(DictWriter& writer, const SpanData& span,
                           const InjectionOptions& options) {
-  // If the only injection style is `NONE`, then don't do anything.
-  if (injection_styles_.size() == 1 &&
-      injection_styles_[0] == PropagationStyle::NONE) {
+  // If there are no styles to inject, e.g. if the only injection style is
+  // `NONE`, then don't do anything.
+  if (context_->injected_styles.empty()) {
     return false;
   }
 
+  // Everything that `inject` needs from the segment's mutable state is read,
+  // and updated, under one lock.
   bool delegate_sampling;
-  // If `options.delegate_sampling_decision` is null, then pick a default based
-  // on our sampling delegation configuration and state.
-  //
-  // Also, even if the caller requested sampling delegation, do _not_ perform
-  // sampling delegation if we previously extracted a sampling decision for
-  // which delegation was not requested.
-  // That is, don't let our desire to delegate sampling result in overriding a
-  // sampling decision made earlier in the trace.
+  std::shared_ptr<const InjectionHeaders> cached;
   {
-    std::lock_guard<std::mutex> lock{mutex_};
+    std::lock_guard<Mutex> lock{mutex_};
+    // If `options.delegate_sampling_decision` is null, then pick a default
+    // based on our sampling delegation configuration and state.
+    //
+    // Also, even if the caller requested sampling delegation, do _not_
+    // perform sampling delegation if we previously extracted a sampling
+    // decision for which delegation was not requested.
+    // That is, don't let our desire to delegate sampling result in overriding
+    // a sampling decision made earlier in the trace.
     if (sampling_decision_ &&
         sampling_decision_->origin == SamplingDecision::Origin::EXTRACTED &&
         !sampling_delegation_.decision_was_delegated_to_me) {
       delegate_sampling = false;
     } else {
       delegate_sampling = options.delegate_sampling_decision.value_or(
-          sampling_delegation_.enabled &&
+          context_->sampling_delegation_enabled &&
           !sampling_delegation_.sent_request_header);
     }
-  }
-
-  bool delegated_trace_sampling_decision = false;
+    // Only the Datadog style carries the delegation request.
+    delegate_sampling = delegate_sampling && context_->injects_datadog;
+    if (delegate_sampling) {
+      sampling_delegation_.sent_request_header = true;
+    }
 
-  // The sampling priority can change (it can be overridden on another thread),
-  // and trace tags might change when that happens ("_dd.p.dm").
-  // So, we lock here, make a sampling decision if necessary, and then copy the
-  // decision and trace tags before unlocking.
-  int sampling_priority;
-  std::vector<std::pair<std::string, std::string>> trace_tags;
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // The sampling priority can change (it can be overridden on another
+    // thread), and trace tags might change when that happens ("_dd.p.dm").
+    // So, make a sampling decision if necessary, and then take the header
+    // values for that decision before unlocking.
     make_sampling_decision_if_null();
-    assert(sampling_decision_);
-    sampling_priority = sampling_decision_->priority;
-    trace_tags = trace_tags_;
+    cached = injection_headers(span.trace_id);
   }
-
-  for (const auto style : injection_styles_) {
+  const int sampling_priority = cached->sampling_priority;
+
+  // The headers are written to `writer` all at once, at the end.  These are
+  // the buffers for values that are specific to `span`, which must outlive
+  // `headers`.  A "tracestate" value is at most 256 characters, plus any
+  // non-Datadog entries extracted from another service, which are rarely
+  // large.  If it doesn't fit in `tracestate_buffer`, then it goes in
+  // `tracestate_overflow`.
+  HeaderBatch headers;
+  char datadog_parent_id[std::numeric_limits<std::uint64_t>::digits10 + 1];
+  char b3_span_id[16];
+  char traceparent[55];
+  char tracestate_buffer[512];
+  std::string tracestate_overflow;
+
+  for (const auto style : context_->injected_styles) {
     switch (style) {
-      case PropagationStyle::DATADOG:
-        writer.set("x-datadog-trace-id", std::to_string(span.trace_id.low));
-        writer.set("x-datadog-parent-id", std::to_string(span.span_id));
-        writer.set("x-datadog-sampling-priority",
-                   std::to_string(sampling_priority));
+      case PropagationStyle::DATADOG: {
+        const auto parent_id_end =
+            std::to_chars(std::begin(datadog_parent_id),
+                          std::end(datadog_parent_id), span.span_id)
+                .ptr;
+        headers.add("x-datadog-trace-id", cached->datadog_trace_id);
+        headers.add("x-datadog-parent-id",
+                    StringView(datadog_parent_id,
+                               parent_id_end - datadog_parent_id));
+        headers.add("x-datadog-sampling-priority",
+                    cached->datadog_sampling_priority);
         if (origin_) {
-          writer.set("x-datadog-origin", *origin_);
+          headers.add("x-datadog-origin", *origin_);
         }
         if (delegate_sampling) {
-          delegated_trace_sampling_decision = true;
-          {
-            std::lock_guard<std::mutex> lock(mutex_);
-            sampling_delegation_.sent_request_header = true;
-          }
-          writer.set("x-datadog-delegate-trace-sampling", "delegate");
+          headers.add("x-datadog-delegate-trace-sampling", "delegate");
         }
-        inject_trace_tags(writer, trace_tags, tags_header_max_size_,
-                          spans_.front()->tags, *logger_);
+        inject_trace_tags(headers, cached->trace_tags,
+                          context_->tags_header_max_size,
+                          trace_tags_oversized_, *context_->logger);
         break;
+      }
       case PropagationStyle::B3:
-        if (span.trace_id.high) {
-          writer.set("x-b3-traceid", span.trace_id.hex_padded());
-        } else {
-          writer.set("x-b3-traceid", hex_padded(span.trace_id.low));
-        }
-        writer.set("x-b3-spanid", hex_padded(span.span_id));
-        writer.set("x-b3-sampled", std::to_string(int(sampling_priority > 0)));
+        write_hex_padded(b3_span_id, span.span_id);
+        headers.add("x-b3-traceid", cached->b3_trace_id);
+        headers.add("x-b3-spanid", StringView(b3_span_id, sizeof b3_span_id));
+        headers.add("x-b3-sampled", sampling_priority > 0 ? "1" : "0");
         if (origin_) {
-          writer.set("x-datadog-origin", *origin_);
+          headers.add("x-datadog-origin", *origin_);
         }
-        inject_trace_tags(writer, trace_tags, tags_header_max_size_,
-                          spans_.front()->tags, *logger_);
+        inject_trace_tags(headers, cached->trace_tags,
+                          context_->tags_header_max_size,
+                          trace_tags_oversized_, *context_->logger);
         break;
-      case PropagationStyle::W3C:
-        writer.set(
-            "traceparent",
-            encode_traceparent(span.trace_id, span.span_id, sampling_priority));
-        writer.set(
-            "tracestate",
-            encode_tracestate(span.span_id, sampling_priority, origin_,
-                              trace_tags, additional_datadog_w3c_tracestate_,
-                              additional_w3c_tracestate_));
+      case PropagationStyle::W3C: {
+        assert(cached->traceparent.size() == sizeof traceparent);
+        std::memcpy(traceparent, cached->traceparent.data(),
+                    sizeof traceparent);
+        write_hex_padded(traceparent + cached->traceparent_span_id_offset,
+                         span.span_id);
+        headers.add("traceparent", StringView(traceparent, sizeof traceparent));
+
+        const std::size_t tracestate_size = cached->tracestate.size();
+        char* tracestate = tracestate_buffer;
+        if (tracestate_size > sizeof tracestate_buffer) {
+          tracestate_overflow = cached->tracestate;
+          tracestate = &tracestate_overflow[0];
+        } else {
+          std::memcpy(tracestate, cached->tracestate.data(), tracestate_size);
+        }
+        write_hex_padded(tracestate + cached->tracestate_span_id_offset,
+                         span.span_id);
+        headers.add("tracestate", StringView(tracestate, tracestate_size));
         break;
+      }
       default:
         assert(style == PropagationStyle::NONE);
         break;
     }
   }
 
-  return delegated_trace_sampling_decision;
+  headers.write_to(writer);
+  return delegate_sampling;
+}
+
+TraceContext TraceSegment::export_context(const SpanData& span) {
+  TraceContext context;
+  context.trace_id = span.trace_id;
+  context.parent_id = span.span_id;
+  context.origin = origin_;
+  context.additional_w3c_tracestate = additional_w3c_tracestate_;
+  context.additional_datadog_w3c_tracestate =
+      additional_datadog_w3c_tracestate_;
+  // The sampling decision, and with it the "_dd.p.dm" trace tag, can change
+  // on another thread, so take them together.
+  std::lock_guard<Mutex> lock(mutex_);
+  make_sampling_decision_if_null();
+  context.sampling_priority = sampling_decision_->priority;
+  context.trace_tags = trace_tags_;
+  return context;
 }
 
 void TraceSegment::write_sampling_delegation_response(DictWriter& writer) {
   nlohmann::json j;
   {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<Mutex> lock(mutex_);
     if (!sampling_delegation_.decision_was_delegated_to_me) return;
     make_sampling_decision_if_null();
     assert(sampling_decision_);
@@ -471,7 +970,7 @@ Expected<void> TraceSegment::read_sampling_delegation_response(
     return std::move(*error);
   }
 
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   sampling_delegation_.received_matching_response_header = true;
   // Overwrite any existing sampling decision if and only if the existing
   // decision is not a local manual override.
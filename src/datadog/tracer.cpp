@@ -2,9 +2,12 @@
 #include <datadog/environment.h>
 #include <datadog/id_generator.h>
 #include <datadog/logger.h>
+#include <datadog/null_collector.h>
 #include <datadog/runtime_id.h>
 #include <datadog/span.h>
 #include <datadog/span_config.h>
+#include <datadog/span_template.h>
+#include <datadog/trace_context.h>
 #include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_signature.h>
@@ -12,20 +15,30 @@
 
 #include <algorithm>
 #include <cassert>
-
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "background_worker.h"
+#include "block_cache.h"
 #include "config_manager.h"
 #include "datadog_agent.h"
 #include "extracted_data.h"
 #include "extraction_util.h"
 #include "hex.h"
 #include "json.hpp"
+#include "memory_budget.h"
 #include "platform_util.h"
 #include "span_data.h"
 #include "span_sampler.h"
 #include "tags.h"
+#include "tail_sampling_policy.h"
 #include "trace_sampler.h"
 #include "tracer_telemetry.h"
 #include "w3c_propagation.h"
+#include "worker_pool.h"
 
 namespace datadog {
 namespace tracing {
@@ -34,6 +47,64 @@ void to_json(nlohmann::json& j, const PropagationStyle& style) {
   j = to_string_view(style);
 }
 
+namespace {
+
+// Keep the specified `object` alive until the process exits.
+void abandon(std::shared_ptr<void> object) {
+  static auto* const abandoned = new std::vector<std::shared_ptr<void>>();
+  abandoned->push_back(std::move(object));
+}
+
+// Return `hex_padded(high)`, where `high` is the high word of a trace ID.  The
+// high word is the trace's start time in seconds, so consecutive traces
+// created on a thread usually share it, and the last one formatted is kept.
+const std::string& hex_padded_high(std::uint64_t high) {
+  thread_local std::uint64_t cached_high = 0;
+  thread_local std::string cached_hex;
+  if (high != cached_high || cached_hex.empty()) {
+    cached_high = high;
+    cached_hex = hex_padded(high);
+  }
+  return cached_hex;
+}
+
+// Return a function that returns the greatest length of a value of the tag
+// having a given name, as `TraceSegment::tag_value_limit` does for segments
+// that share the specified `context`.
+auto tag_value_limiter(const TraceSegmentContext& context) {
+  return [&context](StringView name) {
+    return tags::tag_value_limit(name, context.max_tag_value_length,
+                                 context.tag_value_length_limits);
+  };
+}
+
+}  // namespace
+
+struct Tracer::DeferredStart {
+  std::once_flag once;
+  bool done = false;
+  std::shared_ptr<DatadogAgent> agent;
+  std::unordered_map<ConfigName, ConfigMetadata> metadata;
+  bool log_on_startup;
+};
+
+struct Tracer::ConfigCache {
+  std::mutex mutex;
+  // The parts of the configuration that never change.  Null until first
+  // needed.
+  Optional<nlohmann::json> base;
+  // The serialized configuration, and the `ConfigManager::generation` that it
+  // reflects.
+  Optional<std::string> serialized;
+  std::uint64_t generation = 0;
+};
+
+struct Tracer::ExtractionBatch {
+  std::shared_ptr<const SpanDefaults> span_defaults;
+  std::shared_ptr<TraceSampler> trace_sampler;
+  bool reports_traces;
+};
+
 Tracer::Tracer(const FinalizedTracerConfig& config)
     : Tracer(config, default_id_generator(config.generate_128bit_trace_ids)) {}
 
@@ -43,103 +114,303 @@ Tracer::Tracer(const FinalizedTracerConfig& config,
       runtime_id_(config.runtime_id ? *config.runtime_id
                                     : RuntimeID::generate()),
       signature_{runtime_id_, config.defaults.service,
-                 config.defaults.environment},
+                 config.defaults.environment, config.defaults.version},
       tracer_telemetry_(std::make_shared<TracerTelemetry>(
           config.telemetry.enabled, config.clock, logger_, signature_,
-          config.integration_name, config.integration_version)),
+          config.integration_name, config.integration_version,
+          std::vector<std::shared_ptr<telemetry::Metric>>{},
+          config.stage_timing ? std::make_shared<StageTimings>() : nullptr,
+          config.memory_budget,
+          std::vector<std::shared_ptr<telemetry::CounterFamily>>{},
+          TelemetryCadence{config.telemetry.metrics_capture_interval,
+                           config.telemetry.metrics_interval,
+                           config.telemetry.report_metrics})),
       config_manager_(std::make_shared<ConfigManager>(config, signature_,
                                                       tracer_telemetry_)),
       collector_(/* see constructor body */),
-      span_sampler_(
-          std::make_shared<SpanSampler>(config.span_sampler, config.clock)),
-      generator_(generator),
-      clock_(config.clock),
-      injection_styles_(config.injection_styles),
       extraction_styles_(config.extraction_styles),
-      tags_header_max_size_(config.tags_header_size),
-      sampling_delegation_enabled_(config.delegate_trace_sampling) {
-  if (config.report_hostname) {
-    hostname_ = get_hostname();
+      early_sampling_decision_(config.early_sampling_decision),
+      single_pass_extraction_(config.single_pass_extraction),
+      null_collector_(false),
+      thread_factory_(config.thread_factory),
+      config_cache_(std::make_shared<ConfigCache>()) {
+  if (config.memory_resource) {
+    auto installed = install_memory_resource(config.memory_resource);
+    if (auto* error = installed.if_error()) {
+      logger_->log_error(*error);
+    }
   }
+
+  std::shared_ptr<WorkerPool> workers;
+  if (config.parallel_finalization_min_spans) {
+    workers = std::make_shared<WorkerPool>(
+        config.parallel_finalization_threads,
+        config.parallel_finalization_min_spans, thread_factory_);
+  }
+
+  std::shared_ptr<DatadogAgent> agent;
+  bool lazy_start = false;
   if (auto* collector =
           std::get_if<std::shared_ptr<Collector>>(&config.collector)) {
     collector_ = *collector;
+    null_collector_ = dynamic_cast<NullCollector*>(collector_.get()) != nullptr;
   } else {
-    auto& agent_config =
-        std::get<FinalizedDatadogAgentConfig>(config.collector);
-
-    auto rc_listeners = agent_config.remote_configuration_listeners;
-    rc_listeners.emplace_back(config_manager_);
-    auto agent =
-        std::make_shared<DatadogAgent>(agent_config, tracer_telemetry_,
-                                       config.logger, signature_, rc_listeners);
+    agent_config_ = std::make_shared<FinalizedDatadogAgentConfig>(
+        std::get<FinalizedDatadogAgentConfig>(config.collector));
+    agent = make_agent(workers);
     collector_ = agent;
+    lazy_start = agent_config_->lazy_start;
+    if (auto rates = agent->saved_rates()) {
+      config_manager_->trace_sampler()->handle_collector_response(*rates);
+    }
+  }
+
+  auto context = std::make_shared<TraceSegmentContext>();
+  context->logger = logger_;
+  context->collector = collector_;
+  context->tracer_telemetry = tracer_telemetry_;
+  context->span_sampler =
+      std::make_shared<SpanSampler>(config.span_sampler, config.clock);
+  context->config_manager = config_manager_;
+  context->id_generator = generator;
+  context->clock = config.clock;
+  context->steady_clock_ticks =
+      config.clock.target_type() == default_clock.target_type() ||
+      config.clock.target_type() == fast_clock.target_type();
+  context->runtime_id = runtime_id_.string();
+  context->injection_styles = config.injection_styles;
+  unsigned seen_styles = 0;
+  for (const auto style : config.injection_styles) {
+    const unsigned style_bit = 1u << static_cast<unsigned>(style);
+    if (style == PropagationStyle::NONE || (seen_styles & style_bit)) {
+      continue;
+    }
+    seen_styles |= style_bit;
+    context->injected_styles.push_back(style);
+  }
+  context->injects_datadog =
+      seen_styles & (1u << static_cast<unsigned>(PropagationStyle::DATADOG));
+  if (config.report_hostname) {
+    context->hostname = get_hostname();
+  }
+  context->tags_header_max_size = config.tags_header_size;
+  context->max_tag_value_length = config.max_tag_value_length;
+  context->tag_value_length_limits.assign(
+      config.tag_value_length_limits.begin(),
+      config.tag_value_length_limits.end());
+  context->partial_flush_min_spans =
+      config.partial_flush_enabled ? config.partial_flush_min_spans : 0;
+  context->max_spans_per_trace = config.max_spans_per_trace;
+  // Client-side stats need every span, so spans are not summarized.
+  context->span_summary_min_spans =
+      agent_config_ && agent_config_->stats_computation_enabled
+          ? 0
+          : config.span_summary_min_spans;
+  if (config.background_finalization) {
+    context->finalizer = std::make_shared<BackgroundWorker>(thread_factory_);
+  }
+  context->workers = std::move(workers);
+  context->sampling_delegation_enabled = config.delegate_trace_sampling;
+  if (config.trace_sampler.tail_policy) {
+    context->tail_policy =
+        std::make_shared<TailSamplingPolicy>(*config.trace_sampler.tail_policy);
+  }
+  segment_context_ = std::move(context);
 
+  if (lazy_start) {
+    deferred_start_ = std::make_shared<DeferredStart>();
+    deferred_start_->agent = std::move(agent);
+    deferred_start_->metadata = config.metadata;
+    deferred_start_->log_on_startup = config.log_on_startup;
+  } else {
+    start(agent.get(), config.metadata, config.log_on_startup);
+  }
+}
+
+void Tracer::start(
+    DatadogAgent* agent,
+    const std::unordered_map<ConfigName, ConfigMetadata>& metadata,
+    bool log_on_startup) {
+  if (agent) {
+    agent->start();
     if (tracer_telemetry_->enabled()) {
-      agent->send_app_started(config.metadata);
+      agent->send_app_started(metadata);
     }
   }
 
-  if (config.log_on_startup) {
+  if (log_on_startup) {
     logger_->log_startup([configuration = this->config()](std::ostream& log) {
       log << "DATADOG TRACER CONFIGURATION - " << configuration;
     });
   }
 }
 
+void Tracer::start_if_deferred() {
+  if (deferred_start_) {
+    std::call_once(deferred_start_->once, [this]() {
+      start(deferred_start_->agent.get(), deferred_start_->metadata,
+            deferred_start_->log_on_startup);
+      deferred_start_->done = true;
+    });
+  }
+}
+
+std::shared_ptr<DatadogAgent> Tracer::make_agent(
+    const std::shared_ptr<WorkerPool>& workers) {
+  auto rc_listeners = agent_config_->remote_configuration_listeners;
+  rc_listeners.emplace_back(config_manager_);
+  return std::make_shared<DatadogAgent>(*agent_config_, tracer_telemetry_,
+                                        logger_, signature_, rc_listeners,
+                                        workers, config_manager_);
+}
+
+void Tracer::reinitialize_after_fork() {
+  auto context = std::make_shared<TraceSegmentContext>(*segment_context_);
+  if (context->finalizer) {
+    context->finalizer = std::make_shared<BackgroundWorker>(thread_factory_);
+  }
+  if (context->workers) {
+    context->workers = std::make_shared<WorkerPool>(
+        context->workers->threads(), context->workers->min_items(),
+        thread_factory_);
+  }
+  if (!agent_config_) {
+    segment_context_ = std::move(context);
+    return;
+  }
+
+  // The parent's agent must not be destroyed here, since its destructor
+  // would wait for threads that do not exist in this process.
+  abandon(collector_);
+  renew_default_runtime(*agent_config_, logger_);
+  auto agent = make_agent(context->workers);
+  collector_ = agent;
+  context->collector = agent;
+  segment_context_ = std::move(context);
+
+  if (deferred_start_ && !deferred_start_->done) {
+    // The parent never started, so the child starts on its first span, as
+    // the parent would have.
+    auto deferred = std::make_shared<DeferredStart>();
+    deferred->agent = agent;
+    deferred->metadata = deferred_start_->metadata;
+    deferred->log_on_startup = deferred_start_->log_on_startup;
+    deferred_start_ = std::move(deferred);
+  } else {
+    // The parent already logged its configuration and announced itself to
+    // telemetry, so only the agent's recurring tasks remain to be started.
+    agent->start();
+    deferred_start_ = nullptr;
+  }
+}
+
+bool Tracer::reports_traces() const {
+  return !null_collector_ && config_manager_->report_traces();
+}
+
 std::string Tracer::config() const {
-  // clang-format off
-  auto config = nlohmann::json::object({
-    {"version", tracer_version_string},
-    {"runtime_id", runtime_id_.string()},
-    {"collector", nlohmann::json::parse(collector_->config())},
-    {"span_sampler", span_sampler_->config_json()},
-    {"injection_styles", injection_styles_},
-    {"extraction_styles", extraction_styles_},
-    {"tags_header_size", tags_header_max_size_},
-    {"environment_variables", nlohmann::json::parse(environment::to_json())},
-  });
-  // clang-format on
+  // Read the generation before the configuration, so that an update in
+  // between makes the cached result look stale rather than current.
+  const std::uint64_t generation = config_manager_->generation();
+  auto& cache = *config_cache_;
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  if (cache.serialized && cache.generation == generation) {
+    return *cache.serialized;
+  }
+
+  if (!cache.base) {
+    // clang-format off
+    cache.base = nlohmann::json::object({
+      {"version", tracer_version_string},
+      {"runtime_id", runtime_id_.string()},
+      {"collector", nlohmann::json::parse(collector_->config())},
+      {"span_sampler", segment_context_->span_sampler->config_json()},
+      {"injection_styles", segment_context_->injection_styles},
+      {"extraction_styles", extraction_styles_},
+      {"tags_header_size", segment_context_->tags_header_max_size},
+      {"environment_variables", nlohmann::json::parse(environment::to_json())},
+    });
+    // clang-format on
+
+    if (const auto& hostname = segment_context_->hostname) {
+      (*cache.base)["hostname"] = *hostname;
+    }
+  }
 
+  auto config = *cache.base;
   config.merge_patch(config_manager_->config_json());
 
-  if (hostname_) {
-    config["hostname"] = *hostname_;
+  cache.serialized = config.dump();
+  cache.generation = generation;
+  return *cache.serialized;
+}
+
+Pressure Tracer::pressure() const {
+  const Pressure pressure = collector_->pressure();
+  switch (tracer_telemetry_->memory_budget()->state()) {
+    case MemoryBudget::SHED:
+      return Pressure::HIGH;
+    case MemoryBudget::FLUSH:
+      return pressure == Pressure::NORMAL ? Pressure::ELEVATED : pressure;
+    default:
+      return pressure;
   }
+}
 
-  return config.dump();
+std::shared_ptr<StageTimings> Tracer::stage_timings() const {
+  return tracer_telemetry_->stage_timings();
 }
 
 Span Tracer::create_span() { return create_span(SpanConfig{}); }
 
 Span Tracer::create_span(const SpanConfig& config) {
+  return create_span_from(config);
+}
+
+Span Tracer::create_span(SpanConfig&& config) {
+  return create_span_from(std::move(config));
+}
+
+Span Tracer::create_span(const SpanTemplate& span_template) {
+  return create_span_from(span_template);
+}
+
+template <typename Config>
+Span Tracer::create_span_from(Config&& config) {
+  start_if_deferred();
+  StageTimer timer{tracer_telemetry_->stage(&StageTimings::create_span)};
   auto defaults = config_manager_->span_defaults();
   auto span_data = std::make_unique<SpanData>();
-  span_data->apply_config(*defaults, config, clock_);
-  span_data->trace_id = generator_->trace_id(span_data->start);
+  span_data->apply_config(defaults, std::forward<Config>(config),
+                          segment_context_->clock,
+                          tag_value_limiter(*segment_context_));
+  span_data->trace_id =
+      segment_context_->id_generator->trace_id(span_data->start);
   span_data->span_id = span_data->trace_id.low;
   span_data->parent_id = 0;
 
   std::vector<std::pair<std::string, std::string>> trace_tags;
   if (span_data->trace_id.high) {
     trace_tags.emplace_back(tags::internal::trace_id_high,
-                            hex_padded(span_data->trace_id.high));
+                            hex_padded_high(span_data->trace_id.high));
   }
 
   const auto span_data_ptr = span_data.get();
   tracer_telemetry_->metrics().tracer.trace_segments_created_new.inc();
-  const auto segment = std::make_shared<TraceSegment>(
-      logger_, collector_, tracer_telemetry_, config_manager_->trace_sampler(),
-      span_sampler_, defaults, config_manager_, runtime_id_,
-      sampling_delegation_enabled_,
-      false /* sampling_decision_was_delegated_to_me */, injection_styles_,
-      hostname_, nullopt /* origin */, tags_header_max_size_,
-      std::move(trace_tags), nullopt /* sampling_decision */,
+  const auto segment = std::allocate_shared<TraceSegment>(
+      CachingAllocator<TraceSegment>{}, segment_context_,
+      config_manager_->trace_sampler(), defaults,
+      false /* sampling_decision_was_delegated_to_me */, nullopt /* origin */,
+      std::move(trace_tags), nullopt /* extracted_trace_tags */,
+      nullopt /* sampling_decision */,
       nullopt /* additional_w3c_tracestate */,
       nullopt /* additional_datadog_w3c_tracestate*/, std::move(span_data));
-  Span span{span_data_ptr, segment,
-            [generator = generator_]() { return generator->span_id(); },
-            clock_};
+  if (!reports_traces()) {
+    segment->disable_recording();
+  } else if (early_sampling_decision_) {
+    segment->make_early_sampling_decision();
+  }
+  Span span{span_data_ptr, segment};
   return span;
 }
 
@@ -147,39 +418,43 @@ Expected<Span> Tracer::extract_span(const DictReader& reader) {
   return extract_span(reader, SpanConfig{});
 }
 
-Expected<Span> Tracer::extract_span(const DictReader& reader,
-                                    const SpanConfig& config) {
+Tracer::ExtractionBatch Tracer::begin_extraction() {
+  start_if_deferred();
+  ExtractionBatch batch;
+  batch.span_defaults = config_manager_->span_defaults();
+  batch.trace_sampler = config_manager_->trace_sampler();
+  batch.reports_traces = reports_traces();
+  return batch;
+}
+
+template <typename OnError>
+Optional<Span> Tracer::extract_span_from(const DictReader& reader,
+                                         const SpanConfig& config,
+                                         const ExtractionBatch& batch,
+                                         std::uint64_t span_id,
+                                         OnError&& on_error) {
   assert(!extraction_styles_.empty());
+  StageTimer timer{tracer_telemetry_->stage(&StageTimings::extract_span)};
 
-  AuditedReader audited_reader{reader};
+  Optional<PrefetchedReader> prefetched;
+  if (single_pass_extraction_) {
+    prefetched.emplace(reader);
+  }
+  const DictReader& headers = prefetched ? *prefetched : reader;
 
   auto span_data = std::make_unique<SpanData>();
   Optional<PropagationStyle> first_style_with_trace_id;
   Optional<PropagationStyle> first_style_with_parent_id;
-  std::unordered_map<PropagationStyle, ExtractedData> extracted_contexts;
+  ExtractedContexts extracted_contexts;
 
   for (const auto style : extraction_styles_) {
-    using Extractor = decltype(&extract_datadog);  // function pointer
-    Extractor extract;
-    switch (style) {
-      case PropagationStyle::DATADOG:
-        extract = &extract_datadog;
-        break;
-      case PropagationStyle::B3:
-        extract = &extract_b3;
-        break;
-      case PropagationStyle::W3C:
-        extract = &extract_w3c;
-        break;
-      default:
-        assert(style == PropagationStyle::NONE);
-        extract = &extract_none;
-    }
-    audited_reader.entries_found.clear();
-    auto data = extract(audited_reader, span_data->tags, *logger_);
+    auto data = extractor(style)(headers, span_data->tags, *logger_);
     if (auto* error = data.if_error()) {
-      return error->with_prefix(
-          extraction_error_prefix(style, audited_reader.entries_found));
+      on_error([&]() {
+        return error->with_prefix(
+            extraction_error_prefix(style, headers_examined(headers, style)));
+      });
+      return nullopt;
     }
 
     if (!first_style_with_trace_id && data->trace_id.has_value()) {
@@ -190,7 +465,6 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
       first_style_with_parent_id = style;
     }
 
-    data->headers_examined = audited_reader.entries_found;
     extracted_contexts.emplace(style, std::move(*data));
   }
 
@@ -201,12 +475,13 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
     // The purpose of looking for a parent ID is to allow for the error
     // "extracted a parent ID without a trace ID," if that's what happened.
     if (first_style_with_parent_id) {
-      auto other = extracted_contexts.find(*first_style_with_parent_id);
-      assert(other != extracted_contexts.end());
-      merged_context = other->second;
+      auto* other = extracted_contexts.find(*first_style_with_parent_id);
+      assert(other);
+      merged_context = std::move(*other);
     }
   } else {
-    merged_context = merge(*first_style_with_trace_id, extracted_contexts);
+    merged_context =
+        merge(*first_style_with_trace_id, std::move(extracted_contexts));
   }
 
   // Some information might be missing.
@@ -224,35 +499,49 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
   // - trace ID and parent ID means we're extracting a child span
   // - if trace ID is zero, then that's an error.
 
+  // The error messages below describe the headers examined, which means
+  // reading the headers again, so they are formatted only if wanted.
   if (!merged_context.trace_id && !merged_context.parent_id) {
-    return Error{Error::NO_SPAN_TO_EXTRACT,
-                 "There's neither a trace ID nor a parent span ID to extract."}
-        .with_prefix(extraction_error_prefix(merged_context.style,
-                                             merged_context.headers_examined));
+    on_error([&]() {
+      return Error{
+          Error::NO_SPAN_TO_EXTRACT,
+          "There's neither a trace ID nor a parent span ID to extract."}
+          .with_prefix(extraction_error_prefix(
+              merged_context.style,
+              headers_examined(headers, merged_context)));
+    });
+    return nullopt;
   }
   if (!merged_context.trace_id) {
-    std::string message;
-    message +=
-        "There's no trace ID to extract, but there is a parent span ID: ";
-    message += std::to_string(*merged_context.parent_id);
-    return Error{Error::MISSING_TRACE_ID, std::move(message)}.with_prefix(
-        extraction_error_prefix(merged_context.style,
-                                merged_context.headers_examined));
+    on_error([&]() {
+      std::string message;
+      message +=
+          "There's no trace ID to extract, but there is a parent span ID: ";
+      message += std::to_string(*merged_context.parent_id);
+      return Error{Error::MISSING_TRACE_ID, std::move(message)}.with_prefix(
+          extraction_error_prefix(merged_context.style,
+                                  headers_examined(headers, merged_context)));
+    });
+    return nullopt;
   }
   if (!merged_context.parent_id && !merged_context.origin) {
-    std::string message;
-    message +=
-        "There's no parent span ID to extract, but there is a trace ID: ";
-    message += "[hexadecimal = ";
-    message += merged_context.trace_id->hex_padded();
-    if (merged_context.trace_id->high == 0) {
-      message += ", decimal = ";
-      message += std::to_string(merged_context.trace_id->low);
-    }
-    message += ']';
-    return Error{Error::MISSING_PARENT_SPAN_ID, std::move(message)}.with_prefix(
-        extraction_error_prefix(merged_context.style,
-                                merged_context.headers_examined));
+    on_error([&]() {
+      std::string message;
+      message +=
+          "There's no parent span ID to extract, but there is a trace ID: ";
+      message += "[hexadecimal = ";
+      message += merged_context.trace_id->hex_padded();
+      if (merged_context.trace_id->high == 0) {
+        message += ", decimal = ";
+        message += std::to_string(merged_context.trace_id->low);
+      }
+      message += ']';
+      return Error{Error::MISSING_PARENT_SPAN_ID, std::move(message)}
+          .with_prefix(extraction_error_prefix(
+              merged_context.style,
+              headers_examined(headers, merged_context)));
+    });
+    return nullopt;
   }
 
   if (!merged_context.parent_id) {
@@ -266,16 +555,21 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
   assert(merged_context.trace_id);
 
   if (*merged_context.trace_id == 0) {
-    return Error{Error::ZERO_TRACE_ID,
-                 "extracted zero value for trace ID, which is invalid"}
-        .with_prefix(extraction_error_prefix(merged_context.style,
-                                             merged_context.headers_examined));
+    on_error([&]() {
+      return Error{Error::ZERO_TRACE_ID,
+                   "extracted zero value for trace ID, which is invalid"}
+          .with_prefix(extraction_error_prefix(
+              merged_context.style,
+              headers_examined(headers, merged_context)));
+    });
+    return nullopt;
   }
 
   // We're done extracting fields.  Now create the span.
   // This is similar to what we do in `create_span`.
-  span_data->apply_config(*config_manager_->span_defaults(), config, clock_);
-  span_data->span_id = generator_->span_id();
+  span_data->apply_config(batch.span_defaults, config, segment_context_->clock,
+                          tag_value_limiter(*segment_context_));
+  span_data->span_id = span_id;
   span_data->trace_id = *merged_context.trace_id;
   span_data->parent_id = *merged_context.parent_id;
 
@@ -286,7 +580,7 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
     //
     // First, though, if the `trace_id_high` tag is already set and has a
     // bogus value or a value inconsistent with the trace ID, tag an error.
-    const auto hex_high = hex_padded(span_data->trace_id.high);
+    auto hex_high = hex_padded(span_data->trace_id.high);
     const auto extant =
         std::find_if(merged_context.trace_tags.begin(),
                      merged_context.trace_tags.end(), [&](const auto& pair) {
@@ -294,7 +588,8 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
                      });
     if (extant == merged_context.trace_tags.end()) {
       merged_context.trace_tags.emplace_back(tags::internal::trace_id_high,
-                                             hex_high);
+                                             std::move(hex_high));
+      merged_context.raw_trace_tags.reset();
     } else {
       // There is already a `trace_id_high` tag. `hex_high` is its proper
       // value. Check if the extant value is malformed or different from
@@ -304,22 +599,25 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
       if (!high) {
         span_data->tags[tags::internal::propagation_error] =
             "malformed_tid " + extant->second;
-        extant->second = hex_high;
+        extant->second = std::move(hex_high);
+        merged_context.raw_trace_tags.reset();
       } else if (*high != span_data->trace_id.high) {
         span_data->tags[tags::internal::propagation_error] =
             "inconsistent_tid " + extant->second;
-        extant->second = hex_high;
+        extant->second = std::move(hex_high);
+        merged_context.raw_trace_tags.reset();
       }
     }
   }
 
   if (merged_context.datadog_w3c_parent_id) {
     span_data->tags[tags::internal::w3c_parent_id] =
-        *merged_context.datadog_w3c_parent_id;
+        std::move(*merged_context.datadog_w3c_parent_id);
   }
 
   const bool delegate_sampling_decision =
-      sampling_delegation_enabled_ && merged_context.delegate_sampling_decision;
+      segment_context_->sampling_delegation_enabled &&
+      merged_context.delegate_sampling_decision;
 
   Optional<SamplingDecision> sampling_decision;
   if (!delegate_sampling_decision && merged_context.sampling_priority) {
@@ -334,20 +632,61 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
 
   const auto span_data_ptr = span_data.get();
   tracer_telemetry_->metrics().tracer.trace_segments_created_continued.inc();
-  const auto segment = std::make_shared<TraceSegment>(
-      logger_, collector_, tracer_telemetry_, config_manager_->trace_sampler(),
-      span_sampler_, config_manager_->span_defaults(), config_manager_,
-      runtime_id_, sampling_delegation_enabled_, delegate_sampling_decision,
-      injection_styles_, hostname_, std::move(merged_context.origin),
-      tags_header_max_size_, std::move(merged_context.trace_tags),
-      std::move(sampling_decision),
+  const auto segment = std::allocate_shared<TraceSegment>(
+      CachingAllocator<TraceSegment>{}, segment_context_, batch.trace_sampler,
+      batch.span_defaults, delegate_sampling_decision,
+      std::move(merged_context.origin), std::move(merged_context.trace_tags),
+      std::move(merged_context.raw_trace_tags), std::move(sampling_decision),
       std::move(merged_context.additional_w3c_tracestate),
       std::move(merged_context.additional_datadog_w3c_tracestate),
       std::move(span_data));
-  Span span{span_data_ptr, segment,
-            [generator = generator_]() { return generator->span_id(); },
-            clock_};
-  return span;
+  if (!batch.reports_traces) {
+    segment->disable_recording();
+  } else if (early_sampling_decision_) {
+    segment->make_early_sampling_decision();
+  }
+  return Span{span_data_ptr, segment};
+}
+
+Expected<Span> Tracer::extract_span(const DictReader& reader,
+                                    const SpanConfig& config) {
+  Optional<Error> error;
+  auto span = extract_span_from(
+      reader, config, begin_extraction(),
+      segment_context_->id_generator->span_id(),
+      [&](auto&& make_error) { error = make_error(); });
+  if (!span) {
+    return std::move(*error);
+  }
+  return std::move(*span);
+}
+
+std::vector<Expected<Span>> Tracer::extract_spans(
+    const DictReader* const* readers, std::size_t count) {
+  return extract_spans(readers, count, SpanConfig{});
+}
+
+std::vector<Expected<Span>> Tracer::extract_spans(
+    const DictReader* const* readers, std::size_t count,
+    const SpanConfig& config) {
+  const ExtractionBatch batch = begin_extraction();
+  std::vector<std::uint64_t> ids(count);
+  segment_context_->id_generator->span_ids(ids.data(), count);
+
+  std::vector<Expected<Span>> spans;
+  spans.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    Optional<Error> error;
+    auto span = extract_span_from(
+        *readers[i], config, batch, ids[i],
+        [&](auto&& make_error) { error = make_error(); });
+    if (span) {
+      spans.emplace_back(std::move(*span));
+    } else {
+      spans.emplace_back(std::move(*error));
+    }
+  }
+  return spans;
 }
 
 Span Tracer::extract_or_create_span(const DictReader& reader) {
@@ -356,12 +695,59 @@ Span Tracer::extract_or_create_span(const DictReader& reader) {
 
 Span Tracer::extract_or_create_span(const DictReader& reader,
                                     const SpanConfig& config) {
-  auto maybe_span = extract_span(reader, config);
-  if (maybe_span) {
-    return std::move(*maybe_span);
+  // Whatever prevented extraction, a new trace is created instead, so there is
+  // no need to describe it.
+  auto span = extract_span_from(reader, config, begin_extraction(),
+                                segment_context_->id_generator->span_id(),
+                                [](auto&&) {});
+  if (span) {
+    return std::move(*span);
   }
   return create_span(config);
 }
 
+Span Tracer::continue_trace(TraceContext context) {
+  return continue_trace(std::move(context), SpanConfig{});
+}
+
+Span Tracer::continue_trace(TraceContext context, const SpanConfig& config) {
+  assert(context.trace_id != 0);
+  start_if_deferred();
+  StageTimer timer{tracer_telemetry_->stage(&StageTimings::extract_span)};
+
+  // This is what `extract_span_from` does once it has parsed the trace
+  // context, except that `context` came from a segment of this process, and
+  // so needs no validation.
+  auto span_data = std::make_unique<SpanData>();
+  span_data->apply_config(config_manager_->span_defaults(), config,
+                          segment_context_->clock,
+                          tag_value_limiter(*segment_context_));
+  span_data->span_id = segment_context_->id_generator->span_id();
+  span_data->trace_id = context.trace_id;
+  span_data->parent_id = context.parent_id;
+
+  SamplingDecision decision;
+  decision.priority = context.sampling_priority;
+  decision.origin = SamplingDecision::Origin::EXTRACTED;
+
+  const auto span_data_ptr = span_data.get();
+  tracer_telemetry_->metrics().tracer.trace_segments_created_continued.inc();
+  const auto segment = std::allocate_shared<TraceSegment>(
+      CachingAllocator<TraceSegment>{}, segment_context_,
+      config_manager_->trace_sampler(), config_manager_->span_defaults(),
+      false /* sampling_decision_was_delegated_to_me */,
+      std::move(context.origin), std::move(context.trace_tags),
+      nullopt /* extracted_trace_tags */, decision,
+      std::move(context.additional_w3c_tracestate),
+      std::move(context.additional_datadog_w3c_tracestate),
+      std::move(span_data));
+  if (!reports_traces()) {
+    segment->disable_recording();
+  } else if (early_sampling_decision_) {
+    segment->make_early_sampling_decision();
+  }
+  return Span{span_data_ptr, segment};
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -5,15 +5,18 @@
 #include <algorithm>
 #include <cassert>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "async_cerr_logger.h"
 #include "cerr_logger.h"
 #include "datadog_agent.h"
 #include "json.hpp"
 #include "parse_util.h"
 #include "platform_util.h"
 #include "string_util.h"
+#include "tags.h"
 
 namespace datadog {
 namespace tracing {
@@ -116,6 +119,39 @@ Expected<TracerConfig> load_tracer_env_config(Logger &logger) {
     env_cfg.tags = std::move(*tags);
   }
 
+  if (auto max_length_env =
+          lookup(environment::DD_TRACE_TAG_VALUE_MAX_LENGTH)) {
+    auto max_length = parse_uint64(*max_length_env, 10);
+    if (auto *error = max_length.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      append(prefix, name(environment::DD_TRACE_TAG_VALUE_MAX_LENGTH));
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    env_cfg.max_tag_value_length = *max_length;
+  }
+
+  if (auto limits_env = lookup(environment::DD_TRACE_TAG_VALUE_LENGTH_LIMITS)) {
+    std::string prefix;
+    prefix += "Unable to parse ";
+    append(prefix, name(environment::DD_TRACE_TAG_VALUE_LENGTH_LIMITS));
+    prefix += " environment variable: ";
+    auto pairs = parse_tags(*limits_env);
+    if (auto *error = pairs.if_error()) {
+      return error->with_prefix(prefix);
+    }
+    std::unordered_map<std::string, std::size_t> limits;
+    for (const auto &[tag_name, raw_limit] : *pairs) {
+      auto limit = parse_uint64(raw_limit, 10);
+      if (auto *error = limit.if_error()) {
+        return error->with_prefix(prefix);
+      }
+      limits.emplace(tag_name, *limit);
+    }
+    env_cfg.tag_value_length_limits = std::move(limits);
+  }
+
   if (auto startup_env = lookup(environment::DD_TRACE_STARTUP_LOGS)) {
     env_cfg.log_on_startup = !falsy(*startup_env);
   }
@@ -130,6 +166,83 @@ Expected<TracerConfig> load_tracer_env_config(Logger &logger) {
           lookup(environment::DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED)) {
     env_cfg.generate_128bit_trace_ids = !falsy(*enabled_env);
   }
+  if (auto enabled_env =
+          lookup(environment::DD_TRACE_BACKGROUND_FINALIZATION_ENABLED)) {
+    env_cfg.background_finalization = !falsy(*enabled_env);
+  }
+  if (auto enabled_env =
+          lookup(environment::DD_TRACE_EARLY_SAMPLING_DECISION_ENABLED)) {
+    env_cfg.early_sampling_decision = !falsy(*enabled_env);
+  }
+  if (auto enabled_env =
+          lookup(environment::DD_TRACE_SINGLE_PASS_EXTRACTION_ENABLED)) {
+    env_cfg.single_pass_extraction = !falsy(*enabled_env);
+  }
+  if (auto enabled_env = lookup(environment::DD_TRACE_STAGE_TIMING_ENABLED)) {
+    env_cfg.stage_timing = !falsy(*enabled_env);
+  }
+  if (auto enabled_env = lookup(environment::DD_TRACE_PARTIAL_FLUSH_ENABLED)) {
+    env_cfg.partial_flush_enabled = !falsy(*enabled_env);
+  }
+  if (auto min_spans_env =
+          lookup(environment::DD_TRACE_PARTIAL_FLUSH_MIN_SPANS)) {
+    auto min_spans = parse_uint64(*min_spans_env, 10);
+    if (auto *error = min_spans.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      append(prefix, name(environment::DD_TRACE_PARTIAL_FLUSH_MIN_SPANS));
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    env_cfg.partial_flush_min_spans = *min_spans;
+  }
+  if (auto max_spans_env = lookup(environment::DD_TRACE_MAX_SPANS_PER_TRACE)) {
+    auto max_spans = parse_uint64(*max_spans_env, 10);
+    if (auto *error = max_spans.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      append(prefix, name(environment::DD_TRACE_MAX_SPANS_PER_TRACE));
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    env_cfg.max_spans_per_trace = *max_spans;
+  }
+  if (auto summary_env =
+          lookup(environment::DD_TRACE_SPAN_SUMMARY_MIN_SPANS)) {
+    auto min_spans = parse_uint64(*summary_env, 10);
+    if (auto *error = min_spans.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      append(prefix, name(environment::DD_TRACE_SPAN_SUMMARY_MIN_SPANS));
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    env_cfg.span_summary_min_spans = *min_spans;
+  }
+  if (auto parallel_env =
+          lookup(environment::DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS)) {
+    auto min_spans = parse_uint64(*parallel_env, 10);
+    if (auto *error = min_spans.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      append(prefix,
+             name(environment::DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS));
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    env_cfg.parallel_finalization_min_spans = *min_spans;
+  }
+  if (auto budget_env = lookup(environment::DD_TRACE_MEMORY_BUDGET_BYTES)) {
+    auto budget = parse_uint64(*budget_env, 10);
+    if (auto *error = budget.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      append(prefix, name(environment::DD_TRACE_MEMORY_BUDGET_BYTES));
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    env_cfg.memory_budget = *budget;
+  }
 
   // PropagationStyle
   // Print a warning if a questionable combination of environment variables is
@@ -239,8 +352,23 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &config) {
 
 Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &user_config,
                                                 const Clock &clock) {
-  auto logger =
-      user_config.logger ? user_config.logger : std::make_shared<CerrLogger>();
+  // The logger is needed to load the rest of the environment, and so its
+  // environment variable is looked up here.
+  std::shared_ptr<Logger> logger = user_config.logger;
+  if (!logger) {
+    bool async_logging = user_config.async_logging.value_or(false);
+    if (auto enabled_env =
+            lookup(environment::DD_TRACE_ASYNC_LOGGING_ENABLED)) {
+      async_logging = !falsy(*enabled_env);
+    }
+    if (async_logging) {
+      AsyncCerrLogger::Options options;
+      options.thread_factory = user_config.thread_factory;
+      logger = std::make_shared<AsyncCerrLogger>(options);
+    } else {
+      logger = std::make_shared<CerrLogger>();
+    }
+  }
 
   Expected<TracerConfig> env_config = load_tracer_env_config(*logger);
   if (auto error = env_config.if_error()) {
@@ -250,6 +378,8 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &user_config,
   FinalizedTracerConfig final_config;
   final_config.clock = clock;
   final_config.logger = logger;
+  final_config.memory_resource = user_config.memory_resource;
+  final_config.thread_factory = user_config.thread_factory;
 
   ConfigMetadata::Origin origin;
 
@@ -342,6 +472,82 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &user_config,
   final_config.tags_header_size = value_or(
       env_config->max_tags_header_size, user_config.max_tags_header_size, 512);
 
+  // Tag Value Lengths
+  final_config.max_tag_value_length = value_or(
+      env_config->max_tag_value_length, user_config.max_tag_value_length, 0);
+  final_config.tag_value_length_limits =
+      value_or(env_config->tag_value_length_limits,
+               user_config.tag_value_length_limits,
+               std::unordered_map<std::string, std::size_t>{});
+  // Spans inherit the default tags rather than copy them, so the default tags
+  // are truncated once, here.
+  tags::truncate_tag_values(final_config.defaults.tags,
+                            final_config.max_tag_value_length,
+                            final_config.tag_value_length_limits);
+
+  // Partial Flush
+  final_config.partial_flush_enabled =
+      value_or(env_config->partial_flush_enabled,
+               user_config.partial_flush_enabled, false);
+  final_config.partial_flush_min_spans =
+      value_or(env_config->partial_flush_min_spans,
+               user_config.partial_flush_min_spans, 500);
+  if (final_config.partial_flush_min_spans == 0) {
+    return Error{Error::INVALID_PARTIAL_FLUSH_MIN_SPANS,
+                 "The minimum number of spans for a partial flush must be "
+                 "positive."};
+  }
+
+  // Span Limit
+  std::tie(origin, final_config.max_spans_per_trace) =
+      pick(env_config->max_spans_per_trace, user_config.max_spans_per_trace,
+           0);
+  final_config.metadata[ConfigName::MAX_SPANS_PER_TRACE] =
+      ConfigMetadata(ConfigName::MAX_SPANS_PER_TRACE,
+                     std::to_string(final_config.max_spans_per_trace), origin);
+
+  // Span Summarization
+  final_config.span_summary_min_spans =
+      value_or(env_config->span_summary_min_spans,
+               user_config.span_summary_min_spans, 0);
+
+  // Memory Budget
+  final_config.memory_budget =
+      value_or(env_config->memory_budget, user_config.memory_budget, 0);
+
+  // Background Finalization
+  final_config.background_finalization =
+      value_or(env_config->background_finalization,
+               user_config.background_finalization, false);
+
+  // Parallel Finalization
+  final_config.parallel_finalization_min_spans =
+      value_or(env_config->parallel_finalization_min_spans,
+               user_config.parallel_finalization_min_spans, 0);
+  final_config.parallel_finalization_threads =
+      user_config.parallel_finalization_threads.value_or(
+          std::clamp<std::size_t>(std::thread::hardware_concurrency() / 2, 1,
+                                  4));
+  if (final_config.parallel_finalization_threads == 0) {
+    return Error{Error::INVALID_PARALLEL_FINALIZATION_THREADS,
+                 "The number of parallel finalization threads must be "
+                 "positive."};
+  }
+
+  // Early Sampling Decision
+  final_config.early_sampling_decision =
+      value_or(env_config->early_sampling_decision,
+               user_config.early_sampling_decision, false);
+
+  // Single Pass Extraction
+  final_config.single_pass_extraction =
+      value_or(env_config->single_pass_extraction,
+               user_config.single_pass_extraction, false);
+
+  // Stage Timing
+  final_config.stage_timing =
+      value_or(env_config->stage_timing, user_config.stage_timing, false);
+
   // 128b Trace IDs
   std::tie(origin, final_config.generate_128bit_trace_ids) =
       pick(env_config->generate_128bit_trace_ids,
@@ -363,7 +569,8 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &user_config,
 
   if (!user_config.collector) {
     auto finalized =
-        finalize_config(user_config.agent, final_config.logger, clock);
+        finalize_config(user_config.agent, final_config.logger, clock,
+                        user_config.thread_factory);
     if (auto *error = finalized.if_error()) {
       return std::move(*error);
     }
@@ -4,6 +4,8 @@
 #include <datadog/span_defaults.h>
 #include <datadog/version.h>
 
+#include <algorithm>
+
 #include "platform_util.h"
 
 namespace datadog {
@@ -46,6 +48,14 @@ std::string to_string(datadog::tracing::ConfigName name) {
       return "span_sample_rules";
     case ConfigName::TRACE_SAMPLING_RULES:
       return "trace_sample_rules";
+    case ConfigName::FLUSH_INTERVAL:
+      return "trace_flush_interval";
+    case ConfigName::MAX_BUFFERED_BYTES:
+      return "trace_max_buffered_bytes";
+    case ConfigName::MAX_SPANS_PER_TRACE:
+      return "trace_max_spans_per_trace";
+    case ConfigName::COMPRESSION_ENABLED:
+      return "trace_compression_enabled";
   }
 
   std::abort();
@@ -57,7 +67,11 @@ TracerTelemetry::TracerTelemetry(
     bool enabled, const Clock& clock, const std::shared_ptr<Logger>& logger,
     const TracerSignature& tracer_signature,
     const std::string& integration_name, const std::string& integration_version,
-    const std::vector<std::shared_ptr<telemetry::Metric>>& user_metrics)
+    const std::vector<std::shared_ptr<telemetry::Metric>>& user_metrics,
+    const std::shared_ptr<StageTimings>& stage_timings,
+    std::size_t memory_budget,
+    std::vector<std::shared_ptr<telemetry::CounterFamily>> families,
+    const TelemetryCadence& cadence)
     : enabled_(enabled),
       clock_(clock),
       logger_(logger),
@@ -65,7 +79,10 @@ TracerTelemetry::TracerTelemetry(
       tracer_signature_(tracer_signature),
       integration_name_(integration_name),
       integration_version_(integration_version),
-      user_metrics_(user_metrics) {
+      user_metrics_(user_metrics),
+      stage_timings_(stage_timings),
+      memory_budget_(std::make_shared<MemoryBudget>(memory_budget)),
+      cadence_(cadence) {
   if (enabled_) {
     // Register all the metrics that we're tracking by adding them to the
     // metrics_snapshots_ container. This allows for simpler iteration logic
@@ -80,6 +97,15 @@ TracerTelemetry::TracerTelemetry(
         metrics_.tracer.trace_segments_created_continued, MetricSnapshot{});
     metrics_snapshots_.emplace_back(metrics_.tracer.trace_segments_closed,
                                     MetricSnapshot{});
+    metrics_snapshots_.emplace_back(
+        metrics_.tracer.trace_chunks_dropped_overfull_buffer, MetricSnapshot{});
+    metrics_snapshots_.emplace_back(
+        metrics_.tracer.trace_chunk_bytes_dropped_overfull_buffer,
+        MetricSnapshot{});
+    metrics_snapshots_.emplace_back(
+        metrics_.tracer.trace_chunks_dropped_memory_budget, MetricSnapshot{});
+    metrics_snapshots_.emplace_back(metrics_.tracer.memory_bytes,
+                                    MetricSnapshot{});
     metrics_snapshots_.emplace_back(metrics_.trace_api.requests,
                                     MetricSnapshot{});
     metrics_snapshots_.emplace_back(metrics_.trace_api.responses_1xx,
@@ -99,143 +125,297 @@ TracerTelemetry::TracerTelemetry(
     metrics_snapshots_.emplace_back(metrics_.trace_api.errors_status_code,
                                     MetricSnapshot{});
 
+    distributions_.emplace_back(metrics_.trace_api.bytes);
+    distributions_.emplace_back(metrics_.trace_api.ms);
+    distributions_.emplace_back(metrics_.trace_api.flush_us);
+    if (stage_timings_) {
+      distributions_.emplace_back(stage_timings_->create_span);
+      distributions_.emplace_back(stage_timings_->extract_span);
+      distributions_.emplace_back(stage_timings_->span_finished);
+      distributions_.emplace_back(stage_timings_->sampler_decide);
+      distributions_.emplace_back(stage_timings_->msgpack_encode);
+      distributions_.emplace_back(stage_timings_->flush);
+    }
+
     for (auto& m : user_metrics_) {
-      metrics_snapshots_.emplace_back(*m, MetricSnapshot{});
+      if (m->kind() == telemetry::MetricType::DISTRIBUTION) {
+        distributions_.emplace_back(
+            static_cast<telemetry::DistributionMetric&>(*m));
+      } else {
+        metrics_snapshots_.emplace_back(*m, MetricSnapshot{});
+      }
+    }
+    for (auto& family : families) {
+      families_.emplace_back(std::move(family), 0);
     }
   }
 }
 
-nlohmann::json TracerTelemetry::generate_telemetry_body(
-    std::string request_type) {
+void TracerTelemetry::begin_telemetry_body(JSONWriter& writer,
+                                           StringView request_type) {
   std::time_t tracer_time = std::chrono::duration_cast<std::chrono::seconds>(
                                 clock_().wall.time_since_epoch())
                                 .count();
   seq_id_++;
-  return nlohmann::json::object({
-      {"api_version", "v2"},
-      {"seq_id", seq_id_},
-      {"request_type", request_type},
-      {"tracer_time", tracer_time},
-      {"runtime_id", tracer_signature_.runtime_id.string()},
-      {"debug", debug_},
-      {"application",
-       nlohmann::json::object({
-           {"service_name", tracer_signature_.default_service},
-           {"env", tracer_signature_.default_environment},
-           {"tracer_version", tracer_signature_.library_version},
-           {"language_name", tracer_signature_.library_language},
-           {"language_version", tracer_signature_.library_language_version},
-       })},
-      {"host",
-       {
-           {"hostname", host_info_.hostname},
-           {"os", host_info_.os},
-           {"os_version", host_info_.os_version},
-           {"architecture", host_info_.cpu_architecture},
-           {"kernel_name", host_info_.kernel_name},
-           {"kernel_version", host_info_.kernel_version},
-           {"kernel_release", host_info_.kernel_release},
-       }},
-  });
+  writer.begin_object();
+  writer.member("api_version", "v2");
+  writer.member("seq_id", seq_id_);
+  writer.member("request_type", request_type);
+  writer.member("tracer_time", tracer_time);
+  writer.member("runtime_id", tracer_signature_.runtime_id.string());
+  writer.member("debug", debug_);
+
+  writer.key("application");
+  writer.begin_object();
+  writer.member("service_name", tracer_signature_.default_service);
+  writer.member("env", tracer_signature_.default_environment);
+  writer.member("tracer_version", tracer_signature_.library_version);
+  writer.member("language_name", tracer_signature_.library_language);
+  writer.member("language_version",
+                tracer_signature_.library_language_version);
+  writer.end_object();
+
+  writer.key("host");
+  writer.begin_object();
+  writer.member("hostname", host_info_.hostname);
+  writer.member("os", host_info_.os);
+  writer.member("os_version", host_info_.os_version);
+  writer.member("architecture", host_info_.cpu_architecture);
+  writer.member("kernel_name", host_info_.kernel_name);
+  writer.member("kernel_version", host_info_.kernel_version);
+  writer.member("kernel_release", host_info_.kernel_release);
+  writer.end_object();
+
+  writer.key("payload");
+}
+
+void TracerTelemetry::write_metrics(JSONWriter& writer) {
+  const bool any_points =
+      std::any_of(metrics_snapshots_.begin(), metrics_snapshots_.end(),
+                  [](const auto& m) { return !m.second.empty(); });
+  if (!any_points) {
+    return;
+  }
+
+  std::size_t overwritten = 0;
+  writer.begin_object();
+  writer.member("request_type", "generate-metrics");
+  writer.key("payload");
+  writer.begin_object();
+  writer.key("series");
+  writer.begin_array();
+  for (auto& m : metrics_snapshots_) {
+    auto& metric = m.first.get();
+    auto& points = m.second;
+    if (!points.empty()) {
+      const auto kind = metric.kind();
+      if (kind == telemetry::MetricType::COUNT ||
+          kind == telemetry::MetricType::GAUGE) {
+        writer.begin_object();
+        writer.member("metric", metric.name());
+        writer.key("tags");
+        writer.raw(metric.tags_json());
+        writer.member("type", metric.type());
+        if (kind == telemetry::MetricType::GAUGE) {
+          // gauge metrics have a interval
+          writer.member("interval", 10);
+        }
+        writer.key("points");
+        writer.begin_array();
+        points.visit([&](const MetricSnapshot::Point& point) {
+          writer.begin_array();
+          writer.value(point.first);
+          writer.value(point.second);
+          writer.end_array();
+        });
+        writer.end_array();
+        writer.member("namespace", metric.scope());
+        writer.member("common", metric.common());
+        writer.end_object();
+      }
+    }
+    overwritten += points.overwritten();
+    points.clear();
+  }
+  writer.end_array();
+  writer.end_object();
+  writer.end_object();
+
+  if (overwritten != 0) {
+    logger_->log_error([&](auto& stream) {
+      stream << "Telemetry discarded the " << overwritten
+             << " oldest captured metric point(s), because more than "
+             << MetricSnapshot::capacity
+             << " points per metric were captured between reports.";
+    });
+  }
 }
 
-nlohmann::json TracerTelemetry::generate_configuration_field(
-    const ConfigMetadata& config_metadata) {
+void TracerTelemetry::write_distributions(JSONWriter& writer) {
+  std::vector<std::pair<telemetry::DistributionMetric*,
+                        std::vector<telemetry::DistributionMetric::Bucket>>>
+      captured;
+  for (auto& d : distributions_) {
+    auto buckets = d.get().capture_and_reset_buckets();
+    if (!buckets.empty()) {
+      captured.emplace_back(&d.get(), std::move(buckets));
+    }
+  }
+  if (captured.empty()) {
+    return;
+  }
+
+  writer.begin_object();
+  writer.member("request_type", "distributions");
+  writer.key("payload");
+  writer.begin_object();
+  writer.key("series");
+  writer.begin_array();
+  for (const auto& [metric, buckets] : captured) {
+    writer.begin_object();
+    writer.member("metric", metric->name());
+    writer.key("tags");
+    writer.raw(metric->tags_json());
+    // Each value added is a point, reported as the value of its bucket.
+    writer.key("points");
+    writer.begin_array();
+    for (const auto& [value, count] : buckets) {
+      for (uint64_t i = 0; i < count; ++i) {
+        writer.value(value);
+      }
+    }
+    writer.end_array();
+    writer.member("common", metric->common());
+    writer.member("namespace", metric->scope());
+    writer.end_object();
+  }
+  writer.end_array();
+  writer.end_object();
+  writer.end_object();
+}
+
+void TracerTelemetry::write_configuration_field(
+    JSONWriter& writer, const ConfigMetadata& config_metadata) {
   // NOTE(@dmehala): `seq_id` should start at 1 so that the go backend can
   // detect between non set fields.
   config_seq_ids[config_metadata.name] += 1;
   auto seq_id = config_seq_ids[config_metadata.name];
 
-  auto j = nlohmann::json{{"name", to_string(config_metadata.name)},
-                          {"value", config_metadata.value},
-                          {"seq_id", seq_id}};
+  writer.begin_object();
+  writer.member("name", to_string(config_metadata.name));
+  writer.member("value", config_metadata.value);
+  writer.member("seq_id", seq_id);
 
   switch (config_metadata.origin) {
     case ConfigMetadata::Origin::ENVIRONMENT_VARIABLE:
-      j["origin"] = "env_var";
+      writer.member("origin", "env_var");
       break;
     case ConfigMetadata::Origin::CODE:
-      j["origin"] = "code";
+      writer.member("origin", "code");
       break;
     case ConfigMetadata::Origin::REMOTE_CONFIG:
-      j["origin"] = "remote_config";
+      writer.member("origin", "remote_config");
       break;
     case ConfigMetadata::Origin::DEFAULT:
-      j["origin"] = "default";
+      writer.member("origin", "default");
       break;
   }
 
   if (config_metadata.error) {
-    // clang-format off
-      j["error"] = {
-        {"code", config_metadata.error->code},
-        {"message", config_metadata.error->message}
-      };
-    // clang-format on
+    writer.key("error");
+    writer.begin_object();
+    writer.member("code", int(config_metadata.error->code));
+    writer.member("message", config_metadata.error->message);
+    writer.end_object();
   }
 
-  return j;
+  writer.end_object();
 }
 
 std::string TracerTelemetry::app_started(
     const std::unordered_map<ConfigName, ConfigMetadata>& configurations) {
-  auto configuration_json = nlohmann::json::array();
+  std::string result;
+  JSONWriter writer{result};
+  begin_telemetry_body(writer, "message-batch");
+  writer.begin_array();
+
+  writer.begin_object();
+  writer.member("request_type", "app-started");
+  writer.key("payload");
+  writer.begin_object();
+  writer.key("configuration");
+  writer.begin_array();
   for (const auto& [_, config_metadata] : configurations) {
-    // if (config_metadata.value.empty()) continue;
-
-    configuration_json.emplace_back(
-        generate_configuration_field(config_metadata));
+    write_configuration_field(writer, config_metadata);
   }
-
-  // clang-format off
-  auto app_started_msg = nlohmann::json{
-    {"request_type", "app-started"},
-    {"payload", nlohmann::json{
-      {"configuration", configuration_json}
-    }}
-  };
-
-  auto batch = generate_telemetry_body("message-batch");
-  batch["payload"] = nlohmann::json::array({
-    std::move(app_started_msg)
-  });
-  // clang-format on
+  writer.end_array();
+  writer.end_object();
+  writer.end_object();
 
   if (!integration_name_.empty()) {
-    // clang-format off
-    auto integration_msg = nlohmann::json{
-      {"request_type", "app-integrations-change"},
-      {"payload", nlohmann::json{
-        {"integrations", nlohmann::json::array({
-          nlohmann::json{
-            {"name", integration_name_},
-            {"version", integration_version_},
-            {"enabled", true}
-          }
-        })}
-      }}
-    };
-    // clang-format on
-
-    batch["payload"].emplace_back(std::move(integration_msg));
+    writer.begin_object();
+    writer.member("request_type", "app-integrations-change");
+    writer.key("payload");
+    writer.begin_object();
+    writer.key("integrations");
+    writer.begin_array();
+    writer.begin_object();
+    writer.member("name", integration_name_);
+    writer.member("version", integration_version_);
+    writer.member("enabled", true);
+    writer.end_object();
+    writer.end_array();
+    writer.end_object();
+    writer.end_object();
   }
 
-  return batch.dump();
+  writer.end_array();
+  writer.end_object();
+  return result;
 }
 
 void TracerTelemetry::capture_metrics() {
   std::time_t timepoint = std::chrono::duration_cast<std::chrono::seconds>(
                               clock_().wall.time_since_epoch())
                               .count();
+  metrics_.tracer.memory_bytes.set(memory_budget_->bytes());
+  for (auto& [family, registered] : families_) {
+    for (const std::size_t size = family->size(); registered < size;
+         ++registered) {
+      metrics_snapshots_.emplace_back(family->at(registered), MetricSnapshot{});
+    }
+  }
   for (auto& m : metrics_snapshots_) {
     auto value = m.first.get().capture_and_reset_value();
     if (value == 0) {
       continue;
     }
-    m.second.emplace_back(timepoint, value);
+    m.second.push({timepoint, value});
   }
 }
 
+bool TracerTelemetry::poll(std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(poll_mutex_);
+  if (!polled_) {
+    polled_ = true;
+    next_capture_ = now;
+    next_report_ = now + cadence_.report_interval;
+  }
+  const bool report = now >= next_report_;
+  // Metrics are also captured just before each heartbeat, so that it carries
+  // the latest values.
+  if (now >= next_capture_ || report) {
+    next_capture_ = now + cadence_.capture_interval;
+    if (cadence_.capture_metrics) {
+      capture_metrics();
+    }
+  }
+  if (report) {
+    next_report_ = now + cadence_.report_interval;
+  }
+  return report;
+}
+
 void TracerTelemetry::capture_configuration_change(
     const std::vector<ConfigMetadata>& new_configuration) {
   configuration_snapshot_.insert(configuration_snapshot_.begin(),
@@ -244,131 +424,58 @@ void TracerTelemetry::capture_configuration_change(
 }
 
 std::string TracerTelemetry::heartbeat_and_telemetry() {
-  auto batch_payloads = nlohmann::json::array();
-
-  auto heartbeat = nlohmann::json::object({
-      {"request_type", "app-heartbeat"},
-  });
-  batch_payloads.emplace_back(std::move(heartbeat));
-
-  auto metrics = nlohmann::json::array();
-  for (auto& m : metrics_snapshots_) {
-    auto& metric = m.first.get();
-    auto& points = m.second;
-    if (!points.empty()) {
-      auto type = metric.type();
-      if (type == "count") {
-        metrics.emplace_back(nlohmann::json::object({
-            {"metric", metric.name()},
-            {"tags", metric.tags()},
-            {"type", metric.type()},
-            {"points", points},
-            {"namespace", metric.scope()},
-            {"common", metric.common()},
-        }));
-      } else if (type == "gauge") {
-        // gauge metrics have a interval
-        metrics.emplace_back(nlohmann::json::object({
-            {"metric", metric.name()},
-            {"tags", metric.tags()},
-            {"type", metric.type()},
-            {"namespace", metric.scope()},
-            {"interval", 10},
-            {"points", points},
-            {"common", metric.common()},
-        }));
-      }
-    }
-    points.clear();
-  }
-
-  if (!metrics.empty()) {
-    auto generate_metrics = nlohmann::json::object({
-        {"request_type", "generate-metrics"},
-        {"payload", nlohmann::json::object({
-                        {"series", metrics},
-                    })},
-    });
-    batch_payloads.emplace_back(std::move(generate_metrics));
-  }
-
-  auto telemetry_body = generate_telemetry_body("message-batch");
-  telemetry_body["payload"] = batch_payloads;
-  auto message_batch_payload = telemetry_body.dump();
-
-  return message_batch_payload;
+  // Heartbeats are produced periodically, and each is usually about as large
+  // as the one before it, so reserve that much to begin with.
+  std::string result;
+  result.reserve(heartbeat_size_);
+  JSONWriter writer{result};
+  begin_telemetry_body(writer, "message-batch");
+  writer.begin_array();
+
+  writer.begin_object();
+  writer.member("request_type", "app-heartbeat");
+  writer.end_object();
+  write_metrics(writer);
+  write_distributions(writer);
+
+  writer.end_array();
+  writer.end_object();
+  heartbeat_size_ = result.size();
+  return result;
 }
 
 std::string TracerTelemetry::app_closing() {
-  auto batch_payloads = nlohmann::json::array();
-
-  auto app_closing = nlohmann::json::object({
-      {"request_type", "app-closing"},
-  });
-  batch_payloads.emplace_back(std::move(app_closing));
-
-  auto metrics = nlohmann::json::array();
-  for (auto& m : metrics_snapshots_) {
-    auto& metric = m.first.get();
-    auto& points = m.second;
-    if (!points.empty()) {
-      auto type = metric.type();
-      if (type == "count") {
-        metrics.emplace_back(nlohmann::json::object({
-            {"metric", metric.name()},
-            {"tags", metric.tags()},
-            {"type", metric.type()},
-            {"points", points},
-            {"common", metric.common()},
-            {"namespace", metric.scope()},
-        }));
-      } else if (type == "gauge") {
-        // gauge metrics have a interval
-        metrics.emplace_back(nlohmann::json::object({
-            {"metric", metric.name()},
-            {"tags", metric.tags()},
-            {"type", metric.type()},
-            {"interval", 10},
-            {"points", points},
-            {"common", metric.common()},
-            {"namespace", metric.scope()},
-        }));
-      }
-    }
-    points.clear();
-  }
-
-  if (!metrics.empty()) {
-    auto generate_metrics = nlohmann::json::object({
-        {"request_type", "generate-metrics"},
-        {"payload", nlohmann::json::object({
-                        {"series", metrics},
-                    })},
-    });
-    batch_payloads.emplace_back(std::move(generate_metrics));
-  }
-
-  auto telemetry_body = generate_telemetry_body("message-batch");
-  telemetry_body["payload"] = batch_payloads;
-  auto message_batch_payload = telemetry_body.dump();
-
-  return message_batch_payload;
+  std::string result;
+  result.reserve(heartbeat_size_);
+  JSONWriter writer{result};
+  begin_telemetry_body(writer, "message-batch");
+  writer.begin_array();
+
+  writer.begin_object();
+  writer.member("request_type", "app-closing");
+  writer.end_object();
+  write_metrics(writer);
+  write_distributions(writer);
+
+  writer.end_array();
+  writer.end_object();
+  return result;
 }
 
 std::string TracerTelemetry::configuration_change() {
-  auto configuration_json = nlohmann::json::array();
+  std::string result;
+  JSONWriter writer{result};
+  begin_telemetry_body(writer, "app-client-configuration-change");
+  writer.begin_object();
+  writer.key("configuration");
+  writer.begin_array();
   for (const auto& config_metadata : configuration_snapshot_) {
-    // if (config_metadata.value.empty()) continue;
-    configuration_json.emplace_back(
-        generate_configuration_field(config_metadata));
+    write_configuration_field(writer, config_metadata);
   }
-
-  auto telemetry_body =
-      generate_telemetry_body("app-client-configuration-change");
-  telemetry_body["payload"] =
-      nlohmann::json{{"configuration", configuration_json}};
-
-  return telemetry_body.dump();
+  writer.end_array();
+  writer.end_object();
+  writer.end_object();
+  return result;
 }
 
 }  // namespace tracing
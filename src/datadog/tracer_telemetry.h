@@ -2,7 +2,8 @@
 
 // This component provides a class, TracerTelemetry, that is used to collect
 // data from the activity of the tracer implementation, and encode messages that
-// can be submitted to the Datadog Agent.
+// can be submitted to the Datadog Agent.  Messages are written directly as JSON
+// text, using `JSONWriter`, rather than built as `nlohmann::json` values.
 //
 // Counter metrics are updated in other parts of the tracers, with the values
 // being managed by this class.
@@ -12,31 +13,54 @@
 // - `message-batch`
 // - `app-heartbeat`
 // - `generate-metrics`
+// - `distributions`
 // - `app-closing`
 // - `app-client-configuration-change`
 //
 // `app-started` messages are sent as part of initializing the tracer.
 //
-// At 60 second intervals, a `message-batch` message is sent containing an
-// `app-heartbeat` message, and if metrics have changed during that interval, a
-// `generate-metrics` message is also included in the batch.
+// At intervals (by default, 60 seconds), a `message-batch` message is sent
+// containing an `app-heartbeat` message, and if metrics have changed during
+// that interval, a `generate-metrics` message is also included in the batch.
+// If values were added to distribution metrics during that interval, a
+// `distributions` message is included as well.  Metrics are captured at a
+// shorter interval (by default, 10 seconds).  See `TelemetryCadence`.
+//
+// `TracerTelemetry` does not run on a thread of its own.  Its owner calls
+// `poll` periodically, e.g. whenever the collector's flush runs, and sends a
+// heartbeat when `poll` says that one is due.
 //
 // `app-closing` messages are sent as part of terminating the tracer. These are
 // sent as a `message-batch` message , and if metrics have changed since the
-// last `app-heartbeat` event, a `generate-metrics` message is also included in
-// the batch.
+// last `app-heartbeat` event, `generate-metrics` and `distributions` messages
+// are also included in the batch.
 //
 // `app-client-configuration-change` messages are sent as soon as the tracer
 // configuration has been updated by a Remote Configuration event.
+//
+// This component also provides a class, `StageTimer`, that measures how long
+// a stage of the tracer's work takes, if stage timing is enabled.  See
+// `stage_timings.h`.
+//
+// `TracerTelemetry` is shared by the tracer's trace segments and collector,
+// and so it also holds the tracer's `MemoryBudget` (see `memory_budget.h`),
+// whose total is reported as a gauge.
 #include <datadog/clock.h>
 #include <datadog/config.h>
 #include <datadog/runtime_id.h>
+#include <datadog/stage_timings.h>
 #include <datadog/telemetry/metrics.h>
 #include <datadog/tracer_signature.h>
 
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <vector>
 
-#include "json.hpp"
+#include "json_writer.h"
+#include "memory_budget.h"
 #include "platform_util.h"
 
 namespace datadog {
@@ -45,6 +69,17 @@ namespace tracing {
 class Logger;
 struct SpanDefaults;
 
+// How often `TracerTelemetry` captures metrics, and how often it reports them
+// in a heartbeat.
+struct TelemetryCadence {
+  std::chrono::steady_clock::duration capture_interval =
+      std::chrono::seconds(10);
+  std::chrono::steady_clock::duration report_interval =
+      std::chrono::seconds(60);
+  // Whether metrics are captured at all.  Heartbeats are sent regardless.
+  bool capture_metrics = true;
+};
+
 class TracerTelemetry {
   bool enabled_ = false;
   bool debug_ = false;
@@ -76,6 +111,20 @@ class TracerTelemetry {
           true};
       telemetry::CounterMetric trace_segments_closed = {
           "trace_segments_closed", "tracers", {}, true};
+
+      telemetry::CounterMetric trace_chunks_dropped_overfull_buffer = {
+          "trace_chunks_dropped", "tracers", {"reason:overfull_buffer"}, true};
+      telemetry::CounterMetric trace_chunk_bytes_dropped_overfull_buffer = {
+          "trace_chunk_bytes_dropped",
+          "tracers",
+          {"reason:overfull_buffer"},
+          true};
+      telemetry::CounterMetric trace_chunks_dropped_memory_budget = {
+          "trace_chunks_dropped", "tracers", {"reason:memory_budget"}, true};
+
+      // The bytes accounted for by the `MemoryBudget`, as of each capture.
+      telemetry::GaugeMetric memory_bytes = {
+          "memory_bytes", "tracers", {}, false};
     } tracer;
     struct {
       telemetry::CounterMetric requests = {
@@ -99,26 +148,116 @@ class TracerTelemetry {
       telemetry::CounterMetric errors_status_code = {
           "trace_api.errors", "tracers", {"type:status_code"}, true};
 
+      // The size of each request body, in bytes.
+      telemetry::DistributionMetric bytes = {
+          "trace_api.bytes", "tracers", {}, true};
+      // The time from sending each request until its response or error, in
+      // milliseconds.
+      telemetry::DistributionMetric ms = {"trace_api.ms", "tracers", {}, true};
+      // The time taken by each flush of buffered traces, in microseconds.  This
+      // includes encoding and compressing the payloads, but not waiting for
+      // responses.
+      telemetry::DistributionMetric flush_us = {
+          "trace_api.flush_us", "tracers", {}, false};
     } trace_api;
   } metrics_;
   // Each metric has an associated MetricSnapshot that contains the data points,
-  // represented as a timestamp and the value of that metric.
-  using MetricSnapshot = std::vector<std::pair<std::time_t, uint64_t>>;
+  // represented as a timestamp and the value of that metric.  Points are
+  // captured every 10 seconds and reported every 60 seconds, so a snapshot
+  // keeps the most recent `capacity` points in a fixed-size ring, and capturing
+  // a point never allocates.  If points are captured faster than they are
+  // reported, e.g. because heartbeats are delayed, then the oldest points are
+  // overwritten, and counted in `overwritten`.
+  class MetricSnapshot {
+   public:
+    using Point = std::pair<std::time_t, uint64_t>;
+    static constexpr std::size_t capacity = 12;
+
+   private:
+    std::array<Point, capacity> points_;
+    // `points_[begin_]` is the oldest point, if `size_` is not zero.
+    std::size_t begin_ = 0;
+    std::size_t size_ = 0;
+    std::size_t overwritten_ = 0;
+
+   public:
+    void push(Point point) {
+      if (size_ == capacity) {
+        points_[begin_] = point;
+        begin_ = (begin_ + 1) % capacity;
+        ++overwritten_;
+      } else {
+        points_[(begin_ + size_) % capacity] = point;
+        ++size_;
+      }
+    }
+    // Invoke the specified `visit` with each point, oldest first.
+    template <typename Visitor>
+    void visit(Visitor&& visit) const {
+      for (std::size_t i = 0; i < size_; ++i) {
+        visit(points_[(begin_ + i) % capacity]);
+      }
+    }
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+    // Return the number of points overwritten since the last `clear`.
+    std::size_t overwritten() const { return overwritten_; }
+    void clear() {
+      begin_ = 0;
+      size_ = 0;
+      overwritten_ = 0;
+    }
+  };
   // This uses a reference_wrapper so references to internal metric values can
   // be captured, and be iterated trivially when the values need to be
   // snapshotted and published in telemetry messages.
   std::vector<
       std::pair<std::reference_wrapper<telemetry::Metric>, MetricSnapshot>>
       metrics_snapshots_;
+  // Distribution metrics are not snapshotted.  Their values are captured when
+  // a `distributions` message is produced.
+  std::vector<std::reference_wrapper<telemetry::DistributionMetric>>
+      distributions_;
 
   std::vector<ConfigMetadata> configuration_snapshot_;
 
-  nlohmann::json generate_telemetry_body(std::string request_type);
+  // The size of the most recent heartbeat message, used to size the next one.
+  std::size_t heartbeat_size_ = 0;
+
+  // Write to the specified `writer` the opening of a telemetry message having
+  // the specified `request_type`, up to the key of its payload.  The caller
+  // writes the payload and then ends the object.
+  void begin_telemetry_body(JSONWriter& writer, StringView request_type);
+
+  // Write to the specified `writer` a `generate-metrics` message containing the
+  // captured points of each metric, and clear the points, unless there are no
+  // points.
+  void write_metrics(JSONWriter& writer);
 
-  nlohmann::json generate_configuration_field(
-      const ConfigMetadata& config_metadata);
+  // Write to the specified `writer` a `distributions` message containing the
+  // values added to distribution metrics, unless no values were added.
+  void write_distributions(JSONWriter& writer);
+
+  void write_configuration_field(JSONWriter& writer,
+                                 const ConfigMetadata& config_metadata);
 
   std::vector<std::shared_ptr<telemetry::Metric>> user_metrics_;
+  // User counter families, and how many of each family's counters are in
+  // `metrics_snapshots_`.  Counters created since the last capture are added
+  // by `capture_metrics`.
+  std::vector<std::pair<std::shared_ptr<telemetry::CounterFamily>,
+                        std::size_t>>
+      families_;
+  // Null unless stage timing is enabled.
+  std::shared_ptr<StageTimings> stage_timings_;
+  std::shared_ptr<MemoryBudget> memory_budget_;
+  const TelemetryCadence cadence_;
+  // When `poll` next captures metrics, and next reports a heartbeat.  Set by
+  // the first `poll`.  Guarded by `poll_mutex_`.
+  std::mutex poll_mutex_;
+  bool polled_ = false;
+  std::chrono::steady_clock::time_point next_capture_;
+  std::chrono::steady_clock::time_point next_report_;
 
  public:
   TracerTelemetry(
@@ -127,12 +266,31 @@ class TracerTelemetry {
       const std::string& integration_name,
       const std::string& integration_version,
       const std::vector<std::shared_ptr<telemetry::Metric>>& user_metrics =
-          std::vector<std::shared_ptr<telemetry::Metric>>{});
+          std::vector<std::shared_ptr<telemetry::Metric>>{},
+      const std::shared_ptr<StageTimings>& stage_timings = nullptr,
+      std::size_t memory_budget = 0,
+      std::vector<std::shared_ptr<telemetry::CounterFamily>> families = {},
+      const TelemetryCadence& cadence = TelemetryCadence{});
   inline bool enabled() { return enabled_; }
   inline bool debug() { return debug_; }
   // Provides access to the telemetry metrics for updating the values.
   // This value should not be stored.
   auto& metrics() { return metrics_; }
+  // Return the stage timings, or null if stage timing is disabled.
+  const std::shared_ptr<StageTimings>& stage_timings() const {
+    return stage_timings_;
+  }
+  // Return the distribution of durations of the specified `stage`, or null if
+  // stage timing is disabled.
+  telemetry::DistributionMetric* stage(
+      telemetry::DistributionMetric StageTimings::*stage) const {
+    return stage_timings_ ? &(*stage_timings_.*stage) : nullptr;
+  }
+  // Return the budget of the memory held by the tracer.  It is shared, so
+  // that it can be released by callbacks that outlive the tracer.
+  const std::shared_ptr<MemoryBudget>& memory_budget() const {
+    return memory_budget_;
+  }
   // Constructs an `app-started` message using information provided when
   // constructed and the tracer_config value passed in.
   std::string app_started(
@@ -141,17 +299,51 @@ class TracerTelemetry {
   // collect timestamped "points" of values. These values are later submitted
   // in `generate-metrics` messages.
   void capture_metrics();
+  // Capture metrics if a capture is due at the specified `now`, and return
+  // whether a heartbeat is due, in which case the caller is to send
+  // `heartbeat_and_telemetry()`.  The first call captures metrics, and starts
+  // the interval until the first heartbeat.  `poll` is to be called at least
+  // as often as `cadence().capture_interval`.
+  bool poll(std::chrono::steady_clock::time_point now);
+  const TelemetryCadence& cadence() const { return cadence_; }
   void capture_configuration_change(
       const std::vector<ConfigMetadata>& new_configuration);
   // Constructs a messsage-batch containing `app-heartbeat`, and if metrics
-  // have been modified, a `generate-metrics` message.
+  // have been modified, `generate-metrics` and `distributions` messages.
   std::string heartbeat_and_telemetry();
   // Constructs a message-batch containing `app-closing`, and if metrics have
-  // been modified, a `generate-metrics` message.
+  // been modified, `generate-metrics` and `distributions` messages.
   std::string app_closing();
   // Construct an `app-client-configuration-change` message.
   std::string configuration_change();
 };
 
+// `StageTimer` adds the time between its construction and its destruction, in
+// nanoseconds, to a distribution, unless the distribution is null.  When it is
+// null, the clock is not read.
+class StageTimer {
+  telemetry::DistributionMetric* distribution_;
+  std::chrono::steady_clock::time_point start_;
+
+ public:
+  explicit StageTimer(telemetry::DistributionMetric* distribution)
+      : distribution_(distribution) {
+    if (distribution_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+  ~StageTimer() {
+    if (distribution_) {
+      distribution_->add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start_)
+                             .count());
+    }
+  }
+};
+
 }  // namespace tracing
 }  // namespace datadog
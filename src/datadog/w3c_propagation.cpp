@@ -4,8 +4,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <charconv>
 #include <cstddef>
-#include <regex>
+#include <iterator>
+#include <limits>
 #include <utility>
 
 #include "hex.h"
@@ -17,32 +19,78 @@ namespace datadog {
 namespace tracing {
 namespace {
 
-// Note that match group 0 is the entire match.
-constexpr StringView k_traceparent_pattern =
-    "([0-9a-f]{2})"  // hex version number (match group 1)
-    "-"
-    "([0-9a-f]{32})"  // hex trace ID (match group 2)
-    "-"
-    "([0-9a-f]{16})"  // hex parent span ID (match group 3)
-    "-"
-    "([0-9a-f]{2})"  // hex "trace-flags" (match group 4)
-    "($|-.*)";  // either the end, or a hyphen preceding further fields (match
-                // group 5)
-
-// Return a predicate that returns whether its `char` argument is any of the
-// following:
+// A "traceparent" header value has the following fixed layout, possibly
+// followed by a hyphen and further fields:
 //
-// - outside of the ASCII inclusive range `[lowest_ascii, highest_ascii]`
-// - equal to one of the `disallowed_characters`.
+//     vv-tttttttttttttttttttttttttttttttt-pppppppppppppppp-ff
 //
-// `verboten` is used with `std::replace_if` to sanitize field values within the
+// where "v" is a hex digit of the version, "t" of the trace ID, "p" of the
+// parent span ID, and "f" of the trace flags.  Hex digits are lower case.
+constexpr std::size_t k_traceparent_version_offset = 0;
+constexpr std::size_t k_traceparent_trace_id_offset = 3;
+constexpr std::size_t k_traceparent_parent_id_offset = 36;
+constexpr std::size_t k_traceparent_flags_offset = 53;
+constexpr std::size_t k_traceparent_size = 55;
+
+// Return whether every character of the specified `text` is a lower case hex
+// digit.  Every character is examined, without branching, so that the
+// compiler can vectorize the loop.
+bool is_lower_hex(StringView text) {
+  bool result = true;
+  for (const char ch : text) {
+    const auto c = static_cast<unsigned char>(ch);
+    result &= (unsigned(c - '0') < 10) | (unsigned(c - 'a') < 6);
+  }
+  return result;
+}
+
+// `TracestateCharMap` is a table used to sanitize field values within the
+// tracestate header.  It maps each character to itself, except for the
+// following, which are mapped to an underscore ("_"):
+//
+// - characters outside of the printable ASCII range `[0x20, 0x7e]`
+// - the specified `disallowed` characters
+//
+// and except for the equal sign ("="), which is mapped to the specified
+// `equal_sign` replacement.
+struct TracestateCharMap {
+  char chars[256];
+
+  constexpr TracestateCharMap(const char* disallowed, char equal_sign)
+      : chars() {
+    for (int c = 0; c < 256; ++c) {
+      chars[c] = c >= 0x20 && c <= 0x7e ? char(c) : '_';
+    }
+    for (; *disallowed; ++disallowed) {
+      chars[static_cast<unsigned char>(*disallowed)] = '_';
+    }
+    chars[static_cast<unsigned char>('=')] = equal_sign;
+  }
+};
+
+// The origin and trace tag values may contain equal signs, which are reserved
+// in tracestate.  They're replaced with tildes ("~").
+constexpr TracestateCharMap tracestate_value_chars{",;~", '~'};
+constexpr TracestateCharMap tracestate_key_chars{" ,;", '_'};
+
+// Append the specified `text` to the specified `destination`, with each
+// character replaced by its entry in the specified `char_map`.
+void append_sanitized(std::string& destination, StringView text,
+                      const TracestateCharMap& char_map) {
+  const std::size_t begin = destination.size();
+  destination.resize(begin + text.size());
+  char* out = &destination[begin];
+  for (const char c : text) {
+    *out++ = char_map.chars[static_cast<unsigned char>(c)];
+  }
+}
+
+// Return whether the trace tag having the specified `key` is included in the
 // tracestate header.
-auto verboten(int lowest_ascii, int highest_ascii,
-              StringView disallowed_characters) {
-  return [=, chars = disallowed_characters](char ch) {
-    return int(ch) < lowest_ascii || int(ch) > highest_ascii ||
-           std::find(chars.begin(), chars.end(), ch) != chars.end();
-  };
+bool is_tracestate_tag(StringView key) {
+  // Either it's not a propagation tag, or it's one of the propagation tags that
+  // need not be included in tracestate.
+  return starts_with(key, "_dd.p.") && key != tags::internal::trace_id_high;
 }
 
 // Populate the specified `result` with data extracted from the "traceparent"
@@ -55,58 +103,18 @@ Optional<std::string> extract_traceparent(ExtractedData& result,
     return nullopt;
   }
 
-  const auto traceparent = trim(*maybe_traceparent);
-
-  static const std::regex regex{k_traceparent_pattern.data()};
-
-  std::cmatch match;
-  if (!std::regex_match(traceparent.data(),
-                        traceparent.data() + traceparent.size(), match,
-                        regex)) {
-    return "malformed_traceparent";
-  }
-
-  assert(match.ready());
-  assert(match.size() == 6);
-
-  const auto to_string_view = [traceparent_beg = traceparent.data()](
-                                  const std::cmatch& match,
-                                  const std::size_t index) {
-    assert(index < match.size());
-    return StringView(traceparent_beg + match.position(index),
-                      std::size_t(match.length(index)));
-  };
-
-  const auto version = to_string_view(match, 1);
-  if (version == "ff") {
-    return "invalid_version";
-  }
-
-  if (version == "00" && !to_string_view(match, 5).empty()) {
-    return "malformed_traceparent";
-  }
-
-  result.trace_id = *TraceID::parse_hex(to_string_view(match, 2));
-  if (result.trace_id == 0) {
-    return "trace_id_zero";
-  }
-
-  result.parent_id = *parse_uint64(to_string_view(match, 3), 16);
-  if (*result.parent_id == 0) {
-    return "parent_id_zero";
-  }
-
-  const auto flags = *parse_uint64(to_string_view(match, 4), 16);
-  result.sampling_priority = int(flags & 1);
-
-  return nullopt;
+  return parse_traceparent(result, trim(*maybe_traceparent));
 }
 
-// `struct PartiallyParsedTracestat` contains the separated Datadog-specific and
-// non-Datadog-specific portions of tracestate.
+// `struct PartiallyParsedTracestate` contains the separated Datadog-specific
+// and non-Datadog-specific portions of tracestate.  Its members refer to the
+// parsed header value.  The non-Datadog-specific portion is whatever precedes
+// the "dd" entry followed by whatever follows it, but without an extra comma
+// in the middle.
 struct PartiallyParsedTracestate {
   StringView datadog_value;
-  std::string other_entries;
+  StringView other_entries_prefix;
+  StringView other_entries_suffix;
 };
 
 // Return the separate Datadog-specific and non-Datadog-specific portions of the
@@ -145,26 +153,38 @@ Optional<PartiallyParsedTracestate> parse_tracestate(StringView tracestate) {
 
     PartiallyParsedTracestate result;
     result.datadog_value = pair.substr(kv_separator + 1);
-    // `result->other_entries` is whatever was before the "dd" entry and
-    // whatever is after the "dd" entry, but without an extra comma in the
-    // middle.
+    const bool has_suffix = pair_end != StringView::npos && pair_end + 1 < end;
     if (pair_begin != 0) {
-      // There's a prefix
-      append(result.other_entries, tracestate.substr(0, pair_begin - 1));
-      if (pair_end != StringView::npos && pair_end + 1 < end) {
-        // and a suffix
-        append(result.other_entries, tracestate.substr(pair_end));
+      // There's a prefix, and the suffix, if any, keeps its leading comma.
+      result.other_entries_prefix = tracestate.substr(0, pair_begin - 1);
+      if (has_suffix) {
+        result.other_entries_suffix = tracestate.substr(pair_end);
       }
-    } else if (pair_end != StringView::npos && pair_end + 1 < end) {
-      // There's just a suffix
-      append(result.other_entries, tracestate.substr(pair_end + 1));
+    } else if (has_suffix) {
+      result.other_entries_suffix = tracestate.substr(pair_end + 1);
     }
-
     return result;
   }
 
   return nullopt;
 }
+
+// Return the non-Datadog-specific portion of the specified `parsed`
+// tracestate, or return null if it is empty.  The result is allocated once,
+// at its final size.
+Optional<std::string> other_entries(const PartiallyParsedTracestate& parsed) {
+  const StringView prefix = parsed.other_entries_prefix;
+  const StringView suffix = parsed.other_entries_suffix;
+  if (prefix.empty() && suffix.empty()) {
+    return nullopt;
+  }
+  std::string result;
+  result.reserve(prefix.size() + suffix.size());
+  append(result, prefix);
+  append(result, suffix);
+  return result;
+}
+
 // Fill the specified `result` with information parsed from the specified
 // `datadog_value`. `datadog_value` is the value of the "dd" entry in the
 // "tracestate" header.
@@ -223,7 +243,9 @@ void parse_datadog_tracestate(ExtractedData& result, StringView datadog_value) {
       // The part of the key that follows "t." is the name of a trace tag,
       // except without the "_dd.p." prefix.
       const auto tag_suffix = key.substr(2);
-      std::string tag_name = "_dd.p.";
+      std::string tag_name;
+      tag_name.reserve(6 + tag_suffix.size());
+      tag_name += "_dd.p.";
       append(tag_name, tag_suffix);
       // The tag value was encoded with all '=' replaced by '~'.  Undo that
       // transformation.
@@ -237,7 +259,10 @@ void parse_datadog_tracestate(ExtractedData& result, StringView datadog_value) {
       // inject trace context.
       auto& entries = result.additional_datadog_w3c_tracestate;
       if (!entries) {
+        // The rest of `datadog_value` bounds the size of the entries, so
+        // they're allocated once.
         entries.emplace();
+        entries->reserve(end - (pair.data() - datadog_value.data()));
       } else {
         *entries += ';';
       }
@@ -268,19 +293,62 @@ void extract_tracestate(ExtractedData& result, const DictReader& headers) {
     return;
   }
 
-  auto& [datadog_value, other_entries] = *maybe_parsed;
-  if (!other_entries.empty()) {
-    result.additional_w3c_tracestate = std::move(other_entries);
-  }
-
-  parse_datadog_tracestate(result, datadog_value);
+  result.additional_w3c_tracestate = other_entries(*maybe_parsed);
+  parse_datadog_tracestate(result, maybe_parsed->datadog_value);
 }
 
 }  // namespace
 
+Optional<std::string> parse_traceparent(ExtractedData& result,
+                                        StringView traceparent) {
+  if (traceparent.size() < k_traceparent_size ||
+      traceparent[k_traceparent_trace_id_offset - 1] != '-' ||
+      traceparent[k_traceparent_parent_id_offset - 1] != '-' ||
+      traceparent[k_traceparent_flags_offset - 1] != '-') {
+    return "malformed_traceparent";
+  }
+
+  const auto version = traceparent.substr(k_traceparent_version_offset, 2);
+  const auto trace_id = traceparent.substr(k_traceparent_trace_id_offset, 32);
+  const auto parent_id =
+      traceparent.substr(k_traceparent_parent_id_offset, 16);
+  const auto flags = traceparent.substr(k_traceparent_flags_offset, 2);
+  // Further fields, if any, must be preceded by a hyphen, and may contain
+  // anything but line breaks.
+  const auto rest = traceparent.substr(k_traceparent_size);
+  if (!is_lower_hex(version) || !is_lower_hex(trace_id) ||
+      !is_lower_hex(parent_id) || !is_lower_hex(flags) ||
+      (!rest.empty() &&
+       (rest.front() != '-' || rest.find_first_of("\r\n") != rest.npos))) {
+    return "malformed_traceparent";
+  }
+
+  if (version == "ff") {
+    return "invalid_version";
+  }
+
+  if (version == "00" && !rest.empty()) {
+    return "malformed_traceparent";
+  }
+
+  result.trace_id = *TraceID::parse_hex(trace_id);
+  if (result.trace_id == 0) {
+    return "trace_id_zero";
+  }
+
+  result.parent_id = *parse_uint64(parent_id, 16);
+  if (*result.parent_id == 0) {
+    return "parent_id_zero";
+  }
+
+  result.sampling_priority = int(*parse_uint64(flags, 16) & 1);
+
+  return nullopt;
+}
+
 Expected<ExtractedData> extract_w3c(
     const DictReader& headers,
-    std::unordered_map<std::string, std::string>& span_tags, Logger&) {
+    FlatMap<std::string>& span_tags, Logger&) {
   ExtractedData result;
   result.style = PropagationStyle::W3C;
 
@@ -304,63 +372,89 @@ Expected<ExtractedData> extract_w3c(
 
 std::string encode_traceparent(TraceID trace_id, std::uint64_t span_id,
                                int sampling_priority) {
-  std::string result;
+  // "00-<trace ID>-<span ID>-<flags>"
+  char buffer[55];
+  char* out = buffer;
   // version
-  result += "00-";
+  *out++ = '0';
+  *out++ = '0';
+  *out++ = '-';
 
   // trace ID
-  result += trace_id.hex_padded();
-  result += '-';
+  out = write_hex_padded(out, trace_id.high);
+  out = write_hex_padded(out, trace_id.low);
+  *out++ = '-';
 
   // span ID
-  result += hex_padded(span_id);
-  result += '-';
+  out = write_hex_padded(out, span_id);
+  *out++ = '-';
 
   // flags
-  result += sampling_priority > 0 ? "01" : "00";
+  *out++ = '0';
+  *out++ = sampling_priority > 0 ? '1' : '0';
 
-  return result;
+  assert(out == std::end(buffer));
+  return std::string(buffer, out);
 }
 
-std::string encode_datadog_tracestate(
+std::string encode_tracestate(
     uint64_t span_id, int sampling_priority,
     const Optional<std::string>& origin,
     const std::vector<std::pair<std::string, std::string>>& trace_tags,
-    const Optional<std::string>& additional_datadog_w3c_tracestate) {
-  std::string result = "dd=s:";
-  result += std::to_string(sampling_priority);
+    const Optional<std::string>& additional_datadog_w3c_tracestate,
+    const Optional<std::string>& additional_w3c_tracestate) {
+  // "_dd.p.<name>" is encoded as "t.<name>".
+  const StringView tag_prefix = "_dd.p.";
+
+  char priority[std::numeric_limits<int>::digits10 + 2];
+  const char* const priority_end =
+      std::to_chars(std::begin(priority), std::end(priority), sampling_priority)
+          .ptr;
+
+  // Compute the size of the result before truncation, so that it's allocated
+  // once.
+  std::size_t size = sizeof("dd=s:") - 1 + (priority_end - priority) +
+                     sizeof(";p:") - 1 + 16;
+  if (origin) {
+    size += sizeof(";o:") - 1 + origin->size();
+  }
+  for (const auto& [key, value] : trace_tags) {
+    if (is_tracestate_tag(key)) {
+      size += sizeof(";t.") - 1 + key.size() - tag_prefix.size() + 1 +
+              value.size();
+    }
+  }
+  if (additional_datadog_w3c_tracestate) {
+    size += 1 + additional_datadog_w3c_tracestate->size();
+  }
+  if (additional_w3c_tracestate) {
+    size += 1 + additional_w3c_tracestate->size();
+  }
+
+  std::string result;
+  result.reserve(size);
+  result += "dd=s:";
+  result.append(priority, priority_end - priority);
   result += ";p:";
-  result += hex_padded(span_id);
+  const std::size_t span_id_begin = result.size();
+  result.resize(span_id_begin + 16);
+  write_hex_padded(&result[span_id_begin], span_id);
 
   if (origin) {
     result += ";o:";
-    result += *origin;
-    std::replace_if(result.end() - origin->size(), result.end(),
-                    verboten(0x20, 0x7e, ",;~"), '_');
-    std::replace(result.end() - origin->size(), result.end(), '=', '~');
+    append_sanitized(result, *origin, tracestate_value_chars);
   }
 
   for (const auto& [key, value] : trace_tags) {
-    const StringView prefix = "_dd.p.";
-    if (!starts_with(key, prefix) || key == tags::internal::trace_id_high) {
-      // Either it's not a propagation tag, or it's one of the propagation tags
-      // that need not be included in tracestate.
+    if (!is_tracestate_tag(key)) {
       continue;
     }
 
-    // `key` is "_dd.p.<name>", but we want "t.<name>".
     result += ";t.";
-    result.append(key, prefix.size());
-    std::replace_if(result.end() - (key.size() - prefix.size()), result.end(),
-                    verboten(0x20, 0x7e, " ,;="), '_');
-
+    append_sanitized(result, StringView(key).substr(tag_prefix.size()),
+                     tracestate_key_chars);
     result += ':';
-    result += value;
-    std::replace_if(result.end() - value.size(), result.end(),
-                    verboten(0x20, 0x7e, ",;~"), '_');
-    // `value` might contain equal signs ("="), which is reserved in tracestate.
-    // Replace them with tildes ("~").
-    std::replace(result.end() - value.size(), result.end(), '=', '~');
+    append_sanitized(result, value, tracestate_value_chars);
   }
 
   if (additional_datadog_w3c_tracestate) {
@@ -378,19 +472,6 @@ std::string encode_datadog_tracestate(
     result.resize(last_semicolon_index);
   }
 
-  return result;
-}
-
-std::string encode_tracestate(
-    uint64_t span_id, int sampling_priority,
-    const Optional<std::string>& origin,
-    const std::vector<std::pair<std::string, std::string>>& trace_tags,
-    const Optional<std::string>& additional_datadog_w3c_tracestate,
-    const Optional<std::string>& additional_w3c_tracestate) {
-  std::string result =
-      encode_datadog_tracestate(span_id, sampling_priority, origin, trace_tags,
-                                additional_datadog_w3c_tracestate);
-
   if (additional_w3c_tracestate) {
     result += ',';
     result += *additional_w3c_tracestate;
@@ -7,6 +7,7 @@
 #include <datadog/dict_reader.h>
 #include <datadog/expected.h>
 #include <datadog/optional.h>
+#include <datadog/string_view.h>
 #include <datadog/trace_id.h>
 
 #include <cstdint>
@@ -14,6 +15,7 @@
 #include <unordered_map>
 
 #include "extracted_data.h"
+#include "flat_map.h"
 
 namespace datadog {
 namespace tracing {
@@ -28,7 +30,15 @@ class Logger;
 // `ExtractedData` when extraction fails.
 Expected<ExtractedData> extract_w3c(
     const DictReader& headers,
-    std::unordered_map<std::string, std::string>& span_tags, Logger&);
+    FlatMap<std::string>& span_tags, Logger&);
+
+// Populate the specified `result` with the trace ID, parent ID, and sampling
+// priority of the specified "traceparent" header value, which has already been
+// trimmed of surrounding whitespace.  Return `nullopt` on success.  Return a
+// value for the `tags::internal::w3c_extraction_error` tag if the value is
+// invalid, in which case `result` might be partially populated.
+Optional<std::string> parse_traceparent(ExtractedData& result,
+                                        StringView traceparent);
 
 // Return a value for the "traceparent" header consisting of the specified
 // `trace_id` or the optionally specified `full_w3c_trace_id_hex` as the trace
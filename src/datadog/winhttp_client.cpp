@@ -0,0 +1,555 @@
+#include "winhttp_client.h"
+
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <datadog/logger.h>
+#include <datadog/optional.h>
+#include <datadog/string_view.h>
+#include <windows.h>
+#include <winhttp.h>
+
+#include <climits>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+#include "parse_util.h"
+#include "string_util.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+std::wstring widen(StringView input) {
+  if (input.empty()) {
+    return std::wstring();
+  }
+  const int size = ::MultiByteToWideChar(CP_UTF8, 0, input.data(),
+                                         int(input.size()), nullptr, 0);
+  std::wstring result(size, L'\0');
+  ::MultiByteToWideChar(CP_UTF8, 0, input.data(), int(input.size()),
+                        &result[0], size);
+  return result;
+}
+
+std::string narrow(const wchar_t* input, std::size_t length) {
+  if (length == 0) {
+    return std::string();
+  }
+  const int size = ::WideCharToMultiByte(CP_UTF8, 0, input, int(length),
+                                         nullptr, 0, nullptr, nullptr);
+  std::string result(size, '\0');
+  ::WideCharToMultiByte(CP_UTF8, 0, input, int(length), &result[0], size,
+                        nullptr, nullptr);
+  return result;
+}
+
+std::string system_error_message(StringView what, DWORD error_number) {
+  std::string message;
+  append(message, what);
+  message += ": ";
+  if (error_number < WINHTTP_ERROR_BASE || error_number > WINHTTP_ERROR_LAST) {
+    message += std::system_category().message(int(error_number));
+    return message;
+  }
+
+  // The descriptions of WinHTTP's own errors are in winhttp.dll, not in the
+  // system's message table.
+  wchar_t* buffer = nullptr;
+  const DWORD length = ::FormatMessageW(
+      FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_HMODULE |
+          FORMAT_MESSAGE_IGNORE_INSERTS,
+      ::GetModuleHandleW(L"winhttp.dll"), error_number, 0,
+      reinterpret_cast<LPWSTR>(&buffer), 0, nullptr);
+  if (length == 0) {
+    message += "WinHTTP error ";
+    message += std::to_string(error_number);
+    return message;
+  }
+  append(message, trim(narrow(buffer, length)));
+  ::LocalFree(buffer);
+  return message;
+}
+
+// Return the number of milliseconds from the specified `now` until the
+// specified `deadline`, rounded up, for use as a WinHTTP timeout.  WinHTTP
+// treats a timeout of zero as no timeout, so the result is at least one.
+int timeout_ms(std::chrono::steady_clock::time_point deadline,
+               std::chrono::steady_clock::time_point now) {
+  if (deadline <= now) {
+    return 1;
+  }
+  const auto milliseconds =
+      std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+  return milliseconds > INT_MAX ? INT_MAX : int(milliseconds);
+}
+
+// `RequestHeaderWriter` appends header fields to a block of headers in the
+// form accepted by `WinHttpSendRequest`.  It omits "Content-Length", which
+// WinHTTP sets itself.
+class RequestHeaderWriter : public DictWriter {
+  std::wstring& headers_;
+
+ public:
+  explicit RequestHeaderWriter(std::wstring& headers) : headers_(headers) {}
+
+  void set(StringView key, StringView value) override {
+    if (to_lower(key) == "content-length") {
+      return;
+    }
+    headers_ += widen(key);
+    headers_ += L": ";
+    headers_ += widen(value);
+    headers_ += L"\r\n";
+  }
+};
+
+class ResponseHeaderReader : public DictReader {
+  const std::unordered_map<std::string, std::string>& headers_lower_;
+  mutable std::string buffer_;
+
+ public:
+  explicit ResponseHeaderReader(
+      const std::unordered_map<std::string, std::string>& headers_lower)
+      : headers_lower_(headers_lower) {}
+
+  Optional<StringView> lookup(StringView key) const override {
+    buffer_ = to_lower(key);
+    const auto found = headers_lower_.find(buffer_);
+    if (found == headers_lower_.end()) {
+      return nullopt;
+    }
+    return found->second;
+  }
+
+  void visit(Visitor visitor) const override {
+    for (const auto& [key, value] : headers_lower_) {
+      visitor(key, value);
+    }
+  }
+};
+
+// Read the response header fields of the specified `request` handle into the
+// specified `headers_lower`, keyed by lower-case field name.
+void read_headers(HINTERNET request,
+                  std::unordered_map<std::string, std::string>& headers_lower) {
+  DWORD size = 0;
+  ::WinHttpQueryHeaders(request, WINHTTP_QUERY_RAW_HEADERS_CRLF,
+                        WINHTTP_HEADER_NAME_BY_INDEX, WINHTTP_NO_OUTPUT_BUFFER,
+                        &size, WINHTTP_NO_HEADER_INDEX);
+  if (::GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+    return;
+  }
+  std::wstring buffer(size / sizeof(wchar_t), L'\0');
+  if (!::WinHttpQueryHeaders(request, WINHTTP_QUERY_RAW_HEADERS_CRLF,
+                             WINHTTP_HEADER_NAME_BY_INDEX, &buffer[0], &size,
+                             WINHTTP_NO_HEADER_INDEX)) {
+    return;
+  }
+  const std::string raw = narrow(buffer.data(), size / sizeof(wchar_t));
+
+  // The first line is the status line, e.g. "HTTP/1.1 200 OK".
+  StringView fields = raw;
+  const auto status_line_end = fields.find("\r\n");
+  fields = status_line_end == StringView::npos
+               ? StringView()
+               : fields.substr(status_line_end + 2);
+  while (!fields.empty()) {
+    const auto line_end = fields.find("\r\n");
+    const StringView line = fields.substr(0, line_end);
+    fields = line_end == StringView::npos ? StringView()
+                                          : fields.substr(line_end + 2);
+    const auto colon = line.find(':');
+    if (colon == StringView::npos) {
+      continue;
+    }
+    headers_lower.emplace(to_lower(trim(line.substr(0, colon))),
+                          std::string(trim(line.substr(colon + 1))));
+  }
+}
+
+// Split the specified `authority`, e.g. "localhost:8126" or "[::1]:8126", into
+// a host and a port.  Use the specified `default_port` if `authority` has no
+// port.  Return null if the port is invalid.
+Optional<std::pair<std::string, INTERNET_PORT>> split_authority(
+    StringView authority, INTERNET_PORT default_port) {
+  StringView host = authority;
+  StringView port;
+  const auto bracket = authority.rfind(']');
+  const auto colon = authority.rfind(':');
+  if (colon != StringView::npos &&
+      (bracket == StringView::npos || colon > bracket)) {
+    host = authority.substr(0, colon);
+    port = authority.substr(colon + 1);
+  }
+  if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  if (port.empty()) {
+    return std::make_pair(std::string(host), default_port);
+  }
+  const auto parsed = parse_uint64(port, 10);
+  if (!parsed || *parsed == 0 || *parsed > 65535) {
+    return nullopt;
+  }
+  return std::make_pair(std::string(host), INTERNET_PORT(*parsed));
+}
+
+}  // namespace
+
+struct WinHTTPClient::Request {
+  WinHTTPClient* client;
+  HINTERNET handle = nullptr;
+  // Whether `handle` has been closed, or is about to be.  Guarded by
+  // `client->mutex_`.
+  bool closed = false;
+  // Whether `on_response` or `on_error` has been invoked, or never will be.
+  // Guarded by `client->mutex_`.
+  bool finished = false;
+  // WinHTTP reads the body directly from `body`, which is kept until the
+  // handle is closed.
+  SharedBody body;
+  ResponseHandler on_response;
+  ErrorHandler on_error;
+  int status = 0;
+  std::unordered_map<std::string, std::string> headers_lower;
+  std::string response_body;
+  // The offset within `response_body` into which the pending read writes.
+  std::size_t read_offset = 0;
+
+  static void CALLBACK status_callback(HINTERNET, DWORD_PTR context,
+                                       DWORD status, LPVOID information,
+                                       DWORD length) {
+    // Only request handles have a context.
+    if (context == 0) {
+      return;
+    }
+    auto* request = reinterpret_cast<Request*>(context);
+    request->client->on_status(*request, status, information, length);
+  }
+};
+
+WinHTTPClient::WinHTTPClient(const std::shared_ptr<Logger>& logger,
+                             const Clock& clock)
+    : logger_(logger), clock_(clock), session_(nullptr), shutting_down_(false) {
+  HINTERNET session =
+      ::WinHttpOpen(L"dd-trace-cpp", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+                    WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS,
+                    WINHTTP_FLAG_ASYNC);
+  if (session == nullptr) {
+    logger_->log_error(Error{
+        Error::WINHTTP_CLIENT_SETUP_FAILED,
+        system_error_message("Unable to open a WinHTTP session",
+                             ::GetLastError())});
+    return;
+  }
+
+  const auto previous = ::WinHttpSetStatusCallback(
+      session, &Request::status_callback,
+      WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES,
+      0);
+  if (previous == WINHTTP_INVALID_STATUS_CALLBACK) {
+    logger_->log_error(Error{
+        Error::WINHTTP_CLIENT_SETUP_FAILED,
+        system_error_message("Unable to set the WinHTTP status callback",
+                             ::GetLastError())});
+    ::WinHttpCloseHandle(session);
+    return;
+  }
+
+  session_ = session;
+}
+
+WinHTTPClient::~WinHTTPClient() {
+  // Cancel outstanding requests, and wait for WinHTTP to be done with them.
+  // Handles are closed without `mutex_` locked, because WinHTTP may report
+  // that a handle is closing before `WinHttpCloseHandle` returns.
+  std::vector<HINTERNET> handles;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+    for (Request* request : requests_) {
+      if (!request->closed) {
+        request->closed = true;
+        handles.push_back(request->handle);
+      }
+    }
+  }
+  for (const HINTERNET handle : handles) {
+    ::WinHttpCloseHandle(handle);
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    no_requests_.wait(lock, [this]() { return requests_.empty(); });
+  }
+
+  for (const auto& [_, connection] : connections_) {
+    ::WinHttpCloseHandle(connection);
+  }
+  if (session_) {
+    ::WinHttpCloseHandle(session_);
+  }
+}
+
+Expected<void*> WinHTTPClient::connection(const URL& url) {
+  std::string key = url.scheme;
+  key += "://";
+  key += url.authority;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto found = connections_.find(key);
+  if (found != connections_.end()) {
+    return found->second;
+  }
+
+  const auto host_port = split_authority(
+      url.authority, url.scheme == "https" ? INTERNET_DEFAULT_HTTPS_PORT
+                                           : INTERNET_DEFAULT_HTTP_PORT);
+  if (!host_port) {
+    std::string message;
+    message += "Invalid port in URL authority \"";
+    message += url.authority;
+    message += "\".";
+    return Error{Error::WINHTTP_CLIENT_REQUEST_SETUP_FAILED,
+                 std::move(message)};
+  }
+
+  const HINTERNET connection = ::WinHttpConnect(
+      session_, widen(host_port->first).c_str(), host_port->second, 0);
+  if (connection == nullptr) {
+    std::string what = "Unable to create a WinHTTP connection to ";
+    what += url.authority;
+    return Error{Error::WINHTTP_CLIENT_REQUEST_SETUP_FAILED,
+                 system_error_message(what, ::GetLastError())};
+  }
+  connections_.emplace(std::move(key), connection);
+  return connection;
+}
+
+void WinHTTPClient::close(Request& request) {
+  HINTERNET handle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (request.closed) {
+      return;
+    }
+    request.closed = true;
+    handle = request.handle;
+  }
+  // `request` might be deleted before `WinHttpCloseHandle` returns.
+  ::WinHttpCloseHandle(handle);
+}
+
+void WinHTTPClient::finish(Request& request, const Error* error) {
+  ResponseHandler on_response;
+  ErrorHandler on_error;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (request.finished) {
+      return;
+    }
+    request.finished = true;
+    if (!shutting_down_) {
+      on_response = std::move(request.on_response);
+      on_error = std::move(request.on_error);
+    }
+  }
+
+  if (error && on_error) {
+    on_error(*error);
+  } else if (!error && on_response) {
+    const ResponseHeaderReader reader{request.headers_lower};
+    on_response(request.status, reader, std::move(request.response_body));
+  }
+  close(request);
+}
+
+void WinHTTPClient::on_status(Request& request, unsigned long status,
+                              void* information, unsigned long length) {
+  const HINTERNET handle = request.handle;
+  const auto fail = [&](DWORD error_number, StringView what) {
+    const Error error{Error::WINHTTP_CLIENT_REQUEST_FAILURE,
+                      system_error_message(what, error_number)};
+    finish(request, &error);
+  };
+  const auto query_data_available = [&]() {
+    if (!::WinHttpQueryDataAvailable(handle, nullptr)) {
+      fail(::GetLastError(), "Unable to read the HTTP response body");
+    }
+  };
+
+  switch (status) {
+    case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+      if (!::WinHttpReceiveResponse(handle, nullptr)) {
+        fail(::GetLastError(), "Unable to receive the HTTP response");
+      }
+      break;
+
+    case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE: {
+      DWORD code = 0;
+      DWORD size = sizeof code;
+      ::WinHttpQueryHeaders(
+          handle, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+          WINHTTP_HEADER_NAME_BY_INDEX, &code, &size, WINHTTP_NO_HEADER_INDEX);
+      request.status = int(code);
+      read_headers(handle, request.headers_lower);
+      query_data_available();
+    } break;
+
+    case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE: {
+      const DWORD available = *static_cast<const DWORD*>(information);
+      if (available == 0) {
+        finish(request, nullptr);
+        break;
+      }
+      request.read_offset = request.response_body.size();
+      request.response_body.resize(request.read_offset + available);
+      if (!::WinHttpReadData(handle,
+                             &request.response_body[request.read_offset],
+                             available, nullptr)) {
+        fail(::GetLastError(), "Unable to read the HTTP response body");
+      }
+    } break;
+
+    case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+      request.response_body.resize(request.read_offset + length);
+      if (length == 0) {
+        finish(request, nullptr);
+      } else {
+        query_data_available();
+      }
+      break;
+
+    case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR: {
+      const auto* result =
+          static_cast<const WINHTTP_ASYNC_RESULT*>(information);
+      std::string what = "HTTP request failed";
+      if (result->dwResult == API_SEND_REQUEST) {
+        what = "Unable to send the HTTP request";
+      } else if (result->dwResult == API_RECEIVE_RESPONSE) {
+        what = "Unable to receive the HTTP response";
+      }
+      fail(result->dwError, what);
+    } break;
+
+    case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING: {
+      // This is the last notification for the request.
+      const std::unique_ptr<Request> owner{&request};
+      std::lock_guard<std::mutex> lock(mutex_);
+      requests_.erase(&request);
+      if (requests_.empty()) {
+        no_requests_.notify_all();
+      }
+    } break;
+  }
+}
+
+Expected<void> WinHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, std::string body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  return post(url, std::move(set_headers),
+              std::make_shared<const std::string>(std::move(body)),
+              std::move(on_response), std::move(on_error), deadline);
+}
+
+Expected<void> WinHTTPClient::post(
+    const URL& url, HeadersSetter set_headers, SharedBody body,
+    ResponseHandler on_response, ErrorHandler on_error,
+    std::chrono::steady_clock::time_point deadline) {
+  if (session_ == nullptr) {
+    return Error{Error::WINHTTP_CLIENT_NOT_RUNNING,
+                 "Unable to send request because the HTTP client failed to "
+                 "start."};
+  }
+  if (url.scheme != "http" && url.scheme != "https") {
+    std::string message;
+    message += "WinHTTPClient does not support the \"";
+    message += url.scheme;
+    message += "\" URL scheme.";
+    return Error{Error::WINHTTP_CLIENT_REQUEST_SETUP_FAILED,
+                 std::move(message)};
+  }
+  if (body.data.size() > MAXDWORD) {
+    return Error{Error::WINHTTP_CLIENT_REQUEST_SETUP_FAILED,
+                 "Request body is too large for WinHTTP."};
+  }
+
+  auto connection = this->connection(url);
+  if (auto* error = connection.if_error()) {
+    return *error;
+  }
+
+  const std::wstring path = widen(url.path.empty() ? "/" : url.path);
+  const HINTERNET handle = ::WinHttpOpenRequest(
+      *connection, L"POST", path.c_str(), nullptr, WINHTTP_NO_REFERER,
+      WINHTTP_DEFAULT_ACCEPT_TYPES,
+      url.scheme == "https" ? WINHTTP_FLAG_SECURE : 0);
+  if (handle == nullptr) {
+    return Error{Error::WINHTTP_CLIENT_REQUEST_SETUP_FAILED,
+                 system_error_message("Unable to create a WinHTTP request",
+                                      ::GetLastError())};
+  }
+
+  auto request = std::make_unique<Request>();
+  request->client = this;
+  request->handle = handle;
+  request->body = std::move(body);
+  request->on_response = std::move(on_response);
+  request->on_error = std::move(on_error);
+
+  // The context identifies the request to `Request::status_callback`.  It is
+  // set before anything can fail, so that the notification that the handle is
+  // closing, which deletes the request, always finds it.
+  DWORD_PTR context = reinterpret_cast<DWORD_PTR>(request.get());
+  ::WinHttpSetOption(handle, WINHTTP_OPTION_CONTEXT_VALUE, &context,
+                     sizeof context);
+  const int timeout = timeout_ms(deadline, clock_().tick);
+  ::WinHttpSetTimeouts(handle, timeout, timeout, timeout, timeout);
+
+  std::wstring headers;
+  RequestHeaderWriter writer{headers};
+  set_headers(writer);
+
+  Request* const raw = request.release();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.insert(raw);
+  }
+
+  const auto size = DWORD(raw->body.data.size());
+  if (!::WinHttpSendRequest(
+          handle,
+          headers.empty() ? WINHTTP_NO_ADDITIONAL_HEADERS : headers.c_str(),
+          headers.empty() ? 0 : DWORD(-1L),
+          const_cast<char*>(raw->body.data.data()), size, size, context)) {
+    const DWORD error_number = ::GetLastError();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // The error is returned instead of being passed to `on_error`.
+      raw->finished = true;
+    }
+    close(*raw);
+    return Error{Error::WINHTTP_CLIENT_REQUEST_FAILURE,
+                 system_error_message("Unable to send the HTTP request",
+                                      error_number)};
+  }
+
+  return nullopt;
+}
+
+void WinHTTPClient::drain(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  no_requests_.wait_until(lock, deadline,
+                          [this]() { return requests_.empty(); });
+}
+
+std::string WinHTTPClient::config() const {
+  return nlohmann::json::object({{"type", "datadog::tracing::WinHTTPClient"}})
+      .dump();
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,104 @@
+#pragma once
+
+// This component provides a `class`, `WinHTTPClient`, that implements the
+// `HTTPClient` interface in terms of WinHTTP, the HTTP client built into
+// Windows, without libcurl.
+//
+// `WinHTTPClient` uses WinHTTP in asynchronous mode.  A request is started by
+// `post` and then advanced by WinHTTP's completion callbacks, which run on
+// WinHTTP's own thread pool.  So, unlike `Curl` and `SocketHTTPClient`,
+// `WinHTTPClient` runs no thread of its own, and `on_response` and `on_error`
+// are invoked on a WinHTTP thread.
+//
+// All requests share one WinHTTP session, and requests to the same host and
+// port share one connection handle, so WinHTTP reuses the underlying
+// connections from its pool.  "http" and "https" URLs are supported.  Unix
+// domain socket URLs ("unix://", "http+unix://") are not, since WinHTTP
+// cannot connect to them.
+//
+// A request's deadline is applied as WinHTTP's resolve, connect, send, and
+// receive timeouts, so a request that exceeds its deadline fails with a
+// timeout error.  When a `WinHTTPClient` is destroyed, requests that are still
+// outstanding are cancelled without their callbacks being invoked, as `Curl`
+// abandons them.
+//
+// This file and its implementation, `winhttp_client.cpp`, are included only
+// in builds for Windows.  If this library was built with
+// `DD_TRACE_TRANSPORT` set to "winhttp", then `default_http_client` returns a
+// `WinHTTPClient`.
+
+#include <datadog/clock.h>
+#include <datadog/http_client.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace datadog {
+namespace tracing {
+
+class Logger;
+
+class WinHTTPClient : public HTTPClient {
+  struct Request;
+
+  const std::shared_ptr<Logger> logger_;
+  const Clock clock_;
+  // `session_` is the WinHTTP session handle, or null if it could not be
+  // opened.  Handles are kept as `void*`, which is what WinHTTP's `HINTERNET`
+  // is, so that this header need not include <windows.h>.
+  void* session_;
+  std::mutex mutex_;
+  std::condition_variable no_requests_;
+  // Connection handles, by URL scheme and authority.
+  std::unordered_map<std::string, void*> connections_;
+  // Requests whose handles are open.  A request is removed when WinHTTP
+  // reports that its handle is closing, which is the last callback that
+  // WinHTTP makes for it.
+  std::unordered_set<Request*> requests_;
+  bool shutting_down_;
+
+  // Return the connection handle for the specified `url`, opening it if
+  // necessary.
+  Expected<void*> connection(const URL& url);
+  // Close the request handle of the specified `request`, unless it is already
+  // closed.  The behavior is undefined unless `mutex_` is locked.
+  void close(Request& request);
+  // Handle the specified WinHTTP `status` notification for the specified
+  // `request`.  `information` and `length` are as passed to the WinHTTP
+  // status callback.
+  void on_status(Request& request, unsigned long status, void* information,
+                 unsigned long length);
+  // Invoke the response callback of the specified `request`, or its error
+  // callback if the specified `error` is not null, and then close the request.
+  // Invoke neither if the client is shutting down.
+  void finish(Request& request, const Error* error);
+
+ public:
+  WinHTTPClient(const std::shared_ptr<Logger>&, const Clock&);
+  ~WinHTTPClient();
+
+  WinHTTPClient(const WinHTTPClient&) = delete;
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      SharedBody body, ResponseHandler on_response,
+                      ErrorHandler on_error,
+                      std::chrono::steady_clock::time_point deadline) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override;
+
+  std::string config() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,66 @@
+#include "worker_pool.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace datadog {
+namespace tracing {
+
+WorkerPool::WorkerPool(std::size_t threads, std::size_t min_items,
+                       const ThreadFactory& thread_factory)
+    : min_items_(min_items) {
+  workers_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers_.push_back(std::make_unique<BackgroundWorker>(
+        thread_factory, "dd-finalizer-worker"));
+  }
+}
+
+std::size_t WorkerPool::ranges(std::size_t count) const {
+  if (count < min_items_ || count <= workers_.size()) {
+    return 1;
+  }
+  return workers_.size() + 1;
+}
+
+void WorkerPool::for_each_range(
+    std::size_t count,
+    FunctionRef<void(std::size_t range, std::size_t begin, std::size_t end)>
+        task) {
+  const std::size_t num_ranges = ranges(count);
+  const auto begin = [&](std::size_t range) {
+    return count * range / num_ranges;
+  };
+
+  // `remaining` counts the ranges posted to workers that have not finished.
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::size_t remaining = 0;
+  for (std::size_t range = 1; range < num_ranges; ++range) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++remaining;
+    }
+    const bool posted = workers_[range - 1]->post([&, range]() {
+      task(range, begin(range), begin(range + 1));
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--remaining == 0) {
+        finished.notify_one();
+      }
+    });
+    if (!posted) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        --remaining;
+      }
+      task(range, begin(range), begin(range + 1));
+    }
+  }
+  task(0, 0, begin(1));
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&]() { return remaining == 0; });
+}
+
+}  // namespace tracing
+}  // namespace datadog
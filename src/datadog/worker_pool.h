@@ -0,0 +1,64 @@
+#pragma once
+
+// This component provides a `class`, `WorkerPool`, that divides work on a
+// range of items, such as the spans of a trace, among several threads.
+//
+// A trace segment with tens of thousands of spans takes long to finalize on
+// one thread: its spans are matched against the span sampling rules, and
+// then encoded by the collector.  If `TracerConfig::
+// parallel_finalization_min_spans` is nonzero, then the `Tracer` creates a
+// `WorkerPool`, and segments having at least that many spans are divided
+// into contiguous ranges of spans, one per thread of the pool and one more
+// for the calling thread, which are processed concurrently.  Smaller
+// segments are processed on the calling thread alone, as usual.
+//
+// The pool's threads are `BackgroundWorker`s.  The calling thread waits for
+// every range to be processed, so the work is finished, and its results can
+// be combined in order, when `for_each_range` returns.  In the child of a
+// `fork`, where the pool's threads do not exist, every range is processed on
+// the calling thread.
+
+#include <datadog/function_ref.h>
+#include <datadog/thread_factory.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "background_worker.h"
+
+namespace datadog {
+namespace tracing {
+
+class WorkerPool {
+  std::vector<std::unique_ptr<BackgroundWorker>> workers_;
+  std::size_t min_items_;
+
+ public:
+  // Start the specified number of `threads` using the specified
+  // `thread_factory`.  Work on fewer than the specified `min_items` is not
+  // divided.
+  WorkerPool(std::size_t threads, std::size_t min_items,
+             const ThreadFactory& thread_factory);
+
+  std::size_t threads() const { return workers_.size(); }
+  std::size_t min_items() const { return min_items_; }
+
+  // Return the number of ranges into which `for_each_range` divides the
+  // specified `count` of items: one if `count` is less than `min_items`, and
+  // otherwise one more than the number of threads.
+  std::size_t ranges(std::size_t count) const;
+
+  // Divide the items from zero up to the specified `count` into `ranges(count)`
+  // contiguous ranges of about the same size, and invoke the specified `task`
+  // with the index of each range and the items at which it begins and ends.
+  // The first range is processed on the calling thread, and the others on the
+  // pool's threads, concurrently.  Return once every range is processed.
+  void for_each_range(
+      std::size_t count,
+      FunctionRef<void(std::size_t range, std::size_t begin, std::size_t end)>
+          task);
+};
+
+}  // namespace tracing
+}  // namespace datadog
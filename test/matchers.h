@@ -2,12 +2,15 @@
 
 #include <algorithm>
 #include <sstream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "flat_map.h"
 #include "test.h"
 
-template <typename Map>
-class ContainsSubset : public Catch::MatcherBase<Map> {
+template <typename Map, typename Matched = Map>
+class ContainsSubset : public Catch::MatcherBase<Matched> {
   const Map* subset_;
 
   // `find` for when we're comparing with a `vector`.
@@ -26,7 +29,7 @@ class ContainsSubset : public Catch::MatcherBase<Map> {
  public:
   ContainsSubset(const Map& subset) : subset_(&subset) {}
 
-  bool match(const Map& other) const override {
+  bool match(const Matched& other) const override {
     return std::all_of(subset_->begin(), subset_->end(), [&](const auto& item) {
       const auto& [key, value] = item;
       auto found = find(other, key);
@@ -48,3 +51,8 @@ class ContainsSubset : public Catch::MatcherBase<Map> {
     return stream.str();
   }
 };
+
+// A subset given as an `unordered_map` is matched against the tags of a span.
+ContainsSubset(const std::unordered_map<std::string, std::string>&)
+    -> ContainsSubset<std::unordered_map<std::string, std::string>,
+                      datadog::tracing::FlatMap<std::string>>;
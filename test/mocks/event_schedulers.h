@@ -6,6 +6,7 @@
 #include <chrono>
 #include <datadog/json.hpp>
 #include <functional>
+#include <vector>
 
 using namespace datadog::tracing;
 
@@ -13,6 +14,9 @@ struct MockEventScheduler : public EventScheduler {
   std::function<void()> event_callback;
   Optional<std::chrono::steady_clock::duration> recurrence_interval;
   bool cancelled = false;
+  // Callbacks passed to `schedule_event`, which are never invoked by
+  // `MockEventScheduler` itself.
+  std::vector<std::function<void()>> one_off_events;
 
   Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
                                   std::function<void()> callback) override {
@@ -21,6 +25,11 @@ struct MockEventScheduler : public EventScheduler {
     return [this]() { cancelled = true; };
   }
 
+  bool schedule_event(std::function<void()> callback) override {
+    one_off_events.push_back(std::move(callback));
+    return true;
+  }
+
   std::string config() const override {
     return nlohmann::json::object({{"type", "MockEventScheduler"}}).dump();
   }
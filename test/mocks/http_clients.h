@@ -10,6 +10,7 @@
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "dict_readers.h"
 #include "dict_writers.h"
@@ -17,7 +18,8 @@
 using namespace datadog::tracing;
 
 // `MockHTTPClient` handles at most one request (the most recent call to
-// `post`), doing so in the `drain` member function.
+// `post`), doing so in the `drain` member function.  The bodies of all requests
+// are kept in `request_bodies`.
 //
 // Customize the behavior of `MockHTTPClient` by setting any combination of the
 // following data members:
@@ -36,12 +38,18 @@ struct MockHTTPClient : public HTTPClient {
   std::unordered_map<std::string, std::string> response_headers;
   Optional<Error> response_error;
   MockDictWriter request_headers;
+  URL request_url;
+  std::vector<URL> request_urls;
+  std::string request_body;
+  std::vector<std::string> request_bodies;
   std::mutex mutex_;
   ResponseHandler on_response_;
   ErrorHandler on_error_;
 
+  using HTTPClient::post;
+
   Expected<void> post(
-      const URL&, HeadersSetter set_headers, std::string /*body*/,
+      const URL& url, HeadersSetter set_headers, std::string body,
       ResponseHandler on_response, ErrorHandler on_error,
       std::chrono::steady_clock::time_point /*deadline*/) override {
     std::lock_guard<std::mutex> lock{mutex_};
@@ -49,6 +57,10 @@ struct MockHTTPClient : public HTTPClient {
       on_response_ = on_response;
       on_error_ = on_error;
       set_headers(request_headers);
+      request_url = url;
+      request_urls.push_back(url);
+      request_bodies.push_back(body);
+      request_body = std::move(body);
     }
     return Expected<void>(post_error);
   }
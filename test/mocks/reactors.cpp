@@ -0,0 +1 @@
+#include "reactors.h"
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <datadog/reactor.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace datadog::tracing;
+
+// `ManualReactor` is a `Reactor` whose callbacks are invoked only when a test
+// says so.
+struct ManualReactor : public Reactor {
+  struct Watch {
+    int events;
+    std::function<void(int)> on_ready;
+  };
+  struct Timer {
+    std::chrono::steady_clock::time_point deadline;
+    std::function<void()> on_timeout;
+  };
+
+  std::mutex mutex;
+  std::map<int, Watch> watches;
+  std::map<TimerID, Timer> timers;
+  std::vector<std::function<void()>> posted;
+  TimerID next_timer_id = 1;
+
+  void watch(int fd, int events,
+             std::function<void(int ready)> on_ready) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    watches[fd] = Watch{events, std::move(on_ready)};
+  }
+
+  void unwatch(int fd) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    watches.erase(fd);
+  }
+
+  TimerID set_timer(std::chrono::steady_clock::time_point deadline,
+                    std::function<void()> on_timeout) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    const TimerID id = next_timer_id++;
+    timers.emplace(id, Timer{deadline, std::move(on_timeout)});
+    return id;
+  }
+
+  void cancel_timer(TimerID id) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    timers.erase(id);
+  }
+
+  void post(std::function<void()> task) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    posted.push_back(std::move(task));
+  }
+
+  // Invoke the posted tasks, including any that they post.  Return how many
+  // were invoked.
+  int run_posted() {
+    int count = 0;
+    for (;;) {
+      std::vector<std::function<void()>> tasks;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.swap(posted);
+      }
+      if (tasks.empty()) {
+        return count;
+      }
+      for (auto& task : tasks) {
+        task();
+        ++count;
+      }
+    }
+  }
+
+  // Invoke the callbacks of the timers that are due at the specified `now`.
+  // Return how many were invoked.
+  int run_timers(std::chrono::steady_clock::time_point now) {
+    std::vector<std::function<void()>> due;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto it = timers.begin(); it != timers.end();) {
+        if (it->second.deadline <= now) {
+          due.push_back(std::move(it->second.on_timeout));
+          it = timers.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    for (auto& on_timeout : due) {
+      on_timeout();
+    }
+    return int(due.size());
+  }
+
+  std::size_t num_timers() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return timers.size();
+  }
+};
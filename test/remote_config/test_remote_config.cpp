@@ -89,6 +89,27 @@ REMOTE_CONFIG_TEST("initial state payload") {
   CHECK(payload["client"]["state"].contains("config_states") == false);
 }
 
+REMOTE_CONFIG_TEST("request body is cached between responses") {
+  const TracerSignature tracer_signature{
+      /* runtime_id = */ RuntimeID::generate(),
+      /* service = */ "testsvc",
+      /* environment = */ "test"};
+
+  rc::Manager rc(tracer_signature, {}, logger);
+
+  const std::string first = rc.make_request_body();
+  const auto& second = rc.make_request_body();
+  CHECK(first == second);
+  CHECK(nlohmann::json::parse(first) == rc.make_request_payload());
+
+  // An invalid response is reported in the next request.
+  rc.process_response(nlohmann::json::object());
+  const auto payload = nlohmann::json::parse(rc.make_request_body());
+  CHECK(payload.at("/client/state/has_error"_json_pointer) == true);
+  CHECK(payload.at("/client/client_tracer/service"_json_pointer) == "testsvc");
+  CHECK(payload.contains("cached_target_files") == false);
+}
+
 // TODO: test all combination of product and capabilities generation
 
 REMOTE_CONFIG_TEST("response processing") {
@@ -322,6 +343,46 @@ REMOTE_CONFIG_TEST("response processing") {
       CHECK(h.at("hash").get<std::string_view>().size() == 64U);
     }
 
+    SECTION("saved state restores the applied configurations") {
+      auto restored_tracing_listener = std::make_shared<FakeListener>();
+      restored_tracing_listener->products = rc::product::APM_TRACING;
+      auto restored_agent_listener = std::make_shared<FakeListener>();
+      restored_agent_listener->products =
+          rc::product::AGENT_TASK | rc::product::AGENT_CONFIG;
+
+      rc::Manager restored(tracer_signature,
+                           {restored_tracing_listener, restored_agent_listener},
+                           logger);
+      restored.restore_state(rc.state_json());
+
+      // The configuration that failed to apply is not saved.
+      CHECK(restored_tracing_listener->count_on_update == 0);
+      CHECK(restored_agent_listener->count_on_update == 2);
+      CHECK(restored_agent_listener->count_on_post_process == 1);
+
+      const auto payload = restored.make_request_payload();
+      CHECK(payload.at("/client/state/targets_version"_json_pointer) ==
+            66204320);
+      CHECK(payload.at("/client/state/config_states"_json_pointer).size() ==
+            2);
+
+      // Only what was not restored is applied by the next response.
+      restored.process_response(response_json);
+      CHECK(restored_tracing_listener->count_on_update == 1);
+      CHECK(restored_agent_listener->count_on_update == 2);
+    }
+
+    SECTION("invalid saved state is ignored") {
+      rc::Manager restored(tracer_signature, {agent_listener}, logger);
+      auto state = rc.state_json();
+      state["configs"][0]["path"] = "foo";
+      restored.restore_state(state);
+
+      CHECK(agent_listener->count_on_update == 2);
+      const auto payload = restored.make_request_payload();
+      CHECK(payload.at("/client/state/targets_version"_json_pointer) == 0);
+    }
+
     SECTION("same config update should not trigger listeners") {
       rc.process_response(response_json);
       CHECK(tracing_listener->count_on_update == 1);
@@ -333,6 +394,26 @@ REMOTE_CONFIG_TEST("response processing") {
       CHECK(agent_listener->count_on_post_process == 2);
     }
 
+    SECTION("unchanged targets with fewer client configs reverts") {
+      auto next_response = response_json;
+      auto& client_configs = next_response.at("client_configs");
+      client_configs.erase(client_configs.begin());
+      rc.process_response(next_response);
+
+      CHECK(tracing_listener->count_on_update == 1);
+      CHECK(tracing_listener->count_on_revert == 1);
+      CHECK(tracing_listener->count_on_post_process == 2);
+
+      CHECK(agent_listener->count_on_update == 2);
+      CHECK(agent_listener->count_on_revert == 0);
+      CHECK(agent_listener->count_on_post_process == 2);
+
+      // Restoring the config applies it again.
+      rc.process_response(response_json);
+      CHECK(tracing_listener->count_on_update == 2);
+      CHECK(agent_listener->count_on_update == 2);
+    }
+
     SECTION("new version of a config calls listeners") {
       std::string_view new_rc_response = R"({
           "targets": "ewogICAgInNpZ25lZCI6IHsKICAgICAgICAiY3VzdG9tIjogewogICAgICAgICAgICAiYWdlbnRfcmVmcmVzaF9pbnRlcnZhbCI6IDUsCiAgICAgICAgICAgICJvcGFxdWVfYmFja2VuZF9zdGF0ZSI6ICJleUoyWlhKemFXOXVJam95TENKemRHRjBaU0k2ZXlKbWFXeGxYMmhoYzJobGN5STZleUprWVhSaFpHOW5MekV3TURBeE1qVTROREF2UVZCTlgxUlNRVU5KVGtjdk9ESTNaV0ZqWmpoa1ltTXpZV0l4TkRNMFpETXlNV05pT0RGa1ptSm1OMkZtWlRZMU5HRTBZall4TVRGalpqRTJOakJpTnpGalkyWTRPVGM0TVRrek9DOHlPVEE0Tm1Ka1ltVTFNRFpsTmpoaU5UQm1NekExTlRneU0yRXpaR0UxWTJVd05USTRaakUyTkRCa05USmpaamc0TmpFNE1UWmhZV0U1Wm1ObFlXWTBJanBiSW05WVpESnBlVU16ZUM5b1JXc3hlWFZoWTFoR04xbHFjWEpwVGs5QldVdHVaekZ0V0UwMU5WWktUSGM5SWwxOWZYMD0iCiAgICAgICAgfSwKICAgICAgICAic3BlY192ZXJzaW9uIjogIjEuMC4wIiwKICAgICAgICAidGFyZ2V0cyI6IHsKICAgICAgICAgICAgImVtcGxveWVlL0FQTV9UUkFDSU5HL3Rlc3RfcmNfdXBkYXRlL2xpYl91cGRhdGUiOiB7CiAgICAgICAgICAgICAgICAiaGFzaGVzIjogewogICAgICAgICAgICAgICAgICAgICJzaGEyNTYiOiAiM2I5NDIxY2FhYTVkNzUzMTg0NWY3YzMwN2FkN2M2MTU1ZDgxOTVkMjcwOTEzMzY0OTI2YzlmNjQxZTkyNDE0NyIKICAgICAgICAgICAgICAgIH0sCiAgICAgICAgICAgICAgICAibGVuZ3RoIjogMzc0LAoJCQkJImN1c3RvbSI6IHsgInYiOiAxNjAgfQogICAgICAgICAgICB9LAogICAgICAgICAgICAiZW1wbG95ZWUvQUdFTlRfVEFTSy90ZXN0X3JjX3VwZGF0ZS9mbGFyZV90YXNrIjogewogICAgICAgICAgICAgICAgImhhc2hlcyI6IHsKICAgICAgICAgICAgICAgICAgICAic2hhMjU2IjogIjU2Nzc0ODFhOGMyMWQ2Yzc0MDgyOWZkMTA2MTAwZjQ2ZjdjNTFmNTI2NWIwYmE1NDBiYzE5OGJkODMzOWY4NzIiCiAgICAgICAgICAgICAgICB9LAogICAgICAgICAgICAgICAgImxlbmd0aCI6IDM3NCwKCQkJCSJjdXN0b20iOiB7ICJ2IjogMTYxIH0KICAgICAgICAgICAgfSwKICAgICAgICAgICAgImVtcGxveWVlL0FHRU5UX0NPTkZJRy90ZXN0X3JjX3VwZGF0ZS9mbGFyZV9jb25mIjogewogICAgICAgICAgICAgICAgImhhc2hlcyI6IHsKICAgICAgICAgICAgICAgICAgICAic2hhMjU2IjogImU2OGVjOGQ5YjExYThjZDU4YzhjYTVlMTQyNWQ2MTYzZGI5NDdlYWEzNWY3Mzg1NjFjNDg2ZTE0NGU5NGZjNTIiCiAgICAgICAgICAgICAgICB9LAogICAgICAgICAgICAgICAgImxlbmd0aCI6IDM3NCwKCQkJCSJjdXN0b20iOiB7ICJ2IjogMTYyIH0KICAgICAgICAgICAgfQogICAgICAgIH0sCiAgICAgICAgInZlcnNpb24iOiA2NjIwNDMyMAogICAgfQp9Cg==",
@@ -49,9 +49,7 @@ class HeaderReader final : public datadog::tracing::DictReader {
   };
 
   // Invoke the specified `visitor` once for each key/value pair in this object.
-  void visit(const std::function<void(dd::StringView key,
-                                      dd::StringView value)>& /* visitor */)
-      const override {}
+  void visit(Visitor /* visitor */) const override {}
 };
 
 class HeaderWriter final : public dd::DictWriter {
@@ -21,6 +21,7 @@ TELEMETRY_CONFIGURATION_TEST("defaults") {
   CHECK(cfg->enabled == true);
   CHECK(cfg->report_metrics == true);
   CHECK(cfg->metrics_interval == 60s);
+  CHECK(cfg->metrics_capture_interval == 10s);
   CHECK(cfg->heartbeat_interval == 10s);
 }
 
@@ -29,6 +30,7 @@ TELEMETRY_CONFIGURATION_TEST("code override") {
   cfg.enabled = false;
   cfg.report_metrics = false;
   cfg.metrics_interval_seconds = 1;
+  cfg.metrics_capture_interval_seconds = 0.5;
   cfg.heartbeat_interval_seconds = 2;
   cfg.integration_name = "test";
   cfg.integration_version = "2024.10.28";
@@ -39,6 +41,7 @@ TELEMETRY_CONFIGURATION_TEST("code override") {
   CHECK(final_cfg->debug == false);
   CHECK(final_cfg->report_metrics == false);
   CHECK(final_cfg->metrics_interval == 1s);
+  CHECK(final_cfg->metrics_capture_interval == 500ms);
   CHECK(final_cfg->heartbeat_interval == 2s);
   CHECK(final_cfg->integration_name == "test");
   CHECK(final_cfg->integration_version == "2024.10.28");
@@ -2,6 +2,10 @@
 
 #include <datadog/telemetry/metrics.h>
 
+#include <limits>
+#include <thread>
+#include <vector>
+
 #include "test.h"
 
 using namespace datadog::telemetry;
@@ -16,6 +20,104 @@ TEST_CASE("Counter metrics", "[telemetry.metrics]") {
   auto captured_value = metric.capture_and_reset_value();
   REQUIRE(captured_value == 42);
   REQUIRE(metric.value() == 0);
+
+  // Capturing does not reset the total.
+  metric.add(8);
+  REQUIRE(metric.value() == 8);
+  REQUIRE(metric.total() == 50);
+  REQUIRE(metric.capture_and_reset_value() == 8);
+  REQUIRE(metric.total() == 50);
+}
+
+TEST_CASE("Metric type and serialized tags", "[telemetry.metrics]") {
+  CounterMetric counter = {"c", "test_scope", {"a:b", "quote:\""}, true};
+  REQUIRE(counter.kind() == MetricType::COUNT);
+  REQUIRE(counter.type() == "count");
+  REQUIRE(counter.tags_json() == R"(["a:b","quote:\""])");
+
+  GaugeMetric gauge = {"g", "test_scope", {}, true};
+  REQUIRE(gauge.kind() == MetricType::GAUGE);
+  REQUIRE(gauge.type() == "gauge");
+  REQUIRE(gauge.tags_json() == "[]");
+
+  DistributionMetric distribution = {"d", "test_scope", {}, true};
+  REQUIRE(distribution.kind() == MetricType::DISTRIBUTION);
+  REQUIRE(distribution.type() == "distribution");
+}
+
+TEST_CASE("Counter families", "[telemetry.metrics]") {
+  CounterFamily family{"requests", "test_scope", false, 2};
+  REQUIRE(family.size() == 0);
+
+  auto& a = family.counter({"endpoint:/a"});
+  REQUIRE(&family.counter({"endpoint:/a"}) == &a);
+  auto& b = family.counter({"endpoint:/b"});
+  REQUIRE(&b != &a);
+  // Tags are compared in full, not only by their hash.
+  REQUIRE(&family.counter({"endpoint:/a", ""}) != &a);
+  REQUIRE(family.size() == 3);
+  REQUIRE(a.name() == "requests");
+  REQUIRE(a.scope() == "test_scope");
+  REQUIRE(a.tags() == std::vector<std::string>{"endpoint:/a"});
+  REQUIRE(&family.at(0) == &a);
+  REQUIRE(&family.at(1) == &b);
+
+  // The family is full, so new tags share the overflow counter.
+  auto& overflow = family.at(2);
+  REQUIRE(overflow.tags() == std::vector<std::string>{"overflow:true"});
+  REQUIRE(&family.counter({"endpoint:/c"}) == &overflow);
+  REQUIRE(&family.counter({"endpoint:/b"}) == &b);
+  REQUIRE(family.size() == 3);
+}
+
+TEST_CASE("Counter families used concurrently", "[telemetry.metrics]") {
+  CounterFamily family{"requests", "test_scope", false};
+  const int num_threads = 8;
+  const int per_thread = 1000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&family]() {
+      for (int j = 0; j < per_thread; ++j) {
+        family.counter({"endpoint:" + std::to_string(j % 10)}).inc();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(family.size() == 10);
+  uint64_t total = 0;
+  for (std::size_t i = 0; i < family.size(); ++i) {
+    REQUIRE(family.at(i).value() == num_threads * per_thread / 10);
+    total += family.at(i).value();
+  }
+  REQUIRE(total == num_threads * per_thread);
+}
+
+TEST_CASE("Counter metrics incremented concurrently", "[telemetry.metrics]") {
+  CounterMetric metric = {
+      "test.counter.metric", "test_scope", {"testing-testing:123"}, true};
+
+  const int num_threads = 8;
+  const int increments_per_thread = 10000;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < increments_per_thread; ++j) {
+        metric.inc();
+      }
+    });
+  }
+
+  // Capturing while other threads count loses nothing.
+  uint64_t total = metric.capture_and_reset_value();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  total += metric.capture_and_reset_value();
+
+  REQUIRE(total == num_threads * increments_per_thread);
+  REQUIRE(metric.value() == 0);
 }
 
 TEST_CASE("Gauge metrics", "[telemetry.metrics]") {
@@ -35,3 +137,69 @@ TEST_CASE("Gauge metrics", "[telemetry.metrics]") {
   metric.sub(11);
   REQUIRE(metric.value() == 0);
 }
+
+TEST_CASE("Distribution metrics", "[telemetry.metrics]") {
+  DistributionMetric metric = {
+      "test.distribution.metric", "test_scope", {"testing-testing:123"}, true};
+
+  metric.add(3);
+  metric.add(3);
+  metric.add(1000);
+  REQUIRE(metric.value() == 3);
+  auto buckets = metric.capture_and_reset_buckets();
+  REQUIRE(buckets.size() == 2);
+  REQUIRE(buckets[0] == DistributionMetric::Bucket{3, 2});
+  REQUIRE(buckets[1].second == 1);
+  REQUIRE(buckets[1].first == DistributionMetric::bucket_value(
+                                  DistributionMetric::bucket_index(1000)));
+  REQUIRE(metric.value() == 0);
+  REQUIRE(metric.capture_and_reset_buckets().empty());
+
+  metric.add(7);
+  REQUIRE(metric.capture_and_reset_value() == 1);
+  REQUIRE(metric.value() == 0);
+}
+
+TEST_CASE("Distribution metric buckets", "[telemetry.metrics]") {
+  SECTION("small values are exact") {
+    for (uint64_t value = 0; value < 32; ++value) {
+      CAPTURE(value);
+      REQUIRE(DistributionMetric::bucket_value(
+                  DistributionMetric::bucket_index(value)) == value);
+    }
+  }
+
+  SECTION("reported values are within 1/32 of the value") {
+    std::vector<uint64_t> values;
+    for (int exponent = 5; exponent < 64; ++exponent) {
+      const uint64_t power = uint64_t(1) << exponent;
+      values.push_back(power);
+      values.push_back(power - 1);
+      values.push_back(power + power / 3);
+      values.push_back(power + power - 1);
+    }
+    values.push_back(std::numeric_limits<uint64_t>::max());
+
+    for (const uint64_t value : values) {
+      CAPTURE(value);
+      const std::size_t index = DistributionMetric::bucket_index(value);
+      REQUIRE(index < DistributionMetric::num_buckets);
+      const uint64_t reported = DistributionMetric::bucket_value(index);
+      const uint64_t error = reported > value ? reported - value
+                                              : value - reported;
+      REQUIRE(error <= value / 32);
+    }
+  }
+
+  SECTION("buckets are ordered") {
+    uint64_t previous = 0;
+    for (std::size_t index = 1; index < DistributionMetric::num_buckets;
+         ++index) {
+      CAPTURE(index);
+      const uint64_t value = DistributionMetric::bucket_value(index);
+      REQUIRE(value > previous);
+      REQUIRE(DistributionMetric::bucket_index(value) == index);
+      previous = value;
+    }
+  }
+}
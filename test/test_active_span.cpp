@@ -0,0 +1,92 @@
+// These are tests for `ActiveSpanSlot` and `ActiveSpanGuard`, which record
+// each thread's active span for a sampling profiler.
+
+#include <datadog/active_span.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/tracer.h>
+
+#include <memory>
+#include <thread>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+ActiveSpanSlot::Value read_slot(const ActiveSpanSlot& slot) {
+  ActiveSpanSlot::Value value;
+  REQUIRE(slot.read(value));
+  return value;
+}
+
+}  // namespace
+
+TEST_CASE("ActiveSpanGuard", "[active_span]") {
+  TracerConfig config;
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<MockLogger>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  ActiveSpanSlot& slot = active_span_slot();
+  REQUIRE(read_slot(slot).span_id == 0);
+
+  SECTION("guards nest, and restore the previously active span") {
+    Span root = tracer.create_span();
+    {
+      ActiveSpanGuard active_root{root};
+      auto value = read_slot(slot);
+      REQUIRE(value.trace_id == root.trace_id());
+      REQUIRE(value.span_id == root.id());
+      REQUIRE(value.local_root_id == root.id());
+      {
+        Span child = root.create_child();
+        ActiveSpanGuard active_child{child};
+        value = read_slot(slot);
+        REQUIRE(value.trace_id == root.trace_id());
+        REQUIRE(value.span_id == child.id());
+        REQUIRE(value.local_root_id == root.id());
+      }
+      REQUIRE(read_slot(slot).span_id == root.id());
+    }
+    const auto value = read_slot(slot);
+    REQUIRE(value.span_id == 0);
+    REQUIRE(value.local_root_id == 0);
+    REQUIRE(value.trace_id == TraceID{});
+  }
+
+  SECTION("each thread has its own slot") {
+    Span span = tracer.create_span();
+    ActiveSpanGuard active{span};
+    const ActiveSpanSlot* other_slot = nullptr;
+    ActiveSpanSlot::Value other_value;
+    bool other_read = false;
+    std::thread other([&]() {
+      other_slot = &active_span_slot();
+      other_read = other_slot->read(other_value);
+    });
+    other.join();
+    REQUIRE(other_slot != &slot);
+    REQUIRE(other_read);
+    REQUIRE(other_value.span_id == 0);
+    REQUIRE(read_slot(slot).span_id == span.id());
+  }
+
+  SECTION("a read during a write fails") {
+    Span span = tracer.create_span();
+    ActiveSpanGuard active{span};
+    // Pretend that a write is in progress.
+    slot.sequence += 1;
+    ActiveSpanSlot::Value value;
+    REQUIRE(!slot.read(value));
+    slot.sequence += 1;
+    REQUIRE(slot.read(value));
+    REQUIRE(value.span_id == span.id());
+  }
+}
@@ -0,0 +1,79 @@
+// These are tests for `AdaptiveSampler`, which chooses sample rates so that
+// about a target number of traces are kept per second.
+
+#include <datadog/adaptive_sampler.h>
+#include <datadog/clock.h>
+#include <datadog/span_data.h>
+
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("AdaptiveSampler", "[adaptive_sampler]") {
+  TimePoint now = default_clock();
+  const Clock clock = [&now]() { return now; };
+  AdaptiveSampler sampler{clock, 100};
+
+  SpanData busy;
+  busy.service = "checkout";
+  busy.resource = "GET /cart";
+  SpanData quiet;
+  quiet.service = "checkout";
+  quiet.resource = "POST /cart";
+
+  // Call `rate` for `count` traces like `busy` and `quiet_count` traces like
+  // `quiet` over the next window, and return the last rate for each.
+  const auto run_window = [&](std::size_t count, std::size_t quiet_count) {
+    Rate busy_rate = Rate::one();
+    Rate quiet_rate = Rate::one();
+    for (std::size_t i = 0; i < count; ++i) {
+      busy_rate = sampler.rate(busy);
+    }
+    for (std::size_t i = 0; i < quiet_count; ++i) {
+      quiet_rate = sampler.rate(quiet);
+    }
+    now += AdaptiveSampler::window;
+    return std::make_pair(busy_rate, quiet_rate);
+  };
+
+  SECTION("keeps everything before any traffic is counted") {
+    REQUIRE(sampler.rate(busy) == 1.0);
+  }
+
+  SECTION("keeps everything while under the target") {
+    for (int i = 0; i < 10; ++i) {
+      run_window(50, 0);
+    }
+    REQUIRE(run_window(50, 0).first == 1.0);
+  }
+
+  SECTION("converges on the target during a spike") {
+    for (int i = 0; i < 20; ++i) {
+      run_window(1000, 0);
+    }
+    REQUIRE(run_window(1000, 0).first.value() == Approx(0.1).epsilon(0.01));
+  }
+
+  SECTION("gives unused target to busier resources") {
+    for (int i = 0; i < 20; ++i) {
+      run_window(1000, 10);
+    }
+    const auto [busy_rate, quiet_rate] = run_window(1000, 10);
+    REQUIRE(quiet_rate == 1.0);
+    REQUIRE(busy_rate.value() == Approx(0.09).epsilon(0.01));
+  }
+
+  SECTION("recovers after a spike") {
+    for (int i = 0; i < 20; ++i) {
+      run_window(1000, 0);
+    }
+    for (int i = 0; i < 20; ++i) {
+      run_window(20, 0);
+    }
+    REQUIRE(run_window(20, 0).first == 1.0);
+  }
+}
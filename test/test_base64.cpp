@@ -1,5 +1,9 @@
 #include <datadog/base64.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
 #include "catch.hpp"
 #include "test.h"
 
@@ -30,3 +34,71 @@ BASE64_TEST("padding") {
   CHECK(base64_decode("bGlnaHQgd28=") == "light wo");
   CHECK(base64_decode("bGlnaHQgd29y") == "light wor");
 }
+
+namespace {
+
+std::string encode(const std::string& input) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string output;
+  std::size_t i = 0;
+  for (; i + 3 <= input.size(); i += 3) {
+    const auto bits = std::uint32_t(std::uint8_t(input[i])) << 16 |
+                      std::uint32_t(std::uint8_t(input[i + 1])) << 8 |
+                      std::uint8_t(input[i + 2]);
+    output += alphabet[bits >> 18];
+    output += alphabet[(bits >> 12) & 0x3F];
+    output += alphabet[(bits >> 6) & 0x3F];
+    output += alphabet[bits & 0x3F];
+  }
+  if (i + 1 == input.size()) {
+    const auto bits = std::uint32_t(std::uint8_t(input[i])) << 16;
+    output += alphabet[bits >> 18];
+    output += alphabet[(bits >> 12) & 0x3F];
+    output += "==";
+  } else if (i + 2 == input.size()) {
+    const auto bits = std::uint32_t(std::uint8_t(input[i])) << 16 |
+                      std::uint32_t(std::uint8_t(input[i + 1])) << 8;
+    output += alphabet[bits >> 18];
+    output += alphabet[(bits >> 12) & 0x3F];
+    output += alphabet[(bits >> 6) & 0x3F];
+    output += '=';
+  }
+  return output;
+}
+
+}  // namespace
+
+BASE64_TEST("long inputs") {
+  // Inputs long enough to be decoded 16 characters at a time agree with the
+  // scalar decoder.
+  std::string decoded;
+  for (int i = 0; i < 300; ++i) {
+    decoded += char(i * 37 + 11);
+    const std::string encoded = encode(decoded);
+    CAPTURE(encoded);
+    REQUIRE(base64_decode(encoded) == decoded);
+    REQUIRE(base64_decode_scalar(encoded) == decoded);
+  }
+
+  SECTION("invalid character anywhere") {
+    const std::string encoded = encode(decoded);
+    for (const char bad : {'@', '\x80', '\xFF', '\0', '-', '_'}) {
+      for (std::size_t i = 0; i < encoded.size(); ++i) {
+        std::string corrupted = encoded;
+        corrupted[i] = bad;
+        CAPTURE(i);
+        CHECK(base64_decode(corrupted) == "");
+        CHECK(base64_decode_scalar(corrupted) == "");
+      }
+    }
+  }
+
+  SECTION("'=' in the middle") {
+    // '=' before the last quadruplet decodes as zero, as it always has.
+    std::string encoded = encode(decoded);
+    encoded[17] = '=';
+    CHECK(base64_decode(encoded) == base64_decode_scalar(encoded));
+    CHECK(base64_decode(encoded).size() == decoded.size());
+  }
+}
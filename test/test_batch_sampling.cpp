@@ -0,0 +1,67 @@
+// These are tests for the functions in `batch_sampling.h`.  They must always
+// agree with `knuth_hash` and `max_id_from_rate` applied to one ID at a time,
+// as `TraceSampler` applies them.
+
+#include <datadog/batch_sampling.h>
+#include <datadog/rate.h>
+#include <datadog/sampling_util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+bool is_kept(const std::vector<std::uint64_t>& keep, std::size_t i) {
+  return (keep[i / 64] >> (i % 64)) & 1;
+}
+
+}  // namespace
+
+TEST_CASE("batch keep/drop decisions agree with one at a time",
+          "[batch_sampling]") {
+  const std::size_t count = GENERATE(0, 1, 63, 64, 65, 200);
+  CAPTURE(count);
+
+  std::mt19937_64 generator{count};
+  std::uniform_real_distribution<double> distribution{0.0, 1.0};
+  std::vector<std::uint64_t> ids;
+  std::vector<Rate> rates;
+  for (std::size_t i = 0; i < count; ++i) {
+    ids.push_back(generator());
+    rates.push_back(i % 5 == 0 ? Rate::one()
+                               : *Rate::from(distribution(generator)));
+  }
+  // Fill the masks with ones so that unused bits being cleared is tested.
+  const std::size_t num_words = (count + 63) / 64;
+  std::vector<std::uint64_t> keep(num_words, ~std::uint64_t(0));
+
+  SECTION("one rate") {
+    const Rate rate = *Rate::from(0.3);
+    keep_by_rate(ids.data(), count, rate, keep.data());
+    for (std::size_t i = 0; i < count; ++i) {
+      CAPTURE(i);
+      REQUIRE(is_kept(keep, i) ==
+              (knuth_hash(ids[i]) < max_id_from_rate(rate)));
+    }
+  }
+
+  SECTION("a rate per ID") {
+    keep_by_rates(ids.data(), rates.data(), count, keep.data());
+    for (std::size_t i = 0; i < count; ++i) {
+      CAPTURE(i);
+      REQUIRE(is_kept(keep, i) ==
+              (knuth_hash(ids[i]) < max_id_from_rate(rates[i])));
+    }
+  }
+
+  for (std::size_t i = count; i < num_words * 64; ++i) {
+    CAPTURE(i);
+    REQUIRE_FALSE(is_kept(keep, i));
+  }
+}
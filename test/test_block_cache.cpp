@@ -0,0 +1,92 @@
+// These are tests for `BlockCache` and `CachingAllocator`, which recycle the
+// storage of `SpanData` and `TraceSegment`, and for the `MemoryResource` from
+// which they allocate.
+
+#include <datadog/memory_resource.h>
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+#include "block_cache.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+struct Widget {
+  char bytes[200];
+};
+
+struct CountingResource : public MemoryResource {
+  std::size_t allocations = 0;
+
+  void* allocate(std::size_t size) override {
+    ++allocations;
+    return ::operator new(size);
+  }
+  void deallocate(void* block, std::size_t) noexcept override {
+    ::operator delete(block);
+  }
+};
+
+}  // namespace
+
+TEST_CASE("CachingAllocator", "[block_cache]") {
+  const CachingAllocator<Widget, 2> allocator;
+
+  SECTION("freed storage is reused by the same thread") {
+    auto first = std::allocate_shared<Widget>(allocator);
+    const void* const address = first.get();
+    first.reset();
+    const auto second = std::allocate_shared<Widget>(allocator);
+    REQUIRE(second.get() == address);
+  }
+
+  SECTION("storage freed beyond the cache's capacity is released") {
+    std::shared_ptr<Widget> widgets[3];
+    for (auto& widget : widgets) {
+      widget = std::allocate_shared<Widget>(allocator);
+    }
+    const void* const first = widgets[0].get();
+    const void* const second = widgets[1].get();
+    for (auto& widget : widgets) {
+      widget.reset();
+    }
+    // The cache holds the two blocks freed first, and hands out the most
+    // recently cached one first.
+    const auto reused1 = std::allocate_shared<Widget>(allocator);
+    const auto reused2 = std::allocate_shared<Widget>(allocator);
+    REQUIRE(reused1.get() == second);
+    REQUIRE(reused2.get() == first);
+  }
+
+  SECTION("storage freed on another thread goes to that thread's cache") {
+    auto widget = std::allocate_shared<Widget>(allocator);
+    const void* const address = widget.get();
+    const void* reused_address = nullptr;
+    std::thread([&]() {
+      widget.reset();
+      const auto reused = std::allocate_shared<Widget>(allocator);
+      reused_address = reused.get();
+    }).join();
+    REQUIRE(reused_address == address);
+  }
+}
+
+TEST_CASE("install_memory_resource", "[block_cache]") {
+  // Whatever the process's resource is, allocating a block settles it.
+  MemoryResource& settled = block_memory_resource();
+  REQUIRE(&block_memory_resource() == &settled);
+
+  const auto resource = std::make_shared<CountingResource>();
+  const auto result = install_memory_resource(resource);
+  REQUIRE(!result);
+  REQUIRE(result.error().code == Error::MEMORY_RESOURCE_CONFLICT);
+  REQUIRE(&block_memory_resource() == &settled);
+
+  const CachingAllocator<Widget, 0> uncached;
+  std::allocate_shared<Widget>(uncached).reset();
+  REQUIRE(resource->allocations == 0);
+}
@@ -1,10 +1,15 @@
+#include <datadog/async_cerr_logger.h>
 #include <datadog/cerr_logger.h>
 #include <datadog/error.h>
 
+#include <cstdio>
 #include <ios>
 #include <iostream>
 #include <ostream>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "test.h"
 
@@ -57,3 +62,95 @@ TEST_CASE("CerrLogger") {
     REQUIRE(stream.str() == "hello!\n");
   }
 }
+
+TEST_CASE("AsyncCerrLogger") {
+  std::ostringstream stream;
+  const StreambufGuard guard{std::cerr, stream.rdbuf()};
+  AsyncCerrLogger::Options options;
+
+  SECTION("writes messages in order") {
+    AsyncCerrLogger logger{options};
+    logger.log_error("one");
+    logger.log_startup([](std::ostream &stream) { stream << "two"; });
+    logger.log_error(Error{Error::OTHER, "three"});
+    logger.flush();
+    REQUIRE(stream.str() == "one\ntwo\n[dd-trace-cpp error code 1] three\n");
+  }
+
+  SECTION("collapses repeated messages") {
+    AsyncCerrLogger logger{options};
+    for (int i = 0; i < 5; ++i) {
+      logger.log_error("boom");
+    }
+    logger.log_error("bang");
+    logger.flush();
+    REQUIRE(stream.str() ==
+            "boom\n"
+            "[dd-trace-cpp] The previous message was repeated 4 more "
+            "time(s).\n"
+            "bang\n");
+  }
+
+  SECTION("limits messages per second") {
+    options.max_per_second = 2;
+    AsyncCerrLogger logger{options};
+    for (const char *message : {"a", "b", "c", "d"}) {
+      logger.log_error(message);
+    }
+    logger.flush();
+    REQUIRE(stream.str() ==
+            "a\n"
+            "b\n"
+            "[dd-trace-cpp] 2 log message(s) were suppressed by the limit of "
+            "2 per second.\n");
+  }
+
+  SECTION("writes remaining messages when destroyed") {
+    {
+      AsyncCerrLogger logger{options};
+      logger.log_error("last words");
+    }
+    REQUIRE(stream.str() == "last words\n");
+  }
+
+  SECTION("accepts messages from many threads") {
+    options.capacity = 4096;
+    options.max_per_second = 4096;
+    const int num_threads = 4;
+    const int per_thread = 500;
+    {
+      AsyncCerrLogger logger{options};
+      std::vector<std::thread> threads;
+      for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&logger, t]() {
+          for (int i = 0; i < per_thread; ++i) {
+            logger.log_error([&](std::ostream &stream) {
+              stream << "thread " << t << " message " << i;
+            });
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+    }
+
+    // Each message is written, unless the queue overflowed, in which case the
+    // overflow is reported.
+    std::istringstream lines{stream.str()};
+    std::string line;
+    std::size_t written = 0;
+    std::size_t dropped = 0;
+    while (std::getline(lines, line)) {
+      std::size_t count;
+      if (std::sscanf(line.c_str(), "[dd-trace-cpp] %zu log message(s) were "
+                      "dropped", &count) == 1) {
+        dropped += count;
+      } else {
+        REQUIRE(line.rfind("thread ", 0) == 0);
+        ++written;
+      }
+    }
+    REQUIRE(written + dropped == std::size_t(num_threads * per_thread));
+  }
+}
@@ -0,0 +1,45 @@
+// These are tests for the `Clock`s defined in `clock.h`.
+
+#include <datadog/clock.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <chrono>
+#include <memory>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("fast_clock", "[clock]") {
+  SECTION("agrees with the system and steady clocks") {
+    for (int i = 0; i < 1000; ++i) {
+      const auto system_before = std::chrono::system_clock::now();
+      const auto steady_before = std::chrono::steady_clock::now();
+      const TimePoint now = fast_clock();
+      const auto steady_after = std::chrono::steady_clock::now();
+      REQUIRE(now.tick >= steady_before);
+      REQUIRE(now.tick <= steady_after);
+      // The wall time is derived from an offset sampled within the last
+      // second, and so is allowed some slack.
+      REQUIRE(now.wall > system_before - std::chrono::seconds(1));
+      REQUIRE(now.wall < system_before + std::chrono::seconds(1));
+    }
+  }
+
+  SECTION("can be used by a tracer") {
+    TracerConfig config;
+    config.service = "testsvc";
+    const auto collector = std::make_shared<MockCollector>();
+    config.collector = collector;
+    config.logger = std::make_shared<MockLogger>();
+    const auto finalized = finalize_config(config, fast_clock);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    { auto span = tracer.create_span(); }
+    REQUIRE(collector->span_count() == 1);
+    REQUIRE(collector->first_span().duration >= Duration::zero());
+  }
+}
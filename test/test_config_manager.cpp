@@ -1,6 +1,14 @@
+#include <datadog/sampling_decision.h>
+#include <datadog/sampling_mechanism.h>
+#include <datadog/sampling_priority.h>
+
+#include <atomic>
+#include <thread>
+
 #include "catch.hpp"
 #include "datadog/config_manager.h"
 #include "datadog/remote_config/listener.h"
+#include "datadog/span_data.h"
 #include "datadog/trace_sampler.h"
 
 namespace rc = datadog::remote_config;
@@ -110,14 +118,17 @@ CONFIG_MANAGER_TEST("remote configuration handling") {
 
       const auto old_trace_sampler_config =
           config_manager.trace_sampler()->config_json();
+      const auto old_generation = config_manager.generation();
 
       const auto err = config_manager.on_update(config_update);
       CHECK(!err);
 
       const auto new_trace_sampler_config =
           config_manager.trace_sampler()->config_json();
+      const auto new_generation = config_manager.generation();
 
       CHECK(old_trace_sampler_config != new_trace_sampler_config);
+      CHECK(old_generation != new_generation);
 
       config_manager.on_revert(config_update);
 
@@ -125,6 +136,7 @@ CONFIG_MANAGER_TEST("remote configuration handling") {
           config_manager.trace_sampler()->config_json();
 
       CHECK(old_trace_sampler_config == revert_trace_sampler_config);
+      CHECK(config_manager.generation() != new_generation);
     }
   }
 
@@ -203,4 +215,210 @@ CONFIG_MANAGER_TEST("remote configuration handling") {
     const auto reverted_tracing_status = config_manager.report_traces();
     CHECK(old_tracing_status == reverted_tracing_status);
   }
+
+  SECTION("handling of trace pipeline parameters") {
+    config_update.content = R"({
+        "lib_config": {
+          "library_language": "all",
+          "library_version": "latest",
+          "service_name": "testsvc",
+          "env": "test",
+          "tracing_flush_interval_milliseconds": 10000,
+          "tracing_max_buffered_bytes": 1048576,
+          "tracing_max_spans_per_trace": 500,
+          "tracing_compression_enabled": true
+        },
+        "service_target": {
+           "service": "testsvc",
+           "env": "test"
+        }
+      })";
+
+    const auto& original = config_manager.pipeline_overrides();
+    CHECK(!original.flush_interval);
+    CHECK(!original.max_buffered_bytes);
+    CHECK(!original.max_spans_per_trace);
+    CHECK(!original.compression_enabled);
+
+    const auto err = config_manager.on_update(config_update);
+    CHECK(!err);
+
+    const auto& updated = config_manager.pipeline_overrides();
+    CHECK(updated.flush_interval == std::chrono::milliseconds(10000));
+    CHECK(updated.max_buffered_bytes == std::size_t(1048576));
+    CHECK(updated.max_spans_per_trace == std::size_t(500));
+    CHECK(updated.compression_enabled == true);
+    const auto json = config_manager.config_json();
+    CHECK(json["pipeline_overrides"]["max_spans_per_trace"] == 500);
+
+    config_manager.on_revert(config_update);
+    CHECK(config_manager.pipeline_overrides() == original);
+  }
+
+  SECTION("invalid trace pipeline parameters are ignored") {
+    config_update.content = R"({
+        "lib_config": {
+          "tracing_flush_interval_milliseconds": 0,
+          "tracing_max_buffered_bytes": -1,
+          "tracing_max_spans_per_trace": "lots",
+          "tracing_compression_enabled": "yes"
+        },
+        "service_target": {
+           "service": "testsvc",
+           "env": "test"
+        }
+      })";
+
+    const auto err = config_manager.on_update(config_update);
+    CHECK(!err);
+    CHECK(config_manager.pipeline_overrides() ==
+          ConfigManager::PipelineOverrides{});
+  }
+
+  SECTION("sampling decisions are consistent during updates") {
+    config_update.content = R"({
+        "lib_config": {
+          "library_language": "all",
+          "library_version": "latest",
+          "service_name": "testsvc",
+          "env": "test",
+          "tracing_sampling_rate": 0.0
+        },
+        "service_target": {
+           "service": "testsvc",
+           "env": "test"
+        }
+      })";
+
+    const auto trace_sampler = config_manager.trace_sampler();
+    std::atomic<bool> done{false};
+    std::atomic<int> num_inconsistent{0};
+    std::thread decider([&]() {
+      SpanData span;
+      span.service = "testsvc";
+      while (!done) {
+        const auto decision = trace_sampler->decide(span);
+        // Either the remote rule (rate 0) applies, or the default (rate 1).
+        const bool remote =
+            decision.mechanism == int(SamplingMechanism::RULE) &&
+            decision.priority == int(SamplingPriority::USER_DROP);
+        const bool local =
+            decision.mechanism == int(SamplingMechanism::DEFAULT) &&
+            decision.priority == int(SamplingPriority::AUTO_KEEP);
+        if (!remote && !local) {
+          ++num_inconsistent;
+        }
+        ++span.trace_id.low;
+      }
+    });
+
+    for (int i = 0; i < 200; ++i) {
+      const auto err = config_manager.on_update(config_update);
+      CHECK(!err);
+      config_manager.on_revert(config_update);
+    }
+    done = true;
+    decider.join();
+
+    CHECK(num_inconsistent == 0);
+  }
+
+  SECTION("span defaults and trace reporting are read during updates") {
+    config_update.content = R"({
+        "lib_config": {
+          "library_language": "all",
+          "library_version": "latest",
+          "service_name": "testsvc",
+          "env": "test",
+          "tracing_enabled": false,
+          "tracing_tags": [
+             "hello:world"
+          ]
+        },
+        "service_target": {
+           "service": "testsvc",
+           "env": "test"
+        }
+      })";
+
+    const auto original_defaults = config_manager.span_defaults();
+    std::atomic<bool> done{false};
+    std::atomic<int> num_unexpected{0};
+    std::thread reader([&]() {
+      while (!done) {
+        (void)config_manager.report_traces();
+        const auto defaults = config_manager.span_defaults();
+        if (defaults->tags.empty() ? defaults != original_defaults
+                                   : defaults->tags.at("hello") != "world") {
+          ++num_unexpected;
+        }
+      }
+    });
+
+    for (int i = 0; i < 200; ++i) {
+      const auto err = config_manager.on_update(config_update);
+      CHECK(!err);
+      CHECK(!config_manager.report_traces());
+      config_manager.on_revert(config_update);
+      CHECK(config_manager.report_traces());
+    }
+    done = true;
+    reader.join();
+
+    CHECK(num_unexpected == 0);
+    // Reverting restores the very same defaults.
+    CHECK(config_manager.span_defaults() == original_defaults);
+  }
+}
+
+CONFIG_MANAGER_TEST("remote tracing_tags are truncated") {
+  const TracerSignature tracer_signature{
+      /* runtime_id = */ RuntimeID::generate(),
+      /* service = */ "testsvc",
+      /* environment = */ "test"};
+
+  TracerConfig config;
+  config.service = "testsvc";
+  config.environment = "test";
+  config.max_tag_value_length = 10;
+  config.tag_value_length_limits =
+      std::unordered_map<std::string, std::size_t>{{"long", 0}};
+
+  auto tracer_telemetry = std::make_shared<TracerTelemetry>(
+      false, default_clock, nullptr, tracer_signature, "", "");
+
+  ConfigManager config_manager(*finalize_config(config), tracer_signature,
+                               tracer_telemetry);
+
+  rc::Listener::Configuration config_update{/* id = */ "id",
+                                            /* path = */ "",
+                                            /* content = */ "",
+                                            /* version = */ 1,
+                                            rc::product::Flag::APM_TRACING};
+  config_update.content = R"({
+      "lib_config": {
+        "library_language": "all",
+        "library_version": "latest",
+        "service_name": "testsvc",
+        "env": "test",
+        "tracing_tags": [
+           "short:world",
+           "truncated:abcdefghijklmnopqrstuvwxyz",
+           "long:abcdefghijklmnopqrstuvwxyz"
+        ]
+      },
+      "service_target": {
+         "service": "testsvc",
+         "env": "test"
+      }
+    })";
+
+  const auto err = config_manager.on_update(config_update);
+  CHECK(!err);
+
+  const std::unordered_map<std::string, std::string> expected_tags{
+      {"short", "world"},
+      {"truncated", "abcdefg..."},
+      {"long", "abcdefghijklmnopqrstuvwxyz"}};
+  CHECK(config_manager.span_defaults()->tags == expected_tags);
 }
@@ -0,0 +1,142 @@
+// These are tests for `coroutine.h`, which tracks the active span of a C++20
+// coroutine in the coroutine's frame.  The header declares nothing unless it
+// is compiled with coroutine support, and neither do these tests.
+
+#include <datadog/coroutine.h>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <datadog/optional.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/span_data.h>
+#include <datadog/tracer.h>
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <thread>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `Job` is a coroutine type that begins running when called and destroys
+// itself when it finishes.
+struct Job {
+  struct promise_type : SpanScopePromise {
+    using SpanScopePromise::SpanScopePromise;
+
+    Job get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// `Suspension` is an awaitable that suspends the calling coroutine and
+// remembers it, so that the test can resume it on another thread.
+struct Suspension {
+  std::coroutine_handle<> handle;
+
+  auto operator co_await() {
+    struct Awaiter {
+      Suspension* suspension;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> handle) noexcept {
+        suspension->handle = handle;
+      }
+      void await_resume() const noexcept {}
+    };
+    return Awaiter{this};
+  }
+
+  void resume_on_another_thread() {
+    std::thread thread{[handle = handle]() { handle.resume(); }};
+    thread.join();
+  }
+};
+
+Job traced_job(SpanContext parent, Suspension& suspension) {
+  SpanScope& scope = co_await this_span_scope;
+  REQUIRE(scope.active().span_id() == parent.span_id());
+
+  SpanConfig config;
+  config.name = "job";
+  Optional<Span> job = scope.create_child(config);
+  REQUIRE(job);
+  {
+    auto activation = scope.activate(*job);
+    co_await suspension;
+    // Resumed on another thread, the active span is still `job`.
+    config.name = "step";
+    auto step = scope.create_child(config);
+    REQUIRE(step);
+    REQUIRE(step->parent_id() == job->id());
+  }
+  // With the activation destroyed, `parent` is active again.
+  REQUIRE(scope.active().span_id() == parent.span_id());
+}
+
+Job untraced_job(bool& done) {
+  SpanScope& scope = co_await this_span_scope;
+  REQUIRE(!scope.create_child());
+  done = true;
+}
+
+}  // namespace
+
+TEST_CASE("SpanScope") {
+  TracerConfig config;
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SECTION("the active span follows the coroutine across threads") {
+    std::uint64_t root_id;
+    {
+      auto root = tracer.create_span();
+      root_id = root.id();
+      Suspension suspension;
+      traced_job(root.context(), suspension);
+      REQUIRE(suspension.handle);
+      suspension.resume_on_another_thread();
+    }
+
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& chunk = collector->chunks.front();
+    REQUIRE(chunk.size() == 3);
+    std::uint64_t job_id = 0;
+    for (const auto& span : chunk) {
+      if (span->name == "job") {
+        REQUIRE(span->parent_id == root_id);
+        job_id = span->span_id;
+      }
+    }
+    REQUIRE(job_id != 0);
+    for (const auto& span : chunk) {
+      if (span->name == "step") {
+        REQUIRE(span->parent_id == job_id);
+      }
+    }
+  }
+
+  SECTION("without a span parameter, no span is active") {
+    bool done = false;
+    untraced_job(done);
+    REQUIRE(done);
+  }
+}
+
+#endif  // defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
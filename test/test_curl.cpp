@@ -1,6 +1,7 @@
 #include <curl/curl.h>
 #include <datadog/curl.h>
 #include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
 #include <datadog/error.h>
 #include <datadog/optional.h>
 #include <datadog/tracer.h>
@@ -13,6 +14,7 @@
 
 #include "datadog/clock.h"
 #include "mocks/loggers.h"
+#include "mocks/reactors.h"
 #include "test.h"
 
 using namespace datadog::tracing;
@@ -36,6 +38,20 @@ class SingleRequestMockCurlLibrary : public CurlLibrary {
   // message to the event loop. This allows races to be explored between request
   // registration and `Curl` shutdown.
   bool delay_message_ = false;
+  // `slist_appends_` is the number of request header list nodes allocated.
+  int slist_appends_ = 0;
+  // `postfields_` and `postfieldsize_` describe the most recent request body.
+  const char *postfields_ = nullptr;
+  long postfieldsize_ = -1;
+  // `http_version_`, `pipewait_`, and `pipelining_` record the most recent
+  // value of the corresponding option, or are -1 if it was not set.
+  long http_version_ = -1;
+  long pipewait_ = -1;
+  long pipelining_ = -1;
+  // `http2_supported_` determines whether `version_info` reports HTTP/2
+  // support.
+  bool http2_supported_ = true;
+  curl_version_info_data version_info_;
 
   void easy_cleanup(CURL *handle) override {
     destroyed_handles_.insert(handle);
@@ -71,8 +87,39 @@ class SingleRequestMockCurlLibrary : public CurlLibrary {
     return CURLE_OK;
   }
 
+  CURLcode easy_setopt_postfields(CURL *, const char *data) override {
+    postfields_ = data;
+    return CURLE_OK;
+  }
+  CURLcode easy_setopt_postfieldsize(CURL *, long size) override {
+    postfieldsize_ = size;
+    return CURLE_OK;
+  }
+
   CURLcode easy_setopt_timeout_ms(CURL *, long) override { return CURLE_OK; }
 
+  CURLcode easy_setopt_http_version(CURL *, long version) override {
+    http_version_ = version;
+    return CURLE_OK;
+  }
+  CURLcode easy_setopt_pipewait(CURL *, long wait) override {
+    pipewait_ = wait;
+    return CURLE_OK;
+  }
+  CURLMcode multi_setopt_pipelining(CURLM *, long bitmask) override {
+    pipelining_ = bitmask;
+    return CURLM_OK;
+  }
+  curl_version_info_data *version_info(CURLversion age) override {
+    version_info_ = *CurlLibrary::version_info(age);
+    if (http2_supported_) {
+      version_info_.features |= CURL_VERSION_HTTP2;
+    } else {
+      version_info_.features &= ~CURL_VERSION_HTTP2;
+    }
+    return &version_info_;
+  }
+
   CURLMcode multi_add_handle(CURLM *, CURL *easy_handle) override {
     added_handle_ = easy_handle;
     return CURLM_OK;
@@ -113,6 +160,9 @@ class SingleRequestMockCurlLibrary : public CurlLibrary {
     REQUIRE(on_header_(header.data(), 1, header.size(), user_data_on_header_) ==
             header.size());
     header = "BOOM-boom: ignored";
+    REQUIRE(on_header_(header.data(), 1, header.size(), user_data_on_header_) ==
+            header.size());
+    header = "Content-Length: 48";
     REQUIRE(on_header_(header.data(), 1, header.size(), user_data_on_header_) ==
             header.size());
 
@@ -133,6 +183,10 @@ class SingleRequestMockCurlLibrary : public CurlLibrary {
     added_handle_ = nullptr;
     return CURLM_OK;
   }
+  curl_slist *slist_append(curl_slist *list, const char *string) override {
+    ++slist_appends_;
+    return CurlLibrary::slist_append(list, string);
+  }
 };
 
 TEST_CASE("parse response headers and body", "[curl]") {
@@ -173,11 +227,15 @@ TEST_CASE("parse response headers and body", "[curl]") {
           try {
             REQUIRE(status == 200);
             REQUIRE(headers.lookup("foo-bar") == "baz");
+            REQUIRE(headers.lookup("Foo-BAR") == "baz");
             REQUIRE(headers.lookup("boom-boom") == "boom, boom, boom, boom");
             REQUIRE_FALSE(headers.lookup("snafu"));
+            REQUIRE_FALSE(headers.lookup("foo-ba"));
             headers.visit([](StringView key, StringView value) {
               if (key == "foo-bar") {
                 REQUIRE(value == "baz");
+              } else if (key == "content-length") {
+                REQUIRE(value == "48");
               } else {
                 REQUIRE(key == "boom-boom");
                 REQUIRE(value == "boom, boom, boom, boom");
@@ -247,8 +305,8 @@ TEST_CASE("bad std::thread means error mode", "[curl]") {
 }
 
 TEST_CASE("fail to allocate request handle", "[curl]") {
-  // Each call to `Curl::post` allocates a new "easy handle."  If that fails,
-  // then `post` immediately returns an error.
+  // A call to `Curl::post` allocates a new "easy handle" when there is no idle
+  // one to reuse.  If that fails, then `post` immediately returns an error.
   class MockCurlLibrary : public CurlLibrary {
    public:
     CURL *easy_init() override { return nullptr; }
@@ -455,11 +513,195 @@ TEST_CASE("handles are always cleaned up", "[curl]") {
     client.reset();
   }
 
-  // Here are the checks relevant to this test.
+  // Here are the checks relevant to this test.  Finished handles are kept
+  // for reuse until the `Curl` object is destroyed.
+  client.reset();
   REQUIRE(library.created_handles_.size() == 1);
   REQUIRE(library.created_handles_ == library.destroyed_handles_);
 }
 
+TEST_CASE("handles and header lists are reused", "[curl]") {
+  const auto clock = default_clock;
+  const auto logger = std::make_shared<MockLogger>();
+  SingleRequestMockCurlLibrary library;
+  auto client = std::make_shared<Curl>(logger, clock, library);
+
+  const auto send = [&](StringView count) {
+    Optional<Error> post_error;
+    const HTTPClient::URL url = {"http", "whatever", ""};
+    const auto ignore = [](auto &&...) {};
+    const auto result = client->post(
+        url,
+        [&](DictWriter &headers) {
+          headers.set("Content-Type", "application/msgpack");
+          headers.set("Datadog-Meta-Lang", "cpp");
+          headers.set("X-Datadog-Trace-Count", count);
+        },
+        "whatever", ignore, [&](const Error &error) { post_error = error; },
+        clock().tick + std::chrono::seconds(10));
+    REQUIRE(result);
+    client->drain(clock().tick + std::chrono::seconds(1));
+    REQUIRE_FALSE(post_error);
+  };
+
+  send("1");
+  REQUIRE(library.slist_appends_ == 3);
+  // Only the header that changed gets a new list node.
+  send("2");
+  REQUIRE(library.slist_appends_ == 4);
+  send("2");
+  REQUIRE(library.slist_appends_ == 4);
+
+  REQUIRE(library.created_handles_.size() == 1);
+  REQUIRE(library.destroyed_handles_.empty());
+  client.reset();
+  REQUIRE(library.created_handles_ == library.destroyed_handles_);
+}
+
+TEST_CASE("shared request bodies are not copied", "[curl]") {
+  const auto clock = default_clock;
+  const auto logger = std::make_shared<MockLogger>();
+  SingleRequestMockCurlLibrary library;
+  const auto client = std::make_shared<Curl>(logger, clock, library);
+
+  const auto buffer = std::make_shared<const std::string>("headerbodytrailer");
+  const StringView slice = StringView(*buffer).substr(6, 4);
+  Optional<Error> post_error;
+  const HTTPClient::URL url = {"http", "whatever", ""};
+  const auto ignore = [](auto &&...) {};
+  const auto result = client->post(
+      url, ignore, HTTPClient::SharedBody{buffer, slice}, ignore,
+      [&](const Error &error) { post_error = error; },
+      clock().tick + std::chrono::seconds(10));
+  REQUIRE(result);
+
+  REQUIRE(library.postfields_ == slice.data());
+  REQUIRE(library.postfieldsize_ == 4);
+  client->drain(clock().tick + std::chrono::seconds(1));
+  REQUIRE_FALSE(post_error);
+}
+
+TEST_CASE("HTTP/2 multiplexing", "[curl]") {
+  const auto clock = default_clock;
+  const auto logger = std::make_shared<MockLogger>();
+  SingleRequestMockCurlLibrary library;
+  Curl::Options options;
+
+  const auto send = [&](Curl &client, const HTTPClient::URL &url) {
+    Optional<Error> post_error;
+    const auto ignore = [](auto &&...) {};
+    const auto result = client.post(
+        url, ignore, "whatever", ignore,
+        [&](const Error &error) { post_error = error; },
+        clock().tick + std::chrono::seconds(10));
+    REQUIRE(result);
+    client.drain(clock().tick + std::chrono::seconds(1));
+    REQUIRE_FALSE(post_error);
+  };
+
+  SECTION("is disabled by default") {
+    Curl client{logger, clock, library};
+    send(client, {"http", "localhost:8126", "/v0.4/traces"});
+    REQUIRE(library.http_version_ == -1);
+    REQUIRE(library.pipewait_ == -1);
+    REQUIRE(library.pipelining_ == -1);
+    const auto config = nlohmann::json::parse(client.config());
+    REQUIRE(config["config"]["http2"] == false);
+  }
+
+  SECTION("when enabled") {
+    options.http2 = true;
+
+    SECTION("uses prior knowledge over cleartext") {
+      auto url = GENERATE(
+          HTTPClient::URL{"http", "localhost:8126", "/v0.4/traces"},
+          HTTPClient::URL{"unix", "/var/run/datadog/apm.socket", "/info"},
+          HTTPClient::URL{"http+unix", "/var/run/datadog/apm.socket", "/"});
+      CAPTURE(url.scheme);
+      Curl client{logger, clock, library, options};
+      send(client, url);
+      REQUIRE(library.pipelining_ == CURLPIPE_MULTIPLEX);
+      REQUIRE(library.http_version_ == CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+      REQUIRE(library.pipewait_ == 1);
+      REQUIRE(logger->error_count() == 0);
+      const auto config = nlohmann::json::parse(client.config());
+      REQUIRE(config["config"]["http2"] == true);
+    }
+
+    SECTION("negotiates over TLS") {
+      Curl client{logger, clock, library, options};
+      send(client, {"https", "localhost:8126", "/v0.4/traces"});
+      REQUIRE(library.http_version_ == CURL_HTTP_VERSION_2TLS);
+      REQUIRE(library.pipewait_ == 1);
+    }
+
+    SECTION("falls back to HTTP/1.1 if libcurl lacks support") {
+      library.http2_supported_ = false;
+      Curl client{logger, clock, library, options};
+      REQUIRE(logger->error_count() == 1);
+      REQUIRE(logger->first_error().code ==
+              Error::CURL_HTTP_CLIENT_SETUP_FAILED);
+      send(client, {"http", "localhost:8126", "/v0.4/traces"});
+      REQUIRE(library.http_version_ == -1);
+      REQUIRE(library.pipewait_ == -1);
+      REQUIRE(library.pipelining_ == -1);
+      const auto config = nlohmann::json::parse(client.config());
+      REQUIRE(config["config"]["http2"] == false);
+    }
+  }
+}
+
+TEST_CASE("driven by a reactor", "[curl]") {
+  class ReactorMockCurlLibrary : public SingleRequestMockCurlLibrary {
+   public:
+    int socket_actions_ = 0;
+
+    CURLMcode multi_socket_action(CURLM *multi_handle, curl_socket_t, int,
+                                  int *running_handles) override {
+      ++socket_actions_;
+      return multi_perform(multi_handle, running_handles);
+    }
+  };
+
+  const auto clock = default_clock;
+  const auto logger = std::make_shared<MockLogger>();
+  const auto reactor = std::make_shared<ManualReactor>();
+  ReactorMockCurlLibrary library;
+  bool thread_started = false;
+  Curl::Options options;
+  options.reactor = reactor;
+  const auto client = std::make_shared<Curl>(
+      logger, clock, library,
+      [&](auto &&) {
+        thread_started = true;
+        return std::thread();
+      },
+      options);
+  REQUIRE(!thread_started);
+  REQUIRE(nlohmann::json::parse(client->config())["config"]["reactor"] ==
+          true);
+
+  int status = 0;
+  Optional<Error> post_error;
+  const HTTPClient::URL url = {"http", "whatever", ""};
+  const auto result = client->post(
+      url, [](const auto &) {}, "whatever",
+      [&](int response_status, const DictReader &, std::string) {
+        status = response_status;
+      },
+      [&](const Error &error) { post_error = error; },
+      clock().tick + std::chrono::seconds(10));
+  REQUIRE(result);
+
+  // Nothing happens until the reactor runs the task that `post` posted.
+  REQUIRE(library.socket_actions_ == 0);
+  REQUIRE(reactor->run_posted() == 1);
+  REQUIRE(library.socket_actions_ == 1);
+  REQUIRE(status == 200);
+  REQUIRE_FALSE(post_error);
+  REQUIRE(logger->error_count() == 0);
+}
+
 TEST_CASE("post() deadline exceeded before request start", "[curl]") {
   const auto clock = default_clock;
   Curl client{std::make_shared<NullLogger>(), clock};
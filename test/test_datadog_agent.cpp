@@ -1,12 +1,28 @@
 #include <datadog/collector_response.h>
 #include <datadog/datadog_agent.h>
 #include <datadog/datadog_agent_config.h>
+#include <datadog/gzip.h>
+#include <datadog/msgpack.h>
+#include <datadog/sampling_mechanism.h>
+#include <datadog/sampling_priority.h>
+#include <datadog/span_data.h>
+#include <datadog/span_sampler_config.h>
+#include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "common/environment.h"
+#include "mocks/dict_readers.h"
+#include "mocks/dict_writers.h"
 #include "mocks/event_schedulers.h"
 #include "mocks/http_clients.h"
 #include "mocks/loggers.h"
@@ -16,7 +32,7 @@ using namespace datadog::tracing;
 using namespace std::chrono_literals;
 
 TEST_CASE("CollectorResponse", "[datadog_agent]") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto logger =
       std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
@@ -73,6 +89,22 @@ TEST_CASE("CollectorResponse", "[datadog_agent]") {
     REQUIRE(logger->error_count() == 0);
   }
 
+  SECTION("other properties are ignored, and rates may be integers") {
+    {
+      http_client->response_status = 200;
+      http_client->response_body
+          << "{\"version\": \"7.50.0\", \"other\": {\"rate_by_service\": "
+             "[null]}, \"rate_by_service\": {\""
+          << CollectorResponse::key_of_default_rate
+          << "\": 1, \"service:wiggle,env:foo\": 0}}";
+      Tracer tracer{*finalized};
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    REQUIRE(event_scheduler->cancelled);
+    REQUIRE(logger->error_count() == 0);
+  }
+
   SECTION("HTTP success with empty body") {
     // Don't echo error messages.
     logger->echo = nullptr;
@@ -105,6 +137,9 @@ TEST_CASE("CollectorResponse", "[datadog_agent]") {
          "{\"rate_by_service\": {\"service:foo,env:bar\": []}}"},
         {"invalid sample rate",
          "{\"rate_by_service\": {\"service:foo,env:bar\": -1.337}}"},
+        {"sample rate an object",
+         "{\"rate_by_service\": {\"service:foo,env:bar\": {}}}"},
+        {"truncated", "{\"rate_by_service\": {\"service:foo,env:bar\": 1"},
     }));
 
     CAPTURE(test_case.name);
@@ -170,63 +205,1800 @@ TEST_CASE("CollectorResponse", "[datadog_agent]") {
   }
 }
 
-// NOTE: `report_telemetry` is too vague for now.
-// Does it mean no telemetry at all or just metrics are not generated?
-//
-// TODO: Use cases to implement:
-//   - telemetry is disabled, no event scheduled.
-//   - telemetry is enabled, after x sec generate metrics is called.
-//   - send_app_started?
-TEST_CASE("Remote Configuration", "[datadog_agent]") {
+TEST_CASE("trace chunks are encoded as they are sent", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.telemetry.enabled = false;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const std::size_t num_traces = GENERATE(1, 2, 10);
+  {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    Tracer tracer{*finalized};
+    for (std::size_t i = 0; i < num_traces; ++i) {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      (void)child;
+    }
+    // Destroying `tracer` flushes the pending chunks.
+  }
+
+  REQUIRE(logger->error_count() == 0);
+  REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+          std::to_string(num_traces));
+
+  // The body is a MessagePack array32 whose element count was filled in at
+  // flush time.
+  const auto& body = http_client->request_body;
+  REQUIRE(body.size() > 5);
+  REQUIRE(std::uint8_t(body[0]) == 0xDD);
+  const std::uint32_t count = (std::uint32_t(std::uint8_t(body[1])) << 24) |
+                              (std::uint32_t(std::uint8_t(body[2])) << 16) |
+                              (std::uint32_t(std::uint8_t(body[3])) << 8) |
+                              std::uint32_t(std::uint8_t(body[4]));
+  REQUIRE(count == num_traces);
+  // Each chunk is itself an array of two spans, encoded as a fixarray.
+  REQUIRE(std::uint8_t(body[5]) == 0x92);
+}
+
+TEST_CASE("trace chunks sent from many threads", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
   const auto logger =
       std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
-  logger->echo = nullptr;
   const auto event_scheduler = std::make_shared<MockEventScheduler>();
   const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.telemetry.enabled = false;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const std::size_t num_threads = 4;
+  const std::size_t traces_per_thread = 50;
+  {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    Tracer tracer{*finalized};
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&]() {
+        for (std::size_t j = 0; j < traces_per_thread; ++j) {
+          auto root = tracer.create_span();
+          auto child = root.create_child();
+          (void)child;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
 
-  TracerConfig config;
+  REQUIRE(logger->error_count() == 0);
+  const std::size_t num_traces = num_threads * traces_per_thread;
+  REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+          std::to_string(num_traces));
+  const auto& body = http_client->request_body;
+  REQUIRE(std::uint8_t(body[0]) == 0xDD);
+  const std::uint32_t count = (std::uint32_t(std::uint8_t(body[1])) << 24) |
+                              (std::uint32_t(std::uint8_t(body[2])) << 16) |
+                              (std::uint32_t(std::uint8_t(body[3])) << 8) |
+                              std::uint32_t(std::uint8_t(body[4]));
+  REQUIRE(count == num_traces);
+}
+
+TEST_CASE("bounded buffer", "[datadog_agent]") {
+  TracerConfig config{};
   config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
   config.logger = logger;
   config.agent.event_scheduler = event_scheduler;
   config.agent.http_client = http_client;
   config.telemetry.enabled = false;
+  // Room for three single-span traces.
+  config.agent.max_buffered_spans = 3;
+
+  struct TestCase {
+    std::string policy;
+    // The sampling priority of each of five single-span traces.
+    std::vector<int> priorities;
+    std::vector<int> expected_kept;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"drop_newest", {1, 1, 1, 1, 1}, {0, 1, 2}},
+      {"drop_oldest", {1, 1, 1, 1, 1}, {2, 3, 4}},
+      {"drop_oldest", {1, -1, 1, 1, -1}, {2, 3, 4}},
+      {"drop_unsampled_first", {1, -1, 1, 1, -1}, {0, 2, 3}},
+      {"drop_unsampled_first", {1, 1, 1, 1, 1}, {0, 1, 2}},
+      {"drop_lowest_priority", {2, -1, 1, 1, 2}, {0, 3, 4}},
+      {"drop_lowest_priority", {1, 1, 1, 2, 2}, {2, 3, 4}},
+      {"drop_lowest_priority", {2, 2, 2, 1, -1}, {0, 1, 2}},
+  }));
 
+  CAPTURE(test_case.policy);
+  config.agent.buffer_overflow_policy = test_case.policy;
   auto finalized = finalize_config(config);
   REQUIRE(finalized);
 
-  const TracerSignature signature(RuntimeID::generate(), "testsvc", "test");
+  {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    Tracer tracer{*finalized};
+    for (std::size_t i = 0; i < test_case.priorities.size(); ++i) {
+      auto span = tracer.create_span();
+      span.set_name("trace-" + std::to_string(i));
+      if (test_case.priorities[i] != 1) {
+        span.trace_segment().override_sampling_priority(
+            test_case.priorities[i]);
+      }
+    }
+  }
 
-  auto telemetry = std::make_shared<TracerTelemetry>(
-      finalized->telemetry.enabled, finalized->clock, finalized->logger,
-      signature, "", "");
+  // The dropped chunks are reported once, at the next flush.
+  REQUIRE(logger->error_count() == 1);
+  REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+          std::to_string(test_case.expected_kept.size()));
+  const auto& body = http_client->request_body;
+  for (std::size_t i = 0; i < test_case.priorities.size(); ++i) {
+    const std::string name = "trace-" + std::to_string(i);
+    const bool kept =
+        std::find(test_case.expected_kept.begin(),
+                  test_case.expected_kept.end(),
+                  int(i)) != test_case.expected_kept.end();
+    CAPTURE(name);
+    REQUIRE((body.find(name) != std::string::npos) == kept);
+  }
+}
 
-  auto config_manager =
-      std::make_shared<ConfigManager>(*finalized, signature, telemetry);
+TEST_CASE("flush early when the buffer reaches a threshold",
+          "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.telemetry.enabled = false;
+  // Any trace chunk reaches the threshold.
+  config.agent.flush_threshold_bytes = 1;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
 
-  const auto& agent_config =
-      std::get<FinalizedDatadogAgentConfig>(finalized->collector);
-  DatadogAgent agent(agent_config, telemetry, config.logger, signature, {});
+  {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    Tracer tracer{*finalized};
+    tracer.create_span();
+    REQUIRE(event_scheduler->one_off_events.size() == 1);
+    // A flush is already scheduled.
+    tracer.create_span();
+    REQUIRE(event_scheduler->one_off_events.size() == 1);
 
-  SECTION("404 do not log an error") {
-    http_client->response_status = 404;
-    agent.get_and_apply_remote_configuration_updates();
-    http_client->drain(std::chrono::steady_clock::now());
-    CHECK(logger->error_count() == 0);
+    event_scheduler->one_off_events.front()();
+    REQUIRE(http_client->request_bodies.size() == 1);
+    REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+            "2");
+
+    tracer.create_span();
+    REQUIRE(event_scheduler->one_off_events.size() == 2);
   }
 
-  SECTION("5xx log an error") {
-    http_client->response_status = 500;
-    agent.get_and_apply_remote_configuration_updates();
-    http_client->drain(std::chrono::steady_clock::now());
-    CHECK(logger->error_count() == 1);
+  // The `DatadogAgent` flushed as it was destroyed.  Early flushes scheduled
+  // before then do nothing.
+  REQUIRE(http_client->request_bodies.size() == 2);
+  event_scheduler->one_off_events.back()();
+  REQUIRE(http_client->request_bodies.size() == 2);
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("large batches are split into several requests",
+          "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.telemetry.enabled = false;
+
+  const std::size_t num_traces = 5;
+  std::size_t max_chunks_per_request;
+  SECTION("one chunk per request") {
+    config.agent.max_payload_bytes = 1;
+    max_chunks_per_request = 1;
   }
+  SECTION("everything in one request") { max_chunks_per_request = 5; }
 
-  SECTION("non json input") {
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  {
     http_client->response_status = 200;
-    http_client->response_body << "hello, mars!";
+    http_client->response_body << "{}";
+    Tracer tracer{*finalized};
+    for (std::size_t i = 0; i < num_traces; ++i) {
+      tracer.create_span();
+    }
+  }
 
-    agent.get_and_apply_remote_configuration_updates();
-    http_client->drain(std::chrono::steady_clock::now());
-    CHECK(logger->error_count() == 1);
+  REQUIRE(logger->error_count() == 0);
+  const auto& bodies = http_client->request_bodies;
+  REQUIRE(bodies.size() == num_traces / max_chunks_per_request);
+  for (const auto& body : bodies) {
+    REQUIRE(std::uint8_t(body[0]) == 0xDD);
+    const std::uint32_t count = (std::uint32_t(std::uint8_t(body[1])) << 24) |
+                                (std::uint32_t(std::uint8_t(body[2])) << 16) |
+                                (std::uint32_t(std::uint8_t(body[3])) << 8) |
+                                std::uint32_t(std::uint8_t(body[4]));
+    REQUIRE(count == max_chunks_per_request);
+  }
+}
+
+TEST_CASE("requests in flight are limited", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  // Leave the flush task as the only scheduled event.
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  // One chunk per request, and at most two requests at a time.
+  config.agent.max_payload_bytes = 1;
+  config.agent.max_in_flight_requests = 2;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    Tracer tracer{*finalized};
+    for (int i = 0; i < 5; ++i) {
+      tracer.create_span();
+    }
+
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_bodies.size() == 2);
+    // Neither request has completed, so nothing more is sent.
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_bodies.size() == 2);
+    // `MockHTTPClient` completes only the most recent request.
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_bodies.size() == 3);
+  }
+
+  // Destroying the `DatadogAgent` sends the deferred requests regardless of
+  // the limit.
+  REQUIRE(http_client->request_bodies.size() == 5);
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("chunks most worth keeping are sent first", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  // One chunk per request, and one request at a time.
+  config.agent.max_payload_bytes = 1;
+  config.agent.max_in_flight_requests = 1;
+  config.agent.buffer_overflow_policy = "drop_lowest_priority";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  Tracer tracer{*finalized};
+  {
+    auto sampled = tracer.create_span();
+    sampled.set_name("auto-keep");
+    auto unsampled = tracer.create_span();
+    unsampled.set_name("drop");
+    unsampled.trace_segment().override_sampling_priority(-1);
+    auto kept = tracer.create_span();
+    kept.set_name("user-keep");
+    kept.trace_segment().override_sampling_priority(2);
+    auto failed = tracer.create_span();
+    failed.set_name("error");
+    failed.set_error(true);
+  }
+
+  // The spans finished in reverse order of their creation.  Chunks of equal
+  // rank are sent in the order in which they were finished.
+  for (const char* name : {"error", "user-keep", "auto-keep", "drop"}) {
+    CAPTURE(name);
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_body.find(name) != std::string::npos);
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+  }
+  REQUIRE(http_client->request_bodies.size() == 4);
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("failed requests are retried", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.max_retries = 1;
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+
+  const auto chunk_count = [](const std::string& body) {
+    REQUIRE(std::uint8_t(body[0]) == 0xDD);
+    return (std::uint32_t(std::uint8_t(body[1])) << 24) |
+           (std::uint32_t(std::uint8_t(body[2])) << 16) |
+           (std::uint32_t(std::uint8_t(body[3])) << 8) |
+           std::uint32_t(std::uint8_t(body[4]));
+  };
+
+  http_client->response_status = 503;
+  http_client->response_body << "{}";
+  Tracer tracer{*finalized};
+  tracer.create_span();
+  event_scheduler->event_callback();
+  const auto& bodies = http_client->request_bodies;
+  REQUIRE(bodies.size() == 1);
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+
+  // The retry waits for its backoff.
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 1);
+
+  // Once the backoff has elapsed, the failed chunk is sent again along with
+  // any chunks that have arrived in the meantime.
+  tracer.create_span();
+  *now += 1s;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 2);
+  REQUIRE(chunk_count(bodies[1]) == 2);
+
+  // The second failure exhausts `max_retries`, so that request is dropped.
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  *now += 1min;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 2);
+}
+
+TEST_CASE("retries count against max_buffered_bytes", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.max_retries = 1;
+  // Room for one of the chunks below, but not for two.
+  config.agent.max_buffered_bytes = 5000;
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+
+  const auto chunk_count = [](const std::string& body) {
+    REQUIRE(std::uint8_t(body[0]) == 0xDD);
+    return (std::uint32_t(std::uint8_t(body[1])) << 24) |
+           (std::uint32_t(std::uint8_t(body[2])) << 16) |
+           (std::uint32_t(std::uint8_t(body[3])) << 8) |
+           std::uint32_t(std::uint8_t(body[4]));
+  };
+
+  http_client->response_status = 503;
+  http_client->response_body << "{}";
+  Tracer tracer{*finalized};
+  const std::string filler(3000, 'x');
+  const auto create_span = [&]() {
+    tracer.create_span().set_tag("filler", filler);
+  };
+  const auto& bodies = http_client->request_bodies;
+
+  // A failed request does not fit beside the chunk buffered since, so it is
+  // dropped rather than retried.
+  create_span();
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 1);
+  create_span();
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  *now += 1s;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 2);
+  REQUIRE(chunk_count(bodies[1]) == 1);
+
+  // A new chunk does not fit beside a request awaiting its retry, so it is
+  // dropped.
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  create_span();
+  *now += 1s;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 3);
+  REQUIRE(chunk_count(bodies[2]) == 1);
+}
+
+TEST_CASE("deferred retries count against max_buffered_bytes",
+          "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.max_retries = 5;
+  config.agent.max_in_flight_requests = 2;
+  // Room for two of the chunks below, but not for three.
+  config.agent.max_buffered_bytes = 25000;
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+
+  http_client->response_status = 503;
+  http_client->response_body << "{}";
+  Tracer tracer{*finalized};
+  const std::string filler(10000, 'x');
+  const auto create_span = [&]() {
+    tracer.create_span().set_tag("filler", filler);
+  };
+  const auto& bodies = http_client->request_bodies;
+  const auto buffer_full_count = [&]() {
+    std::lock_guard<std::mutex> lock{logger->mutex};
+    return std::count_if(
+        logger->entries.begin(), logger->entries.end(), [](const auto& entry) {
+          const auto* message = std::get_if<std::string>(&entry.payload);
+          return message && message->find("buffer of traces awaiting "
+                                          "submission") != std::string::npos;
+        });
+  };
+
+  // `MockHTTPClient` completes only the most recent request, so the first
+  // request stays in flight throughout.  The second fails and is queued for a
+  // retry.
+  create_span();
+  event_scheduler->event_callback();
+  create_span();
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 2);
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+
+  // The third request fills the limit on requests in flight again, so the
+  // retry, once due, is deferred.
+  create_span();
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 3);
+  *now += 1min;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 3);
+
+  // The third request fails and is queued for a retry beside the deferred
+  // one.  Together they leave no room for another chunk.
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  create_span();
+  event_scheduler->event_callback();
+  REQUIRE(buffer_full_count() == 1);
+}
+
+TEST_CASE("traces are not sent while the Datadog Agent is unreachable",
+          "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.max_retries = 0;
+  config.agent.circuit_breaker_threshold = 2;
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+
+  const auto chunk_count = [](const std::string& body) {
+    REQUIRE(std::uint8_t(body[0]) == 0xDD);
+    return (std::uint32_t(std::uint8_t(body[1])) << 24) |
+           (std::uint32_t(std::uint8_t(body[2])) << 16) |
+           (std::uint32_t(std::uint8_t(body[3])) << 8) |
+           std::uint32_t(std::uint8_t(body[4]));
+  };
+  const std::string probe = "\x90";
+
+  http_client->response_error = Error{Error::OTHER, "connection refused"};
+  Tracer tracer{*finalized};
+  const auto& bodies = http_client->request_bodies;
+  for (int i = 0; i < 2; ++i) {
+    tracer.create_span();
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+  }
+  REQUIRE(bodies.size() == 2);
+
+  // The circuit is open, so new chunks are dropped, and only a probe is sent
+  // once the flush interval has elapsed.
+  tracer.create_span();
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 2);
+  *now += 2s;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 3);
+  REQUIRE(bodies.back() == probe);
+
+  // A failed probe doubles the interval until the next.
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  *now += 2s;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 3);
+  *now += 2s;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 4);
+  REQUIRE(bodies.back() == probe);
+
+  // A successful probe closes the circuit, and traces are sent again.
+  http_client->response_error.reset();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  tracer.create_span();
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 5);
+  REQUIRE(chunk_count(bodies.back()) == 1);
+
+  // Two failed requests, and one log each for opening and closing the
+  // circuit.
+  REQUIRE(logger->error_count() == 4);
+}
+
+TEST_CASE("pressure", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.max_buffered_spans = 4;
+  config.agent.max_retries = 0;
+  config.agent.circuit_breaker_threshold = 1;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  Tracer tracer{*finalized};
+  REQUIRE(tracer.pressure() == Pressure::NORMAL);
+
+  // The pressure rises as the buffer fills.
+  tracer.create_span();
+  REQUIRE(tracer.pressure() == Pressure::NORMAL);
+  tracer.create_span();
+  REQUIRE(tracer.pressure() == Pressure::ELEVATED);
+  tracer.create_span();
+  REQUIRE(tracer.pressure() == Pressure::HIGH);
+
+  // ...and falls once the buffer is sent.
+  event_scheduler->event_callback();
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  REQUIRE(tracer.pressure() == Pressure::NORMAL);
+
+  // The pressure is high while the Datadog Agent is unreachable.
+  http_client->response_status = 503;
+  tracer.create_span();
+  event_scheduler->event_callback();
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  REQUIRE(tracer.pressure() == Pressure::HIGH);
+}
+
+TEST_CASE("request compression", "[datadog_agent]") {
+  if (!gzip_available()) {
+    SUCCEED("This library was built without zlib.");
+    return;
+  }
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.telemetry.enabled = false;
+  config.agent.compression_enabled = true;
+
+  bool expect_compressed;
+  SECTION("bodies at least as large as the threshold are compressed") {
+    config.agent.compression_threshold_bytes = 0;
+    expect_compressed = true;
+  }
+  SECTION("smaller bodies are not compressed") {
+    config.agent.compression_threshold_bytes = 1024 * 1024;
+    expect_compressed = false;
+  }
+
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    Tracer tracer{*finalized};
+    tracer.create_span();
+  }
+
+  REQUIRE(logger->error_count() == 0);
+  const auto& headers = http_client->request_headers.items;
+  const auto& body = http_client->request_body;
+  REQUIRE(body.size() >= 2);
+  if (expect_compressed) {
+    REQUIRE(headers.at("Content-Encoding") == "gzip");
+    // Every gzip stream begins with these two bytes.
+    REQUIRE(std::uint8_t(body[0]) == 0x1F);
+    REQUIRE(std::uint8_t(body[1]) == 0x8B);
+  } else {
+    REQUIRE(headers.count("Content-Encoding") == 0);
+    REQUIRE(std::uint8_t(body[0]) == 0xDD);
+  }
+}
+
+TEST_CASE("v0.5 trace API", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  // Leave the flush task as the only scheduled event.
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.trace_api_version = "v0.5";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto read_uint32 = [](const std::string& bytes, std::size_t offset) {
+    return (std::uint32_t(std::uint8_t(bytes[offset])) << 24) |
+           (std::uint32_t(std::uint8_t(bytes[offset + 1])) << 16) |
+           (std::uint32_t(std::uint8_t(bytes[offset + 2])) << 8) |
+           std::uint32_t(std::uint8_t(bytes[offset + 3]));
+  };
+
+  SECTION("payload is a string table followed by trace chunks") {
+    {
+      http_client->response_status = 200;
+      http_client->response_body << "{}";
+      Tracer tracer{*finalized};
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      (void)child;
+    }
+
+    REQUIRE(logger->error_count() == 0);
+    REQUIRE(http_client->request_url.path == "/v0.5/traces");
+    REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+            "1");
+
+    const auto& body = http_client->request_body;
+    REQUIRE(body.size() > 15);
+    // [strings, chunks], where the string table is a fixarray.
+    REQUIRE(std::uint8_t(body[0]) == 0x92);
+    REQUIRE((std::uint8_t(body[1]) & 0xF0) == 0x90);
+    REQUIRE((std::uint8_t(body[1]) & 0x0F) > 1);
+    // The first string is always the empty string.
+    REQUIRE(std::uint8_t(body[2]) == 0xA0);
+    // The table contains the service name.
+    REQUIRE(body.find("testsvc") != std::string::npos);
+    // The name "testsvc" is encoded only once, though both spans have it.
+    REQUIRE(body.find("testsvc") == body.rfind("testsvc"));
+  }
+
+  SECTION("falls back to v0.4 if the Agent responds 404") {
+    logger->echo = nullptr;
+    http_client->response_status = 404;
+    Tracer tracer{*finalized};
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_url.path == "/v0.5/traces");
+    http_client->drain(std::chrono::steady_clock::now());
+    REQUIRE(logger->error_count() == 1);
+
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_url.path == "/v0.4/traces");
+    REQUIRE(std::uint8_t(http_client->request_body[0]) == 0xDD);
+    REQUIRE(read_uint32(http_client->request_body, 1) == 1);
+    // The one chunk is an array of one span, and a v0.4 span is a map.
+    REQUIRE(std::uint8_t(http_client->request_body[5]) == 0x91);
+    REQUIRE((std::uint8_t(http_client->request_body[6]) & 0xF0) == 0x80);
+  }
+}
+
+TEST_CASE("v0.7 trace API", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.environment = "test-env";
+  config.version = "1.2.3";
+  const RuntimeID runtime_id = RuntimeID::generate();
+  config.runtime_id = runtime_id;
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  // Leave the flush task as the only scheduled event.
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.trace_api_version = "v0.7";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  SECTION("trace-level attributes are encoded once") {
+    {
+      http_client->response_status = 200;
+      http_client->response_body << "{}";
+      Tracer tracer{*finalized};
+      const std::unordered_map<std::string, std::string> headers{
+          {"x-datadog-trace-id", "123"},
+          {"x-datadog-parent-id", "456"},
+          {"x-datadog-sampling-priority", "2"},
+          {"x-datadog-origin", "synthetics"}};
+      MockDictReader reader{headers};
+      auto root = tracer.extract_span(reader);
+      REQUIRE(root);
+      auto child = root->create_child();
+      (void)child;
+    }
+
+    REQUIRE(logger->error_count() == 0);
+    REQUIRE(http_client->request_url.path == "/v0.7/traces");
+    REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+            "1");
+
+    StringView input = http_client->request_body;
+    auto entries = msgpack::unpack_map(input);
+    REQUIRE(entries);
+    std::unordered_map<std::string, std::string> attributes;
+    std::size_t chunk_count = 0;
+    for (std::size_t i = 0; i < *entries; ++i) {
+      auto key = msgpack::unpack_string(input);
+      REQUIRE(key);
+      if (*key != "chunks") {
+        auto value = msgpack::unpack_string(input);
+        REQUIRE(value);
+        attributes.emplace(std::string(*key), std::string(*value));
+        continue;
+      }
+      auto chunks = msgpack::unpack_array(input);
+      REQUIRE(chunks);
+      chunk_count = *chunks;
+      REQUIRE(chunk_count == 1);
+      auto chunk_entries = msgpack::unpack_map(input);
+      REQUIRE(chunk_entries);
+      REQUIRE(*chunk_entries == 3);
+      for (std::size_t j = 0; j < *chunk_entries; ++j) {
+        auto chunk_key = msgpack::unpack_string(input);
+        REQUIRE(chunk_key);
+        if (*chunk_key == "priority") {
+          auto priority = msgpack::unpack_integer(input);
+          REQUIRE(priority);
+          REQUIRE(*priority == 2);
+        } else if (*chunk_key == "origin") {
+          auto origin = msgpack::unpack_string(input);
+          REQUIRE(origin);
+          REQUIRE(*origin == "synthetics");
+        } else {
+          REQUIRE(*chunk_key == "spans");
+          auto spans = msgpack_decode_spans(input);
+          REQUIRE(spans);
+          REQUIRE(spans->size() == 2);
+          for (const auto& span : *spans) {
+            REQUIRE(span->trace_id.low == 123);
+            REQUIRE(span->tags.count("_dd.origin") == 0);
+            REQUIRE(span->tags.count("language") == 0);
+            REQUIRE(span->tags.count("runtime-id") == 0);
+            REQUIRE(span->tags.count("env") == 0);
+            REQUIRE(span->tags.count("version") == 0);
+          }
+          // Only the local root has the process ID.
+          REQUIRE(spans->front()->numeric_tags.count("process_id") == 1);
+          REQUIRE(spans->back()->numeric_tags.count("process_id") == 0);
+        }
+      }
+    }
+    REQUIRE(input.empty());
+    REQUIRE(chunk_count == 1);
+    REQUIRE(attributes.at("language_name") == "cpp");
+    REQUIRE(attributes.at("runtime_id") == runtime_id.string());
+    REQUIRE(attributes.at("env") == "test-env");
+    REQUIRE(attributes.at("app_version") == "1.2.3");
+  }
+
+  SECTION("falls back to v0.4 if the Agent responds 404") {
+    logger->echo = nullptr;
+    http_client->response_status = 404;
+    Tracer tracer{*finalized};
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_url.path == "/v0.7/traces");
+    http_client->drain(std::chrono::steady_clock::now());
+    REQUIRE(logger->error_count() == 1);
+
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_url.path == "/v0.4/traces");
+    REQUIRE(std::uint8_t(http_client->request_body[0]) == 0xDD);
+    // The one chunk is an array of one span, and a v0.4 span is a map.
+    REQUIRE(std::uint8_t(http_client->request_body[5]) == 0x91);
+    REQUIRE((std::uint8_t(http_client->request_body[6]) & 0xF0) == 0x80);
+  }
+}
+
+// NOTE: `report_telemetry` is too vague for now.
+// Does it mean no telemetry at all or just metrics are not generated?
+//
+// TODO: Use cases to implement:
+//   - telemetry is disabled, no event scheduled.
+//   - telemetry is enabled, after x sec generate metrics is called.
+//   - send_app_started?
+TEST_CASE("Remote Configuration", "[datadog_agent]") {
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  logger->echo = nullptr;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.telemetry.enabled = false;
+
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const TracerSignature signature(RuntimeID::generate(), "testsvc", "test");
+
+  auto telemetry = std::make_shared<TracerTelemetry>(
+      finalized->telemetry.enabled, finalized->clock, finalized->logger,
+      signature, "", "");
+
+  auto config_manager =
+      std::make_shared<ConfigManager>(*finalized, signature, telemetry);
+
+  const auto& agent_config =
+      std::get<FinalizedDatadogAgentConfig>(finalized->collector);
+  DatadogAgent agent(agent_config, telemetry, config.logger, signature, {});
+
+  SECTION("404 do not log an error") {
+    http_client->response_status = 404;
+    agent.get_and_apply_remote_configuration_updates();
+    http_client->drain(std::chrono::steady_clock::now());
+    CHECK(logger->error_count() == 0);
+  }
+
+  SECTION("5xx log an error") {
+    http_client->response_status = 500;
+    agent.get_and_apply_remote_configuration_updates();
+    http_client->drain(std::chrono::steady_clock::now());
+    CHECK(logger->error_count() == 1);
+  }
+
+  SECTION("non json input") {
+    http_client->response_status = 200;
+    http_client->response_body << "hello, mars!";
+
+    agent.get_and_apply_remote_configuration_updates();
+    http_client->drain(std::chrono::steady_clock::now());
+    // The response is parsed by an event, not by the HTTP client's thread.
+    CHECK(logger->error_count() == 0);
+    REQUIRE(event_scheduler->one_off_events.size() == 1);
+    event_scheduler->one_off_events.front()();
+    CHECK(logger->error_count() == 1);
+  }
+}
+
+TEST_CASE("Remote Configuration polling backs off while nothing changes",
+          "[datadog_agent]") {
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  logger->echo = nullptr;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_poll_interval_seconds = 1;
+  config.agent.remote_configuration_max_poll_interval_seconds = 4;
+  config.telemetry.enabled = false;
+
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const TracerSignature signature(RuntimeID::generate(), "testsvc", "test");
+  auto telemetry = std::make_shared<TracerTelemetry>(
+      finalized->telemetry.enabled, finalized->clock, finalized->logger,
+      signature, "", "");
+
+  const auto& agent_config =
+      std::get<FinalizedDatadogAgentConfig>(finalized->collector);
+  DatadogAgent agent(agent_config, telemetry, config.logger, signature, {});
+  // The remote configuration poll is the last recurring event scheduled.
+  REQUIRE(event_scheduler->recurrence_interval == std::chrono::seconds(1));
+
+  std::string response = "{}";
+
+  // Return the ticks, of the specified `num_ticks`, on which a request was
+  // sent.
+  const auto tick = [&](int num_ticks) {
+    std::vector<int> polled;
+    for (int i = 1; i <= num_ticks; ++i) {
+      const auto before = http_client->request_bodies.size();
+      event_scheduler->event_callback();
+      if (http_client->request_bodies.size() != before) {
+        polled.push_back(i);
+        // Invoke the response handler directly, rather than `drain`, because
+        // the handler of a changed configuration sends another request.
+        const auto on_response = http_client->on_response_;
+        const std::unordered_map<std::string, std::string> headers;
+        const MockDictReader reader{headers};
+        on_response(200, reader, response);
+        for (const auto& apply : event_scheduler->one_off_events) {
+          apply();
+        }
+        event_scheduler->one_off_events.clear();
+      }
+    }
+    return polled;
+  };
+
+  // The interval doubles with each empty response, up to four ticks.
+  REQUIRE(tick(11) == std::vector<int>{1, 3, 7, 11});
+
+  // A response that carries a change restores the poll interval.
+  response = R"({"targets": ""})";
+  REQUIRE(tick(4) == std::vector<int>{4});
+  REQUIRE(tick(2) == std::vector<int>{1, 2});
+}
+
+TEST_CASE("trim_memory shrinks buffers that outgrew the load",
+          "[datadog_agent]") {
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.telemetry.enabled = false;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const TracerSignature signature(RuntimeID::generate(), "testsvc", "test");
+  auto telemetry = std::make_shared<TracerTelemetry>(
+      false, finalized->clock, finalized->logger, signature, "", "");
+  const auto& agent_config =
+      std::get<FinalizedDatadogAgentConfig>(finalized->collector);
+  DatadogAgent agent(agent_config, telemetry, config.logger, signature, {});
+
+  const auto send_traces = [&](int count) {
+    for (int i = 0; i < count; ++i) {
+      std::vector<std::unique_ptr<SpanData>> spans;
+      spans.push_back(std::make_unique<SpanData>());
+      spans.back()->service = "testsvc";
+      spans.back()->name = "burst";
+      spans.back()->tags["payload"] = std::string(100, 'x');
+      REQUIRE(agent.send(std::move(spans), nullptr));
+    }
+    // The flush is the last recurring event scheduled.
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+  };
+
+  // A burst grows the buffers.  They needed that capacity in this interval,
+  // and so keep it.
+  send_traces(1000);
+  REQUIRE(agent.trim_memory() == 0);
+  // After an interval of light load, the capacity is released.
+  send_traces(1);
+  REQUIRE(agent.trim_memory() > 0);
+  REQUIRE(agent.trim_memory() == 0);
+  // The buffers still work, and grow again as needed.
+  send_traces(1000);
+  REQUIRE(http_client->request_bodies.size() == 3);
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("lazy start defers work until the first span", "[datadog_agent]") {
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.lazy_start = true;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto count_app_started = [&]() {
+    return std::count_if(http_client->request_bodies.begin(),
+                         http_client->request_bodies.end(),
+                         [](const std::string& body) {
+                           return body.find("app-started") != body.npos;
+                         });
+  };
+
+  Tracer tracer{*finalized};
+  REQUIRE(!event_scheduler->recurrence_interval);
+  REQUIRE(logger->startup_count() == 0);
+  REQUIRE(count_app_started() == 0);
+
+  SECTION("create_span starts") {
+    auto span = tracer.create_span();
+    (void)span;
+  }
+
+  SECTION("extract_span starts") {
+    const std::unordered_map<std::string, std::string> headers;
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(!span);
+  }
+
+  REQUIRE(event_scheduler->recurrence_interval);
+  REQUIRE(logger->startup_count() == 1);
+  REQUIRE(count_app_started() == 1);
+
+  // Only the first span starts.
+  auto span = tracer.create_span();
+  (void)span;
+  REQUIRE(logger->startup_count() == 1);
+  REQUIRE(count_app_started() == 1);
+}
+
+TEST_CASE("idle mode schedules the flush only while needed",
+          "[datadog_agent]") {
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.telemetry.enabled = false;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.idle_mode_enabled = true;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  Tracer tracer{*finalized};
+  // Nothing is scheduled until there is a trace chunk to send.
+  REQUIRE(!event_scheduler->event_callback);
+
+  tracer.create_span();
+  REQUIRE(event_scheduler->event_callback);
+  REQUIRE(!event_scheduler->cancelled);
+
+  // The first flush sends the chunk, and stays scheduled while the request is
+  // in flight.
+  event_scheduler->event_callback();
+  REQUIRE(http_client->request_bodies.size() == 1);
+  REQUIRE(!event_scheduler->cancelled);
+
+  // Once the request completes, the next flush finds nothing to do, and
+  // unschedules itself.
+  http_client->drain(std::chrono::steady_clock::now());
+  event_scheduler->event_callback();
+  REQUIRE(http_client->request_bodies.size() == 1);
+  REQUIRE(event_scheduler->cancelled);
+
+  // The next chunk schedules the flush again.
+  event_scheduler->event_callback = nullptr;
+  event_scheduler->cancelled = false;
+  tracer.create_span();
+  REQUIRE(event_scheduler->event_callback);
+  REQUIRE(!event_scheduler->cancelled);
+  event_scheduler->event_callback();
+  REQUIRE(http_client->request_bodies.size() == 2);
+}
+
+TEST_CASE("adaptive flush interval", "[datadog_agent]") {
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.telemetry.enabled = false;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.adaptive_flush_enabled = true;
+  config.agent.flush_interval_milliseconds = 1000;
+  config.agent.min_flush_interval_milliseconds = 100;
+  config.agent.max_flush_interval_milliseconds = 10000;
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+
+  Tracer tracer{*finalized};
+  // The recurring flush ticks at the minimum interval.
+  REQUIRE(event_scheduler->recurrence_interval == 100ms);
+  const auto& bodies = http_client->request_bodies;
+
+  // The first tick flushes.
+  tracer.create_span();
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 1);
+
+  // The small flush doubled the interval, so ticks before then do nothing.
+  tracer.create_span();
+  *now += 1999ms;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 1);
+  *now += 1ms;
+  event_scheduler->event_callback();
+  REQUIRE(bodies.size() == 2);
+}
+
+TEST_CASE("remote configuration tunes the trace pipeline",
+          "[datadog_agent]") {
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.telemetry.enabled = false;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.flush_interval_milliseconds = 1000;
+  config.agent.compression_threshold_bytes = 0;
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+
+  const TracerSignature signature(RuntimeID::generate(), "testsvc", "test");
+  auto telemetry = std::make_shared<TracerTelemetry>(
+      false, finalized->clock, finalized->logger, signature, "", "");
+  auto config_manager =
+      std::make_shared<ConfigManager>(*finalized, signature, telemetry);
+  const auto& agent_config =
+      std::get<FinalizedDatadogAgentConfig>(finalized->collector);
+  DatadogAgent agent(agent_config, telemetry, config.logger, signature, {},
+                     nullptr, config_manager);
+
+  const auto& bodies = http_client->request_bodies;
+  const auto send_trace_and_flush = [&]() {
+    std::vector<std::unique_ptr<SpanData>> spans;
+    spans.push_back(std::make_unique<SpanData>());
+    spans.back()->service = "testsvc";
+    REQUIRE(agent.send(std::move(spans), nullptr));
+    // The flush is the last recurring event scheduled.
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+  };
+
+  ConfigManager::Update update;
+  SECTION("buffer limit") {
+    update.pipeline.max_buffered_bytes = 1;
+    config_manager->apply_update(update);
+    send_trace_and_flush();
+    REQUIRE(bodies.empty());
+    // The flush reports the dropped chunk.
+    REQUIRE(logger->error_count() == 1);
+
+    // Reverting restores the configured limit.
+    config_manager->apply_update({});
+    send_trace_and_flush();
+    REQUIRE(bodies.size() == 1);
+    REQUIRE(logger->error_count() == 1);
+  }
+
+  SECTION("flush interval") {
+    update.pipeline.flush_interval = 5s;
+    config_manager->apply_update(update);
+
+    // Scheduled flushes wait for the remote interval.
+    *now += 1s;
+    send_trace_and_flush();
+    REQUIRE(bodies.empty());
+    *now += 4s;
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+    REQUIRE(bodies.size() == 1);
+
+    // Reverting restores the configured interval.
+    config_manager->apply_update({});
+    *now += 1s;
+    send_trace_and_flush();
+    REQUIRE(bodies.size() == 2);
+    REQUIRE(logger->error_count() == 0);
+  }
+
+  SECTION("compression") {
+    update.pipeline.compression_enabled = true;
+    config_manager->apply_update(update);
+    send_trace_and_flush();
+    REQUIRE(bodies.size() == 1);
+    // A gzip stream begins with the bytes 0x1F and 0x8B.
+    const bool compressed = bodies[0].rfind("\x1F\x8B", 0) == 0;
+    REQUIRE(compressed == gzip_available());
+    REQUIRE(logger->error_count() == 0);
+  }
+}
+
+TEST_CASE("telemetry is driven by the recurring flush", "[datadog_agent]") {
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  // The flush is the only recurring event.  Telemetry has no timer of its
+  // own.
+  REQUIRE(event_scheduler->recurrence_interval == 2s);
+  const auto heartbeats = [&]() {
+    return std::count_if(
+        http_client->request_bodies.begin(), http_client->request_bodies.end(),
+        [](const std::string& body) {
+          return body.find("app-heartbeat") != std::string::npos;
+        });
+  };
+  event_scheduler->event_callback();
+  *now += 58s;
+  event_scheduler->event_callback();
+  REQUIRE(heartbeats() == 0);
+  *now += 2s;
+  event_scheduler->event_callback();
+  REQUIRE(heartbeats() == 1);
+}
+
+TEST_CASE("on_flush reports each trace request", "[datadog_agent]") {
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  std::vector<FlushReport> reports;
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.telemetry.enabled = false;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.max_retries = 0;
+  config.agent.on_flush = [&](const FlushReport& report) {
+    reports.push_back(report);
+  };
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  {
+    auto root = tracer.create_span();
+    auto child = root.create_child();
+  }
+  tracer.create_span();
+  event_scheduler->event_callback();
+  // Nothing is reported until the request completes.
+  REQUIRE(reports.empty());
+  *now += 25ms;
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  REQUIRE(reports.size() == 1);
+  REQUIRE(reports[0].chunks == 2);
+  REQUIRE(reports[0].spans == 3);
+  REQUIRE(reports[0].bytes == http_client->request_bodies[0].size());
+  REQUIRE(reports[0].latency == 25ms);
+  REQUIRE(reports[0].status == 200);
+  REQUIRE(reports[0].dropped_chunks == 0);
+
+  // A request that fails is reported without a status.
+  http_client->response_error =
+      Error{Error::CURL_REQUEST_FAILURE, "connection refused"};
+  tracer.create_span();
+  event_scheduler->event_callback();
+  http_client->drain(std::chrono::steady_clock::time_point::max());
+  REQUIRE(reports.size() == 2);
+  REQUIRE(reports[1].chunks == 1);
+  REQUIRE(reports[1].status == 0);
+}
+
+TEST_CASE("state file carries sample rates to the next tracer",
+          "[datadog_agent]") {
+  const auto path =
+      std::filesystem::temp_directory_path() /
+      ("dd-trace-cpp-state-" + RuntimeID::generate().string() + ".json");
+  std::filesystem::remove(path);
+
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{\"rate_by_service\": {\""
+                             << CollectorResponse::key_of_default_rate
+                             << "\": 0.0}}";
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = logger;
+  config.telemetry.enabled = false;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.state_file = path.string();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto decide = [](Tracer& tracer) {
+    auto span = tracer.create_span();
+    MockDictWriter writer;
+    span.inject(writer);
+    auto decision = span.trace_segment().sampling_decision();
+    REQUIRE(decision);
+    return *decision;
+  };
+
+  {
+    Tracer tracer{*finalized};
+    // Without a state file, the first trace is kept at the default rate.
+    const auto decision = decide(tracer);
+    REQUIRE(decision.mechanism == int(SamplingMechanism::DEFAULT));
+    REQUIRE(decision.priority == int(SamplingPriority::AUTO_KEEP));
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::now());
+  }
+  REQUIRE(std::filesystem::exists(path));
+
+  {
+    // The next tracer samples with the agent's rate from its first trace.
+    Tracer tracer{*finalized};
+    const auto decision = decide(tracer);
+    REQUIRE(decision.mechanism == int(SamplingMechanism::AGENT_RATE));
+    REQUIRE(decision.priority == int(SamplingPriority::AUTO_DROP));
+  }
+
+  REQUIRE(logger->error_count() == 0);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("APM stats computed by the client", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.telemetry.enabled = false;
+
+  SECTION("disabled by default") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      http_client->response_status = 200;
+      http_client->response_body << "{}";
+      Tracer tracer{*finalized};
+      tracer.create_span();
+    }
+    REQUIRE(http_client->request_bodies.size() == 1);
+    REQUIRE(http_client->request_headers.items.count(
+                "Datadog-Client-Computed-Stats") == 0);
+  }
+
+  SECTION("sent to the stats endpoint when enabled") {
+    config.agent.stats_computation_enabled = true;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      http_client->response_status = 200;
+      http_client->response_body << "{}";
+      Tracer tracer{*finalized};
+      auto span = tracer.create_span();
+      span.set_name("handle");
+      auto child = span.create_child();
+      (void)child;
+    }
+
+    REQUIRE(logger->error_count() == 0);
+    // The stats are sent before the traces.
+    REQUIRE(http_client->request_bodies.size() == 2);
+    REQUIRE(http_client->request_url.path == "/v0.4/traces");
+    REQUIRE(http_client->request_headers.items.at(
+                "Datadog-Client-Computed-Stats") == "yes");
+    REQUIRE(http_client->request_headers.items.at(
+                "Datadog-Client-Computed-Top-Level") == "yes");
+    const auto payload =
+        nlohmann::json::from_msgpack(http_client->request_bodies[0]);
+    REQUIRE(payload["Service"] == "testsvc");
+    const auto& groups = payload["Stats"][0]["Stats"];
+    // Only the root span is top-level.
+    REQUIRE(groups.size() == 1);
+    REQUIRE(groups[0]["Name"] == "handle");
+    REQUIRE(groups[0]["Hits"] == 1);
+    REQUIRE(groups[0]["TopLevelHits"] == 1);
+
+    // Only the root span is marked as top-level.
+    const auto chunks =
+        nlohmann::json::from_msgpack(http_client->request_body);
+    REQUIRE(chunks[0].size() == 2);
+    for (const auto& span : chunks[0]) {
+      REQUIRE(span["metrics"].contains("_dd.top_level") ==
+              (span["parent_id"] == 0));
+    }
+  }
+
+  SECTION("traces dropped by sampling are not sent") {
+    config.agent.stats_computation_enabled = true;
+    config.trace_sampler.sample_rate = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      http_client->response_status = 200;
+      http_client->response_body << "{}";
+      Tracer tracer{*finalized};
+      tracer.create_span();
+    }
+
+    REQUIRE(logger->error_count() == 0);
+    // Only the stats are sent.
+    REQUIRE(http_client->request_bodies.size() == 1);
+    REQUIRE(http_client->request_url.path == "/v0.6/stats");
+    const auto payload =
+        nlohmann::json::from_msgpack(http_client->request_body);
+    REQUIRE(payload["Stats"][0]["Stats"][0]["Hits"] == 1);
+  }
+
+  SECTION("only span-sampled spans of dropped traces are sent") {
+    config.agent.stats_computation_enabled = true;
+    config.trace_sampler.sample_rate = 0;
+    SpanSamplerConfig::Rule rule;
+    rule.name = "keep";
+    config.span_sampler.rules.push_back(rule);
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      http_client->response_status = 200;
+      http_client->response_body << "{}";
+      Tracer tracer{*finalized};
+      auto root = tracer.create_span();
+      root.set_name("drop");
+      auto kept = root.create_child();
+      kept.set_name("keep");
+      auto dropped = kept.create_child();
+      dropped.set_name("drop");
+    }
+
+    REQUIRE(logger->error_count() == 0);
+    REQUIRE(http_client->request_bodies.size() == 2);
+    REQUIRE(http_client->request_url.path == "/v0.4/traces");
+    const auto chunks =
+        nlohmann::json::from_msgpack(http_client->request_body);
+    REQUIRE(chunks.size() == 1);
+    REQUIRE(chunks[0].size() == 1);
+    const auto& span = chunks[0][0];
+    REQUIRE(span["name"] == "keep");
+    REQUIRE(span["metrics"].contains("_dd.span_sampling.mechanism"));
+    REQUIRE(span["metrics"]["_sampling_priority_v1"] <= 0);
+  }
+}
+
+TEST_CASE("trace requests are divided among several agents",
+          "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  config.agent.max_retries = 0;
+  // One chunk per request.
+  config.agent.max_payload_bytes = 1;
+  config.agent.trace_agent_urls = std::vector<std::string>{
+      "http://agent-a:8126", "http://agent-b:8126"};
+
+  const auto now = std::make_shared<std::chrono::steady_clock::time_point>();
+  const Clock clock = [now]() {
+    TimePoint result;
+    result.tick = *now;
+    return result;
+  };
+
+  SECTION("DD_TRACE_AGENT_URLS overrides the configuration") {
+    const datadog::test::EnvGuard guard{"DD_TRACE_AGENT_URLS",
+                                        "http://x:1, http://y:2 http://z:3"};
+    auto finalized = finalize_config(config.agent, logger, clock);
+    REQUIRE(finalized);
+    REQUIRE(finalized->trace_agent_urls.size() == 3);
+    REQUIRE(finalized->trace_agent_urls[2].authority == "z:3");
+  }
+
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+  const auto& urls = http_client->request_urls;
+  // Send one trace, and return the authority of the agent it was sent to.
+  const auto send_trace = [&]() {
+    tracer.create_span();
+    event_scheduler->event_callback();
+    REQUIRE(!urls.empty());
+    return urls.back().authority;
+  };
+
+  SECTION("in turn") {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    REQUIRE(send_trace() == "agent-a:8126");
+    REQUIRE(send_trace() == "agent-b:8126");
+    REQUIRE(send_trace() == "agent-a:8126");
+    REQUIRE(urls.back().path == "/v0.4/traces");
+  }
+
+  SECTION("skipping an agent whose requests keep failing") {
+    http_client->response_body << "{}";
+    // `MockHTTPClient` completes only the most recent request.
+    const auto respond = [&](int status) {
+      http_client->response_status = status;
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+    };
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE(send_trace() == "agent-a:8126");
+      respond(503);
+      REQUIRE(send_trace() == "agent-b:8126");
+      respond(200);
+    }
+    REQUIRE(send_trace() == "agent-b:8126");
+    REQUIRE(send_trace() == "agent-b:8126");
+    // Once its backoff has elapsed, the agent is tried again.
+    *now += 1min;
+    REQUIRE(send_trace() == "agent-a:8126");
+    respond(200);
+    REQUIRE(send_trace() == "agent-b:8126");
+    REQUIRE(send_trace() == "agent-a:8126");
+  }
+
+  SECTION("skipping an agent that keeps responding slowly") {
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    const auto request_timeout =
+        std::get<FinalizedDatadogAgentConfig>(finalized->collector)
+            .request_timeout;
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE(send_trace() == "agent-a:8126");
+      *now += request_timeout;
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+      REQUIRE(send_trace() == "agent-b:8126");
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+    }
+    REQUIRE(send_trace() == "agent-b:8126");
+    REQUIRE(send_trace() == "agent-b:8126");
+  }
+
+  SECTION("averaging the agents' sample rates") {
+    http_client->response_status = 200;
+    const auto respond = [&](double rate) {
+      http_client->response_body.str("");
+      http_client->response_body
+          << R"({"rate_by_service": {"service:testsvc,env:": )" << rate
+          << "}}";
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+    };
+    REQUIRE(send_trace() == "agent-a:8126");
+    respond(0.2);
+    REQUIRE(send_trace() == "agent-b:8126");
+    respond(0.6);
+    send_trace();
+    const auto chunks =
+        nlohmann::json::from_msgpack(http_client->request_bodies.back());
+    REQUIRE(chunks[0][0]["metrics"]["_dd.agent_psr"] == Approx(0.4));
+    REQUIRE(logger->error_count() == 0);
+  }
+}
+
+TEST_CASE("agentless intake", "[datadog_agent]") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.agentless_url = "https://intake.example.com/v0.4/traces";
+
+  SECTION("requires an API key") {
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::DATADOG_AGENT_MISSING_API_KEY);
+  }
+
+  SECTION("sends traces to the intake") {
+    config.agent.api_key = "secret";
+    config.agent.trace_api_version = "v0.5";
+    config.agent.stats_computation_enabled = true;
+    const datadog::test::EnvGuard guard{"DD_API_KEY", "from-env"};
+
+    auto agent = finalize_config(config.agent, logger, default_clock);
+    REQUIRE(agent);
+    REQUIRE(!agent->remote_configuration_enabled);
+    REQUIRE(!agent->stats_computation_enabled);
+    REQUIRE(agent->trace_api_version == TraceAPIVersion::V0_4);
+    REQUIRE(agent->compression_enabled == gzip_available());
+
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      // The intake accepts traces without returning sample rates.
+      http_client->response_status = 202;
+      Tracer tracer{*finalized};
+      tracer.create_span();
+    }
+
+    REQUIRE(logger->error_count() == 0);
+    REQUIRE(http_client->request_urls.size() == 1);
+    const auto& url = http_client->request_url;
+    REQUIRE(url.scheme == "https");
+    REQUIRE(url.authority == "intake.example.com");
+    REQUIRE(url.path == "/v0.4/traces");
+    const auto& headers = http_client->request_headers.items;
+    REQUIRE(headers.at("DD-API-KEY") == "from-env");
   }
 }
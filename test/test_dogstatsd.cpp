@@ -0,0 +1,221 @@
+// These are tests for `DogStatsD`, which sends metrics to a DogStatsD server,
+// and for the health metrics that `DatadogAgent` sends with it.  Each test
+// receives the datagrams on a socket of its own.
+
+#include <arpa/inet.h>
+#include <datadog/dogstatsd.h>
+#include <datadog/error.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+using namespace std::chrono_literals;
+
+namespace {
+
+// `Server` is a datagram socket bound to a local address, from which the
+// datagrams sent to it can be read without blocking.
+class Server {
+  int fd_;
+  std::string path_;
+
+ public:
+  // Bind to a UDP port on the loopback interface.
+  Server() : fd_(::socket(AF_INET, SOCK_DGRAM, 0)) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(::bind(fd_, reinterpret_cast<sockaddr*>(&address),
+                   sizeof address) == 0);
+  }
+
+  // Bind to the Unix domain socket at the specified `path`.
+  explicit Server(std::string path)
+      : fd_(::socket(AF_UNIX, SOCK_DGRAM, 0)), path_(std::move(path)) {
+    ::unlink(path_.c_str());
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path_.c_str());
+    REQUIRE(::bind(fd_, reinterpret_cast<sockaddr*>(&address),
+                   sizeof address) == 0);
+  }
+
+  ~Server() {
+    ::close(fd_);
+    if (!path_.empty()) {
+      ::unlink(path_.c_str());
+    }
+  }
+
+  std::string url() const {
+    if (!path_.empty()) {
+      return "unix://" + path_;
+    }
+    sockaddr_in address{};
+    socklen_t size = sizeof address;
+    ::getsockname(fd_, reinterpret_cast<sockaddr*>(&address), &size);
+    return "udp://127.0.0.1:" + std::to_string(ntohs(address.sin_port));
+  }
+
+  // Return the datagrams received so far.
+  std::vector<std::string> receive() {
+    std::vector<std::string> datagrams;
+    char buffer[65536];
+    for (;;) {
+      const auto rc = ::recv(fd_, buffer, sizeof buffer, MSG_DONTWAIT);
+      if (rc < 0) {
+        return datagrams;
+      }
+      datagrams.emplace_back(buffer, rc);
+    }
+  }
+};
+
+}  // namespace
+
+TEST_CASE("DogStatsD", "[dogstatsd]") {
+  SECTION("sends a batch of lines as one datagram over UDP") {
+    Server server;
+    auto statsd = DogStatsD::open(server.url());
+    REQUIRE(statsd);
+    auto& client = **statsd;
+    const auto requests = client.define(
+        "tracer.requests", DogStatsD::Type::COUNT, {"service:svc", "env:prod"});
+    const auto rate =
+        client.define("tracer.keep_rate", DogStatsD::Type::GAUGE, {});
+    client.add(requests, 42);
+    client.add(rate, 0.25);
+    client.send();
+    // An empty batch is not sent.
+    client.send();
+
+    const auto datagrams = server.receive();
+    REQUIRE(datagrams.size() == 1);
+    REQUIRE(datagrams[0] ==
+            "tracer.requests:42|c|#service:svc,env:prod\n"
+            "tracer.keep_rate:0.25|g");
+    REQUIRE(client.dropped_datagrams() == 0);
+  }
+
+  SECTION("splits a batch that would exceed the datagram size") {
+    Server server;
+    auto statsd = DogStatsD::open(server.url());
+    REQUIRE(statsd);
+    auto& client = **statsd;
+    const auto metric = client.define(std::string(100, 'm'),
+                                      DogStatsD::Type::GAUGE, {});
+    const std::size_t lines = 2 * client.max_datagram_bytes() / 100;
+    for (std::size_t i = 0; i < lines; ++i) {
+      client.add(metric, double(i));
+    }
+    client.send();
+
+    const auto datagrams = server.receive();
+    REQUIRE(datagrams.size() > 2);
+    std::size_t received_lines = 0;
+    for (const auto& datagram : datagrams) {
+      REQUIRE(datagram.size() <= client.max_datagram_bytes());
+      REQUIRE(datagram.back() != '\n');
+      received_lines += 1 + std::count(datagram.begin(), datagram.end(), '\n');
+    }
+    REQUIRE(received_lines == lines);
+  }
+
+  SECTION("sends over a Unix domain socket") {
+    char path[] = "/tmp/dd-trace-cpp-dogstatsd-XXXXXX";
+    const int fd = ::mkstemp(path);
+    REQUIRE(fd != -1);
+    ::close(fd);
+    Server server{path};
+    auto statsd = DogStatsD::open(server.url());
+    REQUIRE(statsd);
+    auto& client = **statsd;
+    client.add(client.define("depth", DogStatsD::Type::GAUGE, {}), 7);
+    client.send();
+    REQUIRE(server.receive() == std::vector<std::string>{"depth:7|g"});
+  }
+
+  SECTION("drops a datagram that cannot be sent") {
+    char path[] = "/tmp/dd-trace-cpp-dogstatsd-XXXXXX";
+    const int fd = ::mkstemp(path);
+    REQUIRE(fd != -1);
+    ::close(fd);
+    ::unlink(path);
+    auto statsd = DogStatsD::open(std::string("unix://") + path);
+    REQUIRE(statsd);
+    auto& client = **statsd;
+    client.add(client.define("depth", DogStatsD::Type::GAUGE, {}), 7);
+    client.send();
+    REQUIRE(client.dropped_datagrams() == 1);
+  }
+
+  SECTION("rejects invalid URLs") {
+    for (const char* url :
+         {"http://localhost:8125", "udp://localhost", "udp://:8125",
+          "unix://", "localhost:8125"}) {
+      CAPTURE(url);
+      auto statsd = DogStatsD::open(url);
+      REQUIRE(!statsd);
+      REQUIRE(statsd.error().code == Error::DOGSTATSD_INVALID_URL);
+    }
+  }
+}
+
+TEST_CASE("DatadogAgent reports health metrics", "[dogstatsd]") {
+  Server server;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  TracerConfig config;
+  config.service = "testsvc";
+  config.logger = std::make_shared<MockLogger>();
+  config.telemetry.enabled = false;
+  config.agent.remote_configuration_enabled = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.health_metrics_enabled = true;
+  config.agent.dogstatsd_url = server.url();
+  config.agent.health_metrics_interval_seconds = 5;
+
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+  // The health metrics are the last recurring event scheduled.
+  REQUIRE(event_scheduler->recurrence_interval == 5s);
+
+  tracer.create_span();
+  event_scheduler->event_callback();
+  auto datagrams = server.receive();
+  REQUIRE(datagrams.size() == 1);
+  const std::string& report = datagrams[0];
+  CAPTURE(report);
+  for (const char* line : {
+           "datadog.tracer.queue.spans:1|g|#service:testsvc\n",
+           "datadog.tracer.flush.bytes:0|c|#service:testsvc\n",
+           "datadog.tracer.api.requests:0|c|#service:testsvc\n",
+           "datadog.tracer.api.errors:0|c|#service:testsvc,type:timeout\n",
+           "datadog.tracer.queue.dropped.traces:0|c|#service:testsvc,"
+           "reason:overfull_buffer\n",
+       }) {
+    REQUIRE(report.find(line) != std::string::npos);
+  }
+  REQUIRE(report.find("datadog.tracer.sampler.keep_rate:1|g") !=
+          std::string::npos);
+}
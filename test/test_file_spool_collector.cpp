@@ -0,0 +1,224 @@
+// These are tests for `FileSpoolCollector`, which appends trace chunks to
+// files for later upload.  Each test reads the files as the uploader would.
+
+#include <datadog/error.h>
+#include <datadog/file_spool_collector.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <datadog/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mocks/loggers.h"
+#include "span_data.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+namespace fs = std::filesystem;
+
+namespace {
+
+// `TemporaryDirectory` is an empty directory that is removed, with its
+// contents, when the object is destroyed.
+struct TemporaryDirectory {
+  fs::path path;
+
+  TemporaryDirectory() {
+    path = fs::temp_directory_path() /
+           ("dd-trace-cpp-spool-" +
+            std::to_string(reinterpret_cast<std::uintptr_t>(this)));
+    fs::remove_all(path);
+    fs::create_directory(path);
+  }
+  ~TemporaryDirectory() {
+    std::error_code ignored;
+    fs::remove_all(path, ignored);
+  }
+
+  // Return the names of the files in the directory having the specified
+  // `suffix`, sorted.
+  std::vector<std::string> files(const std::string& suffix) const {
+    std::vector<std::string> names;
+    for (const auto& entry : fs::directory_iterator(path)) {
+      const std::string name = entry.path().filename().string();
+      if (name.size() >= suffix.size() &&
+          name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+              0) {
+        names.push_back(name);
+      }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+};
+
+std::uint32_t little_endian(const std::string& data, std::size_t offset) {
+  std::uint32_t value = 0;
+  for (int i = 3; i >= 0; --i) {
+    value = (value << 8) | std::uint8_t(data[offset + i]);
+  }
+  return value;
+}
+
+// Return the CRC-32C of the specified `size` bytes at `data`, computed one
+// bit at a time.
+std::uint32_t crc32c(const char* data, std::size_t size) {
+  std::uint32_t crc = 0xFFFFFFFF;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc ^= std::uint8_t(data[i]);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+// Return the trace chunks in the spool file at the specified `path`, up to
+// the first invalid record.
+std::vector<nlohmann::json> read_spool(const fs::path& path) {
+  std::ifstream file{path, std::ios::binary};
+  const std::string data{std::istreambuf_iterator<char>(file), {}};
+  REQUIRE(data.size() >= 16);
+  REQUIRE(data.compare(0, 8, std::string("DDSPOOL\0", 8)) == 0);
+  REQUIRE(little_endian(data, 8) == 1);
+
+  std::vector<nlohmann::json> chunks;
+  std::size_t offset = 16;
+  while (offset + 8 <= data.size()) {
+    const std::uint32_t size = little_endian(data, offset);
+    if (size == 0 || offset + 8 + size > data.size()) {
+      break;
+    }
+    REQUIRE(little_endian(data, offset + 4) ==
+            crc32c(data.data() + offset + 8, size));
+    const auto* begin =
+        reinterpret_cast<const std::uint8_t*>(data.data() + offset + 8);
+    chunks.push_back(nlohmann::json::from_msgpack(begin, begin + size));
+    offset += (8 + size + 7) & ~std::size_t(7);
+  }
+  return chunks;
+}
+
+std::vector<std::unique_ptr<SpanData>> make_chunk(const std::string& name,
+                                                  std::size_t tag_size = 0) {
+  std::vector<std::unique_ptr<SpanData>> spans;
+  auto span = std::make_unique<SpanData>();
+  span->service = "testsvc";
+  span->name = name;
+  if (tag_size) {
+    span->tags["filler"] = std::string(tag_size, 'x');
+  }
+  spans.push_back(std::move(span));
+  return spans;
+}
+
+}  // namespace
+
+TEST_CASE("FileSpoolCollector", "[file_spool_collector]") {
+  // the check value of CRC-32C
+  REQUIRE(crc32c("123456789", 9) == 0xE3069283);
+
+  const TemporaryDirectory directory;
+  const auto logger = std::make_shared<MockLogger>();
+  FileSpoolCollectorConfig config;
+  config.directory = directory.path.string();
+  config.max_file_bytes = 64 * 1024;
+
+  SECTION("chunks are readable while the file is being written") {
+    config.sync = GENERATE(FileSpoolSync::NEVER, FileSpoolSync::ON_ROTATE,
+                           FileSpoolSync::EVERY_CHUNK);
+    auto collector = FileSpoolCollector::create(config, logger);
+    REQUIRE(collector);
+    ChunkTags chunk_tags;
+    chunk_tags.origin = "synthetics";
+    REQUIRE((*collector)->send(make_chunk("first"), chunk_tags, nullptr));
+    REQUIRE((*collector)->send(make_chunk("second"), nullptr));
+
+    // The file is complete only when the collector is destroyed, but what
+    // has been written so far is as a crash would leave it.
+    REQUIRE(directory.files(".spool").empty());
+    const auto partial = directory.files(".spool.partial");
+    REQUIRE(partial.size() == 1);
+    const auto chunks = read_spool(directory.path / partial[0]);
+    REQUIRE(chunks.size() == 2);
+    REQUIRE(chunks[0][0]["name"] == "first");
+    REQUIRE(chunks[0][0]["meta"]["_dd.origin"] == "synthetics");
+    REQUIRE(chunks[1][0]["name"] == "second");
+
+    collector->reset();
+    REQUIRE(directory.files(".spool.partial").empty());
+    const auto complete = directory.files(".spool");
+    REQUIRE(complete.size() == 1);
+    REQUIRE(complete[0] + ".partial" == partial[0]);
+    // The complete file contains only the records.
+    const auto size = fs::file_size(directory.path / complete[0]);
+    REQUIRE(size < 1024);
+    REQUIRE(read_spool(directory.path / complete[0]).size() == 2);
+    REQUIRE(logger->error_count() == 0);
+  }
+
+  SECTION("files are rotated when full") {
+    auto collector = FileSpoolCollector::create(config, logger);
+    REQUIRE(collector);
+    for (int i = 0; i < 30; ++i) {
+      REQUIRE((*collector)->send(make_chunk(std::to_string(i), 5000), nullptr));
+    }
+    collector->reset();
+
+    const auto files = directory.files(".spool");
+    REQUIRE(files.size() >= 3);
+    int expected = 0;
+    for (const auto& name : files) {
+      REQUIRE(fs::file_size(directory.path / name) <= 64 * 1024);
+      for (const auto& chunk : read_spool(directory.path / name)) {
+        REQUIRE(chunk[0]["name"] == std::to_string(expected));
+        ++expected;
+      }
+    }
+    REQUIRE(expected == 30);
+  }
+
+  SECTION("an empty file is removed") {
+    auto collector = FileSpoolCollector::create(config, logger);
+    REQUIRE(collector);
+    REQUIRE(directory.files(".spool.partial").size() == 1);
+    collector->reset();
+    REQUIRE(fs::is_empty(directory.path));
+  }
+
+  SECTION("a chunk larger than a file is an error") {
+    auto collector = FileSpoolCollector::create(config, logger);
+    REQUIRE(collector);
+    auto result = (*collector)->send(make_chunk("big", 100 * 1024), nullptr);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::FILE_SPOOL_COLLECTOR_CHUNK_TOO_LARGE);
+  }
+
+  SECTION("config") {
+    config.sync = FileSpoolSync::EVERY_CHUNK;
+    auto collector = FileSpoolCollector::create(config, logger);
+    REQUIRE(collector);
+    const auto json = nlohmann::json::parse((*collector)->config());
+    REQUIRE(json["type"] == "datadog::tracing::FileSpoolCollector");
+    REQUIRE(json["config"]["directory"] == config.directory);
+    REQUIRE(json["config"]["max_file_bytes"] == 64 * 1024);
+    REQUIRE(json["config"]["sync"] == "every_chunk");
+  }
+
+  SECTION("invalid configurations are rejected") {
+    SECTION("files too small") { config.max_file_bytes = 4096; }
+    SECTION("directory does not exist") {
+      config.directory = (directory.path / "nonexistent").string();
+    }
+
+    auto collector = FileSpoolCollector::create(config, logger);
+    REQUIRE(!collector);
+    REQUIRE(collector.error().code == Error::FILE_SPOOL_COLLECTOR_FILE_FAILED);
+  }
+}
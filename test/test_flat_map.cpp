@@ -0,0 +1,107 @@
+// These are tests for `FlatMap`, the container used for the tags of
+// `SpanData`.
+
+#include <datadog/string_view.h>
+
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "flat_map.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("FlatMap", "[flat_map]") {
+  // Exercise both the inline storage and the heap storage, and both linear and
+  // binary search.
+  const std::size_t num_entries = GENERATE(0, 1, 3, 4, 5, 20, 100);
+  CAPTURE(num_entries);
+
+  FlatMap<std::string, 4> map;
+  std::unordered_map<std::string, std::string> expected;
+  for (std::size_t i = 0; i < num_entries; ++i) {
+    // Insert in an order that is not sorted.
+    const std::string key = "key" + std::to_string((i * 7) % num_entries);
+    const std::string value = "value" + std::to_string(i);
+    const bool inserted = expected.emplace(key, value).second;
+    REQUIRE(map.emplace(key, value).second == inserted);
+  }
+
+  const auto check = [&]() {
+    REQUIRE(map.size() == expected.size());
+    REQUIRE(map.empty() == expected.empty());
+    for (const auto& [key, value] : expected) {
+      REQUIRE(map.count(key) == 1);
+      REQUIRE(map.at(key) == value);
+    }
+    // Entries are sorted by key.
+    for (auto iter = map.begin(); iter != map.end(); ++iter) {
+      REQUIRE(expected.at(iter->first) == iter->second);
+      if (iter != map.begin()) {
+        REQUIRE(std::prev(iter)->first < iter->first);
+      }
+    }
+  };
+  check();
+
+  SECTION("lookup of absent keys") {
+    REQUIRE(map.find("nope") == map.end());
+    REQUIRE(map.count("") == 0);
+    REQUIRE_THROWS_AS(map.at("absent"), std::out_of_range);
+  }
+
+  SECTION("emplace does not overwrite") {
+    for (const auto& [key, value] : expected) {
+      const auto [iter, inserted] = map.emplace(key, "changed");
+      REQUIRE_FALSE(inserted);
+      REQUIRE(iter->second == value);
+    }
+    check();
+  }
+
+  SECTION("insert_or_assign and operator[] overwrite") {
+    for (auto& [key, value] : expected) {
+      value = "changed " + key;
+      const auto [iter, inserted] = map.insert_or_assign(key, value);
+      REQUIRE_FALSE(inserted);
+      REQUIRE(iter->second == value);
+    }
+    check();
+    map["brand new"] = "entry";
+    expected["brand new"] = "entry";
+    check();
+  }
+
+  SECTION("erase") {
+    const auto keys = expected;
+    for (const auto& entry : keys) {
+      REQUIRE(map.erase(entry.first) == 1);
+      REQUIRE(map.erase(entry.first) == 0);
+      expected.erase(entry.first);
+      check();
+    }
+    REQUIRE(map.empty());
+  }
+
+  SECTION("copy and move") {
+    const FlatMap<std::string, 4> copy{map};
+    REQUIRE(copy == map);
+    FlatMap<std::string, 4> moved{std::move(map)};
+    REQUIRE(moved == copy);
+    REQUIRE(map.empty());  // NOLINT(bugprone-use-after-move)
+    map = std::move(moved);
+    check();
+  }
+
+  SECTION("clear") {
+    map.clear();
+    expected.clear();
+    check();
+    map.emplace("again", "yes");
+    expected.emplace("again", "yes");
+    check();
+  }
+}
@@ -0,0 +1,64 @@
+// These are tests for `FlushController`, which chooses the interval between a
+// `DatadogAgent`'s flushes when that interval is adaptive.
+
+#include <datadog/flush_controller.h>
+
+#include <chrono>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+using namespace std::chrono_literals;
+
+TEST_CASE("FlushController", "[flush_controller]") {
+  FlushController controller{1s, 100ms, 10s, 1000};
+  const auto start = std::chrono::steady_clock::time_point{} + 1h;
+
+  SECTION("the first flush is due at once") {
+    REQUIRE(controller.due(start));
+    REQUIRE(controller.interval() == 1s);
+  }
+
+  SECTION("later flushes are due once the interval has elapsed") {
+    controller.record_flush(start, 1000, 0ms);
+    REQUIRE(controller.interval() == 1s);
+    REQUIRE(!controller.due(start + 999ms));
+    REQUIRE(controller.due(start + 1s));
+  }
+
+  SECTION("the interval moves toward the target payload size") {
+    controller.record_flush(start, 4000, 0ms);
+    REQUIRE(controller.interval() == 500ms);
+    controller.record_flush(start, 1250, 0ms);
+    REQUIRE(controller.interval() == 400ms);
+    controller.record_flush(start, 500, 0ms);
+    REQUIRE(controller.interval() == 800ms);
+  }
+
+  SECTION("an empty flush doubles the interval") {
+    controller.record_flush(start, 0, 0ms);
+    REQUIRE(controller.interval() == 2s);
+  }
+
+  SECTION("the interval stays within its bounds") {
+    for (int i = 0; i < 10; ++i) {
+      controller.record_flush(start, 1000000, 0ms);
+    }
+    REQUIRE(controller.interval() == 100ms);
+    for (int i = 0; i < 10; ++i) {
+      controller.record_flush(start, 0, 0ms);
+    }
+    REQUIRE(controller.interval() == 10s);
+  }
+
+  SECTION("flushing takes at most a tenth of the interval") {
+    controller.record_flush(start, 4000, 300ms);
+    REQUIRE(controller.interval() == 3s);
+  }
+
+  SECTION("the interval is no shorter than the response latency") {
+    controller.record_response(700ms);
+    controller.record_flush(start, 4000, 0ms);
+    REQUIRE(controller.interval() == 700ms);
+  }
+}
@@ -0,0 +1,108 @@
+// These are tests for `FunctionRef`, the non-owning callable used for the
+// callbacks of `DictReader::visit` and `Logger::LogFunc`, and for the
+// overloads of `DictReader::visit` that keep older readers working.
+
+#include <datadog/dict_reader.h>
+#include <datadog/function_ref.h>
+
+#include <functional>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+int twice(int value) { return 2 * value; }
+
+int call(FunctionRef<int(int)> function, int value) { return function(value); }
+
+// A reader that overrides `visit(Visitor)`.
+class Reader : public DictReader {
+ public:
+  Optional<StringView> lookup(StringView) const override { return nullopt; }
+  void visit(Visitor visitor) const override { visitor("key", "value"); }
+};
+
+// A reader written before `Visitor` existed, which overrides the deprecated
+// `visit` overload.
+class LegacyReader : public DictReader {
+ public:
+  Optional<StringView> lookup(StringView) const override { return nullopt; }
+  void visit(const std::function<void(StringView key, StringView value)>&
+                 visitor) const override {
+    visitor("key", "value");
+  }
+};
+
+}  // namespace
+
+TEST_CASE("FunctionRef", "[function_ref]") {
+  SECTION("refers to a lambda expression and its captures") {
+    std::string visited;
+    const auto visit = [&](FunctionRef<void(const std::string&)> visitor) {
+      visitor("a");
+      visitor("b");
+    };
+    visit([&visited](const std::string& value) { visited += value; });
+    REQUIRE(visited == "ab");
+  }
+
+  SECTION("refers to a mutable callable without copying it") {
+    int count = 0;
+    auto counter = [count](int value) mutable { return count += value; };
+    REQUIRE(call(counter, 1) == 1);
+    REQUIRE(call(counter, 2) == 3);
+    REQUIRE(counter(0) == 3);
+  }
+
+  SECTION("refers to a std::function") {
+    const std::function<int(int)> function = [](int value) {
+      return value + 1;
+    };
+    REQUIRE(call(function, 1) == 2);
+  }
+
+  SECTION("refers to a function") {
+    REQUIRE(call(twice, 3) == 6);
+    REQUIRE(call(&twice, 4) == 8);
+  }
+
+  SECTION("copies refer to the same callable") {
+    int calls = 0;
+    auto increment = [&calls](int) { return ++calls; };
+    const FunctionRef<int(int)> original{increment};
+    const FunctionRef<int(int)> copy = original;
+    original(0);
+    copy(0);
+    REQUIRE(calls == 2);
+  }
+}
+
+TEST_CASE("DictReader::visit overloads", "[function_ref]") {
+  const Reader reader;
+  const LegacyReader legacy_reader;
+  const DictReader* const reader_under_test =
+      GENERATE_REF(as<const DictReader*>{}, &reader, &legacy_reader);
+
+  std::string visited;
+  const auto append = [&visited](StringView key, StringView value) {
+    visited.append(key.data(), key.size());
+    visited += '=';
+    visited.append(value.data(), value.size());
+  };
+
+  SECTION("with a lambda expression") { reader_under_test->visit(append); }
+
+  SECTION("with a std::function") {
+    const std::function<void(StringView, StringView)> function = append;
+    reader_under_test->visit(function);
+  }
+
+  SECTION("with a Visitor") {
+    reader_under_test->visit(DictReader::Visitor(append));
+  }
+
+  REQUIRE(visited == "key=value");
+}
@@ -1,9 +1,13 @@
 // This test covers the glob-style string pattern matching function,
-// `glob_match`, defined in `glob.h`.
+// `glob_match`, and the compiled pattern `Glob`, defined in `glob.h`.
 
 #include <datadog/glob.h>
 #include <datadog/string_view.h>
 
+#include <random>
+#include <string>
+#include <vector>
+
 #include "test.h"
 
 using namespace datadog::tracing;
@@ -48,7 +52,43 @@ TEST_CASE("glob", "[glob]") {
     {"true", "TRUE", true},
     {"true", "True", true},
     {"true", "tRue", true},
-    {"false", "FALSE", true}
+    {"false", "FALSE", true},
+
+    // shapes that `Glob` matches without backtracking
+    {"**", "anything", true},
+    {"foo*", "FOOD", true},
+    {"foo*", "fo", false},
+    {"foo**", "foo", true},
+    {"*bar", "crowbar", true},
+    {"*bar", "bars", false},
+    {"*bar", "ar", false},
+    {"*b*r", "crowbar", true},
+
+    // long literal runs, which are compared several bytes at a time
+    {"GET /API/V2/ORDERS/*/ITEMS", "get /api/v2/orders/123/items", true},
+    {"get /api/v2/orders/*/items", "GET /API/V2/ORDERS/123/ITEMX", false},
+    {"select * from orders where id = ?", "SELECT * FROM ORDERS WHERE ID = 7",
+     true},
+    {"*-service-replica-??", "Payments-Service-Replica-07", true},
+    {"Checkout-Service-Primary", "CHECKOUT-service-primary", true},
+    {"Checkout-Service-Primary", "CHECKOUT-service-primarY!", false},
+    // only ASCII letters are folded
+    {"@@@@@@@@@@", "``````````", false},
+    {"[[[[[[[[[[", "{{{{{{{{{{", false},
+    {"éééééé", "éééééé", true},
+    {"éééééé", "ÉÉÉÉÉÉ", false},
+
+    // segments between "*", which are found in order without backtracking
+    {"*a*b*c*", "xxcxxbxxaxx", false},
+    {"*a*b*c*", "xxaxxbxxcxx", true},
+    {"*ab*ab*", "abab", true},
+    {"*ab*ab*", "aba", false},
+    {"*a?c*A?C", "abcabc", true},
+    {"*a?c*a?c", "abcab", false},
+    {"x*?*y", "xy", false},
+    {"x*?*y", "xzy", true},
+    {"*SELECT*FROM*WHERE*", "select id from orders where id = 7", true},
+    {"*SELECT*WHERE*FROM*", "select id from orders where id = 7", false}
   }));
   // clang-format on
 
@@ -57,4 +97,106 @@ TEST_CASE("glob", "[glob]") {
   CAPTURE(test_case.expected);
   REQUIRE(glob_match(test_case.pattern, test_case.subject) ==
           test_case.expected);
+  REQUIRE(Glob(test_case.pattern).match(test_case.subject) ==
+          test_case.expected);
+}
+
+TEST_CASE("glob pattern kinds", "[glob]") {
+  struct TestCase {
+    StringView pattern;
+    Glob::Kind expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"*", Glob::Kind::ANY},
+      {"***", Glob::Kind::ANY},
+      {"", Glob::Kind::LITERAL},
+      {"foo", Glob::Kind::LITERAL},
+      {"foo*", Glob::Kind::PREFIX},
+      {"*foo", Glob::Kind::SUFFIX},
+      {"**foo", Glob::Kind::SUFFIX},
+      {"*foo*", Glob::Kind::GENERAL},
+      {"f*o", Glob::Kind::GENERAL},
+      {"foo?", Glob::Kind::GENERAL},
+  }));
+
+  CAPTURE(test_case.pattern);
+  REQUIRE(Glob(test_case.pattern).kind() == test_case.expected);
+}
+
+namespace {
+
+// Return whether the specified `subject` matches the specified `pattern`,
+// computed by dynamic programming over every pair of positions.  This is
+// simple enough to be obviously correct, and is slow for long inputs.
+bool reference_match(StringView pattern, StringView subject) {
+  const auto lower = [](char c) {
+    return c >= 'A' && c <= 'Z' ? char(c + ('a' - 'A')) : c;
+  };
+  // `matches[j]` is whether the first `i` characters of `pattern` match the
+  // first `j` characters of `subject`.
+  std::vector<bool> matches(subject.size() + 1, false);
+  matches[0] = true;
+  for (const char p : pattern) {
+    std::vector<bool> next(subject.size() + 1, false);
+    for (std::size_t j = 0; j <= subject.size(); ++j) {
+      if (p == '*') {
+        next[j] = matches[j] || (j > 0 && next[j - 1]);
+      } else if (j > 0) {
+        next[j] = matches[j - 1] &&
+                  (p == '?' || lower(p) == lower(subject[j - 1]));
+      }
+    }
+    matches = std::move(next);
+  }
+  return matches[subject.size()];
+}
+
+}  // namespace
+
+TEST_CASE("glob agrees with a reference matcher", "[glob]") {
+  // Random patterns and subjects over a small alphabet are likely to have
+  // many partial matches.  Some segments are longer than 64 characters, and
+  // so span more than one word of the bit-parallel search.
+  const auto long_segments = GENERATE(false, true);
+  CAPTURE(long_segments);
+  std::mt19937 generator(long_segments ? 2 : 1);
+  const auto random_string = [&](StringView alphabet, std::size_t max_size) {
+    std::string result(generator() % (max_size + 1), '\0');
+    for (char& c : result) {
+      c = alphabet[generator() % alphabet.size()];
+    }
+    return result;
+  };
+
+  for (int i = 0; i < 2000; ++i) {
+    std::string pattern = long_segments ? random_string("aAb?", 150) + "*" +
+                                              random_string("ab?*", 8)
+                                        : random_string("aAb?*", 10);
+    const std::string subject = random_string("abB", long_segments ? 300 : 16);
+    if (long_segments && i % 2) {
+      pattern = "*" + pattern;
+    }
+    if (long_segments && i % 4 == 3 && subject.size() > 100) {
+      // A segment taken from the subject, so that long segments match too.
+      pattern = subject.substr(generator() % (subject.size() - 100), 100);
+      for (char& c : pattern) {
+        c = generator() % 8 ? c : '?';
+      }
+      pattern = "*" + pattern + "*";
+    }
+    CAPTURE(pattern);
+    CAPTURE(subject);
+    REQUIRE(Glob(pattern).match(subject) == reference_match(pattern, subject));
+  }
+}
+
+TEST_CASE("glob matching adversarial patterns", "[glob]") {
+  // A backtracking matcher takes time proportional to the product of the
+  // lengths of these patterns and subjects.
+  const std::string subject(100000, 'a');
+  REQUIRE_FALSE(Glob("*a*a*a*a*a*a*a*a*b").match(subject));
+  REQUIRE(Glob("*a*a*a*a*a*a*a*a*a").match(subject));
+  REQUIRE_FALSE(glob_match("*" + std::string(100, 'a') + "b*", subject));
+  REQUIRE(glob_match("*" + std::string(100, '?') + "*", subject));
 }
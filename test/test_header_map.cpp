@@ -0,0 +1,120 @@
+// These are tests for `HeaderMap`, the case-insensitive collection of headers
+// that implements both `DictReader` and `DictWriter`.
+
+#include <datadog/header_map.h>
+#include <datadog/span.h>
+#include <datadog/tracer.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+std::vector<std::pair<std::string, std::string>> visited(
+    const HeaderMap& headers) {
+  std::vector<std::pair<std::string, std::string>> result;
+  headers.visit([&](StringView name, StringView value) {
+    result.emplace_back(std::string(name), std::string(value));
+  });
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("HeaderMap", "[header_map]") {
+  HeaderMap headers;
+  REQUIRE(headers.empty());
+  REQUIRE(!headers.lookup("host"));
+
+  SECTION("lookup ignores case") {
+    headers.append("Host", "example.com");
+    headers.append("X-Datadog-Trace-ID", "123");
+    REQUIRE(headers.size() == 2);
+    REQUIRE(headers.lookup("host") == "example.com");
+    REQUIRE(headers.lookup("HOST") == "example.com");
+    REQUIRE(headers.lookup("x-datadog-trace-id") == "123");
+    REQUIRE(!headers.lookup("x-datadog-parent-id"));
+    REQUIRE(!headers.lookup("hos"));
+  }
+
+  SECTION("append keeps duplicates, and lookup finds the first") {
+    headers.append("accept", "text/html");
+    headers.append("Accept", "application/json");
+    REQUIRE(headers.size() == 2);
+    REQUIRE(headers.lookup("accept") == "text/html");
+    REQUIRE(visited(headers) ==
+            std::vector<std::pair<std::string, std::string>>{
+                {"accept", "text/html"}, {"Accept", "application/json"}});
+  }
+
+  SECTION("set overwrites, whether the new value is shorter or longer") {
+    headers.append("a", "1");
+    headers.append("b", "22");
+    headers.set("A", "333");
+    headers.set("b", "4");
+    headers.set("c", "5");
+    REQUIRE(headers.size() == 3);
+    REQUIRE(visited(headers) ==
+            std::vector<std::pair<std::string, std::string>>{
+                {"A", "333"}, {"b", "4"}, {"c", "5"}});
+  }
+
+  SECTION("more headers than are stored inline") {
+    const std::size_t count = 3 * HeaderMap::inline_capacity;
+    for (std::size_t i = 0; i < count; ++i) {
+      headers.append("Header-" + std::to_string(i), std::to_string(i));
+    }
+    REQUIRE(headers.size() == count);
+    for (std::size_t i = 0; i < count; ++i) {
+      REQUIRE(headers.lookup("header-" + std::to_string(i)) ==
+              std::to_string(i));
+    }
+    REQUIRE(visited(headers).size() == count);
+  }
+
+  SECTION("clear removes every header") {
+    for (std::size_t i = 0; i < 2 * HeaderMap::inline_capacity; ++i) {
+      headers.append("Header-" + std::to_string(i), "value");
+    }
+    headers.clear();
+    REQUIRE(headers.empty());
+    REQUIRE(!headers.lookup("header-0"));
+    REQUIRE(visited(headers).empty());
+  }
+}
+
+TEST_CASE("HeaderMap propagates trace context", "[header_map]") {
+  TracerConfig config;
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<MockLogger>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  HeaderMap inbound;
+  inbound.append("Host", "example.com");
+  inbound.append("X-Datadog-Trace-Id", "123");
+  inbound.append("X-Datadog-Parent-Id", "456");
+  inbound.append("X-Datadog-Sampling-Priority", "2");
+  auto span = tracer.extract_span(inbound);
+  REQUIRE(span);
+  REQUIRE(span->trace_id().low == 123);
+  REQUIRE(span->parent_id() == 456);
+
+  HeaderMap outbound;
+  outbound.append("x-datadog-parent-id", "stale");
+  span->inject(outbound);
+  REQUIRE(outbound.lookup("x-datadog-trace-id") == "123");
+  REQUIRE(outbound.lookup("x-datadog-parent-id") ==
+          std::to_string(span->id()));
+  REQUIRE(outbound.lookup("x-datadog-sampling-priority") == "2");
+}
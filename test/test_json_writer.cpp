@@ -0,0 +1,97 @@
+// These are tests for `JSONWriter`, which writes JSON text directly into a
+// buffer.
+
+#include <datadog/json_writer.h>
+
+#include <cstdint>
+#include <datadog/json.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("JSONWriter separates members and elements") {
+  std::string buffer;
+  JSONWriter writer{buffer};
+  writer.begin_object();
+  writer.member("name", "value");
+  writer.member("enabled", false);
+  writer.key("empty");
+  writer.begin_object();
+  writer.end_object();
+  writer.key("points");
+  writer.begin_array();
+  writer.begin_array();
+  writer.value(1);
+  writer.value(2);
+  writer.end_array();
+  writer.begin_array();
+  writer.end_array();
+  writer.end_array();
+  writer.member("tags", std::vector<std::string>{"a:b", "c:d"});
+  writer.end_object();
+
+  REQUIRE(buffer ==
+          R"({"name":"value","enabled":false,"empty":{},"points":[[1,2],[]],)"
+          R"("tags":["a:b","c:d"]})");
+}
+
+TEST_CASE("JSONWriter writes raw JSON as a value") {
+  std::string buffer;
+  JSONWriter writer{buffer};
+  writer.begin_object();
+  writer.member("name", "value");
+  writer.key("tags");
+  writer.raw(R"(["a:b"])");
+  writer.end_object();
+  REQUIRE(buffer == R"({"name":"value","tags":["a:b"]})");
+}
+
+TEST_CASE("JSONWriter appends to the buffer") {
+  std::string buffer = "prefix ";
+  JSONWriter writer{buffer};
+  writer.value(true);
+  REQUIRE(buffer == "prefix true");
+}
+
+TEST_CASE("JSONWriter integers") {
+  std::string buffer;
+  JSONWriter writer{buffer};
+  writer.begin_array();
+  writer.value(std::numeric_limits<std::uint64_t>::max());
+  writer.value(std::numeric_limits<std::int64_t>::min());
+  writer.value(0);
+  writer.end_array();
+
+  REQUIRE(buffer == "[18446744073709551615,-9223372036854775808,0]");
+}
+
+TEST_CASE("JSONWriter escapes strings") {
+  struct TestCase {
+    std::string name;
+    std::string input;
+    std::string expected;
+  };
+
+  // clang-format off
+  auto test_case = GENERATE(values<TestCase>({
+      {"plain", "hello", R"("hello")"},
+      {"empty", "", R"("")"},
+      {"quote and backslash", R"(say "\")", R"("say \"\\\"")"},
+      {"short escapes", "\b\f\n\r\t", R"("\b\f\n\r\t")"},
+      {"other control characters", std::string("\x00\x01\x1f", 3),
+       R"("\u0000\u0001\u001f")"},
+      {"UTF-8 is unchanged", "caf\xc3\xa9", "\"caf\xc3\xa9\""},
+  }));
+  // clang-format on
+
+  CAPTURE(test_case.name);
+  std::string buffer;
+  JSONWriter writer{buffer};
+  writer.value(test_case.input);
+  REQUIRE(buffer == test_case.expected);
+  REQUIRE(nlohmann::json::parse(buffer) == test_case.input);
+}
@@ -1,8 +1,11 @@
 #include <datadog/clock.h>
 #include <datadog/limiter.h>
 
+#include <atomic>
 #include <chrono>
 #include <ctime>
+#include <thread>
+#include <vector>
 
 #include "test.h"
 
@@ -141,4 +144,30 @@ TEST_CASE("limiter") {
     result = lim.allow();
     REQUIRE(!result.allowed);
   }
+
+  SECTION("allows no more than the available tokens when used concurrently") {
+    Limiter lim(clock, 100, 1.0, 1);
+    const int num_threads = 8;
+    const int requests_per_thread = 1000;
+    std::atomic<int> num_allowed{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&]() {
+        for (int j = 0; j < requests_per_thread; ++j) {
+          if (lim.allow().allowed) {
+            ++num_allowed;
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    REQUIRE(num_allowed == 100);
+
+    // The refill after one second is also counted once.
+    current_time += std::chrono::seconds(1);
+    REQUIRE(lim.allow().allowed);
+    REQUIRE(!lim.allow().allowed);
+  }
 }
@@ -0,0 +1,55 @@
+// These are tests for `lock_statistics`, which reports the use of the
+// tracer's internal locks when the library is built with
+// `DD_TRACE_LOCK_STATISTICS`.
+
+#include <datadog/lock_statistics.h>
+#include <datadog/span.h>
+#include <datadog/tracer.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "mocks/collectors.h"
+#include "mocks/dict_writers.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("lock_statistics", "[lock_statistics]") {
+#if defined(DD_TRACE_LOCK_STATISTICS)
+  const auto find = [](StringView name) {
+    const auto all = lock_statistics();
+    const auto found =
+        std::find_if(all.begin(), all.end(), [&](const LockStatistics& lock) {
+          return lock.name == name;
+        });
+    REQUIRE(found != all.end());
+    return *found;
+  };
+
+  const auto before = find("TraceSegment::mutex_");
+
+  TracerConfig config;
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<MockLogger>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+  {
+    Span span = tracer.create_span();
+    // Injecting trace context makes a sampling decision, which locks the
+    // segment's mutex.
+    MockDictWriter writer;
+    span.inject(writer);
+  }
+
+  const auto after = find("TraceSegment::mutex_");
+  REQUIRE(after.acquisitions > before.acquisitions);
+  REQUIRE(after.contentions >= before.contentions);
+  REQUIRE(after.wait_time >= before.wait_time);
+#else
+  REQUIRE(lock_statistics().empty());
+#endif
+}
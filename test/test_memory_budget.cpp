@@ -0,0 +1,90 @@
+// These are tests for `MemoryBudget`, which accounts for the memory held by a
+// tracer, and for how the tracer behaves when its budget is exhausted.
+
+#include <datadog/pressure.h>
+#include <datadog/span.h>
+#include <datadog/tags.h>
+#include <datadog/tracer.h>
+
+#include <thread>
+
+#include "memory_budget.h"
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("MemoryBudget", "[memory_budget]") {
+  SECTION("without a limit, memory is accounted for but never exhausted") {
+    MemoryBudget budget{0};
+    budget.charge(1 << 30);
+    REQUIRE(budget.bytes() == 1 << 30);
+    REQUIRE(budget.refresh() == MemoryBudget::NORMAL);
+    budget.release(1 << 30);
+    REQUIRE(budget.bytes() == 0);
+  }
+
+  SECTION("the state follows the proportion of the limit in use") {
+    // The granularity is a sixty-fourth of the limit, i.e. 100 bytes, so
+    // every charge below refreshes the state.
+    MemoryBudget budget{6400};
+    REQUIRE(budget.state() == MemoryBudget::NORMAL);
+    budget.charge(3200);
+    REQUIRE(budget.state() == MemoryBudget::FLUSH);
+    budget.charge(3200);
+    REQUIRE(budget.state() == MemoryBudget::SHED);
+    budget.release(6400);
+    REQUIRE(budget.state() == MemoryBudget::NORMAL);
+  }
+
+  SECTION("memory may be released by another thread than charged it") {
+    MemoryBudget budget{6400};
+    std::thread([&]() { budget.charge(6400); }).join();
+    REQUIRE(budget.state() == MemoryBudget::SHED);
+    budget.release(6400);
+    REQUIRE(budget.bytes() == 0);
+    REQUIRE(budget.state() == MemoryBudget::NORMAL);
+  }
+
+  SECTION("MemoryCharge charges for its lifetime") {
+    const auto budget = std::make_shared<MemoryBudget>(0);
+    {
+      MemoryCharge charge{budget, 123};
+      REQUIRE(budget->bytes() == 123);
+    }
+    REQUIRE(budget->bytes() == 0);
+  }
+}
+
+TEST_CASE("exhausted memory budget", "[memory_budget]") {
+  TracerConfig config;
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  // A trace segment alone exceeds this.
+  config.memory_budget = 64;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+  REQUIRE(tracer.pressure() == Pressure::NORMAL);
+
+  {
+    auto root = tracer.create_span();
+    REQUIRE(tracer.pressure() == Pressure::HIGH);
+    // Children are not recorded while the budget is exhausted, but they still
+    // propagate the trace.
+    auto child = root.create_child();
+    REQUIRE(!child.recorded());
+    REQUIRE(child.id() != 0);
+  }
+
+  // Sending the trace released its memory.
+  REQUIRE(tracer.pressure() == Pressure::NORMAL);
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 1);
+  REQUIRE(chunk.front()->numeric_tags.at(tags::internal::spans_over_limit) ==
+          1);
+}
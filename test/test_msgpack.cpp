@@ -1,9 +1,18 @@
 #include <datadog/error.h>
+#include <datadog/json.hpp>
 #include <datadog/msgpack.h>
+#include <datadog/span_config.h>
+#include <datadog/span_data.h>
+#include <datadog/span_defaults.h>
+#include <datadog/worker_pool.h>
 
+#include <chrono>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "test.h"
 
@@ -19,6 +28,21 @@ bool operator==(const Error& left, const Error& right) {
 
 using namespace datadog::tracing;
 
+namespace {
+
+// Return the value of the specified `result`, which must not be an error.
+template <typename Value>
+Value value_of(const Expected<Value>& result) {
+  REQUIRE(result);
+  return *result;
+}
+
+// Return zero, meaning that a tag value of any length is kept whole.  For use
+// as the `tag_value_limit` argument of `SpanData::apply_config`.
+std::size_t no_tag_value_limit(StringView) { return 0; }
+
+}  // namespace
+
 TEST_CASE("array element fails to encode") {
   std::string destination;
   const int dummy[] = {42};
@@ -55,6 +79,683 @@ TEST_CASE("map element fails to encode") {
   }
 }
 
+TEST_CASE("encoded span size bound") {
+  auto make_span = [](std::size_t num_tags) {
+    auto span = std::make_unique<SpanData>();
+    span->service = "testsvc";
+    span->service_type = "web";
+    span->name = "do.thing";
+    span->resource = "GET /api/v1/thing";
+    span->span_id = 123;
+    span->trace_id.low = 456;
+    for (std::size_t i = 0; i < num_tags; ++i) {
+      span->tags.emplace("tag." + std::to_string(i), std::string(i, 'x'));
+      span->numeric_tags.emplace("metric." + std::to_string(i), double(i));
+    }
+    return span;
+  };
+
+  SECTION("single span") {
+    const auto num_tags = GENERATE(0, 1, 10, 100);
+    const auto span = make_span(num_tags);
+    std::string destination;
+    ChunkTags chunk_tags;
+    if (GENERATE(false, true)) {
+      chunk_tags.origin = "synthetics";
+      chunk_tags.language = "cpp";
+      chunk_tags.runtime_id = "abcdef";
+      chunk_tags.process_id = 1234;
+    }
+    REQUIRE(msgpack_encode(destination, *span, chunk_tags));
+    REQUIRE(destination.size() <=
+            msgpack_encoded_size_bound(*span, chunk_tags));
+  }
+
+  SECTION("array of spans reserves once") {
+    std::vector<std::unique_ptr<SpanData>> spans;
+    for (std::size_t i = 0; i < 50; ++i) {
+      spans.push_back(make_span(i));
+    }
+    std::string destination;
+    REQUIRE(msgpack_encode(destination, spans, ChunkTags{}));
+    REQUIRE(destination.size() <=
+            msgpack_encoded_size_bound(spans, ChunkTags{}));
+    REQUIRE(destination.capacity() >=
+            msgpack_encoded_size_bound(spans, ChunkTags{}));
+  }
+}
+
+TEST_CASE("chunk tags are encoded into each span") {
+  SpanData span;
+  span.tags.emplace("language", "python");
+  span.tags.emplace("foo", "bar");
+  span.numeric_tags.emplace("process_id", 1.0);
+
+  ChunkTags chunk_tags;
+  chunk_tags.language = "cpp";
+  chunk_tags.runtime_id = "some-runtime-id";
+  chunk_tags.process_id = 42;
+
+  std::string destination;
+  REQUIRE(msgpack_encode(destination, span, chunk_tags));
+  // Chunk tags take precedence over the span's own tags of the same name, and
+  // each name appears only once.
+  REQUIRE(destination.find("python") == std::string::npos);
+  REQUIRE(destination.find("cpp") != std::string::npos);
+  REQUIRE(destination.find("language") == destination.rfind("language"));
+  REQUIRE(destination.find("process_id") == destination.rfind("process_id"));
+  REQUIRE(destination.find("some-runtime-id") != std::string::npos);
+  REQUIRE(destination.find("foo") != std::string::npos);
+  // The span itself is not modified.
+  REQUIRE(span.tags.at("language") == "python");
+  REQUIRE(span.tags.count("runtime-id") == 0);
+
+  apply_chunk_tags(span, chunk_tags);
+  REQUIRE(span.tags.at("language") == "cpp");
+  REQUIRE(span.tags.at("runtime-id") == "some-runtime-id");
+  REQUIRE(span.numeric_tags.at("process_id") == 42);
+  REQUIRE(span.tags.count("_dd.origin") == 0);
+}
+
+TEST_CASE("chunk tags encoded once per chunk") {
+  // An array of spans copies the chunk tags' encoding into each span, which
+  // must be the same as encoding each span on its own.
+  std::vector<std::unique_ptr<SpanData>> spans;
+  for (int i = 0; i < 3; ++i) {
+    auto span = std::make_unique<SpanData>();
+    span->span_id = i + 1;
+    span->tags.emplace("foo", "bar");
+    spans.push_back(std::move(span));
+  }
+  spans[1]->tags.emplace("language", "python");
+  spans[2]->numeric_tags.emplace("process_id", 1.0);
+  spans[2]->numeric_tags.emplace("count", 3.0);
+
+  ChunkTags chunk_tags;
+  chunk_tags.origin = "synthetics";
+  chunk_tags.language = "cpp";
+  chunk_tags.process_id = 42;
+
+  std::string destination;
+  REQUIRE(msgpack_encode(destination, spans, chunk_tags));
+  REQUIRE(destination.size() <= msgpack_encoded_size_bound(spans, chunk_tags));
+  const auto decoded = nlohmann::json::from_msgpack(destination);
+  REQUIRE(decoded.size() == spans.size());
+  for (std::size_t i = 0; i < spans.size(); ++i) {
+    CAPTURE(i);
+    std::string single;
+    REQUIRE(msgpack_encode(single, *spans[i], chunk_tags));
+    REQUIRE(decoded[i] == nlohmann::json::from_msgpack(single));
+    REQUIRE(decoded[i]["meta"] ==
+            nlohmann::json::object({{"foo", "bar"},
+                                    {"_dd.origin", "synthetics"},
+                                    {"language", "cpp"}}));
+    REQUIRE(decoded[i]["metrics"]["process_id"] == 42.0);
+  }
+  REQUIRE(decoded[2]["metrics"]["count"] == 3.0);
+
+  SECTION("different chunk tags on the same thread") {
+    ChunkTags other;
+    other.runtime_id = "some-runtime-id";
+    destination.clear();
+    REQUIRE(msgpack_encode(destination, spans, other));
+    const auto decoded = nlohmann::json::from_msgpack(destination);
+    REQUIRE(decoded[1]["meta"] ==
+            nlohmann::json::object({{"foo", "bar"},
+                                    {"language", "python"},
+                                    {"runtime-id", "some-runtime-id"}}));
+    REQUIRE(decoded[2]["metrics"]["process_id"] == 1.0);
+  }
+}
+
+TEST_CASE("sampling priority is encoded as a numeric tag") {
+  SpanData span;
+  span.numeric_tags.emplace("count", 3.0);
+  span.numeric_tags.emplace("_sampling_priority_v1", -1.0);
+  span.sampling_priority = 2;
+
+  std::string destination;
+  REQUIRE(msgpack_encode(destination, span, ChunkTags{}));
+  REQUIRE(destination.size() <= msgpack_encoded_size_bound(span, ChunkTags{}));
+  // The sampling priority takes precedence over a numeric tag of that name.
+  REQUIRE(nlohmann::json::from_msgpack(destination)["metrics"] ==
+          nlohmann::json::object(
+              {{"count", 3.0}, {"_sampling_priority_v1", 2.0}}));
+
+  // It is decoded into the field rather than into the numeric tags.
+  StringView input = destination;
+  SpanData decoded;
+  REQUIRE(msgpack_decode(input, decoded));
+  REQUIRE(decoded.sampling_priority == 2.0);
+  REQUIRE(decoded.numeric_tags.count("_sampling_priority_v1") == 0);
+
+  // Collectors that are not given the chunk tags find it among the numeric
+  // tags.
+  apply_chunk_tags(span, ChunkTags{});
+  REQUIRE(span.numeric_tags.at("_sampling_priority_v1") == 2.0);
+}
+
+TEST_CASE("inherited tags are encoded into each span") {
+  auto defaults = std::make_shared<SpanDefaults>();
+  defaults->service = "testsvc";
+  defaults->environment = "prod";
+  defaults->version = "1.2.3";
+  defaults->tags = {{"team", "apm"}, {"region", "ceres"}, {"env", "ignored"}};
+
+  SpanConfig config;
+  config.tags = {{"region", "vesta"}};
+  SpanData span;
+  span.apply_config(defaults, config, default_clock, no_tag_value_limit);
+
+  // Only the override is the span's own.
+  REQUIRE(span.tags.size() == 1);
+  REQUIRE(span.tag_count() == 4);
+  REQUIRE(span.lookup_tag("team") == "apm");
+  REQUIRE(span.lookup_tag("region") == "vesta");
+  REQUIRE(span.environment() == "prod");
+  REQUIRE(span.version() == "1.2.3");
+
+  std::string destination;
+  REQUIRE(msgpack_encode(destination, span, ChunkTags{}));
+  REQUIRE(destination.size() <=
+          msgpack_encoded_size_bound(span, ChunkTags{}));
+  REQUIRE(destination.find("apm") != std::string::npos);
+  REQUIRE(destination.find("vesta") != std::string::npos);
+  REQUIRE(destination.find("ceres") == std::string::npos);
+  REQUIRE(destination.find("prod") != std::string::npos);
+  REQUIRE(destination.find("ignored") == std::string::npos);
+  REQUIRE(destination.find("1.2.3") != std::string::npos);
+
+  SECTION("removing an inherited tag hides it") {
+    span.remove_tag("team");
+    REQUIRE(!span.lookup_tag("team"));
+    REQUIRE(span.lookup_tag("region") == "vesta");
+    REQUIRE(span.environment() == "prod");
+    REQUIRE(span.tag_count() == 3);
+  }
+
+  SECTION("removing an own tag does not reveal the inherited tag") {
+    span.remove_tag("region");
+    REQUIRE(!span.lookup_tag("region"));
+    REQUIRE(span.lookup_tag("team") == "apm");
+  }
+}
+
+TEST_CASE("inherited tags encoded in advance") {
+  // Spans that override none of their inherited tags copy the tags' encoding,
+  // which is prepared once per `SpanDefaults`.
+  const auto meta = [](const SpanData& span, const ChunkTags& chunk_tags) {
+    std::string destination;
+    REQUIRE(msgpack_encode(destination, span, chunk_tags));
+    REQUIRE(destination.size() <= msgpack_encoded_size_bound(span, chunk_tags));
+    return nlohmann::json::from_msgpack(destination)["meta"];
+  };
+
+  auto defaults = std::make_shared<SpanDefaults>();
+  defaults->environment = "prod";
+  defaults->version = "1.2.3";
+  defaults->tags = {{"team", "apm"}, {"language", "inherited"}};
+
+  SpanData first;
+  first.apply_config(defaults, SpanConfig{}, default_clock, no_tag_value_limit);
+  SpanConfig config;
+  config.tags = {{"foo", "bar"}};
+  SpanData second;
+  second.apply_config(defaults, config, default_clock, no_tag_value_limit);
+
+  REQUIRE(meta(first, ChunkTags{}) ==
+          nlohmann::json::object({{"env", "prod"},
+                                  {"version", "1.2.3"},
+                                  {"team", "apm"},
+                                  {"language", "inherited"}}));
+  REQUIRE(meta(second, ChunkTags{}) ==
+          nlohmann::json::object({{"env", "prod"},
+                                  {"version", "1.2.3"},
+                                  {"team", "apm"},
+                                  {"language", "inherited"},
+                                  {"foo", "bar"}}));
+
+  SECTION("chunk tags take precedence") {
+    ChunkTags chunk_tags;
+    chunk_tags.language = "cpp";
+    REQUIRE(meta(first, chunk_tags) ==
+            nlohmann::json::object({{"env", "prod"},
+                                    {"version", "1.2.3"},
+                                    {"team", "apm"},
+                                    {"language", "cpp"}}));
+  }
+
+  SECTION("own tags take precedence") {
+    second.tags.emplace("team", "profiling");
+    REQUIRE(meta(second, ChunkTags{})["team"] == "profiling");
+  }
+
+  SECTION("new defaults are encoded anew") {
+    auto updated = std::make_shared<SpanDefaults>(*defaults);
+    updated->version = "1.2.4";
+    updated->tags.erase("language");
+    SpanData third;
+    third.apply_config(updated, SpanConfig{}, default_clock,
+                       no_tag_value_limit);
+    REQUIRE(meta(third, ChunkTags{}) ==
+            nlohmann::json::object(
+                {{"env", "prod"}, {"version", "1.2.4"}, {"team", "apm"}}));
+    REQUIRE(meta(first, ChunkTags{})["version"] == "1.2.3");
+  }
+}
+
+TEST_CASE("static tags are encoded into each span") {
+  auto defaults = std::make_shared<SpanDefaults>();
+  defaults->service = "testsvc";
+  defaults->tags = {{"team", "apm"}, {"component", "inherited"}};
+
+  SpanData span;
+  span.apply_config(defaults, SpanConfig{}, default_clock, no_tag_value_limit);
+  span.static_tags.insert_or_assign(StringView("component"),
+                                    StringView("grpc"));
+  span.static_tags.insert_or_assign(StringView("span.kind"),
+                                    StringView("shadowed"));
+  span.tags.emplace("span.kind", "client");
+
+  // Own tags take precedence over static tags, which take precedence over
+  // inherited tags.
+  REQUIRE(span.tag_count() == 3);
+  REQUIRE(span.lookup_tag("component") == "grpc");
+  REQUIRE(span.lookup_tag("span.kind") == "client");
+  REQUIRE(span.lookup_tag("team") == "apm");
+
+  std::string destination;
+  REQUIRE(msgpack_encode(destination, span, ChunkTags{}));
+  REQUIRE(destination.size() <=
+          msgpack_encoded_size_bound(span, ChunkTags{}));
+  const auto decoded = nlohmann::json::from_msgpack(destination);
+  REQUIRE(decoded["meta"] == nlohmann::json::object({{"component", "grpc"},
+                                                     {"span.kind", "client"},
+                                                     {"team", "apm"}}));
+
+  SECTION("removing a static tag hides the inherited tag") {
+    span.remove_tag("component");
+    REQUIRE(!span.lookup_tag("component"));
+    REQUIRE(span.static_tags.empty());
+    REQUIRE(span.lookup_tag("span.kind") == "client");
+    REQUIRE(span.tag_count() == 2);
+  }
+}
+
+TEST_CASE("compile-time fixstr") {
+  constexpr auto empty = msgpack::fixstr("");
+  static_assert(empty.encoded().size() == 1);
+  REQUIRE(empty.encoded() == "\xA0");
+
+  constexpr auto key = msgpack::fixstr("service");
+  static_assert(key.encoded().size() == 1 + 7);
+  REQUIRE(key.encoded() == "\xA7service");
+
+  std::string destination;
+  msgpack::pack_fixed(destination, key);
+  REQUIRE(destination == key.encoded());
+
+  SECTION("as map keys") {
+    std::string destination;
+    const auto pack_one = [](std::string& destination) {
+      msgpack::pack_integer(destination, std::int64_t(1));
+      return Expected<void>{};
+    };
+    REQUIRE(msgpack::pack_map(destination, msgpack::fixstr("a"), pack_one,
+                              "b", pack_one));
+
+    std::string expected;
+    REQUIRE(msgpack::pack_map(expected, 2));
+    expected += "\xA1"
+                "a";
+    msgpack::pack_integer(expected, std::int64_t(1));
+    REQUIRE(msgpack::pack_string(expected, "b"));
+    msgpack::pack_integer(expected, std::int64_t(1));
+    REQUIRE(destination == expected);
+  }
+}
+
+TEST_CASE("values are encoded in the narrowest format") {
+  std::string destination;
+
+  SECTION("unsigned integers") {
+    struct TestCase {
+      std::uint64_t value;
+      std::string expected;
+    };
+
+    const auto [value, expected] = GENERATE(values<TestCase>(
+        {{0, std::string(1, '\0')},
+         {0x7F, "\x7F"},
+         {0x80, "\xCC\x80"},
+         {0xFF, "\xCC\xFF"},
+         {0x100, std::string("\xCD\x01\x00", 3)},
+         {0x10000, std::string("\xCE\x00\x01\x00\x00", 5)},
+         {0x100000000,
+          std::string("\xCF\x00\x00\x00\x01\x00\x00\x00\x00", 9)}}));
+    CAPTURE(value);
+    msgpack::pack_integer(destination, value);
+    REQUIRE(destination == expected);
+  }
+
+  SECTION("signed integers") {
+    struct TestCase {
+      std::int64_t value;
+      std::string expected;
+    };
+
+    const auto [value, expected] = GENERATE(values<TestCase>(
+        {{5, "\x05"},
+         {-1, "\xFF"},
+         {-32, "\xE0"},
+         {-33, "\xD0\xDF"},
+         {-129, "\xD1\xFF\x7F"},
+         {-32769, "\xD2\xFF\xFF\x7F\xFF"},
+         {std::numeric_limits<std::int64_t>::min(),
+          std::string("\xD3\x80\x00\x00\x00\x00\x00\x00\x00", 9)}}));
+    CAPTURE(value);
+    msgpack::pack_integer(destination, value);
+    REQUIRE(destination == expected);
+  }
+
+  SECTION("strings") {
+    struct TestCase {
+      std::size_t length;
+      std::string prefix;
+    };
+
+    const auto [length, prefix] = GENERATE(values<TestCase>(
+        {{0, "\xA0"},
+         {31, "\xBF"},
+         {32, "\xD9\x20"},
+         {255, "\xD9\xFF"},
+         {256, std::string("\xDA\x01\x00", 3)},
+         {0x10000, std::string("\xDB\x00\x01\x00\x00", 5)}}));
+    CAPTURE(length);
+    const std::string value(length, 'x');
+    REQUIRE(msgpack::pack_string(destination, value));
+    REQUIRE(destination == prefix + value);
+  }
+
+  SECTION("arrays and maps") {
+    REQUIRE(msgpack::pack_array(destination, 15));
+    REQUIRE(msgpack::pack_array(destination, 16));
+    REQUIRE(msgpack::pack_array(destination, 0x10000));
+    REQUIRE(msgpack::pack_map(destination, 15));
+    REQUIRE(msgpack::pack_map(destination, 16));
+    REQUIRE(msgpack::pack_map(destination, 0x10000));
+    REQUIRE(destination == std::string("\x9F"
+                                       "\xDC\x00\x10"
+                                       "\xDD\x00\x01\x00\x00"
+                                       "\x8F"
+                                       "\xDE\x00\x10"
+                                       "\xDF\x00\x01\x00\x00",
+                                       18));
+  }
+}
+
+TEST_CASE("encoded span decodes to the span's fields") {
+  SpanData span;
+  span.service = "testsvc";
+  span.name = "do.thing";
+  span.resource = std::string(300, 'r');
+  span.span_id = 123;
+  span.parent_id = 0;
+  span.trace_id.low = 0xFFFFFFFFFFFFFFFF;
+  span.error = true;
+  span.tags.emplace("foo", "bar");
+  span.numeric_tags.emplace("count", -7);
+
+  std::string destination;
+  REQUIRE(msgpack_encode(destination, span, ChunkTags{}));
+  const auto decoded = nlohmann::json::from_msgpack(destination);
+  REQUIRE(decoded.at("service") == "testsvc");
+  REQUIRE(decoded.at("name") == "do.thing");
+  REQUIRE(decoded.at("resource") == span.resource);
+  REQUIRE(decoded.at("span_id") == 123);
+  REQUIRE(decoded.at("parent_id") == 0);
+  REQUIRE(decoded.at("trace_id") == span.trace_id.low);
+  REQUIRE(decoded.at("error") == 1);
+  REQUIRE(decoded.at("meta").at("foo") == "bar");
+  REQUIRE(decoded.at("metrics").at("count") == -7.0);
+}
+
+TEST_CASE("values decode from each format") {
+  std::string encoded;
+
+  SECTION("integers") {
+    const auto value = GENERATE(
+        std::int64_t(0), std::int64_t(0x7F), std::int64_t(0x80),
+        std::int64_t(0x10000), std::int64_t(0x100000000), std::int64_t(-1),
+        std::int64_t(-33), std::int64_t(-32769),
+        std::numeric_limits<std::int64_t>::min(),
+        std::numeric_limits<std::int64_t>::max());
+    CAPTURE(value);
+    msgpack::pack_integer(encoded, value);
+    StringView input = encoded;
+    const auto decoded = msgpack::unpack_integer(input);
+    REQUIRE(decoded);
+    REQUIRE(*decoded == value);
+    REQUIRE(input.empty());
+    input = encoded;
+    REQUIRE(bool(msgpack::unpack_unsigned(input)) == (value >= 0));
+    input = encoded;
+    REQUIRE(value_of(msgpack::unpack_double(input)) == double(value));
+  }
+
+  SECTION("unsigned integers beyond the signed range") {
+    msgpack::pack_integer(encoded, std::numeric_limits<std::uint64_t>::max());
+    StringView input = encoded;
+    REQUIRE(value_of(msgpack::unpack_unsigned(input)) ==
+            std::numeric_limits<std::uint64_t>::max());
+    input = encoded;
+    const auto result = msgpack::unpack_integer(input);
+    REQUIRE_FALSE(result);
+    REQUIRE(result.error().code == Error::MESSAGEPACK_DECODE_FAILURE);
+  }
+
+  SECTION("strings") {
+    const auto length = GENERATE(0, 31, 32, 256, 0x10000);
+    CAPTURE(length);
+    const std::string value(length, 'x');
+    REQUIRE(msgpack::pack_string(encoded, value));
+    StringView input = encoded;
+    REQUIRE(value_of(msgpack::unpack_string(input)) == StringView(value));
+    REQUIRE(input.empty());
+  }
+
+  SECTION("arrays, maps, doubles, and booleans") {
+    REQUIRE(msgpack::pack_array(encoded, 0x10000));
+    REQUIRE(msgpack::pack_map(encoded, 16));
+    msgpack::pack_double(encoded, -2.5);
+    msgpack::pack_bool(encoded, true);
+    StringView input = encoded;
+    REQUIRE(value_of(msgpack::unpack_array(input)) == std::size_t(0x10000));
+    REQUIRE(value_of(msgpack::unpack_map(input)) == std::size_t(16));
+    REQUIRE(value_of(msgpack::unpack_double(input)) == -2.5);
+    REQUIRE(value_of(msgpack::unpack_bool(input)) == true);
+    REQUIRE(input.empty());
+  }
+}
+
+TEST_CASE("invalid input does not decode") {
+  SECTION("wrong type") {
+    std::string encoded;
+    REQUIRE(msgpack::pack_string(encoded, "foo"));
+    StringView input = encoded;
+    const auto result = msgpack::unpack_integer(input);
+    REQUIRE_FALSE(result);
+    REQUIRE(result.error().code == Error::MESSAGEPACK_DECODE_FAILURE);
+  }
+
+  SECTION("truncated") {
+    std::string encoded;
+    REQUIRE(msgpack::pack_string(encoded, std::string(100, 'x')));
+    msgpack::pack_integer(encoded, std::uint64_t(1) << 40);
+    const auto size = GENERATE(0, 1, 50, 103);
+    CAPTURE(size);
+    StringView input = StringView(encoded).substr(0, size);
+    Expected<void> result = msgpack::skip(input);
+    if (result) {
+      result = msgpack::skip(input);
+    }
+    REQUIRE_FALSE(result);
+    REQUIRE(result.error().code == Error::MESSAGEPACK_DECODE_FAILURE);
+  }
+
+  SECTION("an array that claims more elements than there are") {
+    std::string encoded;
+    REQUIRE(msgpack::pack_array(encoded, 0xFFFFFFFF));
+    StringView input = encoded;
+    REQUIRE_FALSE(msgpack::skip(input));
+    input = encoded;
+    REQUIRE_FALSE(msgpack_decode_spans(input));
+  }
+}
+
+TEST_CASE("skip passes over any value") {
+  std::string encoded;
+  // A map containing nested arrays, binary data, and every scalar type,
+  // followed by a marker.
+  REQUIRE(msgpack::pack_map(encoded, 3));
+  REQUIRE(msgpack::pack_string(encoded, "nested"));
+  REQUIRE(msgpack::pack_array(encoded, 2));
+  REQUIRE(msgpack::pack_array(encoded, 1));
+  msgpack::pack_bool(encoded, false);
+  REQUIRE(msgpack::pack_binary(encoded, "bytes"));
+  REQUIRE(msgpack::pack_string(encoded, "number"));
+  msgpack::pack_double(encoded, 1.5);
+  REQUIRE(msgpack::pack_string(encoded, "nil"));
+  encoded += std::string("\xC0", 1);
+  REQUIRE(msgpack::pack_string(encoded, "marker"));
+
+  StringView input = encoded;
+  REQUIRE(msgpack::skip(input));
+  REQUIRE(value_of(msgpack::unpack_string(input)) == StringView("marker"));
+  REQUIRE(input.empty());
+}
+
+TEST_CASE("encoded spans decode to equivalent spans") {
+  std::vector<std::unique_ptr<SpanData>> spans;
+  for (int i = 0; i < 3; ++i) {
+    auto span = std::make_unique<SpanData>();
+    span->service = "testsvc";
+    span->service_type = "web";
+    span->name = "do.thing";
+    span->resource = std::string(40 * i, 'r');
+    span->span_id = 100 + i;
+    span->parent_id = i == 0 ? 0 : 100;
+    span->trace_id.low = 0xFFFFFFFFFFFFFFFF;
+    span->trace_id.high = 0xABCD;
+    span->start.wall = std::chrono::system_clock::time_point(
+        std::chrono::seconds(1700000000 + i));
+    span->duration = std::chrono::milliseconds(10 * i);
+    span->error = i == 2;
+    span->tags.emplace("foo", "bar");
+    span->tags.emplace("_dd.p.tid", "000000000000abcd");
+    span->numeric_tags.emplace("count", -7 * i);
+    spans.push_back(std::move(span));
+  }
+  ChunkTags chunk_tags;
+  chunk_tags.language = "cpp";
+
+  std::string encoded;
+  REQUIRE(msgpack_encode(encoded, spans, chunk_tags));
+  // A field that this library does not write is skipped.
+  std::string unknown_field;
+  REQUIRE(msgpack::pack_string(unknown_field, "meta_struct"));
+  REQUIRE(msgpack::pack_map(unknown_field, 1));
+  REQUIRE(msgpack::pack_string(unknown_field, "key"));
+  REQUIRE(msgpack::pack_binary(unknown_field, "value"));
+
+  StringView input = encoded;
+  auto decoded = msgpack_decode_spans(input);
+  REQUIRE(decoded);
+  REQUIRE(input.empty());
+  REQUIRE(decoded->size() == spans.size());
+  for (std::size_t i = 0; i < spans.size(); ++i) {
+    const SpanData& expected = *spans[i];
+    const SpanData& actual = *(*decoded)[i];
+    REQUIRE(actual.service == expected.service);
+    REQUIRE(actual.service_type == expected.service_type);
+    REQUIRE(actual.name == expected.name);
+    REQUIRE(actual.resource == expected.resource);
+    REQUIRE(actual.span_id == expected.span_id);
+    REQUIRE(actual.parent_id == expected.parent_id);
+    REQUIRE(actual.trace_id == expected.trace_id);
+    REQUIRE(actual.start.wall == expected.start.wall);
+    REQUIRE(actual.duration == expected.duration);
+    REQUIRE(actual.error == expected.error);
+    REQUIRE(actual.tags.at("foo") == "bar");
+    REQUIRE(actual.tags.at("language") == "cpp");
+    REQUIRE(actual.numeric_tags.at("count") ==
+            expected.numeric_tags.at("count"));
+  }
+
+  SECTION("unknown fields are skipped") {
+    // Insert the field into the first span's map, incrementing the map's
+    // size, which is encoded in the "fixmap" header after the array header.
+    std::string modified = encoded;
+    const std::size_t map_header = 1;
+    REQUIRE((std::uint8_t(modified[map_header]) & 0xF0) == 0x80);
+    ++modified[map_header];
+    modified.insert(map_header + 1, unknown_field);
+    input = modified;
+    decoded = msgpack_decode_spans(input);
+    REQUIRE(decoded);
+    REQUIRE(decoded->size() == spans.size());
+    REQUIRE((*decoded)[0]->span_id == spans[0]->span_id);
+  }
+}
+
+TEST_CASE("spans encoded in parallel are encoded as in series") {
+  std::vector<std::unique_ptr<SpanData>> spans;
+  for (int i = 0; i < 1000; ++i) {
+    auto span = std::make_unique<SpanData>();
+    span->service = "testsvc";
+    span->name = "do.thing";
+    span->resource = std::string(i % 50, 'r');
+    span->span_id = 100 + i;
+    span->parent_id = i == 0 ? 0 : 100;
+    span->sampling_priority = i == 0 ? Optional<double>(2) : nullopt;
+    span->tags.emplace("env", i % 2 ? "prod" : "dev");
+    span->numeric_tags.emplace("count", i);
+    spans.push_back(std::move(span));
+  }
+  ChunkTags chunk_tags;
+  chunk_tags.language = "cpp";
+  chunk_tags.process_id = 1234;
+  const PayloadTags payload_tags{"prod", ""};
+
+  WorkerPool workers{3, 100, nullptr};
+  REQUIRE(workers.ranges(spans.size()) == 4);
+  // Too few spans to divide.
+  REQUIRE(workers.ranges(99) == 1);
+
+  SECTION("v0.4") {
+    std::string serial;
+    std::string parallel;
+    REQUIRE(msgpack_encode(serial, spans, chunk_tags));
+    REQUIRE(msgpack_encode(parallel, spans, chunk_tags, &workers));
+    REQUIRE(parallel == serial);
+  }
+
+  SECTION("v0.7") {
+    std::string serial;
+    std::string parallel;
+    REQUIRE(msgpack_encode_v07(serial, spans, chunk_tags, payload_tags));
+    REQUIRE(msgpack_encode_v07(parallel, spans, chunk_tags, payload_tags,
+                               &workers));
+    REQUIRE(parallel == serial);
+  }
+}
+
+TEST_CASE("overwrite array header") {
+  std::string destination(msgpack::fixed_array_header_size, '\0');
+  REQUIRE(msgpack::overwrite_array_header(destination.data(), 0x01020304));
+  REQUIRE(destination == "\xDD\x01\x02\x03\x04");
+}
+
 // The following group of tests verify that encoding routines return an error
 // if the size of their input cannot fit in 32 bits.
 // This is impossible to do on a 32-bit system, so these tests are excluded by
@@ -2,9 +2,13 @@
 #include <datadog/parse_util.h>
 
 #include <cassert>
+#include <charconv>
+#include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <random>
 #include <string>
+#include <system_error>
 #include <variant>
 
 #include "test.h"
@@ -115,6 +119,16 @@ PARSE_UTIL_TEST("parse_uint64") {
       {__LINE__, "negative (hex)", "-a", 16, Error::INVALID_INTEGER},
       {__LINE__, "lower case", "a", 16, UINT64_C(10)},
       {__LINE__, "upper case", "A", 16, UINT64_C(10)},
+      {__LINE__, "16 hex digits", "00f067aa0ba902b7", 16, UINT64_C(0x00f067aa0ba902b7)},
+      {__LINE__, "16 hex digits (upper case)", "00F067AA0BA902B7", 16, UINT64_C(0x00f067aa0ba902b7)},
+      {__LINE__, "16 hex digits (max)", "ffffffffffffffff", 16, std::numeric_limits<std::uint64_t>::max()},
+      {__LINE__, "16 characters, not all hex", "00f067aa0ba902g7", 16, Error::INVALID_INTEGER},
+      {__LINE__, "16 characters, leading sign", "-0f067aa0ba902b7", 16, Error::INVALID_INTEGER},
+      {__LINE__, "17 hex digits", "100f067aa0ba902b7", 16, Error::OUT_OF_RANGE_INTEGER},
+      {__LINE__, "19 decimal digits", "9999999999999999999", 10, UINT64_C(9999999999999999999)},
+      {__LINE__, "19 characters, not all decimal", "999999999999999999a", 10, Error::INVALID_INTEGER},
+      {__LINE__, "20 decimal digits (max)", std::to_string(std::numeric_limits<std::uint64_t>::max()), 10, std::numeric_limits<std::uint64_t>::max()},
+      {__LINE__, "20 decimal digits (overflow)", "18446744073709551616", 10, Error::OUT_OF_RANGE_INTEGER},
   }));
   // clang-format on
 
@@ -136,6 +150,45 @@ PARSE_UTIL_TEST("parse_uint64") {
   }
 }
 
+PARSE_UTIL_TEST("parse_uint64 agrees with std::from_chars") {
+  // `parse_uint64` has fast paths for short decimal and 16 digit hexadecimal
+  // input.  Compare it with `std::from_chars` on random input of those shapes.
+  std::mt19937_64 generator{42};
+  const std::string alphabet = "0123456789abcdefABCDEFxyz -+\n";
+  std::uniform_int_distribution<std::size_t> pick_char(0, alphabet.size() - 1);
+  std::uniform_int_distribution<std::size_t> pick_size(0, 21);
+  // Mostly choose valid digits, so that most inputs parse.
+  std::uniform_int_distribution<int> pick_valid(0, 31);
+
+  for (int i = 0; i < 100000; ++i) {
+    const int base = i % 2 ? 16 : 10;
+    const std::size_t size =
+        base == 16 && i % 4 == 1 ? 16 : pick_size(generator);
+    std::string input;
+    for (std::size_t j = 0; j < size; ++j) {
+      if (pick_valid(generator)) {
+        input += alphabet[pick_char(generator) % std::size_t(base)];
+      } else {
+        input += alphabet[pick_char(generator)];
+      }
+    }
+    CAPTURE(input);
+    CAPTURE(base);
+
+    std::uint64_t expected;
+    const auto status = std::from_chars(
+        input.data(), input.data() + input.size(), expected, base);
+    const bool expect_success = status.ec == std::errc() &&
+                                status.ptr == input.data() + input.size();
+
+    const auto result = parse_uint64(input, base);
+    REQUIRE(bool(result) == expect_success);
+    if (result) {
+      REQUIRE(*result == expected);
+    }
+  }
+}
+
 PARSE_UTIL_TEST("parse_tags") {
   struct TestCase {
     int line;
@@ -0,0 +1,105 @@
+// These are tests for `ReactorEventScheduler`, which runs events on an
+// application-provided `Reactor`.
+
+#include <datadog/reactor_event_scheduler.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include "mocks/reactors.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+using namespace std::chrono_literals;
+
+TEST_CASE("ReactorEventScheduler recurring events") {
+  const auto reactor = std::make_shared<ManualReactor>();
+  ReactorEventScheduler scheduler{reactor};
+  int count = 0;
+  const auto before = std::chrono::steady_clock::now();
+  auto cancel = scheduler.schedule_recurring_event(10s, [&]() { ++count; });
+
+  REQUIRE(reactor->num_timers() == 1);
+  // Nothing is due before the interval elapses.
+  REQUIRE(reactor->run_timers(before) == 0);
+  REQUIRE(count == 0);
+
+  SECTION("run at each interval") {
+    REQUIRE(reactor->run_timers(before + 11s) == 1);
+    REQUIRE(count == 1);
+    // The event set another timer for its next invocation.
+    REQUIRE(reactor->num_timers() == 1);
+    REQUIRE(reactor->run_timers(before + 21s) == 1);
+    REQUIRE(count == 2);
+  }
+
+  SECTION("stop when cancelled") {
+    cancel();
+    REQUIRE(reactor->num_timers() == 0);
+    REQUIRE(reactor->run_timers(before + 11s) == 0);
+    REQUIRE(count == 0);
+    // Cancelling again does nothing.
+    cancel();
+  }
+
+  SECTION("stop when the scheduler is destroyed") {
+    auto other = std::make_unique<ReactorEventScheduler>(reactor);
+    other->schedule_recurring_event(1s, [&]() { ++count; });
+    REQUIRE(reactor->num_timers() == 2);
+    other.reset();
+    REQUIRE(reactor->num_timers() == 1);
+  }
+}
+
+TEST_CASE("ReactorEventScheduler one-off events are posted") {
+  const auto reactor = std::make_shared<ManualReactor>();
+  ReactorEventScheduler scheduler{reactor};
+  int count = 0;
+  REQUIRE(scheduler.schedule_event([&]() { ++count; }));
+  REQUIRE(count == 0);
+  REQUIRE(reactor->run_posted() == 1);
+  REQUIRE(count == 1);
+}
+
+TEST_CASE("ReactorEventScheduler cancellation of a running callback") {
+  const auto reactor = std::make_shared<ManualReactor>();
+  ReactorEventScheduler scheduler{reactor};
+  std::atomic<bool> started{false};
+  std::atomic<bool> release{false};
+
+  SECTION("from another thread waits for the callback") {
+    auto cancel = scheduler.schedule_recurring_event_async_cancel(1ms, [&]() {
+      started = true;
+      while (!release) {
+        std::this_thread::sleep_for(1ms);
+      }
+    });
+    std::thread reactor_thread{[&]() {
+      reactor->run_timers(std::chrono::steady_clock::now() + 1s);
+    }};
+    while (!started) {
+      std::this_thread::sleep_for(1ms);
+    }
+    auto done = cancel();
+    REQUIRE(done.wait_for(0s) == std::future_status::timeout);
+    release = true;
+    done.wait();
+    reactor_thread.join();
+    // The cancelled event did not set another timer.
+    REQUIRE(reactor->num_timers() == 0);
+  }
+
+  SECTION("from within the callback does not wait") {
+    EventScheduler::Cancel cancel;
+    int count = 0;
+    cancel = scheduler.schedule_recurring_event(1ms, [&]() {
+      ++count;
+      cancel();
+    });
+    REQUIRE(reactor->run_timers(std::chrono::steady_clock::now() + 1s) == 1);
+    REQUIRE(count == 1);
+    REQUIRE(reactor->num_timers() == 0);
+  }
+}
@@ -0,0 +1,130 @@
+// These are tests for `RuleIndex`, which finds the first sampling rule that
+// matches a span.  The index must always agree with a linear scan of the
+// rules.
+
+#include <datadog/compiled_span_matcher.h>
+#include <datadog/rule_index.h>
+#include <datadog/span_data.h>
+#include <datadog/span_matcher.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+SpanMatcher matcher(std::string service, std::string name,
+                    std::string resource = "*") {
+  SpanMatcher result;
+  result.service = std::move(service);
+  result.name = std::move(name);
+  result.resource = std::move(resource);
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("RuleIndex agrees with a linear scan", "[rule_index]") {
+  const std::vector<SpanMatcher> patterns{
+      matcher("checkout", "*", "GET /cart"),
+      matcher("*", "http.request", "POST *"),
+      matcher("check*", "*"),
+      matcher("Checkout", "db.query"),
+      matcher("*", "HTTP.REQUEST"),
+      matcher("payments", "*"),
+      matcher("*out", "*"),
+      matcher("p?yments", "*"),
+      matcher("checkout", "*"),
+      matcher("*", "*"),
+  };
+  REQUIRE(patterns.size() >= RuleIndex::min_indexed_rules);
+
+  // Matchers are referred to by the index, so don't let them move.
+  std::vector<CompiledSpanMatcher> compiled;
+  compiled.reserve(patterns.size());
+  for (const auto& pattern : patterns) {
+    compiled.emplace_back(pattern);
+  }
+  const RuleIndex index{compiled, [](const CompiledSpanMatcher& matcher)
+                                      -> const CompiledSpanMatcher& {
+                          return matcher;
+                        }};
+
+  struct TestCase {
+    std::string service;
+    std::string name;
+    std::string resource;
+    std::size_t expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"checkout", "web.request", "GET /cart", 0},
+      {"CHECKOUT", "web.request", "GET /cart", 0},
+      {"billing", "http.request", "POST /charge", 1},
+      {"checkers", "db.query", "SELECT", 2},
+      {"checkout", "db.query", "SELECT", 2},
+      {"billing", "http.request", "GET /charge", 4},
+      {"payments", "db.query", "SELECT", 5},
+      {"layout", "render", "home", 6},
+      {"pAyments", "render", "home", 5},
+      {"pbyments", "render", "home", 7},
+      {"billing", "render", "home", 9},
+  }));
+
+  SpanData span;
+  span.service = test_case.service;
+  span.name = test_case.name;
+  span.resource = test_case.resource;
+
+  CAPTURE(test_case.service);
+  CAPTURE(test_case.name);
+  CAPTURE(test_case.resource);
+
+  std::size_t linear = 0;
+  while (linear < compiled.size() && !compiled[linear].match(span)) {
+    ++linear;
+  }
+  REQUIRE(linear == test_case.expected);
+
+  std::size_t num_evaluated = 0;
+  const auto found = index.find_first(span, [&](std::size_t i) {
+    ++num_evaluated;
+    return compiled[i].match(span);
+  });
+  REQUIRE(found == test_case.expected);
+  REQUIRE(num_evaluated <= found + 1);
+}
+
+TEST_CASE("RuleIndex evaluates only candidate rules", "[rule_index]") {
+  std::vector<CompiledSpanMatcher> compiled;
+  compiled.reserve(100);
+  for (int i = 0; i < 100; ++i) {
+    compiled.emplace_back(matcher("service" + std::to_string(i), "*"));
+  }
+  const RuleIndex index{compiled, [](const CompiledSpanMatcher& matcher)
+                                      -> const CompiledSpanMatcher& {
+                          return matcher;
+                        }};
+
+  SpanData span;
+  span.service = "service42";
+  std::size_t num_evaluated = 0;
+  const auto found = index.find_first(span, [&](std::size_t i) {
+    ++num_evaluated;
+    return compiled[i].match(span);
+  });
+  REQUIRE(found == 42);
+  REQUIRE(num_evaluated == 1);
+
+  span.service = "unknown";
+  num_evaluated = 0;
+  REQUIRE(index.find_first(span, [&](std::size_t i) {
+    ++num_evaluated;
+    return compiled[i].match(span);
+  }) == compiled.size());
+  REQUIRE(num_evaluated == 0);
+}
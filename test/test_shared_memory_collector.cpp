@@ -0,0 +1,242 @@
+// These are tests for `SharedMemoryCollector`, which writes trace chunks into
+// a ring buffer in a shared file.  Each test reads the ring as the sidecar
+// would, through a mapping of its own.
+
+#include <datadog/error.h>
+#include <datadog/shared_memory_collector.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <datadog/json.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mocks/loggers.h"
+#include "span_data.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `Reader` maps the ring's file and consumes its records, following the
+// layout documented in `shared_memory_collector.h`.
+class Reader {
+  void* mapping_;
+  std::size_t size_;
+
+  char* at(std::size_t offset) const {
+    return static_cast<char*>(mapping_) + offset;
+  }
+  template <typename Integer>
+  Integer get(std::size_t offset) const {
+    Integer value;
+    std::memcpy(&value, at(offset), sizeof value);
+    return value;
+  }
+
+ public:
+  explicit Reader(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDWR);
+    REQUIRE(fd != -1);
+    struct stat status;
+    REQUIRE(::fstat(fd, &status) == 0);
+    size_ = std::size_t(status.st_size);
+    mapping_ =
+        ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    REQUIRE(mapping_ != MAP_FAILED);
+  }
+  ~Reader() { ::munmap(mapping_, size_); }
+
+  std::uint64_t capacity() const { return get<std::uint64_t>(8); }
+  std::uint32_t doorbell() const { return get<std::uint32_t>(192); }
+  std::uint64_t write_position() const {
+    return reinterpret_cast<std::atomic<std::uint64_t>*>(at(64))->load();
+  }
+  std::atomic<std::uint64_t>& read_position() const {
+    return *reinterpret_cast<std::atomic<std::uint64_t>*>(at(128));
+  }
+
+  // Consume every record available and return the decoded trace chunks.
+  // Set `padded` if a padding record was consumed.
+  std::vector<nlohmann::json> read_chunks(bool* padded = nullptr) {
+    std::vector<nlohmann::json> chunks;
+    const std::uint64_t end = write_position();
+    std::uint64_t read = read_position().load();
+    while (read != end) {
+      const std::size_t offset = 4096 + (read & (capacity() - 1));
+      const auto size = get<std::uint32_t>(offset);
+      const auto type = get<std::uint32_t>(offset + 4);
+      if (type == 0) {
+        if (padded) {
+          *padded = true;
+        }
+      } else {
+        REQUIRE(type == 1);
+        const auto* begin = reinterpret_cast<std::uint8_t*>(at(offset + 8));
+        chunks.push_back(nlohmann::json::from_msgpack(begin, begin + size));
+      }
+      read += (8 + size + 7) & ~std::uint64_t(7);
+    }
+    read_position().store(read);
+    return chunks;
+  }
+};
+
+// Return the path of a file that does not exist.  The file is removed when
+// the returned object is destroyed.
+struct TemporaryPath {
+  std::string path;
+
+  TemporaryPath()
+      : path("/tmp/dd-trace-cpp-ring-" + std::to_string(::getpid()) + "-" +
+             std::to_string(reinterpret_cast<std::uintptr_t>(this))) {
+    ::unlink(path.c_str());
+  }
+  ~TemporaryPath() { ::unlink(path.c_str()); }
+};
+
+std::vector<std::unique_ptr<SpanData>> make_chunk(const std::string& name,
+                                                  std::size_t tag_size = 0) {
+  std::vector<std::unique_ptr<SpanData>> spans;
+  auto span = std::make_unique<SpanData>();
+  span->service = "testsvc";
+  span->name = name;
+  if (tag_size) {
+    span->tags["filler"] = std::string(tag_size, 'x');
+  }
+  spans.push_back(std::move(span));
+  return spans;
+}
+
+}  // namespace
+
+TEST_CASE("SharedMemoryCollector", "[shared_memory_collector]") {
+  const TemporaryPath file;
+  const auto logger = std::make_shared<MockLogger>();
+  SharedMemoryCollectorConfig config;
+  config.path = file.path;
+  config.capacity = 64 * 1024;
+
+  SECTION("trace chunks are written as MessagePack records") {
+    auto collector = SharedMemoryCollector::create(config, logger);
+    REQUIRE(collector);
+    Reader reader{file.path};
+    REQUIRE(reader.capacity() == 64 * 1024);
+
+    ChunkTags chunk_tags;
+    chunk_tags.origin = "synthetics";
+    REQUIRE((*collector)->send(make_chunk("first"), chunk_tags, nullptr));
+    REQUIRE((*collector)->send(make_chunk("second"), nullptr));
+    REQUIRE(reader.doorbell() == 2);
+
+    const auto chunks = reader.read_chunks();
+    REQUIRE(chunks.size() == 2);
+    REQUIRE(chunks[0].size() == 1);
+    REQUIRE(chunks[0][0]["name"] == "first");
+    REQUIRE(chunks[0][0]["meta"]["_dd.origin"] == "synthetics");
+    REQUIRE(chunks[1][0]["name"] == "second");
+    REQUIRE(logger->error_count() == 0);
+
+    const auto config_json = nlohmann::json::parse((*collector)->config());
+    REQUIRE(config_json["type"] == "datadog::tracing::SharedMemoryCollector");
+    REQUIRE(config_json["config"]["path"] == file.path);
+  }
+
+  SECTION("records wrap around the end of the ring") {
+    auto collector = SharedMemoryCollector::create(config, logger);
+    REQUIRE(collector);
+    Reader reader{file.path};
+    bool padded = false;
+    int received = 0;
+    for (int i = 0; i < 100; ++i) {
+      REQUIRE((*collector)->send(make_chunk(std::to_string(i), 5000), nullptr));
+      for (const auto& chunk : reader.read_chunks(&padded)) {
+        REQUIRE(chunk[0]["name"] == std::to_string(received));
+        ++received;
+      }
+    }
+    REQUIRE(received == 100);
+    REQUIRE(padded);
+    REQUIRE(reader.write_position() > reader.capacity());
+    REQUIRE(logger->error_count() == 0);
+  }
+
+  SECTION("chunks are dropped while the ring is full") {
+    auto collector = SharedMemoryCollector::create(config, logger);
+    REQUIRE(collector);
+    Reader reader{file.path};
+    for (int i = 0; i < 20; ++i) {
+      REQUIRE((*collector)->send(make_chunk(std::to_string(i), 5000), nullptr));
+    }
+    // Dropping is logged once when it begins.
+    REQUIRE(logger->error_count() == 1);
+    const auto chunks = reader.read_chunks();
+    REQUIRE(chunks.size() > 0);
+    REQUIRE(chunks.size() < 20);
+    REQUIRE(chunks.back()[0]["name"] == std::to_string(chunks.size() - 1));
+
+    // ...and once when it ends.
+    REQUIRE((*collector)->send(make_chunk("after"), nullptr));
+    REQUIRE(logger->error_count() == 2);
+    const auto after = reader.read_chunks();
+    REQUIRE(after.size() == 1);
+    REQUIRE(after[0][0]["name"] == "after");
+  }
+
+  SECTION("a chunk larger than the ring is an error") {
+    auto collector = SharedMemoryCollector::create(config, logger);
+    REQUIRE(collector);
+    auto result = (*collector)->send(make_chunk("big", 100 * 1024), nullptr);
+    REQUIRE(!result);
+    REQUIRE(result.error().code ==
+            Error::SHARED_MEMORY_COLLECTOR_CHUNK_TOO_LARGE);
+  }
+
+  SECTION("an existing ring is reused") {
+    {
+      auto collector = SharedMemoryCollector::create(config, logger);
+      REQUIRE(collector);
+      REQUIRE((*collector)->send(make_chunk("before"), nullptr));
+    }
+    config.capacity = 1024 * 1024;
+    auto collector = SharedMemoryCollector::create(config, logger);
+    REQUIRE(collector);
+    REQUIRE((*collector)->send(make_chunk("after"), nullptr));
+    Reader reader{file.path};
+    REQUIRE(reader.capacity() == 64 * 1024);
+    const auto chunks = reader.read_chunks();
+    REQUIRE(chunks.size() == 2);
+    REQUIRE(chunks[0][0]["name"] == "before");
+    REQUIRE(chunks[1][0]["name"] == "after");
+  }
+
+  SECTION("invalid configurations and files are rejected") {
+    SECTION("capacity not a power of two") {
+      config.capacity = 100 * 1000;
+    }
+    SECTION("capacity too small") { config.capacity = 4096; }
+    SECTION("file is not a ring") {
+      const int fd = ::open(file.path.c_str(), O_RDWR | O_CREAT, 0600);
+      REQUIRE(fd != -1);
+      const std::string junk(8192, 'j');
+      REQUIRE(::write(fd, junk.data(), junk.size()) == ssize_t(junk.size()));
+      ::close(fd);
+    }
+    SECTION("file cannot be created") {
+      config.path = "/nonexistent-directory/ring";
+    }
+
+    auto collector = SharedMemoryCollector::create(config, logger);
+    REQUIRE(!collector);
+    REQUIRE(collector.error().code ==
+            Error::SHARED_MEMORY_COLLECTOR_SETUP_FAILED);
+  }
+}
@@ -0,0 +1,394 @@
+// These are tests for `SocketHTTPClient`, the built-in HTTP client.  Each test
+// runs a small HTTP server on a Unix domain socket.
+
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <datadog/error.h>
+#include <datadog/optional.h>
+#include <datadog/socket_http_client.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+struct ReceivedRequest {
+  std::string head;
+  std::string body;
+};
+
+// `ServerConnection` is the server's end of a connection from the client.
+class ServerConnection {
+  int fd_;
+  std::string buffer_;
+
+ public:
+  explicit ServerConnection(int fd) : fd_(fd) {}
+
+  // Return the next request received, or `nullopt` if the client closed the
+  // connection.
+  Optional<ReceivedRequest> read_request() {
+    for (;;) {
+      const auto head_end = buffer_.find("\r\n\r\n");
+      if (head_end != std::string::npos) {
+        ReceivedRequest request;
+        request.head = buffer_.substr(0, head_end + 4);
+        std::size_t length = 0;
+        const auto field = request.head.find("Content-Length: ");
+        if (field != std::string::npos) {
+          length = std::stoul(request.head.substr(field + 16));
+        }
+        if (buffer_.size() >= head_end + 4 + length) {
+          request.body = buffer_.substr(head_end + 4, length);
+          buffer_.erase(0, head_end + 4 + length);
+          return request;
+        }
+      }
+
+      char chunk[4096];
+      const auto rc = ::read(fd_, chunk, sizeof chunk);
+      if (rc <= 0) {
+        return nullopt;
+      }
+      buffer_.append(chunk, rc);
+    }
+  }
+
+  void write(const std::string& data) {
+    std::size_t written = 0;
+    while (written < data.size()) {
+      const auto rc =
+          ::write(fd_, data.data() + written, data.size() - written);
+      if (rc <= 0) {
+        return;
+      }
+      written += rc;
+    }
+  }
+};
+
+// `UnixServer` listens on a Unix domain socket, and calls a handler for each
+// connection that it accepts, one at a time.
+class UnixServer {
+  int listener_;
+  std::string path_;
+  std::atomic<bool> stop_{false};
+  std::atomic<int> num_connections_{0};
+  std::thread thread_;
+
+ public:
+  using Handler = std::function<void(ServerConnection&)>;
+
+  explicit UnixServer(Handler handler) {
+    static std::atomic<int> instance{0};
+    path_ = "/tmp/dd-trace-cpp-test-" + std::to_string(::getpid()) + "-" +
+            std::to_string(instance++) + ".sock";
+    ::unlink(path_.c_str());
+    listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(listener_ != -1);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path_.c_str());
+    REQUIRE(::bind(listener_, reinterpret_cast<sockaddr*>(&address),
+                   sizeof address) == 0);
+    REQUIRE(::listen(listener_, 8) == 0);
+
+    thread_ = std::thread([this, handler = std::move(handler)]() {
+      while (!stop_) {
+        pollfd poll_fd{listener_, POLLIN, 0};
+        if (::poll(&poll_fd, 1, 10) <= 0) {
+          continue;
+        }
+        const int fd = ::accept(listener_, nullptr, nullptr);
+        if (fd == -1) {
+          continue;
+        }
+        ++num_connections_;
+        ServerConnection connection{fd};
+        handler(connection);
+        ::close(fd);
+      }
+    });
+  }
+
+  ~UnixServer() {
+    stop_ = true;
+    thread_.join();
+    ::close(listener_);
+    ::unlink(path_.c_str());
+  }
+
+  HTTPClient::URL url(std::string path = "/v0.4/traces") const {
+    return HTTPClient::URL{"unix", path_, std::move(path)};
+  }
+
+  int num_connections() const { return num_connections_; }
+};
+
+std::string ok_response(const std::string& body,
+                        const std::string& extra_headers = "") {
+  return "HTTP/1.1 200 OK\r\n" + extra_headers +
+         "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// `Responses` collects the results of requests, which are delivered on the
+// client's thread.
+struct Responses {
+  std::mutex mutex;
+  std::vector<int> statuses;
+  std::vector<std::string> bodies;
+  std::vector<std::string> foo_bar_headers;
+  std::vector<Error> errors;
+
+  HTTPClient::ResponseHandler on_response() {
+    return [this](int status, const DictReader& headers, std::string body) {
+      std::lock_guard<std::mutex> lock(mutex);
+      statuses.push_back(status);
+      bodies.push_back(std::move(body));
+      foo_bar_headers.emplace_back(headers.lookup("foo-bar").value_or(""));
+    };
+  }
+
+  HTTPClient::ErrorHandler on_error() {
+    return [this](Error error) {
+      std::lock_guard<std::mutex> lock(mutex);
+      errors.push_back(std::move(error));
+    };
+  }
+};
+
+const auto no_headers = [](DictWriter&) {};
+
+std::chrono::steady_clock::time_point in_seconds(int seconds) {
+  return default_clock().tick + std::chrono::seconds(seconds);
+}
+
+// Each test runs both with and without io_uring.
+SocketHTTPClient::Options with_io_uring(bool io_uring) {
+  SocketHTTPClient::Options options;
+  options.io_uring = io_uring;
+  return options;
+}
+
+}  // namespace
+
+TEST_CASE("SocketHTTPClient request and response", "[socket_http_client]") {
+  const bool io_uring = GENERATE(false, true);
+  CAPTURE(io_uring);
+  std::mutex mutex;
+  std::vector<ReceivedRequest> received;
+  UnixServer server{[&](ServerConnection& connection) {
+    while (auto request = connection.read_request()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(*request);
+      }
+      connection.write(ok_response("{\"rate_by_service\": {}}",
+                                   "Foo-Bar:  baz  \r\n"));
+    }
+  }};
+
+  Responses responses;
+  {
+    SocketHTTPClient client{std::make_shared<MockLogger>(), default_clock,
+                            with_io_uring(io_uring)};
+    const auto result = client.post(
+        server.url(),
+        [](DictWriter& headers) {
+          headers.set("Content-Type", "application/msgpack");
+          // Ignored in favor of the actual length of the body.
+          headers.set("Content-Length", "999");
+        },
+        "hello", responses.on_response(), responses.on_error(),
+        in_seconds(10));
+    REQUIRE(result);
+    client.drain(in_seconds(10));
+  }
+
+  REQUIRE(responses.errors.empty());
+  REQUIRE(responses.statuses == std::vector<int>{200});
+  REQUIRE(responses.bodies[0] == "{\"rate_by_service\": {}}");
+  REQUIRE(responses.foo_bar_headers[0] == "baz");
+
+  REQUIRE(received.size() == 1);
+  const std::string& head = received[0].head;
+  REQUIRE(head.rfind("POST /v0.4/traces HTTP/1.1\r\n", 0) == 0);
+  REQUIRE(head.find("Host: localhost\r\n") != std::string::npos);
+  REQUIRE(head.find("Content-Type: application/msgpack\r\n") !=
+          std::string::npos);
+  REQUIRE(head.find("Content-Length: 5\r\n") != std::string::npos);
+  REQUIRE(head.find("999") == std::string::npos);
+  REQUIRE(received[0].body == "hello");
+}
+
+TEST_CASE("SocketHTTPClient reuses its connection", "[socket_http_client]") {
+  const bool io_uring = GENERATE(false, true);
+  CAPTURE(io_uring);
+  UnixServer server{[&](ServerConnection& connection) {
+    while (auto request = connection.read_request()) {
+      connection.write(ok_response(request->body));
+    }
+  }};
+
+  Responses responses;
+  {
+    SocketHTTPClient client{std::make_shared<MockLogger>(), default_clock,
+                            with_io_uring(io_uring)};
+    for (int i = 0; i < 5; ++i) {
+      const auto result =
+          client.post(server.url(), no_headers, std::to_string(i),
+                      responses.on_response(), responses.on_error(),
+                      in_seconds(10));
+      REQUIRE(result);
+    }
+    client.drain(in_seconds(10));
+  }
+
+  REQUIRE(responses.errors.empty());
+  REQUIRE(responses.bodies ==
+          std::vector<std::string>{"0", "1", "2", "3", "4"});
+  REQUIRE(server.num_connections() == 1);
+}
+
+TEST_CASE("SocketHTTPClient decodes chunked responses",
+          "[socket_http_client]") {
+  const bool io_uring = GENERATE(false, true);
+  CAPTURE(io_uring);
+  UnixServer server{[&](ServerConnection& connection) {
+    while (connection.read_request()) {
+      connection.write(
+          "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+          "5\r\nhello\r\n6;name=value\r\n world\r\n0\r\n\r\n");
+    }
+  }};
+
+  Responses responses;
+  {
+    SocketHTTPClient client{std::make_shared<MockLogger>(), default_clock,
+                            with_io_uring(io_uring)};
+    for (int i = 0; i < 2; ++i) {
+      REQUIRE(client.post(server.url(), no_headers, "", responses.on_response(),
+                          responses.on_error(), in_seconds(10)));
+    }
+    client.drain(in_seconds(10));
+  }
+
+  REQUIRE(responses.errors.empty());
+  REQUIRE(responses.bodies ==
+          std::vector<std::string>{"hello world", "hello world"});
+}
+
+TEST_CASE("SocketHTTPClient reconnects after the server closes",
+          "[socket_http_client]") {
+  const bool io_uring = GENERATE(false, true);
+  CAPTURE(io_uring);
+  UnixServer server{[&](ServerConnection& connection) {
+    if (connection.read_request()) {
+      connection.write(ok_response("bye", "Connection: close\r\n"));
+    }
+  }};
+
+  Responses responses;
+  {
+    SocketHTTPClient client{std::make_shared<MockLogger>(), default_clock,
+                            with_io_uring(io_uring)};
+    for (int i = 0; i < 2; ++i) {
+      REQUIRE(client.post(server.url(), no_headers, "", responses.on_response(),
+                          responses.on_error(), in_seconds(10)));
+      client.drain(in_seconds(10));
+    }
+  }
+
+  REQUIRE(responses.errors.empty());
+  REQUIRE(responses.bodies == std::vector<std::string>{"bye", "bye"});
+  REQUIRE(server.num_connections() == 2);
+}
+
+TEST_CASE("SocketHTTPClient errors", "[socket_http_client]") {
+  const bool io_uring = GENERATE(false, true);
+  CAPTURE(io_uring);
+  Responses responses;
+  SocketHTTPClient client{std::make_shared<MockLogger>(), default_clock,
+                          with_io_uring(io_uring)};
+
+  SECTION("unsupported scheme") {
+    const HTTPClient::URL url{"https", "localhost:8126", "/v0.4/traces"};
+    const auto result =
+        client.post(url, no_headers, "", responses.on_response(),
+                    responses.on_error(), in_seconds(10));
+    REQUIRE(!result);
+    REQUIRE(result.error().code ==
+            Error::SOCKET_HTTP_CLIENT_REQUEST_SETUP_FAILED);
+  }
+
+  SECTION("nothing is listening") {
+    const HTTPClient::URL url{"unix", "/tmp/dd-trace-cpp-test-nonexistent",
+                              "/v0.4/traces"};
+    REQUIRE(client.post(url, no_headers, "", responses.on_response(),
+                        responses.on_error(), in_seconds(10)));
+    client.drain(in_seconds(10));
+    REQUIRE(responses.statuses.empty());
+    REQUIRE(responses.errors.size() == 1);
+    REQUIRE(responses.errors[0].code ==
+            Error::SOCKET_HTTP_CLIENT_REQUEST_FAILURE);
+  }
+
+  SECTION("deadline exceeded") {
+    UnixServer server{[&](ServerConnection& connection) {
+      // Read requests, but never respond.
+      while (connection.read_request()) {
+      }
+    }};
+    REQUIRE(client.post(
+        server.url(), no_headers, "", responses.on_response(),
+        responses.on_error(),
+        default_clock().tick + std::chrono::milliseconds(100)));
+    client.drain(in_seconds(10));
+    REQUIRE(responses.statuses.empty());
+    REQUIRE(responses.errors.size() == 1);
+    REQUIRE(responses.errors[0].code ==
+            Error::SOCKET_HTTP_CLIENT_DEADLINE_EXCEEDED);
+  }
+}
+
+TEST_CASE("SocketHTTPClient sends large bodies", "[socket_http_client]") {
+  const bool io_uring = GENERATE(false, true);
+  CAPTURE(io_uring);
+  UnixServer server{[&](ServerConnection& connection) {
+    while (auto request = connection.read_request()) {
+      connection.write(ok_response(std::to_string(request->body.size())));
+    }
+  }};
+
+  const std::string body(8 * 1024 * 1024, 'x');
+  Responses responses;
+  {
+    SocketHTTPClient client{std::make_shared<MockLogger>(), default_clock,
+                            with_io_uring(io_uring)};
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE(client.post(server.url(), no_headers, body,
+                          responses.on_response(), responses.on_error(),
+                          in_seconds(10)));
+    }
+    client.drain(in_seconds(10));
+  }
+
+  REQUIRE(responses.errors.empty());
+  const auto size = std::to_string(body.size());
+  REQUIRE(responses.bodies == std::vector<std::string>{size, size, size});
+}
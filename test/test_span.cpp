@@ -4,11 +4,15 @@
 
 #include <datadog/clock.h>
 #include <datadog/hex.h>
+#include <datadog/id_generator.h>
 #include <datadog/injection_options.h>
 #include <datadog/null_collector.h>
 #include <datadog/optional.h>
 #include <datadog/span.h>
 #include <datadog/span_config.h>
+#include <datadog/span_data.h>
+#include <datadog/span_template.h>
+#include <datadog/static_string.h>
 #include <datadog/tag_propagation.h>
 #include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
@@ -16,7 +20,10 @@
 #include <chrono>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "catch.hpp"
 #include "datadog/sampling_mechanism.h"
@@ -30,7 +37,7 @@
 using namespace datadog::tracing;
 
 TEST_CASE("set_tag") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -90,8 +97,215 @@ TEST_CASE("set_tag") {
   }
 }
 
+TEST_CASE("set_tags and set_metrics") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  {
+    auto span = tracer.create_span();
+    span.set_tag("http.method", "PUT");
+    const std::string url = "https://example.com/v1/things";
+    span.set_tags({{"http.method", "GET"},
+                   {"http.url", url},
+                   {"component", "curl"},
+                   {"component", "http"}});
+    span.set_metrics({{"http.status_code", 200}, {"attempt", 2}});
+    REQUIRE(span.lookup_tag("http.url") == url);
+    REQUIRE(span.lookup_metric("attempt") == 2);
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 1);
+  const auto& span = *chunk.front();
+  // Later values take precedence, as with repeated calls to `set_tag`.
+  REQUIRE(span.tags.at("http.method") == "GET");
+  REQUIRE(span.tags.at("http.url") == "https://example.com/v1/things");
+  REQUIRE(span.tags.at("component") == "http");
+  REQUIRE(span.numeric_tags.at("http.status_code") == 200);
+  REQUIRE(span.numeric_tags.at("attempt") == 2);
+}
+
+TEST_CASE("tag values are truncated to the configured length") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.max_tag_value_length = 10;
+  config.tag_value_length_limits =
+      std::unordered_map<std::string, std::size_t>{{"db.statement", 20},
+                                                   {"http.url", 0}};
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  const std::string long_value = "abcdefghijklmnopqrstuvwxyz";
+  {
+    auto span = tracer.create_span();
+    span.set_tag("short", "abcdefghij");
+    span.set_tag("long", long_value);
+    span.set_tags({{"db.statement", long_value}, {"http.url", long_value}});
+    span.set_tag("_dd.internal", long_value);
+    // "é" is two bytes, the second of which would be cut.
+    span.set_tag("accented", "abcdefé12345");
+    span.set_tag("repeated", long_value);
+    span.set_tag("repeated", "fits");
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& span = *collector->chunks.front().front();
+  REQUIRE(span.tags.at("short") == "abcdefghij");
+  REQUIRE(span.tags.at("long") == "abcdefg...");
+  REQUIRE(span.tags.at("db.statement") == "abcdefghijklmnopq...");
+  REQUIRE(span.tags.at("http.url") == long_value);
+  REQUIRE(span.tags.at("_dd.internal") == long_value);
+  REQUIRE(span.tags.at("accented") == "abcdef...");
+  REQUIRE(span.tags.at("repeated") == "fits");
+}
+
+TEST_CASE("span properties are truncated to the configured length") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.max_tag_value_length = 10;
+  config.tag_value_length_limits =
+      std::unordered_map<std::string, std::size_t>{{"resource.name", 20},
+                                                   {"error.stack", 15}};
+  const std::string long_value = "abcdefghijklmnopqrstuvwxyz";
+  config.tags = std::unordered_map<std::string, std::string>{
+      {"team", long_value}, {"_dd.internal", long_value}};
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SpanConfig span_config;
+  span_config.name = long_value;
+  // The version applies only along with the service.
+  span_config.service = "testsvc";
+  span_config.version = long_value;
+  span_config.environment = long_value;
+  span_config.tags.emplace("from.config", long_value);
+  const SpanTemplate span_template{span_config};
+
+  // Unlike the other spans' stacks, this one is not shared with other tests.
+  const std::string stack = "span properties are truncated";
+  std::vector<std::uint64_t> ids;
+  {
+    auto root = tracer.create_span(span_config);
+    ids.push_back(root.id());
+    SpanConfig moved_config = span_config;
+    moved_config.resource = long_value;
+    auto moved = root.create_child(std::move(moved_config));
+    ids.push_back(moved.id());
+    auto templated = root.create_child(span_template);
+    ids.push_back(templated.id());
+
+    auto set = root.create_child();
+    ids.push_back(set.id());
+    set.set_name(long_value);
+    set.set_resource_name(long_value);
+    set.set_error_message(long_value);
+    set.set_error_type(long_value);
+    set.set_error_stack(stack);
+    auto same_stack = root.create_child();
+    ids.push_back(same_stack.id());
+    same_stack.set_error_stack(stack);
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  const auto find = [&](std::uint64_t id) -> const SpanData& {
+    for (const auto& span : chunk) {
+      if (span->span_id == id) {
+        return *span;
+      }
+    }
+    FAIL("no span having the ID " << id);
+    return *chunk.front();
+  };
+
+  // From a `SpanConfig`, copied, moved, or prepared by a `SpanTemplate`.
+  for (std::size_t i = 0; i < 3; ++i) {
+    CAPTURE(i);
+    const auto& span = find(ids[i]);
+    REQUIRE(span.name == "abcdefg...");
+    REQUIRE(span.lookup_tag("version") == "abcdefg...");
+    REQUIRE(span.lookup_tag("env") == "abcdefg...");
+    REQUIRE(span.lookup_tag("from.config") == "abcdefg...");
+    // Default tags are truncated once, and inherited.
+    REQUIRE(span.lookup_tag("team") == "abcdefg...");
+    REQUIRE(span.lookup_tag("_dd.internal") == long_value);
+  }
+  // Without a resource, the resource is the name, which is already short.
+  REQUIRE(find(ids[0]).resource == "abcdefg...");
+  REQUIRE(find(ids[1]).resource == "abcdefghijklmnopq...");
+
+  // By the setters.
+  const auto& span = find(ids[3]);
+  REQUIRE(span.name == "abcdefg...");
+  REQUIRE(span.resource == "abcdefghijklmnopq...");
+  REQUIRE(span.lookup_tag("error.message") == "abcdefg...");
+  REQUIRE(span.lookup_tag("error.type") == "abcdefg...");
+  // The truncated stack is interned, and so shared among spans.
+  REQUIRE(span.static_tags.at("error.stack") == "span propert...");
+  REQUIRE(find(ids[4]).static_tags.at("error.stack").data() ==
+          span.static_tags.at("error.stack").data());
+}
+
+TEST_CASE("static tags") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.max_tag_value_length = 10;
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  static const char method[] = "GET";
+  {
+    auto span = tracer.create_span();
+    span.set_tag(StaticString{"http.method"}, StaticString{method});
+    span.set_tag("span.kind", "server");
+    span.set_tag(StaticString{"span.kind"}, StaticString{"client"});
+    span.set_tag(StaticString{"component"}, StaticString{"grpc"});
+    span.set_tag("component", "overridden");
+    span.set_tag(StaticString{"long"},
+                 StaticString::assume_static("abcdefghijklmnopqrstuvwxyz"));
+    REQUIRE(span.lookup_tag("http.method") == "GET");
+    REQUIRE(span.lookup_tag("span.kind") == "client");
+    REQUIRE(span.lookup_tag("component") == "overridden");
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& span = *collector->chunks.front().front();
+  // The value is referred to, not copied.
+  REQUIRE(span.static_tags.at("http.method").data() == method);
+  REQUIRE(span.tags.count("http.method") == 0);
+  REQUIRE(span.lookup_tag("span.kind") == "client");
+  REQUIRE(span.tags.count("span.kind") == 0);
+  REQUIRE(span.lookup_tag("component") == "overridden");
+  // A value that must be truncated is copied.
+  REQUIRE(span.static_tags.count("long") == 0);
+  REQUIRE(span.tags.at("long") == "abcdefg...");
+}
+
 TEST_CASE("lookup_tag") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.collector = std::make_shared<MockCollector>();
   config.logger = std::make_shared<MockLogger>();
@@ -134,7 +348,7 @@ TEST_CASE("lookup_tag") {
 }
 
 TEST_CASE("remove_tag") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.collector = std::make_shared<MockCollector>();
   config.logger = std::make_shared<MockLogger>();
@@ -166,7 +380,7 @@ TEST_CASE("remove_tag") {
 }
 
 TEST_CASE("set_metric") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -222,7 +436,7 @@ TEST_CASE("set_metric") {
 }
 
 TEST_CASE("lookup_metric") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.collector = std::make_shared<MockCollector>();
   config.logger = std::make_shared<MockLogger>();
@@ -251,7 +465,7 @@ TEST_CASE("lookup_metric") {
 }
 
 TEST_CASE("remove_metric") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.collector = std::make_shared<MockCollector>();
   config.logger = std::make_shared<MockLogger>();
@@ -281,8 +495,513 @@ TEST_CASE("remove_metric") {
   }
 }
 
+TEST_CASE("span configs passed as rvalues are moved from") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  const auto make_config = [](const std::string& name) {
+    SpanConfig span_config;
+    span_config.service = "othersvc";
+    span_config.version = "v1";
+    span_config.environment = "staging";
+    span_config.name = name;
+    span_config.resource = "GET /" + name;
+    span_config.service_type = "web";
+    span_config.tags["hello"] = "world";
+    return span_config;
+  };
+
+  {
+    SpanConfig root_config = make_config("root");
+    auto root = tracer.create_span(std::move(root_config));
+    // Every tag is taken from the config, key and all.
+    REQUIRE(root_config.tags.empty());
+
+    SpanConfig child_config = make_config("child");
+    auto child = root.create_child(std::move(child_config));
+    REQUIRE(child_config.tags.empty());
+
+    const SpanConfig copied_config = make_config("copied");
+    auto copied = root.create_child(copied_config);
+    REQUIRE(copied_config.tags.size() == 1);
+
+    SpanConfig context_config = make_config("continued");
+    auto continued = root.context().create_child(std::move(context_config));
+    REQUIRE(continued);
+    REQUIRE(context_config.tags.empty());
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 4);
+  for (const auto& span : chunk) {
+    REQUIRE(span->service == "othersvc");
+    REQUIRE(span->service_type == "web");
+    REQUIRE(span->resource == "GET /" + span->name);
+    REQUIRE(span->version() == "v1");
+    REQUIRE(span->environment() == "staging");
+    REQUIRE(span->tags.find("hello") != span->tags.end());
+    REQUIRE(span->tags.find("hello")->second == "world");
+  }
+}
+
+TEST_CASE("span templates") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SpanConfig span_config;
+  span_config.environment = "staging";
+  span_config.name = "cache.get";
+  span_config.service_type = "cache";
+  span_config.tags["hello"] = "world";
+  const SpanTemplate span_template{std::move(span_config)};
+
+  {
+    auto root = tracer.create_span(span_template);
+    root.set_tag("only", "root");
+    auto child = root.create_child(span_template);
+    auto copied = root.create_child(SpanTemplate{span_template});
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 3);
+  for (const auto& span : chunk) {
+    REQUIRE(span->service == "testsvc");
+    REQUIRE(span->service_type == "cache");
+    REQUIRE(span->name == "cache.get");
+    REQUIRE(span->resource == "cache.get");
+    REQUIRE(span->environment() == "staging");
+    REQUIRE(span->lookup_tag("hello") == "world");
+  }
+  // A tag set on one span does not affect the others.
+  REQUIRE(chunk[0]->lookup_tag("only") == "root");
+  REQUIRE(!chunk[1]->lookup_tag("only"));
+  REQUIRE(!chunk[2]->lookup_tag("only"));
+
+  // The template is prepared anew for a tracer with other defaults.
+  config.service = "othersvc";
+  auto other_config = finalize_config(config);
+  REQUIRE(other_config);
+  Tracer other_tracer{*other_config};
+  collector->chunks.clear();
+  { auto span = other_tracer.create_span(span_template); }
+  REQUIRE(collector->chunks.size() == 1);
+  REQUIRE(collector->chunks.front().front()->service == "othersvc");
+  REQUIRE(collector->chunks.front().front()->name == "cache.get");
+}
+
+TEST_CASE("create_children") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  // Override the tracer's ID generator to count values and batches.
+  struct Generator : public IDGenerator {
+    mutable std::uint64_t next_id = 1;
+    mutable int batches = 0;
+    TraceID trace_id(const TimePoint&) const override {
+      return TraceID(next_id++);
+    }
+    std::uint64_t span_id() const override { return next_id++; }
+    void span_ids(std::uint64_t* ids, std::size_t count) const override {
+      ++batches;
+      IDGenerator::span_ids(ids, count);
+    }
+  };
+  const auto generator = std::make_shared<Generator>();
+  Tracer tracer{*finalized_config, generator};
+
+  {
+    auto parent = tracer.create_span();
+    SpanConfig child_config;
+    child_config.name = "db.query";
+    const std::vector<Span> children = parent.create_children(3, child_config);
+    REQUIRE(generator->batches == 1);
+    REQUIRE(children.size() == 3);
+    for (const auto& child : children) {
+      REQUIRE(child.parent_id() == parent.id());
+      REQUIRE(child.trace_id() == parent.trace_id());
+      REQUIRE(child.name() == "db.query");
+    }
+    REQUIRE(children[0].id() != children[1].id());
+    REQUIRE(children[1].id() != children[2].id());
+    REQUIRE(parent.create_children(0).empty());
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  REQUIRE(collector->chunks.front().size() == 4);
+}
+
+TEST_CASE("finish_all") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  // The third child of each root is not recorded.
+  config.max_spans_per_trace = 3;
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  {
+    auto first = tracer.create_span();
+    auto second = tracer.create_span();
+    std::vector<Span> children = first.create_children(3);
+    std::vector<Span> others = second.create_children(3);
+    const auto end = children[1].start_time().tick + std::chrono::seconds(10);
+    children[1].set_end_time(end);
+    // Interleave the segments' spans, and include a moved-from span.
+    std::vector<Span> spans;
+    spans.push_back(std::move(children[0]));
+    spans.push_back(std::move(others[0]));
+    spans.push_back(std::move(children[0]));
+    spans.push_back(std::move(children[1]));
+    spans.push_back(std::move(children[2]));
+    spans.push_back(std::move(others[1]));
+    spans.push_back(std::move(others[2]));
+
+    Span::finish_all(spans);
+    REQUIRE(spans.empty());
+    REQUIRE(collector->chunks.empty());
+  }
+
+  REQUIRE(collector->chunks.size() == 2);
+  bool found_end_time = false;
+  for (const auto& chunk : collector->chunks) {
+    REQUIRE(chunk.size() == 3);
+    for (const auto& span : chunk) {
+      REQUIRE(span->duration >= Duration::zero());
+      found_end_time |= span->duration == std::chrono::seconds(10);
+    }
+  }
+  REQUIRE(found_end_time);
+}
+
+TEST_CASE("spans are timed relative to the local root") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  // `default_clock` is the default, and its ticks are steady clock readings.
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  {
+    auto root = tracer.create_span();
+    const auto before = std::chrono::steady_clock::now();
+    auto child = root.create_child();
+    auto grandchild = child.create_child();
+    const auto after = std::chrono::steady_clock::now();
+
+    // A child's wall time is derived from the root's, so that the two differ
+    // by exactly what their steady times do.
+    for (const Span* span : {&child, &grandchild}) {
+      const TimePoint start = span->start_time();
+      REQUIRE(start.tick >= before);
+      REQUIRE(start.tick <= after);
+      REQUIRE(start.wall - root.start_time().wall ==
+              std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                  start.tick - root.start_time().tick));
+    }
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  for (const auto& span : collector->chunks.front()) {
+    REQUIRE(span->duration >= Duration::zero());
+  }
+}
+
+TEST_CASE("SpanContext") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SECTION("children are created on another thread") {
+    std::uint64_t parent_id;
+    {
+      auto parent = tracer.create_span();
+      parent_id = parent.id();
+      const SpanContext context = parent.context();
+      REQUIRE(context.trace_id() == parent.trace_id());
+      REQUIRE(context.span_id() == parent.id());
+
+      std::thread thread{[context]() {
+        SpanConfig child_config;
+        child_config.name = "continuation";
+        auto child = context.create_child(child_config);
+        REQUIRE(child);
+        REQUIRE(child->parent_id() == context.span_id());
+        REQUIRE(child->trace_id() == context.trace_id());
+      }};
+      thread.join();
+    }
+
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& chunk = collector->chunks.front();
+    REQUIRE(chunk.size() == 2);
+    REQUIRE(chunk[1]->parent_id == parent_id);
+    REQUIRE(chunk[1]->name == "continuation");
+  }
+
+  SECTION("a child outlives its parent") {
+    Optional<Span> child;
+    {
+      auto parent = tracer.create_span();
+      auto created = parent.context().create_child();
+      REQUIRE(created);
+      child.emplace(std::move(*created));
+    }
+    // The parent is finished, but the child keeps the segment open.
+    REQUIRE(collector->chunks.empty());
+    child.reset();
+    REQUIRE(collector->chunks.size() == 1);
+    REQUIRE(collector->chunks.front().size() == 2);
+  }
+
+  SECTION("no child once the segment is gone") {
+    SpanContext context;
+    REQUIRE(!context.create_child());
+    {
+      auto parent = tracer.create_span();
+      context = parent.context();
+    }
+    REQUIRE(collector->chunks.size() == 1);
+    REQUIRE(!context.create_child());
+  }
+}
+
+TEST_CASE("early sampling decision") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.early_sampling_decision = true;
+  config.trace_sampler.sample_rate = 0.0;
+
+  SECTION("children of a dropped trace are not recorded") {
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    {
+      auto root = tracer.create_span();
+      REQUIRE(root.recorded());
+      auto child = root.create_child();
+      REQUIRE(!child.recorded());
+      REQUIRE(child.parent_id() == root.id());
+      REQUIRE(child.trace_id() == root.trace_id());
+      child.set_tag("foo", "bar");
+      child.set_metric("baz", 1.0);
+      REQUIRE(!child.lookup_tag("foo"));
+      REQUIRE(!child.lookup_metric("baz"));
+
+      auto grandchild = child.create_child();
+      REQUIRE(!grandchild.recorded());
+      REQUIRE(grandchild.parent_id() == child.id());
+      const auto batch = root.create_children(2);
+      REQUIRE(!batch[0].recorded());
+      REQUIRE(!batch[1].recorded());
+
+      // Unrecorded spans still propagate the trace.
+      MockDictWriter writer;
+      grandchild.inject(writer);
+      REQUIRE(writer.items.at("x-datadog-parent-id") ==
+              std::to_string(grandchild.id()));
+      REQUIRE(std::stoi(writer.items.at("x-datadog-sampling-priority")) <= 0);
+    }
+    // Only the local root is sent.
+    REQUIRE(collector->chunks.size() == 1);
+    REQUIRE(collector->chunks.front().size() == 1);
+    REQUIRE(collector->first_span().parent_id == 0);
+  }
+
+  SECTION("unrecorded children outlive the local root") {
+    // Any trace tags are too large to inject.
+    config.max_tags_header_size = 1;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    Optional<Span> child;
+    std::uint64_t root_id;
+    {
+      auto root = tracer.create_span();
+      root_id = root.id();
+      child.emplace(root.create_child());
+      REQUIRE(!child->recorded());
+    }
+    REQUIRE(collector->chunks.size() == 1);
+
+    // Keeping the trace now adds the "_dd.p.dm" trace tag, so that the
+    // injected "x-datadog-tags" header is oversized.  The local root, which
+    // would be tagged with the propagation error, has already been sent.
+    child->trace_segment().override_sampling_priority(
+        SamplingPriority::USER_KEEP);
+    MockDictWriter writer;
+    child->inject(writer);
+    REQUIRE(writer.items.at("x-datadog-parent-id") ==
+            std::to_string(child->id()));
+    REQUIRE(std::stoi(writer.items.at("x-datadog-sampling-priority")) > 0);
+    REQUIRE(writer.items.count("x-datadog-tags") == 0);
+    REQUIRE(child->trace_segment().local_root_id() == root_id);
+  }
+
+  SECTION("keeping the trace records subsequent children") {
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    {
+      auto root = tracer.create_span();
+      auto unrecorded = root.create_child();
+      root.trace_segment().override_sampling_priority(
+          SamplingPriority::USER_KEEP);
+      auto recorded = root.create_child();
+      REQUIRE(!unrecorded.recorded());
+      REQUIRE(recorded.recorded());
+    }
+    REQUIRE(collector->chunks.size() == 1);
+    REQUIRE(collector->chunks.front().size() == 2);
+  }
+
+  SECTION("children of a kept trace are recorded") {
+    config.trace_sampler.sample_rate = 1.0;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      REQUIRE(child.recorded());
+    }
+    REQUIRE(collector->chunks.front().size() == 2);
+  }
+
+  SECTION("children are recorded if span sampling might keep them") {
+    SpanSamplerConfig::Rule rule;
+    rule.service = "testsvc";
+    config.span_sampler.rules.push_back(rule);
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      REQUIRE(child.recorded());
+    }
+    REQUIRE(collector->chunks.front().size() == 2);
+  }
+}
+
+TEST_CASE("spans are not recorded when traces are not reported") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  SECTION("report_traces is false") {
+    config.report_traces = false;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    {
+      auto root = tracer.create_span();
+      REQUIRE(!root.recorded());
+      REQUIRE(root.service_name() == "testsvc");
+      root.set_tag("foo", "bar");
+      REQUIRE(!root.lookup_tag("foo"));
+
+      auto child = root.create_child();
+      REQUIRE(!child.recorded());
+      REQUIRE(child.parent_id() == root.id());
+      REQUIRE(!root.context().create_child()->recorded());
+      const auto batch = root.create_children(2);
+      REQUIRE(!batch[0].recorded());
+      REQUIRE(!batch[1].recorded());
+
+      // Keeping the trace doesn't start recording.
+      root.trace_segment().override_sampling_priority(
+          SamplingPriority::USER_KEEP);
+      REQUIRE(!root.create_child().recorded());
+
+      // The trace still propagates.
+      MockDictWriter writer;
+      child.inject(writer);
+      REQUIRE(writer.items.at("x-datadog-trace-id") ==
+              std::to_string(root.trace_id().low));
+      REQUIRE(writer.items.at("x-datadog-parent-id") ==
+              std::to_string(child.id()));
+      REQUIRE(writer.items.at("x-datadog-sampling-priority") == "2");
+    }
+    REQUIRE(collector->chunks.empty());
+  }
+
+  SECTION("extracted spans propagate the extracted context") {
+    config.report_traces = false;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-sampling-priority", "-1"},
+        {"x-datadog-origin", "rum"}};
+    const MockDictReader reader{headers};
+    {
+      auto span = tracer.extract_or_create_span(reader);
+      REQUIRE(!span.recorded());
+      REQUIRE(span.parent_id() == 456);
+      auto child = span.create_child();
+      MockDictWriter writer;
+      child.inject(writer);
+      REQUIRE(writer.items.at("x-datadog-trace-id") == "123");
+      REQUIRE(writer.items.at("x-datadog-sampling-priority") == "-1");
+      REQUIRE(writer.items.at("x-datadog-origin") == "rum");
+    }
+    REQUIRE(collector->chunks.empty());
+  }
+
+  SECTION("the collector is a NullCollector") {
+    config.collector = std::make_shared<NullCollector>();
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    auto root = tracer.create_span();
+    REQUIRE(!root.recorded());
+    REQUIRE(!root.create_child().recorded());
+  }
+}
+
 TEST_CASE("span duration") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -366,7 +1085,7 @@ TEST_CASE(".error() and .set_error*()") {
         },
         false, nullopt, nullopt, nullopt}}));
 
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -407,11 +1126,43 @@ TEST_CASE(".error() and .set_error*()") {
   }
 }
 
+TEST_CASE("identical error stacks are stored once") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  const std::string stack(4096, 'x');
+  {
+    auto root = tracer.create_span();
+    root.set_error_stack(stack);
+    auto child = root.create_child();
+    child.set_tag("error.stack", "overwritten");
+    child.set_error_stack(std::string(stack));
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 2);
+  const auto first = chunk[0]->lookup_tag("error.stack");
+  const auto second = chunk[1]->lookup_tag("error.stack");
+  REQUIRE(first);
+  REQUIRE(second);
+  REQUIRE(*first == stack);
+  REQUIRE(first->data() == second->data());
+  REQUIRE(chunk[1]->tags.count("error.stack") == 0);
+}
+
 TEST_CASE("property setters and getters") {
   // Verify that modifications made by `Span::set_...` are visible both in the
   // corresponding getter method and in the resulting span data sent to the
   // collector.
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -465,7 +1216,7 @@ TEST_CASE("property setters and getters") {
 // Trace context injection is implemented in `TraceSegment`, but it's part of
 // the interface of `Span`, so the test is here.
 TEST_CASE("injection") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.collector = std::make_shared<MockCollector>();
   config.logger = std::make_shared<MockLogger>();
@@ -548,7 +1299,7 @@ TEST_CASE("injection") {
 }
 
 TEST_CASE("injection can be disabled using the \"none\" style") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.name = "spanny";
   config.collector = std::make_shared<MockCollector>();
@@ -566,8 +1317,151 @@ TEST_CASE("injection can be disabled using the \"none\" style") {
   REQUIRE(writer.items == empty);
 }
 
+TEST_CASE("the \"none\" style is ignored among other injection styles") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<MockLogger>();
+  config.injection_styles = {PropagationStyle::NONE, PropagationStyle::B3,
+                             PropagationStyle::NONE};
+
+  const auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  const auto span = tracer.create_span();
+  MockDictWriter writer;
+  // Only the Datadog style can request sampling delegation, so none is
+  // requested.
+  InjectionOptions options;
+  options.delegate_sampling_decision = true;
+  span.inject(writer, options);
+  REQUIRE(writer.items.at("x-b3-spanid") == hex_padded(span.id()));
+  REQUIRE(writer.items.count("x-datadog-trace-id") == 0);
+  REQUIRE(writer.items.count("traceparent") == 0);
+  REQUIRE(writer.items.count("x-datadog-delegate-trace-sampling") == 0);
+}
+
+TEST_CASE("injected trace-level headers follow the sampling decision") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<MockLogger>();
+  config.injection_styles = {PropagationStyle::DATADOG, PropagationStyle::B3,
+                             PropagationStyle::W3C};
+
+  const auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  auto parent = tracer.create_span();
+  auto child = parent.create_child();
+  const std::string trace_id = parent.trace_id().hex_padded();
+
+  // The trace-level parts of the headers are shared by both spans, and only
+  // the span IDs differ.
+  for (const Span* span : {&parent, &child}) {
+    MockDictWriter writer;
+    span->inject(writer);
+    const auto& headers = writer.items;
+    const std::string span_id = hex_padded(span->id());
+    REQUIRE(headers.at("x-datadog-trace-id") ==
+            std::to_string(span->trace_id().low));
+    REQUIRE(headers.at("x-datadog-parent-id") == std::to_string(span->id()));
+    REQUIRE(headers.at("x-datadog-sampling-priority") == "1");
+    REQUIRE(headers.at("x-datadog-tags").find("_dd.p.dm=-0") !=
+            std::string::npos);
+    REQUIRE(headers.at("x-b3-spanid") == span_id);
+    REQUIRE(headers.at("x-b3-sampled") == "1");
+    REQUIRE(headers.at("traceparent") ==
+            "00-" + trace_id + "-" + span_id + "-01");
+    REQUIRE(headers.at("tracestate") == "dd=s:1;p:" + span_id + ";t.dm:-0");
+  }
+
+  // A new sampling decision changes the trace-level parts.
+  child.trace_segment().override_sampling_priority(-1);
+  for (const Span* span : {&parent, &child}) {
+    MockDictWriter writer;
+    span->inject(writer);
+    const auto& headers = writer.items;
+    const std::string span_id = hex_padded(span->id());
+    REQUIRE(headers.at("x-datadog-sampling-priority") == "-1");
+    REQUIRE(headers.at("x-datadog-tags").find("_dd.p.dm") ==
+            std::string::npos);
+    REQUIRE(headers.at("x-b3-sampled") == "0");
+    REQUIRE(headers.at("traceparent") ==
+            "00-" + trace_id + "-" + span_id + "-00");
+    REQUIRE(headers.at("tracestate") == "dd=s:-1;p:" + span_id);
+  }
+}
+
+TEST_CASE("injection writes all headers with one set_all call") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<MockLogger>();
+  config.injection_styles = {PropagationStyle::DATADOG, PropagationStyle::B3,
+                             PropagationStyle::W3C, PropagationStyle::DATADOG};
+
+  const auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  struct BatchWriter : public DictWriter {
+    int set_all_calls = 0;
+    std::vector<std::pair<std::string, std::string>> items;
+
+    void set(StringView, StringView) override {
+      throw std::logic_error("This test should not call set.");
+    }
+    void set_all(const Entry* entries, std::size_t count) override {
+      ++set_all_calls;
+      for (std::size_t i = 0; i < count; ++i) {
+        items.emplace_back(entries[i].first, entries[i].second);
+      }
+    }
+  };
+
+  const std::unordered_map<std::string, std::string> extracted{
+      {"x-datadog-trace-id", "123"},
+      {"x-datadog-parent-id", "456"},
+      {"x-datadog-origin", "Egypt"},
+      {"x-datadog-tags", "_dd.p.foo=bar"}};
+  MockDictReader reader{extracted};
+  auto span = tracer.extract_span(reader);
+  REQUIRE(span);
+
+  BatchWriter batch;
+  span->inject(batch);
+  REQUIRE(batch.set_all_calls == 1);
+
+  // The default `set_all` produces the same headers, in the same order.
+  struct ListWriter : public DictWriter {
+    std::vector<std::pair<std::string, std::string>> items;
+
+    void set(StringView key, StringView value) override {
+      items.emplace_back(key, value);
+    }
+  };
+
+  ListWriter list;
+  span->inject(list);
+  REQUIRE(batch.items == list.items);
+
+  // The Datadog style is configured twice, but written once.
+  std::size_t num_trace_id_headers = 0;
+  for (const auto& [key, value] : list.items) {
+    num_trace_id_headers += key == "x-datadog-trace-id";
+  }
+  REQUIRE(num_trace_id_headers == 1);
+  // Datadog: trace ID, parent ID, sampling priority, origin, tags
+  // B3: trace ID, span ID, sampled, origin, tags
+  // W3C: traceparent, tracestate
+  REQUIRE(list.items.size() == 12);
+}
+
 TEST_CASE("injecting W3C traceparent header") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.collector = std::make_shared<NullCollector>();
   config.logger = std::make_shared<NullLogger>();
@@ -674,7 +1568,7 @@ TEST_CASE("injecting W3C tracestate header") {
   //   - at a trace tag
   //   - at the extra fields (extracted from W3C)
 
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   // The order of the extraction styles doesn't matter for this test, because
   // it'll either be one or the other in the test cases.
@@ -749,6 +1643,12 @@ TEST_CASE("injecting W3C tracestate header") {
       // The "s:-1" comes from the 0% sample rate.
      "dd=s:-1;p:$parent_id;t.wacky:hello fr_d_ how are _________?"},
 
+    {__LINE__, "replace control characters in origin",
+     {{"x-datadog-trace-id", "1"}, {"x-datadog-parent-id", "1"},
+      {"x-datadog-origin", "tab\there,del\x7f,tilde~"}},
+      // The "s:-1" comes from the 0% sample rate.
+     "dd=s:-1;p:$parent_id;o:tab_here_del__tilde_"},
+
     {__LINE__, "replace equal signs with tildes in trace tag value",
      {{"x-datadog-trace-id", "1"}, {"x-datadog-parent-id", "1"},
       {"x-datadog-tags", "_dd.p.base64_thingy=d2Fra2EhIHdhaw=="}},
@@ -808,7 +1708,7 @@ TEST_CASE("injecting W3C tracestate header") {
 }
 
 TEST_CASE("128-bit trace ID injection") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.logger = std::make_shared<MockLogger>();
   config.generate_128bit_trace_ids = true;
@@ -861,7 +1761,7 @@ TEST_CASE("128-bit trace ID injection") {
 }
 
 TEST_CASE("sampling delegation injection") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.logger = std::make_shared<MockLogger>();
   config.collector = std::make_shared<NullCollector>();
@@ -966,3 +1866,15 @@ TEST_CASE("sampling delegation injection") {
     }
   }
 }
+
+TEST_CASE("freed SpanData storage is reused on the same thread") {
+  auto first = std::make_unique<SpanData>();
+  first->tags.emplace("foo", "bar");
+  const void* const address = first.get();
+  first.reset();
+
+  auto second = std::make_unique<SpanData>();
+  REQUIRE(static_cast<const void*>(second.get()) == address);
+  // The recycled storage holds a freshly constructed object.
+  REQUIRE(second->tags.empty());
+}
@@ -5,10 +5,12 @@
 #include <datadog/tracer.h>
 
 #include <cstddef>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "mocks/collectors.h"
 #include "mocks/loggers.h"
@@ -151,7 +153,7 @@ TEST_CASE("span rules matching") {
        {x, x, x}},
   }));
 
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -207,7 +209,7 @@ TEST_CASE("span rules matching") {
 }
 
 TEST_CASE("span rules only on trace drop") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -243,7 +245,7 @@ TEST_CASE("span rules only on trace drop") {
 }
 
 TEST_CASE("span rule sample rate") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -282,7 +284,7 @@ TEST_CASE("span rule sample rate") {
 }
 
 TEST_CASE("span rule limiter") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -329,3 +331,83 @@ TEST_CASE("span rule limiter") {
 
   REQUIRE(count_of_sampled_spans == test_case.expected_count);
 }
+
+TEST_CASE("span rule match cache agrees with matching") {
+  SpanSamplerConfig config;
+  config.rules.push_back(by_name("db.query"));
+  config.rules.push_back(by_resource("office"));
+  auto with_tags = by_name_and_tags("http.request", {{"generation", "first"}});
+  const bool rules_have_tags = GENERATE(false, true);
+  if (rules_have_tags) {
+    config.rules.insert(config.rules.begin(), with_tags);
+  }
+
+  NullLogger logger;
+  const auto finalized = finalize_config(config, logger);
+  REQUIRE(finalized);
+  SpanSampler sampler{*finalized, default_clock};
+
+  // More distinct spans than the cache holds, each seen several times.
+  std::vector<std::unique_ptr<SpanData>> spans;
+  const char* const names[] = {"db.query", "http.request", "render"};
+  const char* const resources[] = {"office", "factory", "prison", "studio"};
+  for (int round = 0; round < 3; ++round) {
+    for (const char* name : names) {
+      for (const char* resource : resources) {
+        auto span = std::make_unique<SpanData>();
+        span->service = "testsvc";
+        span->name = name;
+        span->resource = resource;
+        span->tags["generation"] = round == 1 ? "first" : "second";
+        spans.push_back(std::move(span));
+      }
+    }
+  }
+
+  CAPTURE(rules_have_tags);
+  SpanSampler::MatchCache cache;
+  for (const auto& span_ptr : spans) {
+    const SpanData& span = *span_ptr;
+    CAPTURE(span.name);
+    CAPTURE(span.resource);
+    REQUIRE(sampler.match(span, cache) == sampler.match(span));
+  }
+}
+
+TEST_CASE("span rules on a large trace sampled in parallel") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  config.trace_sampler.sample_rate = 0.0;  // drop the trace
+  config.parallel_finalization_min_spans = 100;
+  config.parallel_finalization_threads = 3;
+  SpanSamplerConfig::Rule rule;
+  rule.max_per_second = 100;
+  config.span_sampler.rules.push_back(rule);
+
+  auto clock = [frozen_time = default_clock()]() { return frozen_time; };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+  {
+    auto root = tracer.create_span();
+    for (int i = 0; i < 999; ++i) {
+      root.create_child();
+    }
+  }
+
+  // The ranges of the trace share the rule's limiter.
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 1000);
+  std::size_t count_of_sampled_spans = 0;
+  for (const auto& span_ptr : chunk) {
+    REQUIRE(span_ptr);
+    if (span_sampling_tags(*span_ptr).mechanism) {
+      ++count_of_sampled_spans;
+    }
+  }
+  REQUIRE(count_of_sampled_spans == 100);
+}
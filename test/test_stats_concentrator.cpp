@@ -0,0 +1,311 @@
+// These are tests for `StatsConcentrator`, which computes APM stats from spans,
+// and for `DDSketch`, which summarizes their durations.
+
+#include <datadog/runtime_id.h>
+#include <datadog/tracer_signature.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <datadog/json.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ddsketch.h"
+#include "mocks/loggers.h"
+#include "span_data.h"
+#include "stats_concentrator.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Return the eight little-endian bytes of the specified `value`.
+std::string little_endian(double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  std::string result;
+  for (int i = 0; i < 8; ++i) {
+    result.push_back(char(bits & 0xFF));
+    bits >>= 8;
+  }
+  return result;
+}
+
+// The start of a ten second bucket, as a wall time.
+const auto bucket_start =
+    std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+
+std::uint64_t nanoseconds(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+std::unique_ptr<SpanData> make_span(std::uint64_t id, std::uint64_t parent_id,
+                                    std::string service,
+                                    Duration duration = 1ms) {
+  auto span = std::make_unique<SpanData>();
+  span->span_id = id;
+  span->parent_id = parent_id;
+  span->service = std::move(service);
+  span->name = "handle";
+  span->resource = "GET /";
+  span->service_type = "web";
+  span->start.wall = bucket_start + 1s;
+  span->duration = duration;
+  return span;
+}
+
+}  // namespace
+
+TEST_CASE("DDSketch", "[stats]") {
+  SECTION("empty sketch encodes only its mapping") {
+    const DDSketch sketch;
+    std::string encoded;
+    sketch.encode(encoded);
+    const double gamma = 1.01 / 0.99;
+    REQUIRE(encoded == "\x0A\x09\x09" + little_endian(gamma));
+  }
+
+  SECTION("values are counted in logarithmic bins") {
+    DDSketch sketch;
+    sketch.add(1.0);
+    sketch.add(1.0);
+    sketch.add(0);
+    REQUIRE(sketch.count() == 3);
+    std::string encoded;
+    sketch.encode(encoded);
+    const double gamma = 1.01 / 0.99;
+    const std::string expected = "\x0A\x09\x09" + little_endian(gamma) +
+                                 // positiveValues, 10 bytes
+                                 "\x12\x0A"
+                                 // contiguousBinCounts, 8 bytes
+                                 "\x12\x08" +
+                                 little_endian(2) +
+                                 // zeroCount
+                                 "\x21" + little_endian(1);
+    REQUIRE(encoded == expected);
+  }
+
+  SECTION("the index of the lowest bin is zigzag encoded") {
+    DDSketch sketch;
+    const double gamma = 1.01 / 0.99;
+    sketch.add(std::pow(gamma, -3) * 1.001);
+    std::string encoded;
+    sketch.encode(encoded);
+    // contiguousBinIndexOffset is -3, which is zigzag encoded as 5.
+    REQUIRE(encoded.substr(encoded.size() - 2) == "\x18\x05");
+  }
+
+  SECTION("representative values are within the relative accuracy") {
+    const DDSketch sketch;
+    for (double value = 1; value < 1e12; value *= 1.7) {
+      CAPTURE(value);
+      const double estimate = sketch.representative(value);
+      REQUIRE(std::abs(estimate - value) / value <=
+              sketch.relative_accuracy() + 1e-9);
+    }
+  }
+
+  SECTION("adding values in bulk is the same as one at a time") {
+    std::vector<double> values;
+    for (int i = 0; i < 1000; ++i) {
+      values.push_back(i % 7 == 0 ? 0 : std::exp(i % 50) * (1 + i));
+    }
+    DDSketch one_at_a_time;
+    for (const double value : values) {
+      one_at_a_time.add(value);
+    }
+    DDSketch bulk;
+    bulk.add(values.data(), values.size());
+    REQUIRE(bulk.count() == one_at_a_time.count());
+    std::string expected, actual;
+    one_at_a_time.encode(expected);
+    bulk.encode(actual);
+    REQUIRE(actual == expected);
+  }
+
+  SECTION("merged sketches count the values of both") {
+    DDSketch low, high, both;
+    for (int i = 1; i <= 100; ++i) {
+      low.add(i);
+      both.add(i);
+      high.add(i * 1e6);
+      both.add(i * 1e6);
+    }
+    low.merge(high);
+    REQUIRE(low.count() == 200);
+    std::string expected, actual;
+    both.encode(expected);
+    low.encode(actual);
+    REQUIRE(actual == expected);
+  }
+
+  SECTION("quantiles are within the relative accuracy") {
+    DDSketch sketch;
+    std::vector<double> values;
+    for (int i = 1; i <= 1001; ++i) {
+      values.push_back(i * 1000.0);
+    }
+    sketch.add(values.data(), values.size());
+    for (const double q : {0.0, 0.5, 0.9, 0.99, 1.0}) {
+      CAPTURE(q);
+      const double actual = values[std::size_t(q * (values.size() - 1))];
+      REQUIRE(std::abs(sketch.quantile(q) - actual) / actual <=
+              sketch.relative_accuracy() + 1e-9);
+    }
+  }
+
+  SECTION("the number of bins is bounded") {
+    DDSketch sketch;
+    for (double value = 1e-300; value < 1e300; value *= 10) {
+      sketch.add(value);
+    }
+    std::string encoded;
+    sketch.encode(encoded);
+    REQUIRE(sketch.count() == 600);
+    REQUIRE(encoded.size() < DDSketch::max_bins * 8 + 64);
+    // The highest quantiles are unaffected by collapsing.
+    REQUIRE(std::abs(sketch.quantile(1) - 1e299) / 1e299 <=
+            sketch.relative_accuracy() + 1e-9);
+  }
+}
+
+TEST_CASE("StatsConcentrator", "[stats]") {
+  const TracerSignature signature{RuntimeID::generate(), "defaultsvc",
+                                  "defaultenv"};
+  StatsConcentrator concentrator{signature, std::make_shared<NullLogger>()};
+
+  SECTION("nothing to flush") {
+    REQUIRE(concentrator.flush(bucket_start + 1h, true).empty());
+  }
+
+  SECTION("top-level and measured spans are aggregated") {
+    std::vector<std::unique_ptr<SpanData>> spans;
+    spans.push_back(make_span(1, 0, "web"));
+    // not top-level
+    spans.push_back(make_span(2, 1, "web"));
+    // measured
+    spans.push_back(make_span(3, 1, "web"));
+    spans.back()->name = "query";
+    spans.back()->numeric_tags[tags::internal::measured] = 1;
+    // top-level, because its service differs from its parent's
+    spans.push_back(make_span(4, 1, "db", 3ms));
+    spans.back()->error = true;
+    spans.push_back(make_span(5, 1, "db", 5ms));
+    spans.back()->tags[tags::http_status_code] = "503";
+    concentrator.add(spans);
+
+    // Top-level spans are marked as such.
+    REQUIRE(spans[0]->numeric_tags.count(tags::internal::top_level));
+    REQUIRE(!spans[1]->numeric_tags.count(tags::internal::top_level));
+    REQUIRE(!spans[2]->numeric_tags.count(tags::internal::top_level));
+    REQUIRE(spans[3]->numeric_tags.count(tags::internal::top_level));
+
+    // The bucket has not yet ended.
+    REQUIRE(concentrator.flush(bucket_start + 9s, false).empty());
+
+    const auto bodies = concentrator.flush(bucket_start + 10s, false);
+    REQUIRE(bodies.size() == 1);
+    const auto payload = nlohmann::json::from_msgpack(bodies[0]);
+    REQUIRE(payload["Env"] == "");
+    REQUIRE(payload["Lang"] == "cpp");
+    REQUIRE(payload["Service"] == "defaultsvc");
+    REQUIRE(payload["RuntimeID"] == signature.runtime_id.string());
+    REQUIRE(payload["Sequence"] == 1);
+    REQUIRE(payload["Stats"].size() == 1);
+    const auto& bucket = payload["Stats"][0];
+    REQUIRE(bucket["Start"] == nanoseconds(bucket_start));
+    REQUIRE(bucket["Duration"] == 10'000'000'000ULL);
+
+    auto groups = bucket["Stats"];
+    REQUIRE(groups.size() == 4);
+    const auto find = [&](StringView service, StringView name,
+                          int status) -> const nlohmann::json& {
+      for (const auto& group : groups) {
+        if (group["Service"] == service && group["Name"] == name &&
+            group["HTTPStatusCode"] == status) {
+          return group;
+        }
+      }
+      FAIL("no such group");
+      return groups[0];
+    };
+
+    const auto& root = find("web", "handle", 0);
+    REQUIRE(root["Hits"] == 1);
+    REQUIRE(root["TopLevelHits"] == 1);
+    REQUIRE(root["Errors"] == 0);
+    REQUIRE(root["Duration"] == 1'000'000);
+    REQUIRE(root["Resource"] == "GET /");
+    REQUIRE(root["Type"] == "web");
+    REQUIRE(root["Synthetics"] == false);
+    REQUIRE(root["OkSummary"].is_binary());
+
+    const auto& measured = find("web", "query", 0);
+    REQUIRE(measured["Hits"] == 1);
+    REQUIRE(measured["TopLevelHits"] == 0);
+
+    const auto& error = find("db", "handle", 0);
+    REQUIRE(error["Hits"] == 1);
+    REQUIRE(error["Errors"] == 1);
+    REQUIRE(error["Duration"] == 3'000'000);
+
+    const auto& status = find("db", "handle", 503);
+    REQUIRE(status["Hits"] == 1);
+    REQUIRE(status["TopLevelHits"] == 1);
+
+    // Flushed buckets are not sent again.
+    REQUIRE(concentrator.flush(bucket_start + 1h, true).empty());
+  }
+
+  SECTION("spans in the same group are combined") {
+    for (int i = 0; i < 3; ++i) {
+      std::vector<std::unique_ptr<SpanData>> spans;
+      spans.push_back(make_span(1, 0, "web", 2ms));
+      spans.back()->tags[tags::internal::origin] = "synthetics-browser";
+      concentrator.add(spans);
+    }
+    const auto bodies = concentrator.flush(bucket_start, true);
+    REQUIRE(bodies.size() == 1);
+    const auto payload = nlohmann::json::from_msgpack(bodies[0]);
+    const auto& group = payload["Stats"][0]["Stats"][0];
+    REQUIRE(group["Hits"] == 3);
+    REQUIRE(group["Duration"] == 6'000'000);
+    REQUIRE(group["Synthetics"] == true);
+  }
+
+  SECTION("each environment and version is reported separately") {
+    for (const char* env : {"prod", "staging"}) {
+      std::vector<std::unique_ptr<SpanData>> spans;
+      spans.push_back(make_span(1, 0, "web"));
+      spans.back()->tags[tags::environment] = env;
+      spans.back()->tags[tags::version] = "1.2.3";
+      concentrator.add(spans);
+    }
+    const auto bodies = concentrator.flush(bucket_start + 10s, false);
+    REQUIRE(bodies.size() == 2);
+    const auto first = nlohmann::json::from_msgpack(bodies[0]);
+    const auto second = nlohmann::json::from_msgpack(bodies[1]);
+    REQUIRE(first["Env"] == "prod");
+    REQUIRE(second["Env"] == "staging");
+    REQUIRE(first["Version"] == "1.2.3");
+    REQUIRE(first["Sequence"] != second["Sequence"]);
+  }
+
+  SECTION("spans are bucketed by their end time") {
+    std::vector<std::unique_ptr<SpanData>> spans;
+    spans.push_back(make_span(1, 0, "web", 12s));
+    concentrator.add(spans);
+    REQUIRE(concentrator.flush(bucket_start + 10s, false).empty());
+    const auto bodies = concentrator.flush(bucket_start + 20s, false);
+    REQUIRE(bodies.size() == 1);
+    const auto payload = nlohmann::json::from_msgpack(bodies[0]);
+    REQUIRE(payload["Stats"][0]["Start"] == nanoseconds(bucket_start + 10s));
+  }
+}
@@ -0,0 +1,103 @@
+// These are tests for `TracerConfig::thread_factory`, which starts the threads
+// that the tracer runs in the background.
+
+#include <datadog/thread_factory.h>
+#include <datadog/threaded_event_scheduler.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `RecordingThreadFactory` starts plain threads, and remembers their names.
+struct RecordingThreadFactory {
+  std::mutex mutex;
+  std::vector<std::string> names;
+
+  ThreadFactory factory() {
+    return [this](StringView name, std::function<void()> body) {
+      std::lock_guard<std::mutex> lock(mutex);
+      names.emplace_back(name);
+      return std::thread(std::move(body));
+    };
+  }
+
+  bool started(StringView name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::find(names.begin(), names.end(), name) != names.end();
+  }
+};
+
+}  // namespace
+
+TEST_CASE("start_thread", "[thread_factory]") {
+  bool ran = false;
+
+  SECTION("uses std::thread without a factory") {
+    start_thread(nullptr, "test", [&]() { ran = true; }).join();
+  }
+
+  SECTION("uses the factory") {
+    RecordingThreadFactory recorder;
+    start_thread(recorder.factory(), "test", [&]() { ran = true; }).join();
+    REQUIRE(recorder.started("test"));
+  }
+
+  REQUIRE(ran);
+}
+
+TEST_CASE("ThreadedEventScheduler uses the thread factory",
+          "[thread_factory]") {
+  RecordingThreadFactory recorder;
+  std::promise<void> ran;
+  {
+    ThreadedEventScheduler scheduler{1, recorder.factory()};
+    REQUIRE(scheduler.schedule_event([&]() { ran.set_value(); }));
+    ran.get_future().wait();
+  }
+  REQUIRE(recorder.started("dd-scheduler"));
+  REQUIRE(recorder.started("dd-scheduler-worker"));
+}
+
+TEST_CASE("TracerConfig::thread_factory", "[thread_factory]") {
+  RecordingThreadFactory recorder;
+  TracerConfig config;
+  config.service = "testsvc";
+  config.thread_factory = recorder.factory();
+  config.background_finalization = true;
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+  config.telemetry.enabled = false;
+
+  SECTION("starts the tracer's threads") {
+    config.logger = std::make_shared<NullLogger>();
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      Tracer tracer{*finalized};
+      tracer.create_span();
+    }
+    REQUIRE(recorder.started("dd-scheduler"));
+    REQUIRE(recorder.started("dd-finalizer"));
+  }
+
+  SECTION("starts the thread of the asynchronous default logger") {
+    config.async_logging = true;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(recorder.started("dd-logger"));
+  }
+}
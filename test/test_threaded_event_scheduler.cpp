@@ -0,0 +1,202 @@
+// These are tests for `ThreadedEventScheduler`, which runs events on a
+// dedicated thread.
+
+#include <datadog/threaded_event_scheduler.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Wait until the specified `condition` is satisfied, or until a few seconds
+// have passed.  Return whether `condition` was satisfied.
+template <typename Condition>
+bool eventually(Condition&& condition) {
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST_CASE("ThreadedEventScheduler runs one-off events") {
+  ThreadedEventScheduler scheduler;
+  std::atomic<int> count{0};
+  for (int i = 0; i < 10; ++i) {
+    REQUIRE(scheduler.schedule_event([&]() { ++count; }));
+  }
+  REQUIRE(eventually([&]() { return count == 10; }));
+}
+
+TEST_CASE("ThreadedEventScheduler runs recurring events at their intervals") {
+  ThreadedEventScheduler scheduler;
+  std::mutex mutex;
+  std::vector<int> order;
+  std::vector<EventScheduler::Cancel> cancels;
+  // Schedule events out of order.  Each records itself the first time it
+  // runs.
+  for (const int interval_ms : {300, 100, 200}) {
+    cancels.push_back(scheduler.schedule_recurring_event(
+        std::chrono::milliseconds(interval_ms),
+        [&, interval_ms, recorded = false]() mutable {
+          if (!recorded) {
+            recorded = true;
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(interval_ms);
+          }
+        }));
+  }
+
+  REQUIRE(eventually([&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size() == 3;
+  }));
+  for (auto& cancel : cancels) {
+    cancel();
+  }
+  REQUIRE(order == std::vector<int>{100, 200, 300});
+}
+
+TEST_CASE("ThreadedEventScheduler runs many recurring events") {
+  ThreadedEventScheduler scheduler;
+  const int num_events = 500;
+  std::vector<std::atomic<int>> counts(num_events);
+  std::vector<EventScheduler::Cancel> cancels;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_events; ++i) {
+    cancels.push_back(scheduler.schedule_recurring_event(
+        std::chrono::milliseconds(1 + i % 50),
+        [&counts, i]() { ++counts[i]; }));
+  }
+
+  REQUIRE(eventually([&]() {
+    for (const auto& count : counts) {
+      if (count < 2) {
+        return false;
+      }
+    }
+    return true;
+  }));
+  for (auto& cancel : cancels) {
+    cancel();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  // No event runs more often than its interval allows.
+  for (int i = 0; i < num_events; ++i) {
+    CAPTURE(i);
+    REQUIRE(counts[i] <= elapsed / std::chrono::milliseconds(1 + i % 50));
+  }
+}
+
+TEST_CASE("ThreadedEventScheduler runs callbacks on workers") {
+  ThreadedEventScheduler scheduler{2};
+  std::atomic<bool> slow_started{false};
+  std::atomic<bool> release{false};
+  std::atomic<int> count{0};
+  auto cancel_slow = scheduler.schedule_recurring_event(1ms, [&]() {
+    slow_started = true;
+    while (!release) {
+      std::this_thread::sleep_for(1ms);
+    }
+  });
+  auto cancel_fast = scheduler.schedule_recurring_event(1ms, [&]() {
+    ++count;
+  });
+
+  // The fast event keeps running while the slow one is stuck.
+  REQUIRE(eventually([&]() { return slow_started.load(); }));
+  const int before = count;
+  REQUIRE(eventually([&]() { return count >= before + 10; }));
+  release = true;
+  cancel_slow();
+  cancel_fast();
+  REQUIRE(scheduler.config().find("\"max_workers\":2") != std::string::npos);
+}
+
+TEST_CASE("ThreadedEventScheduler cancellation") {
+  // Cancellation behaves the same whether callbacks run on the dispatching
+  // thread or on workers.
+  ThreadedEventScheduler scheduler{std::size_t(GENERATE(0, 2))};
+
+  SECTION("stops a recurring event") {
+    std::atomic<int> count{0};
+    auto cancel = scheduler.schedule_recurring_event(1ms, [&]() { ++count; });
+    REQUIRE(eventually([&]() { return count >= 3; }));
+    auto copy = cancel;
+    cancel();
+    const int final_count = count;
+    std::this_thread::sleep_for(20ms);
+    REQUIRE(count == final_count);
+    // Cancelling again, even through a copy, does nothing.
+    copy();
+    cancel();
+  }
+
+  SECTION("waits for a running callback") {
+    std::atomic<bool> started{false};
+    std::atomic<bool> finished{false};
+    auto cancel = scheduler.schedule_recurring_event(1ms, [&]() {
+      if (!started.exchange(true)) {
+        std::this_thread::sleep_for(50ms);
+        finished = true;
+      }
+    });
+    REQUIRE(eventually([&]() { return started.load(); }));
+    cancel();
+    REQUIRE(finished);
+  }
+
+  SECTION("asynchronously does not wait for a running callback") {
+    std::atomic<bool> started{false};
+    std::atomic<bool> release{false};
+    std::atomic<int> count{0};
+    auto cancel = scheduler.schedule_recurring_event_async_cancel(1ms, [&]() {
+      ++count;
+      started = true;
+      while (!release) {
+        std::this_thread::sleep_for(1ms);
+      }
+    });
+    REQUIRE(eventually([&]() { return started.load(); }));
+    auto done = cancel();
+    REQUIRE(done.wait_for(0s) == std::future_status::timeout);
+    // Cancelling again, before the callback returns, also waits for it.
+    auto done_again = cancel();
+    release = true;
+    done.wait();
+    done_again.wait();
+    REQUIRE(count == 1);
+    // Once the event is gone, cancellation is immediately complete.
+    REQUIRE(cancel().wait_for(0s) == std::future_status::ready);
+  }
+
+  SECTION("asynchronously of an event that is not running") {
+    auto cancel = scheduler.schedule_recurring_event_async_cancel(
+        24h, []() { REQUIRE(false); });
+    REQUIRE(cancel().wait_for(0s) == std::future_status::ready);
+  }
+
+  SECTION("of an event far in the future") {
+    std::atomic<int> count{0};
+    auto far = scheduler.schedule_recurring_event(24h, [&]() { ++count; });
+    auto near = scheduler.schedule_recurring_event(1ms, [&]() {});
+    far();
+    near();
+    REQUIRE(count == 0);
+  }
+}
@@ -0,0 +1,169 @@
+// These are tests for `TimerWheel`, which orders the upcoming events of
+// `ThreadedEventScheduler`.
+
+#include <datadog/timer_wheel.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+struct Timer : public TimerWheel::Node {
+  int id = 0;
+};
+
+// Level spans, in ticks, of a `TimerWheel`.
+constexpr std::uint64_t level_1 = TimerWheel::slots_per_level;
+constexpr std::uint64_t level_2 = level_1 * TimerWheel::slots_per_level;
+constexpr std::uint64_t level_3 = level_2 * TimerWheel::slots_per_level;
+constexpr std::uint64_t top = level_3 * TimerWheel::slots_per_level;
+
+}  // namespace
+
+TEST_CASE("TimerWheel pops each timer at its deadline") {
+  const std::uint64_t start = GENERATE(0, 1, 63, 64, 4095, 4097, 262143);
+  CAPTURE(start);
+  TimerWheel wheel{start};
+  REQUIRE(wheel.next_tick() == TimerWheel::never);
+  REQUIRE(wheel.pop_expired(start + top) == nullptr);
+  REQUIRE(wheel.now() == start + top + 1);
+
+  const std::uint64_t now = wheel.now();
+  const std::vector<std::uint64_t> offsets{
+      0,           1,           62,          63,      64,      65,
+      level_2 - 1, level_2,     level_2 + 1, level_3, top - 1, top,
+      top + 1,     3 * top + 7, 1,           64};
+  std::deque<Timer> timers(offsets.size());
+  for (std::size_t i = 0; i < offsets.size(); ++i) {
+    timers[i].id = int(i);
+    wheel.insert(timers[i], now + offsets[i]);
+    REQUIRE(timers[i].linked());
+    REQUIRE(timers[i].deadline() == now + offsets[i]);
+  }
+
+  std::vector<std::uint64_t> deadlines;
+  for (const auto offset : offsets) {
+    deadlines.push_back(now + offset);
+  }
+  std::sort(deadlines.begin(), deadlines.end());
+  deadlines.erase(std::unique(deadlines.begin(), deadlines.end()),
+                  deadlines.end());
+
+  std::size_t popped = 0;
+  for (const std::uint64_t deadline : deadlines) {
+    CAPTURE(deadline);
+    // Nothing is due before the deadline, and the wheel knows to wake up in
+    // time.
+    REQUIRE(wheel.next_tick() <= deadline);
+    if (deadline > wheel.now()) {
+      REQUIRE(wheel.pop_expired(deadline - 1) == nullptr);
+    }
+    while (auto* node = wheel.pop_expired(deadline)) {
+      REQUIRE(!node->linked());
+      REQUIRE(node->deadline() == deadline);
+      ++popped;
+    }
+    REQUIRE(wheel.now() == deadline + 1);
+  }
+  REQUIRE(popped == offsets.size());
+  REQUIRE(wheel.next_tick() == TimerWheel::never);
+}
+
+TEST_CASE("TimerWheel pops timers having the same deadline in order") {
+  TimerWheel wheel;
+  std::deque<Timer> timers(5);
+  for (std::size_t i = 0; i < timers.size(); ++i) {
+    timers[i].id = int(i);
+    wheel.insert(timers[i], 1000);
+  }
+
+  for (std::size_t i = 0; i < timers.size(); ++i) {
+    auto* node = wheel.pop_expired(1000);
+    REQUIRE(node);
+    REQUIRE(static_cast<Timer*>(node)->id == int(i));
+  }
+  REQUIRE(wheel.pop_expired(1000) == nullptr);
+}
+
+TEST_CASE("TimerWheel treats a past deadline as now") {
+  TimerWheel wheel{100};
+  Timer timer;
+  wheel.insert(timer, 10);
+  REQUIRE(timer.deadline() == 100);
+  REQUIRE(wheel.next_tick() == 100);
+  REQUIRE(wheel.pop_expired(100) == &timer);
+}
+
+TEST_CASE("TimerWheel does not pop removed timers") {
+  TimerWheel wheel;
+  Timer near, far, kept;
+  wheel.insert(near, 5);
+  wheel.insert(far, 100000);
+  wheel.insert(kept, 100000);
+  wheel.remove(near);
+  wheel.remove(far);
+  REQUIRE(!near.linked());
+  REQUIRE(!far.linked());
+  // Removing an unlinked timer does nothing.
+  wheel.remove(near);
+
+  REQUIRE(wheel.pop_expired(99999) == nullptr);
+  REQUIRE(wheel.pop_expired(100000) == &kept);
+  REQUIRE(wheel.pop_expired(100000) == nullptr);
+  REQUIRE(wheel.next_tick() == TimerWheel::never);
+
+  // A removed timer can be inserted again.
+  wheel.insert(near, 100005);
+  REQUIRE(wheel.pop_expired(100005) == &near);
+}
+
+TEST_CASE("TimerWheel agrees with sorting") {
+  // Insert, remove, and pop timers at random, and check that each timer is
+  // popped at the first `pop_expired` whose current tick is at or after its
+  // deadline.
+  std::mt19937_64 random{GENERATE(1, 2, 3)};
+  const auto below = [&](std::uint64_t bound) {
+    return std::uniform_int_distribution<std::uint64_t>{0, bound - 1}(random);
+  };
+
+  TimerWheel wheel;
+  std::deque<Timer> timers(2000);
+  std::uint64_t current = 0;
+  for (int round = 0; round < 200; ++round) {
+    for (int i = 0; i < 20; ++i) {
+      Timer& timer = timers[below(timers.size())];
+      if (timer.linked()) {
+        wheel.remove(timer);
+        continue;
+      }
+      // Mostly near deadlines, and some far ones.
+      const std::uint64_t spans[] = {level_1, level_2, level_3, 2 * top};
+      wheel.insert(timer, wheel.now() + below(spans[below(4)]));
+    }
+
+    std::uint64_t next_deadline = TimerWheel::never;
+    for (const Timer& timer : timers) {
+      if (timer.linked()) {
+        next_deadline = std::min(next_deadline, timer.deadline());
+      }
+    }
+    REQUIRE(wheel.next_tick() <= next_deadline);
+
+    current += below(2) ? below(level_1) : below(level_3);
+    while (auto* node = wheel.pop_expired(current)) {
+      REQUIRE(node->deadline() <= current);
+    }
+    for (const Timer& timer : timers) {
+      if (timer.linked()) {
+        REQUIRE(timer.deadline() > current);
+      }
+    }
+  }
+}
@@ -1,18 +1,25 @@
 #include <datadog/clock.h>
 #include <datadog/id_generator.h>
 #include <datadog/rate.h>
+#include <datadog/sampling_decision.h>
 #include <datadog/sampling_priority.h>
+#include <datadog/span_config.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
 
 #include <chrono>
 #include <limits>
 #include <map>
+#include <mutex>
 #include <ostream>
+#include <thread>
+#include <vector>
 
 #include "mocks/collectors.h"
 #include "mocks/loggers.h"
+#include "span_data.h"
 #include "test.h"
+#include "trace_sampler.h"
 
 namespace std {
 
@@ -157,6 +164,57 @@ TEST_CASE("trace sampling rate limiter") {
   REQUIRE(collector->count_of(SamplingPriority::USER_KEEP) == 1);
 }
 
+TEST_CASE("trace sampling rule rate limiter") {
+  // A rule having its own `max_per_second` is limited by its own limiter, so
+  // traces that it keeps do not use up the limit of the other rules.
+  TracerConfig config;
+  config.service = "testsvc";
+  TraceSamplerConfig::Rule noisy;
+  noisy.name = "noisy";
+  noisy.max_per_second = 5;
+  config.trace_sampler.rules.push_back(noisy);
+  config.trace_sampler.sample_rate = 1.0;
+  config.trace_sampler.max_per_second = 10;
+  const auto collector = std::make_shared<PriorityCountingCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+
+  TimePoint current_time = default_clock();
+  auto clock = [&current_time]() { return current_time; };
+
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  SpanConfig noisy_span;
+  noisy_span.name = "noisy";
+  for (int i = 0; i < 100; ++i) {
+    auto span = tracer.create_span(noisy_span);
+    (void)span;
+  }
+  REQUIRE(collector->count_of(SamplingPriority::USER_KEEP) == 5);
+
+  collector->sampling_priority_count.clear();
+  for (int i = 0; i < 100; ++i) {
+    auto span = tracer.create_span();
+    (void)span;
+  }
+  REQUIRE(collector->count_of(SamplingPriority::USER_KEEP) == 10);
+
+  // Decisions report the limit that applied, as does the configuration.
+  TraceSampler sampler{finalized->trace_sampler, clock};
+  SpanData span;
+  span.name = "noisy";
+  REQUIRE(sampler.decide(span).limiter_max_per_second == 5);
+  span.name = "quiet";
+  REQUIRE(sampler.decide(span).limiter_max_per_second == 10);
+
+  const auto rules = sampler.config_json()["rules"];
+  REQUIRE(rules.size() == 2);
+  REQUIRE(rules[0]["max_per_second"] == 5);
+  REQUIRE(!rules[1].contains("max_per_second"));
+}
+
 TEST_CASE("priority sampling") {
   // Verify that a `TraceSampler` not otherwise configured will use whichever
   // sample rates are sent back to it by the collector (Datadog Agent).
@@ -173,6 +231,8 @@ TEST_CASE("priority sampling") {
       {{"default rate", CollectorResponse::key_of_default_rate, 0.5, 0.5},
        {"testsvc on dev", "service:testsvc,env:dev", 0.5, 0.5},
        {"no match uses default of 100%", "service:unrelated,env:foo", 0.25,
+        1.0},
+       {"other env uses default of 100%", "service:testsvc,env:devel", 0.25,
         1.0}}));
 
   TracerConfig config;
@@ -204,6 +264,173 @@ TEST_CASE("priority sampling") {
           Approx(test_case.expected_rate).margin(0.05));
 }
 
+TEST_CASE("adaptive sampling") {
+  // Verify that, when adaptive sampling is configured, traces that no rule
+  // matches are kept at about the target rate, regardless of the rates sent
+  // back by the collector.
+  TracerConfig config;
+  config.service = "testsvc";
+  config.trace_sampler.adaptive_target_per_second = 100;
+  const auto collector =
+      std::make_shared<PriorityCountingCollectorWithResponse>();
+  collector->response
+      .sample_rate_by_key[CollectorResponse::key_of_default_rate] =
+      assert_rate(0.0);
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+
+  TimePoint now = default_clock();
+  const auto clock = [&now]() { return now; };
+  auto finalized = finalize_config(config, clock);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const std::size_t traces_per_second = 1'000;
+  const auto run_second = [&]() {
+    collector->sampling_priority_count.clear();
+    for (std::size_t i = 0; i < traces_per_second; ++i) {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    now += std::chrono::seconds(1);
+  };
+
+  // Until traffic has been counted, every trace is kept.
+  run_second();
+  REQUIRE(collector->count_of(SamplingPriority::USER_KEEP) ==
+          traces_per_second);
+
+  for (int i = 0; i < 20; ++i) {
+    run_second();
+  }
+  CAPTURE(collector->sampling_priority_count);
+  REQUIRE(collector->total_count() == traces_per_second);
+  REQUIRE(collector->count_of(SamplingPriority::USER_KEEP) ==
+          Approx(100).margin(30));
+}
+
+TEST_CASE("collector response keys are looked up without building them") {
+  struct TestCase {
+    std::string service;
+    std::string environment;
+    std::string other_key;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"testsvc", "dev", "service:testsvc,env:devel"},
+      {"testsvc", "dev", "service:testsv,env:dev"},
+      {"testsvc", "dev", "service:testsvc,env:"},
+      {"testsvc", "", "service:testsvc"},
+      {"", "", "service:,env:x"},
+  }));
+
+  CAPTURE(test_case.service);
+  CAPTURE(test_case.environment);
+  const std::string key =
+      CollectorResponse::key(test_case.service, test_case.environment);
+  REQUIRE(CollectorResponse::key_hash(key) ==
+          CollectorResponse::key_hash(test_case.service,
+                                      test_case.environment));
+  REQUIRE(CollectorResponse::key_equals(key, test_case.service,
+                                        test_case.environment));
+  REQUIRE_FALSE(CollectorResponse::key_equals(
+      test_case.other_key, test_case.service, test_case.environment));
+}
+
+TEST_CASE("a collector response already handled is skipped") {
+  auto config = finalize_config(TraceSamplerConfig{});
+  REQUIRE(config);
+  TraceSampler sampler{*config, default_clock};
+  SpanData root;
+  root.service = "testsvc";
+
+  const auto respond = [&](double rate, std::uint64_t body_hash) {
+    CollectorResponse response;
+    response.sample_rate_by_key[CollectorResponse::key_of_default_rate] =
+        assert_rate(rate);
+    response.body_hash = body_hash;
+    sampler.handle_collector_response(response);
+  };
+
+  respond(0.0, 42);
+  REQUIRE(sampler.has_collector_response(42));
+  REQUIRE(sampler.decide(root).priority == int(SamplingPriority::AUTO_DROP));
+
+  // The same hash is taken to mean the same rates.
+  respond(1.0, 42);
+  REQUIRE(sampler.decide(root).priority == int(SamplingPriority::AUTO_DROP));
+
+  // A response of unknown hash is always handled.
+  respond(1.0, 0);
+  REQUIRE(!sampler.has_collector_response(0));
+  REQUIRE(sampler.decide(root).priority == int(SamplingPriority::AUTO_KEEP));
+}
+
+TEST_CASE("priority sampling while sample rates change") {
+  // Verify that sampling decisions made on several threads at once are
+  // consistent with one of the sample rates sent back by the collector, while
+  // the collector's responses keep changing those rates.
+  struct AlternatingCollector : public Collector {
+    std::mutex mutex;
+    std::size_t num_traces = 0;
+    std::size_t num_unexpected = 0;
+
+    Expected<void> send(
+        std::vector<std::unique_ptr<SpanData>>&& spans,
+        const std::shared_ptr<TraceSampler>& response_handler) override {
+      CollectorResponse response;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto& root = *spans.front();
+        const auto found =
+            root.numeric_tags.find(tags::internal::sampling_priority);
+        if (found == root.numeric_tags.end() ||
+            (found->second != int(SamplingPriority::AUTO_KEEP) &&
+             found->second != int(SamplingPriority::AUTO_DROP))) {
+          ++num_unexpected;
+        }
+        const double rate = num_traces++ % 2 ? 0.0 : 1.0;
+        response.sample_rate_by_key["service:testsvc,env:dev"] =
+            assert_rate(rate);
+      }
+      response_handler->handle_collector_response(response);
+      return {};
+    }
+
+    std::string config() const override { return "{}"; }
+  };
+
+  const std::size_t num_threads = 4;
+  const std::size_t traces_per_thread = 1'000;
+
+  TracerConfig config;
+  config.service = "testsvc";
+  config.environment = "dev";
+  const auto collector = std::make_shared<AlternatingCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      for (std::size_t j = 0; j < traces_per_thread; ++j) {
+        auto span = tracer.create_span();
+        (void)span;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  REQUIRE(collector->num_traces == num_threads * traces_per_thread);
+  REQUIRE(collector->num_unexpected == 0);
+}
+
 TEST_CASE("sampling rules") {
   TracerConfig config;
   config.service = "testsvc";
@@ -7,7 +7,13 @@
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <datadog/json.hpp>
+#include <mutex>
 #include <regex>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include "matchers.h"
@@ -29,7 +35,7 @@ Rate assert_rate(double rate) {
 }  // namespace
 
 TEST_CASE("TraceSegment accessors") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -143,7 +149,7 @@ TEST_CASE("TraceSegment accessors") {
 }
 
 TEST_CASE("When Collector::send fails, TraceSegment logs the error.") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<FailureCollector>();
   config.collector = collector;
@@ -164,7 +170,7 @@ TEST_CASE("When Collector::send fails, TraceSegment logs the error.") {
 }
 
 TEST_CASE("TraceSegment finalization of spans") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -459,13 +465,409 @@ TEST_CASE("TraceSegment finalization of spans") {
   }
 }  // span finalizers
 
+TEST_CASE("unchanged x-datadog-tags are injected as extracted") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<MockLogger>();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  // A segment that changes nothing forwards the header that it extracted.
+  // One that filters the tags, or changes the decision maker, encodes them.
+  std::unordered_map<std::string, std::string> headers{
+      {"x-datadog-trace-id", "123"},
+      {"x-datadog-parent-id", "456"},
+      {"x-datadog-sampling-priority", "2"},
+      {"x-datadog-tags", "_dd.p.foo=bar,_dd.p.dm=-4"}};
+
+  SECTION("when the sampling decision is extracted") {
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    MockDictWriter writer;
+    span->inject(writer);
+    REQUIRE(writer.items.at("x-datadog-tags") == "_dd.p.foo=bar,_dd.p.dm=-4");
+  }
+
+  SECTION("but not when the tags were filtered") {
+    headers["x-datadog-tags"] = "_dd.p.foo=bar,other=ignored";
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    MockDictWriter writer;
+    span->inject(writer);
+    REQUIRE(writer.items.at("x-datadog-tags") == "_dd.p.foo=bar");
+  }
+
+  SECTION("but not when the decision maker changes") {
+    headers.erase("x-datadog-sampling-priority");
+    headers["x-datadog-tags"] = "_dd.p.foo=bar";
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    MockDictWriter writer;
+    span->inject(writer);
+    REQUIRE(writer.items.at("x-datadog-tags") == "_dd.p.foo=bar,_dd.p.dm=-0");
+  }
+}
+
+TEST_CASE("spans registered and finished concurrently") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const int num_threads = 8;
+  const int spans_per_thread = 200;
+  std::uint64_t root_id;
+  {
+    auto root = tracer.create_span();
+    root_id = root.id();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&, batch = i % 2 == 0]() {
+        for (int j = 0; j < spans_per_thread; j += 2) {
+          if (batch) {
+            auto children = root.create_children(2);
+          } else {
+            auto child = root.create_child();
+            auto grandchild = child.create_child();
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    // The trace is not sent until the root finishes.
+    REQUIRE(collector->chunks.empty());
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 1 + num_threads * spans_per_thread);
+  // The local root comes first, and every span is present exactly once.
+  REQUIRE(chunk.front()->span_id == root_id);
+  std::unordered_set<const SpanData*> distinct;
+  for (const auto& span : chunk) {
+    distinct.insert(span.get());
+  }
+  REQUIRE(distinct.size() == chunk.size());
+}
+
+TEST_CASE("partial flush") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.partial_flush_enabled = true;
+  config.partial_flush_min_spans = 3;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  std::uint64_t root_id;
+  {
+    auto root = tracer.create_span();
+    root_id = root.id();
+    auto open_child = root.create_child();
+    for (int i = 0; i < 2; ++i) {
+      auto child = root.create_child();
+    }
+    // Two finished spans are fewer than the minimum.
+    REQUIRE(collector->chunks.empty());
+
+    std::vector<std::uint64_t> expected_ids;
+    for (int i = 0; i < 3; ++i) {
+      auto child = root.create_child();
+      expected_ids.push_back(child.id());
+    }
+    // The third finished span triggered a flush of all three finished spans,
+    // oldest first.  The two after it are waiting.
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& chunk = collector->chunks.front();
+    REQUIRE(chunk.size() == 3);
+    REQUIRE(chunk[2]->span_id == expected_ids[0]);
+    for (const auto& span : chunk) {
+      REQUIRE(span->span_id != root_id);
+      REQUIRE(span->span_id != open_child.id());
+    }
+    // The first span of the chunk carries the sampling decision.
+    REQUIRE(chunk.front()->numeric_tags.count(
+        tags::internal::sampling_priority));
+  }
+
+  // Finishing `open_child` triggered another flush, and the local root is
+  // always sent last.
+  REQUIRE(collector->chunks.size() == 3);
+  REQUIRE(collector->chunks[1].size() == 3);
+  const auto& last_chunk = collector->chunks.back();
+  REQUIRE(last_chunk.size() == 1);
+  REQUIRE(last_chunk.front()->span_id == root_id);
+  REQUIRE(last_chunk.front()->numeric_tags.count(
+      tags::internal::sampling_priority));
+}
+
+TEST_CASE("span limit") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.max_spans_per_trace = 4;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  std::uint64_t root_id;
+  {
+    auto root = tracer.create_span();
+    root_id = root.id();
+    auto child = root.create_child();
+    // Of these, only the first two fit within the limit.
+    auto children = root.create_children(3);
+    // Neither a child beyond the limit nor its descendants are recorded, but
+    // they still have IDs of their own.  Only the child counts as over the
+    // limit.
+    auto over = root.create_child();
+    auto grandchild = over.create_child();
+    REQUIRE(over.id() != 0);
+    REQUIRE(grandchild.parent_id() == over.id());
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 4);
+  REQUIRE(chunk.front()->span_id == root_id);
+  REQUIRE(chunk.front()->numeric_tags.at(tags::internal::spans_over_limit) ==
+          2);
+  for (std::size_t i = 1; i < chunk.size(); ++i) {
+    REQUIRE(chunk[i]->numeric_tags.count(tags::internal::spans_over_limit) ==
+            0);
+  }
+
+  // Another trace has a limit of its own, and is not tagged unless it exceeds
+  // it.
+  collector->chunks.clear();
+  {
+    auto root = tracer.create_span();
+    auto child = root.create_child();
+  }
+  REQUIRE(collector->chunks.size() == 1);
+  REQUIRE(collector->chunks.front().size() == 2);
+  REQUIRE(collector->chunks.front().front()->numeric_tags.count(
+              tags::internal::spans_over_limit) == 0);
+}
+
+TEST_CASE("spans over the limit outlive the local root") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.max_spans_per_trace = 1;
+  // The "_dd.p.dm" trace tag is too large to inject.
+  config.max_tags_header_size = 1;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  Optional<Span> over;
+  {
+    auto root = tracer.create_span();
+    over.emplace(root.create_child());
+    REQUIRE(!over->recorded());
+  }
+  REQUIRE(collector->chunks.size() == 1);
+  REQUIRE(collector->first_span().numeric_tags.at(
+              tags::internal::spans_over_limit) == 1);
+
+  // The segment is finished, but the span still propagates the trace.
+  MockDictWriter writer;
+  over->inject(writer);
+  REQUIRE(writer.items.at("x-datadog-parent-id") ==
+          std::to_string(over->id()));
+  REQUIRE(writer.items.count("x-datadog-tags") == 0);
+}
+
+TEST_CASE("span summarization") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.span_summary_min_spans = 3;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const auto child = [](Span& parent, StringView name) {
+    auto span = parent.create_child();
+    span.set_name(name);
+    span.set_resource_name("GET");
+    return span;
+  };
+
+  std::uint64_t handler_id;
+  std::uint64_t failed_id;
+  {
+    auto root = tracer.create_span();
+    auto handler = child(root, "handler");
+    handler_id = handler.id();
+    for (int i = 0; i < 5; ++i) {
+      auto read = child(handler, "cache.get");
+      if (i == 2) {
+        read.set_error(true);
+        failed_id = read.id();
+      }
+    }
+    child(handler, "db.query");
+    // Too few to summarize.
+    child(root, "cache.get");
+    child(root, "cache.get");
+    // A span that has children is not a leaf, even if it resembles one.
+    auto parent = child(handler, "cache.get");
+    child(parent, "cache.get");
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& chunk = collector->chunks.front();
+  // root, handler, the summary, db.query, two reads under the root, and the
+  // read that has a child, and its child.
+  REQUIRE(chunk.size() == 8);
+
+  std::size_t summaries = 0;
+  for (const auto& span : chunk) {
+    const auto found = span->numeric_tags.find("_dd.summary.count");
+    if (found == span->numeric_tags.end()) {
+      continue;
+    }
+    ++summaries;
+    // The summary is the span that had an error.
+    REQUIRE(span->span_id == failed_id);
+    REQUIRE(span->parent_id == handler_id);
+    REQUIRE(span->error);
+    REQUIRE(found->second == 5);
+    REQUIRE(span->numeric_tags.at("_dd.summary.errors") == 1);
+    REQUIRE(span->numeric_tags.at("_dd.summary.duration.max") <=
+            span->numeric_tags.at("_dd.summary.duration.total"));
+  }
+  REQUIRE(summaries == 1);
+}
+
+TEST_CASE("partial flush of spans finished concurrently") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.partial_flush_enabled = true;
+  config.partial_flush_min_spans = 16;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const int num_threads = 8;
+  const int spans_per_thread = 200;
+  {
+    auto root = tracer.create_span();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&]() {
+        for (int j = 0; j < spans_per_thread; j += 2) {
+          auto child = root.create_child();
+          auto grandchild = child.create_child();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  // Every span is sent exactly once, and the local root is sent last.
+  REQUIRE(collector->chunks.size() > 1);
+  std::unordered_set<const SpanData*> distinct;
+  std::size_t num_spans = 0;
+  for (const auto& chunk : collector->chunks) {
+    num_spans += chunk.size();
+    for (const auto& span : chunk) {
+      distinct.insert(span.get());
+    }
+  }
+  REQUIRE(num_spans == 1 + num_threads * spans_per_thread);
+  REQUIRE(distinct.size() == num_spans);
+  REQUIRE(collector->chunks.back().front()->parent_id == 0);
+}
+
+TEST_CASE("background finalization") {
+  // `SignalingCollector` records the thread on which chunks are sent, and
+  // allows the test to wait for them.
+  struct SignalingCollector : public Collector {
+    std::mutex mutex;
+    std::condition_variable sent;
+    std::vector<std::vector<std::unique_ptr<SpanData>>> chunks;
+    std::thread::id sender;
+
+    Expected<void> send(std::vector<std::unique_ptr<SpanData>>&& spans,
+                        const std::shared_ptr<TraceSampler>&) override {
+      std::lock_guard<std::mutex> lock(mutex);
+      chunks.emplace_back(std::move(spans));
+      sender = std::this_thread::get_id();
+      sent.notify_all();
+      return {};
+    }
+
+    std::string config() const override {
+      return nlohmann::json::object({{"type", "SignalingCollector"}}).dump();
+    }
+  };
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<SignalingCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.background_finalization = true;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Optional<Tracer> tracer{*finalized};
+
+  std::uint64_t root_id;
+  {
+    auto root = tracer->create_span();
+    root_id = root.id();
+    auto child = root.create_child();
+    SECTION("tracer outlives the trace") {}
+    SECTION("tracer destroyed before the trace finishes") { tracer.reset(); }
+  }
+
+  std::unique_lock<std::mutex> lock(collector->mutex);
+  REQUIRE(collector->sent.wait_for(lock, std::chrono::seconds(10), [&]() {
+    return !collector->chunks.empty();
+  }));
+  REQUIRE(collector->chunks.size() == 1);
+  REQUIRE(collector->sender != std::this_thread::get_id());
+  const auto& chunk = collector->chunks.front();
+  REQUIRE(chunk.size() == 2);
+  REQUIRE(chunk.front()->span_id == root_id);
+  REQUIRE(chunk.front()->numeric_tags.count(tags::internal::sampling_priority));
+}
+
 TEST_CASE("independent of Tracer") {
   // This test verifies that a `TraceSegment` (via the `Span`s that refer to it)
   // can continue to operate even after the `Tracer` that created it is
   // destroyed.
   //
   // Primarily, the test checks that the code doesn't crash in this scenario.
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.name = "do.thing";
   config.collector = std::make_shared<NullCollector>();
@@ -480,3 +882,123 @@ TEST_CASE("independent of Tracer") {
 
   tracer.reset();
 }
+
+TEST_CASE("tail sampling policy") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  // The sampler drops every trace.
+  config.trace_sampler.sample_rate = 0;
+  TraceSamplerConfig::TailPolicy policy;
+  policy.keep_errors = true;
+  policy.latency_threshold = std::chrono::seconds(10);
+  policy.resource_latency_thresholds["GET /slow"] = std::chrono::minutes(10);
+  policy.min_span_count = 4;
+  config.trace_sampler.tail_policy = policy;
+
+  const auto priority = [&]() {
+    REQUIRE(collector->chunks.size() == 1);
+    return collector->first_span().numeric_tags.at(
+        tags::internal::sampling_priority);
+  };
+
+  SECTION("an ordinary trace is dropped") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+    }
+    REQUIRE(priority() == -1);
+  }
+
+  SECTION("a trace having an error is kept") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      child.set_error(true);
+    }
+    REQUIRE(priority() == 2);
+    REQUIRE(collector->first_span().tags.at(
+                tags::internal::decision_maker) == "-4");
+  }
+
+  SECTION("a slow trace is kept") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      root.set_end_time(std::chrono::steady_clock::now() +
+                        std::chrono::seconds(11));
+    }
+    REQUIRE(priority() == 2);
+  }
+
+  SECTION("latency thresholds can depend on the resource") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      root.set_resource_name("GET /slow");
+      root.set_end_time(std::chrono::steady_clock::now() +
+                        std::chrono::seconds(11));
+    }
+    REQUIRE(priority() == -1);
+  }
+
+  SECTION("a trace having many spans is kept") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      for (int i = 0; i < 3; ++i) {
+        root.create_child();
+      }
+    }
+    REQUIRE(priority() == 2);
+  }
+
+  SECTION("spans are recorded despite an early decision") {
+    config.early_sampling_decision = true;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      child.set_error(true);
+    }
+    REQUIRE(priority() == 2);
+    REQUIRE(collector->span_count() == 2);
+  }
+
+  SECTION("a manual drop is respected") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      root.trace_segment().override_sampling_priority(
+          SamplingPriority::USER_DROP);
+      root.set_error(true);
+    }
+    REQUIRE(priority() == -1);
+  }
+
+  SECTION("a negative latency threshold is an error") {
+    policy.latency_threshold = std::chrono::milliseconds(-1);
+    config.trace_sampler.tail_policy = policy;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_TAIL_SAMPLING_POLICY);
+  }
+}
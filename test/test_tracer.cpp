@@ -3,6 +3,9 @@
 
 #include <datadog/error.h>
 #include <datadog/hex.h>
+#include <datadog/id_generator.h>
+#include <datadog/json.hpp>
+#include <datadog/memory_resource.h>
 #include <datadog/null_collector.h>
 #include <datadog/optional.h>
 #include <datadog/parse_util.h>
@@ -11,8 +14,10 @@
 #include <datadog/span_config.h>
 #include <datadog/span_data.h>
 #include <datadog/span_defaults.h>
+#include <datadog/stage_timings.h>
 #include <datadog/tag_propagation.h>
 #include <datadog/tags.h>
+#include <datadog/trace_context.h>
 #include <datadog/trace_id.h>
 #include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
@@ -23,15 +28,25 @@
 #include <ctime>
 #include <iosfwd>
 #include <stdexcept>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 
 #include "matchers.h"
 #include "mocks/collectors.h"
 #include "mocks/dict_readers.h"
 #include "mocks/dict_writers.h"
+#include "mocks/http_clients.h"
 #include "mocks/loggers.h"
 #include "test.h"
 
+// clang-format off
+#if !defined(_MSC_VER)
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+// clang-format on
+
 namespace datadog {
 namespace tracing {
 
@@ -48,11 +63,25 @@ std::ostream& operator<<(std::ostream& stream,
 
 using namespace datadog::tracing;
 
+namespace {
+
+// Return the string tags of the specified `span`, both its own and those that
+// it inherits from its `SpanDefaults`.
+FlatMap<std::string> all_tags(const SpanData& span) {
+  FlatMap<std::string> result;
+  span.for_each_tag([&](StringView key, StringView value) {
+    result.emplace(key, value);
+  });
+  return result;
+}
+
+}  // namespace
+
 // Verify that the `.defaults.*` (`SpanDefaults`) properties of a tracer's
 // configuration do determine the default properties of spans created by the
 // tracer.
 TEST_CASE("tracer span defaults") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "foosvc";
   config.service_type = "crawler";
   config.environment = "swamp";
@@ -128,10 +157,10 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(root.environment() == config.environment);
     REQUIRE(root.version() == config.version);
     REQUIRE(root.name == config.name);
-    REQUIRE_THAT(root.tags, ContainsSubset(*config.tags));
+    REQUIRE_THAT(all_tags(root), ContainsSubset(*config.tags));
 
-    REQUIRE(root.tags.count(tags::version) == 1);
-    REQUIRE(root.tags.find(tags::version)->second == config.version);
+    REQUIRE(all_tags(root).count(tags::version) == 1);
+    REQUIRE(all_tags(root).at(tags::version) == config.version);
   }
 
   SECTION("can be overridden in a root span") {
@@ -155,10 +184,10 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(root.environment() == overrides.environment);
     REQUIRE(root.version() == overrides.version);
     REQUIRE(root.name == overrides.name);
-    REQUIRE_THAT(root.tags, ContainsSubset(overrides.tags));
+    REQUIRE_THAT(all_tags(root), ContainsSubset(overrides.tags));
 
-    REQUIRE(root.tags.count(tags::version) == 1);
-    REQUIRE(root.tags.find(tags::version)->second == overrides.version);
+    REQUIRE(all_tags(root).count(tags::version) == 1);
+    REQUIRE(all_tags(root).at(tags::version) == overrides.version);
   }
 
   SECTION("are honored in an extracted span") {
@@ -182,10 +211,10 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(span.environment() == config.environment);
     REQUIRE(span.version() == config.version);
     REQUIRE(span.name == config.name);
-    REQUIRE_THAT(span.tags, ContainsSubset(*config.tags));
+    REQUIRE_THAT(all_tags(span), ContainsSubset(*config.tags));
 
-    REQUIRE(span.tags.count(tags::version) == 1);
-    REQUIRE(span.tags.find(tags::version)->second == config.version);
+    REQUIRE(all_tags(span).count(tags::version) == 1);
+    REQUIRE(all_tags(span).at(tags::version) == config.version);
   }
 
   SECTION("can be overridden in an extracted span") {
@@ -209,10 +238,10 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(span.environment() == overrides.environment);
     REQUIRE(span.version() == overrides.version);
     REQUIRE(span.name == overrides.name);
-    REQUIRE_THAT(span.tags, ContainsSubset(overrides.tags));
+    REQUIRE_THAT(all_tags(span), ContainsSubset(overrides.tags));
 
-    REQUIRE(span.tags.count(tags::version) == 1);
-    REQUIRE(span.tags.find(tags::version)->second == overrides.version);
+    REQUIRE(all_tags(span).count(tags::version) == 1);
+    REQUIRE(all_tags(span).at(tags::version) == overrides.version);
   }
 
   SECTION("are honored in a child span") {
@@ -239,10 +268,10 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(child.environment() == config.environment);
     REQUIRE(child.version() == config.version);
     REQUIRE(child.name == config.name);
-    REQUIRE_THAT(child.tags, ContainsSubset(*config.tags));
+    REQUIRE_THAT(all_tags(child), ContainsSubset(*config.tags));
 
-    REQUIRE(child.tags.count(tags::version) == 1);
-    REQUIRE(child.tags.find(tags::version)->second == config.version);
+    REQUIRE(all_tags(child).count(tags::version) == 1);
+    REQUIRE(all_tags(child).at(tags::version) == config.version);
   }
 
   SECTION("can be overridden in a child span") {
@@ -269,10 +298,10 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(child.environment() == overrides.environment);
     REQUIRE(child.version() == overrides.version);
     REQUIRE(child.name == overrides.name);
-    REQUIRE_THAT(child.tags, ContainsSubset(overrides.tags));
+    REQUIRE_THAT(all_tags(child), ContainsSubset(overrides.tags));
 
-    REQUIRE(child.tags.count(tags::version) == 1);
-    REQUIRE(child.tags.find(tags::version)->second == overrides.version);
+    REQUIRE(all_tags(child).count(tags::version) == 1);
+    REQUIRE(all_tags(child).at(tags::version) == overrides.version);
   }
 
   SECTION("can be overridden in a child span with empty values") {
@@ -300,14 +329,14 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(child.version() == nullopt);  // version is not inherited since the
                                           // service name is different
     REQUIRE(child.name == config.name);
-    REQUIRE_THAT(child.tags, ContainsSubset(*config.tags));
+    REQUIRE_THAT(all_tags(child), ContainsSubset(*config.tags));
 
-    REQUIRE(child.tags.count(tags::version) == 0);
+    REQUIRE(all_tags(child).count(tags::version) == 0);
   }
 }
 
 TEST_CASE("span extraction") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -483,6 +512,44 @@ TEST_CASE("span extraction") {
     }
   }
 
+  SECTION("extraction failures name the headers examined") {
+    struct TestCase {
+      int line;
+      std::string name;
+      std::vector<PropagationStyle> extraction_styles;
+      std::unordered_map<std::string, std::string> headers;
+      std::string expected_headers;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {__LINE__,
+         "bad x-datadog-trace-id",
+         {PropagationStyle::DATADOG},
+         {{"x-datadog-trace-id", "f"}, {"x-datadog-parent-id", "456"}},
+         "[x-datadog-trace-id: f]"},
+        {__LINE__,
+         "missing parent span ID",
+         {PropagationStyle::W3C, PropagationStyle::DATADOG},
+         {{"x-datadog-trace-id", "123"}, {"x-datadog-sampling-priority", "1"}},
+         "[x-datadog-trace-id: 123, x-datadog-sampling-priority: 1]"},
+    }));
+
+    CAPTURE(test_case.line);
+    CAPTURE(test_case.name);
+
+    config.extraction_styles = test_case.extraction_styles;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+
+    MockDictReader reader{test_case.headers};
+    auto result = tracer.extract_span(reader);
+    REQUIRE(!result);
+    CAPTURE(result.error().message);
+    REQUIRE(result.error().message.find(test_case.expected_headers) !=
+            std::string::npos);
+  }
+
   SECTION("extracted span has the expected properties") {
     struct TestCase {
       int line;
@@ -739,6 +806,18 @@ TEST_CASE("span extraction") {
         {__LINE__, "invalid: trailing characters when version is zero",
          "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00-foo", // traceparent
          "malformed_traceparent"}, // expected_error_tag_value
+
+        {__LINE__, "invalid: upper case hex",
+         "00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-00", // traceparent
+         "malformed_traceparent"}, // expected_error_tag_value
+
+        {__LINE__, "invalid: non-hex character",
+         "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902g7-00", // traceparent
+         "malformed_traceparent"}, // expected_error_tag_value
+
+        {__LINE__, "invalid: line break in extra fields",
+         "06-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00-af\ndelta", // traceparent
+         "malformed_traceparent"}, // expected_error_tag_value
     }));
     // clang-format on
 
@@ -1139,7 +1218,7 @@ TEST_CASE("span extraction") {
     CAPTURE(test_case.traceparent);
     CAPTURE(test_case.tracestate);
 
-    std::unordered_map<std::string, std::string> span_tags;
+    FlatMap<std::string> span_tags;
     MockLogger logger;
     CAPTURE(logger.entries);
     CAPTURE(span_tags);
@@ -1257,7 +1336,7 @@ TEST_CASE("span extraction") {
     const auto collector = std::make_shared<MockCollector>();
     const auto logger = std::make_shared<MockLogger>();
 
-    TracerConfig config;
+    TracerConfig config{};
     config.collector = collector;
     config.logger = logger;
     config.service = "service1";
@@ -1341,6 +1420,41 @@ TEST_CASE("span extraction") {
       REQUIRE(tracer.extract_span(reader));
     }
 
+    SECTION("tags are visited as views into x-datadog-tags") {
+      const std::string header_value = "foo=bar,_dd.p.a=b=c,_dd.p.empty=,";
+      std::vector<std::pair<std::string, std::string>> visited;
+      const auto result =
+          visit_tags(header_value, [&](StringView key, StringView value) {
+            REQUIRE(key.data() >= header_value.data());
+            REQUIRE(value.data() + value.size() <=
+                    header_value.data() + header_value.size());
+            visited.emplace_back(std::string(key), std::string(value));
+          });
+      REQUIRE(result);
+      const std::vector<std::pair<std::string, std::string>> expected{
+          {"foo", "bar"}, {"_dd.p.a", "b=c"}, {"_dd.p.empty", ""}};
+      REQUIRE(visited == expected);
+      REQUIRE(*decode_tags(header_value) == expected);
+    }
+
+    SECTION("no tags are visited when x-datadog-tags is invalid") {
+      const std::string header_value = "_dd.p.foo=bar,missing";
+      int visits = 0;
+      REQUIRE(!visit_tags(header_value,
+                          [&](StringView, StringView) { ++visits; }));
+      REQUIRE(visits == 0);
+
+      headers["x-datadog-tags"] = header_value;
+      auto span = tracer.extract_span(reader);
+      REQUIRE(span);
+      MockDictWriter writer;
+      span->inject(writer);
+      const auto injected = writer.items.find("x-datadog-tags");
+      if (injected != writer.items.end()) {
+        REQUIRE(injected->second.find("_dd.p.foo") == std::string::npos);
+      }
+    }
+
     SECTION("invalid _dd.p.tid") {
       const std::string header_value =
           "_dd.p.foobar=hello,_dd.p.tid=invalidhex";
@@ -1429,7 +1543,7 @@ TEST_CASE("span extraction") {
 }
 
 TEST_CASE("report hostname") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.collector = std::make_shared<NullCollector>();
   config.logger = std::make_shared<NullLogger>();
@@ -1450,6 +1564,68 @@ TEST_CASE("report hostname") {
   }
 }
 
+TEST_CASE("memory resource installed after spans were created") {
+  struct Resource : public MemoryResource {
+    void* allocate(std::size_t size) override { return ::operator new(size); }
+    void deallocate(void* block, std::size_t) noexcept override {
+      ::operator delete(block);
+    }
+  };
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.collector = std::make_shared<NullCollector>();
+  const auto logger = std::make_shared<MockLogger>();
+  config.logger = logger;
+
+  {
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    // This span is allocated from the global allocator.
+    tracer.create_span();
+  }
+  REQUIRE(logger->error_count() == 0);
+
+  config.memory_resource = std::make_shared<Resource>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+  REQUIRE(logger->error_count() == 1);
+  REQUIRE(logger->first_error().code == Error::MEMORY_RESOURCE_CONFLICT);
+}
+
+TEST_CASE("default ID generator") {
+  const auto generator = default_id_generator(false);
+  const std::uint64_t max_63_bit = 0x7fffffffffffffff;
+
+  SECTION("generates distinct 63-bit IDs") {
+    std::unordered_set<std::uint64_t> ids;
+    for (int i = 0; i < 10000; ++i) {
+      const std::uint64_t span_id = generator->span_id();
+      REQUIRE(span_id <= max_63_bit);
+      ids.insert(span_id);
+      const TraceID trace_id = generator->trace_id(default_clock());
+      REQUIRE(trace_id.high == 0);
+      REQUIRE(trace_id.low <= max_63_bit);
+    }
+    REQUIRE(ids.size() == 10000);
+  }
+
+  SECTION("is seeded differently on each thread") {
+    std::vector<std::uint64_t> first;
+    std::vector<std::uint64_t> second;
+    const auto fill = [&](std::vector<std::uint64_t>& ids) {
+      for (int i = 0; i < 4; ++i) {
+        ids.push_back(generator->span_id());
+      }
+    };
+    std::thread(fill, std::ref(first)).join();
+    std::thread(fill, std::ref(second)).join();
+    REQUIRE(first != second);
+  }
+}
+
 TEST_CASE("128-bit trace IDs") {
   // Use a clock that always returns a hard-coded `TimePoint`.
   // May 6, 2010 14:45:13 America/New_York
@@ -1460,7 +1636,7 @@ TEST_CASE("128-bit trace IDs") {
     return result;
   };
 
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.generate_128bit_trace_ids = true;
   const auto collector = std::make_shared<MockCollector>();
@@ -1579,7 +1755,7 @@ TEST_CASE(
   CAPTURE(test_case.line);
   CAPTURE(test_case.name);
 
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.generate_128bit_trace_ids = true;
   const auto collector = std::make_shared<MockCollector>();
@@ -1620,7 +1796,7 @@ TEST_CASE("sampling delegation extraction") {
   const auto logger = std::make_shared<NullLogger>();
   const auto collector = std::make_shared<NullCollector>();
 
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "test-sampling-delegation";
   config.logger = logger;
   config.collector = collector;
@@ -2105,10 +2281,15 @@ TEST_CASE("heterogeneous extraction") {
   CAPTURE(test_case.extracted_headers);
   CAPTURE(test_case.expected_injected_headers);
 
-  TracerConfig config;
+  // Extracting from one pass over the headers must yield the same result.
+  const bool single_pass_extraction = GENERATE(false, true);
+  CAPTURE(single_pass_extraction);
+
+  TracerConfig config{};
   config.service = "testsvc";
   config.extraction_styles = test_case.extraction_styles;
   config.injection_styles = test_case.injection_styles;
+  config.single_pass_extraction = single_pass_extraction;
   config.logger = std::make_shared<NullLogger>();
 
   auto finalized_config = finalize_config(config);
@@ -2125,9 +2306,214 @@ TEST_CASE("heterogeneous extraction") {
   REQUIRE(writer.items == test_case.expected_injected_headers);
 }
 
+TEST_CASE("single pass extraction") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.extraction_styles = {PropagationStyle::DATADOG, PropagationStyle::B3,
+                              PropagationStyle::W3C};
+  config.single_pass_extraction = true;
+  config.logger = std::make_shared<NullLogger>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SECTION("header names are matched case-insensitively") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"X-Datadog-Trace-Id", "48"},
+        {"X-DATADOG-PARENT-ID", "64"},
+        {"x-datadog-Origin", "Kansas"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id().low == 48);
+    REQUIRE(span->parent_id() == 64);
+    REQUIRE(span->trace_segment().origin() == "Kansas");
+  }
+
+  SECTION("the first of duplicate headers is used") {
+    // `MockDictReader` visits its map in an unspecified order, so visit a
+    // list instead.
+    class ListReader : public DictReader {
+     public:
+      std::vector<std::pair<std::string, std::string>> items;
+
+      Optional<StringView> lookup(StringView) const override {
+        throw std::logic_error("This test should not look up headers.");
+      }
+      void visit(Visitor visitor) const override {
+        for (const auto& [key, value] : items) {
+          visitor(key, value);
+        }
+      }
+    };
+
+    ListReader reader;
+    reader.items = {{"x-datadog-trace-id", "48"},
+                    {"x-datadog-parent-id", "64"},
+                    {"X-Datadog-Trace-Id", "49"}};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id().low == 48);
+    REQUIRE(span->parent_id() == 64);
+  }
+
+  SECTION("no tracing headers") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"content-type", "text/plain"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(!span);
+    REQUIRE(span.error().code == Error::NO_SPAN_TO_EXTRACT);
+  }
+}
+
+TEST_CASE("batch extraction") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  // Override the tracer's ID generator to count values and batches.
+  struct Generator : public IDGenerator {
+    mutable std::uint64_t next_id = 1;
+    mutable int batches = 0;
+    TraceID trace_id(const TimePoint&) const override {
+      return TraceID(next_id++);
+    }
+    std::uint64_t span_id() const override { return next_id++; }
+    void span_ids(std::uint64_t* ids, std::size_t count) const override {
+      ++batches;
+      IDGenerator::span_ids(ids, count);
+    }
+  };
+  const auto generator = std::make_shared<Generator>();
+  Tracer tracer{*finalized_config, generator};
+
+  const std::unordered_map<std::string, std::string> first{
+      {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+  const std::unordered_map<std::string, std::string> none{
+      {"content-type", "text/plain"}};
+  const std::unordered_map<std::string, std::string> orphan{
+      {"x-datadog-parent-id", "789"}};
+  const std::unordered_map<std::string, std::string> last{
+      {"x-datadog-trace-id", "321"},
+      {"x-datadog-parent-id", "654"},
+      {"x-datadog-sampling-priority", "2"}};
+  const MockDictReader readers[] = {MockDictReader{first},
+                                    MockDictReader{none},
+                                    MockDictReader{orphan},
+                                    MockDictReader{last}};
+  const DictReader* const reader_ptrs[] = {&readers[0], &readers[1],
+                                           &readers[2], &readers[3]};
+
+  {
+    SpanConfig span_config;
+    span_config.name = "consume";
+    auto spans = tracer.extract_spans(reader_ptrs, 4, span_config);
+    REQUIRE(generator->batches == 1);
+    REQUIRE(spans.size() == 4);
+
+    REQUIRE(spans[0]);
+    REQUIRE(spans[0]->trace_id() == 123);
+    REQUIRE(spans[0]->parent_id() == 456);
+    REQUIRE(spans[0]->name() == "consume");
+    REQUIRE(!spans[1]);
+    REQUIRE(spans[1].error().code == Error::NO_SPAN_TO_EXTRACT);
+    REQUIRE(!spans[2]);
+    REQUIRE(spans[2].error().code == Error::MISSING_TRACE_ID);
+    REQUIRE(spans[3]);
+    REQUIRE(spans[3]->trace_id() == 321);
+    REQUIRE(spans[3]->parent_id() == 654);
+    REQUIRE(spans[3]->id() != spans[0]->id());
+    const auto decision = spans[3]->trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(decision->priority == 2);
+
+    // Each error is the same as extracting from that reader alone.
+    const auto alone = tracer.extract_span(readers[2]);
+    REQUIRE(!alone);
+    REQUIRE(alone.error().message == spans[2].error().message);
+    REQUIRE(tracer.extract_spans(reader_ptrs, 0).empty());
+  }
+
+  // Each extracted span is the local root of its own trace segment.
+  REQUIRE(collector->chunks.size() == 2);
+}
+
+TEST_CASE("continue trace in process") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  config.injection_styles = {PropagationStyle::DATADOG, PropagationStyle::W3C};
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  const std::unordered_map<std::string, std::string> headers{
+      {"x-datadog-trace-id", "123"},
+      {"x-datadog-parent-id", "456"},
+      {"x-datadog-origin", "synthetics"},
+      {"x-datadog-tags", "_dd.p.dm=-4,_dd.p.tid=000000000000beef"},
+      {"x-datadog-sampling-priority", "2"}};
+  MockDictReader reader{headers};
+  auto producer = tracer.extract_span(reader);
+  REQUIRE(producer);
+  auto child = producer->create_child();
+
+  SECTION("is equivalent to injecting and then extracting") {
+    TraceContext context = child.export_trace_context();
+    REQUIRE(context.trace_id == child.trace_id());
+    REQUIRE(context.parent_id == child.id());
+    REQUIRE(context.sampling_priority == 2);
+    REQUIRE(context.origin == "synthetics");
+
+    MockDictWriter injected;
+    child.inject(injected);
+    MockDictReader injected_reader{injected.items};
+    auto extracted = tracer.extract_span(injected_reader);
+    REQUIRE(extracted);
+    auto continued = tracer.continue_trace(std::move(context));
+
+    REQUIRE(continued.trace_id() == extracted->trace_id());
+    REQUIRE(continued.parent_id() == child.id());
+    REQUIRE(continued.id() != child.id());
+    REQUIRE(continued.trace_segment().origin() == "synthetics");
+    REQUIRE(&continued.trace_segment() != &child.trace_segment());
+    const auto decision = continued.trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(decision->priority == 2);
+    REQUIRE(decision->origin == SamplingDecision::Origin::EXTRACTED);
+
+    MockDictWriter from_extracted;
+    extracted->inject(from_extracted);
+    MockDictWriter from_continued;
+    continued.inject(from_continued);
+    for (const char* header :
+         {"x-datadog-trace-id", "x-datadog-sampling-priority",
+          "x-datadog-origin", "x-datadog-tags"}) {
+      CAPTURE(header);
+      REQUIRE(from_continued.items.count(header) == 1);
+      REQUIRE(from_continued.items[header] == from_extracted.items[header]);
+    }
+  }
+
+  SECTION("makes a sampling decision if there isn't one") {
+    auto root = tracer.create_span();
+    REQUIRE(!root.trace_segment().sampling_decision());
+    const TraceContext context = root.export_trace_context();
+    const auto decision = root.trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(context.sampling_priority == decision->priority);
+    REQUIRE(context.parent_id == root.id());
+  }
+}
+
 TEST_CASE("move semantics") {
   // Verify that `Tracer` can be moved.
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   config.logger = std::make_shared<NullLogger>();
   config.collector = std::make_shared<MockCollector>();
@@ -2140,3 +2526,134 @@ TEST_CASE("move semantics") {
   Tracer tracer2{std::move(tracer1)};
   (void)tracer2;
 }
+
+TEST_CASE("config is computed once") {
+  // `ConfigCountingCollector` counts the calls to its `config`.
+  struct ConfigCountingCollector : public MockCollector {
+    mutable int config_calls = 0;
+
+    std::string config() const override {
+      ++config_calls;
+      return MockCollector::config();
+    }
+  };
+
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = std::make_shared<NullLogger>();
+  const auto collector = std::make_shared<ConfigCountingCollector>();
+  config.collector = collector;
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+  // The startup log computed the configuration.
+  REQUIRE(collector->config_calls == 1);
+
+  const auto first = tracer.config();
+  const auto second = tracer.config();
+  REQUIRE(first == second);
+  REQUIRE(collector->config_calls == 1);
+  REQUIRE(nlohmann::json::parse(first).contains("trace_sampler"));
+}
+
+#if !defined(_MSC_VER)
+TEST_CASE("reinitialize after fork") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.logger = std::make_shared<NullLogger>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.agent.http_client = http_client;
+  config.agent.flush_interval_milliseconds = 10;
+  config.agent.remote_configuration_enabled = false;
+  config.telemetry.enabled = false;
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+
+  // Return whether a request was sent within a few seconds.
+  const auto flushed = [&]() {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    do {
+      {
+        std::lock_guard<std::mutex> lock(http_client->mutex_);
+        if (!http_client->request_bodies.empty()) {
+          return true;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } while (std::chrono::steady_clock::now() < deadline);
+    return false;
+  };
+
+  Optional<Tracer> tracer{*finalized_config};
+  // Start the event scheduler's thread in the parent, and wait until it has
+  // nothing more to send.
+  { auto span = tracer->create_span(); }
+  REQUIRE(flushed());
+
+  const pid_t child = ::fork();
+  REQUIRE(child != -1);
+  if (child == 0) {
+    // The parent's scheduler thread does not exist in the child, so only a
+    // reinitialized tracer flushes the child's span on schedule.  Don't use
+    // Catch2 here.
+    http_client->request_bodies.clear();
+    tracer->reinitialize_after_fork();
+    { auto span = tracer->create_span(); }
+    const bool ok = flushed();
+    tracer.reset();
+    ::_exit(ok ? 0 : 1);
+  }
+
+  int status = 0;
+  REQUIRE(::waitpid(child, &status, 0) == child);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+}
+#endif
+
+TEST_CASE("stage timing") {
+  TracerConfig config{};
+  config.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<NullLogger>();
+
+  SECTION("is disabled by default") {
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    REQUIRE(tracer.stage_timings() == nullptr);
+  }
+
+  SECTION("records the duration of each stage") {
+    config.stage_timing = true;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    const auto timings = tracer.stage_timings();
+    REQUIRE(timings);
+
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+    }
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers};
+    {
+      auto span = tracer.extract_span(reader);
+      REQUIRE(span);
+    }
+    const std::unordered_map<std::string, std::string> no_headers;
+    REQUIRE(!tracer.extract_span(MockDictReader{no_headers}));
+
+    REQUIRE(timings->create_span.value() == 1);
+    REQUIRE(timings->extract_span.value() == 2);
+    REQUIRE(timings->span_finished.value() == 3);
+    REQUIRE(timings->sampler_decide.value() == 2);
+    // Chunks are sent to `MockCollector`, so nothing is encoded or flushed.
+    REQUIRE(timings->msgpack_encode.value() == 0);
+    REQUIRE(timings->flush.value() == 0);
+  }
+}
@@ -1,6 +1,11 @@
+#include <datadog/async_cerr_logger.h>
+#include <datadog/cerr_logger.h>
+#include <datadog/gzip.h>
 #include <datadog/id_generator.h>
+#include <datadog/lazy_http_client.h>
 #include <datadog/optional.h>
 #include <datadog/propagation_style.h>
+#include <datadog/reactor_event_scheduler.h>
 #include <datadog/threaded_event_scheduler.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
@@ -22,7 +27,9 @@
 #include "common/environment.h"
 #include "mocks/collectors.h"
 #include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
 #include "mocks/loggers.h"
+#include "mocks/reactors.h"
 #include "test.h"
 
 namespace datadog {
@@ -99,7 +106,7 @@ class SomewhatSecureTemporaryFile : public std::fstream {
 }  // namespace
 
 TEST_CASE("TracerConfig::defaults") {
-  TracerConfig config;
+  TracerConfig config{};
 
   SECTION("service is not required") {
     SECTION("empty") {
@@ -232,7 +239,7 @@ TEST_CASE("TracerConfig::defaults") {
 }
 
 TEST_CASE("TracerConfig::log_on_startup") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto logger = std::make_shared<MockLogger>();
   config.logger = logger;
@@ -292,8 +299,43 @@ TEST_CASE("TracerConfig::log_on_startup") {
   }
 }
 
+TEST_CASE("TracerConfig::async_logging") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("default is a synchronous logger") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(dynamic_cast<CerrLogger*>(finalized->logger.get()));
+  }
+
+  SECTION("true selects the asynchronous logger") {
+    config.async_logging = true;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(dynamic_cast<AsyncCerrLogger*>(finalized->logger.get()));
+  }
+
+  SECTION("no effect if a logger is specified") {
+    config.async_logging = true;
+    const auto logger = std::make_shared<MockLogger>();
+    config.logger = logger;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->logger == logger);
+  }
+
+  SECTION("overridden by DD_TRACE_ASYNC_LOGGING_ENABLED") {
+    config.async_logging = true;
+    const EnvGuard guard{"DD_TRACE_ASYNC_LOGGING_ENABLED", "false"};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(dynamic_cast<CerrLogger*>(finalized->logger.get()));
+  }
+}
+
 TEST_CASE("TracerConfig::report_traces") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
   const auto collector = std::make_shared<MockCollector>();
   config.collector = collector;
@@ -359,93 +401,740 @@ TEST_CASE("TracerConfig::report_traces") {
       REQUIRE(collector->chunks.size() == 0);
     }
   }
-}
+}
+
+TEST_CASE("TracerConfig::agent") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("event_scheduler") {
+    SECTION("default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(
+          dynamic_cast<ThreadedEventScheduler*>(agent->event_scheduler.get()));
+    }
+
+    SECTION("custom") {
+      auto scheduler = std::make_shared<MockEventScheduler>();
+      config.agent.event_scheduler = scheduler;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->event_scheduler == scheduler);
+    }
+
+    SECTION("reactor") {
+      config.agent.reactor = std::make_shared<ManualReactor>();
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(
+          dynamic_cast<ReactorEventScheduler*>(agent->event_scheduler.get()));
+    }
+  }
+
+  SECTION("flush interval") {
+    SECTION("cannot be zero") {
+      config.agent.flush_interval_milliseconds = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+    }
+
+    SECTION("cannot be negative") {
+      config.agent.flush_interval_milliseconds = -1337;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+    }
+  }
+
+  SECTION("remote configuration poll interval") {
+    SECTION("cannot be negative") {
+      config.agent.remote_configuration_poll_interval_seconds = -1337;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_REMOTE_CONFIG_POLL_INTERVAL);
+    }
+
+    SECTION("override default value") {
+      SECTION("programmatically") {
+        config.agent.remote_configuration_poll_interval_seconds = 42;
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->remote_configuration_poll_interval ==
+                std::chrono::seconds(42));
+      }
+
+      SECTION("environment variable") {
+        const EnvGuard env_guard{"DD_REMOTE_CONFIG_POLL_INTERVAL_SECONDS",
+                                 "15"};
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->remote_configuration_poll_interval ==
+                std::chrono::seconds(15));
+      }
+
+      SECTION("ill-formated environment variable is an error") {
+        const EnvGuard env_guard{"DD_REMOTE_CONFIG_POLL_INTERVAL_SECONDS",
+                                 "ddog"};
+        auto finalized = finalize_config(config);
+        REQUIRE(!finalized);
+        REQUIRE(finalized.error().code == Error::INVALID_DOUBLE);
+      }
+    }
+
+    SECTION("maximum") {
+      SECTION("defaults to the poll interval") {
+        config.agent.remote_configuration_poll_interval_seconds = 3;
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->remote_configuration_max_poll_interval ==
+                std::chrono::seconds(3));
+      }
+
+      SECTION("overridden by DD_REMOTE_CONFIG_MAX_POLL_INTERVAL_SECONDS") {
+        config.agent.remote_configuration_max_poll_interval_seconds = 30;
+        const EnvGuard env_guard{"DD_REMOTE_CONFIG_MAX_POLL_INTERVAL_SECONDS",
+                                 "60"};
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->remote_configuration_max_poll_interval ==
+                std::chrono::seconds(60));
+      }
+
+      SECTION("cannot be less than the poll interval") {
+        config.agent.remote_configuration_poll_interval_seconds = 10;
+        config.agent.remote_configuration_max_poll_interval_seconds = 5;
+        auto finalized = finalize_config(config);
+        REQUIRE(!finalized);
+        REQUIRE(finalized.error().code ==
+                Error::DATADOG_AGENT_INVALID_REMOTE_CONFIG_POLL_INTERVAL);
+      }
+    }
+  }
+
+  SECTION("trace API version") {
+    SECTION("defaults to v0.4") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->trace_api_version == TraceAPIVersion::V0_4);
+    }
+
+    SECTION("programmatically") {
+      auto [name, expected] = GENERATE(table<std::string, TraceAPIVersion>(
+          {{"v0.5", TraceAPIVersion::V0_5}, {"v0.7", TraceAPIVersion::V0_7}}));
+      config.agent.trace_api_version = name;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->trace_api_version == expected);
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.trace_api_version = "v0.5";
+      const EnvGuard env_guard{"DD_TRACE_API_VERSION", "v0.4"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->trace_api_version == TraceAPIVersion::V0_4);
+    }
+
+    SECTION("unsupported version is an error") {
+      config.agent.trace_api_version = GENERATE("v0.3", "v0.6", "0.5", "");
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_TRACE_API_VERSION);
+    }
+  }
+
+  SECTION("buffer") {
+    SECTION("defaults to 25 MiB, no span limit, and dropping the newest") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->max_buffered_bytes == 25 * 1024 * 1024);
+      REQUIRE(!agent->max_buffered_spans);
+      REQUIRE(agent->buffer_overflow_policy ==
+              BufferOverflowPolicy::DROP_NEWEST);
+    }
+
+    SECTION("programmatically") {
+      config.agent.max_buffered_bytes = 1000;
+      config.agent.max_buffered_spans = 10;
+      config.agent.buffer_overflow_policy = "drop_unsampled_first";
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->max_buffered_bytes == 1000);
+      REQUIRE(agent->max_buffered_spans == std::size_t(10));
+      REQUIRE(agent->buffer_overflow_policy ==
+              BufferOverflowPolicy::DROP_UNSAMPLED_FIRST);
+    }
+
+    SECTION("environment variables override programmatic values") {
+      config.agent.max_buffered_bytes = 1000;
+      config.agent.max_buffered_spans = 10;
+      config.agent.buffer_overflow_policy = "drop_unsampled_first";
+      const EnvGuard bytes_guard{"DD_TRACE_WRITER_BUFFER_SIZE_BYTES", "2000"};
+      const EnvGuard spans_guard{"DD_TRACE_WRITER_BUFFER_SIZE_SPANS", "20"};
+      const EnvGuard policy_guard{"DD_TRACE_WRITER_BUFFER_OVERFLOW_POLICY",
+                                  "drop_oldest"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->max_buffered_bytes == 2000);
+      REQUIRE(agent->max_buffered_spans == std::size_t(20));
+      REQUIRE(agent->buffer_overflow_policy ==
+              BufferOverflowPolicy::DROP_OLDEST);
+    }
+
+    SECTION("zero bytes is an error") {
+      config.agent.max_buffered_bytes = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_MAX_BUFFERED_BYTES);
+    }
+
+    SECTION("zero spans is an error") {
+      config.agent.max_buffered_spans = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_MAX_BUFFERED_SPANS);
+    }
+
+    SECTION("non-integer environment variable is an error") {
+      const EnvGuard guard{"DD_TRACE_WRITER_BUFFER_SIZE_BYTES", "lots"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+
+    SECTION("unsupported overflow policy is an error") {
+      config.agent.buffer_overflow_policy =
+          GENERATE("drop_all", "DROP_NEWEST", "");
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_BUFFER_OVERFLOW_POLICY);
+    }
+  }
+
+  SECTION("flush threshold and maximum payload size") {
+    SECTION("default to 4 MiB and 8 MiB") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->flush_threshold_bytes == 4 * 1024 * 1024);
+      REQUIRE(agent->max_payload_bytes == 8 * 1024 * 1024);
+    }
+
+    SECTION("environment variables override programmatic values") {
+      config.agent.flush_threshold_bytes = 100;
+      config.agent.max_payload_bytes = 200;
+      const EnvGuard threshold_guard{"DD_TRACE_WRITER_FLUSH_THRESHOLD_BYTES",
+                                     "300"};
+      const EnvGuard payload_guard{"DD_TRACE_WRITER_MAX_PAYLOAD_SIZE_BYTES",
+                                   "400"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->flush_threshold_bytes == 300);
+      REQUIRE(agent->max_payload_bytes == 400);
+    }
+
+    SECTION("zero flush threshold is an error") {
+      config.agent.flush_threshold_bytes = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_FLUSH_THRESHOLD);
+    }
+
+    SECTION("zero maximum payload size is an error") {
+      config.agent.max_payload_bytes = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_MAX_PAYLOAD_SIZE);
+    }
+  }
+
+  SECTION("compression") {
+    SECTION("is disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->compression_enabled);
+      REQUIRE(agent->compression_threshold_bytes == 8 * 1024);
+    }
+
+    SECTION("requires zlib") {
+      const EnvGuard guard{"DD_TRACE_WRITER_COMPRESSION_ENABLED", "true"};
+      auto finalized = finalize_config(config);
+      if (gzip_available()) {
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->compression_enabled);
+      } else {
+        REQUIRE(!finalized);
+        REQUIRE(finalized.error().code ==
+                Error::DATADOG_AGENT_COMPRESSION_UNAVAILABLE);
+      }
+    }
+
+    SECTION("threshold environment variable overrides programmatic value") {
+      config.agent.compression_threshold_bytes = 100;
+      const EnvGuard guard{"DD_TRACE_WRITER_COMPRESSION_THRESHOLD_BYTES",
+                           "200"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->compression_threshold_bytes == 200);
+    }
+  }
+
+  SECTION("stats computation") {
+    SECTION("is disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->stats_computation_enabled);
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.stats_computation_enabled = false;
+      const EnvGuard guard{"DD_TRACE_STATS_COMPUTATION_ENABLED", "true"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->stats_computation_enabled);
+    }
+  }
+
+  SECTION("HTTP/2") {
+    SECTION("is disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->http2_enabled);
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.http2_enabled = true;
+      const EnvGuard guard{"DD_TRACE_AGENT_HTTP2_ENABLED", "false"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->http2_enabled);
+    }
+  }
+
+  SECTION("shared runtime") {
+    SECTION("is disabled by default") {
+      auto first = finalize_config(config);
+      auto second = finalize_config(config);
+      REQUIRE(first);
+      REQUIRE(second);
+      const auto* const first_agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&first->collector);
+      const auto* const second_agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&second->collector);
+      REQUIRE(first_agent);
+      REQUIRE(second_agent);
+      REQUIRE(!first_agent->shared_runtime_enabled);
+      REQUIRE(first_agent->event_scheduler != second_agent->event_scheduler);
+      REQUIRE(first_agent->http_client != second_agent->http_client);
+    }
+
+    SECTION("shares the default scheduler and HTTP client") {
+      const EnvGuard guard{"DD_TRACE_SHARED_RUNTIME_ENABLED", "true"};
+      auto first = finalize_config(config);
+      auto second = finalize_config(config);
+      REQUIRE(first);
+      REQUIRE(second);
+      const auto* const first_agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&first->collector);
+      const auto* const second_agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&second->collector);
+      REQUIRE(first_agent);
+      REQUIRE(second_agent);
+      REQUIRE(first_agent->shared_runtime_enabled);
+      REQUIRE(dynamic_cast<ThreadedEventScheduler*>(
+          first_agent->event_scheduler.get()));
+      REQUIRE(first_agent->event_scheduler == second_agent->event_scheduler);
+      REQUIRE(first_agent->http_client == second_agent->http_client);
+    }
+
+    SECTION("does not replace a custom scheduler") {
+      config.agent.shared_runtime_enabled = true;
+      auto scheduler = std::make_shared<MockEventScheduler>();
+      config.agent.event_scheduler = scheduler;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->event_scheduler == scheduler);
+    }
+  }
+
+  SECTION("lazy start") {
+    SECTION("is disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->lazy_start);
+      REQUIRE(!dynamic_cast<LazyHTTPClient*>(agent->http_client.get()));
+    }
+
+    SECTION("defers creating the default HTTP client") {
+      config.agent.lazy_start = true;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->lazy_start);
+      const auto* const client =
+          dynamic_cast<LazyHTTPClient*>(agent->http_client.get());
+      REQUIRE(client);
+      REQUIRE(!client->started());
+    }
+
+    SECTION("does not replace a custom HTTP client") {
+      config.agent.lazy_start = true;
+      auto client = std::make_shared<MockHTTPClient>();
+      config.agent.http_client = client;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->http_client == client);
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.lazy_start = true;
+      const EnvGuard guard{"DD_TRACE_AGENT_LAZY_START_ENABLED", "false"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->lazy_start);
+    }
+  }
+
+  SECTION("idle mode") {
+    SECTION("is disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->idle_mode_enabled);
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.idle_mode_enabled = false;
+      const EnvGuard guard{"DD_TRACE_AGENT_IDLE_MODE_ENABLED", "true"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->idle_mode_enabled);
+    }
+  }
+
+  SECTION("adaptive flush") {
+    SECTION("is disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->adaptive_flush_enabled);
+      REQUIRE(agent->min_flush_interval == std::chrono::milliseconds(100));
+      REQUIRE(agent->max_flush_interval == std::chrono::seconds(10));
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.adaptive_flush_enabled = false;
+      const EnvGuard guard{"DD_TRACE_AGENT_ADAPTIVE_FLUSH_ENABLED", "true"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->adaptive_flush_enabled);
+    }
+
+    SECTION("minimum interval must be positive") {
+      config.agent.min_flush_interval_milliseconds = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+    }
+
+    SECTION("maximum interval cannot be less than the minimum") {
+      config.agent.min_flush_interval_milliseconds = 500;
+      config.agent.max_flush_interval_milliseconds = 499;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+    }
+  }
+
+  SECTION("state file") {
+    SECTION("is absent by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->state_file.empty());
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.state_file = "/tmp/programmatic.json";
+      const EnvGuard guard{"DD_TRACE_AGENT_STATE_FILE", "/tmp/env.json"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->state_file == "/tmp/env.json");
+    }
+  }
+
+  SECTION("health metrics") {
+    SECTION("are disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->health_metrics_enabled);
+      REQUIRE(agent->dogstatsd_url == "udp://localhost:8125");
+      REQUIRE(agent->health_metrics_interval == std::chrono::seconds(10));
+    }
+
+    SECTION("environment variables override programmatic values") {
+      config.agent.health_metrics_enabled = false;
+      config.agent.dogstatsd_url = "udp://statsd:8125";
+      const EnvGuard enabled_guard{"DD_TRACE_HEALTH_METRICS_ENABLED", "true"};
+      const EnvGuard url_guard{"DD_DOGSTATSD_URL", "unix:///var/run/dsd"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->health_metrics_enabled);
+      REQUIRE(agent->dogstatsd_url == "unix:///var/run/dsd");
+    }
+
+    SECTION("interval must be positive") {
+      config.agent.health_metrics_interval_seconds = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_HEALTH_METRICS_INTERVAL);
+    }
+  }
+
+  SECTION("memory trim interval") {
+    SECTION("defaults to a minute") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->memory_trim_interval == std::chrono::seconds(60));
+    }
+
+    SECTION("zero disables trimming") {
+      config.agent.memory_trim_interval_seconds = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->memory_trim_interval ==
+              std::chrono::steady_clock::duration::zero());
+    }
+
+    SECTION("must not be negative") {
+      config.agent.memory_trim_interval_seconds = -1;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_MEMORY_TRIM_INTERVAL);
+    }
+  }
+
+  SECTION("scheduler workers") {
+    SECTION("default to zero") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->scheduler_workers == 0);
+    }
+
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.scheduler_workers = 1;
+      const EnvGuard guard{"DD_TRACE_SCHEDULER_WORKERS", "3"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->scheduler_workers == 3);
+    }
+
+    SECTION("environment variable must be a number") {
+      const EnvGuard guard{"DD_TRACE_SCHEDULER_WORKERS", "many"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+  }
 
-TEST_CASE("TracerConfig::agent") {
-  TracerConfig config;
-  config.service = "testsvc";
-
-  SECTION("event_scheduler") {
-    SECTION("default") {
+  SECTION("maximum retries") {
+    SECTION("defaults to 3") {
       auto finalized = finalize_config(config);
       REQUIRE(finalized);
       const auto* const agent =
           std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
       REQUIRE(agent);
-      REQUIRE(
-          dynamic_cast<ThreadedEventScheduler*>(agent->event_scheduler.get()));
+      REQUIRE(agent->max_retries == 3);
     }
 
-    SECTION("custom") {
-      auto scheduler = std::make_shared<MockEventScheduler>();
-      config.agent.event_scheduler = scheduler;
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.max_retries = 5;
+      const EnvGuard guard{"DD_TRACE_WRITER_MAX_RETRIES", "0"};
       auto finalized = finalize_config(config);
       REQUIRE(finalized);
       const auto* const agent =
           std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
       REQUIRE(agent);
-      REQUIRE(agent->event_scheduler == scheduler);
+      REQUIRE(agent->max_retries == 0);
     }
   }
 
-  SECTION("flush interval") {
-    SECTION("cannot be zero") {
-      config.agent.flush_interval_milliseconds = 0;
+  SECTION("circuit breaker threshold") {
+    SECTION("defaults to 5") {
       auto finalized = finalize_config(config);
-      REQUIRE(!finalized);
-      REQUIRE(finalized.error().code ==
-              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->circuit_breaker_threshold == 5);
     }
 
-    SECTION("cannot be negative") {
-      config.agent.flush_interval_milliseconds = -1337;
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.circuit_breaker_threshold = 10;
+      const EnvGuard guard{"DD_TRACE_WRITER_CIRCUIT_BREAKER_THRESHOLD", "0"};
       auto finalized = finalize_config(config);
-      REQUIRE(!finalized);
-      REQUIRE(finalized.error().code ==
-              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->circuit_breaker_threshold == 0);
     }
   }
 
-  SECTION("remote configuration poll interval") {
-    SECTION("cannot be negative") {
-      config.agent.remote_configuration_poll_interval_seconds = -1337;
+  SECTION("maximum in-flight requests") {
+    SECTION("defaults to 4") {
       auto finalized = finalize_config(config);
-      REQUIRE(!finalized);
-      REQUIRE(finalized.error().code ==
-              Error::DATADOG_AGENT_INVALID_REMOTE_CONFIG_POLL_INTERVAL);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->max_in_flight_requests == 4);
     }
 
-    SECTION("override default value") {
-      SECTION("programmatically") {
-        config.agent.remote_configuration_poll_interval_seconds = 42;
-        auto finalized = finalize_config(config);
-        REQUIRE(finalized);
-        const auto* const agent =
-            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
-        REQUIRE(agent);
-        REQUIRE(agent->remote_configuration_poll_interval ==
-                std::chrono::seconds(42));
-      }
-
-      SECTION("environment variable") {
-        const EnvGuard env_guard{"DD_REMOTE_CONFIG_POLL_INTERVAL_SECONDS",
-                                 "15"};
-        auto finalized = finalize_config(config);
-        REQUIRE(finalized);
-        const auto* const agent =
-            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
-        REQUIRE(agent);
-        REQUIRE(agent->remote_configuration_poll_interval ==
-                std::chrono::seconds(15));
-      }
+    SECTION("environment variable overrides programmatic value") {
+      config.agent.max_in_flight_requests = 2;
+      const EnvGuard guard{"DD_TRACE_WRITER_MAX_IN_FLIGHT_REQUESTS", "8"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->max_in_flight_requests == 8);
+    }
 
-      SECTION("ill-formated environment variable is an error") {
-        const EnvGuard env_guard{"DD_REMOTE_CONFIG_POLL_INTERVAL_SECONDS",
-                                 "ddog"};
-        auto finalized = finalize_config(config);
-        REQUIRE(!finalized);
-        REQUIRE(finalized.error().code == Error::INVALID_DOUBLE);
-      }
+    SECTION("zero is an error") {
+      config.agent.max_in_flight_requests = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_MAX_IN_FLIGHT_REQUESTS);
     }
   }
 
@@ -550,7 +1239,7 @@ TEST_CASE("TracerConfig::agent") {
 }
 
 TEST_CASE("TracerConfig::trace_sampler") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
 
   SECTION("default is no rules") {
@@ -689,6 +1378,41 @@ TEST_CASE("TracerConfig::trace_sampler") {
     }
   }
 
+  SECTION("adaptive_target_per_second") {
+    SECTION("is unset by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(!finalized->trace_sampler.adaptive_target_per_second);
+    }
+
+    SECTION("must be >0 and a finite number") {
+      auto target = GENERATE(0.0, -1.0, std::nan(""),
+                             std::numeric_limits<double>::infinity());
+
+      CAPTURE(target);
+      config.trace_sampler.adaptive_target_per_second = target;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::ADAPTIVE_SAMPLING_TARGET_OUT_OF_RANGE);
+    }
+
+    SECTION("is overridden by DD_TRACE_ADAPTIVE_SAMPLING_TARGET") {
+      config.trace_sampler.adaptive_target_per_second = 10;
+      const EnvGuard guard{"DD_TRACE_ADAPTIVE_SAMPLING_TARGET", "250"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->trace_sampler.adaptive_target_per_second == 250);
+    }
+
+    SECTION("DD_TRACE_ADAPTIVE_SAMPLING_TARGET must be a number") {
+      const EnvGuard guard{"DD_TRACE_ADAPTIVE_SAMPLING_TARGET", "lots"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_DOUBLE);
+    }
+  }
+
   SECTION("DD_TRACE_RATE_LIMIT") {
     SECTION("overrides SpanSamplerConfig::max_per_second") {
       const EnvGuard guard{"DD_TRACE_RATE_LIMIT", "120"};
@@ -804,6 +1528,12 @@ TEST_CASE("TracerConfig::trace_sampler") {
            Error::RULE_WRONG_TYPE},
           {"sample_rate must be a number", R"json([{"sample_rate": true}])json",
            Error::TRACE_SAMPLING_RULES_SAMPLE_RATE_WRONG_TYPE},
+          {"max_per_second must be a number (or absent)",
+           R"json([{"max_per_second": false}])json",
+           Error::TRACE_SAMPLING_RULES_MAX_PER_SECOND_WRONG_TYPE},
+          {"max_per_second must be positive",
+           R"json([{"max_per_second": 0}])json",
+           Error::MAX_PER_SECOND_OUT_OF_RANGE},
           {"no unknown properties", R"json([{"extension": "denied!"}])json",
            Error::TRACE_SAMPLING_RULES_UNKNOWN_PROPERTY},
       }));
@@ -819,7 +1549,7 @@ TEST_CASE("TracerConfig::trace_sampler") {
 }
 
 TEST_CASE("TracerConfig::span_sampler") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
 
   SECTION("default is no rules") {
@@ -1053,7 +1783,7 @@ TEST_CASE("TracerConfig::span_sampler") {
 }
 
 TEST_CASE("TracerConfig propagation styles") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
 
   SECTION("default style is [Datadog, W3C]") {
@@ -1275,7 +2005,7 @@ TEST_CASE("TracerConfig propagation styles") {
 }
 
 TEST_CASE("configure 128-bit trace IDs") {
-  TracerConfig config;
+  TracerConfig config{};
   config.service = "testsvc";
 
   SECTION("defaults to true") {
@@ -1328,3 +2058,291 @@ TEST_CASE("configure 128-bit trace IDs") {
     REQUIRE(finalized->generate_128bit_trace_ids == test_case.expected_value);
   }
 }
+
+TEST_CASE("configure partial flush") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("disabled by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->partial_flush_enabled == false);
+    REQUIRE(finalized->partial_flush_min_spans == 500);
+  }
+
+  SECTION("values honored in finalizer") {
+    config.partial_flush_enabled = true;
+    config.partial_flush_min_spans = 10;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->partial_flush_enabled == true);
+    REQUIRE(finalized->partial_flush_min_spans == 10);
+  }
+
+  SECTION("values overridden by environment variables") {
+    EnvGuard enabled_guard{"DD_TRACE_PARTIAL_FLUSH_ENABLED", "true"};
+    EnvGuard min_spans_guard{"DD_TRACE_PARTIAL_FLUSH_MIN_SPANS", "42"};
+    config.partial_flush_enabled = false;
+    config.partial_flush_min_spans = 10;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->partial_flush_enabled == true);
+    REQUIRE(finalized->partial_flush_min_spans == 42);
+  }
+
+  SECTION("minimum number of spans must be positive") {
+    config.partial_flush_min_spans = 0;
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_PARTIAL_FLUSH_MIN_SPANS);
+  }
+
+  SECTION("invalid DD_TRACE_PARTIAL_FLUSH_MIN_SPANS") {
+    EnvGuard guard{"DD_TRACE_PARTIAL_FLUSH_MIN_SPANS", "lots"};
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+  }
+}
+
+TEST_CASE("configure tag value length limits") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("no limits by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->max_tag_value_length == 0);
+    REQUIRE(finalized->tag_value_length_limits.empty());
+  }
+
+  SECTION("values overridden by environment variables") {
+    EnvGuard max_guard{"DD_TRACE_TAG_VALUE_MAX_LENGTH", "1024"};
+    EnvGuard limits_guard{"DD_TRACE_TAG_VALUE_LENGTH_LIMITS",
+                          "db.statement:4096, http.url:0"};
+    config.max_tag_value_length = 10;
+    config.tag_value_length_limits =
+        std::unordered_map<std::string, std::size_t>{{"other", 1}};
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->max_tag_value_length == 1024);
+    const std::unordered_map<std::string, std::size_t> expected{
+        {"db.statement", 4096}, {"http.url", 0}};
+    REQUIRE(finalized->tag_value_length_limits == expected);
+  }
+
+  SECTION("invalid DD_TRACE_TAG_VALUE_MAX_LENGTH") {
+    EnvGuard guard{"DD_TRACE_TAG_VALUE_MAX_LENGTH", "long"};
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+  }
+
+  SECTION("invalid DD_TRACE_TAG_VALUE_LENGTH_LIMITS") {
+    EnvGuard guard{"DD_TRACE_TAG_VALUE_LENGTH_LIMITS", "db.statement:long"};
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+  }
+}
+
+TEST_CASE("configure span limit") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("no limit by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->max_spans_per_trace == 0);
+  }
+
+  SECTION("value overridden by environment variable") {
+    EnvGuard guard{"DD_TRACE_MAX_SPANS_PER_TRACE", "1000"};
+    config.max_spans_per_trace = 10;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->max_spans_per_trace == 1000);
+  }
+
+  SECTION("invalid DD_TRACE_MAX_SPANS_PER_TRACE") {
+    EnvGuard guard{"DD_TRACE_MAX_SPANS_PER_TRACE", "lots"};
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+  }
+}
+
+TEST_CASE("configure memory budget") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("no budget by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->memory_budget == 0);
+  }
+
+  SECTION("value overridden by environment variable") {
+    EnvGuard guard{"DD_TRACE_MEMORY_BUDGET_BYTES", "67108864"};
+    config.memory_budget = 1024;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->memory_budget == 67108864);
+  }
+
+  SECTION("invalid DD_TRACE_MEMORY_BUDGET_BYTES") {
+    EnvGuard guard{"DD_TRACE_MEMORY_BUDGET_BYTES", "lots"};
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+  }
+}
+
+TEST_CASE("configure background finalization") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("disabled by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->background_finalization == false);
+  }
+
+  SECTION("value honored in finalizer") {
+    config.background_finalization = true;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->background_finalization == true);
+  }
+
+  SECTION("value overridden by DD_TRACE_BACKGROUND_FINALIZATION_ENABLED") {
+    EnvGuard guard{"DD_TRACE_BACKGROUND_FINALIZATION_ENABLED", "false"};
+    config.background_finalization = true;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->background_finalization == false);
+  }
+}
+
+TEST_CASE("configure parallel finalization") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("disabled by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->parallel_finalization_min_spans == 0);
+    REQUIRE(finalized->parallel_finalization_threads >= 1);
+    REQUIRE(finalized->parallel_finalization_threads <= 4);
+  }
+
+  SECTION("values honored in finalizer") {
+    config.parallel_finalization_min_spans = 10000;
+    config.parallel_finalization_threads = 8;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->parallel_finalization_min_spans == 10000);
+    REQUIRE(finalized->parallel_finalization_threads == 8);
+  }
+
+  SECTION("value overridden by DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS") {
+    EnvGuard guard{"DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS", "5000"};
+    config.parallel_finalization_min_spans = 10000;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->parallel_finalization_min_spans == 5000);
+  }
+
+  SECTION("invalid DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS") {
+    EnvGuard guard{"DD_TRACE_PARALLEL_FINALIZATION_MIN_SPANS", "many"};
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+  }
+
+  SECTION("number of threads must be positive") {
+    config.parallel_finalization_threads = 0;
+    const auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::INVALID_PARALLEL_FINALIZATION_THREADS);
+  }
+}
+
+TEST_CASE("configure early sampling decision") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("disabled by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->early_sampling_decision == false);
+  }
+
+  SECTION("value honored in finalizer") {
+    config.early_sampling_decision = true;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->early_sampling_decision == true);
+  }
+
+  SECTION("value overridden by DD_TRACE_EARLY_SAMPLING_DECISION_ENABLED") {
+    EnvGuard guard{"DD_TRACE_EARLY_SAMPLING_DECISION_ENABLED", "true"};
+    config.early_sampling_decision = false;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->early_sampling_decision == true);
+  }
+}
+
+TEST_CASE("configure single pass extraction") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("disabled by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->single_pass_extraction == false);
+  }
+
+  SECTION("value honored in finalizer") {
+    config.single_pass_extraction = true;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->single_pass_extraction == true);
+  }
+
+  SECTION("value overridden by DD_TRACE_SINGLE_PASS_EXTRACTION_ENABLED") {
+    EnvGuard guard{"DD_TRACE_SINGLE_PASS_EXTRACTION_ENABLED", "false"};
+    config.single_pass_extraction = true;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->single_pass_extraction == false);
+  }
+}
+
+TEST_CASE("configure stage timing") {
+  TracerConfig config{};
+  config.service = "testsvc";
+
+  SECTION("disabled by default") {
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->stage_timing == false);
+  }
+
+  SECTION("value honored in finalizer") {
+    config.stage_timing = true;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->stage_timing == true);
+  }
+
+  SECTION("value overridden by DD_TRACE_STAGE_TIMING_ENABLED") {
+    EnvGuard guard{"DD_TRACE_STAGE_TIMING_ENABLED", "false"};
+    config.stage_timing = true;
+    const auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->stage_timing == false);
+  }
+}
@@ -13,6 +13,7 @@
 #include "test.h"
 
 using namespace datadog::tracing;
+using namespace std::chrono_literals;
 
 namespace {
 bool is_valid_telemetry_payload(const nlohmann::json& json) {
@@ -204,6 +205,120 @@ TEST_CASE("Tracer telemetry", "[telemetry]") {
     REQUIRE(points[0][1] == 1);
   }
 
+  SECTION("keeps the most recent points when reports are delayed") {
+    auto& counter = tracer_telemetry.metrics().tracer.spans_created;
+    for (uint64_t i = 1; i <= 20; ++i) {
+      counter.add(i);
+      tracer_telemetry.capture_metrics();
+    }
+    auto message_batch =
+        nlohmann::json::parse(tracer_telemetry.heartbeat_and_telemetry());
+    REQUIRE(message_batch["payload"].size() == 2);
+    auto series = message_batch["payload"][1]["payload"]["series"];
+    REQUIRE(series.size() == 1);
+    auto points = series[0]["points"];
+    REQUIRE(points.size() == 12);
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      REQUIRE(points[i][1] == 9 + i);
+    }
+    REQUIRE(logger->error_count() == 1);
+    const auto& message = std::get<std::string>(logger->entries[0].payload);
+    REQUIRE(message.find(" 8 ") != std::string::npos);
+
+    // The overwritten points were reported once.
+    counter.inc();
+    tracer_telemetry.capture_metrics();
+    tracer_telemetry.heartbeat_and_telemetry();
+    REQUIRE(logger->error_count() == 1);
+  }
+
+  SECTION("reports the counters of counter families") {
+    const auto family = std::make_shared<datadog::telemetry::CounterFamily>(
+        "requests", "tracers", false);
+    TracerTelemetry with_family{true,
+                                clock,
+                                logger,
+                                tracer_signature,
+                                ignore,
+                                ignore,
+                                {},
+                                nullptr,
+                                0,
+                                {family}};
+    // A counter created after construction is reported too.
+    family->counter({"endpoint:/a"}).add(3);
+    family->counter({"endpoint:/b"}).inc();
+    with_family.capture_metrics();
+    auto message_batch =
+        nlohmann::json::parse(with_family.heartbeat_and_telemetry());
+    REQUIRE(message_batch["payload"].size() == 2);
+    auto series = message_batch["payload"][1]["payload"]["series"];
+    REQUIRE(series.size() == 2);
+    REQUIRE(series[0]["metric"] == "requests");
+    REQUIRE(series[0]["tags"] == nlohmann::json::array({"endpoint:/a"}));
+    REQUIRE(series[0]["points"][0][1] == 3);
+    REQUIRE(series[1]["tags"] == nlohmann::json::array({"endpoint:/b"}));
+    REQUIRE(series[1]["points"][0][1] == 1);
+  }
+
+  SECTION("poll captures metrics and reports heartbeats on its cadence") {
+    TracerTelemetry polled{true,
+                           clock,
+                           logger,
+                           tracer_signature,
+                           ignore,
+                           ignore,
+                           {},
+                           nullptr,
+                           0,
+                           {},
+                           TelemetryCadence{10s, 30s, true}};
+    auto& counter = polled.metrics().tracer.spans_created;
+    const auto start = std::chrono::steady_clock::time_point{} + 1h;
+    // The first poll captures, and starts the interval until a heartbeat.
+    counter.inc();
+    REQUIRE(!polled.poll(start));
+    REQUIRE(counter.value() == 0);
+    counter.inc();
+    REQUIRE(!polled.poll(start + 5s));
+    REQUIRE(counter.value() == 1);
+    REQUIRE(!polled.poll(start + 10s));
+    REQUIRE(counter.value() == 0);
+    // A heartbeat is due after the report interval, and metrics are captured
+    // just before it.
+    counter.inc();
+    REQUIRE(polled.poll(start + 30s));
+    REQUIRE(counter.value() == 0);
+    REQUIRE(!polled.poll(start + 31s));
+    REQUIRE(polled.poll(start + 60s));
+  }
+
+  SECTION("sends distributions payload") {
+    auto& trace_api = tracer_telemetry.metrics().trace_api;
+    trace_api.bytes.add(10);
+    trace_api.bytes.add(10);
+    trace_api.bytes.add(20);
+    auto heartbeat_and_telemetry_message =
+        tracer_telemetry.heartbeat_and_telemetry();
+    auto message_batch = nlohmann::json::parse(heartbeat_and_telemetry_message);
+    REQUIRE(is_valid_telemetry_payload(message_batch) == true);
+    REQUIRE(message_batch["payload"].size() == 2);
+    auto distributions = message_batch["payload"][1];
+    REQUIRE(distributions["request_type"] == "distributions");
+    auto series = distributions["payload"]["series"];
+    REQUIRE(series.size() == 1);
+    auto metric = series[0];
+    REQUIRE(metric["metric"] == "trace_api.bytes");
+    REQUIRE(metric["namespace"] == "tracers");
+    REQUIRE(metric["common"] == true);
+    REQUIRE(metric["points"] == nlohmann::json::array({10, 10, 20}));
+
+    // The values were reset, so the next heartbeat has no distributions.
+    message_batch =
+        nlohmann::json::parse(tracer_telemetry.heartbeat_and_telemetry());
+    REQUIRE(message_batch["payload"].size() == 1);
+  }
+
   SECTION("generates an app-closing event") {
     auto app_closing_message = tracer_telemetry.app_closing();
     auto message_batch = nlohmann::json::parse(app_closing_message);